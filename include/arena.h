@@ -0,0 +1,135 @@
+/**
+ * @file arena.h
+ * @brief Arena allocator
+ * @ingroup system
+ */
+#ifndef __LIBDRAGON_ARENA_H
+#define __LIBDRAGON_ARENA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup arena Arena allocator
+ * @ingroup system
+ * @brief Bump allocator with O(1) bulk deallocation
+ *
+ * An arena is a fixed block of memory from which allocations are carved
+ * sequentially ("bump allocation"). Individual allocations cannot be freed;
+ * instead, the whole arena is released at once with #arena_reset, which is
+ * a constant-time operation no matter how many allocations were made.
+ *
+ * This is the natural allocation scheme for objects that share a lifetime,
+ * such as everything loaded for one game level: allocate from the arena
+ * during loading, and reset the arena on teardown, instead of tracking (and
+ * walking) thousands of individual malloc/free pairs on the main heap. It
+ * also keeps such transient allocations from fragmenting the main heap.
+ *
+ * The backing memory can either be malloc'd (#arena_create) -- note that on
+ * consoles with the Expansion Pak the heap extends over the full 8 MB of
+ * RDRAM, so a large arena is a convenient way to put the extra memory to
+ * work -- or supplied by the caller (#arena_create_buf) to place the arena
+ * at a specific address.
+ *
+ * Allocations are aligned to 16 bytes (the data cache line size), so any
+ * allocation can be safely used as a DMA target after cache invalidation.
+ *
+ * @{
+ */
+
+/**
+ * @brief An arena allocator
+ *
+ * Initialize with #arena_create or #arena_create_buf.
+ */
+typedef struct
+{
+    /** @brief Start of the backing memory block */
+    uint8_t *base;
+    /** @brief Next free byte */
+    uint8_t *cur;
+    /** @brief First byte past the backing memory block */
+    uint8_t *top;
+    /** @brief True if the backing memory is owned (malloc'd) by the arena */
+    bool owned;
+} arena_t;
+
+/** @} */
+
+/**
+ * @brief Initialize an arena with malloc'd backing memory
+ *
+ * @param[out] arena
+ *             Arena to initialize
+ * @param[in]  size
+ *             Size of the arena in bytes
+ *
+ * @return true on success, false if the backing memory could not be allocated
+ */
+bool arena_create(arena_t *arena, int size);
+
+/**
+ * @brief Initialize an arena over a caller-provided block of memory
+ *
+ * @param[out] arena
+ *             Arena to initialize
+ * @param[in]  buf
+ *             Backing memory (must be 16-byte aligned)
+ * @param[in]  size
+ *             Size of the backing memory in bytes
+ */
+void arena_create_buf(arena_t *arena, void *buf, int size);
+
+/**
+ * @brief Release an arena and (if owned) its backing memory
+ *
+ * @param[in] arena
+ *            Arena to destroy
+ */
+void arena_destroy(arena_t *arena);
+
+/**
+ * @brief Allocate memory from an arena
+ *
+ * The returned memory is 16-byte aligned and uninitialized. It stays valid
+ * until the arena is reset or destroyed; it cannot be freed individually.
+ *
+ * @param[in] arena
+ *            Arena to allocate from
+ * @param[in] size
+ *            Number of bytes to allocate
+ *
+ * @return The allocated memory, or NULL if the arena is full
+ */
+void *arena_alloc(arena_t *arena, int size);
+
+/**
+ * @brief Free all allocations of an arena at once
+ *
+ * Constant-time operation: the arena is simply rewound to empty. All
+ * pointers previously returned by #arena_alloc become invalid.
+ *
+ * @param[in] arena
+ *            Arena to reset
+ */
+void arena_reset(arena_t *arena);
+
+/**
+ * @brief Return the number of bytes still available in an arena
+ *
+ * @param[in] arena
+ *            Arena to query
+ *
+ * @return Number of bytes that can still be allocated
+ */
+int arena_avail(arena_t *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
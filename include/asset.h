@@ -47,7 +47,7 @@
  * 
  * To compress your own data files, you can use the mkasset tool.
  * 
- * There are currently two compression levels:
+ * There are currently three compression levels:
  * 
  * * Level 1: this is based on LZ4 by Yann Collet. It is extremely fast and
  *   produce reasonable compression ratios. It is so fast at decompression
@@ -59,10 +59,14 @@
  *   been measured to beat gzip/zlib for small files like those typically used
  *   on N64. Level 2 should be selected if there is a necessity to squeeze data
  *   at the maximum ratio, at the expense of loading speed.
- * 
+ * * Level 3: this is LZE, a custom LZ77 + static Huffman codec. It compresses
+ *   better than LZ4 (usually close to LZH5), while decompressing much faster
+ *   than LZH5 thanks to a table-driven entropy decoder. It is a good choice
+ *   for "cold" assets that are loaded rarely but should not waste ROM space.
+ *
  * To minimize text siz and RAM usage, only the decompression code for level 1
- * is compiled by default. If you need to use level 2, you must call
- * #asset_init_compression(2).
+ * is compiled by default. If you need to use level 2 or 3, you must call
+ * #asset_init_compression(2) (or 3).
  */
 
 #include <stdio.h>
@@ -77,6 +81,8 @@ extern "C" {
 
 /// @private
 extern void __asset_init_compression_lvl2(void);
+/// @private
+extern void __asset_init_compression_lvl3(void);
 
 /**
  * @brief Enable a non-default compression level
@@ -85,8 +91,8 @@ extern void __asset_init_compression_lvl2(void);
  * a non-default compression level. The default compression level is 1,
  * for which no initialization is required.
  * 
- * Currently, only level 2 requires initialization. If you have any assets
- * compressed with level 2, you must call this function before loading them.
+ * Currently, levels 2 and 3 require initialization. If you have any assets
+ * compressed with those levels, you must call this function before loading them.
  * 
  * @code{.c}
  *      asset_init_compression(2); 
@@ -104,10 +110,28 @@ extern void __asset_init_compression_lvl2(void);
     switch (level) { \
     case 1: break; \
     case 2: __asset_init_compression_lvl2(); break; \
+    case 3: __asset_init_compression_lvl3(); break; \
     default: assertf(0, "Unsupported compression level: %d", level); \
     } \
 })
 
+/**
+ * @brief Offload LZ4 asset decompression to the RSP
+ *
+ * After this call, blocked LZ4 assets (created with "mkasset -b") are
+ * decompressed by an RSP overlay instead of the CPU: while the RSP
+ * decodes one block, the PI DMA reads the next compressed block, so
+ * scene loads become genuinely background work and the CPU is free to
+ * build the scene in the meantime.
+ *
+ * This initializes the RSP command queue (#rspq_init) if needed, and
+ * registers an overlay; don't call it if the RSP queue DMEM budget is
+ * needed for something else. Assets that cannot go through the RSP
+ * (non-blocked files, other compression levels) silently keep using
+ * the CPU decoders, so this is always safe to enable.
+ */
+void asset_init_rsp_decompression(void);
+
 /**
  * @brief Load an asset file (possibly uncompressing it)
  * 
@@ -121,6 +145,133 @@ extern void __asset_init_compression_lvl2(void);
  */
 void *asset_load(const char *fn, int *sz);
 
+/**
+ * @brief Initialize the opt-in asset cache
+ *
+ * The asset cache keeps recently loaded ROM assets resident in RDRAM
+ * within the given budget, so that reloading them via #asset_cache_load
+ * (eg: across scene transitions) skips the PI transfer and decompression.
+ * Entries are keyed by the ROM address of the file and evicted in LRU
+ * order when room is needed; entries still held by a caller are never
+ * evicted.
+ *
+ * @param max_bytes     RDRAM budget for cached contents, in bytes
+ */
+void asset_cache_init(int max_bytes);
+
+/**
+ * @brief Tear down the asset cache, freeing all cached contents
+ *
+ * All buffers obtained from #asset_cache_load must have been released
+ * with #asset_cache_release before calling this.
+ */
+void asset_cache_close(void);
+
+/**
+ * @brief Load an asset file through the cache
+ *
+ * Like #asset_load, but if the same ROM file was loaded recently and is
+ * still cached, the cached buffer is returned immediately. The returned
+ * buffer may be shared with other holders, so treat it as read-only, and
+ * release it with #asset_cache_release (not free()) when done; the
+ * contents then stay cached for future loads until evicted.
+ *
+ * Files not on the ROM filesystem cannot be keyed by ROM address and are
+ * loaded normally, as are files that do not fit the configured budget.
+ * If the cache is not initialized, this is exactly #asset_load.
+ *
+ * @param fn        Filename to load (including filesystem prefix, eg: "rom:/foo.dat")
+ * @param sz        If not NULL, this will be filed with the uncompressed size of the loaded file
+ * @return void*    Pointer to the loaded file (release with #asset_cache_release)
+ */
+void *asset_cache_load(const char *fn, int *sz);
+
+/**
+ * @brief Release a buffer obtained from #asset_cache_load
+ *
+ * Cached buffers are refcounted: releasing does not free the contents,
+ * it only makes the entry eligible for LRU eviction once no holders
+ * remain. Buffers that were not cached are freed immediately.
+ *
+ * @param ptr       Buffer returned by #asset_cache_load
+ */
+void asset_cache_release(void *ptr);
+
+/**
+ * @brief Read the asset cache statistics
+ *
+ * @param hits      If not NULL, filled with the number of loads served from the cache
+ * @param misses    If not NULL, filled with the number of loads that went to the filesystem
+ * @param used      If not NULL, filled with the number of bytes currently cached
+ */
+void asset_cache_stats(int *hits, int *misses, int *used);
+
+/**
+ * @brief Register the shared dictionary for dictionary-compressed assets
+ *
+ * Assets compressed with "mkasset --dict" reference a shared dictionary
+ * trained on the asset corpus (mkasset --train-dict), which improves the
+ * compression ratio of many small, similar files. Before loading such
+ * assets, the application must load the dictionary file and register it
+ * with this function; the buffer must stay valid (and unmodified) for as
+ * long as dictionary-compressed assets are being loaded.
+ *
+ * @code{.c}
+ *      int dict_size;
+ *      void *dict = asset_load("rom:/assets.dict", &dict_size);
+ *      asset_set_dict(dict, dict_size);
+ * @endcode
+ *
+ * Dictionary-compressed assets can only be loaded whole with #asset_load
+ * (no #asset_fopen streaming, no #asset_load_range).
+ *
+ * @param dict      Pointer to the dictionary contents
+ * @param size      Size of the dictionary in bytes
+ */
+void asset_set_dict(const void *dict, int size);
+
+/**
+ * @brief A range of an asset file, for use with #asset_load_ranges
+ */
+typedef struct {
+    int offset;         ///< Byte offset in the (uncompressed) file contents
+    int size;           ///< Number of bytes to load
+    void *ptr;          ///< Destination buffer (caller allocated, at least size bytes)
+} asset_range_t;
+
+/**
+ * @brief Load a portion of an asset file (possibly uncompressing it)
+ *
+ * This function loads only the requested byte range of a file, which is
+ * useful for large archives packing many independent chunks. For
+ * uncompressed files, only the requested bytes are read. For files
+ * compressed in blocks (mkasset -b), only the blocks containing the range
+ * are decompressed. For files compressed without blocks, the file is
+ * decompressed (and discarded) from the start up to the end of the range,
+ * so use block compression for data meant to be range-loaded.
+ *
+ * @param fn        Filename to load (including filesystem prefix, eg: "rom:/foo.dat")
+ * @param offset    Byte offset in the (uncompressed) file contents
+ * @param size      Number of bytes to load
+ * @return void*    Pointer to the loaded range (must be freed with free() when done)
+ */
+void *asset_load_range(const char *fn, int offset, int size);
+
+/**
+ * @brief Load multiple portions of an asset file in a single pass
+ *
+ * Like #asset_load_range, but fulfills several ranges while reading the
+ * file only once: each compressed block intersecting at least one range is
+ * decompressed exactly once, no matter how many ranges it serves, and the
+ * file is read sequentially. Ranges can overlap and do not need to be
+ * sorted; each one is copied into its caller-provided buffer.
+ *
+ * @param fn        Filename to load (including filesystem prefix, eg: "rom:/foo.dat")
+ * @param ranges    Array of ranges to load
+ * @param nranges   Number of ranges
+ */
+void asset_load_ranges(const char *fn, asset_range_t *ranges, int nranges);
+
 /**
  * @brief Open an asset file for reading (with transparent decompression)
  * 
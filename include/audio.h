@@ -8,6 +8,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,13 +28,20 @@ typedef void(*audio_fill_buffer_callback)(short *buffer, size_t numsamples);
 
 void audio_init(const int frequency, int numbuffers);
 void audio_set_buffer_callback(audio_fill_buffer_callback fill_buffer_callback);
+void audio_set_slice_length(int len);
+void audio_set_quiescent(bool quiescent);
 void audio_pause(bool pause);
 void audio_write(const short * const buffer);
 volatile int audio_can_write();
 void audio_write_silence();
 void audio_close();
 int audio_get_frequency();
+float audio_get_frequency_exact();
 int audio_get_buffer_length();
+int audio_get_buffer_count();
+int audio_get_fill_level();
+uint32_t audio_get_underruns();
+void audio_set_adaptive_buffering(bool enable);
 
 short* audio_write_begin(void);
 void audio_write_end(void);
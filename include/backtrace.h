@@ -124,6 +124,29 @@ void backtrace_frame_print_compact(backtrace_frame_t *frame, FILE *out, int widt
  */
 int backtrace(void **buffer, int size);
 
+/**
+ * @brief Walk the stack and return the call stack, skipping the innermost frames
+ *
+ * Variant of #backtrace for lightweight diagnostics such as allocation-site
+ * tracking: it records raw return addresses only (no symbol data is touched,
+ * so no PI access or string formatting happens at capture time), skips the
+ * requested number of innermost frames (eg: allocator internals), and stops
+ * walking as soon as the buffer is full, so a shallow capture does not pay
+ * for the full stack depth. Symbolization can then be deferred to dump time
+ * via #backtrace_symbols or #backtrace_symbols_cb.
+ *
+ * Like #backtrace, this function does not allocate memory and is safe to
+ * call from interrupt context.
+ *
+ * @param buffer    Empty array of pointers, populated with the return
+ *                  addresses of the captured call frames.
+ * @param size      Maximum number of call frames to capture.
+ * @param skip      Number of innermost call frames to skip (0 behaves
+ *                  like #backtrace).
+ * @return          Number of call frames captured (at most, size).
+ */
+int backtrace_skip(void **buffer, int size, int skip);
+
 /**
  * @brief Translate the buffer returned by #backtrace into a list of strings
  * 
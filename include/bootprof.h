@@ -0,0 +1,70 @@
+/**
+ * @file bootprof.h
+ * @brief Boot-time profiling
+ * @ingroup system
+ */
+#ifndef __LIBDRAGON_BOOTPROF_H
+#define __LIBDRAGON_BOOTPROF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A single boot-phase timestamp.
+ *
+ * The COP0 count register starts running at hardware reset, so the tick
+ * value of each mark is an absolute "time since boot" measure; the delta
+ * between two consecutive marks is the duration of the phase in between.
+ * Convert ticks to microseconds with #TIMER_MICROS.
+ */
+typedef struct {
+    const char *name;           ///< Name of the boot phase (static string)
+    uint32_t ticks;             ///< COP0 tick count when the mark was recorded
+} bootprof_mark_t;
+
+/** @brief Maximum number of boot marks that can be recorded. */
+#define BOOTPROF_MAX_MARKS    32
+
+/**
+ * @brief Record a boot-phase timestamp.
+ *
+ * Call this at the end of each boot phase you want to measure. libdragon
+ * itself records marks for the C++ constructors, #dfs_init and
+ * #display_init; applications can add their own marks for their
+ * remaining startup work.
+ *
+ * Marks past #BOOTPROF_MAX_MARKS are silently dropped. The name must
+ * point to a string with static storage duration (it is not copied).
+ *
+ * @param[in] name   Name of the phase that just completed
+ */
+void bootprof_mark(const char *name);
+
+/** @brief Return the number of boot marks recorded so far. */
+int bootprof_count(void);
+
+/**
+ * @brief Return one recorded boot mark.
+ *
+ * @param[in] idx    Index of the mark (0 .. #bootprof_count()-1)
+ *
+ * @return Pointer to the mark, or NULL if the index is out of range.
+ */
+const bootprof_mark_t *bootprof_get(int idx);
+
+/**
+ * @brief Dump all recorded boot marks via #debugf.
+ *
+ * Each line reports the mark name, the absolute time since boot and the
+ * delta from the previous mark, in microseconds.
+ */
+void bootprof_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+/**
+ * @file capture.h
+ * @brief Non-hitching framebuffer capture over USB
+ * @ingroup debug
+ */
+#ifndef __LIBDRAGON_CAPTURE_H
+#define __LIBDRAGON_CAPTURE_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the capture service.
+ *
+ * The capture service takes screenshots without stalling the frame
+ * loop: when a capture is requested, the next framebuffer to leave the
+ * screen is held out of the display rotation (no copy is made) and its
+ * contents are trickled out over USB in small pieces from a background
+ * timer, a few kilobytes per tick. The game keeps rendering into the
+ * remaining buffers, so the captured scene is exactly the one being
+ * analyzed.
+ *
+ * Requires the timer subsystem to be running and a supported flashcart;
+ * initialization fails if no cart is found. Because one framebuffer is
+ * withheld while a capture is in flight, captures are only accepted
+ * when the display was initialized with at least 3 buffers.
+ *
+ * @return true if the service is ready, false if no cart was found or
+ *         the background timer could not be created
+ */
+bool capture_init(void);
+
+/**
+ * @brief Capture the next presented frame.
+ *
+ * Arms the service: the next framebuffer retired after #display_show
+ * is snapshotted and streamed out across the following frames. With
+ * @p compressed set, the frame is first LZ4-compressed in the
+ * background (a slice per tick, into a transiently allocated buffer)
+ * and the framebuffer returns to the rotation as soon as compression
+ * ends, which shortens the hold and the USB time at the cost of heap.
+ *
+ * Plain captures go out as a standard UNFLoader screenshot packet and
+ * show up directly in its debugger. Compressed captures are sent as a
+ * raw binary packet holding a "FBC1" header (width, height, bytes per
+ * pixel, raw size, all big-endian) followed by independent LZ4 blocks,
+ * each prefixed with its 32-bit compressed length.
+ *
+ * @param[in] compressed
+ *            True to LZ4-compress the frame before sending it
+ *
+ * @return true if the capture was armed, false if the service is not
+ *         initialized, a capture is already in flight, the display has
+ *         fewer than 3 buffers, or memory for compression ran out
+ */
+bool capture_frame(bool compressed);
+
+/**
+ * @brief Check whether a capture is still in flight.
+ *
+ * @return true from the moment a capture is armed until its last byte
+ *         has been handed to the USB hardware
+ */
+bool capture_busy(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
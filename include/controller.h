@@ -7,6 +7,7 @@
 #define __LIBDRAGON_CONTROLLER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * @addtogroup controller
@@ -193,6 +194,21 @@ typedef struct controller_origin_data
     struct SI_origdat_gc gc[4];
 } SI_controllers_origin_t;
 
+/**
+ * @brief One buffered input event, captured by the background poll.
+ *
+ * An event is recorded every time one or more buttons of a controller
+ * change state, with the #TICKS_READ timestamp of the poll that observed
+ * the change. See #controller_next_event.
+ */
+typedef struct controller_event
+{
+    uint8_t port;       ///< Controller port that generated the event (0-3)
+    bool down;          ///< True if the buttons were pressed, false if released
+    uint16_t buttons;   ///< Buttons that changed state (same layout as the upper 16 bits of SI_condat data)
+    uint32_t ticks;     ///< Hardware tick timestamp of the poll
+} controller_event_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -204,14 +220,27 @@ void controller_read_gc_origin( struct controller_origin_data * data);
 int get_controllers_present( void );
 int get_accessories_present( struct controller_data * data );
 void controller_scan( void );
+void controller_set_poll_rate( int hz );
+bool controller_next_event( controller_event_t *event );
+bool controller_record_start( const char *path );
+void controller_record_stop( void );
+bool controller_replay_start( const char *path );
+void controller_replay_stop( void );
+bool controller_replay_active( void );
 struct controller_data get_keys_down( void );
 struct controller_data get_keys_up( void );
 struct controller_data get_keys_held( void );
 struct controller_data get_keys_pressed( void );
 int get_dpad_direction( int controller );
 int read_mempak_address( int controller, uint16_t address, uint8_t *data );
+int read_mempak_bulk( int controller, uint16_t address, int len, uint8_t *data,
+    void (*progress)(int done, int total) );
 int write_mempak_address( int controller, uint16_t address, uint8_t *data );
 int identify_accessory( int controller );
+int identify_accessory_cached( int controller );
+void accessory_probe_start( void );
+void accessory_probe_stop( void );
+void accessory_changed_callback( void (*callback)( int controller, int accessory ) );
 void rumble_start( int controller );
 void rumble_stop( int controller );
 void execute_raw_command( int controller, int command, int bytesout, int bytesin, unsigned char *out, unsigned char *in );
@@ -7,6 +7,7 @@
 #define __LIBDRAGON_DEBUG_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #ifdef __cplusplus
@@ -142,6 +143,128 @@ extern "C" {
 	/** @brief Shutdown SD filesystem. */
 	void debug_close_sdfs(void);
 
+	/**
+	 * @brief Query whether a SD file is stored contiguously on the card.
+	 *
+	 * A contiguous file occupies a single run of sectors, so streaming
+	 * code can bypass the FAT filesystem entirely and read it with raw
+	 * multi-sector card accesses (eg: #cart_card_rd_dram or
+	 * #cart_card_rd_queue), which is the fastest way to get data off the
+	 * card. Use #debug_sdfs_preallocate to create such a file.
+	 *
+	 * @param fn           Filename (with or without the sd mount prefix)
+	 * @param first_lba    If not NULL, set to the first sector of the file
+	 * @param num_sectors  If not NULL, set to the number of sectors
+	 *                     containing file data
+	 *
+	 * @return true if the file exists and is contiguous
+	 */
+	bool debug_sdfs_sectors(const char *fn, uint32_t *first_lba, uint32_t *num_sectors);
+
+	/**
+	 * @brief Create a file preallocated as a single contiguous area.
+	 *
+	 * The file is created (or truncated, if it exists) and a contiguous
+	 * run of clusters big enough for @p size bytes is allocated to it.
+	 * Data written to it afterwards stays contiguous, so it remains
+	 * eligible for the raw streaming path (see #debug_sdfs_sectors).
+	 *
+	 * @param fn      Filename (with or without the sd mount prefix)
+	 * @param size    Number of bytes to preallocate (must be > 0)
+	 *
+	 * @return true if the contiguous allocation succeeded (it can fail if
+	 *         the free space on the card is too fragmented)
+	 */
+	bool debug_sdfs_preallocate(const char *fn, uint32_t size);
+
+	/**
+	 * @brief Enable write-behind caching for SD writes.
+	 *
+	 * SD write latency is spiky: a single sector write can stall for
+	 * tens of milliseconds on an erase-block boundary, and that stall
+	 * normally lands on the frame that called fwrite. With write-behind
+	 * enabled, written sectors are queued in RAM and the write call
+	 * returns immediately; the queue is drained in small bounded bursts
+	 * by #debug_sdfs_poll (call it once per frame, at a point where a
+	 * card stall is acceptable) and completely by #debug_sdfs_sync.
+	 * Sectors reach the card in the order they were first written, so
+	 * FAT metadata is never reordered against the data it describes.
+	 *
+	 * Note that queued data is lost if the console crashes or powers
+	 * off before it is flushed: call #debug_sdfs_sync at checkpoints
+	 * that must survive (f_sync/fclose also drain the queue).
+	 *
+	 * @param num_sectors  Queue capacity in 512-byte sectors (0 for the
+	 *                     default of 64, ie: 32 KiB)
+	 *
+	 * @return true if the queue is active, false if the SD filesystem is
+	 *         not initialized or the memory could not be allocated
+	 */
+	bool debug_sdfs_writeback(int num_sectors);
+
+	/**
+	 * @brief Flush one burst of queued SD writes.
+	 *
+	 * Performs at most one bounded multi-sector card write, keeping the
+	 * latency of a single call predictable. Call from an idle point,
+	 * eg: once per frame. Does nothing if write-behind is not enabled
+	 * or the queue is empty.
+	 */
+	void debug_sdfs_poll(void);
+
+	/**
+	 * @brief Drain all queued SD writes to the card (checkpoint).
+	 *
+	 * @return true if everything reached the card, false if any write
+	 *         failed (including failures from earlier deferred flushes)
+	 */
+	bool debug_sdfs_sync(void);
+
+	/**
+	 * @brief Enable deferred logging through a RAM ring buffer.
+	 *
+	 * Once enabled, #debugf (and any write to stderr) appends to a ring
+	 * buffer in RDRAM instead of writing synchronously through the
+	 * (potentially slow) debugging channels; a background timer drains
+	 * the ring in bounded chunks. This makes logging cheap enough to
+	 * leave enabled in hot paths: the caller only pays for formatting
+	 * and a memory copy. If the ring overflows, whole lines are dropped
+	 * and a loss marker is emitted in the log.
+	 *
+	 * Requires the Timer Subsystem (#timer_init). Call this after
+	 * activating the debugging channels with #debug_init.
+	 *
+	 * @param bufsize size in bytes of the ring buffer (at least 1 KiB)
+	 *
+	 * @return true if deferred logging was activated
+	 */
+	bool debug_init_deferred(int bufsize);
+
+	/**
+	 * @brief Drain all deferred log records to the debugging channels.
+	 *
+	 * Blocks until the ring is empty. Useful before intentionally
+	 * halting, or at points where log completeness matters more than
+	 * latency.
+	 */
+	void debug_flush(void);
+
+	/**
+	 * @brief Write a compact binary structured-log record.
+	 *
+	 * Emits a record of a 16-bit event code plus up to 8 32-bit
+	 * arguments (a few bytes instead of a formatted line), suitable for
+	 * high-frequency events in production captures. Records are framed
+	 * with the USB raw-binary datatype so host tools can split them from
+	 * the text log; they are only transmitted on the USB channel. In
+	 * deferred mode the record goes through the ring like text lines.
+	 *
+	 * @param code  application-defined event code
+	 * @param nargs number of arguments (0-8)
+	 * @param args  pointer to the argument words (can be NULL if nargs is 0)
+	 */
+	void debug_binlog(uint16_t code, int nargs, const uint32_t *args);
+
 	/**
 	 * @brief Initialize debugging features of libdragon.
 	 *
@@ -202,6 +325,14 @@ extern "C" {
 	#define debug_init_isviewer()      ({ false; })
 	#define debug_init_sdlog(fn,fmt)   ({ false; })
 	#define debug_init_sdfs(prefix,np) ({ false; })
+	#define debug_sdfs_sectors(fn,lba,ns)  ({ false; })
+	#define debug_sdfs_preallocate(fn,sz)  ({ false; })
+	#define debug_sdfs_writeback(ns)   ({ false; })
+	#define debug_sdfs_poll()          ({ })
+	#define debug_sdfs_sync()          ({ false; })
+	#define debug_init_deferred(sz)    ({ false; })
+	#define debug_flush()              ({ })
+	#define debug_binlog(c,n,a)        ({ })
 	#define debugf(msg, ...)           ({ })
 	#define assertf(expr, msg, ...)    ({ })
 #endif
@@ -23,4 +23,52 @@
     ///@endcond
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+
+/**
+ * @brief Enable pool-backed C++ allocation.
+ *
+ * Carves the given memory budget into per-size-class pools (16 to 256
+ * bytes) and routes `operator new`/`delete` through them: allocations
+ * become a constant-time free-list pop with no heap walk and no
+ * fragmentation, which keeps entity churn from eating frame time.
+ * Larger allocations, and allocations made when the matching pools are
+ * exhausted, transparently fall back to malloc as before.
+ *
+ * Each pool allocation records its call site, so outstanding
+ * allocations can be reported with #debug_cpp_pools_leaks.
+ *
+ * @param[in] pool_bytes  Total memory budget for the pools (split evenly
+ *                        across the size classes; at least 1 KiB each)
+ *
+ * @return true if the pools were allocated and activated
+ */
+bool debug_cpp_pools_init(int pool_bytes);
+
+/**
+ * @brief Print per-size-class pool statistics via #debugf.
+ *
+ * Reports, for each size class, the number of chunks, total allocations
+ * served, currently outstanding allocations and their high-water mark,
+ * plus how many requests fell back to malloc (a high fallback count
+ * means the pools are undersized for the workload).
+ */
+void debug_cpp_pools_stats(void);
+
+/**
+ * @brief Report outstanding pool allocations via #debugf.
+ *
+ * Call at a point where all pooled objects should have been destroyed
+ * (eg: after tearing down a level): every chunk still allocated is
+ * printed with its size and the address of the `new` that allocated it,
+ * resolvable with the symbol table (see #backtrace_symbols).
+ *
+ * @return The number of outstanding pool allocations.
+ */
+int debug_cpp_pools_leaks(void);
+
+}
+#endif
+
 #endif
@@ -23,6 +23,52 @@
 /** @brief The size of a sector payload */
 #define SECTOR_PAYLOAD  252
 
+/** @brief Size of a small-file cluster.
+ *
+ * mkdfs packs files of up to #CLUSTER_FILE_MAX bytes back to back (8-byte
+ * aligned) into clusters of this size, instead of rounding each of them up
+ * to a full sector. The runtime serves reads of small files through a
+ * one-cluster cache of this size, fetched with a single PI transfer. */
+#define CLUSTER_SIZE        4096
+/** @brief Largest file that is packed into (and served through) clusters */
+#define CLUSTER_FILE_MAX    1024
+
+/** @brief Magic number identifying the path lookup index ("DFL1") */
+#define DFS_LOOKUP_MAGIC    0x44464C31
+/** @brief FNV-1a 64-bit offset basis, used to hash file paths */
+#define DFS_FNV1A_OFFSET    0xCBF29CE484222325ULL
+/** @brief FNV-1a 64-bit prime, used to hash file paths */
+#define DFS_FNV1A_PRIME     0x100000001B3ULL
+
+/**
+ * @brief One entry of the path lookup index
+ *
+ * The index is an optional blob appended to the image by mkdfs, pointed to
+ * by the (otherwise unused) file_pointer field of the root sector. It holds
+ * one entry per file, sorted by hash, so that #dfs_open can binary search
+ * the full path instead of walking the directory entries one sector at a
+ * time. Images without the index (file_pointer == 0) keep working through
+ * the linear walk.
+ */
+struct dfs_lookup_entry
+{
+    /** @brief Top 32 bits of the FNV-1a hash of the file path */
+    uint32_t hash_hi;
+    /** @brief Bottom 32 bits of the FNV-1a hash of the file path */
+    uint32_t hash_lo;
+    /** @brief Offset to the directory entry of the file */
+    uint32_t entry_offset;
+} __attribute__((__packed__));
+
+/** @brief Header of the path lookup index, followed by the sorted entries */
+struct dfs_lookup_header
+{
+    /** @brief Magic number (#DFS_LOOKUP_MAGIC) */
+    uint32_t magic;
+    /** @brief Number of #dfs_lookup_entry that follow */
+    uint32_t num_entries;
+} __attribute__((__packed__));
+
 /** @brief Representation of a directory entry */
 struct directory_entry
 {
@@ -61,6 +107,14 @@ typedef struct open_file
     uint32_t loc;
     /** @brief The offset within the filesystem where the file is stored */
     uint32_t cart_start_loc;
+    /** @brief Read-ahead buffer (see #dfs_advise_sequential), or NULL */
+    uint8_t *prefetch_buf;
+    /** @brief Size of the read-ahead window in bytes (0: read-ahead disabled) */
+    int prefetch_window;
+    /** @brief File offset of the first byte in #prefetch_buf */
+    uint32_t prefetch_loc;
+    /** @brief Number of valid prefetched bytes in #prefetch_buf */
+    int prefetch_valid;
 } open_file_t;
 
 /** @} */ /* dfs */
@@ -45,6 +45,41 @@ typedef struct surface_s surface_t;
  * @{
  */
 
+/**
+ * @brief Interlace mode of a resolution
+ */
+typedef enum {
+    /** @brief Progressive output (no interlacing) */
+    INTERLACE_OFF = 0,
+
+    /** @brief Interlaced output with full-height framebuffers.
+     *
+     * Framebuffers hold all the lines of the image (eg: 640x480): the VI
+     * displays the even lines on one field and the odd lines on the other.
+     * This is what `interlaced = true` historically selected.
+     */
+    INTERLACE_FULL = 1,
+
+    /** @brief Interlaced output with half-height framebuffers (field rendering).
+     *
+     * Framebuffers hold a single field (eg: 640x240 for 480i output), and
+     * each is displayed on one field of the output. Compared to
+     * #INTERLACE_FULL, this halves both the framebuffer memory and the
+     * per-frame fill/RDP cost of high-resolution output.
+     *
+     * The application is expected to render fields at field rate,
+     * alternating the half-line vertical offset of its projection to match
+     * the field each buffer will be shown on (bit 0 of
+     * #display_get_current_scanline is the field currently displayed).
+     * Rendering the same content on both fields works too, at the cost of
+     * halving the effective vertical resolution.
+     *
+     * Surfaces returned by #display_lock (and #display_get_height) have
+     * the field height (eg: 240), not the output height.
+     */
+    INTERLACE_HALF = 2,
+} interlace_mode_t;
+
 /**
  * @brief Video resolution structure
  *
@@ -56,8 +91,8 @@ typedef struct {
     int32_t width;
     /** @brief Screen height (must be between 1 and 720) */
     int32_t height;
-    /** @brief True if interlaced mode enabled */
-    bool interlaced;
+    /** @brief Interlace mode (`false` and `true` map to #INTERLACE_OFF and #INTERLACE_FULL) */
+    interlace_mode_t interlaced;
 } resolution_t;
 
 ///@cond
@@ -130,6 +165,16 @@ typedef enum
     FILTERS_RESAMPLE_ANTIALIAS_DEDITHER
 } filter_options_t;
 
+/** @brief Filter preset that leaves the most RDRAM bandwidth to the RDP and CPU.
+ *
+ * The VI filters cost RDRAM bandwidth every scanline: the anti-aliasing
+ * fetch modes read extra framebuffer pixels, and divot/dedither add further
+ * work on top. This preset (plain bilinear resampling, everything else off)
+ * is the cheapest configuration that is valid at every resolution, and is
+ * the one to select (see #display_set_filters) in scenes that are limited
+ * by RDP fill rate or memory bandwidth. */
+#define FILTERS_MAX_BANDWIDTH FILTERS_RESAMPLE
+
 ///@cond
 /** 
  * @brief Display anti-aliasing options (DEPRECATED: Use #filter_options_t instead)
@@ -187,6 +232,12 @@ extern "C" {
  *            Number of buffers, usually 2 or 3, but can be more. Triple buffering
  *            is recommended in case the application cannot hold a steady full framerate,
  *            so that slowdowns don't impact too much.
+ *            Passing 1 selects an expert single-buffer mode in which
+ *            #display_lock returns the buffer being displayed, and the
+ *            application draws directly behind the raster ("beam chasing",
+ *            see #display_get_current_scanline). This saves the memory and
+ *            latency of a back buffer, but any pixel drawn ahead of the
+ *            beam tears.
  * @param[in] gamma
  *            The requested gamma setting
  * @param[in] filters
@@ -194,6 +245,24 @@ extern "C" {
  */
 void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma_t gamma, filter_options_t filters );
 
+/**
+ * @brief Initialize the display, deferring the expensive work
+ *
+ * Same as #display_init, but only records the requested configuration:
+ * the framebuffer allocation and clearing, the VI programming and the
+ * possible wait for vertical blank all happen on the first #display_lock.
+ * Use this during boot to bring up the first interactive frame sooner,
+ * when other initialization work can run before the display is actually
+ * needed.
+ *
+ * The configuration queries (#display_get_width, #display_get_height,
+ * #display_get_bitdepth, #display_get_num_buffers) already report the
+ * requested configuration before the deferred init runs.
+ *
+ * The parameters are the same as #display_init.
+ */
+void display_init_lazy( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma_t gamma, filter_options_t filters );
+
 /**
  * @brief Close the display
  *
@@ -217,6 +286,13 @@ void display_close();
  * surfaces will always be shown on the screen in locking order,
  * irrespective of the order #display_show is called.
  *
+ * In single-buffer mode (#display_init called with 1 buffer), the returned
+ * surface is the one currently being displayed: whatever is drawn becomes
+ * visible as soon as the beam reaches it. Use #display_get_current_scanline
+ * to track the beam and draw behind it; #display_show still marks the end
+ * of the frame (for the frame statistics and pacing), and the buffer
+ * becomes lockable again after the following vertical blank.
+ *
  * @return A valid surface to render to or NULL if none is available.
  */
 surface_t* display_lock(void);
@@ -255,6 +331,138 @@ uint32_t display_get_bitdepth(void);
  */
 uint32_t display_get_num_buffers(void);
 
+/**
+ * @brief Set a target frame rate for frame pacing
+ *
+ * When a target frame rate is configured, frames queued with #display_show
+ * are not flipped before their slot comes up, so that the game does not run
+ * faster than the target even when rendering is quick. The display module
+ * also starts accounting frames that miss their slot: see
+ * #display_get_late_frames, #display_get_dropped_frames and
+ * #display_should_skip_frame.
+ *
+ * Pass 0 (the default) to disable pacing; frames are then flipped at the
+ * first vertical blank after #display_show, as usual. The target should not
+ * exceed the TV refresh rate (60 Hz NTSC/MPAL, 50 Hz PAL), and rates that
+ * do not divide the refresh rate evenly are paced with sub-vblank accuracy
+ * on average.
+ *
+ * @param[in] fps
+ *            Target frame rate in frames per second, or 0 to disable pacing
+ */
+void display_set_target_fps(int fps);
+
+/**
+ * @brief Change the VI filter configuration at runtime
+ *
+ * This function reconfigures the VI filters (anti-aliasing, divot,
+ * dedither) selected at #display_init time, without reinitializing the
+ * display. Since the filters consume RDRAM bandwidth that competes with
+ * the RDP and CPU on every scanline, switching to a cheaper setting (see
+ * #FILTERS_MAX_BANDWIDTH) measurably increases RDP throughput in
+ * bandwidth-limited scenes; the full setting can be restored for scenes
+ * where edge smoothing matters more than fill rate.
+ *
+ * The change takes effect on the next scanline, so it is best called right
+ * after #display_show. All other display parameters (resolution, bit
+ * depth, gamma) are left untouched.
+ *
+ * @param[in] filters
+ *            The new filter options (same values accepted by #display_init)
+ */
+void display_set_filters(filter_options_t filters);
+
+/**
+ * @brief Automatically clear framebuffers with the RDP before reuse
+ *
+ * When enabled, each call to #display_show also kicks an RDP fill of the
+ * next free framebuffer, so that it arrives already cleared to the given
+ * color by the time #display_lock returns it. This replaces a per-frame
+ * CPU clear (eg: #graphics_fill_screen), which costs around a millisecond
+ * per frame at 320x240; the RDP does the same work in the dead time
+ * between frames. Should the clear exceptionally still be running when
+ * #display_lock is called, the function waits for it to complete before
+ * returning the buffer.
+ *
+ * The clear reprograms the RDP render target, cycle mode, scissor and fill
+ * color, so applications using this option must set up the RDP state they
+ * need every frame (which the rdp.h API requires per frame anyway). The
+ * RDP must be initialized with #rdp_init, and must be idle (detached) when
+ * #display_show is called.
+ *
+ * @param[in] enable
+ *            True to clear buffers automatically, false to disable
+ * @param[in] color
+ *            Color to clear to, in packed framebuffer format (in 16 bpp
+ *            mode, the same 16-bit color in both halves; see
+ *            #graphics_make_color)
+ */
+void display_set_auto_clear(bool enable, uint32_t color);
+
+/**
+ * @brief Check whether the next frame should be skipped to catch up
+ *
+ * When frame pacing is enabled (#display_set_target_fps) and the game is
+ * running behind schedule, this function returns true to suggest skipping
+ * the rendering part of the current iteration (while still running the
+ * game logic), so that the schedule can be recovered. Without pacing, it
+ * always returns false.
+ */
+bool display_should_skip_frame(void);
+
+/**
+ * @brief Get the measured frame rate in frames per second
+ *
+ * This is a moving average of the rate at which new frames have been
+ * displayed over the last several frames, expressed in frames per second.
+ */
+float display_get_fps(void);
+
+/**
+ * @brief Get the number of frames shown since #display_init
+ */
+uint32_t display_get_frame_count(void);
+
+/**
+ * @brief Get the number of vertical blanks since #display_init
+ */
+uint32_t display_get_vblank_count(void);
+
+/**
+ * @brief Get the number of frames that were shown at least one frame period
+ *        after their deadline (frame pacing must be enabled)
+ */
+uint32_t display_get_late_frames(void);
+
+/**
+ * @brief Get the number of frame slots that passed without a new frame to
+ *        show (frame pacing must be enabled)
+ */
+uint32_t display_get_dropped_frames(void);
+
+/**
+ * @brief Get the duration of the last completed frame
+ *
+ * The duration is the time elapsed between the last two buffer flips,
+ * measured in hardware ticks (see #TICKS_PER_SECOND).
+ */
+uint32_t display_get_frame_duration(void);
+
+/**
+ * @brief Get the scanline currently being displayed by the VI
+ *
+ * The returned value is the line of the final TV output that the beam is
+ * currently drawing, in the same convention used by #set_VI_interrupt
+ * (range 0..524 on NTSC, 0..624 on PAL; in interlaced modes, bit 0
+ * indicates the field). The vertical blank is at the beginning of the
+ * range (roughly lines 0..33 on NTSC).
+ *
+ * This is mainly useful in single-buffer mode (see #display_init) to draw
+ * behind the raster, possibly in combination with
+ * #register_VI_scanline_handler to schedule the rendering phases.
+ */
+uint32_t display_get_current_scanline(void);
+
 #ifdef __cplusplus
 }
 #endif
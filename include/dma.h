@@ -27,6 +27,12 @@ void dma_read(void * ram_address, unsigned long pi_address, unsigned long len);
 
 void dma_wait(void);
 
+void dma_queue_read(void *ram_address, unsigned long pi_address, unsigned long len,
+    int priority, void (*callback)(void *ctx), void *ctx);
+void dma_queue_write(const void *ram_address, unsigned long pi_address, unsigned long len,
+    int priority, void (*callback)(void *ctx), void *ctx);
+int dma_queue_depth(void);
+
 /* 32 bit IO read from PI device */
 uint32_t io_read(uint32_t pi_address);
 
@@ -35,6 +41,12 @@ void io_write(uint32_t pi_address, uint32_t data);
 
 bool io_accessible(uint32_t pi_address);
 
+void dma_set_domain_timings(int domain, uint8_t latency, uint8_t pulse_width,
+    uint8_t page_size, uint8_t release);
+void dma_get_domain_timings(int domain, uint8_t *latency, uint8_t *pulse_width,
+    uint8_t *page_size, uint8_t *release);
+uint32_t dma_measure_bandwidth(void *ram_address, unsigned long pi_address, unsigned long len);
+
 __attribute__((deprecated("use dma_wait instead"))) 
 volatile int dma_busy(void);
 
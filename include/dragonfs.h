@@ -6,6 +6,8 @@
 #ifndef __LIBDRAGON_DRAGONFS_H
 #define __LIBDRAGON_DRAGONFS_H
 
+#include <stdbool.h>
+
 /** 
  * @addtogroup dfs
  * @{
@@ -84,23 +86,85 @@
 
 /** @} */
 
+/**
+ * @brief Directory entry metadata, filled by #dfs_dir_findfirst_ext
+ *
+ * All fields come from the directory sector the iteration has already
+ * read, so populating them costs no extra PI traffic compared to the
+ * name-only #dfs_dir_findfirst.
+ */
+typedef struct
+{
+    /** @brief Entry name */
+    char name[MAX_FILENAME_LEN+1];
+    /** @brief Entry type (#FLAGS_FILE or #FLAGS_DIR) */
+    int flags;
+    /** @brief File size in bytes (0 for directories) */
+    uint32_t size;
+    /** @brief Starting ROM address of the file data (0 for directories) */
+    uint32_t rom_addr;
+} dfs_dirent_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 int dfs_init(uint32_t base_fs_loc);
+int dfs_init_overlay(uint32_t base_fs_loc, uint32_t patch_fs_loc);
+int dfs_init_lazy(uint32_t base_fs_loc);
 int dfs_chdir(const char * const path);
 int dfs_dir_findfirst(const char * const path, char *buf);
 int dfs_dir_findnext(char *buf);
+int dfs_dir_findfirst_ext(const char * const path, dfs_dirent_t *entry);
+int dfs_dir_findnext_ext(dfs_dirent_t *entry);
+
+/**
+ * @brief Callback invoked when a read started by #dfs_read_async completes
+ *
+ * The callback runs in interrupt context, so it should be short and must not
+ * call blocking functions.
+ *
+ * @param[in] bytes_read
+ *            Number of bytes actually read
+ * @param[in] ctx
+ *            Opaque argument passed to #dfs_read_async
+ */
+typedef void (*dfs_read_callback_t)(int bytes_read, void *ctx);
 
 int dfs_open(const char * const path);
 int dfs_read(void * const buf, int size, int count, uint32_t handle);
+int dfs_read_async(void * const buf, int size, int count, uint32_t handle,
+    dfs_read_callback_t callback, void *ctx);
+bool dfs_read_async_busy(void);
+int dfs_advise_sequential(uint32_t handle, int window);
 int dfs_seek(uint32_t handle, int offset, int origin);
 int dfs_tell(uint32_t handle);
 int dfs_close(uint32_t handle);
 int dfs_eof(uint32_t handle);
 int dfs_size(uint32_t handle);
 uint32_t dfs_rom_addr(const char *path);
+const void *dfs_map(const char *path);
+void dfs_map_cache_init(int frames);
+
+/**
+ * @brief Start recording the order in which files are first opened
+ *
+ * While recording, every successful #dfs_open (including opens done through
+ * the standard C library with the "rom:/" prefix) appends the file path to an
+ * in-memory list, the first time that file is opened. Dump the list with
+ * #dfs_profile_dump, feed it to mkdfs -p, and the next build will place the
+ * recorded files adjacently in ROM in that order, turning scattered PI reads
+ * during a level load into a near-sequential sweep.
+ */
+void dfs_profile_start(void);
+
+/**
+ * @brief Dump the recorded load order and stop recording
+ *
+ * Prints one path per line on the debug channel, in the exact format
+ * expected by mkdfs -p, and releases the recording buffer.
+ */
+void dfs_profile_dump(void);
 
 const char *dfs_strerror(int error);
 
@@ -30,6 +30,7 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * @brief EEPROM Probe Values
@@ -58,8 +59,12 @@ eeprom_type_t eeprom_present( void );
 size_t eeprom_total_blocks( void );
 void eeprom_read( uint8_t block, uint8_t * dest );
 uint8_t eeprom_write( uint8_t block, const uint8_t * src );
+void eeprom_write_async( uint8_t block, const uint8_t * src,
+    void (*callback)(uint64_t *output, void *ctx), void *ctx );
 void eeprom_read_bytes( uint8_t * dest, size_t start, size_t len );
 void eeprom_write_bytes( const uint8_t * src, size_t start, size_t len );
+void eeprom_write_bytes_async( const uint8_t * src, size_t start, size_t len );
+bool eeprom_write_pending( void );
 
 #ifdef __cplusplus
 }
@@ -79,6 +79,7 @@ int eepfs_close(void);
 int eepfs_read(const char * path, void * dest, size_t size);
 int eepfs_write(const char * path, const void * src, size_t size);
 int eepfs_erase(const char * path);
+int eepfs_sync(void);
 
 bool eepfs_verify_signature(void);
 void eepfs_wipe(void);
@@ -7,6 +7,7 @@
 #define __LIBDRAGON_EXCEPTION_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * @addtogroup exceptions
@@ -138,6 +139,39 @@ void exception_default_handler( exception_t* ex );
 
 void register_syscall_handler( syscall_handler_t cb, uint32_t first_code, uint32_t last_code );
 
+/**
+ * @brief Enable transparent flush-to-zero handling of FPU denormals.
+ *
+ * The VR4300 FPU does not implement denormal (subnormal) numbers: any
+ * floating point operation with a denormal input raises an
+ * unimplemented-operation exception, which is normally fatal — a single
+ * subnormal produced by (for instance) decaying audio envelopes kills the
+ * program. When this mode is enabled, the exception handler instead
+ * flushes the denormal operands to (signed) zero and retries the
+ * instruction, implementing standard flush-to-zero semantics in software;
+ * the FCR31 FS bit is also set so that denormal *results* are flushed
+ * directly by the hardware.
+ *
+ * The emulation runs as a minimal fast path in the exception handler
+ * (no full context save), so the cost per flushed operation is bounded
+ * (~100 cycles) even when denormals show up inside a hot loop. It is
+ * still an exception per operation: use #fpu_flush_denormals_count to
+ * locate the code producing denormals and fix it at the source.
+ *
+ * @param[in] enable    Enable or disable denormal flush-to-zero
+ */
+void fpu_flush_denormals( bool enable );
+
+/**
+ * @brief Return the number of denormal operands flushed so far.
+ *
+ * The counter increments once per faulting instruction handled by the
+ * flush-to-zero path enabled with #fpu_flush_denormals. A nonzero (and
+ * especially a growing) value means some code is doing math on subnormal
+ * values and paying an exception per operation for it.
+ */
+uint32_t fpu_flush_denormals_count( void );
+
 #ifdef __cplusplus
 }
 #endif
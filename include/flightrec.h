@@ -0,0 +1,75 @@
+/**
+ * @file flightrec.h
+ * @brief Crash-dump flight recorder
+ * @ingroup debug
+ */
+#ifndef __LIBDRAGON_FLIGHTREC_H
+#define __LIBDRAGON_FLIGHTREC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the flight recorder.
+ *
+ * The flight recorder keeps a small always-on ring of recent activity:
+ * the tail of the debug log, application-defined events recorded via
+ * #flightrec_event, and (when rspq is in use) the tail of the current
+ * RSP queue buffer. When an unhandled exception occurs, the rings are
+ * LZ4-compressed and written out to USB and/or to a file on SD, so a
+ * crash on a tester's cart leaves more than a screen photo behind.
+ *
+ * Recording costs a handful of instructions per event and a short
+ * memcpy per log write; it is meant to stay enabled in every build
+ * that ships to testers.
+ *
+ * @return true if the recorder is active, false if the ring memory
+ *         could not be allocated.
+ */
+bool flightrec_init(void);
+
+/**
+ * @brief Record an application event into the flight ring.
+ *
+ * Events are fixed-size records (a COP0 timestamp, a 16-bit code and
+ * two 32-bit arguments) stored in a ring that keeps the most recent
+ * ones. The call is cheap enough for per-frame or per-state-change
+ * markers; it does nothing if the recorder is not initialized.
+ *
+ * @param[in] code   Application-defined event code
+ * @param[in] arg0   First event argument
+ * @param[in] arg1   Second event argument
+ */
+void flightrec_event(uint16_t code, uint32_t arg0, uint32_t arg1);
+
+/**
+ * @brief Set the file the crash dump is written to.
+ *
+ * Pass a path on a mounted filesystem (eg: "sd:/crash.flr" after
+ * #debug_init_sdfs). Without this call the dump goes to USB only.
+ * The string is not copied and must have static storage duration.
+ *
+ * @param[in] fn     Dump file path, or NULL to disable the file output
+ */
+void flightrec_dump_file(const char *fn);
+
+/**
+ * @brief Write the flight recorder dump now.
+ *
+ * This is invoked automatically on unhandled exceptions; calling it
+ * manually can be useful to snapshot the rings at a known-good point
+ * or to test the dump pipeline.
+ *
+ * @return true if the dump was written to at least one output
+ */
+bool flightrec_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
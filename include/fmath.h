@@ -0,0 +1,340 @@
+/**
+ * @file fmath.h
+ * @brief Fixed-point math for the VR4300
+ * @ingroup fmath
+ */
+#ifndef __LIBDRAGON_FMATH_H
+#define __LIBDRAGON_FMATH_H
+
+#include <stdint.h>
+
+/**
+ * @defgroup fmath Fixed-point math
+ * @ingroup libdragon
+ * @brief Fixed-point scalar, trigonometric, vector and matrix math.
+ *
+ * Floating point on the VR4300 is serviceable but slow in the wrong
+ * places: single-precision multiplies take 8 cycles against 5 for the
+ * integer multiplier, divisions take 29, and every float<->int
+ * conversion costs a further 5-cycle trip through the FPU. Fixed-point
+ * arithmetic stays in the integer pipeline, where a s16.16 multiply
+ * compiles to a single MULT plus shifts.
+ *
+ * This module provides the two formats that cover most game math:
+ *
+ *  * #fx32_t - s16.16: ~4 decimal digits of fraction, range +/-32768.
+ *    The workhorse for positions, matrices and trigonometry; this is
+ *    also the format the RSP T&L overlay (tnl.h) uses internally.
+ *  * #fx64_t - s32.32: double the range and precision, for
+ *    accumulators and world-space coordinates that outgrow s16.16.
+ *
+ * Angles are expressed as 16-bit binary angles (#fm_angle_t), where a
+ * full turn is 0x10000: wraparound is free, quadrant operations are
+ * masks, and the value doubles as the index into the ROM-resident
+ * lookup tables behind #fm_sin and #fm_atan2.
+ *
+ * Approximate cycle costs (VR4300, warm cache) are documented on each
+ * function; they include the call overhead for the out-of-line ones.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Signed 16.16 fixed-point number */
+typedef int32_t fx32_t;
+/** @brief Signed 32.32 fixed-point number */
+typedef int64_t fx64_t;
+
+/**
+ * @brief 16-bit binary angle (full turn = 0x10000)
+ *
+ * Arithmetic on binary angles wraps for free: 0xFFFF + 1 is 0, so
+ * there is never a range reduction step before a table lookup.
+ */
+typedef uint16_t fm_angle_t;
+
+/** @brief The value 1.0 in s16.16 */
+#define FX32_ONE        (1 << 16)
+/** @brief The value 0.5 in s16.16 */
+#define FX32_HALF       (1 << 15)
+/** @brief The value 1.0 in s32.32 */
+#define FX64_ONE        (1ll << 32)
+
+/** @brief Convert a floating point constant to s16.16 at compile time */
+#define FX32(f)         ((fx32_t)((f) * 65536.0 + ((f) >= 0 ? 0.5 : -0.5)))
+/** @brief Convert a floating point constant to s32.32 at compile time */
+#define FX64(f)         ((fx64_t)((f) * 4294967296.0 + ((f) >= 0 ? 0.5 : -0.5)))
+/** @brief Convert degrees to a binary angle at compile time */
+#define FM_DEG(d)       ((fm_angle_t)((d) * 65536.0 / 360.0 + 0.5))
+
+/** @brief Convert an integer to s16.16 (free: folds into a shift) */
+static inline fx32_t fx32_from_int(int x)       { return x << 16; }
+/** @brief Truncate a s16.16 to an integer */
+static inline int fx32_to_int(fx32_t x)         { return x >> 16; }
+/** @brief Round a s16.16 to the nearest integer */
+static inline int fx32_round(fx32_t x)          { return (x + FX32_HALF) >> 16; }
+/** @brief Widen a s16.16 into a s32.32 */
+static inline fx64_t fx64_from_fx32(fx32_t x)   { return (fx64_t)x << 16; }
+/** @brief Narrow a s32.32 into a s16.16 (truncates both ends) */
+static inline fx32_t fx32_from_fx64(fx64_t x)   { return (fx32_t)(x >> 16); }
+
+/**
+ * @brief Multiply two s16.16 numbers. (~6 cycles: one MULT)
+ *
+ * The 32x32->64 product comes straight out of the HI/LO multiplier
+ * registers, so no precision is lost before the final shift.
+ */
+static inline fx32_t fx32_mul(fx32_t a, fx32_t b)
+{
+    return (fx32_t)(((int64_t)a * b) >> 16);
+}
+
+/**
+ * @brief Multiply-accumulate in s16.16: a + b*c. (~7 cycles)
+ *
+ * Prefer chaining this over separate #fx32_mul and adds in inner loops:
+ * the compiler keeps the 64-bit product in HI/LO and overlaps the adds
+ * with the multiplier latency (see the dot products below).
+ */
+static inline fx32_t fx32_mac(fx32_t a, fx32_t b, fx32_t c)
+{
+    return a + (fx32_t)(((int64_t)b * c) >> 16);
+}
+
+/**
+ * @brief Divide two s16.16 numbers. (~70 cycles: DDIV)
+ *
+ * Division does not pipeline; hoist it out of loops, or multiply by a
+ * reciprocal when the divisor is reused. Behavior on division by zero
+ * is undefined, as for integers.
+ */
+static inline fx32_t fx32_div(fx32_t a, fx32_t b)
+{
+    return (fx32_t)(((int64_t)a << 16) / b);
+}
+
+/**
+ * @brief Multiply two s32.32 numbers. (~25 cycles: four MULT/DMULTs)
+ *
+ * Computed by 32-bit limb decomposition since the full product needs
+ * 128 bits; the result is exact except for truncation of the low 32
+ * fractional bits.
+ */
+static inline fx64_t fx64_mul(fx64_t a, fx64_t b)
+{
+    uint32_t al = (uint32_t)a, bl = (uint32_t)b;
+    int32_t ah = (int32_t)(a >> 32), bh = (int32_t)(b >> 32);
+    return ((int64_t)ah * bh << 32)
+         + (int64_t)ah * bl + (int64_t)bh * al
+         + (int64_t)(((uint64_t)al * bl) >> 32);
+}
+
+/** @brief A 2D vector in s16.16 */
+typedef struct
+{
+    fx32_t x;   ///< X component
+    fx32_t y;   ///< Y component
+} fm_vec2_t;
+
+/** @brief A 3D vector in s16.16 */
+typedef struct
+{
+    fx32_t x;   ///< X component
+    fx32_t y;   ///< Y component
+    fx32_t z;   ///< Z component
+} fm_vec3_t;
+
+/**
+ * @brief A 4x4 matrix in s16.16, row-major
+ *
+ * Same layout and convention as the float matrix taken by
+ * #tnl_matrix_load (vectors are rows, points transform as v * M);
+ * see #fm_mat4_to_float for the bridge.
+ */
+typedef struct
+{
+    fx32_t m[4][4];     ///< Coefficients, m[row][column]
+} fm_mat4_t;
+
+/**
+ * @brief Sine of a binary angle, in s16.16. (~20 cycles)
+ *
+ * Looked up in a 1024-entry ROM-resident table with linear
+ * interpolation between entries; maximum error is about 3e-5.
+ *
+ * @param[in] angle  Binary angle (full turn = 0x10000)
+ * @return sin(angle) in [-1, 1] as s16.16
+ */
+fx32_t fm_sin(fm_angle_t angle);
+
+/**
+ * @brief Cosine of a binary angle, in s16.16. (~20 cycles)
+ *
+ * @param[in] angle  Binary angle (full turn = 0x10000)
+ * @return cos(angle) in [-1, 1] as s16.16
+ */
+fx32_t fm_cos(fm_angle_t angle);
+
+/**
+ * @brief Angle of the vector (x, y). (~50 cycles, one division)
+ *
+ * Octant reduction plus a 256-entry ROM-resident arctangent table with
+ * linear interpolation; maximum error is about 0.01 degrees.
+ * fm_atan2(0, 0) returns 0.
+ *
+ * @param[in] y  Y component, s16.16 (any consistent scale works)
+ * @param[in] x  X component, s16.16
+ * @return Binary angle of (x, y), counterclockwise from the +X axis
+ */
+fm_angle_t fm_atan2(fx32_t y, fx32_t x);
+
+/**
+ * @brief Square root of a s16.16 number. (~130 cycles)
+ *
+ * Exact bit-by-bit integer square root (no tables, no iteration count
+ * dependent on the value). Negative inputs return 0.
+ *
+ * @param[in] x  Value in s16.16
+ * @return sqrt(x) in s16.16
+ */
+fx32_t fx32_sqrt(fx32_t x);
+
+/** @brief Add two 2D vectors. (~4 cycles) */
+static inline fm_vec2_t fm_vec2_add(fm_vec2_t a, fm_vec2_t b)
+{
+    return (fm_vec2_t){ a.x + b.x, a.y + b.y };
+}
+
+/** @brief Subtract two 2D vectors. (~4 cycles) */
+static inline fm_vec2_t fm_vec2_sub(fm_vec2_t a, fm_vec2_t b)
+{
+    return (fm_vec2_t){ a.x - b.x, a.y - b.y };
+}
+
+/** @brief Scale a 2D vector by a s16.16 factor. (~10 cycles) */
+static inline fm_vec2_t fm_vec2_scale(fm_vec2_t a, fx32_t s)
+{
+    return (fm_vec2_t){ fx32_mul(a.x, s), fx32_mul(a.y, s) };
+}
+
+/**
+ * @brief Dot product of two 2D vectors, in s16.16. (~12 cycles)
+ *
+ * The products are accumulated at 64 bits before the final shift, so
+ * intermediate terms cannot overflow.
+ */
+static inline fx32_t fm_vec2_dot(fm_vec2_t a, fm_vec2_t b)
+{
+    return (fx32_t)(((int64_t)a.x * b.x + (int64_t)a.y * b.y) >> 16);
+}
+
+/** @brief Add two 3D vectors. (~5 cycles) */
+static inline fm_vec3_t fm_vec3_add(fm_vec3_t a, fm_vec3_t b)
+{
+    return (fm_vec3_t){ a.x + b.x, a.y + b.y, a.z + b.z };
+}
+
+/** @brief Subtract two 3D vectors. (~5 cycles) */
+static inline fm_vec3_t fm_vec3_sub(fm_vec3_t a, fm_vec3_t b)
+{
+    return (fm_vec3_t){ a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+/** @brief Scale a 3D vector by a s16.16 factor. (~15 cycles) */
+static inline fm_vec3_t fm_vec3_scale(fm_vec3_t a, fx32_t s)
+{
+    return (fm_vec3_t){ fx32_mul(a.x, s), fx32_mul(a.y, s), fx32_mul(a.z, s) };
+}
+
+/**
+ * @brief Dot product of two 3D vectors, in s16.16. (~17 cycles)
+ *
+ * Accumulated at 64 bits: three back-to-back MULTs whose adds overlap
+ * the multiplier latency.
+ */
+static inline fx32_t fm_vec3_dot(fm_vec3_t a, fm_vec3_t b)
+{
+    return (fx32_t)(((int64_t)a.x * b.x + (int64_t)a.y * b.y
+                   + (int64_t)a.z * b.z) >> 16);
+}
+
+/** @brief Cross product of two 3D vectors. (~35 cycles) */
+static inline fm_vec3_t fm_vec3_cross(fm_vec3_t a, fm_vec3_t b)
+{
+    return (fm_vec3_t){
+        (fx32_t)(((int64_t)a.y * b.z - (int64_t)a.z * b.y) >> 16),
+        (fx32_t)(((int64_t)a.z * b.x - (int64_t)a.x * b.z) >> 16),
+        (fx32_t)(((int64_t)a.x * b.y - (int64_t)a.y * b.x) >> 16),
+    };
+}
+
+/**
+ * @brief Length of a 3D vector, in s16.16. (~160 cycles)
+ *
+ * Components larger than 181.0 can overflow the squared sum; use
+ * #fx64_t accumulation by hand for world-scale vectors.
+ */
+fx32_t fm_vec3_len(fm_vec3_t a);
+
+/**
+ * @brief Normalize a 3D vector to unit length. (~280 cycles, one division)
+ *
+ * The zero vector is returned unchanged.
+ */
+fm_vec3_t fm_vec3_normalize(fm_vec3_t a);
+
+/** @brief Set a matrix to the identity. (~30 cycles) */
+void fm_mat4_identity(fm_mat4_t *out);
+
+/** @brief Set a matrix to a translation by (x, y, z). (~35 cycles) */
+void fm_mat4_translate(fm_mat4_t *out, fx32_t x, fx32_t y, fx32_t z);
+
+/** @brief Set a matrix to a scale by (x, y, z). (~35 cycles) */
+void fm_mat4_scale(fm_mat4_t *out, fx32_t x, fx32_t y, fx32_t z);
+
+/**
+ * @brief Set a matrix to a rotation around one axis. (~90 cycles)
+ *
+ * @param[out] out    Matrix to fill
+ * @param[in]  axis   0 for X, 1 for Y, 2 for Z
+ * @param[in]  angle  Rotation angle (counterclockwise looking down the axis)
+ */
+void fm_mat4_rotate(fm_mat4_t *out, int axis, fm_angle_t angle);
+
+/**
+ * @brief Multiply two matrices: out = a * b. (~450 cycles: 64 MULTs)
+ *
+ * Each coefficient is accumulated at 64 bits, so intermediate products
+ * cannot overflow even when both inputs use the full s16.16 range.
+ * @p out must not alias @p a or @p b.
+ */
+void fm_mat4_mul(fm_mat4_t *out, const fm_mat4_t *a, const fm_mat4_t *b);
+
+/**
+ * @brief Transform a point by a matrix (W implicitly 1). (~110 cycles)
+ *
+ * Applies the full affine transform v * M, including the translation
+ * row; use #fm_mat4_transform_vec to transform a direction instead.
+ */
+fm_vec3_t fm_mat4_transform(const fm_mat4_t *m, fm_vec3_t v);
+
+/**
+ * @brief Transform a direction by a matrix (W implicitly 0). (~90 cycles)
+ */
+fm_vec3_t fm_mat4_transform_vec(const fm_mat4_t *m, fm_vec3_t v);
+
+/**
+ * @brief Convert a fixed-point matrix to floats, for #tnl_matrix_load.
+ *
+ * The RSP T&L overlay accepts float matrices and converts them back to
+ * 16.16 internally; this bridge lets all CPU-side math stay fixed point
+ * and only touch the FPU once per matrix upload.
+ */
+void fm_mat4_to_float(const fm_mat4_t *m, float out[4][4]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+/**
+ * @file font64.h
+ * @brief Variable-width bitmap fonts with kerning
+ * @ingroup graphics
+ */
+
+#ifndef __LIBDRAGON_FONT64_H
+#define __LIBDRAGON_FONT64_H
+
+#include <stdint.h>
+#include "graphics.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum number of atlas sheets a FONT64 file can hold */
+#define FONT64_MAX_SHEETS 8
+
+/**
+ * @brief One glyph of a FONT64 font
+ *
+ * Glyph bitmaps live inside the font's atlas sheets; the metrics follow the
+ * usual bitmap-font conventions: the bitmap is drawn at the pen position
+ * displaced by the offsets, and the pen then advances by #xadvance.
+ */
+typedef struct
+{
+	/** @brief Index of the atlas sheet holding the bitmap */
+	uint8_t sheet;
+	/** @brief X position of the bitmap inside the sheet, in pixels */
+	uint8_t x;
+	/** @brief Y position of the bitmap inside the sheet, in pixels */
+	uint8_t y;
+	/** @brief Width of the bitmap in pixels (0 for blank glyphs) */
+	uint8_t width;
+	/** @brief Height of the bitmap in pixels */
+	uint8_t height;
+	/** @brief Horizontal offset from the pen position to the bitmap */
+	int8_t xofs;
+	/** @brief Vertical offset from the top of the line to the bitmap */
+	int8_t yofs;
+	/** @brief Pen advance after drawing this glyph */
+	int8_t xadvance;
+} font64_glyph_t;
+
+/**
+ * @brief One kerning pair of a FONT64 font
+ *
+ * The amount is added to the pen advance whenever the two glyphs are drawn
+ * next to each other.  Entries are sorted by (first, second) so the lookup
+ * can binary search them.
+ */
+typedef struct
+{
+	/** @brief Character code of the left glyph of the pair */
+	uint8_t first;
+	/** @brief Character code of the right glyph of the pair */
+	uint8_t second;
+	/** @brief Extra advance between the pair, usually negative */
+	int8_t amount;
+	/** @brief Reserved, written as zero */
+	uint8_t __pad;
+} font64_kern_t;
+
+/**
+ * @brief Header of a FONT64 file
+ *
+ * Layout of the ".font64" file emitted by the mkfont tool.  The file is
+ * written big-endian, so on the N64 it can be loaded into memory and used
+ * as-is: the glyph and kerning tables follow the header, and the atlas
+ * sheets (standard CI4 sprites sharing the header palette, each fitting
+ * the low half of TMEM) live at the recorded offsets.
+ */
+typedef struct
+{
+	/** @brief Magic, "FNT1" */
+	char magic[4];
+	/** @brief First character code covered by the glyph table */
+	uint8_t first_char;
+	/** @brief Number of glyph entries following the header */
+	uint8_t num_chars;
+	/** @brief Number of atlas sheets embedded in the file */
+	uint8_t num_sheets;
+	/** @brief Vertical distance between two lines of text */
+	uint8_t line_height;
+	/** @brief Distance from the top of a line to the baseline */
+	uint8_t baseline;
+	/** @brief Reserved, written as zero */
+	uint8_t __pad;
+	/** @brief Number of kerning entries following the glyph table */
+	uint16_t num_kerns;
+	/** @brief RGBA16 palette shared by all the atlas sheets */
+	uint16_t palette[16];
+	/** @brief File offsets of the embedded atlas sheet sprites */
+	uint32_t sheet_offset[FONT64_MAX_SHEETS];
+} font64_header_t;
+
+/**
+ * @brief An opened FONT64 font
+ *
+ * Initialized by #font64_load; the structure keeps the whole file in memory
+ * and points into it, so it stays valid until #font64_free.
+ */
+typedef struct
+{
+	/** @brief The whole FONT64 file in memory */
+	void *data;
+	/** @brief Glyph table inside #data */
+	font64_glyph_t *glyphs;
+	/** @brief Kerning table inside #data */
+	font64_kern_t *kerns;
+	/** @brief Atlas sheet sprites inside #data */
+	sprite_t *sheets[FONT64_MAX_SHEETS];
+	/** @brief RGBA16 palette shared by the sheets */
+	uint16_t *palette;
+	/** @brief First character code covered by the glyph table */
+	int first_char;
+	/** @brief Number of glyphs in the table */
+	int num_chars;
+	/** @brief Number of kerning entries */
+	int num_kerns;
+	/** @brief Vertical distance between two lines of text */
+	int line_height;
+	/** @brief Distance from the top of a line to the baseline */
+	int baseline;
+} font64_t;
+
+/**
+ * @brief Load a FONT64 font
+ *
+ * Loads a ".font64" file created by the mkfont tool.  The file is kept in
+ * memory whole and must be released with #font64_free.
+ *
+ * @param[in] fn
+ *            Filename of the font (with filesystem prefix, eg: "rom:/font.font64")
+ *
+ * @return The loaded font
+ */
+font64_t *font64_load( const char *fn );
+
+/**
+ * @brief Release a font loaded with #font64_load
+ *
+ * @param[in] font
+ *            Font to release
+ */
+void font64_free( font64_t *font );
+
+/**
+ * @brief Measure the width of a text string in pixels
+ *
+ * Applies the same metrics and kerning as #font64_draw_text.  For texts
+ * spanning several lines (embedded "\n"), the widest line is returned.
+ *
+ * @param[in] font
+ *            Font to measure with
+ * @param[in] text
+ *            Text to measure
+ *
+ * @return The width of the widest line of the text in pixels
+ */
+int font64_text_width( font64_t *font, const char *text );
+
+/**
+ * @brief Draw a text string with the RDP
+ *
+ * Draws the text at the given position (top left of the first line) using
+ * textured rectangles, with kerning applied between glyph pairs.  "\n"
+ * moves to the next line.
+ *
+ * The font palette and atlas sheets are loaded on demand and stay resident
+ * between calls, so consecutive text draws with the same font cost no
+ * further TMEM traffic.  The RDP must be attached and set up in texture
+ * mode (see #rdp_attach and #rdp_enable_texture_copy) before calling this.
+ *
+ * @param[in] texslot
+ *            The RDP texture slot to stream the atlas sheets through (0-7)
+ * @param[in] font
+ *            Font to draw with
+ * @param[in] x
+ *            The pixel X location of the top left of the text
+ * @param[in] y
+ *            The pixel Y location of the top left of the text
+ * @param[in] text
+ *            Text to draw
+ */
+void font64_draw_text( uint32_t texslot, font64_t *font, int x, int y, const char *text );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
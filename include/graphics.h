@@ -71,9 +71,9 @@ typedef struct
      * A 32 bit sprite would have a value of '4' here
      */
     uint8_t bitdepth;
-    /** 
+    /**
      * @brief Sprite format
-     * @note Currently unused
+     * @note Either 0 (linear data) or #SPRITE_FORMAT_TMEM_SWIZZLED
      */
     uint8_t format;
     /** @brief Number of horizontal slices for spritemaps */
@@ -85,6 +85,121 @@ typedef struct
     uint32_t data[0];
 } sprite_t;
 
+/**
+ * @brief Sprite data is pre-swizzled for direct TMEM block loads
+ *
+ * Sprites converted with "mksprite --swizzle" store their odd rows with the
+ * 32-bit halves of every 64-bit word swapped, which is the layout the RDP
+ * expects inside TMEM.  #rdp_load_texture detects this flag and uploads the
+ * sprite with a single raw block transfer, skipping the per-line interleave.
+ *
+ * Such sprites always fit TMEM whole, can only be loaded in their entirety
+ * (no slices or strides), and cannot be drawn with the software blitters in
+ * graphics.c, which expect linear data.
+ */
+#define SPRITE_FORMAT_TMEM_SWIZZLED 0x01
+
+/**
+ * @brief Sprite data contains a full mipmap chain
+ *
+ * Sprites converted with "mksprite --mipmap" store a box-filtered mipmap
+ * chain right after the base image: each level halves the previous one
+ * (rounding down, never below 1 pixel) until a 1x1 level is reached.  The
+ * width/height fields describe level 0; the location of every other level
+ * is derived by walking the chain.
+ *
+ * Load a specific level with #rdp_load_texture_mipmap.  Slices, the software
+ * blitters, and the regular loaders keep working on such sprites and see only
+ * the base level.  Mipmapped sprites are never pre-swizzled.
+ */
+#define SPRITE_FORMAT_MIPMAPPED 0x02
+
+/**
+ * @brief Sprite pixels are 4-bit indices into a 16-entry RGBA16 palette
+ *
+ * Sprites converted with "mksprite 4" store two pixels per byte (the first
+ * pixel of each pair in the high nibble) and set the bitdepth field to 1.
+ * Unless #SPRITE_FORMAT_SHARED_PALETTE is also set, the 16-entry palette
+ * (32 bytes of RGBA16 values) is stored right after the pixel data.
+ *
+ * #rdp_load_texture uploads such sprites as color-indexed textures and
+ * loads the embedded palette into the RDP color lookup table, skipping the
+ * palette upload when it is already resident.  CI4 sprites cannot be
+ * pre-swizzled or mipmapped and cannot be drawn with the software blitters
+ * in graphics.c.
+ */
+#define SPRITE_FORMAT_CI4 0x04
+
+/**
+ * @brief CI4 sprite indexes a palette shared with other sprites
+ *
+ * Set on sprites converted with "mksprite --palette": the sprite embeds no
+ * palette of its own and its indices refer to a palette group produced with
+ * "mksprite --make-palette".  Load the group palette once with
+ * #rdp_load_palette; every sprite of the group can then be drawn without
+ * touching the color lookup table again.
+ */
+#define SPRITE_FORMAT_SHARED_PALETTE 0x08
+
+/**
+ * @brief Sprite carries precomputed transparency span metadata
+ *
+ * Sprites converted with "mksprite --spans" store a run-length description
+ * of their alpha channel right after the pixel data: a stream of big-endian
+ * 16-bit entries, each holding an opcode in the top two bits (0 = fully
+ * transparent, 1 = fully opaque, 2 = translucent) and a pixel count in the
+ * low 14 bits.  The entries of each row add up to exactly the sprite width.
+ *
+ * #graphics_draw_sprite_trans walks the spans instead of testing alpha per
+ * pixel: transparent runs are skipped without ever touching the pixel data
+ * and opaque runs go through the plain row copier.  UI-style art, which is
+ * mostly made of solid shapes on a transparent background, blits several
+ * times faster this way.  Span sprites cannot be pre-swizzled or mipmapped.
+ */
+#define SPRITE_FORMAT_ALPHA_SPANS 0x10
+
+/** @brief One sprite inside a texture atlas sheet (see #atlas_t) */
+typedef struct
+{
+    /** @brief Index of the sheet sprite holding this entry */
+    uint8_t sheet;
+    /** @brief Reserved, written as zero */
+    uint8_t __pad;
+    /** @brief X position of the entry inside the sheet, in pixels */
+    uint16_t x;
+    /** @brief Y position of the entry inside the sheet, in pixels */
+    uint16_t y;
+    /** @brief Width of the entry in pixels */
+    uint16_t width;
+    /** @brief Height of the entry in pixels */
+    uint16_t height;
+} atlas_entry_t;
+
+/**
+ * @brief Texture atlas coordinate table
+ *
+ * Layout of the ".atlas" file emitted by the mkatlas tool.  The file is
+ * written big-endian, so on the N64 it can be read straight into memory and
+ * used as-is: load the sheet sprite named by #atlas_entry_t::sheet (each
+ * sheet fits TMEM whole) with #rdp_load_texture, then draw the entry's
+ * rectangle out of it.  Sprites packed with the same mkatlas tag share a
+ * sheet, so drawing them together costs a single TMEM load.
+ *
+ * Entry indices match the defines in the header generated next to the
+ * atlas.
+ */
+typedef struct
+{
+    /** @brief Magic, "ATL1" */
+    char magic[4];
+    /** @brief Number of entries in the table */
+    uint16_t num_entries;
+    /** @brief Number of sheet sprites the entries refer to */
+    uint16_t num_sheets;
+    /** @brief The coordinate entries */
+    atlas_entry_t entries[0];
+} atlas_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -103,6 +218,7 @@ void graphics_set_default_font( void );
 void graphics_set_font_sprite( sprite_t *font );
 void graphics_draw_character( surface_t* surf, int x, int y, char c );
 void graphics_draw_text( surface_t* surf, int x, int y, const char * const msg );
+sprite_t* graphics_render_text( const char * const msg );
 void graphics_draw_sprite( surface_t* surf, int x, int y, sprite_t *sprite );
 void graphics_draw_sprite_stride( surface_t* surf, int x, int y, sprite_t *sprite, int offset );
 void graphics_draw_sprite_trans( surface_t* surf, int x, int y, sprite_t *sprite );
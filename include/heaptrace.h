@@ -0,0 +1,125 @@
+/**
+ * @file heaptrace.h
+ * @brief Heap instrumentation and fragmentation reporting
+ * @ingroup system
+ */
+#ifndef __LIBDRAGON_HEAPTRACE_H
+#define __LIBDRAGON_HEAPTRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup heaptrace Heap instrumentation
+ * @ingroup system
+ * @brief Runtime visibility into the malloc heap
+ *
+ * The newlib heap is otherwise a black box: fragmentation is discovered
+ * only when a big allocation (eg: #surface_alloc) fails. libdragon wraps
+ * malloc/free/realloc/calloc/memalign (the wrappers forward straight to
+ * newlib and cost one predicted branch while tracing is off), and
+ * #heap_trace_init turns on lightweight accounting: bytes live, peak
+ * usage, allocation counts per call site (captured from the return
+ * address, one table update per allocation), and optionally guard words
+ * around each block to catch buffer overruns and invalid frees.
+ *
+ * All counters are queryable at runtime (#heap_trace_stats,
+ * #heap_trace_sites), summarized on the debug log (#heap_trace_report)
+ * and shown on the inspector performance HUD when active. Tracing is
+ * cheap enough for production builds; guard mode adds 16 bytes and one
+ * check per allocation and is meant for bug hunts.
+ *
+ * @{
+ */
+
+/** @brief Snapshot of the heap accounting counters */
+typedef struct
+{
+    uint32_t live_bytes;        ///< Bytes currently allocated
+    uint32_t peak_bytes;        ///< High-water mark of live_bytes
+    uint32_t total_allocs;      ///< Number of allocations served
+    uint32_t total_frees;       ///< Number of frees
+    uint32_t failed_allocs;     ///< Allocations that returned NULL
+    uint32_t guard_hits;        ///< Guard corruptions detected (guard mode)
+} heap_stats_t;
+
+/** @brief Accumulated allocations of one call site */
+typedef struct
+{
+    uint32_t pc;                ///< Address of the call to malloc
+    uint32_t count;             ///< Number of allocations from this site
+    uint32_t bytes;             ///< Total bytes requested by this site
+} heap_site_t;
+
+/** @} */
+
+/**
+ * @brief Start tracing heap activity.
+ *
+ * Tracing cannot be turned off once enabled (pointers carrying guard
+ * words must keep being recognized by free), but its passive cost is
+ * a few loads and stores per allocation.
+ *
+ * @param[in] guard  Also surround each malloc'd block with guard words,
+ *                   verified on free; corruptions are reported on the
+ *                   debug log and counted in #heap_stats_t::guard_hits
+ */
+void heap_trace_init(bool guard);
+
+/** @brief True if #heap_trace_init has been called */
+bool heap_trace_active(void);
+
+/**
+ * @brief Read the current accounting counters.
+ *
+ * @param[out] stats  Filled with a snapshot of the counters
+ * @return true if tracing is active (stats are zeroed otherwise)
+ */
+bool heap_trace_stats(heap_stats_t *stats);
+
+/**
+ * @brief Copy out the per-call-site allocation table.
+ *
+ * Sites are reported in no particular order. Call sites are raw code
+ * addresses; resolve them with the symbol table (see
+ * #backtrace_symbols).
+ *
+ * @param[out] sites  Destination array
+ * @param[in]  max    Capacity of the destination array
+ *
+ * @return Number of entries written
+ */
+int heap_trace_sites(heap_site_t *sites, int max);
+
+/**
+ * @brief Measure the largest currently allocatable block.
+ *
+ * Probes the heap with trial allocations (immediately freed), so it is
+ * meant for on-demand diagnostics, not per-frame use. Comparing the
+ * result with the total free space from mallinfo() quantifies
+ * fragmentation: a large gap means the free space is shattered into
+ * small chunks.
+ *
+ * @return Size in bytes of the largest single allocation that would
+ *         currently succeed
+ */
+int heap_trace_largest_free(void);
+
+/**
+ * @brief Print a heap summary on the debug log.
+ *
+ * Includes the accounting counters, the free-list summary from
+ * mallinfo(), the largest allocatable block with a fragmentation
+ * percentage, and the busiest allocation call sites.
+ */
+void heap_trace_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
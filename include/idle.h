@@ -0,0 +1,86 @@
+/**
+ * @file idle.h
+ * @brief Idle-task scheduler for spare frame time
+ * @ingroup display
+ */
+#ifndef __LIBDRAGON_IDLE_H
+#define __LIBDRAGON_IDLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief One idle task.
+ *
+ * An idle task performs a small, bounded chunk of background work per call
+ * (eg: decompress one chunk of an asset, prefetch one page of a file, flush
+ * a block of profiler records) and returns quickly: the scheduler checks the
+ * frame deadline between calls, so a task that runs long eats into the next
+ * frame. Return true if the task has more work pending, false if it has
+ * nothing to do right now (it stays registered and is polled again on the
+ * next idle period).
+ */
+typedef bool (*idle_task_t)(void *ctx);
+
+/**
+ * @brief Register an idle task.
+ *
+ * Registered tasks are called round-robin by #idle_run during the spare
+ * time at the end of each frame. Tasks run in the context of the caller of
+ * #idle_run (normally the main loop, right after #display_show).
+ *
+ * @param[in] task
+ *            Task to register
+ * @param[in] ctx
+ *            Opaque argument passed to the task on every call
+ *
+ * @return An identifier to pass to #idle_task_remove
+ */
+int idle_task_add(idle_task_t task, void *ctx);
+
+/**
+ * @brief Unregister an idle task.
+ *
+ * @param[in] id
+ *            Identifier returned by #idle_task_add
+ */
+void idle_task_remove(int id);
+
+/**
+ * @brief Configure the safety margin before vblank.
+ *
+ * #idle_run stops dispatching tasks when fewer than this many halflines
+ * remain before the vblank, leaving room for the last task chunk to finish
+ * without pushing the frame over. The default of 16 halflines is about
+ * half a millisecond. Raise it if tasks run coarser chunks.
+ *
+ * @param[in] halflines
+ *            Margin in video halflines
+ */
+void idle_set_margin(uint32_t halflines);
+
+/**
+ * @brief Run idle tasks until the frame deadline.
+ *
+ * Call this once per frame after #display_show: the frame is done but the
+ * flip only happens at vblank, so the time until then is pure slack.
+ * Registered tasks are dispatched round-robin, one chunk at a time, until
+ * either the VI line counter says the vblank is closer than the configured
+ * margin (see #idle_set_margin) or every task reported having no work.
+ * Turning this average-case headroom into prefetching and deferred
+ * housekeeping is what flattens the worst-case frames.
+ *
+ * If the VI is not currently generating video (no deadline can be derived
+ * from the line counter), the function returns immediately.
+ */
+void idle_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file inspector.h
+ * @brief Debug overlays: performance HUD
+ * @ingroup debug
+ */
+#ifndef __LIBDRAGON_INSPECTOR_H
+#define __LIBDRAGON_INSPECTOR_H
+
+#include "surface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the performance HUD.
+ *
+ * The HUD shows a live budget readout on top of the application's own
+ * frames: per-frame CPU time against the video refresh budget, RSP and
+ * RDP utilization, heap usage and the PI transfer queue depth, each
+ * rendered as a bar with a short history graph.
+ *
+ * RSP utilization is measured by sampling the SP status register from a
+ * periodic timer, so #timer_init must have been called. RDP utilization
+ * comes from the free-running DP clock/busy counters and costs nothing.
+ *
+ * After initialization, call #inspector_hud_draw once per frame on the
+ * surface about to be shown (typically right before #display_show).
+ */
+void inspector_hud_init(void);
+
+/** @brief Stop the performance HUD and release its sampling timer. */
+void inspector_hud_close(void);
+
+/**
+ * @brief Update the HUD metrics and draw the HUD onto a surface.
+ *
+ * Call this exactly once per frame: the time between two calls is what
+ * the HUD accounts as the frame. Drawing uses the CPU (same renderer as
+ * the exception inspector), so call it after all RDP rendering to the
+ * surface is finished.
+ *
+ * @param[in] disp   Surface to draw the HUD on (usually from #display_lock)
+ */
+void inspector_hud_draw(surface_t *disp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,6 +7,7 @@
 #define __LIBDRAGON_INTERRUPT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,6 +31,47 @@ typedef enum
     INTERRUPTS_ENABLED
 } interrupt_state_t;
 
+/**
+ * @brief Interrupt sources routed through the MIPS interface (MI)
+ *
+ * These identify the RCP interrupt sources for the priority and
+ * instrumentation APIs (#interrupt_set_priority, #interrupt_get_stats).
+ */
+typedef enum
+{
+    /** @brief RSP interrupt (break or request) */
+    INTERRUPT_SOURCE_SP,
+    /** @brief Serial interface interrupt (PIF DMA completed) */
+    INTERRUPT_SOURCE_SI,
+    /** @brief Audio interface interrupt (audio buffer consumed) */
+    INTERRUPT_SOURCE_AI,
+    /** @brief Video interface interrupt (configured line reached) */
+    INTERRUPT_SOURCE_VI,
+    /** @brief Peripheral interface interrupt (PI DMA completed) */
+    INTERRUPT_SOURCE_PI,
+    /** @brief RDP interrupt (full sync reached) */
+    INTERRUPT_SOURCE_DP,
+    /** @brief Number of MI interrupt sources */
+    INTERRUPT_SOURCE_COUNT
+} interrupt_source_t;
+
+/**
+ * @brief Dispatch statistics for one MI interrupt source
+ *
+ * All times are expressed in hardware ticks (see #TICKS_READ).
+ */
+typedef struct
+{
+    /** @brief Number of interrupts serviced for this source */
+    uint32_t count;
+    /** @brief Worst-case delay between MI dispatch start and this source's callbacks */
+    uint32_t max_latency;
+    /** @brief Worst-case duration of this source's callback chain */
+    uint32_t max_duration;
+    /** @brief Cumulative time spent in this source's callback chain */
+    uint64_t total_duration;
+} interrupt_stats_t;
+
 /** @} */
 
 void register_AI_handler( void (*callback)() );
@@ -52,6 +94,44 @@ void unregister_TI_handler( void (*callback)() );
 void unregister_CART_handler( void (*callback)() );
 void unregister_RESET_handler( void (*callback)() );
 
+void register_VI_scanline_handler( unsigned long line, void (*callback)() );
+void unregister_VI_scanline_handler( void (*callback)() );
+
+/**
+ * @name Leaf interrupt handlers
+ *
+ * A leaf handler is a reduced-context dispatch path for trivial, very
+ * frequent interrupts (AI buffer refills, timer ticks): instead of building
+ * the full exception frame, the interrupt handler spills only a small set
+ * of registers, acknowledges the device itself, and calls the handler
+ * directly, roughly halving the fixed per-interrupt overhead.
+ *
+ * In exchange, a leaf handler must honor a strict contract:
+ *
+ *  * it may clobber only AT, v0-v1, a0-a3, t0-t3, ra and LO/HI. Plain C
+ *    functions can use more temporaries; either keep the handler trivial
+ *    enough to verify the generated code, or compile its file with
+ *    `-ffixed-t4 -ffixed-t5 -ffixed-t6 -ffixed-t7 -ffixed-t8 -ffixed-t9`;
+ *  * it must not use the FPU (the FPU is disabled during the call, so a
+ *    violation traps as a fatal COP1-unusable exception rather than
+ *    corrupting the interrupted code);
+ *  * it runs with the exception level still set: it cannot be preempted,
+ *    must not re-enable interrupts, and must be short.
+ *
+ * Only one leaf handler per source can be registered, and it cannot
+ * coexist with regular callbacks for the same source (for the timer, that
+ * includes the timer library). Handlers that need more than the contract
+ * allows should use the regular #register_AI_handler/#register_TI_handler
+ * instead, which saves the full caller-saved context. Leaf dispatches are
+ * not accounted in #interrupt_stats nor in #interrupt_total_time.
+ */
+/** @{ */
+void register_AI_leaf_handler( void (*callback)(void) );
+void unregister_AI_leaf_handler( void (*callback)(void) );
+void register_TI_leaf_handler( void (*callback)(void) );
+void unregister_TI_leaf_handler( void (*callback)(void) );
+/** @} */
+
 void set_AI_interrupt( int active );
 void set_VI_interrupt( int active, unsigned long line );
 void set_PI_interrupt( int active );
@@ -87,10 +167,35 @@ void register_reset_handler( void (*callback)() )
     register_RESET_handler(callback);
 }
 
+void interrupt_set_priority( interrupt_source_t source, int priority );
+void interrupt_set_preemption( int active );
+void interrupt_get_stats( interrupt_source_t source, interrupt_stats_t *stats );
+void interrupt_reset_stats( void );
+uint64_t interrupt_total_time( void );
+
 void enable_interrupts();
 void disable_interrupts();
 
-interrupt_state_t get_interrupts_state(); 
+interrupt_state_t get_interrupts_state();
+
+/**
+ * @brief Check whether the CPU is currently servicing an interrupt
+ *
+ * Returns true while the CPU is running an interrupt callback dispatched by
+ * the interrupt controller (any MI source, or the timer interrupt),
+ * including callbacks preempted by a higher-priority source (see
+ * #interrupt_set_preemption). Note that this is different from
+ * #get_interrupts_state, which reports the explicit
+ * #disable_interrupts/#enable_interrupts nesting: interrupt callbacks run
+ * with interrupts implicitly disabled, without going through those.
+ *
+ * This can be used by code that must behave differently when called from an
+ * interrupt handler (eg: skipping work that could race with the interrupted
+ * main loop).
+ *
+ * @return true if called from an interrupt callback, false otherwise
+ */
+bool interrupt_in_handler( void );
 
 #ifdef __cplusplus
 }
@@ -8,6 +8,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 /**
  * @addtogroup lowlevel
@@ -28,7 +29,21 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Callback invoked when a scheduled Joybus command completes.
+ *
+ * Receives a pointer to the bytes the command read back from the PIF
+ * block. Runs in interrupt context; keep it short.
+ */
+typedef void (*joybus_sched_callback_t)( uint8_t *rx, void *ctx );
+
 void joybus_exec( const void * inblock, void * outblock );
+void joybus_sched_init( void );
+void joybus_sched_close( void );
+bool joybus_sched_submit( int channel, const uint8_t *tx, int tx_len, int rx_len,
+    joybus_sched_callback_t callback, void *ctx );
+void joybus_sched_flush( void );
+bool joybus_sched_active( void );
 
 #ifdef __cplusplus
 }
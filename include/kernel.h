@@ -0,0 +1,179 @@
+/**
+ * @file kernel.h
+ * @brief Cooperative threading kernel
+ * @ingroup kernel
+ */
+#ifndef __LIBDRAGON_KERNEL_H
+#define __LIBDRAGON_KERNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup kernel Cooperative threading kernel
+ * @ingroup libdragon
+ * @brief Small cooperative threading kernel for overlapping I/O and computation
+ *
+ * This module implements a minimal cooperative (non-preemptive) threading
+ * kernel. Threads run until they explicitly give up the CPU by yielding
+ * (#kthread_yield), sleeping on the hardware timer (#kthread_sleep), or
+ * suspending until another thread or an interrupt handler wakes them
+ * (#kthread_suspend / #kthread_wake). Because switches only happen at these
+ * well-known points, threads never need locks around data they share with
+ * other threads -- only data shared with interrupt handlers requires the
+ * usual #disable_interrupts critical sections.
+ *
+ * The intended use is to overlap slow I/O with computation: for instance a
+ * streaming thread can start a PI DMA transfer and suspend itself, with the
+ * completion callback calling #kthread_wake, while the main thread keeps
+ * simulating; an audio thread can sleep until the next mixer deadline instead
+ * of being polled from the main loop.
+ *
+ * Call #kernel_init once to turn the running code into the "main" thread,
+ * then create additional threads with #kthread_new. The scheduler is a
+ * simple round-robin over the threads that are ready to run; when no thread
+ * is ready, the kernel idles with interrupts enabled waiting for one to be
+ * woken by an interrupt.
+ *
+ * #kthread_sleep requires the timer subsystem (#timer_init).
+ *
+ * @{
+ */
+
+/** @brief State of a thread */
+typedef enum
+{
+    /** @brief Thread is ready to run (queued in the scheduler) */
+    KTHREAD_READY,
+    /** @brief Thread is currently running */
+    KTHREAD_RUNNING,
+    /** @brief Thread is blocked waiting for #kthread_wake */
+    KTHREAD_BLOCKED,
+    /** @brief Thread has exited and waits to be reaped */
+    KTHREAD_ZOMBIE,
+} kthread_state_t;
+
+/**
+ * @brief A thread
+ *
+ * The structure is allocated by #kthread_new together with the thread stack,
+ * and freed automatically when the thread exits. Application code should
+ * treat it as opaque and only store pointers to it (for #kthread_wake).
+ */
+typedef struct kthread
+{
+    /** @brief Saved callee-saved register context (must be first) */
+    uint64_t ctx[19];
+    /** @brief Name of the thread (for debugging) */
+    const char *name;
+    /** @brief Current state of the thread */
+    kthread_state_t state;
+    /** @brief Link in the scheduler ready queue */
+    struct kthread *next;
+    /** @brief Entry point of the thread */
+    void (*entry)(void *arg);
+    /** @brief Argument passed to the entry point */
+    void *arg;
+    /** @brief Timer used by #kthread_sleep */
+    timer_link_t sleep_timer;
+    /** @brief Set if a wake arrived while the thread was not suspended */
+    bool wake_pending;
+} kthread_t;
+
+/** @} */
+
+/**
+ * @brief Initialize the threading kernel
+ *
+ * Turns the currently running code into the "main" thread, from which
+ * additional threads can be spawned with #kthread_new.
+ */
+void kernel_init(void);
+
+/**
+ * @brief Shut down the threading kernel
+ *
+ * Must be called from the main thread, after all other threads have exited.
+ */
+void kernel_close(void);
+
+/**
+ * @brief Create a new thread
+ *
+ * The thread starts running at @p entry the next time the current thread
+ * yields the CPU. When @p entry returns, the thread exits and its memory is
+ * freed automatically.
+ *
+ * @param[in] name
+ *            Name of the thread (not copied; must outlive the thread)
+ * @param[in] stack_size
+ *            Size of the thread stack in bytes
+ * @param[in] entry
+ *            Entry point of the thread
+ * @param[in] arg
+ *            Argument passed to the entry point
+ *
+ * @return The new thread, or NULL if allocation failed
+ */
+kthread_t *kthread_new(const char *name, int stack_size, void (*entry)(void *arg), void *arg);
+
+/** @brief Return the currently running thread */
+kthread_t *kthread_current(void);
+
+/**
+ * @brief Give up the CPU to the next ready thread
+ *
+ * If no other thread is ready, returns immediately.
+ */
+void kthread_yield(void);
+
+/**
+ * @brief Put the current thread to sleep for the specified time
+ *
+ * Other threads keep running in the meantime. Requires #timer_init.
+ *
+ * @param[in] ticks
+ *            Number of hardware ticks to sleep (see #TIMER_TICKS)
+ */
+void kthread_sleep(int ticks);
+
+/**
+ * @brief Suspend the current thread until it is woken with #kthread_wake
+ */
+void kthread_suspend(void);
+
+/**
+ * @brief Make a suspended thread ready to run again
+ *
+ * This function is safe to call from interrupt handlers, which makes it the
+ * building block for wake-on-interrupt: start an asynchronous operation,
+ * call #kthread_suspend, and call #kthread_wake on the thread from the
+ * completion callback.
+ *
+ * Waking a thread that is not suspended is a no-op, except that a thread
+ * currently in #kthread_sleep is woken up early.
+ *
+ * @param[in] thread
+ *            The thread to wake
+ */
+void kthread_wake(kthread_t *thread);
+
+/**
+ * @brief Terminate the current thread
+ *
+ * Equivalent to returning from the thread entry point. Must not be called
+ * from the main thread.
+ */
+__attribute__((noreturn))
+void kthread_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,32 +29,51 @@
 #include "audio.h"
 #include "console.h"
 #include "debug.h"
+#include "bootprof.h"
+#include "flightrec.h"
+#include "capture.h"
+#include "heaptrace.h"
 #include "joybus.h"
 #include "controller.h"
 #include "rtc.h"
 #include "mempak.h"
 #include "tpak.h"
 #include "display.h"
+#include "idle.h"
 #include "dma.h"
 #include "dragonfs.h"
 #include "asset.h"
+#include "arena.h"
 #include "eeprom.h"
 #include "eepromfs.h"
 #include "graphics.h"
+#include "fmath.h"
 #include "interrupt.h"
+#include "inspector.h"
 #include "n64sys.h"
 #include "backtrace.h"
 #include "rdp.h"
 #include "rsp.h"
+#include "rspmem.h"
 #include "timer.h"
+#include "kernel.h"
+#include "profiler.h"
+#include "perf.h"
 #include "exception.h"
+#include "stackguard.h"
+#include "tunables.h"
 #include "dir.h"
 #include "mixer.h"
 #include "samplebuffer.h"
 #include "wav64.h"
 #include "xm64.h"
 #include "ym64.h"
+#include "video64.h"
+#include "font64.h"
 #include "rspq.h"
+#include "rspq_rdp.h"
+#include "tnl.h"
+#include "skin.h"
 #include "surface.h"
 #include "debugcpp.h"
 
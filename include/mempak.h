@@ -54,6 +54,8 @@ extern "C" {
 #endif
 
 int read_mempak_sector( int controller, int sector, uint8_t *sector_data );
+int read_mempak_sectors( int controller, int sector, int num_sectors, uint8_t *sector_data,
+    void (*progress)(int done, int total) );
 int write_mempak_sector( int controller, int sector, uint8_t *sector_data );
 int validate_mempak( int controller );
 int get_mempak_free_space( int controller );
@@ -62,6 +64,8 @@ int format_mempak( int controller );
 int read_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *data );
 int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *data );
 int delete_mempak_entry( int controller, entry_structure_t *entry );
+int mempak_shadow_enable( int controller );
+void mempak_shadow_disable( int controller );
 
 #ifdef __cplusplus
 }
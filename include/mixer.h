@@ -200,13 +200,61 @@ void mixer_ch_play(int ch, waveform_t *wave);
  * 
  * This function must be called after mixer_ch_play, as otherwise the
  * frequency is reset to the default of the waveform.
- * 
+ *
+ * The resampling step is computed against the exact DAC output rate (see
+ * #audio_get_frequency_exact). Frequencies that match the nominal output
+ * rate up to the DAC quantization error (about 0.1%) are snapped to a
+ * unitary step, so such waveforms pass through with no resampling at all.
+ *
  * @param[in]   ch              Channel index
  * @param[in]   frequency       Playback frequency (in Hz / samples per second)
  */
 void mixer_ch_set_freq(int ch, float frequency);
 
-/** 
+/** @brief Resampling quality of a mixer channel (see #mixer_ch_set_quality). */
+typedef enum {
+	/** @brief Nearest-neighbor resampling (default).
+	 *
+	 * The cheapest option: each output sample is the input sample closest
+	 * to the resampling position. This is perfectly adequate for noise-like
+	 * content (percussions, sound effects) and for waveforms that play at
+	 * (or near) their original frequency.
+	 */
+	MIXER_QUALITY_NEAREST = 0,
+
+	/** @brief Linear interpolation between adjacent samples.
+	 *
+	 * Interpolate linearly between the two input samples surrounding the
+	 * resampling position. This removes most of the aliasing that
+	 * nearest-neighbor introduces on tonal content played far from its
+	 * original frequency (eg: pitched-down music stems), at the cost of a
+	 * slower RSP resampling loop for the channel.
+	 *
+	 * Linear interpolation is only implemented for 16-bit waveforms: 8-bit
+	 * waveforms fall back to nearest-neighbor.
+	 */
+	MIXER_QUALITY_LINEAR = 1,
+} mixer_quality_t;
+
+/**
+ * @brief Select the resampling quality for the specified channel.
+ *
+ * By default, all channels resample with #MIXER_QUALITY_NEAREST, which is
+ * the fastest option. Use this function to opt specific channels into
+ * higher-quality (but slower) resampling; a typical split is linear
+ * interpolation on music channels and nearest-neighbor on sound effects,
+ * which often cannot be distinguished from the higher quality resampling
+ * anyway.
+ *
+ * The setting is sticky: it applies to the waveform currently playing on
+ * the channel (if any) and to all subsequent ones, until changed again.
+ *
+ * @param[in]   ch              Channel index
+ * @param[in]   quality         Resampling quality for this channel
+ */
+void mixer_ch_set_quality(int ch, mixer_quality_t quality);
+
+/**
  * @brief Change the current playback position within a waveform. 
  * 
  * This function can be useful to seek to a specific point of the waveform.
@@ -305,6 +353,30 @@ void mixer_ch_set_limits(int ch, int max_bits, float max_frequency, int max_buf_
  */
 void mixer_poll(int16_t *out, int nsamples);
 
+/**
+ * @brief Attach the mixer to the audio subsystem (incremental mixing).
+ *
+ * This function registers #mixer_poll as the audio fill callback (see
+ * #audio_set_buffer_callback), so that mixing proceeds incrementally in
+ * slices, driven by the AI interrupt, rather than in explicit bursts from
+ * the main loop.
+ *
+ * Channel parameter changes (#mixer_ch_play, #mixer_ch_set_freq, etc.) take
+ * effect at the next slice boundary. Combined with #audio_set_slice_length,
+ * this allows sub-20 ms trigger-to-DAC latency, as the slices can be much
+ * shorter than the full audio buffers that a manual #mixer_poll loop must
+ * fill in one go.
+ */
+void mixer_poll_attach(void);
+
+/**
+ * @brief Detach the mixer from the audio subsystem.
+ *
+ * After calling this function, #mixer_poll must be called manually again
+ * to produce samples.
+ */
+void mixer_poll_detach(void);
+
 /**
  * @brief Callback invoked by mixer_poll at a specified time
  * 
@@ -440,10 +512,17 @@ typedef struct waveform_s {
 	/** @brief Name of the waveform (for debugging purposes) */
 	const char *name;
 
-	/** 
+	/**
      * @brief Width of a sample of this waveform, in bits.
-     * 
+     *
      * Supported values are 8 or 16. Notice that samples must always be signed.
+     *
+     * 8-bit waveforms are processed natively through the whole pipeline:
+     * they are stored as 8-bit in the channel sample buffer, fetched via
+     * DMA at one byte per sample, and widened by the RSP in DMEM while
+     * resampling. Using 8-bit thus halves the memory footprint and DMA
+     * bandwidth of a channel with no CPU cost; pair it with
+     * #mixer_ch_set_limits to also halve the sample buffer allocation.
      */
 	uint8_t bits;
 
@@ -485,6 +564,40 @@ typedef struct waveform_s {
 
 	/** @brief Opaque pointer provided as context to the read function. */
 	void *ctx;
+
+	/**
+	 * @brief Memory-resident sample data (zero-copy mode), or NULL.
+	 *
+	 * If non-NULL, the samples of this waveform are fully resident in memory
+	 * at this address (followed by #MIXER_LOOP_OVERREAD bytes of padding),
+	 * and the mixer will play them directly from here: no staging through
+	 * the channel sample buffer happens, and the read callback is never
+	 * invoked. The pointer must be in the uncached segment (or the data must
+	 * be committed to RDRAM), since samples are fetched by the RSP.
+	 *
+	 * Because the RSP handles the loop natively in this mode, looping
+	 * memory-resident waveforms are limited to 512 KiB of sample data.
+	 *
+	 * See #wav64_preload for a ready-made implementation for WAV64 files.
+	 */
+	void *samples;
+
+	/**
+	 * @brief Request caching of the loop region in RDRAM.
+	 *
+	 * If true and the waveform loops (`loop_len != 0`), the mixer pins the
+	 * loop region in RDRAM after it has been decoded for the first time, and
+	 * serves subsequent loop iterations from the cached copy instead of
+	 * invoking the read callback again. This removes the steady trickle of
+	 * ROM transfers otherwise caused by long always-playing loops (such as
+	 * ambience beds), at the cost of keeping the whole loop resident in
+	 * memory.
+	 *
+	 * This is only relevant for loops that do not fit the channel sample
+	 * buffer: shorter loops are already kept cached there. See also
+	 * #wav64_set_loop_cache.
+	 */
+	bool loop_cache;
 } waveform_t;
 
 /** @brief Maximum number of samples in a waveform */
@@ -250,12 +250,50 @@ void wait_ms( unsigned long wait_ms );
 void __data_cache_hit_invalidate(volatile void * addr, unsigned long length);
 void data_cache_hit_writeback(volatile const void *, unsigned long);
 void data_cache_hit_writeback_invalidate(volatile void *, unsigned long);
+void data_cache_hit_create_dirty(volatile void *, unsigned long);
 void data_cache_index_writeback_invalidate(volatile void *, unsigned long);
 void data_cache_writeback_invalidate_all(void);
 void inst_cache_hit_writeback(volatile const void *, unsigned long);
 void inst_cache_hit_invalidate(volatile void *, unsigned long);
 void inst_cache_index_invalidate(volatile void *, unsigned long);
 void inst_cache_invalidate_all(void);
+void inst_cache_prefetch(volatile const void *, unsigned long);
+void hot_text_prefetch(void);
+
+/**
+ * @brief Place a function in the hot code region
+ *
+ * Functions annotated with this macro are laid out contiguously at the
+ * start of the text segment by the linker script (see n64.ld), instead
+ * of wherever link order happens to put them. The VR4300 instruction
+ * cache is direct-mapped, so two functions whose addresses are 16 KB
+ * apart evict each other on every alternation; a contiguous hot region
+ * that fits in the cache never conflicts with itself, which removes
+ * exactly those pathological misses from the code that runs every frame.
+ *
+ * Annotate the inner-loop functions that dominate your frame time (use
+ * the profiler to find them), keep their combined size under the 16 KB
+ * instruction cache, and optionally warm the region at boot with
+ * #hot_text_prefetch. The macro also carries the compiler `hot`
+ * attribute, so branches leading to these functions are predicted taken.
+ *
+ * @code{.c}
+ *      HOT_CODE void mixer_poll(short *out, int nsamples) { ... }
+ * @endcode
+ */
+#define HOT_CODE    __attribute__((hot, section(".hottext")))
+
+/**
+ * @brief Place a function in the cold code region
+ *
+ * The counterpart of #HOT_CODE: functions annotated with this macro are
+ * moved to the end of the text segment, so initialization, error paths
+ * and other rarely-running code stops interleaving with (and polluting
+ * the cache lines of) the code that runs every frame. The macro also
+ * carries the compiler `cold` attribute, which optimizes the function
+ * for size and predicts branches leading to it as not taken.
+ */
+#define COLD_CODE   __attribute__((cold, section(".coldtext")))
 
 int get_memory_size();
 bool is_memory_expanded();
@@ -263,6 +301,37 @@ void *malloc_uncached(size_t size);
 void *malloc_uncached_aligned(int align, size_t size);
 void free_uncached(void *buf);
 
+/**
+ * @brief A DMA-visible memory buffer
+ *
+ * This structure pairs an uncached allocation (see #malloc_uncached) with
+ * its size, so that the cache maintenance required to access the buffer
+ * through the cached segment always covers exactly the right range. Use it
+ * instead of hand-rolling #UncachedAddr casts and cache invalidations for
+ * buffers exchanged with the hardware (PI DMA, RSP, AI).
+ *
+ * Typical usage: DMA engines and hardware are given #dma_buffer_uncached;
+ * CPU-intensive processing of the contents goes through #dma_buffer_cached,
+ * followed by a #dma_buffer_sync before the hardware touches the buffer
+ * again.
+ */
+typedef struct
+{
+    /** @brief Pointer to the buffer in the uncached segment */
+    void *buf;
+    /** @brief Size of the buffer in bytes */
+    size_t size;
+} dma_buffer_t;
+
+void *memcpy_stream(void *dst, const void *src, size_t n);
+
+dma_buffer_t dma_buffer_alloc(size_t size);
+dma_buffer_t dma_buffer_alloc_aligned(int align, size_t size);
+void dma_buffer_free(dma_buffer_t *dmabuf);
+void *dma_buffer_uncached(const dma_buffer_t *dmabuf);
+void *dma_buffer_cached(const dma_buffer_t *dmabuf);
+void dma_buffer_sync(const dma_buffer_t *dmabuf);
+
 /** @brief Type of TV video output */
 typedef enum {
     TV_PAL = 0,      ///< Video output is PAL
@@ -0,0 +1,123 @@
+/**
+ * @file perf.h
+ * @brief Scoped performance counters and cache characterization
+ * @ingroup lowlevel
+ */
+#ifndef __LIBDRAGON_PERF_H
+#define __LIBDRAGON_PERF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A scoped cycle measurement.
+ *
+ * Fill with #perf_span_begin / #perf_span_end around the code of
+ * interest. On end, @ref ticks holds the elapsed hardware ticks with
+ * the measurement overhead already subtracted, and @ref interrupt_ticks
+ * holds how much of that window was spent servicing interrupts, so
+ * `ticks - interrupt_ticks` is the time the measured code actually ran.
+ * Ticks convert to time with #TIMER_MICROS.
+ *
+ * This is complementary to the sampling profiler (see profiler.h):
+ * spans measure one specific region exactly, the profiler measures
+ * where a whole program spends its time statistically.
+ */
+typedef struct
+{
+    /** @brief Tick counter at #perf_span_begin (internal) */
+    uint32_t start_ticks;
+    /** @brief Interrupt time counter at #perf_span_begin (internal) */
+    uint64_t start_int_ticks;
+    /** @brief Measured duration in ticks, net of measurement overhead */
+    uint32_t ticks;
+    /** @brief Ticks of the span spent inside interrupt handlers */
+    uint32_t interrupt_ticks;
+} perf_span_t;
+
+/**
+ * @brief Cache behavior of a code region, as measured by #perf_cache_profile.
+ *
+ * Miss estimates are derived by timing the region warm and after a full
+ * cache invalidation, and dividing the difference by a calibrated
+ * per-line miss cost; they are estimates, not hardware counts (the
+ * VR4300 has no cache event counters), but track real miss behavior
+ * closely for memory-bound code.
+ */
+typedef struct
+{
+    /** @brief Duration of a run with warm caches, in ticks */
+    uint32_t warm_ticks;
+    /** @brief Duration of a run after invalidating the data cache */
+    uint32_t cold_d_ticks;
+    /** @brief Duration of a run after invalidating the instruction cache */
+    uint32_t cold_i_ticks;
+    /** @brief Estimated number of data cache lines the region touches */
+    int est_dcache_lines;
+    /** @brief Estimated number of instruction cache lines the region touches */
+    int est_icache_lines;
+} perf_cache_profile_t;
+
+/**
+ * @brief Begin a scoped measurement.
+ *
+ * The first call calibrates the measurement overhead (a few
+ * microseconds, once); subsequent calls cost a handful of cycles.
+ *
+ * @param[in] span  Span to start. One span can be reused across
+ *                  measurements but not nested with itself.
+ */
+void perf_span_begin( perf_span_t *span );
+
+/**
+ * @brief End a scoped measurement, filling in the results.
+ *
+ * @param[in] span  Span previously started with #perf_span_begin
+ */
+void perf_span_end( perf_span_t *span );
+
+/**
+ * @brief Characterize the cache behavior of a code region.
+ *
+ * Runs @p fn several times with interrupts disabled: once to warm the
+ * caches, once timed warm, once timed after writing back and
+ * invalidating the whole data cache, and once timed after invalidating
+ * the whole instruction cache. The cold-versus-warm differences,
+ * divided by a calibrated per-line miss cost, estimate how many cache
+ * lines the region touches (see #perf_cache_profile_t).
+ *
+ * @p fn must be repeatable: it runs 4 times with the same argument, and
+ * because interrupts stay disabled throughout, it should complete in at
+ * most a few milliseconds to avoid audio or video hiccups.
+ *
+ * @param[in]  fn   Code region to measure
+ * @param[in]  arg  Opaque argument passed to @p fn on every run
+ * @param[out] out  Filled with the measured profile
+ */
+void perf_cache_profile( void (*fn)(void *arg), void *arg, perf_cache_profile_t *out );
+
+/**
+ * @brief Calibrated cost in ticks of one data cache line miss.
+ *
+ * Measured once (lazily) by timing strided reads over an invalidated
+ * buffer. Useful to convert the tick deltas in #perf_cache_profile_t
+ * back and forth between time and line counts.
+ */
+uint32_t perf_dcache_miss_ticks( void );
+
+/**
+ * @brief Calibrated cost in ticks of one instruction cache line miss.
+ *
+ * Measured once (lazily) by timing a generated straight-line code
+ * buffer after invalidating it from the instruction cache.
+ */
+uint32_t perf_icache_miss_ticks( void );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file profiler.h
+ * @brief CPU sampling profiler
+ * @ingroup lowlevel
+ */
+#ifndef __LIBDRAGON_PROFILER_H
+#define __LIBDRAGON_PROFILER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the CPU sampling profiler.
+ *
+ * The profiler uses a continuous timer (so #timer_init must have been
+ * called) to periodically interrupt the CPU and record the interrupted
+ * program counter into a ring buffer in RDRAM. The recorded samples can
+ * later be aggregated into a flat profile with #profiler_dump (which
+ * resolves addresses against the `.sym` symbol table produced by n64sym,
+ * when present in the rompak), or emitted raw with #profiler_dump_raw
+ * for offline processing.
+ *
+ * Sampling has a small fixed cost per sample; 1000 Hz is a good default
+ * rate, giving ~1 ms resolution with negligible overhead.
+ *
+ * @param[in] hz            Sampling frequency in Hertz (1 .. 10000)
+ * @param[in] max_samples   Capacity of the sample ring buffer. When full,
+ *                          the oldest samples are overwritten.
+ */
+void profiler_init(int hz, int max_samples);
+
+/** @brief Stop the profiler and free the sample ring buffer. */
+void profiler_close(void);
+
+/**
+ * @brief Temporarily pause sampling.
+ *
+ * Recorded samples are kept; sampling can be resumed with
+ * #profiler_resume.
+ */
+void profiler_pause(void);
+
+/** @brief Resume sampling after a #profiler_pause. */
+void profiler_resume(void);
+
+/** @brief Discard all recorded samples. */
+void profiler_reset(void);
+
+/** @brief Return the total number of samples recorded so far.
+ *
+ * This can exceed the ring capacity; in that case only the most recent
+ * samples are retained.
+ */
+uint32_t profiler_sample_count(void);
+
+/**
+ * @brief Aggregate the recorded samples and dump a flat profile via #debugf.
+ *
+ * Samples are grouped by function (resolved through the symbol table,
+ * like exception backtraces) and printed sorted by decreasing hit count,
+ * with the percentage of total samples for each. Without a symbol table,
+ * samples are grouped by address.
+ *
+ * Sampling is paused while the dump runs, so the dump itself does not
+ * pollute the profile.
+ *
+ * @param[in] max_rows   Maximum number of rows to print (0 = no limit)
+ */
+void profiler_dump(int max_rows);
+
+/**
+ * @brief Dump the raw program counter samples via #debugf.
+ *
+ * Each sample is printed as a hexadecimal address, 8 per line, between
+ * `PROFILER-RAW-BEGIN` / `PROFILER-RAW-END` markers, so that host-side
+ * tooling can capture the stream from the USB log and post-process it
+ * (e.g. symbolize against the ELF, or fold into flame-graph input).
+ */
+void profiler_dump_raw(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -55,6 +55,23 @@ typedef enum
     FLUSH_STRATEGY_AUTOMATIC
 } flush_t;
 
+/**
+ * @brief A single sprite instance in a batched draw
+ *
+ * @see #rdp_draw_sprite_batch
+ */
+typedef struct
+{
+    /** @brief Sprite to draw */
+    sprite_t *sprite;
+    /** @brief The pixel X location of the top left of the sprite */
+    int x;
+    /** @brief The pixel Y location of the top left of the sprite */
+    int y;
+    /** @brief Whether the texture should be mirrored */
+    mirror_t mirror;
+} rdp_sprite_instance_t;
+
 /** @} */
 
 #ifdef __cplusplus
@@ -63,6 +80,7 @@ extern "C" {
 
 void rdp_init( void );
 void rdp_attach( surface_t* disp );
+void rdp_attach_zbuffer( surface_t* zbuffer );
 void rdp_detach( void );
 void rdp_sync( sync_t sync );
 void rdp_set_clipping( uint32_t tx, uint32_t ty, uint32_t bx, uint32_t by );
@@ -70,16 +88,36 @@ void rdp_set_default_clipping( void );
 void rdp_enable_primitive_fill( void );
 void rdp_enable_blend_fill( void );
 void rdp_enable_texture_copy( void );
+void rdp_enable_blend_fill_zbuffer( void );
+void rdp_enable_texture_zbuffer( void );
+void rdp_enable_texture_yuv( void );
+void rdp_set_primitive_depth( uint16_t depth );
 uint32_t rdp_load_texture( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite );
 uint32_t rdp_load_texture_stride( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite, int offset );
+uint32_t rdp_load_texture_mipmap( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite, int level );
+uint32_t rdp_load_yuv_texture( uint32_t texslot, uint32_t texloc, void *buffer, int width, int height );
+void rdp_load_palette( uint16_t *palette, int num_colors );
+void rdp_draw_surface_ci8( uint32_t texslot, surface_t *surface, uint16_t *palette, int num_colors, int x, int y );
+int rdp_sprite_mipmap_levels( sprite_t *sprite );
 void rdp_draw_textured_rectangle( uint32_t texslot, int tx, int ty, int bx, int by,  mirror_t mirror );
 void rdp_draw_textured_rectangle_scaled( uint32_t texslot, int tx, int ty, int bx, int by, double x_scale, double y_scale,  mirror_t mirror );
+void rdp_draw_textured_sub_rectangle( uint32_t texslot, int tx, int ty, int s, int t, int width, int height );
 void rdp_draw_sprite( uint32_t texslot, int x, int y ,  mirror_t mirror);
 void rdp_draw_sprite_scaled( uint32_t texslot, int x, int y, double x_scale, double y_scale,  mirror_t mirror);
+void rdp_draw_sprite_tiled( uint32_t texslot, int x, int y, sprite_t *sprite );
+void rdp_draw_sprite_batch( rdp_sprite_instance_t *instances, int count );
+void rdp_detach_async( void (*callback)( void *arg ), void *arg );
+void rdp_tmem_invalidate( void );
+uint32_t rdp_get_tmem_hits( void );
+uint32_t rdp_get_tmem_misses( void );
 void rdp_set_primitive_color( uint32_t color );
 void rdp_set_blend_color( uint32_t color );
 void rdp_draw_filled_rectangle( int tx, int ty, int bx, int by );
 void rdp_draw_filled_triangle( float x1, float y1, float x2, float y2, float x3, float y3 );
+void rdp_post_tint( uint32_t color, uint8_t level );
+void rdp_post_fade( uint8_t level );
+void rdp_post_flash( uint8_t level );
+void rdp_post_desaturate( uint8_t level );
 void rdp_set_texture_flush( flush_t flush );
 void rdp_close( void );
 
@@ -121,7 +121,18 @@ typedef struct PI_regs_s {
     uint32_t dom1_latency;
     /** @brief Cartridge domain 1 pulse width in RCP clock cycles. Requires DMA status bit guards to work reliably */
     uint32_t dom1_pulse_width;
-    // TODO: add remaining registers
+    /** @brief Cartridge domain 1 page size (log2 of bytes transferred per latency cycle, minus 2) */
+    uint32_t dom1_page_size;
+    /** @brief Cartridge domain 1 release duration in RCP clock cycles */
+    uint32_t dom1_release;
+    /** @brief Cartridge domain 2 latency in RCP clock cycles */
+    uint32_t dom2_latency;
+    /** @brief Cartridge domain 2 pulse width in RCP clock cycles */
+    uint32_t dom2_pulse_width;
+    /** @brief Cartridge domain 2 page size */
+    uint32_t dom2_page_size;
+    /** @brief Cartridge domain 2 release duration in RCP clock cycles */
+    uint32_t dom2_release;
 } PI_regs_t;
 
 /** 
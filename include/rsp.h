@@ -365,6 +365,48 @@ void rsp_init(void);
  **/
 void rsp_load(rsp_ucode_t *ucode);
 
+/** @brief Load a RSP ucode into one half of IMEM (partitioned residency).
+ *
+ * IMEM is 4 KiB. When a frame alternates between two small ucodes (each
+ * fitting in 2 KiB), loading them with #rsp_load forces a full IMEM
+ * transfer on every switch. This function instead keeps each ucode
+ * resident in its own IMEM half: the code segment is transferred only
+ * the first time (or if something else overwrote that half), while the
+ * data segment is still loaded into DMEM on every switch, since DMEM is
+ * not partitioned.
+ *
+ * A subsequent #rsp_run / #rsp_run_async will start the RSP at the
+ * ucode's entry point within its partition (that is, at
+ * `start_pc + partition * 2048`).
+ *
+ * @note Code running in partition 1 executes at IMEM address 0x800 + its
+ *       link address. Since ucodes are linked at IMEM base 0, only
+ *       PC-relative branches work there: a ucode using absolute jumps
+ *       (`j` / `jal`) must be loaded in partition 0.
+ *
+ * @param[in]     ucode       Ucode to load (code segment must fit 2 KiB)
+ * @param[in]     partition   IMEM partition to use (0 or 1)
+ *
+ * @see #rsp_load
+ * @see #rsp_load_stats
+ **/
+void rsp_load_partitioned(rsp_ucode_t *ucode, int partition);
+
+/** @brief Read the ucode load statistics.
+ *
+ * Reports how many ucode loads (via #rsp_load or #rsp_load_partitioned)
+ * actually transferred code to IMEM, versus how many were satisfied by
+ * already-resident code. A high reload count indicates ucode thrashing.
+ *
+ * @param[out]    reloads     If not NULL, number of IMEM code transfers
+ * @param[out]    hits        If not NULL, number of loads that found the
+ *                            code already resident
+ **/
+void rsp_load_stats(uint32_t *reloads, uint32_t *hits);
+
+/** @brief Reset the ucode load statistics counters. */
+void rsp_load_stats_reset(void);
+
 /** @brief Run RSP ucode.
  * 
  * This function starts running the RSP, and wait until the ucode is finished.
@@ -446,6 +488,93 @@ void rsp_read_code(void* code, unsigned long size, unsigned int imem_offset);
  */
 void rsp_read_data(void* data, unsigned long size, unsigned int dmem_offset);
 
+/** @brief Maximum number of DMEM regions watched by the telemetry API */
+#define RSP_TELEMETRY_MAX_REGIONS   4
+
+/**
+ * @brief One telemetry capture of a watched DMEM region.
+ *
+ * See #rsp_telemetry_add. The header fields are filled by the CPU after the
+ * DMA of the region body completes; #rsp_telemetry_latest returns a pointer
+ * to the most recent complete sample.
+ */
+typedef struct {
+    uint32_t seqno;     ///< Capture counter of the region (1 = first capture)
+    uint32_t ticks;     ///< #TICKS_READ timestamp of the capture
+    uint32_t sync;      ///< Value of the ucode sync word after the capture (0 if the region has none)
+    bool torn;          ///< True if the sync word shows the ucode updated the region mid-capture
+    /// Captured contents of the DMEM region
+    uint8_t data[] __attribute__((aligned(8)));
+} rsp_telemetry_sample_t;
+
+/**
+ * @brief Register a DMEM region for periodic telemetry snapshots.
+ *
+ * The region is captured to RDRAM via SP DMA every telemetry period (see
+ * #rsp_telemetry_start) *without halting the RSP*: this is meant for watching
+ * live ucode state (eg: mixer channel levels) without perturbing the very
+ * timing being observed. Inspecting state with the ucode stopped is what
+ * #rsp_ucode_t's crash handler and queue-coordinated mechanisms are for.
+ *
+ * Since the RSP keeps running, a capture can observe a region mid-update.
+ * To detect this, the ucode can maintain a sync word: a 32-bit counter in
+ * DMEM that it increments once before starting to update the region and
+ * once after finishing (so it is odd while an update is in progress). Pass
+ * its offset as sync_offset and each sample's `torn` flag will tell whether
+ * the capture is consistent; pass -1 if the ucode maintains no sync word
+ * (samples are then best-effort). The sync word is read directly from DMEM
+ * around the DMA, which only steals single memory cycles from the RSP.
+ *
+ * Captures are stored in a ring of num_samples entries: a sample returned
+ * by #rsp_telemetry_latest stays valid until the ring wraps around to it,
+ * so size the ring for the consumer's polling rate.
+ *
+ * @note The SP DMA engine is shared with the ucode. A capture waits until
+ *       the engine is idle before programming it, but a ucode that issues
+ *       DMA transfers at a very high duty cycle can still race the capture
+ *       setup; such ucodes should be watched at a low telemetry rate.
+ *
+ * @param[in] dmem_offset
+ *            Byte offset in DMEM of the region to watch (multiple of 8)
+ * @param[in] size
+ *            Size of the region in bytes (multiple of 8)
+ * @param[in] sync_offset
+ *            Byte offset in DMEM of the ucode sync word (multiple of 4),
+ *            or -1 if the region has none
+ * @param[in] num_samples
+ *            Number of samples in the capture ring (at least 1)
+ *
+ * @return The region index, to pass to #rsp_telemetry_latest
+ */
+int rsp_telemetry_add(uint32_t dmem_offset, uint32_t size, int sync_offset, int num_samples);
+
+/**
+ * @brief Start capturing the registered telemetry regions periodically.
+ *
+ * Captures happen under interrupt on a timer, so they keep running no
+ * matter what the CPU is doing. Calling this again changes the period.
+ *
+ * @param[in] period_us
+ *            Capture period in microseconds
+ */
+void rsp_telemetry_start(uint32_t period_us);
+
+/** @brief Stop the periodic telemetry captures (registrations are kept). */
+void rsp_telemetry_stop(void);
+
+/**
+ * @brief Return the most recent complete sample of a watched region.
+ *
+ * @param[in] region
+ *            Region index returned by #rsp_telemetry_add
+ *
+ * @return The latest sample, or NULL if the region was never captured yet
+ */
+const rsp_telemetry_sample_t *rsp_telemetry_latest(int region);
+
+/** @brief Stop the telemetry and free all region registrations. */
+void rsp_telemetry_close(void);
+
 /**
  * @brief Abort the program showing a RSP crash screen
  * 
@@ -0,0 +1,87 @@
+/**
+ * @file rspmem.h
+ * @brief RSP bulk memory operations
+ * @ingroup rsp
+ */
+#ifndef __LIBDRAGON_RSPMEM_H
+#define __LIBDRAGON_RSPMEM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup rspmem RSP bulk memory operations
+ * @ingroup rsp
+ * @brief memcpy/memset offloaded to the RSP via the rspq
+ *
+ * This module offloads large clears and copies (framebuffers, vertex
+ * buffers) to the RSP, which streams them through DMEM via DMA while the
+ * CPU keeps running. The operations are enqueued as rspq commands, so
+ * they sequence naturally with other RSP work (a copy enqueued before a
+ * rendering batch is guaranteed to complete before it).
+ *
+ * The operations are asynchronous: they complete at some point after the
+ * rspq reaches them. Use #rspq_wait (or a #rspq_syncpoint_t) before the
+ * CPU reads the destination, and make sure the CPU caches are coherent
+ * with RDRAM for both buffers (for cached buffers, writeback the source
+ * and invalidate the destination; buffers from #malloc_uncached need
+ * nothing).
+ *
+ * Call #rspmem_init once before using the module.
+ *
+ * @{
+ */
+
+/** @} */
+
+/**
+ * @brief Initialize the RSP bulk memory module
+ *
+ * Registers the overlay with the rspq engine (initializing it if needed).
+ */
+void rspmem_init(void);
+
+/**
+ * @brief Shut down the RSP bulk memory module
+ */
+void rspmem_close(void);
+
+/**
+ * @brief Enqueue an RSP copy of a block of RDRAM
+ *
+ * The copy is performed by the RSP, streaming through DMEM; the ranges
+ * must not overlap. See the module documentation for the synchronization
+ * and cache coherency rules.
+ *
+ * @param[in] dst
+ *            Destination buffer (8-byte aligned, in RDRAM)
+ * @param[in] src
+ *            Source buffer (8-byte aligned, in RDRAM)
+ * @param[in] len
+ *            Number of bytes to copy (multiple of 8, max 16 MiB)
+ */
+void rsp_memcpy(void *dst, const void *src, uint32_t len);
+
+/**
+ * @brief Enqueue an RSP fill of a block of RDRAM
+ *
+ * The fill is performed by the RSP, streaming through DMEM. See the
+ * module documentation for the synchronization and cache coherency rules.
+ *
+ * @param[in] dst
+ *            Destination buffer (8-byte aligned, in RDRAM)
+ * @param[in] pattern
+ *            32-bit pattern to fill with (eg: 0 to clear)
+ * @param[in] len
+ *            Number of bytes to fill (multiple of 8, max 16 MiB)
+ */
+void rsp_memset(void *dst, uint32_t pattern, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -207,11 +207,53 @@ void rspq_init(void);
 
 /**
  * @brief Shut down the RSPQ library.
- * 
+ *
  * This is mainly used for testing.
  */
 void rspq_close(void);
 
+/**
+ * @brief Configure the size of the RSP queue buffers.
+ *
+ * By default, the queue uses the buffer sizes defined in rspq_constants.h.
+ * This function allows to override them at runtime, which is useful for
+ * applications whose command bursts exceed the default low-priority buffer
+ * (causing stalls in the queue write path). Use #rspq_get_stats to measure
+ * whether this is the case.
+ *
+ * Must be called before #rspq_init. Since #rspq_init is implicitly called
+ * by all libraries using the RSP queue, this function should be called very
+ * early at boot.
+ *
+ * @param[in]  lowpri_words   Size of each lowpri queue buffer, in 32-bit words
+ * @param[in]  highpri_words  Size of each highpri queue buffer, in 32-bit words
+ */
+void rspq_config_buffer_size(int lowpri_words, int highpri_words);
+
+/** @brief RSP queue usage statistics (see #rspq_get_stats). */
+typedef struct {
+    uint32_t switches;          ///< Number of queue buffer switches
+    uint32_t stalls;            ///< Number of times the CPU had to wait for the RSP to free a buffer
+    uint64_t stall_ticks;       ///< Total CPU time spent waiting, in hardware ticks (see #TICKS_READ)
+    int highwater_mark;         ///< Maximum number of words ever written into one buffer
+} rspq_stats_t;
+
+/**
+ * @brief Read the RSP queue usage statistics.
+ *
+ * The statistics accumulate since #rspq_init (or the last call to
+ * #rspq_reset_stats). A non-zero stall count means that command bursts
+ * are exceeding the queue buffer size and the CPU is blocking in the
+ * write path; consider increasing the buffer size via
+ * #rspq_config_buffer_size.
+ *
+ * @param[out]  stats  Structure filled with the current statistics
+ */
+void rspq_get_stats(rspq_stats_t *stats);
+
+/** @brief Reset the RSP queue usage statistics. */
+void rspq_reset_stats(void);
+
 
 /**
  * @brief Register a rspq overlay into the RSP queue engine.
@@ -282,6 +324,26 @@ void rspq_overlay_register_static(rsp_ucode_t *overlay_ucode, uint32_t overlay_i
  */
 void rspq_overlay_unregister(uint32_t overlay_id);
 
+/**
+ * @brief Enqueue a command that prefetches an overlay into the RSP.
+ *
+ * The queue engine demand-loads overlay code and data into IMEM/DMEM when a
+ * command for a non-resident overlay is executed, stalling the queue for the
+ * duration of the DMA transfers. When the overlay switch pattern is known in
+ * advance (eg: a frame that alternates between two overlays), this function
+ * allows to schedule the load ahead of time, at a point in the stream where
+ * the RSP would otherwise be idle, so that the first real command of the
+ * overlay does not pay for the load.
+ *
+ * If the overlay is already resident when the prefetch command is executed,
+ * the command is a no-op. It is always safe (if useless) to prefetch: it
+ * only affects performance, never correctness.
+ *
+ * @param[in]  ovl_id  ID of the overlay to prefetch (preshifted by 28, as
+ *                     returned by #rspq_overlay_register).
+ */
+void rspq_overlay_prefetch(uint32_t ovl_id);
+
 /**
  * @brief Return a pointer to the overlay state (in RDRAM)
  * 
@@ -401,6 +463,108 @@ void* rspq_overlay_get_state(rsp_ucode_t *overlay_ucode);
 
 /// @endcond
 
+/**
+ * @brief Assemble the first word of a queue command.
+ *
+ * This is the same packing performed by #rspq_write: the overlay ID and the
+ * command index in the most significant byte, OR-ed with the first argument
+ * word. It is meant to pre-assemble commands into static arrays that are
+ * later enqueued with #rspq_write_bulk (or #rspq_write_deferred), which is
+ * the fastest way to emit a fixed sequence of commands:
+ *
+ * @code{.c}
+ *      // A fixed sequence of state-setting commands, assembled once.
+ *      // ovl_id is only known at runtime (rspq_overlay_register), so the
+ *      // array is filled on first use.
+ *      static uint32_t ui_state[4];
+ *      if (!ui_state[0]) {
+ *          ui_state[0] = RSPQ_CMD_WORD(ovl_id, CMD_SET_MODE, MODE_2D);
+ *          ui_state[1] = RSPQ_CMD_WORD(ovl_id, CMD_SET_BLEND, 0);
+ *          ui_state[2] = BLEND_MULTIPLY;   // second word of CMD_SET_BLEND
+ *          ui_state[3] = RSPQ_CMD_WORD(ovl_id, CMD_SET_SCISSOR, FULLSCREEN);
+ *      }
+ *      rspq_write_bulk(ui_state, 4);
+ * @endcode
+ *
+ * @param      ovl_id    The overlay ID (preshifted by 28, as returned by
+ *                       #rspq_overlay_register)
+ * @param      cmd_id    Index of the command within the overlay
+ * @param      arg0      First argument word (0 if the command has none)
+ *
+ * @see #rspq_write_bulk
+ * @hideinitializer
+ */
+#define RSPQ_CMD_WORD(ovl_id, cmd_id, arg0)   (((ovl_id) + ((cmd_id)<<24)) | (arg0))
+
+/**
+ * @brief Enqueue a command whose arguments never change (cached assembly).
+ *
+ * This is a drop-in variant of #rspq_write for commands whose arguments
+ * evaluate to the same values on every execution of the statement, which is
+ * the common case for state-setting commands. The command words are
+ * assembled only the first time the statement runs and latched into a
+ * static buffer; every later execution just copies the pre-assembled words
+ * into the queue with a straight (unrolled) copy, skipping the argument
+ * packing entirely. When the arguments are compile-time constants, the
+ * compiler folds the one-time assembly down to plain stores; the overlay
+ * ID may still be a runtime value (as returned by #rspq_overlay_register),
+ * it is simply latched along with the rest.
+ *
+ * Do not use this for commands whose arguments can vary: the values of the
+ * first execution would be replayed forever. For fixed multi-command
+ * sequences, pre-assembling a static array with #RSPQ_CMD_WORD and writing
+ * it with #rspq_write_bulk is faster still.
+ *
+ * @param      ovl_id    The overlay ID of the command to enqueue (preshifted
+ *                       by 28, as returned by #rspq_overlay_register)
+ * @param      cmd_id    Index of the command to call, within the overlay
+ * @param      ...       Optional arguments for the command
+ *
+ * @see #rspq_write
+ * @hideinitializer
+ */
+#define rspq_write_const(ovl_id, cmd_id, ...) \
+    __PPCAT(_rspq_write_const, __HAS_VARARGS(__VA_ARGS__)) (ovl_id, cmd_id, ##__VA_ARGS__)
+
+/// @cond
+
+// Helpers used to implement rspq_write_const
+#define _rspq_write_const_arg(arg) \
+    *__cp++ = (arg);
+
+#define _rspq_write_const0(ovl_id, cmd_id) ({ \
+    static uint32_t __rspq_ccmd; \
+    static bool __rspq_ccmd_init = false; \
+    if (__builtin_expect(!__rspq_ccmd_init, 0)) { \
+        __rspq_ccmd = (ovl_id) + ((cmd_id)<<24); \
+        __rspq_ccmd_init = true; \
+    } \
+    _rspq_write_prolog(); \
+    rspq_cur_pointer[0] = __rspq_ccmd; \
+    rspq_cur_pointer += 1; \
+    _rspq_write_epilog(); \
+})
+
+#define _rspq_write_const1(ovl_id, cmd_id, arg0, ...) ({ \
+    _Static_assert(__COUNT_VARARGS(__VA_ARGS__) < RSPQ_MAX_SHORT_COMMAND_SIZE); \
+    static uint32_t __rspq_ccmd[1 + __COUNT_VARARGS(__VA_ARGS__)]; \
+    static bool __rspq_ccmd_init = false; \
+    if (__builtin_expect(!__rspq_ccmd_init, 0)) { \
+        uint32_t *__cp = __rspq_ccmd+1; (void)__cp; \
+        __CALL_FOREACH(_rspq_write_const_arg, ##__VA_ARGS__); \
+        __rspq_ccmd[0] = ((ovl_id) + ((cmd_id)<<24)) | (arg0); \
+        __rspq_ccmd_init = true; \
+    } \
+    _rspq_write_prolog(); \
+    for (int __ci = 0; __ci < __COUNT_VARARGS(__VA_ARGS__); __ci++) \
+        ptr[__ci] = __rspq_ccmd[__ci+1]; \
+    rspq_cur_pointer[0] = __rspq_ccmd[0]; \
+    rspq_cur_pointer += 1 + __COUNT_VARARGS(__VA_ARGS__); \
+    _rspq_write_epilog(); \
+})
+
+/// @endcond
+
 /** @brief A write cursor, returned by #rspq_write_begin. */
 typedef struct {
     uint32_t first_word;                  ///< value that will be written as first word
@@ -509,6 +673,95 @@ inline void rspq_write_end(rspq_write_t *w) {
     w->pointer = 0;
 }
 
+/**
+ * @brief Stage a command for the RSP queue from interrupt context.
+ *
+ * #rspq_write (and the other enqueuing APIs) must never be called from an
+ * interrupt handler, as they would race with an enqueue possibly in progress
+ * in the interrupted code. This function provides an interrupt-safe
+ * alternative: the command is copied into a small staging buffer, and moved
+ * into the actual queue by the next call to #rspq_flush performed outside
+ * of interrupt context.
+ *
+ * The buffer must contain one or more fully-formed commands, laid out
+ * exactly as they would appear in the queue (see #rspq_write_bulk).
+ * Deferred commands are enqueued in staging order, but their ordering
+ * relative to commands written directly with #rspq_write is unspecified.
+ *
+ * This is useful for latency-tolerant commands generated by interrupt
+ * handlers, for instance audio mixing commands emitted from the audio
+ * interrupt.
+ *
+ * @param      words   The command words to stage
+ * @param[in]  nwords  Number of 32-bit words
+ *
+ * @return true if the commands were staged, false if the staging buffer is
+ *         full (in which case the caller should retry later, or drop).
+ *
+ * @see #rspq_flush
+ */
+bool rspq_write_deferred(const uint32_t *words, int nwords);
+
+/**
+ * @brief Copy a pre-staged batch of commands into the RSP queue.
+ *
+ * This function enqueues a batch of commands that has been staged in a
+ * memory buffer, with a single queue capacity check and a single write
+ * pointer update for the whole batch. It is meant for code that emits
+ * thousands of small commands per frame (eg: particle systems), for which
+ * the per-command overhead of #rspq_write becomes measurable.
+ *
+ * The buffer must contain fully-formed commands, laid out exactly as they
+ * would appear in the queue (first word of each command containing the
+ * overlay ID and command index in the MSB, as described in #rspq_write).
+ * The batch is copied as a single contiguous unit, so it must fit into
+ * one queue buffer; batches up to a few hundred words are safe.
+ *
+ * @param      words   The staged command words to copy into the queue
+ * @param[in]  nwords  Number of 32-bit words in the batch
+ *
+ * @see #rspq_write
+ * @see #rspq_write_reserve
+ */
+void rspq_write_bulk(const uint32_t *words, int nwords);
+
+/**
+ * @brief Reserve a contiguous region of the RSP queue to build commands in place.
+ *
+ * This function reserves \p nwords contiguous words in the RSP queue and
+ * returns a pointer to them, so that commands can be built directly in the
+ * queue buffer without a staging copy. Together with #rspq_write_commit,
+ * this is the lowest-overhead way to emit large batches of commands.
+ *
+ * After calling this function, fill the region with commands in any order,
+ * but leave the very first word untouched: pass its value to
+ * #rspq_write_commit instead. The RSP will not execute any part of the
+ * region (nor anything enqueued after it) until the commit happens, so the
+ * region can be filled at leisure without racing with the RSP.
+ *
+ * @param[in]  nwords  Number of 32-bit words to reserve
+ *
+ * @return Pointer to the reserved region inside the queue
+ *
+ * @see #rspq_write_commit
+ */
+volatile uint32_t* rspq_write_reserve(int nwords);
+
+/**
+ * @brief Publish a region reserved via #rspq_write_reserve.
+ *
+ * This function finalizes a reserved region by writing the first word of
+ * its first command, which makes the whole region visible to the RSP.
+ * Call it once the rest of the region has been completely filled.
+ *
+ * @param      ptr         The pointer returned by #rspq_write_reserve
+ * @param[in]  first_word  Value for the first word of the region (command ID
+ *                         in the MSB, as described in #rspq_write)
+ *
+ * @see #rspq_write_reserve
+ */
+void rspq_write_commit(volatile uint32_t *ptr, uint32_t first_word);
+
 /**
  * @brief Make sure that RSP starts executing up to the last written command.
  * 
@@ -604,6 +857,33 @@ void rspq_flush(void);
  */
 rspq_syncpoint_t rspq_syncpoint_new(void);
 
+/**
+ * @brief Create a syncpoint in the queue that will fire a callback.
+ *
+ * Like #rspq_syncpoint_new, this function creates a new syncpoint
+ * referencing the current position in the queue. In addition, when the RSP
+ * reaches the syncpoint, the specified callback is invoked (from under the
+ * SP interrupt), without the CPU ever having to block or poll.
+ *
+ * This is useful to pipeline resource reuse: for instance, a callback can
+ * mark a streaming buffer as free again as soon as the RSP is done reading
+ * it, while the CPU keeps running game logic.
+ *
+ * Since the callback is invoked from interrupt context, it must be fast and
+ * must not call functions that wait on the RSP (eg: #rspq_wait,
+ * #rspq_syncpoint_wait); enqueuing new commands is also not allowed (see
+ * #rspq_write). Typically, it should just update some flags or pointers.
+ *
+ * @param      func  Callback to invoke when the syncpoint is reached
+ * @param      ctx   Opaque context pointer passed to the callback
+ *
+ * @return     ID of the just-created syncpoint. The syncpoint can also be
+ *             checked or waited upon like a normal syncpoint.
+ *
+ * @see #rspq_syncpoint_new
+ */
+rspq_syncpoint_t rspq_syncpoint_new_cb(void (*func)(void *ctx), void *ctx);
+
 /**
  * @brief Check whether a syncpoint was reached by RSP or not.
  * 
@@ -702,6 +982,69 @@ void rspq_block_run(rspq_block_t *block);
  */
 void rspq_block_free(rspq_block_t *block);
 
+/**
+ * @brief Return the size in bytes required to serialize a block.
+ *
+ * Use this function to allocate (or reserve in a file) the buffer that will
+ * be filled by #rspq_block_serialize.
+ *
+ * @param  block  The block to measure
+ *
+ * @return Number of bytes required for the serialized image
+ *
+ * @see #rspq_block_serialize
+ */
+int rspq_block_serialized_size(rspq_block_t *block);
+
+/**
+ * @brief Serialize a block into a flat, position-independent image.
+ *
+ * This function flattens a block (created via #rspq_block_begin /
+ * #rspq_block_end) into a single contiguous image that contains no absolute
+ * RDRAM addresses. The image can be saved to a file (eg: stored in DragonFS
+ * as part of the build process) and later replayed directly from the loaded
+ * buffer via #rspq_block_from_serialized, without rebuilding the block
+ * command by command.
+ *
+ * This is useful for large blocks that are identical across runs (menus,
+ * HUDs, etc.): the block can be recorded once offline, and at runtime the
+ * only cost of loading it is the DMA of the image itself.
+ *
+ * The destination buffer must be at least #rspq_block_serialized_size bytes.
+ *
+ * @param  block  The block to serialize
+ * @param  dest   Destination buffer (filled with the serialized image)
+ *
+ * @note Blocks that call other blocks (via #rspq_block_run during recording)
+ *       cannot be serialized, as they embed runtime RDRAM addresses.
+ *
+ * @see #rspq_block_from_serialized
+ */
+void rspq_block_serialize(rspq_block_t *block, void *dest);
+
+/**
+ * @brief Prepare a serialized block image for execution, in place.
+ *
+ * This function validates a serialized block image (created by
+ * #rspq_block_serialize, eg: loaded from DragonFS) and returns a
+ * #rspq_block_t that can be passed to #rspq_block_run. The image is executed
+ * in place: no command is copied or rewritten, so the cost of this function
+ * is constant irrespective of the block size.
+ *
+ * The buffer must be 8-byte aligned and must remain valid (and unmodified)
+ * for as long as the block is used. Do not call #rspq_block_free on the
+ * returned block; free the buffer itself instead, once the RSP is done
+ * with it.
+ *
+ * @param  buf   Buffer containing the serialized block image
+ * @param  size  Size of the buffer in bytes (used for validation)
+ *
+ * @return A block ready to be run via #rspq_block_run
+ *
+ * @see #rspq_block_serialize
+ */
+rspq_block_t* rspq_block_from_serialized(void *buf, int size);
+
 /**
  * @brief Start building a high-priority queue.
  * 
@@ -762,6 +1105,119 @@ void rspq_highpri_end(void);
  */
 void rspq_highpri_sync(void);
 
+/** @brief High-priority queue usage statistics (see #rspq_highpri_get_stats). */
+typedef struct {
+    uint32_t sections;            ///< Number of highpri sections opened (#rspq_highpri_begin calls)
+    uint64_t occupancy_ticks;     ///< Total time highpri kept the RSP away from the normal queue, in hardware ticks
+    uint32_t max_occupancy_ticks; ///< Longest continuous highpri occupancy observed, in hardware ticks
+    uint32_t budget_yields;       ///< Number of forced yields to the normal queue (see #rspq_highpri_set_budget)
+} rspq_highpri_stats_t;
+
+/**
+ * @brief Read the high-priority queue usage statistics.
+ *
+ * The statistics accumulate since #rspq_init (or the last call to
+ * #rspq_highpri_reset_stats). The occupancy counters measure for how long
+ * the high-priority mechanism kept the RSP away from the normal queue:
+ * #rspq_highpri_stats_t::max_occupancy_ticks is therefore the worst-case
+ * starvation suffered by the normal queue during the measurement window,
+ * which directly bounds the latency of pending rendering commands.
+ *
+ * The CPU cannot observe the exact instant the RSP leaves high-priority
+ * mode, so occupancy periods are closed at the next observation point
+ * (#rspq_highpri_begin, #rspq_highpri_sync, or this function): the reported
+ * durations are conservative upper bounds. An occupancy period that is
+ * still open when this function is called is included in the snapshot.
+ *
+ * @param[out]  stats  Structure filled with the current statistics
+ */
+void rspq_highpri_get_stats(rspq_highpri_stats_t *stats);
+
+/** @brief Reset the high-priority queue usage statistics. */
+void rspq_highpri_reset_stats(void);
+
+/**
+ * @brief Bound normal-queue starvation by budgeting the high-priority queue.
+ *
+ * By default, back-to-back high-priority sections chain into one another
+ * and can occupy the RSP indefinitely, starving the normal queue (for
+ * example, heavy audio work delaying rendering commands) with no upper
+ * bound. This function enables a budget: once high-priority work has
+ * continuously occupied the RSP for more than @p slice_us microseconds,
+ * the next #rspq_highpri_begin does not chain; instead, the RSP is left
+ * to fall back to the normal queue, and the new section is only started
+ * @p gap_us microseconds later (the request is raised by a one-shot
+ * timer, so the CPU does not block). The normal queue is thus guaranteed
+ * a window of at least @p gap_us every @p slice_us of high-priority
+ * occupancy, making its worst-case latency a function of the slice
+ * rather than of the total amount of high-priority work.
+ *
+ * The price is added latency on the deferred high-priority sections;
+ * pick a slice well above the duration of one section (e.g. one audio
+ * frame) so that only pathological bursts are throttled. Forced yields
+ * are counted in #rspq_highpri_stats_t::budget_yields. #rspq_highpri_sync
+ * releases a deferred request immediately before waiting.
+ *
+ * @note Budget mode requires the @ref timer "timer subsystem" to be
+ *       initialized.
+ *
+ * @param[in] slice_us  Maximum continuous high-priority occupancy before a
+ *                      forced yield, in microseconds (0 to disable)
+ * @param[in] gap_us    Duration of the forced yield, in microseconds
+ *                      (0 to disable; must be non-zero if slice_us is)
+ */
+void rspq_highpri_set_budget(int slice_us, int gap_us);
+
+/**
+ * @brief Start capturing the RSP command stream into a buffer.
+ *
+ * This function starts a trace capture: all commands submitted to the lowpri
+ * queue from this point on (via #rspq_write, #rspq_block_run, etc.) are
+ * mirrored into the provided buffer, exactly as the RSP consumes them. The
+ * internal buffer-management commands (jumps between the double buffers) are
+ * not part of the capture, so the resulting stream is position-independent.
+ *
+ * The captured stream can be dumped to the host (eg: via the debugging
+ * channel) to diff the queue contents between builds, or replayed on target
+ * via #rspq_trace_to_block to reproduce RSP workloads.
+ *
+ * @param      buffer  Buffer that will receive the captured command words
+ * @param[in]  size    Size of the buffer in 32-bit words
+ *
+ * @see #rspq_trace_stop
+ * @see #rspq_trace_to_block
+ */
+void rspq_trace_start(uint32_t *buffer, int size);
+
+/**
+ * @brief Stop the trace capture started with #rspq_trace_start.
+ *
+ * @return Number of command words captured. If the capture buffer overflowed,
+ *         the trace is truncated (and a warning is logged).
+ */
+int rspq_trace_stop(void);
+
+/**
+ * @brief Wrap a captured command stream into a replayable block.
+ *
+ * This function copies a stream captured via #rspq_trace_start /
+ * #rspq_trace_stop into a block that can be executed with #rspq_block_run,
+ * allowing captured workloads to be replayed for benchmarking.
+ *
+ * Note that commands may reference resources by RDRAM address (eg: DMA
+ * commands, block calls); the replay is only meaningful as long as those
+ * resources are still allocated at the same addresses.
+ *
+ * The returned block must be freed with free_uncached() (not
+ * #rspq_block_free) once it is no longer needed.
+ *
+ * @param      words   The captured command words
+ * @param[in]  nwords  Number of words in the stream
+ *
+ * @return A block containing the captured stream
+ */
+rspq_block_t* rspq_trace_to_block(const uint32_t *words, int nwords);
+
 /**
  * @brief Enqueue a no-op command in the queue.
  * 
@@ -770,6 +1226,57 @@ void rspq_highpri_sync(void);
  */
 void rspq_noop(void);
 
+/** @brief Number of profiling slots in #rspq_profile_t (one per overlay). */
+#define RSPQ_PROFILE_SLOT_COUNT  8
+
+/** @brief Profiling counters for a single overlay (see #rspq_profile_get). */
+typedef struct {
+    uint32_t cycles;        ///< Total RCP clock ticks spent while the overlay was current
+    uint32_t count;         ///< Number of samples (commands dispatched)
+} rspq_profile_slot_t;
+
+/** @brief Snapshot of the RSP queue profiling counters (see #rspq_profile_get). */
+typedef struct {
+    /** @brief Per-overlay counters. Slot 0 is the builtin queue engine overlay. */
+    rspq_profile_slot_t slots[RSPQ_PROFILE_SLOT_COUNT];
+    /** @brief Name of the overlay in each slot (NULL if the slot is unused). */
+    const char *slot_names[RSPQ_PROFILE_SLOT_COUNT];
+} rspq_profile_t;
+
+/**
+ * @brief Read the per-overlay RSP profiling counters.
+ *
+ * When profiling is enabled (see RSPQ_PROFILE in rspq_constants.h), the RSP
+ * queue engine accumulates the number of RCP clock ticks spent running the
+ * commands of each overlay, plus the number of commands dispatched for it.
+ * This function takes a coherent snapshot of the counters and resolves the
+ * overlay names, so that the time spent in each overlay can be reported.
+ *
+ * The counters are sampled by the RSP itself between commands, so the
+ * measurement includes the queue engine overhead (command fetch and dispatch,
+ * overlay switches) of each command, which is attributed to the overlay
+ * being run. Counters are free-running and wrap around; use
+ * #rspq_profile_reset to restart a measurement window.
+ *
+ * @param[out]  profile  Structure filled with the profiling snapshot
+ *
+ * @note This function waits for the RSP to execute the counter readback, so
+ *       it implies a full queue sync. Call it at most once per frame.
+ *
+ * @see #rspq_profile_reset
+ */
+void rspq_profile_get(rspq_profile_t *profile);
+
+/**
+ * @brief Reset the RSP profiling counters to zero.
+ *
+ * This clears the per-overlay counters read by #rspq_profile_get, to start
+ * a new measurement window.
+ *
+ * @see #rspq_profile_get
+ */
+void rspq_profile_reset(void);
+
 /**
  * @brief Enqueue a command that sets a signal in SP status
  * 
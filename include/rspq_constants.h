@@ -3,6 +3,11 @@
 
 #define RSPQ_DEBUG                     1
 
+/** Enable per-overlay cycle profiling counters (see #rspq_profile_get).
+ *  This adds a small overhead to the RSP main loop, so it is disabled
+ *  by default. */
+#define RSPQ_PROFILE                   0
+
 #define RSPQ_DRAM_LOWPRI_BUFFER_SIZE   0x200   ///< Size of each RSPQ RDRAM buffer for lowpri queue (in 32-bit words)
 #define RSPQ_DRAM_HIGHPRI_BUFFER_SIZE  0x80    ///< Size of each RSPQ RDRAM buffer for highpri queue (in 32-bit words)
 
@@ -19,10 +24,17 @@
 #define RSPQ_BLOCK_MIN_SIZE            64
 #define RSPQ_BLOCK_MAX_SIZE            4192
 
+/** Maximum number of syncpoint callbacks pending at the same time */
+#define RSPQ_MAX_SYNCPOINT_CALLBACKS   16
+
+/** Size of the staging buffer for deferred writes (in 32-bit words) */
+#define RSPQ_DEFERRED_BUFFER_SIZE      128
+
 /** Maximum number of nested block calls */
 #define RSPQ_MAX_BLOCK_NESTING_LEVEL   8
 #define RSPQ_LOWPRI_CALL_SLOT          (RSPQ_MAX_BLOCK_NESTING_LEVEL+0)  ///< Special slot used to store the current lowpri pointer
 #define RSPQ_HIGHPRI_CALL_SLOT         (RSPQ_MAX_BLOCK_NESTING_LEVEL+1)  ///< Special slot used to store the current highpri pointer
+#define RSPQ_GENERATED_CALL_SLOT       (RSPQ_MAX_BLOCK_NESTING_LEVEL+2)  ///< Special slot used by RSP-generated command lists (see RSPQ_RunGenerated)
 
 /** Signal used by RSP to notify that a syncpoint was reached */
 #define SP_STATUS_SIG_SYNCPOINT                SP_STATUS_SIG2
@@ -61,4 +73,7 @@
 /** Debug marker in DMEM to check that C and Assembly have the same DMEM layout */
 #define RSPQ_DEBUG_MARKER            0xABCD0123
 
+/** Magic word at the start of a serialized block image ("RQB1") */
+#define RSPQ_BLOCK_SERIALIZED_MAGIC  0x52514231
+
 #endif
@@ -0,0 +1,72 @@
+/**
+ * @file rspq_rdp.h
+ * @brief RDP command bridging through the RSP queue
+ * @ingroup rsp
+ *
+ * This module allows raw RDP commands to be enqueued in the RSP command
+ * queue, so that RDP work is sequenced inside the rspq stream, interleaved
+ * with commands of other overlays.
+ *
+ * Normally, rdp.c drives the RDP directly from the CPU via the DP registers,
+ * while the RSP runs its queue independently: mixing the two pipelines
+ * requires full synchronization (eg: #rdp_sync) at every transition. With
+ * this module, the RSP itself forwards RDP commands to the RDP through the
+ * XBUS (DMEM) interface, preserving ordering with respect to all other
+ * queued RSP work without any blocking sync on the CPU.
+ *
+ * The API is low-level: it transports raw 64-bit RDP command words, which
+ * the caller is expected to assemble (see the RDP programming documentation
+ * for the command encodings). Synchronization commands like SYNC_FULL can
+ * be sent through the same path.
+ */
+
+#ifndef __LIBDRAGON_RSPQ_RDP_H
+#define __LIBDRAGON_RSPQ_RDP_H
+
+#include <stdint.h>
+#include <rspq.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the RDP bridge overlay.
+ *
+ * This registers the bridge overlay into the RSP queue engine. It can be
+ * called multiple times without side effects.
+ */
+void rspq_rdp_init(void);
+
+/**
+ * @brief Shut down the RDP bridge overlay.
+ */
+void rspq_rdp_close(void);
+
+/**
+ * @brief Enqueue a raw 64-bit RDP command into the RSP queue.
+ *
+ * The command will be forwarded to the RDP by the RSP, in order with
+ * respect to all other queued commands.
+ *
+ * @param[in]  cmd  The raw RDP command (64 bits)
+ */
+void rspq_rdp_write(uint64_t cmd);
+
+/**
+ * @brief Enqueue two raw 64-bit RDP commands into the RSP queue.
+ *
+ * Like #rspq_rdp_write, but forwards two commands with a single queue
+ * command, halving the dispatch overhead. Useful for primitives that are
+ * always emitted in pairs (eg: SET_COLOR + FILL_RECTANGLE).
+ *
+ * @param[in]  cmd0  The first raw RDP command
+ * @param[in]  cmd1  The second raw RDP command
+ */
+void rspq_rdp_write2(uint64_t cmd0, uint64_t cmd1);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
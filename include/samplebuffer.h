@@ -122,6 +122,33 @@ typedef struct samplebuffer_s {
      * wv_ctx is the opaque pointer to pass as context to decoder functions.
      */
     void *wv_ctx;
+
+    /**
+     * Loop cache: a memory buffer where the loop region of the waveform is
+     * pinned after it has been decoded for the first time, so that subsequent
+     * loop iterations are served from memory instead of going through wv_read
+     * again. NULL if no loop cache is configured (see #samplebuffer_set_loop).
+     */
+    uint8_t *loop_mem;
+
+    /**
+     * Absolute position in the waveform of the first sample of the loop
+     * cache (that is, the loop start point).
+     */
+    int loop_wpos;
+
+    /**
+     * Length of the loop cache (expressed as number of samples).
+     */
+    int loop_len;
+
+    /**
+     * Number of samples of the loop cache that have been captured so far.
+     * The cache is filled incrementally as the first loop iteration is
+     * decoded; once this reaches loop_len, wv_read is not called anymore
+     * for positions within the loop.
+     */
+    int loop_filled;
 } samplebuffer_t;
 
 /**
@@ -146,7 +173,13 @@ void samplebuffer_init(samplebuffer_t *buf, uint8_t *uncached_mem, int size);
  * Valid values for "bps" are 1, 2, or 4: 1 can be used for 8-bit mono samples,
  * 2 for either 8-bit interleaved stereo or 16-bit mono, and 4 for 16-bit
  * interleaved stereo.
- * 
+ *
+ * Samples are always stored at their native width: 8-bit samples occupy
+ * one byte each in the buffer, and are never widened by the CPU. The RSP
+ * mixer consumes them natively, fetching one byte per sample via DMA and
+ * widening in DMEM during resampling, so 8-bit storage halves both the
+ * RDRAM footprint and the DMA volume of a channel.
+ *
  * @param[in]   buf     Sample buffer
  * @param[in]   bps     Bytes per sample.
  */
@@ -169,6 +202,34 @@ void samplebuffer_set_bps(samplebuffer_t *buf, int bps);
  */
 void samplebuffer_set_waveform(samplebuffer_t *buf, WaveformRead read, void *ctx);
 
+/**
+ * @brief Configure a loop cache for this sample buffer.
+ *
+ * When a waveform loop is larger than the sample buffer itself, looped
+ * playback normally re-decodes the loop region through the waveform read
+ * function at every iteration, which for streamed waveforms means a steady
+ * trickle of PI DMA transfers from ROM.
+ *
+ * The loop cache avoids this: the loop region (starting at waveform position
+ * "wpos", "wlen" samples long) is captured into a dedicated RDRAM buffer as
+ * it is decoded for the first time, and from then on #samplebuffer_get serves
+ * the looped samples from the cached copy, without invoking the read function
+ * anymore.
+ *
+ * The cache costs `wlen` samples of uncached memory, allocated by this
+ * function. It is freed by configuring a different loop region (or wlen == 0),
+ * or by #samplebuffer_close. Calling this function again with the same region
+ * is a no-op, so an already-built cache survives multiple playbacks of the
+ * same waveform.
+ *
+ * This function must be called after #samplebuffer_set_bps.
+ *
+ * @param[in]   buf     Sample buffer
+ * @param[in]   wpos    Absolute waveform position of the loop start
+ * @param[in]   wlen    Length of the loop in samples (0 to disable the cache)
+ */
+void samplebuffer_set_loop(samplebuffer_t *buf, int wpos, int wlen);
+
 /**
  * @brief Get a pointer to specific set of samples in the buffer (zero-copy).
  * 
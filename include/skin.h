@@ -0,0 +1,132 @@
+/**
+ * @file skin.h
+ * @brief RSP matrix-palette skinning
+ * @ingroup rsp
+ *
+ * This module offloads skeletal animation vertex blending to the RSP,
+ * as an overlay for the RSP command queue (rspq.h). The CPU uploads a
+ * palette of bone matrices (16.16 fixed point, see fmath.h), then
+ * streams batches of vertices that carry two bone indices and a blend
+ * weight; the RSP transforms each vertex by both bone matrices,
+ * interpolates the two results by the weight, and DMAs the blended
+ * positions back to RDRAM.
+ *
+ * The output format is exactly #tnl_vertex_t, so a skinned mesh can be
+ * handed straight to #tnl_vertex_load and drawn without the CPU ever
+ * touching a vertex. Alternatively the blended vertices can be read
+ * back by the CPU (after waiting on an #rspq_syncpoint_t) for software
+ * pipelines.
+ *
+ * Typical usage:
+ *
+ * @code{.c}
+ *      skin_init();
+ *
+ *      // Per frame, per character:
+ *      skin_palette_load(character->bones, 0, character->num_bones);
+ *      skin_blend(mesh->verts, out_verts, mesh->num_verts);
+ *
+ *      // Feed the blended mesh to the T&L overlay (same RSP queue,
+ *      // so ordering is implicit):
+ *      tnl_vertex_load(out_verts, 0, 32);
+ * @endcode
+ */
+
+#ifndef __LIBDRAGON_SKIN_H
+#define __LIBDRAGON_SKIN_H
+
+#include <stdint.h>
+#include "fmath.h"
+#include "tnl.h"
+
+/** @brief Number of bone matrices in the RSP palette */
+#define SKIN_PALETTE_SIZE   16
+
+/** @brief Maximum number of vertices blended by one RSP batch */
+#define SKIN_BATCH_SIZE     32
+
+/**
+ * @brief A single skinned input vertex
+ *
+ * Positions are signed 16-bit integers in model space, like
+ * #tnl_vertex_t. Each vertex is influenced by up to two bones:
+ * @ref weight is the contribution of @ref bone0 as an unsigned 0.16
+ * fraction (0xFFFF = 1.0), and bone1 receives the remainder. For a
+ * rigid vertex, set both bones to the same index (any weight works).
+ * The structure is 16 bytes so that vertex arrays can be DMA'd
+ * directly to the RSP: arrays passed to #skin_blend must be 8-byte
+ * aligned.
+ */
+typedef struct __attribute__((aligned(8)))
+{
+    int16_t x;          ///< X coordinate in model space
+    int16_t y;          ///< Y coordinate in model space
+    int16_t z;          ///< Z coordinate in model space
+    int16_t padding;    ///< Unused (keeps the position ldv-aligned)
+    uint8_t bone0;      ///< Palette index of the first bone (0..15)
+    uint8_t bone1;      ///< Palette index of the second bone (0..15)
+    uint16_t weight;    ///< Weight of bone0, unsigned 0.16 (bone1 gets the rest)
+    uint32_t padding2;  ///< Unused (keeps the vertex 16 bytes)
+} skin_vertex_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the skinning overlay.
+ *
+ * This registers the overlay into the RSP queue engine. It can be called
+ * multiple times without side effects.
+ */
+void skin_init(void);
+
+/**
+ * @brief Shut down the skinning overlay.
+ */
+void skin_close(void);
+
+/**
+ * @brief Upload bone matrices into the RSP palette.
+ *
+ * Each matrix is normally the composed bone transform
+ * (inverse bind pose * animated pose * model transform) in s16.16,
+ * mapping model-space vertices directly to their skinned position.
+ * Coefficients are converted to the RSP's split layout into an
+ * internal staging ring, so @p matrices can live anywhere and can be
+ * reused immediately after the call.
+ *
+ * The palette persists across batches (it is part of the overlay's
+ * saved state), so characters sharing a skeleton pose only upload it
+ * once per frame.
+ *
+ * @param[in]  matrices  Bone matrices to upload (row-major, v * M)
+ * @param[in]  first     First palette slot to fill (0..15)
+ * @param[in]  count     Number of matrices (first+count must be <= #SKIN_PALETTE_SIZE)
+ */
+void skin_palette_load(const fm_mat4_t *matrices, int first, int count);
+
+/**
+ * @brief Blend a batch of skinned vertices on the RSP.
+ *
+ * The vertices are transformed by their two bone matrices from the
+ * current palette, blended by their weights, and written to @p output
+ * in #tnl_vertex_t layout. The call only enqueues the work: it returns
+ * immediately, and the output is ready once the RSP reaches the
+ * command (implicitly ordered before any later rspq command, or wait
+ * on an #rspq_syncpoint_t before reading it from the CPU).
+ *
+ * Batches larger than #SKIN_BATCH_SIZE are split into multiple RSP
+ * commands automatically.
+ *
+ * @param[in]  vertices  Input vertex array (8-byte aligned, see #skin_vertex_t)
+ * @param[out] output    Output vertex array (8-byte aligned, in RDRAM)
+ * @param[in]  count     Number of vertices to blend
+ */
+void skin_blend(const skin_vertex_t *vertices, tnl_vertex_t *output, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * @file stackguard.h
+ * @brief Stack overflow detection via TLB guard pages
+ * @ingroup lowlevel
+ */
+#ifndef __LIBDRAGON_STACKGUARD_H
+#define __LIBDRAGON_STACKGUARD_H
+
+/**
+ * @defgroup stackguard Stack guard
+ * @ingroup lowlevel
+ * @brief Trap stack overflows at the faulting instruction using the TLB
+ *
+ * A stack overflow normally corrupts whatever lives below the stack (the
+ * heap), and the corruption only surfaces much later as an apparently
+ * unrelated crash. This module uses the VR4300 TLB to make the overflow
+ * itself trap: the stack is remapped through the TLB at its identity
+ * address in KUSEG, with a read-only guard page just below it and nothing
+ * mapped below that. The first write past the bottom of the stack then
+ * raises an exception at the faulting instruction, with the usual
+ * exception screen and backtrace pointing exactly at the overflowing code.
+ *
+ * The protection has zero runtime cost: the TLB translates the stack
+ * accesses in hardware, and both the mapped alias and the original KSEG0
+ * alias refer to the same memory and cache lines (the mapping is identity,
+ * so there is no virtual aliasing in the caches).
+ *
+ * Call #stackguard_init once at startup to protect the main stack:
+ *
+ * @code{.c}
+ *      stackguard_init(64*1024);    // trap if the stack grows beyond 64 KiB
+ * @endcode
+ *
+ * Additional caller-allocated stacks (for coroutines, interpreters, or
+ * future threads) can be protected with #stackguard_map, which returns the
+ * guarded alias to be used as the stack region. Since the overflow
+ * exception itself cannot use the overflowed stack, the exception handler
+ * switches to a small private stack when it detects the stack pointer
+ * below the guard of the currently active stack; code that switches
+ * between multiple guarded stacks must keep #stackguard_set_active up to
+ * date.
+ *
+ * Note that libdragon does not otherwise use the TLB, so all 32 entries
+ * are available for guarded stacks.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Protect the main stack with a TLB guard page.
+ *
+ * The top @p stack_size bytes of RDRAM (where the main stack lives) are
+ * remapped through the TLB, with a read-only guard page below them, and
+ * the stack pointer is switched to the mapped alias. From this point on,
+ * growing the stack beyond @p stack_size bytes traps immediately with a
+ * "Stack overflow" exception instead of silently overwriting the heap.
+ *
+ * Call this early, before the stack has grown deeper than @p stack_size
+ * (it will assert otherwise). The stack size is a real limit afterwards:
+ * choose it with headroom for the deepest call chain (including interrupt
+ * handlers, which run on the current stack).
+ *
+ * @param[in] stack_size    Stack size to protect in bytes; must be a
+ *                          multiple of 8 KiB. 64 KiB is a reasonable
+ *                          default for most applications.
+ */
+void stackguard_init(int stack_size);
+
+/**
+ * @brief Map a caller-allocated stack through the TLB with a guard below it.
+ *
+ * Given a buffer that will be used as a stack (eg: for a coroutine or a
+ * thread), this maps it at its identity address in KUSEG with a read-only
+ * guard page below it, and returns the mapped alias. Use the returned
+ * pointer (not the original buffer) as the stack region, so that overflows
+ * trap instead of corrupting the memory below the buffer.
+ *
+ * The buffer must be 8 KiB aligned and its size a multiple of 8 KiB (eg:
+ * allocate it with memalign(8192, size)). Do not map two buffers that are
+ * physically adjacent: the guard page of one would overlap the other.
+ *
+ * Each call consumes TLB entries (one per 8 KiB..8 MiB of stack depending
+ * on alignment, plus one for the guard); there are 32 in total.
+ *
+ * @param[in] stack     Stack buffer (8 KiB aligned, in the cached segment)
+ * @param[in] size      Size of the buffer in bytes (multiple of 8 KiB)
+ *
+ * @return The mapped alias of the buffer, to be used as the stack region
+ */
+void *stackguard_map(void *stack, int size);
+
+/**
+ * @brief Declare which guarded stack is currently executing.
+ *
+ * The exception handler must switch to a private stack when the stack
+ * pointer has crossed into the guard area, and it decides that by
+ * comparing the stack pointer against the bottom of the *active* guarded
+ * stack. #stackguard_init sets the main stack as active; code that swaps
+ * the stack pointer to a stack obtained from #stackguard_map must call
+ * this around the switch (and restore the previous value when switching
+ * back).
+ *
+ * @param[in] stack     Mapped stack as returned by #stackguard_map, or
+ *                      NULL to track the main stack again
+ */
+void stackguard_set_active(void *stack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
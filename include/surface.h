@@ -95,7 +95,9 @@ extern "C" {
  * 
  * Notice that only some of those can be used by RDP as framebuffer (specifically,
  * #FMT_RGBA16, #FMT_RGBA32 and #FMT_CI8). Moreover, the CPU-based graphics library
- * graphics.h only accepts surfaces in either #FMT_RGBA16 or #FMT_RGBA32 as target buffers.
+ * graphics.h only accepts surfaces in #FMT_RGBA16, #FMT_RGBA32 or #FMT_CI8 as
+ * target buffers (on #FMT_CI8 surfaces, it draws palette indices; see
+ * #rdp_draw_surface_ci8 for expanding such a surface to the framebuffer).
  */
 typedef enum {
     FMT_NONE   = 0,                        ///< Placeholder for no format defined
@@ -211,6 +213,25 @@ inline surface_t surface_make_linear(void *buffer, tex_format_t format, uint32_t
  */
 surface_t surface_alloc(tex_format_t format, uint32_t width, uint32_t height);
 
+/**
+ * @brief Allocate a new Z-buffer surface in memory
+ *
+ * This function allocates a buffer suitable for use as a RDP Z-buffer
+ * (passed to #rdp_attach_zbuffer), matching the size of a color framebuffer
+ * of the same dimensions. The surface must be freed via #surface_free when
+ * it is not needed anymore.
+ *
+ * The Z-buffer holds one 16-bit depth value per pixel; the returned surface
+ * is tagged as #FMT_RGBA16 (which has the same memory layout), so that it
+ * can also be attached as a color image via #rdp_attach to clear it with a
+ * fill rectangle.
+ *
+ * @param[in]  width    Width in pixels (normally the framebuffer width)
+ * @param[in]  height   Height in pixels (normally the framebuffer height)
+ * @return              The initialized surface
+ */
+surface_t surface_alloc_zbuffer(uint32_t width, uint32_t height);
+
 /**
  * @brief Initialize a surface_t structure, pointing to a rectangular portion of another
  *        surface.
@@ -228,6 +249,57 @@ surface_t surface_alloc(tex_format_t format, uint32_t width, uint32_t height);
 surface_t surface_make_sub(surface_t *parent, 
     uint32_t x0, uint32_t y0, uint32_t width, uint32_t height);
 
+/**
+ * @brief Callback invoked by #surface_foreach_tile for each tile
+ *
+ * @param[in] tile  Sub-surface referring to the current tile (valid only
+ *                  for the duration of the call)
+ * @param[in] x0    X coordinate of the tile within the parent surface
+ * @param[in] y0    Y coordinate of the tile within the parent surface
+ * @param[in] ctx   Opaque context passed to #surface_foreach_tile
+ */
+typedef void (*surface_tile_callback_t)(surface_t *tile, uint32_t x0, uint32_t y0, void *ctx);
+
+/**
+ * @brief Iterate a surface in cache-sized tiles
+ *
+ * CPU-side image processing that walks a full framebuffer-sized surface
+ * row by row thrashes the 8 KB data cache, as each strided row evicts the
+ * previous ones before they can be reused. This helper splits the surface
+ * into tiles small enough to stay cache-resident while they are processed,
+ * and invokes the callback once per tile with a sub-surface view of it
+ * (see #surface_make_sub).
+ *
+ * Pass 0 for @p tile_width and @p tile_height to get a sensible default
+ * (full-width tiles that fit half of the data cache, leaving room for a
+ * second operand). Passes that read one surface and write another should
+ * iterate over one of the two and derive the matching region of the other
+ * from the tile coordinates, as #surface_copy does.
+ *
+ * @param[in] surface      Surface to iterate
+ * @param[in] tile_width   Tile width in pixels (0 = whole rows)
+ * @param[in] tile_height  Tile height in pixels (0 = fit half the data cache)
+ * @param[in] callback     Function invoked for each tile
+ * @param[in] ctx          Opaque context passed through to the callback
+ */
+void surface_foreach_tile(surface_t *surface, uint32_t tile_width, uint32_t tile_height,
+    surface_tile_callback_t callback, void *ctx);
+
+/**
+ * @brief Copy the contents of a surface into another
+ *
+ * The two surfaces must have the same format and size (strides may
+ * differ, so copying between a full surface and a same-sized view of a
+ * larger one works). The copy is performed in cache-sized tiles via
+ * #surface_foreach_tile; on cached destination buffers, whole rows are
+ * pre-allocated in the data cache with #data_cache_hit_create_dirty so
+ * that the old destination pixels are never fetched from RDRAM.
+ *
+ * @param[in] dest    Surface to copy to
+ * @param[in] source  Surface to copy from
+ */
+void surface_copy(surface_t *dest, surface_t *source);
+
 /**
  * @brief Free the buffer allocated in a surface.
  * 
@@ -242,6 +314,37 @@ surface_t surface_make_sub(surface_t *parent,
  */
 void surface_free(surface_t *surface);
 
+/**
+ * @brief Configure the surface buffer pool
+ *
+ * The surface pool is a cache of large buffers (framebuffer-sized and up)
+ * that is used to recycle memory across #surface_alloc / #surface_free
+ * cycles, instead of returning it to the heap. This prevents the heap
+ * fragmentation otherwise caused by repeatedly allocating and freeing very
+ * large blocks, for instance when re-initializing the display at a
+ * different resolution (via #display_close / #display_init, which allocate
+ * their framebuffers through this module).
+ *
+ * The pool is disabled by default. To enable it, configure the maximum
+ * amount of memory it is allowed to retain; a good value is the total
+ * size of the largest set of framebuffers the game will use. Buffers
+ * cached by the pool stay allocated until #surface_pool_flush is called
+ * (or the limit is set back to 0), which is the way to reclaim the memory
+ * when large surfaces are not needed for a while.
+ *
+ * @param[in] max_bytes  Maximum number of bytes the pool may retain,
+ *                       or 0 to disable the pool (flushing it)
+ */
+void surface_pool_set_limit(uint32_t max_bytes);
+
+/**
+ * @brief Free all the buffers currently cached by the surface pool
+ *
+ * Buffers that are part of a live surface are not affected; they will
+ * return to the pool when their surface is freed.
+ */
+void surface_pool_flush(void);
+
 /**
  * @brief Returns the pixel format of a surface
  * 
@@ -22,6 +22,7 @@ extern "C" {
 
 #include <dir.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 /**
  * @brief Filesystem hook structure
@@ -136,6 +137,44 @@ typedef struct
      * @return 0 on successful lookup or a negative value on failure or empty directory.
      */
     int (*findnext)( dir_t *dir );
+    /**
+     * @brief Function to call when performing a vectored read (optional)
+     *
+     * Reads into each buffer of the vector in turn, advancing the file
+     * position, as if by consecutive read calls but with a single hook
+     * dispatch. Filesystems can use the vector to coalesce adjacent
+     * ranges into fewer media transfers. May be null: #readv then falls
+     * back to looping over #filesystem_t::read.
+     *
+     * @param[in]  file
+     *             Arbitrary file handle returned by #filesystem_t::open
+     * @param[in]  iov
+     *             Array of destination buffers
+     * @param[in]  iovcnt
+     *             Number of entries in iov
+     *
+     * @return The total number of bytes read or a negative value on failure.
+     */
+    int (*readv)( void *file, const struct iovec *iov, int iovcnt );
+    /**
+     * @brief Function to call when performing a positioned read (optional)
+     *
+     * Reads at the given absolute offset without moving the file
+     * position. May be null: #pread then falls back to an lseek/read/
+     * lseek sequence through the scalar hooks.
+     *
+     * @param[in]  file
+     *             Arbitrary file handle returned by #filesystem_t::open
+     * @param[out] ptr
+     *             Buffer to place data read into
+     * @param[in]  len
+     *             Length of data that should be read into ptr
+     * @param[in]  offset
+     *             Absolute byte offset to read from
+     *
+     * @return The actual number of bytes read or a negative value on failure.
+     */
+    int (*pread)( void *file, uint8_t *ptr, int len, int offset );
 } filesystem_t;
 
 /**
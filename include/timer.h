@@ -39,8 +39,12 @@ typedef struct timer_link
     };
     /** @brief Callback context parameter */
     void *ctx;
-    /** @brief Link to next timer */
+    /** @brief Link to next timer in its wheel bucket (internal) */
     struct timer_link *next;
+    /** @brief Link to previous timer in its wheel bucket (internal) */
+    struct timer_link *prev;
+    /** @brief Head of the wheel bucket this timer is linked into (internal) */
+    struct timer_link **bucket;
 } timer_link_t;
 
 /** @brief Timer should fire only once */
@@ -111,6 +115,17 @@ void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t ca
 /* start a timer not currently in the list */
 void start_timer_context(timer_link_t *timer, int ticks, int flags, timer_callback2_t callback, void *ctx);
 
+/* preallocate a pool of timers for malloc-free (interrupt-safe) creation */
+void timer_pool_init(int n);
+/* free the preallocated timer pool */
+void timer_pool_close(void);
+/* create a new timer from the pool (interrupt-safe) */
+timer_link_t *timer_pool_new(int ticks, int flags, timer_callback1_t callback);
+/* create a new timer with context from the pool (interrupt-safe) */
+timer_link_t *timer_pool_new_context(int ticks, int flags, timer_callback2_t callback, void *ctx);
+/* stop a pool timer and return it to the pool (interrupt-safe) */
+void timer_pool_delete(timer_link_t *timer);
+
 /* reset a timer and add to list */
 void restart_timer(timer_link_t *timer);
 /* remove a timer from the list */
@@ -0,0 +1,145 @@
+/**
+ * @file tnl.h
+ * @brief RSP transform & triangle setup
+ * @ingroup rsp
+ *
+ * This module implements the geometry stage of a simple 3D pipeline on the
+ * RSP, as an overlay for the RSP command queue (rspq.h). Vertices are
+ * transformed by a 4x4 matrix, projected, clip-tested and mapped to the
+ * viewport entirely on the RSP; indexed triangles are then converted into
+ * RDP edge coefficients and fed straight to the RDP through the XBUS (DMEM)
+ * interface. Compared to #rdp_draw_filled_triangle, which expects the CPU
+ * to pre-project every vertex, this frees the VR4300 from all per-vertex
+ * math and from the triangle setup divisions.
+ *
+ * The pipeline is deliberately minimal: triangles are flat-filled with the
+ * current RDP blend color (configure the RDP with #rdp_enable_blend_fill
+ * and #rdp_set_blend_color), and clipping is trivial rejection only.
+ * Triangles crossing the left/right/top/bottom frustum planes are emitted
+ * whole and cut by the RDP scissor rectangle (#rdp_set_clipping), while
+ * triangles touching the near plane are dropped.
+ *
+ * Typical usage:
+ *
+ * @code{.c}
+ *      tnl_init();
+ *      tnl_viewport(0, 0, 320, 240);
+ *
+ *      // Per frame:
+ *      tnl_matrix_load(mvp);                   // modelview * projection
+ *      tnl_vertex_load(mesh->verts, 0, 32);    // fill the vertex cache
+ *      tnl_triangle_list(mesh->indices, mesh->num_indices);
+ *      rspq_flush();
+ * @endcode
+ */
+
+#ifndef __LIBDRAGON_TNL_H
+#define __LIBDRAGON_TNL_H
+
+#include <stdint.h>
+#include <rspq.h>
+
+/** @brief Number of entries in the RSP vertex cache */
+#define TNL_VERTEX_CACHE_SIZE   32
+
+/**
+ * @brief A single input vertex
+ *
+ * Vertex positions are signed 16-bit integers in model space; W is
+ * implicitly 1. Scale models into this range when exporting them.
+ * The structure is 8 bytes so that vertex arrays can be DMA'd directly
+ * to the RSP: arrays passed to #tnl_vertex_load must be 8-byte aligned.
+ */
+typedef struct __attribute__((aligned(8)))
+{
+    int16_t x;          ///< X coordinate in model space
+    int16_t y;          ///< Y coordinate in model space
+    int16_t z;          ///< Z coordinate in model space
+    int16_t padding;    ///< Unused (keeps the vertex 8 bytes)
+} tnl_vertex_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the transform & setup overlay.
+ *
+ * This registers the overlay into the RSP queue engine. It can be called
+ * multiple times without side effects.
+ */
+void tnl_init(void);
+
+/**
+ * @brief Shut down the transform & setup overlay.
+ */
+void tnl_close(void);
+
+/**
+ * @brief Load the current transformation matrix.
+ *
+ * The matrix must be the full model-view-projection product, mapping model
+ * space to clip space. It is converted to 16.16 fixed point and uploaded
+ * to the RSP, where it applies to all subsequent #tnl_vertex_load calls.
+ * Matrix coefficients must fit the 16.16 range (-32768..32767).
+ *
+ * @param[in]  mtx  The matrix to load (row-major)
+ */
+void tnl_matrix_load(const float mtx[4][4]);
+
+/**
+ * @brief Set the viewport that projected vertices are mapped to.
+ *
+ * Normalized device coordinates are mapped so that X in [-1,1] covers
+ * [x0, x0+width] left to right, and Y in [-1,1] covers [y0, y0+height]
+ * bottom to top. This normally matches the rectangle passed to
+ * #rdp_set_clipping.
+ *
+ * @param[in]  x0      Left edge of the viewport in pixels
+ * @param[in]  y0      Top edge of the viewport in pixels
+ * @param[in]  width   Width of the viewport in pixels
+ * @param[in]  height  Height of the viewport in pixels
+ */
+void tnl_viewport(int x0, int y0, int width, int height);
+
+/**
+ * @brief Transform a batch of vertices into the RSP vertex cache.
+ *
+ * The vertices are transformed by the current matrix, projected and mapped
+ * to the viewport on the RSP, and stored into the on-chip vertex cache at
+ * the given position, where #tnl_triangle can index them.
+ *
+ * @param[in]  vertices  Vertex array (8-byte aligned, see #tnl_vertex_t)
+ * @param[in]  first     First vertex cache slot to fill (0..31)
+ * @param[in]  count     Number of vertices (first+count must be <= #TNL_VERTEX_CACHE_SIZE)
+ */
+void tnl_vertex_load(const tnl_vertex_t *vertices, int first, int count);
+
+/**
+ * @brief Draw one triangle from the vertex cache.
+ *
+ * The triangle is set up on the RSP and sent to the RDP as a flat fill
+ * triangle, drawn with the current blend color. Triangles completely
+ * outside the frustum, touching the near plane, or with zero screen
+ * height are dropped. Both windings are accepted (there is no backface
+ * culling).
+ *
+ * @param[in]  i0  Vertex cache index of the first vertex (0..31)
+ * @param[in]  i1  Vertex cache index of the second vertex (0..31)
+ * @param[in]  i2  Vertex cache index of the third vertex (0..31)
+ */
+void tnl_triangle(int i0, int i1, int i2);
+
+/**
+ * @brief Draw an indexed triangle list from the vertex cache.
+ *
+ * @param[in]  indices  Vertex cache indices, three per triangle
+ * @param[in]  count    Number of indices (must be a multiple of 3)
+ */
+void tnl_triangle_list(const uint16_t *indices, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
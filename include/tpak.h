@@ -314,6 +314,19 @@ struct gameboy_cartridge_header
     uint8_t overflow[16];
 };
 
+/**
+ * @brief One range of Game Boy cartridge data to read via #tpak_read_bulk.
+ */
+typedef struct tpak_request
+{
+    /** @brief Address in Game Boy cartridge space (multiple of 32). */
+    uint16_t address;
+    /** @brief Number of bytes to read (multiple of 32). */
+    uint16_t size;
+    /** @brief Destination buffer for the read data. */
+    uint8_t *buffer;
+} tpak_request_t;
+
 int tpak_init(int controller);
 int tpak_set_value(int controller, uint16_t address, uint8_t value);
 int tpak_set_bank(int controller, int bank);
@@ -324,6 +337,7 @@ int tpak_get_cartridge_header(int controller, struct gameboy_cartridge_header* h
 bool tpak_check_header(struct gameboy_cartridge_header* header);
 int tpak_write(int controller, uint16_t address, uint8_t* data, uint16_t size);
 int tpak_read(int controller, uint16_t address, uint8_t* buffer, uint16_t size);
+int tpak_read_bulk(int controller, tpak_request_t* requests, int count);
 
 #ifdef __cplusplus
 }
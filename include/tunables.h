@@ -0,0 +1,120 @@
+/**
+ * @file tunables.h
+ * @brief Live variable tuning over USB
+ * @ingroup lowlevel
+ */
+#ifndef __LIBDRAGON_TUNABLES_H
+#define __LIBDRAGON_TUNABLES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup tunables Live variable tuning
+ * @ingroup lowlevel
+ * @brief Registry of named variables that can be inspected and changed
+ *        from the host over USB while the program is running.
+ *
+ * Tuning a constant (a mixer gain, a streaming window size, an RDP
+ * threshold) normally means rebuild, reflash, retest. This module lets
+ * code declare such variables as *tunables*: named 32-bit values that a
+ * host tool (`n64tune`, under tools/) can list, read and write live over
+ * the flashcart USB link.
+ *
+ * Usage on the target:
+ *
+ * @code{.c}
+ *      static float mixer_gain = 1.0f;
+ *
+ *      tunables_init();
+ *      tunable_register("mixer_gain", TUNABLE_TYPE_F32, &mixer_gain);
+ * @endcode
+ *
+ * and then call #tunables_poll once per frame (for instance from the
+ * main loop). Commands arrive as text packets through the USB receive
+ * ring (#usb_rx_start), so #timer_init must have been called before
+ * #tunables_init.
+ *
+ * Changes are applied lock-free: a tunable is a single aligned 32-bit
+ * variable, written with one atomic store, so the code using it never
+ * needs to synchronize with the tuning service and can read it from any
+ * context (including interrupt handlers). Code that samples a tunable
+ * more than once per computation should copy it to a local first if it
+ * needs a coherent value.
+ *
+ * @{
+ */
+
+/** @brief Type of a tunable variable */
+typedef enum {
+    TUNABLE_TYPE_I32,           ///< Signed 32-bit integer (int32_t / int)
+    TUNABLE_TYPE_U32,           ///< Unsigned 32-bit integer (uint32_t)
+    TUNABLE_TYPE_F32,           ///< 32-bit floating point (float)
+} tunable_type_t;
+
+/**
+ * @brief Initialize the tuning service.
+ *
+ * This starts the background USB receive ring (#usb_rx_start) used to
+ * pick up commands from the host, so the timer library must have been
+ * initialized. Calling it more than once is harmless.
+ *
+ * @return true if the service is running, false if there is no
+ *         flashcart USB link.
+ */
+bool tunables_init(void);
+
+/**
+ * @brief Register a variable as tunable.
+ *
+ * The variable must be a single aligned 32-bit value that stays alive
+ * for the whole program (a global or a static). The name is not copied
+ * and must be a literal or otherwise permanent string; it must be
+ * unique, contain no whitespace, and should be short — it is what the
+ * host tool displays and matches on.
+ *
+ * @param[in] name      Unique name of the tunable
+ * @param[in] type      Type of the variable
+ * @param[in] var       Pointer to the variable
+ */
+void tunable_register(const char *name, tunable_type_t type, volatile void *var);
+
+/**
+ * @brief Set a tunable from a textual value.
+ *
+ * This is the same path used by remote `set` commands: the value is
+ * parsed according to the tunable's type (integers accept the 0x prefix)
+ * and applied with a single atomic store. It can also be called locally,
+ * for instance to apply settings loaded from a file.
+ *
+ * @param[in] name      Name of the tunable
+ * @param[in] value     Textual value to parse and apply
+ *
+ * @return true if the tunable exists and the value parsed, false otherwise
+ */
+bool tunable_set(const char *name, const char *value);
+
+/**
+ * @brief Process pending tuning commands from the host.
+ *
+ * Call this regularly (once per frame is plenty). It never blocks: it
+ * only dequeues text packets already collected by the USB receive ring.
+ * Note that while the tuning service is polled, incoming USB text
+ * packets are owned by it: unrecognized commands are answered with an
+ * error instead of being left queued.
+ *
+ * @return true if at least one command was processed
+ */
+bool tunables_poll(void);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
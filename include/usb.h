@@ -69,8 +69,58 @@
     ==============================*/
     
     extern void usb_write(int datatype, const void* data, int size);
-    
-    
+
+
+    /*==============================
+        usb_write_start
+        Opens a chunked packet whose payload is supplied incrementally
+        with usb_write_chunk, so a large transfer can be spread over
+        time without one long blocking call. Only one chunked packet
+        can be open at a time; while one is open on the EverDrive,
+        regular usb_write calls are dropped (they keep working on the
+        64Drive and SC64).
+        @param  The DATATYPE of the packet
+        @param  The total payload size in bytes
+        @return 1 if the packet was opened, 0 if the cart is missing or busy
+    ==============================*/
+
+    extern char usb_write_start(int datatype, int size);
+
+
+    /*==============================
+        usb_write_chunk
+        Supplies the next piece of the payload of a chunked packet.
+        Every chunk except the final one must be a multiple of 4 bytes
+        long; the chunks must add up to the size announced at
+        usb_write_start.
+        @param A buffer with the payload piece
+        @param The size of the piece in bytes
+    ==============================*/
+
+    extern void usb_write_chunk(const void* data, int size);
+
+
+    /*==============================
+        usb_write_end
+        Closes a chunked packet and hands it to the USB hardware
+        @return 1 if the packet went out whole, 0 on timeout or if no
+                packet was open
+    ==============================*/
+
+    extern char usb_write_end(void);
+
+
+    /*==============================
+        usb_getstats
+        Returns running totals of bytes written through USB and CPU
+        ticks spent writing them, for throughput measurements
+        @param Destination for the total bytes written (can be NULL)
+        @param Destination for the total ticks spent writing (can be NULL)
+    ==============================*/
+
+    extern void usb_getstats(unsigned int* bytes, unsigned int* ticks);
+
+
     /*==============================
         usb_poll
         Returns the header of data being received via USB
@@ -117,6 +167,74 @@
     extern void usb_purge(void);
 
 
+    /*==============================
+        usb_rx_start
+        Starts servicing incoming USB data in the background: a periodic
+        timer polls the cart and drains packets into a RAM ring, so host
+        commands are picked up within one interval instead of whenever
+        the game explicitly polls. Packets larger than the internal ring
+        (4 KiB) are left in cart memory for the legacy usb_poll/usb_read
+        API. Requires the timer library to be initialized.
+        @param  How often to poll the cart, in milliseconds
+        @return 1 if the service is running, 0 if there is no cart or
+                no timer
+    ==============================*/
+
+    extern char usb_rx_start(int interval_ms);
+
+
+    /*==============================
+        usb_rx_stop
+        Stops the background RX service and discards queued packets
+    ==============================*/
+
+    extern void usb_rx_stop(void);
+
+
+    /*==============================
+        usb_rx_service
+        Polls the flashcart once and drains complete packets into the
+        RX ring. Called automatically from a timer after usb_rx_start;
+        only needed directly on platforms without the timer library.
+    ==============================*/
+
+    extern void usb_rx_service(void);
+
+
+    /*==============================
+        usb_rx_poll
+        Returns the header of the oldest packet queued in the RX ring,
+        without blocking and without touching the cart. Like usb_poll,
+        the first byte is the data type and the other 3 the number of
+        bytes left to read.
+        @return The data header, or 0 if no packet is queued
+    ==============================*/
+
+    extern unsigned long usb_rx_poll(void);
+
+
+    /*==============================
+        usb_read_available
+        Returns how many payload bytes of the oldest queued packet can
+        be dequeued right now, without blocking
+        @return The number of bytes available, or 0 if no packet is queued
+    ==============================*/
+
+    extern int usb_read_available(void);
+
+
+    /*==============================
+        usb_rx_read
+        Dequeues bytes of the oldest queued packet from the RX ring into
+        the provided buffer. Never blocks and never touches the cart.
+        @param  The buffer to put the read data in
+        @param  The maximum number of bytes to read
+        @return The number of bytes actually dequeued
+    ==============================*/
+
+    extern int usb_rx_read(void* buffer, int nbytes);
+
+
     /*==============================
         usb_timedout
         Checks if the USB timed out recently
@@ -0,0 +1,176 @@
+/**
+ * @file video64.h
+ * @brief Support for VIDEO64 movie files
+ * @ingroup rdp
+ */
+
+#ifndef __LIBDRAGON_VIDEO64_H
+#define __LIBDRAGON_VIDEO64_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief VIDEO64 structure
+ *
+ * This structure is initialized by #video64_open to refer to an opened
+ * VIDEO64 file, a full-motion video stream created by the videoconv64 tool.
+ * Frames are stored in ROM as packed YUV and are never touched by the CPU:
+ * playback streams them to RDRAM with asynchronous PI DMA (double-buffered,
+ * so the transfer of the next frame overlaps the display of the current
+ * one), and #video64_draw composites them with RDP textured rectangles
+ * using the hardware YUV conversion (see #rdp_enable_texture_yuv).
+ *
+ * Frame timing is driven by the audio mixer: #video64_play registers a
+ * mixer event (see #mixer_add_event) that fires once per frame period,
+ * counted in audio output samples. This keeps the video locked to the
+ * audio clock, so a soundtrack played through the mixer cannot drift with
+ * respect to the picture. The mixer (and thus the audio subsystem) must be
+ * initialized and polled for playback to advance.
+ *
+ * The typical playback loop is:
+ *
+ * @code{.c}
+ *      video64_t vid;
+ *      video64_open(&vid, "rom:/movie.vid64");
+ *      video64_play(&vid);
+ *      while (video64_update(&vid)) {
+ *          surface_t *disp = display_get();
+ *          rdp_attach(disp);
+ *          video64_draw(&vid, 0, 0);
+ *          rdp_detach();
+ *          display_show(disp);
+ *      }
+ *      video64_close(&vid);
+ * @endcode
+ */
+typedef struct {
+	/** @brief Width of each frame in pixels */
+	int width;
+	/** @brief Height of each frame in pixels */
+	int height;
+	/** @brief Playback rate numerator (frames per second = fps_num/fps_den) */
+	int fps_num;
+	/** @brief Playback rate denominator */
+	int fps_den;
+	/** @brief Total number of frames in the file */
+	int num_frames;
+	/** @brief Frame currently available for drawing (-1 before playback starts) */
+	int cur_frame;
+	/** @brief True if playback restarts from the first frame after the last one */
+	bool loop;
+
+	/** @brief Absolute ROM address of the first frame */
+	uint32_t rom_addr;
+	/** @brief Size in bytes of one frame */
+	int frame_size;
+	/** @brief Height in lines of one TMEM strip */
+	int strip_height;
+	/** @brief Double-buffered frame storage (uncached memory) */
+	uint8_t *buffers[2];
+	/** @brief Frame index stored in each buffer (-1 if none) */
+	int buf_frame[2];
+	/** @brief Buffer currently holding #cur_frame */
+	int buf_front;
+	/** @brief Frames elapsed on the audio clock, not yet consumed */
+	volatile int frames_due;
+	/** @brief Frame period numerator (audio samples * fps_den) */
+	int64_t clock_num;
+	/** @brief Frame period denominator (fps_num) */
+	int64_t clock_den;
+	/** @brief Frame period remainder accumulator */
+	int64_t clock_rem;
+	/** @brief True while playback is active */
+	bool playing;
+	/** @brief True while the frame clock is registered with the mixer */
+	bool clock_active;
+} video64_t;
+
+/** @brief Open a VIDEO64 file for playback.
+ *
+ * This function opens the file, parses the header, and allocates the two
+ * frame buffers used for streaming (in uncached memory, as frames are
+ * written by PI DMA and read by the RDP without ever entering the CPU
+ * cache).
+ *
+ * @param   vid         Pointer to video64_t structure
+ * @param   fn          Filename of the video64 (with filesystem prefix).
+ *                      Currently, only files on DFS ("rom:/") are supported.
+ */
+void video64_open(video64_t *vid, const char *fn);
+
+/** @brief Start playing a VIDEO64 file.
+ *
+ * This function starts streaming the first frame and registers the frame
+ * clock with the audio mixer. The audio subsystem must have been opened
+ * (see #audio_init) and the mixer must be polled regularly (see
+ * #mixer_poll), otherwise playback will never advance past the first
+ * frame.
+ *
+ * Playback of the soundtrack itself is not handled by this module: play
+ * the companion wav64/xm64 through the mixer as usual, starting it next
+ * to this call. Since the frame clock counts mixer output samples, the
+ * two streams cannot drift apart.
+ *
+ * @param   vid         Pointer to video64_t structure
+ */
+void video64_play(video64_t *vid);
+
+/** @brief Advance playback to the frame due on the audio clock.
+ *
+ * Call this function once per displayed frame, before #video64_draw. If a
+ * new frame is due, it flips to the prefetched frame buffer and starts the
+ * asynchronous transfer of the following frame; if the caller is running
+ * behind the clock, intermediate frames are dropped by skipping directly
+ * to the due frame (frames have a fixed size in ROM, so seeking is free).
+ * If no frame is due yet, it returns immediately and #video64_draw will
+ * draw the current frame again.
+ *
+ * @param   vid         Pointer to video64_t structure
+ * @return              True if playback is still active, false if the last
+ *                      frame has been reached (and looping is disabled).
+ *                      The last frame remains valid for drawing.
+ */
+bool video64_update(video64_t *vid);
+
+/** @brief Draw the current frame at the specified position.
+ *
+ * This function composites the current frame into the attached surface
+ * (see #rdp_attach) as a series of RDP textured rectangles, one per TMEM
+ * strip, converting from YUV to RGB in hardware. It configures the render
+ * mode itself (see #rdp_enable_texture_yuv): to draw other textured
+ * primitives afterwards, set the render mode again.
+ *
+ * @param   vid         Pointer to video64_t structure
+ * @param   x           The pixel X location of the top left of the frame
+ * @param   y           The pixel Y location of the top left of the frame
+ */
+void video64_draw(video64_t *vid, int x, int y);
+
+/** @brief Configure a VIDEO64 file for looping playback. */
+void video64_set_loop(video64_t *vid, bool loop);
+
+/** @brief Stop playback.
+ *
+ * The current frame remains valid for drawing. Playback can be restarted
+ * from the beginning with #video64_play.
+ *
+ * @param   vid         Pointer to video64_t structure
+ */
+void video64_stop(video64_t *vid);
+
+/** @brief Close a VIDEO64 file, releasing its memory.
+ *
+ * @param   vid         Pointer to video64_t structure
+ */
+void video64_close(video64_t *vid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __LIBDRAGON_VIDEO64_INTERNAL_H
+#define __LIBDRAGON_VIDEO64_INTERNAL_H
+
+#define VIDEO64_ID              "VID6"
+#define VIDEO64_FILE_VERSION    1
+
+/** @brief Header of a VIDEO64 file.
+ *
+ * The header is followed by #num_frames frames stored back to back at
+ * #start_offset. Every frame has the same size (width * height * 2 bytes)
+ * and is stored as packed 4:2:2 YUV (U Y0 V Y1 macropixels, the DRAM layout
+ * of the RDP YUV 16-bit texture format), sliced in horizontal strips of
+ * #strip_height lines each. A strip is exactly one RDP tile load: its
+ * height is chosen by videoconv64 as the tallest divisor of the frame
+ * height whose luma plane fits the low half of TMEM (2 KiB).
+ *
+ * The fixed frame size is what makes streaming cheap: the ROM address of
+ * any frame can be computed directly from its index, so the player can
+ * drop frames by simply skipping ahead, without parsing the stream. */
+typedef struct __attribute__((packed)) {
+	char id[4];             ///< ID of the file (VIDEO64_ID)
+	int8_t version;         ///< Version of the file (VIDEO64_FILE_VERSION)
+	int8_t padding;         ///< Padding (zero)
+	int16_t width;          ///< Width of each frame in pixels
+	int16_t height;         ///< Height of each frame in pixels
+	int16_t strip_height;   ///< Height in lines of each TMEM strip
+	int32_t fps_num;        ///< Playback rate numerator (frames per second)
+	int32_t fps_den;        ///< Playback rate denominator
+	int32_t num_frames;     ///< Total number of frames in the file
+	int32_t start_offset;   ///< Offset of the first frame in the file
+} video64_header_t;
+
+_Static_assert(sizeof(video64_header_t) == 28, "invalid video64_header size");
+
+#endif
@@ -36,6 +36,28 @@ typedef struct {
 	uint32_t rom_addr;
 } wav64_t;
 
+/**
+ * @brief WAV64 bank: multiple waveforms packed into a single file
+ *
+ * A bank is built by audioconv64 (--wav-bank) and packs any number of
+ * WAV64 waveforms into one file with a single header table. Opening the
+ * bank with #wav64_bank_open initializes all its waveforms at once,
+ * reading the table with a single transfer: for projects with hundreds of
+ * sound effects, this replaces one filesystem open per effect (and the
+ * per-file ROM alignment padding) with a single open at boot.
+ *
+ * Waveforms are addressed by their index in the bank, which matches the
+ * order in which the files were passed to audioconv64. Use
+ * #wav64_bank_play for playback, or #wav64_bank_get to access the
+ * underlying #wav64_t (eg: to configure looping or preloading).
+ */
+typedef struct {
+	/** @brief Waveforms contained in the bank, in bank order */
+	wav64_t *waves;
+	/** @brief Number of waveforms in the bank */
+	int num_waves;
+} wav64_bank_t;
+
 /** @brief Open a WAV64 file for playback.
  * 
  * This function opens the file, parses the header, and initializes for
@@ -50,6 +72,50 @@ void wav64_open(wav64_t *wav, const char *fn);
 /** @brief Configure a WAV64 file for looping playback. */
 void wav64_set_loop(wav64_t *wav, bool loop);
 
+/** @brief Request caching of the loop region in RDRAM.
+ *
+ * For looping waveforms whose loop is too long to stay resident in the
+ * channel sample buffer, looped playback normally re-streams the loop from
+ * ROM at every iteration. Enabling the loop cache makes the mixer pin the
+ * loop region in RDRAM after the first iteration has been decoded, and
+ * serve subsequent iterations from the cached copy, freeing the PI bus for
+ * other transfers. This is useful for long always-playing loops such as
+ * ambience beds.
+ *
+ * The cache costs as much memory as the decompressed loop region, allocated
+ * lazily when the waveform is played. It works both for uncompressed and
+ * compressed files (the cache holds decoded samples). To keep a whole
+ * non-looping waveform in memory instead, see #wav64_preload.
+ *
+ * @param   wav         Pointer to wav64_t structure
+ * @param   enable      True to enable the loop cache for this file
+ */
+void wav64_set_loop_cache(wav64_t *wav, bool enable);
+
+/** @brief Preload a WAV64 file in memory for zero-copy playback.
+ *
+ * This function loads the whole waveform into RDRAM (with a single DMA
+ * transfer), so that subsequent playbacks happen directly from memory:
+ * the mixer will read the samples in place, with no per-poll streaming
+ * from ROM and no staging through the channel sample buffers. This is
+ * ideal for short sound effects that are played very frequently.
+ *
+ * Only uncompressed files can be preloaded. Use #wav64_unload to release
+ * the memory and go back to streaming from ROM.
+ *
+ * @param   wav         Pointer to wav64_t structure
+ */
+void wav64_preload(wav64_t *wav);
+
+/** @brief Release the memory allocated by #wav64_preload.
+ *
+ * After this call, the file goes back to being streamed from ROM during
+ * playback. Do not call this function while the waveform is playing.
+ *
+ * @param   wav         Pointer to wav64_t structure
+ */
+void wav64_unload(wav64_t *wav);
+
 /** @brief Start playing a WAV64 file.
  * 
  * This is just a simple wrapper that calls #mixer_ch_play on the WAV64's
@@ -61,6 +127,48 @@ void wav64_set_loop(wav64_t *wav, bool loop);
  */
 void wav64_play(wav64_t *wav, int ch);
 
+/** @brief Open a WAV64 bank, initializing all its waveforms.
+ *
+ * This function opens the file, parses the header table, and initializes
+ * one #wav64_t per packed waveform. The waveform array is allocated on the
+ * heap; release it with #wav64_bank_close.
+ *
+ * @param   bank        Pointer to wav64_bank_t structure
+ * @param   fn          Filename of the bank (with filesystem prefix). Currently,
+ *                      only files on DFS ("rom:/") are supported.
+ */
+void wav64_bank_open(wav64_bank_t *bank, const char *fn);
+
+/** @brief Close a WAV64 bank, releasing its memory.
+ *
+ * Any waveform preloaded with #wav64_preload is unloaded. Do not call this
+ * function while any waveform of the bank is playing.
+ *
+ * @param   bank        Pointer to wav64_bank_t structure
+ */
+void wav64_bank_close(wav64_bank_t *bank);
+
+/** @brief Access one waveform of a WAV64 bank.
+ *
+ * The returned pointer can be used with all the wav64 functions (eg:
+ * #wav64_set_loop, #wav64_preload) and stays valid until #wav64_bank_close.
+ *
+ * @param   bank        Pointer to wav64_bank_t structure
+ * @param   index       Index of the waveform in the bank
+ * @return              Pointer to the requested waveform
+ */
+wav64_t *wav64_bank_get(wav64_bank_t *bank, int index);
+
+/** @brief Start playing one waveform of a WAV64 bank.
+ *
+ * Equivalent to #wav64_play on the waveform returned by #wav64_bank_get.
+ *
+ * @param   bank        Pointer to wav64_bank_t structure
+ * @param   index       Index of the waveform in the bank
+ * @param   ch          Channel of the mixer to use for playback.
+ */
+void wav64_bank_play(wav64_bank_t *bank, int index, int ch);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,20 @@
 #ifndef __LIBDRAGON_WAV64_INTERNAL_H
 #define __LIBDRAGON_WAV64_INTERNAL_H
 
-#define WAV64_ID            "WV64"
-#define WAV64_FILE_VERSION  2
-#define WAV64_FORMAT_RAW    0
+#define WAV64_ID                "WV64"
+#define WAV64_FILE_VERSION      2
+#define WAV64_FORMAT_RAW        0
+#define WAV64_FORMAT_IMA_ADPCM  1
+
+/** @brief Number of samples (per channel) encoded in each IMA-ADPCM block. */
+#define WAV64_IMA_BLOCK_SAMPLES  1024
+
+/** @brief Compressed size in bytes of one IMA-ADPCM block (all channels).
+ *
+ * Each block starts with a 4-byte header per channel (16-bit predictor,
+ * 8-bit step index, 1 byte padding), followed by the nibble data of each
+ * channel stored contiguously (2 samples per byte, low nibble first). */
+#define WAV64_IMA_BLOCK_SIZE(channels)  ((channels) * (4 + WAV64_IMA_BLOCK_SAMPLES/2))
 
 /** @brief Header of a WAV64 file. */
 typedef struct __attribute__((packed)) {
@@ -20,6 +31,67 @@ typedef struct __attribute__((packed)) {
 
 _Static_assert(sizeof(wav64_header_t) == 24, "invalid wav64_header size");
 
+#define WAV64_BANK_ID           "WB64"
+#define WAV64_BANK_VERSION      1
+
+/** @brief Header of a WAV64 bank file.
+ *
+ * A bank packs multiple waveforms into a single file: this header is
+ * followed by one #wav64_header_t per waveform (the table), and then by the
+ * sample data of all waveforms. The #wav64_header_t::start_offset of each
+ * table entry is relative to the start of the bank file. */
+typedef struct __attribute__((packed)) {
+	char id[4];             ///< ID of the file (WAV64_BANK_ID)
+	int8_t version;         ///< Version of the file (WAV64_BANK_VERSION)
+	int8_t padding[3];      ///< Padding (zero)
+	int32_t num_waves;      ///< Number of waveforms packed in the bank
+} wav64_bank_header_t;
+
+_Static_assert(sizeof(wav64_bank_header_t) == 12, "invalid wav64_bank_header size");
+
+/** @brief IMA-ADPCM step size table. */
+static const int16_t ima_step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+/** @brief IMA-ADPCM step index adjustment table. */
+static const int8_t ima_index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+/**
+ * @brief Decode one IMA-ADPCM nibble, updating the decoder state.
+ *
+ * This function is shared between the runtime decoder (wav64.c) and the
+ * encoder in audioconv64, so that the encoder can reconstruct samples
+ * exactly like the decoder will, avoiding any drift.
+ */
+static inline int16_t ima_decode_nibble(int16_t *predictor, int *step_index, int nib) {
+	int step = ima_step_table[*step_index];
+	int diff = step >> 3;
+	if (nib & 1) diff += step >> 2;
+	if (nib & 2) diff += step >> 1;
+	if (nib & 4) diff += step;
+	if (nib & 8) diff = -diff;
+	int pred = *predictor + diff;
+	if (pred > 32767) pred = 32767;
+	if (pred < -32768) pred = -32768;
+	*predictor = pred;
+	*step_index += ima_index_table[nib];
+	if (*step_index < 0) *step_index = 0;
+	if (*step_index > 88) *step_index = 88;
+	return pred;
+}
+
 typedef struct samplebuffer_s samplebuffer_t;
 
 /**
@@ -78,6 +78,31 @@ typedef struct xm64player_s {
  */
 void xm64player_open(xm64player_t *player, const char *fn);
 
+/**
+ * @brief Open a shared sample bank (XB64 file).
+ *
+ * Modules converted with `audioconv64 --xm-bank` do not embed their waveforms:
+ * the samples of all modules are extracted into a single bank file, with
+ * waveforms shared by multiple modules stored only once. This saves ROM space
+ * and lets crossfading tracks stream the same instrument data.
+ *
+ * Call this function before opening any module converted against the bank;
+ * the bank must stay open for as long as those modules are in use. Only one
+ * bank can be open at a time.
+ *
+ * @param fn     Filename of the XB64 bank (with filesystem prefix). Currently,
+ *               only files on DFS ("rom:/") are supported.
+ */
+void xm64_sample_bank_open(const char *fn);
+
+/**
+ * @brief Close the shared sample bank.
+ *
+ * Make sure all players using modules converted against the bank have been
+ * closed first.
+ */
+void xm64_sample_bank_close(void);
+
 /**
  * @brief Get the number of channels in the XM64 file
  * 
@@ -38,8 +38,12 @@ extern "C" {
  * already fully compatible).
  * 
  * The main conversion option to pay attention too is whether the output file
- * must be compressed or not. Compressed files are smaller but takes 18 KiB
- * more of RDRAM to be played back and cannot be seeked.
+ * must be compressed or not. LHA-compressed files are smaller but takes 18 KiB
+ * more of RDRAM to be played back and cannot be seeked. Alternatively,
+ * audioconv64 can emit a LZ4 block-compressed file (`--ym-lz4`): register
+ * frames are delta-coded and grouped in independently compressed blocks with
+ * a seek table, so the file keeps most of the compression while supporting
+ * seeking and needing only a small (~5 KiB) block buffer at playback.
  * 
  * This player is dedicated to the late Sir Clive Sinclair whose computer,
  * powered by the AY-3-8910, helped popularize what we now call
@@ -69,6 +73,15 @@ typedef struct {
 	uint16_t playfreq;        ///< Frequency of an audio frame (typically 50Hz or 60Hz)
 	int curframe;             ///< Current audio frame being played
 
+	int nblocks;              ///< Number of LZ4 blocks (0 if not block-compressed)
+	uint16_t frames_per_block;///< Number of audio frames in each LZ4 block
+	uint32_t *block_offs;     ///< File offset of each LZ4 block (nblocks+1 entries)
+	uint8_t *block_buf;       ///< Decoding buffer for the current LZ4 block
+	int block_cur;            ///< Block currently decoded in block_buf (-1 if none)
+	int block_pos;            ///< Read position within the decoded block
+	int block_frame;          ///< Audio frames already decoded from the current block
+	uint8_t block_regs[16];   ///< Register reconstruction state for delta decoding
+
 	int first_ch;             ///< First channel used in the mixer for playback
 } ym64player_t;
 
@@ -141,12 +154,14 @@ void ym64player_tell(ym64player_t *player, int *pos, float *secs);
  * 
  * The function seeks to a new absolute position expressed in ticks (internal
  * YM position). Notice that it's not possible to seek in a YM64 file that has
- * been compressed. audioconv64 compresses YM files by default.
- * 
+ * been LHA-compressed (audioconv64 compresses YM files this way by default);
+ * files converted with `audioconv64 --ym-lz4` can be seeked even though they
+ * are compressed.
+ *
  * @param[in]	player 		YM64 player
  * @param[out] 	pos 		Absolute position in ticks
- * @return                  True if it was possible to seek, false if 
- *                          the file is compressed.
+ * @return                  True if it was possible to seek, false if
+ *                          the file is LHA-compressed.
  */
 bool ym64player_seek(ym64player_t *player, int pos);
 
@@ -88,7 +88,6 @@ RSPASFLAGS+=-MMD
 	if [ ! -z "$(strip $(N64_ED64ROMCONFIGFLAGS))" ]; then \
 		$(N64_ED64ROMCONFIG) $(N64_ED64ROMCONFIGFLAGS) $@; \
 	fi
-	$(N64_CHKSUM) $@ >/dev/null
 
 %.v64: %.z64
 	@echo "    [V64] $@"
@@ -0,0 +1,68 @@
+/**
+ * @file arena.c
+ * @brief Arena allocator
+ * @ingroup arena
+ */
+#include <malloc.h>
+#include <stdbool.h>
+#include "libdragon.h"
+
+/** @brief Alignment of arena allocations (data cache line size) */
+#define ARENA_ALIGN 16
+
+bool arena_create(arena_t *arena, int size)
+{
+    assertf(size > 0, "invalid arena size: %d", size);
+
+    void *buf = memalign(ARENA_ALIGN, size);
+    if (!buf)
+        return false;
+    arena_create_buf(arena, buf, size);
+    arena->owned = true;
+    return true;
+}
+
+void arena_create_buf(arena_t *arena, void *buf, int size)
+{
+    assertf(((uint32_t)buf % ARENA_ALIGN) == 0,
+        "arena backing memory must be %d-byte aligned: %p", ARENA_ALIGN, buf);
+    assertf(size > 0, "invalid arena size: %d", size);
+
+    arena->base = buf;
+    arena->cur = arena->base;
+    arena->top = arena->base + size;
+    arena->owned = false;
+}
+
+void arena_destroy(arena_t *arena)
+{
+    if (arena->owned)
+        free(arena->base);
+    arena->base = arena->cur = arena->top = NULL;
+    arena->owned = false;
+}
+
+void *arena_alloc(arena_t *arena, int size)
+{
+    assertf(arena->base, "arena not initialized");
+    assertf(size >= 0, "invalid allocation size: %d", size);
+
+    uint8_t *ptr = arena->cur;
+    int aligned_size = (size + ARENA_ALIGN-1) & ~(ARENA_ALIGN-1);
+    if (aligned_size > arena->top - ptr)
+        return NULL;
+    arena->cur = ptr + aligned_size;
+    return ptr;
+}
+
+void arena_reset(arena_t *arena)
+{
+    assertf(arena->base, "arena not initialized");
+    arena->cur = arena->base;
+}
+
+int arena_avail(arena_t *arena)
+{
+    assertf(arena->base, "arena not initialized");
+    return arena->top - arena->cur;
+}
@@ -2,6 +2,7 @@
 #include "asset_internal.h"
 #include "compress/lzh5_internal.h"
 #include "compress/lz4_dec_internal.h"
+#include "compress/lze_dec_internal.h"
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -13,6 +14,7 @@
 #include "n64sys.h"
 #include "dma.h"
 #include "dragonfs.h"
+#include "compress/lz4_rsp_internal.h"
 #else
 #include <stdlib.h>
 #include <assert.h>
@@ -20,18 +22,20 @@
 #define assertf(x, ...) assert(x)
 #endif
 
-/** 
+/**
  * @brief Compression algorithms
- * 
- * Only level 1 (LZ4) is always initialized. The other algorithm (LZH5)
- * must be initialized manually via #asset_init_compression.
+ *
+ * Only level 1 (LZ4) is always initialized. The other algorithms (LZH5
+ * and LZE) must be initialized manually via #asset_init_compression.
  */
-static asset_compression_t algos[2] = {
+static asset_compression_t algos[3] = {
     {
         .state_size = DECOMPRESS_LZ4_STATE_SIZE,
         .decompress_init = decompress_lz4_init,
+        .decompress_init_rom = decompress_lz4_init_rom,
         .decompress_read = decompress_lz4_read,
         .decompress_full = decompress_lz4_full,
+        .decompress_full_mem = decompress_lz4_full_mem,
     }
 };
 
@@ -45,6 +49,176 @@ void __asset_init_compression_lvl2(void)
     };
 }
 
+#ifdef N64
+void asset_init_rsp_decompression(void)
+{
+    lz4_rsp_init();
+}
+#endif
+
+void __asset_init_compression_lvl3(void)
+{
+    algos[2] = (asset_compression_t){
+        .state_size = DECOMPRESS_LZE_STATE_SIZE,
+        .decompress_init = decompress_lze_init,
+        .decompress_read = decompress_lze_read,
+        .decompress_full = decompress_lze_full,
+        .decompress_full_mem = decompress_lze_full_mem,
+    };
+}
+
+/** @brief Block index of a blocked asset (see #ASSET_FLAG_BLOCKED) */
+typedef struct {
+    int block_size;         ///< Plaintext size of each block (the last one may be shorter)
+    int num_blocks;         ///< Number of blocks
+    uint32_t *offsets;      ///< Compressed offsets (num_blocks+1 entries, malloc'd)
+    uint32_t data_start;    ///< File offset where the block data starts
+    int max_cmp_block;      ///< Size of the largest compressed block
+} asset_blkidx_t;
+
+/**
+ * @brief Read the block index of a blocked asset
+ *
+ * Must be called with the file positioned right after the asset header.
+ * The index is stored big-endian in the file (like the header).
+ */
+static void asset_read_blkidx(FILE *f, asset_blkidx_t *idx)
+{
+    uint32_t hdr[2];
+    fread(hdr, 1, sizeof(hdr), f);
+    if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {  // for mkasset running on PC
+        hdr[0] = __builtin_bswap32(hdr[0]);
+        hdr[1] = __builtin_bswap32(hdr[1]);
+    }
+    idx->block_size = hdr[0];
+    idx->num_blocks = hdr[1];
+
+    idx->offsets = malloc((idx->num_blocks+1) * sizeof(uint32_t));
+    fread(idx->offsets, sizeof(uint32_t), idx->num_blocks+1, f);
+    idx->data_start = ftell(f);
+    idx->max_cmp_block = 0;
+    for (int i = 0; i < idx->num_blocks+1; i++) {
+        if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+            idx->offsets[i] = __builtin_bswap32(idx->offsets[i]);
+        if (i > 0 && idx->offsets[i] - idx->offsets[i-1] > idx->max_cmp_block)
+            idx->max_cmp_block = idx->offsets[i] - idx->offsets[i-1];
+    }
+}
+
+/**
+ * @brief Load a blocked asset, decompressing all blocks in sequence
+ */
+static void *asset_load_blocked(FILE *f, asset_header_t *header)
+{
+    assertf(algos[header->algo-1].decompress_full_mem,
+        "asset: compression level %d does not support blocked files", header->algo);
+
+    asset_blkidx_t idx;
+    asset_read_blkidx(f, &idx);
+
+    uint8_t *s = memalign(16, header->orig_size);
+
+    #ifdef N64
+    // When the RSP LZ4 overlay is available (see asset_init_rsp_decompression),
+    // pipeline the load: while the RSP decodes one block, the PI DMA behind
+    // fread() brings in the next compressed block, so the CPU only
+    // orchestrates. Blocks must start cache-line aligned in the output so
+    // that RSP DMA writes and CPU-decoded blocks never share a line.
+    if (header->algo == 1 && lz4_rsp_usable(idx.block_size) && (idx.block_size % 16) == 0) {
+        uint8_t *scratch2[2] = { malloc(idx.max_cmp_block), malloc(idx.max_cmp_block) };
+        rspq_syncpoint_t sp[2] = { -1, -1 };
+        int left2 = header->orig_size;
+        for (int i = 0; i < idx.num_blocks; i++) {
+            int csize = idx.offsets[i+1] - idx.offsets[i];
+            int dsize = left2 < idx.block_size ? left2 : idx.block_size;
+            uint8_t *buf = scratch2[i & 1];
+
+            // Wait until the RSP is done with this staging slot, then read
+            // the next compressed block into it
+            if (sp[i & 1] >= 0) rspq_syncpoint_wait(sp[i & 1]);
+            fread(buf, 1, csize, f);
+
+            if (lz4_rsp_usable(dsize)) {
+                sp[i & 1] = lz4_rsp_decompress_async(buf, csize,
+                    s + (uint32_t)i*idx.block_size, dsize);
+            } else {
+                // Unpadded final block: decode it on the CPU, after the RSP
+                // has finished writing the blocks before it
+                for (int j = 0; j < 2; j++)
+                    if (sp[j] >= 0) { rspq_syncpoint_wait(sp[j]); sp[j] = -1; }
+                int n = decompress_lz4_full_mem(buf, csize,
+                    s + (uint32_t)i*idx.block_size, dsize, false);
+                assertf(n == dsize, "asset: corrupted blocked file (block %d)", i);
+            }
+            left2 -= dsize;
+        }
+        for (int j = 0; j < 2; j++)
+            if (sp[j] >= 0) rspq_syncpoint_wait(sp[j]);
+        free(scratch2[0]);
+        free(scratch2[1]);
+        free(idx.offsets);
+        return s;
+    }
+    #endif
+
+    uint8_t *scratch = malloc(idx.max_cmp_block);
+    int left = header->orig_size;
+    for (int i = 0; i < idx.num_blocks; i++) {
+        int csize = idx.offsets[i+1] - idx.offsets[i];
+        int dsize = left < idx.block_size ? left : idx.block_size;
+        fread(scratch, 1, csize, f);
+        int n = algos[header->algo-1].decompress_full_mem(scratch, csize,
+            s + (uint32_t)i*idx.block_size, dsize, false);
+        assertf(n == dsize, "asset: corrupted blocked file (block %d)", i);
+        left -= dsize;
+    }
+    free(scratch);
+    free(idx.offsets);
+    return s;
+}
+
+/** @brief Shared dictionary for dictionary-compressed assets (see #asset_set_dict) */
+static const uint8_t *asset_dict = NULL;
+/** @brief Size of #asset_dict in bytes */
+static int asset_dict_size = 0;
+
+void asset_set_dict(const void *dict, int size)
+{
+    asset_dict = dict;
+    asset_dict_size = size;
+}
+
+/**
+ * @brief Load a dictionary-compressed asset (see #ASSET_FLAG_DICT)
+ *
+ * The decompressed output is produced right after a copy of the shared
+ * dictionary, so matches can reference it, and then slid down over it.
+ */
+static void *asset_load_dict(const char *fn, FILE *f, asset_header_t *header)
+{
+    assertf(header->algo == 1,
+        "asset: dictionary compression is only supported with LZ4 (got %d)", header->algo);
+    assertf(asset_dict,
+        "asset: %s was compressed with a shared dictionary.\n"
+        "Load it and call asset_set_dict() at initialization time", fn);
+
+    uint8_t *cmp = malloc(header->cmp_size);
+    fread(cmp, 1, header->cmp_size, f);
+
+    uint8_t *s = memalign(16, asset_dict_size + header->orig_size);
+    memcpy(s, asset_dict, asset_dict_size);
+    int n = decompress_lz4_full_mem_dict(cmp, header->cmp_size,
+        s + asset_dict_size, header->orig_size, s, false);
+    assertf(n == header->orig_size,
+        "asset: decompression error on file %s: corrupted, or wrong dictionary?", fn);
+    free(cmp);
+
+    memmove(s, s + asset_dict_size, header->orig_size);
+    void *ptr = realloc(s, header->orig_size); (void)ptr;
+    assertf(s == ptr, "asset: realloc moved the buffer"); // guaranteed by newlib
+    return ptr;
+}
+
 FILE *must_fopen(const char *fn)
 {
     FILE *f = fopen(fn, "rb");
@@ -92,13 +266,18 @@ void *asset_load(const char *fn, int *sz)
         header.orig_size = __builtin_bswap32(header.orig_size);
         #endif
 
-        assertf(header.algo >= 1 || header.algo <= 2,
+        assertf(header.algo >= 1 && header.algo <= 3,
             "unsupported compression algorithm: %d", header.algo);
         assertf(algos[header.algo-1].decompress_full, 
             "asset: compression level %d not initialized. Call asset_init_compression(%d) at initialization time", header.algo, header.algo);
 
         size = header.orig_size;
-        s = algos[header.algo-1].decompress_full(fn, f, header.cmp_size, size);
+        if (header.flags & ASSET_FLAG_DICT)
+            s = asset_load_dict(fn, f, &header);
+        else if (header.flags & ASSET_FLAG_BLOCKED)
+            s = asset_load_blocked(f, &header);
+        else
+            s = algos[header.algo-1].decompress_full(fn, f, header.cmp_size, size);
     } else {
         // Allocate a buffer big enough to hold the file.
         // We force a 16-byte alignment for the buffer so that it's cacheline aligned.
@@ -117,6 +296,135 @@ void *asset_load(const char *fn, int *sz)
     return s;
 }
 
+void asset_load_ranges(const char *fn, asset_range_t *ranges, int nranges)
+{
+    FILE *f = must_fopen(fn);
+
+    // Check if file is compressed
+    asset_header_t header;
+    fread(&header, 1, sizeof(asset_header_t), f);
+    if (!memcmp(header.magic, ASSET_MAGIC, 3)) {
+        if (header.version != '2') {
+            assertf(0, "unsupported asset version: %c\nMake sure to rebuild libdragon tools and your assets", header.version);
+            return;
+        }
+
+        if (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {  // for mkasset running on PC
+            header.algo = __builtin_bswap16(header.algo);
+            header.flags = __builtin_bswap16(header.flags);
+            header.cmp_size = __builtin_bswap32(header.cmp_size);
+            header.orig_size = __builtin_bswap32(header.orig_size);
+        }
+
+        assertf(header.algo >= 1 && header.algo <= 3,
+            "unsupported compression algorithm: %d", header.algo);
+        assertf(!(header.flags & ASSET_FLAG_DICT),
+            "asset: range loads are not supported on dictionary-compressed files (use asset_load)");
+
+        for (int r = 0; r < nranges; r++)
+            assertf(ranges[r].offset + ranges[r].size <= header.orig_size,
+                "asset range out of bounds: %d+%d > %d",
+                ranges[r].offset, ranges[r].size, (int)header.orig_size);
+
+        if (header.flags & ASSET_FLAG_BLOCKED) {
+            // Blocked file: decode only the blocks that intersect a range,
+            // each exactly once, copying the relevant pieces out. Blocks are
+            // visited in order so the compressed data is read sequentially.
+            assertf(algos[header.algo-1].decompress_full_mem,
+                "asset: compression level %d does not support blocked files", header.algo);
+
+            asset_blkidx_t idx;
+            asset_read_blkidx(f, &idx);
+            uint8_t *scratch = malloc(idx.max_cmp_block);
+            uint8_t *block_buf = malloc(idx.block_size);
+
+            for (int b = 0; b < idx.num_blocks; b++) {
+                uint32_t bstart = (uint32_t)b * idx.block_size;
+                int dsize = header.orig_size - bstart;
+                if (dsize > idx.block_size) dsize = idx.block_size;
+
+                bool needed = false;
+                for (int r = 0; r < nranges && !needed; r++)
+                    needed = ranges[r].offset < bstart + dsize && ranges[r].offset + ranges[r].size > bstart;
+                if (!needed) continue;
+
+                int csize = idx.offsets[b+1] - idx.offsets[b];
+                fseek(f, idx.data_start + idx.offsets[b], SEEK_SET);
+                fread(scratch, 1, csize, f);
+                int n = algos[header.algo-1].decompress_full_mem(scratch, csize, block_buf, dsize, false);
+                assertf(n == dsize, "asset: corrupted blocked file (block %d)", b);
+
+                for (int r = 0; r < nranges; r++) {
+                    int32_t start = ranges[r].offset > bstart ? ranges[r].offset : bstart;
+                    int32_t end = ranges[r].offset + ranges[r].size < bstart + dsize
+                        ? ranges[r].offset + ranges[r].size : bstart + dsize;
+                    if (start < end)
+                        memcpy((uint8_t*)ranges[r].ptr + (start - ranges[r].offset),
+                            block_buf + (start - bstart), end - start);
+                }
+            }
+
+            free(block_buf);
+            free(scratch);
+            free(idx.offsets);
+        } else {
+            // Non-blocked file: there is no way to start decompression in
+            // the middle, so stream from the start up to the last byte
+            // needed, copying the relevant pieces out. Compress with
+            // "mkasset -b" to make range loads skip unneeded blocks.
+            assertf(algos[header.algo-1].decompress_init,
+                "asset: compression level %d not initialized. Call asset_init_compression(%d) at initialization time", header.algo, header.algo);
+
+            uint32_t max_end = 0;
+            for (int r = 0; r < nranges; r++)
+                if (ranges[r].offset + ranges[r].size > max_end)
+                    max_end = ranges[r].offset + ranges[r].size;
+
+            void *state = malloc(algos[header.algo-1].state_size);
+            algos[header.algo-1].decompress_init(state, f);
+
+            uint8_t chunk[512];
+            uint32_t pos = 0;
+            while (pos < max_end) {
+                int n = max_end - pos < sizeof(chunk) ? max_end - pos : sizeof(chunk);
+                n = algos[header.algo-1].decompress_read(state, chunk, n);
+                assertf(n > 0, "asset: corrupted file: %s", fn);
+
+                for (int r = 0; r < nranges; r++) {
+                    int32_t start = ranges[r].offset > pos ? ranges[r].offset : (int32_t)pos;
+                    int32_t end = ranges[r].offset + ranges[r].size < pos + n
+                        ? ranges[r].offset + ranges[r].size : (int32_t)(pos + n);
+                    if (start < end)
+                        memcpy((uint8_t*)ranges[r].ptr + (start - ranges[r].offset),
+                            chunk + (start - pos), end - start);
+                }
+                pos += n;
+            }
+            free(state);
+        }
+    } else {
+        // Uncompressed file: one seek+read per range, each served by a
+        // single DMA transaction on the console.
+        for (int r = 0; r < nranges; r++) {
+            fseek(f, ranges[r].offset, SEEK_SET);
+            int n = fread(ranges[r].ptr, 1, ranges[r].size, f);
+            assertf(n == ranges[r].size, "asset range out of bounds: %d+%d",
+                ranges[r].offset, ranges[r].size);
+        }
+    }
+
+    fclose(f);
+}
+
+void *asset_load_range(const char *fn, int offset, int size)
+{
+    // We force a 16-byte alignment for the buffer like asset_load does.
+    void *buf = memalign(16, size);
+    asset_range_t range = { .offset = offset, .size = size, .ptr = buf };
+    asset_load_ranges(fn, &range, 1);
+    return buf;
+}
+
 #ifdef N64
 
 typedef struct  {
@@ -191,6 +499,96 @@ static int closefn_cmp(void *c)
     return 0;
 }
 
+/** @brief Number of decoded blocks kept cached by a blocked asset FILE* */
+#define BLK_CACHE_SLOTS  2
+
+/** @brief funopen cookie for a blocked (seekable) compressed file */
+typedef struct {
+    FILE *fp;               ///< Underlying (compressed) file
+    int pos;                ///< Current virtual position in the plaintext
+    int orig_size;          ///< Total plaintext size
+    asset_blkidx_t idx;     ///< Block index
+    /** @brief Memory-to-memory decompressor of the file's algorithm */
+    int (*full_mem)(const unsigned char *src, int src_size,
+        unsigned char *dst, int dst_size, bool dma_race);
+    uint8_t *scratch;       ///< Scratch buffer for one compressed block
+    /** @brief Small LRU cache of decoded blocks */
+    struct {
+        int block;          ///< Decoded block index, or -1
+        int stamp;          ///< Last use (for LRU eviction)
+        uint8_t *data;      ///< Decoded block contents
+    } cache[BLK_CACHE_SLOTS];
+    int stamp;              ///< Monotonic access counter
+} cookie_blk_t;
+
+/**
+ * @brief Return the decoded contents of a block, via the LRU cache
+ */
+static uint8_t *blk_get_block(cookie_blk_t *ck, int block)
+{
+    int evict = 0;
+    for (int i = 0; i < BLK_CACHE_SLOTS; i++) {
+        if (ck->cache[i].block == block) {
+            ck->cache[i].stamp = ++ck->stamp;
+            return ck->cache[i].data;
+        }
+        if (ck->cache[i].stamp < ck->cache[evict].stamp)
+            evict = i;
+    }
+
+    int csize = ck->idx.offsets[block+1] - ck->idx.offsets[block];
+    int dsize = ck->orig_size - block*ck->idx.block_size;
+    if (dsize > ck->idx.block_size) dsize = ck->idx.block_size;
+    fseek(ck->fp, ck->idx.data_start + ck->idx.offsets[block], SEEK_SET);
+    fread(ck->scratch, 1, csize, ck->fp);
+    int n = ck->full_mem(ck->scratch, csize, ck->cache[evict].data, dsize, false);
+    assertf(n == dsize, "asset: corrupted blocked file (block %d)", block);
+    ck->cache[evict].block = block;
+    ck->cache[evict].stamp = ++ck->stamp;
+    return ck->cache[evict].data;
+}
+
+static int readfn_blk(void *c, char *buf, int sz)
+{
+    cookie_blk_t *ck = c;
+    if (sz > ck->orig_size - ck->pos) sz = ck->orig_size - ck->pos;
+    int read = 0;
+    while (read < sz) {
+        int block = ck->pos / ck->idx.block_size;
+        int boff = ck->pos % ck->idx.block_size;
+        int n = ck->idx.block_size - boff;
+        if (n > sz - read) n = sz - read;
+        memcpy(buf + read, blk_get_block(ck, block) + boff, n);
+        read += n; ck->pos += n;
+    }
+    return read;
+}
+
+static fpos_t seekfn_blk(void *c, fpos_t pos, int whence)
+{
+    cookie_blk_t *ck = c;
+    switch (whence) {
+    case SEEK_CUR: pos += ck->pos; break;
+    case SEEK_END: pos += ck->orig_size; break;
+    }
+    if (pos < 0) pos = 0;
+    if (pos > ck->orig_size) pos = ck->orig_size;
+    ck->pos = pos;
+    return pos;
+}
+
+static int closefn_blk(void *c)
+{
+    cookie_blk_t *ck = c;
+    fclose(ck->fp); ck->fp = NULL;
+    free(ck->idx.offsets);
+    free(ck->scratch);
+    for (int i = 0; i < BLK_CACHE_SLOTS; i++)
+        free(ck->cache[i].data);
+    free(ck);
+    return 0;
+}
+
 FILE *asset_fopen(const char *fn, int *sz)
 {
     FILE *f = must_fopen(fn);
@@ -217,14 +615,49 @@ FILE *asset_fopen(const char *fn, int *sz)
 
         cookie_cmp_t *cookie;
 
-        assertf(header.algo >= 1 || header.algo <= 2,
+        assertf(header.algo >= 1 && header.algo <= 3,
             "unsupported compression algorithm: %d", header.algo);
-        assertf(algos[header.algo-1].decompress_init, 
+        assertf(!(header.flags & ASSET_FLAG_DICT),
+            "asset: streaming is not supported on dictionary-compressed files (use asset_load)");
+        assertf(algos[header.algo-1].decompress_init,
             "asset: compression level %d not initialized. Call asset_init_compression(%d) at initialization time", header.algo, header.algo);
 
+        if (header.flags & ASSET_FLAG_BLOCKED) {
+            // Blocked file: return a fully seekable FILE* backed by the
+            // block index and a small cache of decoded blocks.
+            assertf(algos[header.algo-1].decompress_full_mem,
+                "asset: compression level %d does not support blocked files", header.algo);
+            cookie_blk_t *blk = malloc(sizeof(cookie_blk_t));
+            blk->fp = f;
+            blk->pos = 0;
+            blk->orig_size = header.orig_size;
+            blk->stamp = 0;
+            asset_read_blkidx(f, &blk->idx);
+            blk->full_mem = algos[header.algo-1].decompress_full_mem;
+            blk->scratch = malloc(blk->idx.max_cmp_block);
+            for (int i = 0; i < BLK_CACHE_SLOTS; i++) {
+                blk->cache[i].block = -1;
+                blk->cache[i].stamp = 0;
+                blk->cache[i].data = malloc(blk->idx.block_size);
+            }
+            if (sz) *sz = header.orig_size;
+            return funopen(blk, readfn_blk, NULL, seekfn_blk, closefn_blk);
+        }
+
         cookie = malloc(sizeof(cookie_cmp_t) + algos[header.algo-1].state_size);
         cookie->read = algos[header.algo-1].decompress_read;
-        algos[header.algo-1].decompress_init(cookie->state, f);
+
+        // If the file lives on DFS, feed the decoder straight from ROM via
+        // DMA (when the algorithm supports it), skipping the stdio staging
+        // copies through the DFS sector cache.
+        uint32_t rom_addr = 0;
+        if (algos[header.algo-1].decompress_init_rom && !strncmp(fn, "rom:/", 5))
+            rom_addr = dfs_rom_addr(fn+5);
+        if (rom_addr)
+            algos[header.algo-1].decompress_init_rom(cookie->state, f,
+                rom_addr + sizeof(asset_header_t), header.cmp_size);
+        else
+            algos[header.algo-1].decompress_init(cookie->state, f);
 
         cookie->fp = f;
         cookie->pos = 0;
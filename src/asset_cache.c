@@ -0,0 +1,177 @@
+/**
+ * @file asset_cache.c
+ * @brief Opt-in cache for repeated asset loads
+ * @ingroup asset
+ */
+#include "asset.h"
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include "debug.h"
+#include "dragonfs.h"
+
+/**
+ * Scene transitions tend to reload many of the same assets (shared UI
+ * textures, common sound effects), paying the full PI transfer and
+ * decompression cost every time. This module keeps recently loaded assets
+ * resident in RDRAM within a configurable budget, so an A->B->A pattern
+ * serves the second A largely from memory.
+ *
+ * Entries are keyed by the ROM address of the file (via #dfs_rom_addr),
+ * which is stable, cheap to obtain, and independent of path spelling.
+ * Files outside the ROM filesystem cannot be keyed this way and simply
+ * bypass the cache. Entries are refcounted: a cached buffer is shared
+ * between all current holders (treat it as read-only) and only entries
+ * with no holders are eligible for LRU eviction.
+ */
+
+/** @brief One cached asset, linked in LRU order (most recent first) */
+typedef struct cache_entry_s {
+    struct cache_entry_s *next;     ///< Next entry (less recently used)
+    struct cache_entry_s *prev;     ///< Previous entry (more recently used)
+    uint32_t rom_addr;              ///< ROM address of the file (cache key)
+    void *data;                     ///< Loaded (uncompressed) contents
+    int size;                       ///< Size of the contents in bytes
+    int refcount;                   ///< Number of holders that have not released
+} cache_entry_t;
+
+/** @brief Head of the LRU list (most recently used) */
+static cache_entry_t *cache_head = NULL;
+/** @brief Tail of the LRU list (least recently used) */
+static cache_entry_t *cache_tail = NULL;
+/** @brief Configured RDRAM budget in bytes (0: cache disabled) */
+static int cache_budget = 0;
+/** @brief Bytes currently held by cached entries */
+static int cache_used = 0;
+/** @brief Number of loads served from the cache */
+static int cache_hits = 0;
+/** @brief Number of loads that went to the filesystem */
+static int cache_misses = 0;
+
+static void cache_unlink(cache_entry_t *e)
+{
+    if (e->prev) e->prev->next = e->next;
+    else cache_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else cache_tail = e->prev;
+    e->next = e->prev = NULL;
+}
+
+static void cache_push_front(cache_entry_t *e)
+{
+    e->prev = NULL;
+    e->next = cache_head;
+    if (cache_head) cache_head->prev = e;
+    cache_head = e;
+    if (!cache_tail) cache_tail = e;
+}
+
+/** @brief Evict unreferenced entries from the LRU tail until @p bytes fit */
+static void cache_make_room(int bytes)
+{
+    cache_entry_t *e = cache_tail;
+    while (e && cache_used + bytes > cache_budget) {
+        cache_entry_t *prev = e->prev;
+        if (e->refcount == 0) {
+            cache_unlink(e);
+            cache_used -= e->size;
+            free(e->data);
+            free(e);
+        }
+        e = prev;
+    }
+}
+
+void asset_cache_init(int max_bytes)
+{
+    assertf(cache_budget == 0, "asset cache already initialized");
+    assertf(max_bytes > 0, "invalid asset cache budget: %d", max_bytes);
+    cache_budget = max_bytes;
+    cache_hits = cache_misses = 0;
+}
+
+void asset_cache_close(void)
+{
+    cache_entry_t *e = cache_head;
+    while (e) {
+        cache_entry_t *next = e->next;
+        assertf(e->refcount == 0, "asset cache closed with %d unreleased reference(s)", e->refcount);
+        free(e->data);
+        free(e);
+        e = next;
+    }
+    cache_head = cache_tail = NULL;
+    cache_budget = cache_used = 0;
+}
+
+void *asset_cache_load(const char *fn, int *sz)
+{
+    // Without an initialized cache, behave exactly like asset_load
+    if (cache_budget == 0)
+        return asset_load(fn, sz);
+
+    // Key the file by its ROM address; non-ROM files bypass the cache
+    uint32_t rom_addr = 0;
+    if (!strncmp(fn, "rom:/", 5))
+        rom_addr = dfs_rom_addr(fn+5);
+
+    if (rom_addr) {
+        for (cache_entry_t *e = cache_head; e; e = e->next) {
+            if (e->rom_addr == rom_addr) {
+                e->refcount++;
+                cache_hits++;
+                cache_unlink(e);
+                cache_push_front(e);
+                if (sz) *sz = e->size;
+                return e->data;
+            }
+        }
+    }
+
+    int size;
+    void *data = asset_load(fn, &size);
+    if (sz) *sz = size;
+    cache_misses++;
+
+    if (!rom_addr)
+        return data;
+
+    // Make room within the budget; if the file is larger than what can be
+    // freed (or than the budget itself), hand it out uncached
+    cache_make_room(size);
+    if (cache_used + size > cache_budget)
+        return data;
+
+    cache_entry_t *e = malloc(sizeof(cache_entry_t));
+    e->rom_addr = rom_addr;
+    e->data = data;
+    e->size = size;
+    e->refcount = 1;
+    cache_push_front(e);
+    cache_used += size;
+    return data;
+}
+
+void asset_cache_release(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    for (cache_entry_t *e = cache_head; e; e = e->next) {
+        if (e->data == ptr) {
+            assertf(e->refcount > 0, "asset released more times than loaded");
+            e->refcount--;
+            return;
+        }
+    }
+
+    // Not a cached buffer (non-ROM file, or it did not fit the budget)
+    free(ptr);
+}
+
+void asset_cache_stats(int *hits, int *misses, int *used)
+{
+    if (hits) *hits = cache_hits;
+    if (misses) *misses = cache_misses;
+    if (used) *used = cache_used;
+}
@@ -3,9 +3,36 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stdbool.h>
 
 #define ASSET_MAGIC    "DCA"   ///< Magic compressed asset header
 
+/**
+ * @brief Flag: the payload is a sequence of independently compressed blocks
+ *
+ * Blocked assets support random access: mkasset splits the plaintext in
+ * fixed-size blocks, compresses each one independently, and stores an index
+ * of compressed offsets before the block data. The payload layout is:
+ *
+ *   u32 block_size; u32 num_blocks; u32 offsets[num_blocks+1]; blocks...
+ *
+ * where offsets are relative to the end of the index, so block i occupies
+ * the compressed byte range [offsets[i], offsets[i+1]).
+ */
+#define ASSET_FLAG_BLOCKED  (1<<0)
+
+/**
+ * @brief Flag: the payload was compressed against a shared dictionary
+ *
+ * Dictionary-compressed assets (mkasset --dict) reference a shared
+ * dictionary trained on the asset corpus: the decompressor must place the
+ * dictionary right before the output buffer so matches can reach into it.
+ * The application registers the dictionary with #asset_set_dict before
+ * loading such assets. Only supported with LZ4 and #asset_load (no
+ * streaming, no blocks, no ranges).
+ */
+#define ASSET_FLAG_DICT     (1<<1)
+
 /** @brief Header of a compressed asset */
 typedef struct {
     char magic[3];          ///< Magic header
@@ -24,11 +51,17 @@ typedef struct {
 
     /** @brief Initialize the decompression state */
     void (*decompress_init)(void *state, FILE *fp);
+    /** @brief Initialize the state with input DMA-fed from ROM (can be NULL) */
+    void (*decompress_init_rom)(void *state, FILE *fp, uint32_t rom_addr, int cmp_size);
     /** @brief Partially read a decompressed file from a state */
     ssize_t (*decompress_read)(void *state, void *buf, size_t len);
 
     /** @brief Decompress a full file in one go */
     void* (*decompress_full)(const char *fn, FILE *fp, size_t cmp_size, size_t len);
+
+    /** @brief Decompress a full block from memory (used for blocked assets, can be NULL) */
+    int (*decompress_full_mem)(const unsigned char *src, int src_size,
+        unsigned char *dst, int dst_size, bool dma_race);
 } asset_compression_t;
 
 
@@ -70,6 +70,10 @@
 
 /** @brief Number of buffers the audio subsytem allocates and manages */
 #define NUM_BUFFERS     4
+/** @brief Maximum number of buffers the adaptive mode is allowed to grow to */
+#define MAX_ADAPTIVE_BUFFERS   8
+/** @brief Underrun-free chunks played before adaptive mode tries to shrink (~10s) */
+#define ADAPTIVE_SHRINK_PERIOD (BUFFERS_PER_SECOND * 10)
 /** @brief How many different audio buffers we want to schedule in one second. */
 #define BUFFERS_PER_SECOND    25
 /**
@@ -84,6 +88,8 @@
 
 /** @brief The actual frequency the AI will run at */
 static int _frequency = 0;
+/** @brief The exact (fractional) frequency the AI will run at */
+static float _frequency_exact = 0;
 /** @brief The number of buffers currently allocated */
 static int _num_buf = NUM_BUFFERS;
 /** @brief The buffer size in bytes for each buffer allocated */
@@ -98,6 +104,10 @@ static audio_fill_buffer_callback _orig_fill_buffer_callback = NULL;
 
 static volatile bool _paused = false;
 
+/** @brief Slice size in stereo samples used in pull mode (defaults to a full buffer) */
+static int _slice_size = 0;
+/** @brief Sample offset of the next slice within the current buffer (pull mode) */
+static volatile int slice_off = 0;
 /** @brief Index of the current playing buffer */
 static volatile int now_playing = 0;
 /** @brief Length of the playing queue (number of buffers queued for AI DMA) */
@@ -109,6 +119,25 @@ static volatile int now_writing = 0;
 /** @brief Bitmask of buffers indicating which buffers are full */
 static volatile int buf_full = 0;
 
+/** @brief Cumulative number of detected underruns (AI ran dry) */
+static volatile uint32_t _underruns = 0;
+/** @brief True if at least one buffer was enqueued since the AI last went idle */
+static bool _started = false;
+/** @brief Number of chunks (buffers or slices) enqueued to the AI so far */
+static uint32_t _chunks_played = 0;
+/** @brief Value of _chunks_played at the last underrun (or adaptive resize) */
+static uint32_t _last_underrun = 0;
+/** @brief True if adaptive buffering is enabled (see #audio_set_adaptive_buffering) */
+static bool _adaptive = false;
+/** @brief Number of buffers originally requested (adaptive mode won't shrink below) */
+static int _num_buf_min = NUM_BUFFERS;
+/** @brief True if an underrun occurred and adaptive mode should grow the ring */
+static volatile bool _grow_pending = false;
+/** @brief True if the audio producer declared itself quiescent (see #audio_set_quiescent) */
+static volatile bool _quiescent = false;
+/** @brief Bitmask of internal buffers known to contain only silence */
+static volatile uint32_t _buf_silent = 0;
+
 /** @brief Structure used to interact with the AI registers */
 static volatile struct AI_regs_s * const AI_regs = (struct AI_regs_s *)0xa4500000;
 
@@ -170,26 +199,74 @@ static void audio_callback()
         buf_full &= ~(1<<now_empty);
     }
 
-    /* Copy in as many buffers as can fit (up to 2) */
+    /* If the DAC went idle while we had started playback, it means that we
+       missed a deadline: record the underrun. In adaptive mode, ask for the
+       buffer ring to be grown (this happens lazily in audio_write and
+       friends, as we cannot allocate memory here under interrupt). */
+    if (_started && playing_queue == 0 && !(status & AI_STATUS_BUSY)) {
+        _underruns++;
+        _started = false;
+        _last_underrun = _chunks_played;
+        if (_adaptive && !_fill_buffer_callback && _num_buf < MAX_ADAPTIVE_BUFFERS)
+            _grow_pending = true;
+    }
+
+    /* Copy in as many buffers/slices as can fit (up to 2) */
     while(playing_queue < 2)
     {
-        /* check if next buffer is full */
-        int next = (now_playing + 1) % _num_buf;
-        if ((!(buf_full & (1<<next))) && !_fill_buffer_callback)
-        {
-            break;
-        }
+        short *dst;
+        int nsamples;
 
         if (_fill_buffer_callback) {
-            _fill_buffer_callback(buffers[next], _buf_size);
+            /* Pull mode: fill and enqueue one slice at a time, carved out of
+               the internal buffers. The AI can keep two DMA transfers queued,
+               so the trigger-to-DAC latency is roughly two slices: smaller
+               slices mean the callback runs more often, but latency shrinks
+               accordingly (see #audio_set_slice_length). */
+            if (slice_off >= _buf_size) {
+                slice_off = 0;
+                now_playing = (now_playing + 1) % _num_buf;
+            }
+            dst = buffers[now_playing] + slice_off*2;
+            nsamples = _buf_size - slice_off;
+            if (nsamples > _slice_size)
+                nsamples = _slice_size;
+            if (_quiescent) {
+                /* Quiescent producer: do not invoke the callback, feed cached
+                   silence instead. Each buffer is zeroed (at most) once as it
+                   comes around, so once the whole ring is silent the per-slice
+                   cost drops to nothing. */
+                if (!(_buf_silent & (1<<now_playing))) {
+                    if (slice_off == 0) {
+                        memset(buffers[now_playing], 0, _buf_size * 2 * sizeof(short));
+                        _buf_silent |= 1<<now_playing;
+                    } else {
+                        memset(dst, 0, nsamples * 2 * sizeof(short));
+                    }
+                }
+            } else {
+                _fill_buffer_callback(dst, nsamples);
+                _buf_silent &= ~(1<<now_playing);
+            }
+            slice_off += nsamples;
+        } else {
+            /* check if next buffer is full */
+            int next = (now_playing + 1) % _num_buf;
+            if (!(buf_full & (1<<next)))
+            {
+                break;
+            }
+            dst = buffers[next];
+            nsamples = _buf_size;
+            now_playing = next;
         }
 
         /* Enqueue next buffer. Don't mark it as empty right now because the
            DMA will run in background, and we need to avoid audio_write()
            to reuse it before the DMA is finished. */
-        AI_regs->address = buffers[next];
+        AI_regs->address = dst;
         MEMORY_BARRIER();
-        AI_regs->length = (_buf_size * 2 * 2 ) & ( ~7 );
+        AI_regs->length = (nsamples * 2 * 2 ) & ( ~7 );
         MEMORY_BARRIER();
 
         /* Start DMA */
@@ -198,7 +275,8 @@ static void audio_callback()
 
         /* Remember that we queued one buffer */
         playing_queue++;
-        now_playing = next;
+        _started = true;
+        _chunks_played++;
     }
 
     /* Safe to enable interrupts here */
@@ -250,11 +328,13 @@ void audio_init(const int frequency, int numbuffers)
     }
 
     /* Remember frequency */
-    AI_regs->dacrate = ((2 * clockrate / frequency) + 1) / 2 - 1;
+    int dacrate = ((2 * clockrate / frequency) + 1) / 2 - 1;
+    AI_regs->dacrate = dacrate;
     AI_regs->samplesize = 15;
 
     /* Real frequency */
     _frequency = 2 * clockrate / ((2 * clockrate / frequency) + 1);
+    _frequency_exact = (float)clockrate / (float)(dacrate + 1);
 
     /* Set up hardware to notify us when it needs more data */
     register_AI_handler(audio_callback);
@@ -290,6 +370,148 @@ void audio_init(const int frequency, int numbuffers)
     now_writing = 0;
     buf_full = 0;
     _paused = false;
+    _slice_size = _buf_size;
+    slice_off = 0;
+
+    /* All buffers start zeroed, so mark them as silent */
+    _quiescent = false;
+    _buf_silent = (1 << _num_buf) - 1;
+
+    /* Reset telemetry and adaptive state */
+    _underruns = 0;
+    _started = false;
+    _chunks_played = 0;
+    _last_underrun = 0;
+    _grow_pending = false;
+    _num_buf_min = _num_buf;
+}
+
+/**
+ * @brief Apply a pending adaptive resize of the buffer ring.
+ *
+ * Called (with interrupts disabled) from the writer functions, where it is
+ * safe to allocate memory. Growing only happens when the ring is fully
+ * drained, which is the normal state right after an underrun: appending a
+ * buffer at that point cannot reorder audio that is already queued.
+ */
+static void audio_adaptive_apply(void)
+{
+    if (!_adaptive)
+        return;
+
+    if (_grow_pending) {
+        if (buf_full == 0 && playing_queue == 0 && _num_buf < MAX_ADAPTIVE_BUFFERS) {
+            int i = _num_buf;
+            buffers = realloc(buffers, (_num_buf+1) * sizeof(short *));
+            buffers_orig = realloc(buffers_orig, (_num_buf+1) * sizeof(short *));
+            buffers_orig[i] = buffers[i] =
+                malloc_uncached(sizeof(short) * 2 * _buf_size + 8);
+            if (((uint32_t)(buffers[i] + 2 * _buf_size) & 0x1FFF) == 0)
+                buffers[i] += 4;
+            memset(buffers[i], 0, sizeof(short) * 2 * _buf_size);
+            _buf_silent |= 1<<i;
+            _num_buf++;
+            now_playing = now_empty = now_writing = 0;
+        }
+        _grow_pending = false;
+    } else if (_num_buf > _num_buf_min && _chunks_played - _last_underrun > ADAPTIVE_SHRINK_PERIOD) {
+        /* Headroom is back: drop the last buffer of the ring, provided it is
+           not full, not being written, and not queued to the AI. */
+        int last = _num_buf - 1;
+        bool in_flight = false;
+        for (int q=0, idx=now_empty; q<playing_queue; q++) {
+            idx = (idx + 1) % _num_buf;
+            if (idx == last)
+                in_flight = true;
+        }
+        if (!in_flight && !(buf_full & (1<<last)) &&
+            now_playing != last && now_empty != last && now_writing != last) {
+            free_uncached(buffers_orig[last]);
+            buffers_orig[last] = buffers[last] = NULL;
+            _buf_silent &= ~(1<<last);
+            _num_buf--;
+            /* Restart the headroom timer, so that shrinking is gradual */
+            _last_underrun = _chunks_played;
+        }
+    }
+}
+
+/**
+ * @brief Enable or disable adaptive buffering
+ *
+ * In adaptive mode, the audio subsystem reacts to underruns (see
+ * #audio_get_underruns) by growing the number of internal buffers (up to a
+ * maximum of 8), trading latency for resilience. When playback then runs
+ * without underruns for a while, the ring is progressively shrunk back,
+ * down to the count requested in #audio_init.
+ *
+ * Adaptive mode only applies to the push interface (#audio_write and
+ * friends): in pull mode (#audio_set_buffer_callback), buffers are filled
+ * on demand under interrupt, so a larger ring would not prevent underruns.
+ *
+ * @param[in] enable
+ *            True to enable adaptive buffering, false to disable it
+ */
+void audio_set_adaptive_buffering(bool enable)
+{
+    disable_interrupts();
+    _adaptive = enable;
+    if (!enable)
+        _grow_pending = false;
+    enable_interrupts();
+}
+
+/**
+ * @brief Declare that the audio producer is quiescent (producing pure silence)
+ *
+ * This enables a low-power mode for the audio stack in pull mode
+ * (#audio_set_buffer_callback): while the producer is quiescent, the fill
+ * callback is not invoked at all, and the AI is fed from the internal buffers
+ * which are lazily zeroed (at most once each) and then reused as cached
+ * silence. Once the whole ring is silent, the per-slice CPU cost of keeping
+ * the DAC fed drops to virtually zero.
+ *
+ * The flag is purely a hint about future output: asserting it does not cut
+ * off audio that is already queued. It is normally managed automatically by
+ * the mixer, which asserts it when all channels are stopped (and fully
+ * ramped down) with no pending events, and clears it on the next
+ * #mixer_ch_play; manual pull-mode producers can drive it the same way.
+ * Playback resumes with the first slice after the flag is cleared.
+ *
+ * @param[in] quiescent
+ *            True if the producer would only generate silence, false to
+ *            resume invoking the fill callback
+ */
+void audio_set_quiescent(bool quiescent)
+{
+    _quiescent = quiescent;
+}
+
+/**
+ * @brief Configure the slice length used in pull mode
+ *
+ * When a fill callback is installed via #audio_set_buffer_callback, audio is
+ * produced and enqueued to the AI in slices. By default, a slice is a whole
+ * internal buffer (1/25th of a second). Since the AI keeps at most two DMA
+ * transfers queued, the latency between producing a sample and hearing it is
+ * roughly two slices; shortening the slice reduces the latency at the cost of
+ * running the fill callback (and its AI interrupt) more often.
+ *
+ * For instance, at 44100 Hz a slice of 352 samples gives a ~16 ms
+ * trigger-to-DAC latency.
+ *
+ * @param[in] len
+ *            Length of a slice in stereo samples. Will be clamped to the
+ *            internal buffer length, and rounded down to a multiple of 2
+ *            (as required by AI DMA).
+ */
+void audio_set_slice_length(int len)
+{
+    if (len > _buf_size)
+        len = _buf_size;
+    if (len < 2)
+        len = 2;
+    _slice_size = len & ~1;
 }
 
 /**
@@ -343,6 +565,7 @@ void audio_close()
     }
 
     _frequency = 0;
+    _frequency_exact = 0;
     _buf_size = 0;
 }
 
@@ -401,6 +624,10 @@ void audio_write(const short * const buffer)
 
     disable_interrupts();
 
+    /* Apply any pending adaptive resize of the ring (safe here: not under
+       interrupt, so we are allowed to allocate memory) */
+    audio_adaptive_apply();
+
     /* check for empty buffer */
     int next = (now_writing + 1) % _num_buf;
     while (buf_full & (1<<next))
@@ -415,6 +642,7 @@ void audio_write(const short * const buffer)
     buf_full |= (1<<next);
     now_writing = next;
     memcpy(buffers[now_writing], buffer, _buf_size * 2 * sizeof(short));
+    _buf_silent &= ~(1<<now_writing);
     audio_callback();
     enable_interrupts();
 }
@@ -448,6 +676,10 @@ short* audio_write_begin(void)
 
     disable_interrupts();
 
+    /* Apply any pending adaptive resize of the ring (safe here: not under
+       interrupt, so we are allowed to allocate memory) */
+    audio_adaptive_apply();
+
     /* check for empty buffer */
     int next = (now_writing + 1) % _num_buf;
     while (buf_full & (1<<next))
@@ -477,6 +709,7 @@ void audio_write_end(void)
 {
     disable_interrupts();
     buf_full |= (1<<now_writing);
+    _buf_silent &= ~(1<<now_writing);
     audio_callback();
     enable_interrupts();
 }
@@ -500,6 +733,10 @@ void audio_write_silence()
 
     disable_interrupts();
 
+    /* Apply any pending adaptive resize of the ring (safe here: not under
+       interrupt, so we are allowed to allocate memory) */
+    audio_adaptive_apply();
+
     /* check for empty buffer */
     int next = (now_writing + 1) % _num_buf;
     while (buf_full & (1<<next))
@@ -510,10 +747,14 @@ void audio_write_silence()
         disable_interrupts();
     }
 
-    /* Copy silence into local buffers */
+    /* Copy silence into local buffers. Buffers that already contain silence
+       from a previous round don't even need the memset. */
     buf_full |= (1<<next);
     now_writing = next;
-    memset(buffers[now_writing], 0, _buf_size * 2 * sizeof(short));
+    if (!(_buf_silent & (1<<now_writing))) {
+        memset(buffers[now_writing], 0, _buf_size * 2 * sizeof(short));
+        _buf_silent |= 1<<now_writing;
+    }
     audio_callback();
     enable_interrupts();
 }
@@ -547,6 +788,28 @@ int audio_get_frequency()
     return _frequency;
 }
 
+/**
+ * @brief Return the exact frequency of audio playback
+ *
+ * The AI DAC rate is programmed as an integer divisor of the video clock,
+ * so the frequency requested in #audio_init is quantized to the nearest
+ * achievable rate, which is in general not an integer (eg: requesting
+ * 44100 Hz on NTSC yields about 44095.5 Hz). This function returns the
+ * exact achieved rate, while #audio_get_frequency returns it truncated
+ * to an integer.
+ *
+ * Knowing the exact rate is useful for resamplers that want to match the
+ * output rate precisely (the mixer does this automatically, see
+ * #mixer_ch_set_freq), or to author content at the achieved rate in the
+ * first place.
+ *
+ * @return Exact frequency in Hz of the audio playback
+ */
+float audio_get_frequency_exact()
+{
+    return _frequency_exact;
+}
+
 /**
  * @brief Get the number of stereo samples that fit into an allocated buffer
  *
@@ -560,4 +823,51 @@ int audio_get_buffer_length()
     return _buf_size;
 }
 
+/**
+ * @brief Get the number of internal buffers currently allocated
+ *
+ * This matches the count requested in #audio_init, unless adaptive
+ * buffering (#audio_set_adaptive_buffering) has resized the ring.
+ *
+ * @return The number of internal buffers
+ */
+int audio_get_buffer_count()
+{
+    return _num_buf;
+}
+
+/**
+ * @brief Get the current fill level of the internal buffers
+ *
+ * This returns the number of buffers that currently hold samples waiting
+ * to be played (including the ones queued for AI DMA). A fill level that
+ * frequently reaches 0 indicates that underruns are imminent and the
+ * producer is late; a fill level that is always at the maximum means there
+ * is headroom to reduce latency (fewer buffers, or a shorter slice in
+ * pull mode).
+ *
+ * @return The number of filled buffers (0 to #audio_get_buffer_count;
+ *         in pull mode, 0 to 2, as buffers are filled on demand)
+ */
+int audio_get_fill_level()
+{
+    if (!buffers)
+        return 0;
+    return _fill_buffer_callback ? playing_queue : __builtin_popcount(buf_full);
+}
+
+/**
+ * @brief Get the cumulative number of audio underruns
+ *
+ * An underrun is recorded whenever the AI DAC runs out of queued samples
+ * while playback is active, which results in an audible pop or gap. The
+ * counter is reset by #audio_init.
+ *
+ * @return The number of underruns detected since #audio_init
+ */
+uint32_t audio_get_underruns()
+{
+    return _underruns;
+}
+
 /** @} */ /* audio */
@@ -20,6 +20,10 @@ int xm_create_context_safe(xm_context_t** ctxp, const char* moddata, size_t modd
 	char* mempool;
 	xm_context_t* ctx;
 
+#if XM_FIXED_POINT_MATH
+	xm_tables_init();
+#endif
+
 	if(XM_DEFENSIVE) {
 		int ret;
 		if((ret = xm_check_sanity_preload(moddata, moddata_length))) {
@@ -107,6 +111,12 @@ int xm_create_context_safe(xm_context_t** ctxp, const char* moddata, size_t modd
 
 #if !defined(N64) && !XM_STREAM_PATTERNS && !XM_STREAM_WAVEFORMS
 
+/* When non-NULL, xm_context_save does not embed waveform data: sample i
+ * (in flat instrument/sample order) is instead stored as a reference into
+ * an external sample bank at this offset (XM64_SAMPLE_IN_BANK is set on
+ * it). Set by audioconv64 when building a shared bank (--xm-bank). */
+const uint32_t *xm_save_sample_bank_offsets = NULL;
+
 void xm_context_save(xm_context_t* ctx, FILE* out) {
 
 	#undef _W64 // defined by mingw
@@ -127,7 +137,7 @@ void xm_context_save(xm_context_t* ctx, FILE* out) {
 	#define WALIGN()  ({ while (ftell(out) % 8) _W8(0); })
 
 
-	const uint8_t version = 6;
+	const uint8_t version = xm_save_sample_bank_offsets ? 8 : 7;
 	WA("XM64", 4);
 	W8(version);
 	W32(ctx->ctx_size);
@@ -136,6 +146,9 @@ void xm_context_save(xm_context_t* ctx, FILE* out) {
 	W32(ctx->ctx_size_stream_pattern_buf);
 	for (int i=0; i<32; i++) W32(ctx->ctx_size_stream_sample_buf[i]);
 
+	uint32_t metadata_size_off = ftell(out);
+	W32((uint32_t)0); // metadata size, will fill later
+
 	W16(ctx->module.tempo);
 	W16(ctx->module.bpm);
 
@@ -224,8 +237,15 @@ void xm_context_save(xm_context_t* ctx, FILE* out) {
 			W32(s->loop_type);
 			WF(s->panning);
 			W8(s->relative_note);
-			sam_off[sam_off_idx++] = ftell(out);
-			W32(0); // will fill later
+			if (xm_save_sample_bank_offsets) {
+				/* Waveform lives in the external bank: store the reference */
+				uint32_t bank_off = xm_save_sample_bank_offsets[sam_off_idx] | XM64_SAMPLE_IN_BANK;
+				sam_off[sam_off_idx++] = 0;
+				W32(bank_off);
+			} else {
+				sam_off[sam_off_idx++] = ftell(out);
+				W32((uint32_t)0); // will fill later
+			}
 		}
 	}
 
@@ -233,10 +253,17 @@ void xm_context_save(xm_context_t* ctx, FILE* out) {
 	pat_off_idx = 0;
 	sam_off_idx = 0;
 
+	// Record the size of the serialized metadata (everything up to this
+	// point), so that the loader can fetch it with a single read.
+	uint32_t metadata_size = ftell(out);
+	fseek(out, metadata_size_off, SEEK_SET);
+	W32(metadata_size);
+	fseek(out, metadata_size, SEEK_SET);
+
 	WA("WAVE", 4);
 	uint32_t wv_overred = XM_WAVEFORM_OVERREAD;
 	W32(wv_overred);
-	for (int i=0;i<ctx->module.num_instruments;i++) {
+	for (int i=0;i<ctx->module.num_instruments && !xm_save_sample_bank_offsets;i++) {
 		xm_instrument_t *ins = &ctx->module.instruments[i];
 		for (int j=0;j<ins->num_samples;j++) {
 			xm_sample_t *s = &ins->samples[j];
@@ -409,14 +436,102 @@ int xm_context_decompress_pattern(uint8_t *in, int sz, xm_pattern_slot_t *pat) {
 }
 
 
+/* Buffered reader used by xm_context_load. The serialized metadata is made
+ * of thousands of tiny fields: reading them with one fread() each dominates
+ * module open time (each call pays the full stdio/filesystem overhead). The
+ * reader slurps the file in large chunks and serves the fields from memory,
+ * so opening a module is bound by the few bulk reads only. */
+#define XM_BR_BUFSIZE 4096
+typedef struct {
+	FILE *fh;
+	uint8_t *buf;     /* current buffer: either inbuf, or a preloaded blob */
+	uint8_t inbuf[XM_BR_BUFSIZE];
+	int pos, len;
+	long fpos;    /* physical file position (end of the buffered data) */
+} xm_bufreader_t;
+
+static void xm_br_init(xm_bufreader_t *br, FILE *fh) {
+	br->fh = fh; br->buf = br->inbuf; br->pos = br->len = 0; br->fpos = ftell(fh);
+}
+
+/* Fill the reader from an external buffer with a single bulk read. All
+ * subsequent reads and seeks within the preloaded range are served from
+ * memory; past its end, the reader falls back to its internal buffer. The
+ * caller owns the external buffer and can free it once the reader has moved
+ * past it. */
+static void xm_br_preload(xm_bufreader_t *br, uint8_t *buf, int n) {
+	int avail = br->len - br->pos;
+	if (n <= avail) return;   /* already fully buffered */
+	memcpy(buf, br->buf + br->pos, avail);
+	int rd = fread(buf + avail, 1, n - avail, br->fh);
+	br->buf = buf; br->pos = 0; br->len = avail + rd; br->fpos += rd;
+}
+
+static long xm_br_tell(xm_bufreader_t *br) {
+	return br->fpos - (br->len - br->pos);
+}
+
+static void xm_br_seek(xm_bufreader_t *br, long off, int whence) {
+	if (whence == SEEK_CUR) off += xm_br_tell(br);
+	long have = br->fpos - br->len;   /* file offset of buf[0] */
+	if (off >= have && off <= br->fpos) {
+		/* Seek within the buffered data: just move the cursor */
+		br->pos = off - have;
+		return;
+	}
+	fseek(br->fh, off, SEEK_SET);
+	br->fpos = off; br->pos = br->len = 0;
+}
+
+static uint8_t xm_br_u8(xm_bufreader_t *br) {
+	if (br->pos == br->len) {
+		br->buf = br->inbuf;
+		br->len = fread(br->buf, 1, XM_BR_BUFSIZE, br->fh);
+		br->fpos += br->len;
+		br->pos = 0;
+		if (br->len == 0) return 0;
+	}
+	return br->buf[br->pos++];
+}
+
+static void xm_br_read(xm_bufreader_t *br, void *dst, int n) {
+	uint8_t *d = dst;
+	int avail = br->len - br->pos;
+	if (avail > n) avail = n;
+	memcpy(d, br->buf + br->pos, avail);
+	br->pos += avail; d += avail; n -= avail;
+	if (n >= XM_BR_BUFSIZE) {
+		/* Large read: no point staging it through the buffer */
+		int rd = fread(d, 1, n, br->fh);
+		br->fpos += rd;
+		return;
+	}
+	while (n-- > 0) *d++ = xm_br_u8(br);
+}
+
+#if !XM_STREAM_WAVEFORMS
+/* Shared sample bank registered with xm_set_sample_bank. The non-streaming
+ * loader resolves XM64_SAMPLE_IN_BANK references by copying the waveform
+ * data out of this buffer. (The streaming player on N64 never loads the
+ * data at all: it resolves the references to ROM addresses instead, see
+ * xm64.c.) */
+static const uint8_t* xm_sample_bank_data = NULL;
+static uint32_t xm_sample_bank_size = 0;
+
+void xm_set_sample_bank(const void* data, uint32_t size) {
+	xm_sample_bank_data = data;
+	xm_sample_bank_size = size;
+}
+#endif
+
 int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 
 	#define _CHKSZ(x,n) ({ _Static_assert(sizeof(x) == n, "invalid type size"); })
-	#define _R8(x)     ({ uint8_t u8; fread(&u8, 1, 1, in); x=u8; })
+	#define _R8(x)     ({ x = xm_br_u8(br); })
 	#define _R16(x)    ({ uint16_t lo2, hi2; _R8(hi2); _R8(lo2); x=(hi2<<8)|lo2; })
 	#define _R32(x)    ({ uint32_t lo4, hi4; _R16(hi4); _R16(lo4); x=(hi4<<16)|lo4; })
 	#define _R64(x)    ({ uint64_t lo8, hi8; _R32(hi8); _R32(lo8); x=(hi8<<32)|lo8; })
-	#define _RA(x,n)   ({ fread(x, n, 1, in); })
+	#define _RA(x,n)   ({ xm_br_read(br, x, n); })
 
 	#define R8(x)     ({ _CHKSZ(x,1); _R8((x)); })
 	#define R16(x)    ({ _CHKSZ(x,2); _R16((x)); })
@@ -425,14 +540,22 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 	#define RA(x,n)   ({ _RA((uint8_t*)(x),n); })
 	#define RB(x)     ({ bool *b = &x; _R8(*b); })
 	#define RF(x)     ({ _CHKSZ(x,4); uint32_t fx; _R32(fx); uint8_t *f = (uint8_t*)(&fx); x=*(float*)f; })
-	#define RALIGN()  ({ int a = ftell(in)%8; if (a) fseek(in, 8-a, SEEK_CUR); })
+	#define RALIGN()  ({ int a = xm_br_tell(br)%8; if (a) xm_br_seek(br, 8-a, SEEK_CUR); })
 
 	#ifdef XM_STRINGS
 	#define RS(x,n)   RA(x,n)
 	#else
-	#define RS(x,n)   fseek(in, n, SEEK_CUR)  // just skip the string
+	#define RS(x,n)   xm_br_seek(br, n, SEEK_CUR)  // just skip the string
 	#endif
 
+	xm_bufreader_t br_state;
+	xm_bufreader_t *br = &br_state;
+	xm_br_init(br, in);
+
+#if XM_FIXED_POINT_MATH
+	xm_tables_init();
+#endif
+
 	uint8_t version;
 	char head[4];
 	RA(head, 4);
@@ -445,8 +568,13 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 	//  5: first public version
 	//  6: added overread for non-looping samples. The size of optimal
 	//     stream sample buffer size must change, hance the version bump.
+	//  7: size of the serialized metadata stored in the header, so that
+	//     the loader can fetch the whole metadata with one bulk read.
+	//  8: waveforms may live in an external shared sample bank (XB64):
+	//     their data8_offset has XM64_SAMPLE_IN_BANK set and is relative
+	//     to the bank file instead of the module file.
 	R8(version);
-	if (version != 5 && version != 6) {
+	if (version < 5 || version > 8) {
 		DEBUG("invalid XM64 version %d\n", version);
 		return 1;		
 	}
@@ -467,6 +595,19 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 		}
 	}
 
+	uint8_t *metadata_buf = NULL;
+	if (version >= 7) {
+		uint32_t metadata_size;
+		R32(metadata_size);
+		// Fetch the rest of the metadata (plus the WAVE tag and overread
+		// word that follow it) with one bulk read, so that opening a module
+		// costs a couple of large I/O operations instead of a seek-and-read
+		// per structure.
+		int n = metadata_size + 8 - xm_br_tell(br);
+		metadata_buf = malloc(n);
+		xm_br_preload(br, metadata_buf, n);
+	}
+
 	uint32_t alloc_bytes = ctx_size;
 	#if XM_STREAM_PATTERNS
 	alloc_bytes -= ctx_size_all_patterns;
@@ -581,6 +722,7 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 	RA(head, 4);
 	if (head[0] != 'W' && head[1] != 'A' && head[2] != 'V' && head[3] != 'E') {
 		DEBUG("invalid WAVE header\n");
+		free(metadata_buf);
 		free(*ctxp);
 		*ctxp = NULL;
 		return 1;
@@ -590,11 +732,22 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 	R32(wv_overread);
 	if (wv_overread < XM_WAVEFORM_OVERREAD) {
 		DEBUG("waveform overread too little (%d < %d)\n", (int)wv_overread, XM_WAVEFORM_OVERREAD);
+		free(metadata_buf);
 		free(*ctxp);
 		*ctxp = NULL;
 		return 1;
 	}
 
+	// The preloaded metadata ends here: everything that follows is either
+	// streamed from ROM (N64) or bulk sample/pattern data. Detach the
+	// reader from the blob before freeing it.
+	if (metadata_buf) {
+		if (br->buf == metadata_buf) {
+			br->buf = br->inbuf; br->pos = br->len = 0;
+		}
+		free(metadata_buf);
+	}
+
 
 #if !XM_STREAM_WAVEFORMS
 	for (int i=0;i<ctx->module.num_instruments;i++) {
@@ -603,21 +756,40 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 		for (int j=0;j<ins->num_samples;j++) {
 			xm_sample_t *s = &ins->samples[j];
 
-			fseek(in, s->data8_offset, SEEK_SET);
+			uint32_t bank_off = 0; bool in_bank = false;
+			if (s->data8_offset & XM64_SAMPLE_IN_BANK) {
+				bank_off = s->data8_offset & ~XM64_SAMPLE_IN_BANK;
+				in_bank = true;
+			} else {
+				xm_br_seek(br, s->data8_offset, SEEK_SET);
+			}
 
 			s->data8 = (int8_t*)mempool;
 			mempool += s->length * (s->bits / 8) + XM_WAVEFORM_OVERREAD;
 			if ((size_t)mempool & 7) mempool += 8 - ((size_t)mempool & 7);
 
-			if (s->bits == 8)
-				RA(s->data8, s->length+XM_WAVEFORM_OVERREAD);
-			else {
-				RA(s->data8, s->length*2+XM_WAVEFORM_OVERREAD);
-				#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			uint32_t nbytes = s->length * (s->bits / 8) + XM_WAVEFORM_OVERREAD;
+			if (in_bank) {
+				/* Resolve the reference against the registered sample bank.
+				   The bank stores data in the same (big-endian) layout as
+				   the module WAVE section would. */
+				if (xm_sample_bank_data == NULL || bank_off + nbytes > xm_sample_bank_size) {
+					DEBUG("module references a sample bank that is not loaded\n");
+					free(*ctxp);
+					*ctxp = NULL;
+					return 1;
+				}
+				memcpy(s->data8, xm_sample_bank_data + bank_off, nbytes);
+			} else {
+				RA(s->data8, nbytes);
+			}
+
+			#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			if (s->bits == 16) {
 				for (int k=0;k<s->length+XM_WAVEFORM_OVERREAD/2;k++)
 					s->data16[k] = __builtin_bswap16(s->data16[k]);
-				#endif
 			}
+			#endif
 		}
 	}
 
@@ -640,7 +812,7 @@ int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate) {
 		int cmp_size = p->slots_size;
 		int dec_size = sizeof(xm_pattern_slot_t) * p->num_rows * ctx->module.num_channels;
 
-		fseek(in, p->slots_offset, SEEK_SET);
+		xm_br_seek(br, p->slots_offset, SEEK_SET);
 
 		assert(((size_t)mempool & 7) == 0);
 		p->slots = (xm_pattern_slot_t*)mempool;
@@ -118,6 +118,35 @@ static const float multi_retrig_multiply[] = {
 
 /* ----- Function definitions ----- */
 
+#if XM_FIXED_POINT_MATH
+/* Precomputed tables for the hot synthesis math, filled by xm_tables_init
+ * at context load. powf and sinf are by far the most expensive operations
+ * of the engine on targets with a slow FPU: powf runs on every frequency
+ * update (so on every tick of a vibrato), sinf on every tick of a
+ * sine-waveform vibrato/tremolo. */
+static float xm_pow2_table[769]; /* 2^(i/768), i in [0, 768] */
+static float xm_sine_table[64];  /* sin(2*pi*i/64), i in [0, 64) */
+static bool xm_tables_ready = false;
+
+void xm_tables_init(void) {
+	if(xm_tables_ready) return;
+	for(int i = 0; i <= 768; i++)
+		xm_pow2_table[i] = powf(2.f, (float)i / 768.f);
+	for(int i = 0; i < 64; i++)
+		xm_sine_table[i] = sinf(2.f * 3.141592f * (float)i / 64.f);
+	xm_tables_ready = true;
+}
+
+/* Compute val * 2^oct by adjusting the float exponent directly. Valid as
+ * long as the result stays in the normal range, which holds for the
+ * period/frequency values used by the engine. */
+static inline float xm_scale_pow2(float val, int oct) {
+	union { float f; uint32_t i; } u = { .f = val };
+	u.i += (uint32_t)oct << 23;
+	return u.f;
+}
+#endif
+
 static float xm_waveform(xm_waveform_type_t waveform, uint8_t step) {
 	static unsigned int next_rand = 24492;
 	step %= 0x40;
@@ -125,9 +154,13 @@ static float xm_waveform(xm_waveform_type_t waveform, uint8_t step) {
 	switch(waveform) {
 
 	case XM_SINE_WAVEFORM:
+#if XM_FIXED_POINT_MATH
+		return -xm_sine_table[step];
+#else
 		/* Why not use a table? For saving space, and because there's
 		 * very very little actual performance gain. */
 		return -sinf(2.f * 3.141592f * (float)step / (float)0x40);
+#endif
 
 	case XM_RAMP_DOWN_WAVEFORM:
 		/* Ramp down: 1.0f when step = 0; -1.0f when step = 0x40 */
@@ -306,7 +339,23 @@ static float xm_linear_period(float note) {
 }
 
 static float xm_linear_frequency(float period) {
+#if XM_FIXED_POINT_MATH
+	/* 8363 * 2^((4608 - period) / 768), computed via the 2^(i/768) table.
+	 * The exponent is decomposed as octave + table index + fraction in
+	 * 24.8 fixed point; linear interpolation between adjacent table
+	 * entries keeps the relative error below 1e-5, inaudible. */
+	int32_t x = (int32_t)((4608.f - period) * 256.f);
+	int32_t oct = x / (768*256);
+	if(x < 0 && x != oct * (768*256)) oct--;
+	int32_t rem = x - oct * (768*256);
+	int32_t idx = rem >> 8;
+	float frac = (float)(rem & 255) * (1.f / 256.f);
+	float val = xm_pow2_table[idx];
+	val += (xm_pow2_table[idx+1] - val) * frac;
+	return xm_scale_pow2(8363.f * val, oct);
+#else
 	return 8363.f * powf(2.f, (4608.f - period) / 768.f);
+#endif
 }
 
 static float xm_amiga_period(float note) {
@@ -857,6 +906,107 @@ static void xm_key_off(xm_channel_context_t* ch) {
 	}
 }
 
+#if XM_STREAM_PATTERNS
+#include <malloc.h>
+#include <string.h>
+#include "dma.h"
+#include "n64sys.h"
+
+/* Pattern prefetch state. While a pattern plays, the compressed slot data
+ * of the upcoming one (predicted from the order table) is loaded from ROM
+ * in background with an asynchronous PI DMA, so that the switch does not
+ * stall on I/O. This state is deliberately kept out of xm_context_t, whose
+ * memory budget is computed by audioconv64 at conversion time. */
+static struct {
+	xm_context_t *ctx;   /* context that owns the prefetcher (NULL = none) */
+	uint32_t rom_base;   /* ROM address of the module file */
+	uint8_t *buf;        /* staging buffer for compressed slot data */
+	int pat_idx;         /* pattern currently staged (-1 = none) */
+	int skew;            /* 1 if the ROM address parity required a 1-byte skew */
+	bool pending;        /* a DMA transfer is still in flight */
+} xm_prefetch = { .pat_idx = -1 };
+
+void xm_set_pattern_prefetch(xm_context_t *ctx, uint32_t rom_base) {
+	if(xm_prefetch.ctx && xm_prefetch.ctx != ctx) {
+		/* Another context already owns the prefetcher: fall back to
+		 * synchronous reads for this one. */
+		return;
+	}
+	if(xm_prefetch.pending)
+		dma_wait();
+	free(xm_prefetch.buf);
+	memset(&xm_prefetch, 0, sizeof(xm_prefetch));
+	xm_prefetch.pat_idx = -1;
+	if(ctx == NULL || rom_base == 0)
+		return;
+
+	int max_size = 0;
+	for(int i = 0; i < ctx->module.num_patterns; i++) {
+		if(ctx->module.patterns[i].slots_size > max_size)
+			max_size = ctx->module.patterns[i].slots_size;
+	}
+	if(max_size == 0)
+		return;
+
+	/* One extra byte allows fixing up the 2-byte phase of odd ROM
+	 * addresses, as required by PI DMA. */
+	xm_prefetch.buf = memalign(16, (max_size + 1 + 15) & ~15);
+	if(xm_prefetch.buf == NULL)
+		return;
+	xm_prefetch.ctx = ctx;
+	xm_prefetch.rom_base = rom_base;
+}
+
+/* If the requested pattern has been prefetched, copy it into dst and
+ * return true. Returns false if the prediction missed (eg: because of a
+ * position jump), in which case the caller must read it synchronously. */
+static bool xm_prefetch_get(xm_context_t *ctx, int pat_idx, uint8_t *dst, int size) {
+	if(xm_prefetch.ctx != ctx || xm_prefetch.pat_idx != pat_idx)
+		return false;
+	if(xm_prefetch.pending) {
+		dma_wait();
+		xm_prefetch.pending = false;
+	}
+	memcpy(dst, xm_prefetch.buf + xm_prefetch.skew, size);
+	return true;
+}
+
+/* Kick off the background load of the upcoming pattern, if it is not
+ * already staged. Called at the end of each row, so a mispredicted jump
+ * corrects itself within one row. */
+static void xm_prefetch_start(xm_context_t *ctx) {
+	if(xm_prefetch.ctx != ctx)
+		return;
+
+	uint16_t ti = ctx->current_table_index;
+	if(ti >= ctx->module.length)
+		ti = ctx->module.restart_position;
+	uint8_t target = ctx->module.pattern_table[ti];
+	if(target == ctx->slot_buffer_index) {
+		/* Still inside the current pattern: look one entry ahead. */
+		ti++;
+		if(ti >= ctx->module.length)
+			ti = ctx->module.restart_position;
+		target = ctx->module.pattern_table[ti];
+	}
+	if(target == ctx->slot_buffer_index || target == xm_prefetch.pat_idx)
+		return;
+
+	if(xm_prefetch.pending)
+		dma_wait();
+
+	xm_pattern_t *pat = ctx->module.patterns + target;
+	uint32_t rom_addr = xm_prefetch.rom_base + pat->slots_offset;
+	xm_prefetch.skew = rom_addr & 1;
+	data_cache_hit_writeback_invalidate(xm_prefetch.buf,
+		(pat->slots_size + xm_prefetch.skew + 15) & ~15);
+	dma_read_async(xm_prefetch.buf, rom_addr - xm_prefetch.skew,
+		pat->slots_size + xm_prefetch.skew);
+	xm_prefetch.pat_idx = target;
+	xm_prefetch.pending = true;
+}
+#endif
+
 static void xm_row(xm_context_t* ctx) {
 	if(ctx->position_jump) {
 		ctx->current_table_index = ctx->jump_dest;
@@ -886,8 +1036,10 @@ static void xm_row(xm_context_t* ctx) {
 		int dec_size = sizeof(xm_pattern_slot_t) * cur->num_rows * ctx->module.num_channels;
 		uint8_t *cmp_data = (uint8_t*)ctx->slot_buffer + dec_size - cmp_size;
 
-		fseek(ctx->fh, cur->slots_offset, SEEK_SET);
-		fread(cmp_data, cmp_size, 1, ctx->fh);
+		if(!xm_prefetch_get(ctx, pat_idx, cmp_data, cmp_size)) {
+			fseek(ctx->fh, cur->slots_offset, SEEK_SET);
+			fread(cmp_data, cmp_size, 1, ctx->fh);
+		}
 
 		int sz = xm_context_decompress_pattern(cmp_data, cmp_size, ctx->slot_buffer);
 		assert(sz == dec_size);
@@ -936,6 +1088,12 @@ static void xm_row(xm_context_t* ctx) {
 		ctx->jump_row = 0;
 		xm_post_pattern_change(ctx);
 	}
+
+#if XM_STREAM_PATTERNS
+	/* Start loading the upcoming pattern in background, so that the next
+	 * pattern switch finds it already staged. */
+	xm_prefetch_start(ctx);
+#endif
 }
 
 static void xm_envelope_tick(xm_channel_context_t* ch,
@@ -21,6 +21,7 @@
 #define XM_LINEAR_INTERPOLATION      0
 #define XM_DEBUG                     1
 #define XM_DEFENSIVE                 0
+#define XM_FIXED_POINT_MATH          1    // Replace transcendental libm calls in the synthesis engine with precomputed tables and integer math
 
 // Activate RSP-based XM implementation
 #ifdef N64
@@ -89,13 +90,25 @@ void xm_context_save(xm_context_t* ctx, FILE* out);
 #endif
 
 /** Load a context from a XM64 file.
- * 
+ *
  * Returns 0 in case of success, 1 in case of generic error (file corrupted),
  * or 2 in case the memory size estimated by the writer wasn't enough to load
  * the file.
  */
 int xm_context_load(xm_context_t** ctxp, FILE* in, uint32_t rate);
 
+/** Register a shared sample bank (XB64 contents) for the non-streaming loader.
+ *
+ * Modules saved with an external sample bank (audioconv64 --xm-bank) do not
+ * embed waveform data; xm_context_load copies it out of the registered bank
+ * instead. The buffer must stay valid while such modules are being loaded.
+ * On N64 the waveforms are streamed straight from the bank in ROM, so this
+ * function does not exist there: see xm64_sample_bank_open() instead.
+ */
+#if !XM_STREAM_WAVEFORMS
+void xm_set_sample_bank(const void* data, uint32_t size);
+#endif
+
 /** Play the module and put the sound samples in an output buffer.
  *
  * @param output buffer of 2*numsamples elements
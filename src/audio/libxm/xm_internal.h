@@ -16,6 +16,13 @@
 // this amount of bytes. See also rspxm.S for details.
 #define XM_WAVEFORM_OVERREAD      64
 
+// Flag set in xm_sample_t.data8_offset when the waveform data lives in an
+// external shared sample bank (XB64 file) instead of the module file itself.
+// The rest of the offset is then relative to the start of the bank file.
+// Banks are created by audioconv64 (--xm-bank) to deduplicate waveforms
+// shared by multiple modules.
+#define XM64_SAMPLE_IN_BANK       0x80000000u
+
 #if XM_STREAM_WAVEFORMS
 typedef struct waveform_s waveform_t;
 #endif
@@ -337,6 +344,29 @@ struct xm_context_s {
 
 /* ----- Internal API ----- */
 
+#if XM_FIXED_POINT_MATH
+/** Precompute the frequency/waveform tables used by the synthesis engine.
+ *
+ * Called automatically when a context is created/loaded. Idempotent.
+ */
+void xm_tables_init(void);
+#endif
+
+#if XM_STREAM_PATTERNS
+/** Enable background prefetching of streamed patterns.
+ *
+ * When the module file lives in ROM, pattern data can be loaded in
+ * background with an asynchronous PI DMA while the previous pattern is
+ * still playing, instead of synchronously at the pattern boundary.
+ * Pass the ROM address of the module file to enable, or 0 to disable
+ * (which also releases the staging buffer).
+ *
+ * Only one context at a time can use prefetching; further contexts
+ * silently fall back to synchronous reads.
+ */
+void xm_set_pattern_prefetch(xm_context_t*, uint32_t rom_base);
+#endif
+
 /** Check the module data for errors/inconsistencies.
  *
  * @returns 0 if everything looks OK. Module should be safe to load.
@@ -41,9 +41,9 @@
 #define AI_STATUS_FULL  ( 1 << 31 )
 /** @} */
 
-/** @brief Maximum number of mixer events */
+/** @brief Initial capacity of the mixer event queue (grown on demand) */
 #define MAX_EVENTS              32
-/** @brief Number of expected #mixer_poll calls per second 
+/** @brief Number of expected #mixer_poll calls per second
  *
  * This is used to allocate memory for the sample buffers
  * according to the expected number of samples that must
@@ -51,6 +51,44 @@
  */
 #define MIXER_POLL_PER_SECOND   8
 
+/** @brief Number of polls a stopped channel keeps being processed by the RSP.
+ *
+ * When a channel is keyed off, the RSP volume filter still needs a few polls
+ * to smoothly ramp its volume down to zero. During this grace period, the
+ * channel is still counted as active (see #mixer_exec); after that, it is
+ * excluded from the RSP processing loop altogether, so that the RSP cost
+ * scales with the number of playing voices rather than with the configured
+ * channel count.
+ */
+#define MIXER_CH_GRACE_POLLS    8
+
+/** @brief Volume (in #mixer_fx15_t units) below which a channel is inaudible.
+ *
+ * When both the left and right volume of a playing channel stay below this
+ * threshold (about -60 dB), and the RSP volume filter has had time to ramp
+ * the output down to silence (see #MIXER_CH_GRACE_POLLS), the channel is
+ * skipped entirely: no sample fetch, no samplebuffer maintenance and no RSP
+ * mixing. The playback position keeps advancing arithmetically, so raising
+ * the volume later resumes playback exactly where it would have been. This
+ * makes ducked-but-allocated channels (eg: ambience beds faded to zero)
+ * virtually free.
+ */
+#define MIXER_CH_SILENT_VOL     MIXER_FX15(0.001f)
+
+/** @brief Maximum distance (in #mixer_fx64_t units) of a resampling step
+ * from 1.0 that is snapped to exactly 1.0.
+ *
+ * The AI DAC rate is quantized (see #audio_get_frequency_exact), so a
+ * waveform authored at the nominal output rate (eg: 44100 Hz) never matches
+ * the exact achieved rate (eg: ~44095.5 Hz on NTSC), and would be resampled
+ * forever to correct an inaudible pitch error. When the computed step is
+ * within this threshold of 1.0 (4/4096, about 0.1%, while the achievable
+ * DAC rates around 44 kHz are about 40 Hz = 0.09% apart), it is snapped to
+ * a unitary step, so that the waveform passes through with no resampling
+ * at all.
+ */
+#define MIXER_STEP_UNITY_SNAP   4
+
 /**
  * RSP mixer ucode (rsp_mixer.S)
  */
@@ -64,6 +102,7 @@ DEFINE_RSP_UCODE(rsp_mixer);
 #define CH_FLAGS_16BIT      (1<<2)   ///< Set if the channel is 16 bit
 #define CH_FLAGS_STEREO     (1<<3)   ///< Set if the channel is stereo (left)
 #define CH_FLAGS_STEREO_SUB (1<<4)   ///< The channel is the second half of a stereo (right)
+#define CH_FLAGS_LERP       (1<<5)   ///< Resample with linear interpolation (16-bit only)
 
 /// @brief Fixed point value used in waveform position calculations.
 /// This is a signed 64-bit integer with the fractional part using
@@ -149,12 +188,14 @@ typedef struct {
 
 static struct {
 	uint32_t sample_rate;
+	float sample_rate_exact;
 	int num_channels;
 	float vol;
 
 	int64_t ticks;
 	int num_events;
-	mixer_event_t events[MAX_EVENTS];
+	int max_events;
+	mixer_event_t *events;
 
 	uint8_t *ch_buf_mem;
 	samplebuffer_t ch_buf[MIXER_MAX_CHANNELS];
@@ -163,6 +204,10 @@ static struct {
 	mixer_channel_t channels[MIXER_MAX_CHANNELS];
 	mixer_fx15_t lvol[MIXER_MAX_CHANNELS];
 	mixer_fx15_t rvol[MIXER_MAX_CHANNELS];
+	uint8_t ch_grace[MIXER_MAX_CHANNELS];
+	uint8_t ch_silence[MIXER_MAX_CHANNELS];
+	uint8_t ch_quality[MIXER_MAX_CHANNELS];
+	uint32_t ch_static;
 
 	rsp_mixer_settings_t ucode_settings __attribute__((aligned(8)));
 
@@ -180,6 +225,7 @@ void mixer_init(int num_channels) {
 
 	Mixer.num_channels = num_channels;
 	Mixer.sample_rate = audio_get_frequency();  // actual sample rate obtained via DAC clock
+	Mixer.sample_rate_exact = audio_get_frequency_exact();
 	assertf(Mixer.sample_rate > 0, "audio_init() must be called before mixer_init()");
 	Mixer.vol = 1.0f;
 
@@ -242,6 +288,7 @@ void mixer_set_vol(float vol) {
 void mixer_close(void) {
 	assert(mixer_initialized());
 
+	audio_set_quiescent(false);
 	rspq_overlay_unregister(__mixer_overlay_id);
 	__mixer_overlay_id = 0;
 
@@ -250,6 +297,12 @@ void mixer_close(void) {
 		Mixer.ch_buf_mem = NULL;
 	}
 
+	if (Mixer.events) {
+		free(Mixer.events);
+		Mixer.events = NULL;
+		Mixer.num_events = Mixer.max_events = 0;
+	}
+
 	Mixer.num_channels = 0;
 }
 
@@ -257,7 +310,35 @@ void mixer_ch_set_freq(int ch, float frequency) {
 	mixer_channel_t *c = &Mixer.channels[ch];
 	assertf(!(c->flags & CH_FLAGS_STEREO_SUB), "mixer_ch_set_freq: cannot call on secondary stereo channel %d", ch);
 	assertf(frequency >= 0, "mixer_ch_set_freq: cannot set negative frequency on channel %d: %f", ch, frequency);
-	c->step = MIXER_FX64(frequency / (float)Mixer.sample_rate) << (c->flags & CH_FLAGS_BPS_SHIFT);
+	// Disable interrupts so that the 64-bit step is updated atomically
+	// with respect to mixer_poll running under the AI interrupt
+	// (see mixer_poll_attach).
+	// Compute the resampling step against the exact (fractional) DAC output
+	// rate, so that arbitrary sources play back at the correct pitch; then
+	// snap near-unitary steps to exactly 1.0 (see #MIXER_STEP_UNITY_SNAP),
+	// so that sources authored at the nominal output rate pass through
+	// without resampling.
+	int64_t step = MIXER_FX64(frequency / Mixer.sample_rate_exact);
+	if (llabs(step - MIXER_FX64(1.0f)) <= MIXER_STEP_UNITY_SNAP)
+		step = MIXER_FX64(1.0f);
+	disable_interrupts();
+	c->step = step << (c->flags & CH_FLAGS_BPS_SHIFT);
+	enable_interrupts();
+}
+
+void mixer_ch_set_quality(int ch, mixer_quality_t quality) {
+	mixer_channel_t *c = &Mixer.channels[ch];
+	assertf(!(c->flags & CH_FLAGS_STEREO_SUB), "mixer_ch_set_quality: cannot call on secondary stereo channel %d", ch);
+	disable_interrupts();
+	Mixer.ch_quality[ch] = quality;
+	// Apply to the currently playing waveform too (if any). Linear
+	// interpolation is only implemented for 16-bit waveforms in the ucode,
+	// so 8-bit waveforms silently fall back to nearest-neighbor.
+	if (quality == MIXER_QUALITY_LINEAR && (c->flags & CH_FLAGS_16BIT))
+		c->flags |= CH_FLAGS_LERP;
+	else
+		c->flags &= ~CH_FLAGS_LERP;
+	enable_interrupts();
 }
 
 void mixer_ch_set_vol(int ch, float lvol, float rvol) {
@@ -374,6 +455,52 @@ void mixer_ch_play(int ch, waveform_t *wave) {
 		mixer_init_samplebuffers();
 	}
 
+	// Make sure the channel state is updated atomically: if the mixer is
+	// attached to the audio subsystem (mixer_poll_attach), mixing can run
+	// under interrupt at any time, and must not observe a half-configured
+	// channel. The key-on then takes effect at the next slice boundary.
+	disable_interrupts();
+
+	// Wake up the audio stack if it went quiescent (see mixer_exec).
+	audio_set_quiescent(false);
+
+	if (wave->samples) {
+		// Memory-resident waveform (zero-copy mode): the RSP plays the
+		// samples directly from memory, with no sample buffer staging.
+		assert(wave->channels == 1 || wave->channels == 2);
+		assert(wave->bits == 8 || wave->bits == 16);
+		assertf(wave->len >= 0 && wave->len != WAVEFORM_UNKNOWN_LEN,
+			"waveform %s: memory-resident waveforms require a known length", wave->name);
+
+		int bps = (wave->bits == 16 ? 1 : 0) + (wave->channels == 2 ? 1 : 0);
+		c->flags = bps | (wave->channels == 2 ? CH_FLAGS_STEREO : 0) | (wave->bits == 16 ? CH_FLAGS_16BIT : 0);
+		if (Mixer.ch_quality[ch] == MIXER_QUALITY_LINEAR && wave->bits == 16)
+			c->flags |= CH_FLAGS_LERP;
+		c->len = MIXER_FX64((int64_t)wave->len) << bps;
+		c->loop_len = MIXER_FX64((int64_t)wave->loop_len) << bps;
+
+		// In this mode the RSP follows the loop natively, so the waveform
+		// end must be representable in its 31-bit fixed point position.
+		assertf(wave->loop_len == 0 || c->len <= 0x7FFFFFFF,
+			"waveform %s: looping memory-resident waveforms are limited to 512 KiB", wave->name);
+		mixer_ch_set_freq(ch, wave->frequency);
+
+		if (wave->channels == 2) {
+			assertf(ch != Mixer.num_channels-1, "cannot configure last channel (%d) as stereo", ch);
+			Mixer.channels[ch+1].flags |= CH_FLAGS_STEREO_SUB;
+		} else if (ch != Mixer.num_channels-1) {
+			Mixer.channels[ch+1].flags &= ~CH_FLAGS_STEREO_SUB;
+		}
+
+		Mixer.ch_static |= 1<<ch;
+		sbuf->wv_ctx = NULL;
+		c->ptr = UncachedAddr(wave->samples);
+		c->pos = 0;
+		enable_interrupts();
+		return;
+	}
+	Mixer.ch_static &= ~(1<<ch);
+
 	// Configure the waveform on this channel, if we have not
 	// already. This optimization is useful in case the caller
 	// wants to play the same waveform on the same channel multiple
@@ -388,11 +515,22 @@ void mixer_ch_play(int ch, waveform_t *wave) {
 		samplebuffer_set_bps(sbuf, wave->bits*wave->channels);
 		samplebuffer_set_waveform(sbuf, wave->read ? waveform_read : NULL, wave);
 
+		// If the waveform requested loop caching and its loop is too long to
+		// stay resident in the sample buffer (short loops are kept cached
+		// there already, see mixer_exec), pin the loop region in RDRAM so
+		// that iterations after the first don't stream from ROM again.
+		if (wave->loop_cache && wave->loop_len > 0 && wave->loop_len >= sbuf->size)
+			samplebuffer_set_loop(sbuf, wave->len - wave->loop_len, wave->loop_len);
+		else
+			samplebuffer_set_loop(sbuf, 0, 0);
+
 		// Configure the mixer channel structured used by the RSP ucode
 		assertf(wave->len >= 0 && wave->len <= WAVEFORM_MAX_LEN, "waveform %s: invalid length %x", wave->name, wave->len);
 		assertf(wave->len != WAVEFORM_UNKNOWN_LEN || wave->loop_len == 0, "waveform %s with unknown length cannot loop", wave->name);
 		int bps = SAMPLES_BPS_SHIFT(sbuf);
 		c->flags = bps | (wave->channels == 2 ? CH_FLAGS_STEREO : 0) | (wave->bits == 16 ? CH_FLAGS_16BIT : 0);
+		if (Mixer.ch_quality[ch] == MIXER_QUALITY_LINEAR && wave->bits == 16)
+			c->flags |= CH_FLAGS_LERP;
 		c->len = MIXER_FX64((int64_t)wave->len) << bps;
 		c->loop_len = MIXER_FX64((int64_t)wave->loop_len) << bps;
 		mixer_ch_set_freq(ch, wave->frequency);
@@ -410,12 +548,16 @@ void mixer_ch_play(int ch, waveform_t *wave) {
 	// Restart from the beginning of the waveform
 	c->ptr = SAMPLES_PTR(sbuf);
 	c->pos = 0;
+
+	enable_interrupts();
 }
 
 void mixer_ch_set_pos(int ch, float pos) {
 	mixer_channel_t *c = &Mixer.channels[ch];
 	assertf(!(c->flags & CH_FLAGS_STEREO_SUB), "mixer_ch_set_pos: cannot call on secondary stereo channel %d", ch);
+	disable_interrupts();
 	c->pos = MIXER_FX64(pos) << (c->flags & CH_FLAGS_BPS_SHIFT);
+	enable_interrupts();
 }
 
 float mixer_ch_get_pos(int ch) {
@@ -427,7 +569,9 @@ float mixer_ch_get_pos(int ch) {
 
 void mixer_ch_stop(int ch) {
 	mixer_channel_t *c = &Mixer.channels[ch];
+	disable_interrupts();
 	c->ptr = 0;
+	Mixer.ch_static &= ~(1<<ch);
 	if (c->flags & CH_FLAGS_STEREO)
 		c[1].flags &= ~CH_FLAGS_STEREO_SUB;
 
@@ -436,6 +580,7 @@ void mixer_ch_stop(int ch) {
 	// to free waveform, and thus this pointer might become invalid.
 	Mixer.ch_buf[ch].wv_ctx = NULL;
 
+	enable_interrupts();
 }
 
 bool mixer_ch_playing(int ch) {
@@ -467,6 +612,23 @@ void mixer_ch_set_limits(int ch, int max_bits, float max_frequency, int max_buf_
 }
 
 static void mixer_exec(int32_t *out, int num_samples) {
+	// Quiescent mode: when no channel is playing (or still ramping down
+	// after a key-off) and no event is scheduled, there is nothing to mix.
+	// Write silence directly, skipping channel maintenance and the RSP
+	// dispatch altogether, and tell the audio subsystem that it can feed
+	// the AI from cached silence without even polling us (pull mode).
+	// The flag is cleared by the next mixer_ch_play / mixer_add_event,
+	// which makes polling resume instantly.
+	bool active = Mixer.num_events > 0;
+	for (int i=0; i<Mixer.num_channels && !active; i++)
+		active = Mixer.channels[i].ptr != NULL || Mixer.ch_grace[i] > 0;
+	if (!active) {
+		memset(out, 0, num_samples * sizeof(int32_t));
+		Mixer.ticks += num_samples;
+		audio_set_quiescent(true);
+		return;
+	}
+
 	if (!Mixer.ch_buf_mem) {
 		// If we have not yet allocated the memory for the sample buffers,
 		// this is a good moment to do so.
@@ -476,6 +638,7 @@ static void mixer_exec(int32_t *out, int num_samples) {
 	tracef("mixer_exec: 0x%x samples\n", num_samples);
 
 	uint32_t fake_loop = 0;
+	uint32_t silent_skip = 0;
 
 	for (int i=0; i<Mixer.num_channels; i++) {
 		samplebuffer_t *sbuf = &Mixer.ch_buf[i];
@@ -483,6 +646,53 @@ static void mixer_exec(int32_t *out, int num_samples) {
 		int bps = ch->flags & CH_FLAGS_BPS_SHIFT;
 		int bps_fx64 = bps + MIXER_FX64_FRAC;
 
+		// Detect effectively-silent channels. Volumes can be negative (Dolby
+		// surround matrix), so compare magnitudes. The channel keeps being
+		// processed normally for a few polls, so that the RSP volume filter
+		// ramps the output down to true silence before we start skipping it.
+		if (ch->ptr && !(ch->flags & CH_FLAGS_STEREO_SUB)) {
+			mixer_fx15_t lv = Mixer.lvol[i] < 0 ? -Mixer.lvol[i] : Mixer.lvol[i];
+			mixer_fx15_t rv = Mixer.rvol[i] < 0 ? -Mixer.rvol[i] : Mixer.rvol[i];
+			if (lv < MIXER_CH_SILENT_VOL && rv < MIXER_CH_SILENT_VOL) {
+				if (Mixer.ch_silence[i] < MIXER_CH_GRACE_POLLS) {
+					Mixer.ch_silence[i]++;
+				} else {
+					// Inaudible: skip sample fetch and mixing, and advance the
+					// playback position arithmetically instead.
+					ch->pos += ch->step * num_samples;
+					if (ch->loop_len) {
+						// Wrap the position according to the loop definition,
+						// like waveform_wrap_wpos does for buffer positions.
+						if (ch->pos >= ch->len)
+							ch->pos = (ch->pos - ch->len) % ch->loop_len + (ch->len - ch->loop_len);
+					} else if (ch->pos >= ch->len) {
+						// Key off the channel at the end of the waveform.
+						ch->ptr = 0;
+						if (ch->flags & CH_FLAGS_STEREO)
+							ch[1].flags &= ~CH_FLAGS_STEREO_SUB;
+						continue;
+					}
+					silent_skip |= 1<<i;
+					continue;
+				}
+			} else {
+				Mixer.ch_silence[i] = 0;
+			}
+		}
+
+		if (ch->ptr && (Mixer.ch_static & (1<<i))) {
+			// Memory-resident waveform: no sample buffer management is
+			// required, as the RSP reads the samples in place (and follows
+			// the loop natively, if any). Just key off the channel when a
+			// non-looping waveform is over.
+			if (!ch->loop_len && (ch->pos >> bps_fx64) >= (ch->len >> bps_fx64)) {
+				ch->ptr = 0;
+				if (ch->flags & CH_FLAGS_STEREO)
+					ch[1].flags &= ~CH_FLAGS_STEREO_SUB;
+			}
+			continue;
+		}
+
 		if (ch->ptr) {
 			int len = ch->len >> bps_fx64;
 			int loop_len = ch->loop_len >> bps_fx64;
@@ -571,6 +781,11 @@ static void mixer_exec(int32_t *out, int num_samples) {
 	mixer_fx15_t lvol[MIXER_MAX_CHANNELS] __attribute__((aligned(8))) = {0};
 	mixer_fx15_t rvol[MIXER_MAX_CHANNELS] __attribute__((aligned(8))) = {0};
 
+	// Number of channels the RSP must actually process this poll. Channels
+	// above this index are either stopped (and fully ramped down) or not
+	// configured, so the RSP can skip them entirely.
+	int active_channels = 0;
+
 	for (int ch=0;ch<Mixer.num_channels;ch++) {
 		mixer_channel_t *c = &Mixer.channels[ch];
 
@@ -583,6 +798,16 @@ static void mixer_exec(int32_t *out, int num_samples) {
 			continue;
 		}
 
+		// Silent channel being skipped this poll: its position has already
+		// been advanced arithmetically, so just keep it out of the RSP
+		// processing loop (without consuming the key-off grace period).
+		if (silent_skip & (1<<ch)) {
+			rsp_wv[ch].ptr = 0;
+			lvol[ch] = 0;
+			rvol[ch] = 0;
+			continue;
+		}
+
 		// Check if the channel is stopped
 		if (!c->ptr) {
 			rsp_wv[ch].ptr = 0;
@@ -592,9 +817,18 @@ static void mixer_exec(int32_t *out, int num_samples) {
 			// the one-tap volume filter if the volume started from max).
 			lvol[ch] = 0;
 			rvol[ch] = 0;
+			// Keep the channel in the RSP processing loop for a few more
+			// polls, so that the volume filter can ramp it down smoothly.
+			if (Mixer.ch_grace[ch]) {
+				Mixer.ch_grace[ch]--;
+				active_channels = ch+1;
+			}
 			continue;
 		}
 
+		Mixer.ch_grace[ch] = MIXER_CH_GRACE_POLLS;
+		active_channels = ch + ((c->flags & CH_FLAGS_STEREO) ? 2 : 1);
+
 		// Convert to RSP mixer channel structure truncating 64-bit values to 32-bit.
 		// We don't need full absolute position on the RSP, so 32-bit is more
 		// than enough. In fact, we only expose 31 bits, so that we can use the
@@ -650,9 +884,12 @@ static void mixer_exec(int32_t *out, int num_samples) {
 	uint32_t t0 = TICKS_READ();
 
 	rspq_highpri_begin();
+	// Only ask the RSP to process the channels that are actually in use.
+	// This also allows the ucode to select the faster 8-channel core when
+	// few voices are playing, irrespective of the configured channel count.
 	rspq_write(__mixer_overlay_id, 0,
 		(((uint32_t)MIXER_FX16(gvol)) & 0xFFFF),
-		(num_samples << 16) | Mixer.num_channels,
+		(num_samples << 16) | active_channels,
 		PhysicalAddr(out),
 		PhysicalAddr(&Mixer.ucode_settings));
 	rspq_highpri_end();
@@ -663,35 +900,87 @@ static void mixer_exec(int32_t *out, int num_samples) {
 
 	for (int i=0;i<Mixer.num_channels;i++) {
 		mixer_channel_t *ch = &Mixer.channels[i];
-		if (ch->ptr)
+		// Skipped silent channels were not processed by the RSP: their
+		// position was already advanced arithmetically above.
+		if (ch->ptr && !(silent_skip & (1<<i)))
 			ch->pos += (uint64_t)rsp_wv[i].pos - (uint64_t)(ch->pos & 0x7FFFFFFF);
 	}
 
 	Mixer.ticks += num_samples;
 }
 
-static mixer_event_t* mixer_next_event(void) {
-	mixer_event_t *e = NULL;
-	for (int i=0;i<Mixer.num_events;i++) {
-		if (!e || Mixer.events[i].ticks < e->ticks)
-			e = &Mixer.events[i];
+/*
+ * Pending events are kept in a binary min-heap ordered by trigger time, so
+ * that the cost of peeking at the next event in mixer_poll is O(1) and
+ * insertion/removal is O(log n), irrespective of how many events have been
+ * scheduled ahead of time (sequencers might schedule thousands of them).
+ */
+
+/** @brief Move the event at index \p i up the heap until its parent triggers first. */
+static void mixer_event_sift_up(int i) {
+	mixer_event_t e = Mixer.events[i];
+	while (i > 0) {
+		int parent = (i-1)/2;
+		if (Mixer.events[parent].ticks <= e.ticks)
+			break;
+		Mixer.events[i] = Mixer.events[parent];
+		i = parent;
 	}
-	return e;
+	Mixer.events[i] = e;
+}
+
+/** @brief Move the event at index \p i down the heap until its children trigger later. */
+static void mixer_event_sift_down(int i) {
+	mixer_event_t e = Mixer.events[i];
+	while (1) {
+		int child = i*2+1;
+		if (child >= Mixer.num_events)
+			break;
+		if (child+1 < Mixer.num_events && Mixer.events[child+1].ticks < Mixer.events[child].ticks)
+			child++;
+		if (e.ticks <= Mixer.events[child].ticks)
+			break;
+		Mixer.events[i] = Mixer.events[child];
+		i = child;
+	}
+	Mixer.events[i] = e;
+}
+
+static mixer_event_t* mixer_next_event(void) {
+	return Mixer.num_events > 0 ? &Mixer.events[0] : NULL;
 }
 
 void mixer_add_event(int64_t delay, MixerEvent cb, void *ctx) {
-	Mixer.events[Mixer.num_events++] = (mixer_event_t){
+	if (Mixer.num_events == Mixer.max_events) {
+		Mixer.max_events = Mixer.max_events ? Mixer.max_events*2 : MAX_EVENTS;
+		Mixer.events = realloc(Mixer.events, sizeof(mixer_event_t) * Mixer.max_events);
+		assert(Mixer.events);
+	}
+	Mixer.events[Mixer.num_events] = (mixer_event_t){
 		.cb = cb,
 		.ctx = ctx,
 		.ticks = Mixer.ticks + delay
 	};
+	mixer_event_sift_up(Mixer.num_events);
+	Mixer.num_events++;
+
+	// Events can key on channels, so the mixer must be polled again for
+	// them to trigger: wake up the audio stack if it went quiescent.
+	audio_set_quiescent(false);
 }
 
 void mixer_remove_event(MixerEvent cb, void *ctx) {
 	for (int i=0;i<Mixer.num_events;i++) {
 		if (Mixer.events[i].cb == cb && Mixer.events[i].ctx == ctx) {
-			memmove(&Mixer.events[i], &Mixer.events[i+1], sizeof(mixer_event_t) * (Mixer.num_events-i-1));
+			// Replace with the last event, and let it sink/float to its place.
 			Mixer.num_events--;
+			if (i < Mixer.num_events) {
+				Mixer.events[i] = Mixer.events[Mixer.num_events];
+				if (i > 0 && Mixer.events[i].ticks < Mixer.events[(i-1)/2].ticks)
+					mixer_event_sift_up(i);
+				else
+					mixer_event_sift_down(i);
+			}
 			return;
 		}
 	}
@@ -716,11 +1005,31 @@ void mixer_poll(int16_t *out16, int num_samples) {
 			num_samples -= ns;
 		}
 		if (e && Mixer.ticks == e->ticks) {
-			int64_t repeat = e->cb(e->ctx);
+			// Pop the event before invoking the callback, so that the
+			// callback can freely add/remove events (which might grow the
+			// heap and invalidate the pointer).
+			mixer_event_t ev = *e;
+			Mixer.num_events--;
+			if (Mixer.num_events > 0) {
+				Mixer.events[0] = Mixer.events[Mixer.num_events];
+				mixer_event_sift_down(0);
+			}
+			int64_t repeat = ev.cb(ev.ctx);
 			if (repeat)
-				e->ticks += repeat;
-			else
-				mixer_remove_event(e->cb, e->ctx);
+				mixer_add_event(repeat, ev.cb, ev.ctx);
 		}
 	}
 }
+
+static void mixer_audio_callback(short *buffer, size_t numsamples) {
+	mixer_poll(buffer, numsamples);
+}
+
+void mixer_poll_attach(void) {
+	assert(mixer_initialized());
+	audio_set_buffer_callback(mixer_audio_callback);
+}
+
+void mixer_poll_detach(void) {
+	audio_set_buffer_callback(NULL);
+}
@@ -53,10 +53,93 @@ void samplebuffer_set_waveform(samplebuffer_t *buf, WaveformRead read, void *ctx
 	buf->wv_ctx = ctx;
 }
 
+void samplebuffer_set_loop(samplebuffer_t *buf, int wpos, int wlen) {
+	// Keep an already-built cache if the loop region doesn't change. This
+	// preserves the captured samples across multiple playbacks of the same
+	// waveform on the same channel.
+	if (buf->loop_mem && buf->loop_wpos == wpos && buf->loop_len == wlen)
+		return;
+
+	if (buf->loop_mem) {
+		free_uncached(buf->loop_mem);
+		buf->loop_mem = NULL;
+	}
+	buf->loop_wpos = wpos;
+	buf->loop_len = wlen;
+	buf->loop_filled = 0;
+	if (wlen > 0)
+		buf->loop_mem = malloc_uncached(wlen << SAMPLES_BPS_SHIFT(buf));
+}
+
 void samplebuffer_close(samplebuffer_t *buf) {
+	if (buf->loop_mem) {
+		free_uncached(buf->loop_mem);
+		buf->loop_mem = NULL;
+	}
 	buf->ptr_and_flags = 0;
 }
 
+/**
+ * @brief Capture freshly-decoded samples into the loop cache.
+ *
+ * Called after each wv_read to copy any samples that belong to the
+ * not-yet-captured part of the loop region from the sample buffer into the
+ * loop cache. The capture is incremental and strictly sequential: it resumes
+ * from where it left off, possibly across multiple loop iterations if some
+ * samples scrolled out of the buffer before we could grab them.
+ */
+static void samplebuffer_loop_capture(samplebuffer_t *buf) {
+	if (!buf->loop_mem || buf->loop_filled >= buf->loop_len)
+		return;
+
+	// Waveform position of the next sample to capture. Notice that during
+	// loop unrolling positions keep growing past the end of the waveform,
+	// so if the capture point already scrolled out of the buffer (eg: it was
+	// discarded before we ran), resync to the next time the loop comes around
+	// to the same sample.
+	int next = buf->loop_wpos + buf->loop_filled;
+	if (next < buf->wpos)
+		next += ROUND_UP(buf->wpos - next, buf->loop_len);
+	if (next >= buf->wpos + buf->widx)
+		return;
+
+	int n = MIN(buf->wpos + buf->widx - next, buf->loop_len - buf->loop_filled);
+	int bps = SAMPLES_BPS_SHIFT(buf);
+	memcpy(buf->loop_mem + (buf->loop_filled << bps),
+		SAMPLES_PTR(buf) + ((next - buf->wpos) << bps), n << bps);
+	buf->loop_filled += n;
+}
+
+/**
+ * @brief Produce samples into the buffer, using the loop cache when possible.
+ *
+ * This is a wrapper around wv_read that serves the leading part of the
+ * request from the loop cache (if configured and already captured), and
+ * forwards the rest to the actual waveform read function. Serving from the
+ * cache is a RDRAM-to-RDRAM copy, so it doesn't compete for the PI bus with
+ * other ROM transfers, contrary to a streamed decode.
+ */
+static void samplebuffer_wv_read(samplebuffer_t *buf, int wpos, int wlen, bool seeking) {
+	int bps = SAMPLES_BPS_SHIFT(buf);
+
+	while (buf->loop_mem && buf->loop_filled > 0 && wlen > 0 && wpos >= buf->loop_wpos) {
+		// Index into the loop cache for this position. Positions past the
+		// loop region wrap around it (loop unrolling).
+		int idx = (wpos - buf->loop_wpos) % buf->loop_len;
+		if (idx >= buf->loop_filled)
+			break;
+		int n = MIN(wlen, buf->loop_filled - idx);
+		void *dst = samplebuffer_append(buf, n);
+		memcpy(dst, buf->loop_mem + (idx << bps), n << bps);
+		wpos += n; wlen -= n;
+	}
+	if (wlen <= 0)
+		return;
+
+	buf->wv_read(buf->wv_ctx, buf, wpos, wlen, seeking);
+	samplebuffer_loop_capture(buf);
+}
+
 void* samplebuffer_get(samplebuffer_t *buf, int wpos, int *wlen) {
 	// ROUNDUP8_BPS rounds up the specified number of samples
 	// (given the bps shift) so that they span an exact multiple
@@ -89,7 +172,7 @@ void* samplebuffer_get(samplebuffer_t *buf, int wpos, int *wlen) {
 		if ((buf->wpos << bps) & 1) {
 			buf->wpos--; len++;
 		}
-		buf->wv_read(buf->wv_ctx, buf, buf->wpos, ROUNDUP8_BPS(len, bps), true);
+		samplebuffer_wv_read(buf, buf->wpos, ROUNDUP8_BPS(len, bps), true);
 	} else {
 		// Record first sample that we still need to keep in the sample
 		// buffer. This is important to do now because decoder_read might
@@ -107,7 +190,7 @@ void* samplebuffer_get(samplebuffer_t *buf, int wpos, int *wlen) {
 		// If the existing samples are not enough, read the missing
 		// through the callback.
 		if (reuse < *wlen)
-			buf->wv_read(buf->wv_ctx, buf, wpos+reuse, ROUNDUP8_BPS(*wlen-reuse, bps), false);
+			samplebuffer_wv_read(buf, wpos+reuse, ROUNDUP8_BPS(*wlen-reuse, bps), false);
 	}
 
 	assertf(wpos >= buf->wpos && wpos < buf->wpos+buf->widx, 
@@ -13,6 +13,7 @@
 #include "samplebuffer.h"
 #include "debug.h"
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -44,9 +45,99 @@ static void waveform_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, b
 	raw_waveform_read(sbuf, wav->rom_addr, wpos, wlen, bps);
 }
 
-void wav64_open(wav64_t *wav, const char *fn) {
+static void waveform_read_ima(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking) {
+	wav64_t *wav = (wav64_t*)ctx;
+	int channels = wav->wave.channels;
+	int len = wav->wave.len;
+	int loop_len = wav->wave.loop_len;
+	const int blk_size = WAV64_IMA_BLOCK_SIZE(channels);
+
+	// Scratch buffer holding one compressed block. It is cacheline-aligned
+	// so that it can be safely invalidated before the PI DMA transfer.
+	uint8_t scratch[WAV64_IMA_BLOCK_SIZE(2)] __attribute__((aligned(16)));
+
+	while (wlen > 0) {
+		int pos = wpos;
+		if (pos >= len) {
+			if (loop_len == 0) {
+				// Overread past the end of a non-looping waveform: for raw
+				// files this area exists in ROM (zero-filled by audioconv64),
+				// for compressed files we synthesize the silence here.
+				int16_t *dst = samplebuffer_append(sbuf, wlen);
+				memset(dst, 0, wlen * channels * 2);
+				return;
+			}
+			// Unroll the loop: map the position back into the waveform.
+			do pos -= loop_len; while (pos >= len);
+		}
+
+		int blk = pos / WAV64_IMA_BLOCK_SAMPLES;
+		int skip = pos % WAV64_IMA_BLOCK_SAMPLES;
+		int n = WAV64_IMA_BLOCK_SAMPLES - skip;
+		if (n > len - pos) n = len - pos;
+		if (n > wlen) n = wlen;
+
+		// Fetch the compressed block from ROM. Blocks have a fixed size so
+		// the ROM address can be computed directly from the block index.
+		uint32_t t0 = TICKS_READ();
+		data_cache_hit_writeback_invalidate(scratch, sizeof(scratch));
+		dma_read(scratch, wav->rom_addr + blk*blk_size, blk_size);
+		__wav64_profile_dma += TICKS_READ() - t0;
+
+		// Decode the block one channel at a time, interleaving the output.
+		// Decoding always starts from the block header state; samples before
+		// the requested position are decoded and discarded.
+		int16_t *dst = samplebuffer_append(sbuf, n);
+		for (int ch = 0; ch < channels; ch++) {
+			uint8_t *hdr = scratch + ch*4;
+			int16_t predictor = (int16_t)((hdr[0] << 8) | hdr[1]);
+			int step_index = hdr[2];
+			uint8_t *nibs = scratch + channels*4 + ch*(WAV64_IMA_BLOCK_SAMPLES/2);
+			int16_t *out = dst + ch;
+			for (int i = 0; i < skip+n; i++) {
+				int nib = (i & 1) ? (nibs[i/2] >> 4) : (nibs[i/2] & 0xF);
+				int16_t s = ima_decode_nibble(&predictor, &step_index, nib);
+				if (i >= skip) {
+					*out = s;
+					out += channels;
+				}
+			}
+		}
+
+		wpos += n;
+		wlen -= n;
+	}
+}
+
+/** @brief Initialize a #wav64_t from a parsed header. */
+static void wav64_init(wav64_t *wav, const wav64_header_t *head, const char *fn, uint32_t rom_addr) {
 	memset(wav, 0, sizeof(*wav));
 
+	assertf(head->version == WAV64_FILE_VERSION, "wav64 %s: invalid version: %02x\n",
+		fn, head->version);
+	assertf(head->format == WAV64_FORMAT_RAW || head->format == WAV64_FORMAT_IMA_ADPCM,
+		"wav64 %s: invalid format: %02x\n", fn, head->format);
+
+	wav->wave.name = fn;
+	wav->wave.channels = head->channels;
+	wav->wave.bits = head->nbits;
+	wav->wave.frequency = head->freq;
+	wav->wave.len = head->len;
+	wav->wave.loop_len = head->loop_len;
+	wav->rom_addr = rom_addr;
+
+	if (head->format == WAV64_FORMAT_IMA_ADPCM) {
+		// Compressed waveforms are always decoded to 16-bit samples,
+		// whatever the source bit depth was.
+		wav->wave.bits = 16;
+		wav->wave.read = waveform_read_ima;
+	} else {
+		wav->wave.read = waveform_read;
+	}
+	wav->wave.ctx = wav;
+}
+
+void wav64_open(wav64_t *wav, const char *fn) {
 	// Currently, we only support streaming WAVs from DFS (ROMs). Any other
 	// filesystem is unsupported.
 	// For backward compatibility, we also silently accept a non-prefixed path.
@@ -66,22 +157,93 @@ void wav64_open(wav64_t *wav, const char *fn) {
 		assertf(0, "wav64 %s: invalid ID: %02x%02x%02x%02x\n",
 			fn, head.id[0], head.id[1], head.id[2], head.id[3]);
 	}
-	assertf(head.version == WAV64_FILE_VERSION, "wav64 %s: invalid version: %02x\n",
-		fn, head.version);
-	assertf(head.format == WAV64_FORMAT_RAW, "wav64 %s: invalid format: %02x\n",
-		fn, head.format);
+	dfs_close(fh);
 
-	wav->wave.name = fn;
-	wav->wave.channels = head.channels;
-	wav->wave.bits = head.nbits;
-	wav->wave.frequency = head.freq;
-	wav->wave.len = head.len;
-	wav->wave.loop_len = head.loop_len; 
-	wav->rom_addr = dfs_rom_addr(fn) + head.start_offset;
+	wav64_init(wav, &head, fn, dfs_rom_addr(fn) + head.start_offset);
+}
+
+void wav64_bank_open(wav64_bank_t *bank, const char *fn) {
+	memset(bank, 0, sizeof(*bank));
+
+	if (strstr(fn, ":/")) {
+		assertf(strncmp(fn, "rom:/", 5) == 0, "Cannot open %s: wav64 only supports files in ROM (rom:/)", fn);
+		fn += 5;
+	}
+
+	int fh = dfs_open(fn);
+	assertf(fh >= 0, "file does not exist: %s", fn);
+
+	wav64_bank_header_t bhead;
+	dfs_read(&bhead, 1, sizeof(bhead), fh);
+	assertf(memcmp(bhead.id, WAV64_BANK_ID, 4) == 0, "wav64 bank %s: invalid ID: %02x%02x%02x%02x\n",
+		fn, bhead.id[0], bhead.id[1], bhead.id[2], bhead.id[3]);
+	assertf(bhead.version == WAV64_BANK_VERSION, "wav64 bank %s: invalid version: %02x\n",
+		fn, bhead.version);
+	assertf(bhead.num_waves > 0, "wav64 bank %s: empty bank\n", fn);
+
+	// Read the whole waveform table with a single transfer, then initialize
+	// all waveforms from it without touching the filesystem again.
+	wav64_header_t *heads = malloc(bhead.num_waves * sizeof(wav64_header_t));
+	assert(heads != NULL);
+	dfs_read(heads, sizeof(wav64_header_t), bhead.num_waves, fh);
 	dfs_close(fh);
 
-	wav->wave.read = waveform_read;
-	wav->wave.ctx = wav;
+	uint32_t bank_rom_addr = dfs_rom_addr(fn);
+	bank->waves = malloc(bhead.num_waves * sizeof(wav64_t));
+	assert(bank->waves != NULL);
+	bank->num_waves = bhead.num_waves;
+
+	for (int i = 0; i < bank->num_waves; i++) {
+		assertf(memcmp(heads[i].id, WAV64_ID, 4) == 0, "wav64 bank %s: invalid waveform %d\n", fn, i);
+		// Table offsets are relative to the start of the bank file.
+		wav64_init(&bank->waves[i], &heads[i], fn, bank_rom_addr + heads[i].start_offset);
+	}
+
+	free(heads);
+}
+
+void wav64_bank_close(wav64_bank_t *bank) {
+	for (int i = 0; i < bank->num_waves; i++)
+		wav64_unload(&bank->waves[i]);
+	free(bank->waves);
+	memset(bank, 0, sizeof(*bank));
+}
+
+wav64_t *wav64_bank_get(wav64_bank_t *bank, int index) {
+	assertf(index >= 0 && index < bank->num_waves,
+		"wav64 bank %s: invalid waveform index %d (bank contains %d)",
+		bank->num_waves ? bank->waves[0].wave.name : "?", index, bank->num_waves);
+	return &bank->waves[index];
+}
+
+void wav64_bank_play(wav64_bank_t *bank, int index, int ch) {
+	mixer_ch_play(ch, &wav64_bank_get(bank, index)->wave);
+}
+
+void wav64_preload(wav64_t *wav) {
+	if (wav->wave.samples)
+		return;
+
+	// Compressed files would need to be decoded while loading; for now,
+	// only uncompressed files can be made memory-resident.
+	assertf(wav->wave.read == waveform_read,
+		"wav64 %s: only uncompressed files can be preloaded", wav->wave.name);
+
+	// Load the whole waveform in memory, including the overread area that
+	// follows it in ROM (required by the RSP mixer).
+	int bps = (wav->wave.bits == 8 ? 0 : 1) + (wav->wave.channels == 2 ? 1 : 0);
+	int nbytes = (wav->wave.len << bps) + MIXER_LOOP_OVERREAD;
+	void *buf = malloc_uncached(nbytes);
+	assert(buf != NULL);
+	dma_read(buf, wav->rom_addr, nbytes);
+	wav->wave.samples = buf;
+}
+
+void wav64_unload(wav64_t *wav) {
+	if (wav->wave.samples) {
+		free_uncached(wav->wave.samples);
+		wav->wave.samples = NULL;
+	}
 }
 
 void wav64_play(wav64_t *wav, int ch)
@@ -99,3 +261,7 @@ void wav64_set_loop(wav64_t *wav, bool loop) {
 	if (wav->wave.bits == 8 && wav->wave.loop_len & 1)
 		wav->wave.loop_len -= 1;
 }
+
+void wav64_set_loop_cache(wav64_t *wav, bool enable) {
+	wav->wave.loop_cache = enable;
+}
@@ -11,6 +11,25 @@
 #include "libxm/xm_internal.h"
 #include <stdbool.h>
 
+/** ROM address of the shared sample bank, or 0 if no bank is open */
+static uint32_t sample_bank_rom_addr = 0;
+
+void xm64_sample_bank_open(const char *fn) {
+	assertf(strncmp(fn, "rom:/", 5) == 0, "xm64 sample banks only support files in ROM (rom:/)");
+
+	FILE *f = must_fopen(fn);
+	char magic[4];
+	fread(magic, 1, 4, f);
+	fclose(f);
+	assertf(memcmp(magic, "XB64", 4) == 0, "error loading sample bank: %s\nNot a XB64 file (convert with audioconv64 --xm-bank)", fn);
+
+	sample_bank_rom_addr = dfs_rom_addr(fn+5);
+}
+
+void xm64_sample_bank_close(void) {
+	sample_bank_rom_addr = 0;
+}
+
 static void wave_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking) {
 	xm_sample_t *samp = (xm_sample_t*)ctx;
 	raw_waveform_read(sbuf, samp->data8_offset, wpos, wlen, samp->bits >> 4);
@@ -121,6 +140,13 @@ void xm64player_open(xm64player_t *player, const char *fn) {
 	assertf(strncmp(fn, "rom:/", 5) == 0, "xm64player only supports files in ROM (rom:/)");
 	uint32_t base_rom_addr = dfs_rom_addr(fn+5);
 
+#if XM_STREAM_PATTERNS
+	// Patterns are streamed from ROM: enable background prefetching so that
+	// the next pattern is loaded via async DMA while the current one plays,
+	// avoiding a synchronous read at every pattern boundary.
+	xm_set_pattern_prefetch(player->ctx, base_rom_addr);
+#endif
+
 	// Count samples
 	int ninst = xm_get_number_of_instruments(player->ctx);
 	int nwaves = 0;
@@ -136,8 +162,16 @@ void xm64player_open(xm64player_t *player, const char *fn) {
 		for (int j=0;j<inst->num_samples;j++) {
 			xm_sample_t *samp = &inst->samples[j];
 
-			// Convert offset of samples from relative to absolute
-			samp->data8_offset += base_rom_addr;
+			// Convert offset of samples from relative to absolute. Samples
+			// living in a shared bank (audioconv64 --xm-bank) are resolved
+			// against the bank's ROM address instead of the module's.
+			if (samp->data8_offset & XM64_SAMPLE_IN_BANK) {
+				assertf(sample_bank_rom_addr != 0,
+					"%s references a shared sample bank\nOpen it first with xm64_sample_bank_open()", fn);
+				samp->data8_offset = (samp->data8_offset & ~XM64_SAMPLE_IN_BANK) + sample_bank_rom_addr;
+			} else {
+				samp->data8_offset += base_rom_addr;
+			}
 
 			// Initialize the waveform_t structures with information
 			// coming from the XM "sample".
@@ -262,6 +296,9 @@ void xm64player_close(xm64player_t *player) {
 	}
 
 	if (player->ctx) {
+#if XM_STREAM_PATTERNS
+		xm_set_pattern_prefetch(player->ctx, 0);
+#endif
 		xm_free_context(player->ctx);
 		player->ctx = NULL;
 	}
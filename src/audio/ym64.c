@@ -2,12 +2,20 @@
  * @file ym64.c
  * @brief Player for the .YM64 module format (Arkos Tracker 2)
  * @ingroup mixer
+ *
+ * The actual AY-3-8910 sound synthesis runs on the RSP (rsp_ym.S): this
+ * module streams the YM register dumps to the ucode and lets it fill the
+ * mixer sample buffer.
  */
 
 #include "ym64.h"
 #include "ay8910.h"
 #include "../compress/lzh5_internal.h"
+#include "../compress/lz4_dec_internal.h"
+#include "../compress/lz4_enc_internal.h"
 #include "samplebuffer.h"
+#include "rspq.h"
+#include "n64sys.h"
 #include "debug.h"
 #include "asset_internal.h"
 #include "utils.h"
@@ -16,6 +24,55 @@
 #include <stdio.h>
 #include <malloc.h>
 
+/**
+ * RSP AY-3-8910 ucode (rsp_ym.S)
+ *
+ * The PSG emulation runs on the RSP: the CPU only parses the YM register
+ * stream (via the AY8910 mirror in #ym64player_t, which decodes raw register
+ * writes into periods/volumes/enables), and forwards the derived configuration
+ * to the ucode, which synthesizes the samples directly into the mixer
+ * sample buffer.
+ */
+DEFINE_RSP_UCODE(rsp_ym);
+
+/** @brief ID of the rsp_ym overlay (0 if not registered yet) */
+static uint32_t __ym64_overlay_id;
+/** @brief Number of currently open YM64 players (the overlay is shared) */
+static int __ym64_overlay_users;
+
+// Overlay commands. Keep these in sync with rsp_ym.S
+#define YM_CMD_WRITE   0x0   ///< Update the PSG configuration
+#define YM_CMD_GEN     0x1   ///< Generate samples into RDRAM
+#define YM_CMD_RESET   0x2   ///< Reset the PSG state
+
+// The ucode mixes the 3 PSG channels with fixed stereo pans, and its volume
+// table is built at the ay8910.h configuration's default values.
+_Static_assert(AY8910_OUTPUT_STEREO == 1, "rsp_ym.S only implements stereo output");
+_Static_assert(AY8910_DECIMATE == 3, "rsp_ym.S assumes a decimation factor of 3");
+
+/** @brief Send the current (derived) PSG configuration to the RSP. */
+static void ym_rsp_write_regs(ym64player_t *player, bool env_restart) {
+	AY8910 *ay = &player->ay;
+	uint32_t flags =
+		((uint32_t)ay->ch[0].tone_en  << 0) |
+		((uint32_t)ay->ch[1].tone_en  << 1) |
+		((uint32_t)ay->ch[2].tone_en  << 2) |
+		((uint32_t)ay->ch[0].noise_en << 3) |
+		((uint32_t)ay->ch[1].noise_en << 4) |
+		((uint32_t)ay->ch[2].noise_en << 5) |
+		((ay->env.attack ? 1 : 0)     << 6) |
+		((uint32_t)ay->env.alternate  << 7) |
+		((uint32_t)ay->env.hold       << 8) |
+		((env_restart ? 1 : 0)        << 9);
+	rspq_write(__ym64_overlay_id, YM_CMD_WRITE, flags,
+		((uint32_t)ay->ch[0].tone_period << 16) | ay->ch[1].tone_period,
+		((uint32_t)ay->ch[2].tone_period << 16) | ay->ns.period,
+		((uint32_t)ay->env.period << 16) |
+			((uint32_t)ay->ch[0].tone_vol << 10) |
+			((uint32_t)ay->ch[1].tone_vol << 5) |
+			(uint32_t)ay->ch[2].tone_vol);
+}
+
 /** @brief Header of a YM5 file */
 typedef struct __attribute__((packed)) {
 	uint32_t nframes;         ///< Number of audioframes
@@ -29,12 +86,81 @@ typedef struct __attribute__((packed)) {
 
 _Static_assert(sizeof(ym5header) == 22, "invalid header size");
 
+/** @brief Header of a YMB1 file (after the magic, nframes and chip frequency) */
+typedef struct __attribute__((packed)) {
+	uint16_t playfreq;        ///< Playback frequency in audioframes per seconds (eg: 50)
+	uint16_t frames_per_block;///< Number of audioframes in each LZ4 block
+	uint32_t loop;            ///< Audioframe where the loop starts
+	uint32_t nblocks;         ///< Number of LZ4 blocks
+} ymbheader;
+
+_Static_assert(sizeof(ymbheader) == 12, "invalid header size");
+
+/** @brief Worst-case size of a delta-coded audioframe (bitmask + 16 registers) */
+#define YMB_MAX_FRAME_SIZE    (2+16)
+
 static int ymread(ym64player_t *player, void *buf, int sz) {
 	if (player->decoder)
 		return decompress_lzh5_read(player->decoder, buf, sz);
 	return fread(buf, 1, sz, player->f);
 }
 
+/** @brief Decompress a LZ4 block of a YMB1 file into the player's block buffer. */
+static void ymb_load_block(ym64player_t *player, int bl) {
+	int cmp_size = player->block_offs[bl+1] - player->block_offs[bl];
+	int raw_max = player->frames_per_block * YMB_MAX_FRAME_SIZE;
+	int buf_size = raw_max + LZ4_DECOMPRESS_INPLACE_MARGIN(cmp_size);
+
+	// In-place decompression: read the compressed data at the end of the
+	// buffer and let the decompressor overtake it (see
+	// #LZ4_DECOMPRESS_INPLACE_MARGIN).
+	fseek(player->f, player->block_offs[bl], SEEK_SET);
+	fread(player->block_buf + buf_size - cmp_size, 1, cmp_size, player->f);
+	decompress_lz4_full_mem(player->block_buf + buf_size - cmp_size, cmp_size,
+		player->block_buf, raw_max, false);
+
+	player->block_cur = bl;
+	player->block_pos = 0;
+	player->block_frame = 0;
+}
+
+/** @brief Decode the next delta-coded audioframe of the current block. */
+static void ymb_decode_frame(ym64player_t *player) {
+	uint8_t *p = player->block_buf + player->block_pos;
+	uint16_t mask = (p[0] << 8) | p[1]; p += 2;
+	for (int r=0;r<16;r++)
+		if (mask & (1 << r))
+			player->block_regs[r] = *p++;
+	player->block_pos = p - player->block_buf;
+	player->block_frame++;
+}
+
+/**
+ * @brief Reconstruct the registers of audioframe #curframe (YMB1 files).
+ *
+ * The first audioframe of each block stores all 16 registers, so blocks
+ * decode independently of each other: seeking just means decoding (and
+ * discarding) the delta frames between the block start and the target
+ * audioframe.
+ */
+static void ymb_read_frame(ym64player_t *player, uint8_t regs[16]) {
+	int bl = player->curframe / player->frames_per_block;
+	int target = player->curframe % player->frames_per_block;
+
+	if (bl != player->block_cur)
+		ymb_load_block(player, bl);
+	else if (target < player->block_frame) {
+		// Backward seek within the current block: restart the delta
+		// decoding from the block-initial keyframe.
+		player->block_pos = 0;
+		player->block_frame = 0;
+	}
+
+	while (player->block_frame <= target)
+		ymb_decode_frame(player);
+	memcpy(regs, player->block_regs, 16);
+}
+
 static void ym_wave_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking) {
 	ym64player_t *player = (ym64player_t*)ctx;
 
@@ -53,7 +179,10 @@ static void ym_wave_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bo
 	// converting them back from sample number.
 	if (seeking && !player->decoder) {
 		player->curframe = ((float)wpos / f_samples_per_frame);
-		fseek(player->f, player->start_off + player->curframe * 16, SEEK_SET);
+		// Block-compressed files need no file repositioning here: the block
+		// offset table is used when the audioframe is reconstructed.
+		if (!player->nblocks)
+			fseek(player->f, player->start_off + player->curframe * 16, SEEK_SET);
 	}
 
 	// Calculate the last audioframe to be reconstructed in this call. Notice
@@ -73,31 +202,52 @@ static void ym_wave_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bo
 	int16_t *out = samples;
 	const int num_channels = AY8910_OUTPUT_STEREO ? 2 : 1;
 
+	// Enqueue the synthesis commands on the high-priority queue. This
+	// function is called by the mixer (which runs its own mix command in
+	// high priority): staying on the same queue guarantees that the samples
+	// are fully written before the mixer command reads them, without any
+	// explicit synchronization.
+	rspq_highpri_begin();
+
 	for (int i=0;i<nframes;i++) {
 		// Read 14 ay8910 registers (+ maybe 2 digidrums regs, unsupported)
 		uint8_t regs[16];
-		ymread(player, regs, 16);
+		if (player->nblocks)
+			ymb_read_frame(player, regs);
+		else
+			ymread(player, regs, 16);
 
 		// Iterate over the 14 ay8910 registers and see which ones
-		// changed since last tick.
-		for (int i=0;i<14;i++) {
-			if (player->regs[i] != regs[i]) {
-				player->regs[i] = regs[i];
+		// changed since last tick. Changed registers are decoded via the
+		// CPU-side AY8910 mirror, whose derived state (periods, volumes,
+		// enables) is then streamed to the RSP in a single command.
+		bool changed = false, env_restart = false;
+		for (int r=0;r<14;r++) {
+			if (player->regs[r] != regs[r]) {
+				player->regs[r] = regs[r];
 				// Envelope register: the special value 0xFF means
 				// "don't touch". Writing the reg always restarts the
 				// envelope calculation, so it requires special handling.
-				if (i == 13 && regs[i] == 0xFF) continue;
-				ay8910_write_addr(&player->ay, i);
-				ay8910_write_data(&player->ay, regs[i]);
+				if (r == 13 && regs[r] == 0xFF) continue;
+				ay8910_write_addr(&player->ay, r);
+				ay8910_write_data(&player->ay, regs[r]);
+				changed = true;
+				if (r == 13) env_restart = true;
 			}
 		}
-
-		// Generate the required number of samples, and store them into the
-		// sample buffer.
-		ay8910_gen(&player->ay, out, samples_per_frame);
+		if (changed)
+			ym_rsp_write_regs(player, env_restart);
+
+		// Ask the RSP to synthesize this audioframe straight into the
+		// sample buffer (which is in the uncached segment, so no cache
+		// maintenance is needed).
+		rspq_write(__ym64_overlay_id, YM_CMD_GEN,
+			samples_per_frame, PhysicalAddr(out));
 		out += (int)samples_per_frame * num_channels;
 		player->curframe++;
 	}
+
+	rspq_highpri_end();
 }
 
 void ym64player_open(ym64player_t *player, const char *fn, ym64player_songinfo_t *info) {
@@ -132,7 +282,49 @@ void ym64player_open(ym64player_t *player, const char *fn, ym64player_songinfo_t
 
 	int loop_pos = 0;
 
-	if (strncmp(head, "YM6!", 4) == 0 || strncmp(head, "YM5!", 4) == 0) {
+	if (strncmp(head, "YMB1", 4) == 0) {
+		// Block-compressed file (audioconv64 --ym-lz4): audioframes are
+		// delta-coded and grouped in independently compressed LZ4 blocks,
+		// so the file can be streamed with no decoder state, and seeked
+		// even though it is compressed.
+		memcpy(&player->nframes, head+4, 4);
+		memcpy(&player->chipfreq, head+8, 4);
+
+		ymbheader h; char buf[512];
+		_ymread(&h, sizeof(h));
+		player->playfreq = h.playfreq;
+		player->frames_per_block = h.frames_per_block;
+		player->nblocks = h.nblocks;
+		loop_pos = h.loop;
+
+		// Read Song info
+		int i = 0;
+		do _ymread(&buf[i], 1);
+		while (buf[i++] != '\0');
+		if (info) strlcpy(info->name, buf, sizeof(info->name));
+
+		i = 0;
+		do _ymread(&buf[i], 1);
+		while (buf[i++] != '\0');
+		if (info) strlcpy(info->author, buf, sizeof(info->author));
+
+		i = 0;
+		do _ymread(&buf[i], 1);
+		while (buf[i++] != '\0');
+		if (info) strlcpy(info->comment, buf, sizeof(info->comment));
+
+		// Read the block offset table. One extra entry records the end of
+		// the last block, so that compressed sizes can be derived.
+		player->block_offs = malloc((player->nblocks+1) * sizeof(uint32_t));
+		_ymread(player->block_offs, (player->nblocks+1) * sizeof(uint32_t));
+
+		// Allocate the block decoding buffer, sized for in-place
+		// decompression of a worst-case (incompressible) block.
+		int raw_max = player->frames_per_block * YMB_MAX_FRAME_SIZE;
+		player->block_buf = malloc(raw_max +
+			LZ4_DECOMPRESS_INPLACE_MARGIN(LZ4_COMPRESS_BOUND(raw_max)));
+		player->block_cur = -1;
+	} else if (strncmp(head, "YM6!", 4) == 0 || strncmp(head, "YM5!", 4) == 0) {
 		assertf(strncmp(head+4, "LeOnArD!", 8) == 0, "invalid YM check string: %s", head+4);
 
 		ym5header h; char buf[512];
@@ -206,6 +398,17 @@ void ym64player_open(ym64player_t *player, const char *fn, ym64player_songinfo_t
 	};
 
 	ay8910_reset(&player->ay);
+
+	// Register the PSG ucode, and reset the RSP-side state to match the
+	// freshly reset CPU mirror. The ucode keeps a single PSG state in its
+	// overlay saved state, so only one player can be open at a time.
+	assertf(__ym64_overlay_users == 0, "only one ym64 player can be open at a time");
+	if (__ym64_overlay_users++ == 0) {
+		rspq_init();
+		__ym64_overlay_id = rspq_overlay_register(&rsp_ym);
+	}
+	rspq_write(__ym64_overlay_id, YM_CMD_RESET);
+
 	player->first_ch = -1;
 	debugf("ym64: loading %s (freq:%ld, wfreq:%ld)\n", fn, player->chipfreq/8, player->chipfreq/8/AY8910_DECIMATE);
 }
@@ -239,7 +442,8 @@ void ym64player_tell(ym64player_t *player, int *pos, float *secs) {
 }
 
 bool ym64player_seek(ym64player_t *player, int pos) {
-	// Cannot seek in a compressed file
+	// Cannot seek in a LHA-compressed file. Block-compressed (YMB1) files
+	// have no streaming decoder state, so they can be seeked.
 	if (player->decoder)
 		return false;
 
@@ -255,11 +459,26 @@ bool ym64player_seek(ym64player_t *player, int pos) {
 void ym64player_close(ym64player_t *player) {
 	ym64player_stop(player);
 
+	if (--__ym64_overlay_users == 0) {
+		rspq_overlay_unregister(__ym64_overlay_id);
+		__ym64_overlay_id = 0;
+	}
+
 	if (player->decoder) {
 		free(player->decoder);
 		player->decoder = NULL;
 	}
 
+	if (player->block_offs) {
+		free(player->block_offs);
+		player->block_offs = NULL;
+	}
+
+	if (player->block_buf) {
+		free(player->block_buf);
+		player->block_buf = NULL;
+	}
+
 	if (player->f) {
 		fclose(player->f);
 		player->f = NULL;
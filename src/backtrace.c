@@ -170,6 +170,14 @@ static bool is_valid_address(uint32_t addr)
  * If not found, return a null header.
  */
 static symtable_header_t symt_open(void) {
+    // The symbol table lives in ROM and never changes, so the validated
+    // header is cached after the first open: symbolization paths call
+    // this once per lookup and should not pay a PI transfer each time.
+    static symtable_header_t symt_header_cache;
+    static bool symt_header_valid = false;
+    if (symt_header_valid)
+        return symt_header_cache;
+
     if (SYMT_ROM == 0xFFFFFFFF) {
         SYMT_ROM = rompak_search_ext(".sym");
         if (!SYMT_ROM)
@@ -195,6 +203,8 @@ static symtable_header_t symt_open(void) {
         return (symtable_header_t){0};
     }
 
+    symt_header_cache = symt_header;
+    symt_header_valid = true;
     return symt_header;
 }
 
@@ -227,9 +237,16 @@ static addrtable_entry_t symt_addrtab_entry(symtable_header_t *symt, int idx)
  */
 static addrtable_entry_t symt_addrtab_search(symtable_header_t *symt, uint32_t addr, int *idx)
 {
+    // Size of the window resolved with a single DMA burst at the end of
+    // the search. Each probe above this threshold costs one uncached PI
+    // word read; the burst replaces the last log2(ADDRTAB_BURST) probes
+    // with a single DMA transfer, which matters when symbolizing a full
+    // trace on a crash screen.
+    enum { ADDRTAB_BURST = 16 };
+
     int min = 0;
     int max = symt->addrtab_size - 1;
-    while (min < max) {
+    while (max - min >= ADDRTAB_BURST) {
         int mid = (min + max) / 2;
         addrtable_entry_t entry = symt_addrtab_entry(symt, mid);
         if (addr <= ADDRENTRY_ADDR(entry))
@@ -237,9 +254,24 @@ static addrtable_entry_t symt_addrtab_search(symtable_header_t *symt, uint32_t a
         else
             min = mid + 1;
     }
-    addrtable_entry_t entry = symt_addrtab_entry(symt, min);
-    if (min > 0 && ADDRENTRY_ADDR(entry) > addr)
-        entry = symt_addrtab_entry(symt, --min);
+
+    // Narrowed to a small window: fetch it in one burst and finish in RAM
+    addrtable_entry_t window[ADDRTAB_BURST] alignas(8);
+    int n = max - min + 1;
+    data_cache_hit_writeback_invalidate(window, sizeof(window));
+    dma_read(window, SYMT_ROM + symt->addrtab_off + min * 4, n * 4);
+
+    // Lower bound within the window: first entry with address >= addr
+    int j = 0;
+    while (j < n - 1 && addr > ADDRENTRY_ADDR(window[j]))
+        j++;
+
+    addrtable_entry_t entry = window[j];
+    min += j;
+    if (min > 0 && ADDRENTRY_ADDR(entry) > addr) {
+        min--;
+        entry = (j > 0) ? window[j-1] : symt_addrtab_entry(symt, min);
+    }
     if (idx) *idx = min;
     return entry;
 }
@@ -377,7 +409,7 @@ char* __symbolize(void *vaddr, char *buf, int size)
  * 
  * @return true if the backtrace can continue, false if must be aborted (eg: we are within invalid memory)
  */
-bool __bt_analyze_func(bt_func_t *func, uint32_t *ptr, uint32_t func_start, bool from_exception)
+static bool __bt_analyze_func_uncached(bt_func_t *func, uint32_t *ptr, uint32_t func_start, bool from_exception)
 {
     *func = (bt_func_t){
         .type = (ptr >= inthandler && ptr < inthandler_end) ? BT_EXCEPTION : BT_FUNCTION,
@@ -450,7 +482,63 @@ bool __bt_analyze_func(bt_func_t *func, uint32_t *ptr, uint32_t func_start, bool
     return true;
 }
 
-static void backtrace_foreach(void (*cb)(void *arg, void *ptr), void *arg)
+/**
+ * @brief Number of entries of the unwind cache (must be a power of two).
+ *
+ * Each entry is 20 bytes, so the cache costs 2.5 KiB of BSS.
+ */
+#define UNWIND_CACHE_SIZE  128
+
+/** @brief One memoized result of the prologue analysis heuristic */
+typedef struct {
+    uint32_t addr;          ///< Address the analysis started from (0 if empty)
+    bt_func_t func;         ///< Function description produced by the analysis
+} bt_unwind_entry_t;
+
+/**
+ * @brief Unwind cache: memoized prologue analysis results.
+ *
+ * Walking a function's code instruction by instruction makes the first
+ * backtrace through a call site expensive, but the result only depends on
+ * the code itself, which never changes. This direct-mapped cache (keyed by
+ * the address the analysis starts from, which is the call site's return
+ * address) turns subsequent backtraces through the same call sites into
+ * table walks, cheap enough to attach to soft assertions or allocation
+ * tracking in live sessions.
+ *
+ * The cache is static BSS (backtraces must not allocate) and is filled in
+ * an order that keeps a concurrent lookup from an interrupt safe: an entry
+ * is invalidated before being overwritten, so a torn update reads as a
+ * cache miss.
+ */
+static bt_unwind_entry_t bt_unwind_cache[UNWIND_CACHE_SIZE];
+
+bool __bt_analyze_func(bt_func_t *func, uint32_t *ptr, uint32_t func_start, bool from_exception)
+{
+    // Exception frames depend on context beyond the code (func_start hints,
+    // leaf detection), so only straight call frames are cached.
+    bt_unwind_entry_t *entry = NULL;
+    if (!from_exception) {
+        entry = &bt_unwind_cache[((uint32_t)ptr >> 2) & (UNWIND_CACHE_SIZE-1)];
+        if (entry->addr == (uint32_t)ptr) {
+            *func = entry->func;
+            return true;
+        }
+    }
+
+    bool ok = __bt_analyze_func_uncached(func, ptr, func_start, from_exception);
+
+    if (ok && entry) {
+        entry->addr = 0;
+        MEMORY_BARRIER();
+        entry->func = *func;
+        MEMORY_BARRIER();
+        entry->addr = (uint32_t)ptr;
+    }
+    return ok;
+}
+
+static void backtrace_foreach(bool (*cb)(void *arg, void *ptr), void *arg)
 {
     /*
      * This function is called in very risky contexts, for instance as part of an exception
@@ -545,7 +633,8 @@ static void backtrace_foreach(void (*cb)(void *arg, void *ptr), void *arg)
                     
                     // Store the invalid address in the backtrace, so that it will appear in dumps.
                     // This makes it easier for the user to understand the reason for the exception.
-                    cb(arg, ra);
+                    if (!cb(arg, ra))
+                        return;
                     #if BACKTRACE_DEBUG
                     debugf("backtrace: %s, ra=%p, sp=%p, fp=%p ra_offset=%d, fp_offset=%d, stack_size=%d\n", 
                         "BT_INVALID", ra, sp, fp, func.ra_offset, func.fp_offset, func.stack_size);
@@ -587,21 +676,40 @@ static void backtrace_foreach(void (*cb)(void *arg, void *ptr), void *arg)
                 break;
         }
 
-        // Call the callback with this stack frame
-        cb(arg, ra);
+        // Call the callback with this stack frame. The callback can stop
+        // the walk early by returning false, so that bounded captures
+        // (eg: per-allocation tracking) don't pay for the full stack depth.
+        if (!cb(arg, ra))
+            return;
     }
 }
 
 int backtrace(void **buffer, int size)
 {
     int i = -1; // skip backtrace itself
-    void cb(void *arg, void *ptr) {
+    bool cb(void *arg, void *ptr) {
+        if (i >= 0 && i < size)
+            buffer[i] = ptr;
+        i++;
+        // Stop walking as soon as the buffer is full: bounded captures
+        // must not pay for frames they won't store.
+        return i < size;
+    }
+    backtrace_foreach(cb, NULL);
+    return i < 0 ? 0 : i;
+}
+
+int backtrace_skip(void **buffer, int size, int skip)
+{
+    int i = -1 - skip; // skip backtrace_skip itself plus the requested frames
+    bool cb(void *arg, void *ptr) {
         if (i >= 0 && i < size)
             buffer[i] = ptr;
         i++;
+        return i < size;
     }
     backtrace_foreach(cb, NULL);
-    return i;
+    return i < 0 ? 0 : i;
 }
 
 static void format_entry(void (*cb)(void *, backtrace_frame_t *), void *cb_arg, 
@@ -0,0 +1,49 @@
+/**
+ * @file bootprof.c
+ * @brief Boot-time profiling
+ * @ingroup system
+ */
+#include "bootprof.h"
+#include "debug.h"
+#include "n64sys.h"
+#include "timer.h"
+
+/** @brief Recorded boot marks */
+static bootprof_mark_t marks[BOOTPROF_MAX_MARKS];
+/** @brief Number of recorded boot marks */
+static int num_marks = 0;
+
+void bootprof_mark(const char *name)
+{
+    uint32_t now = TICKS_READ();
+    if (num_marks >= BOOTPROF_MAX_MARKS)
+        return;
+    marks[num_marks].name = name;
+    marks[num_marks].ticks = now;
+    num_marks++;
+}
+
+int bootprof_count(void)
+{
+    return num_marks;
+}
+
+const bootprof_mark_t *bootprof_get(int idx)
+{
+    if (idx < 0 || idx >= num_marks)
+        return NULL;
+    return &marks[idx];
+}
+
+void bootprof_dump(void)
+{
+    uint32_t prev = 0;
+    debugf("Boot profile:\n");
+    for (int i = 0; i < num_marks; i++)
+    {
+        debugf("  %-24s %8lld us (+%lld us)\n", marks[i].name,
+            TIMER_MICROS_LL(marks[i].ticks),
+            TIMER_MICROS_LL(marks[i].ticks - prev));
+        prev = marks[i].ticks;
+    }
+}
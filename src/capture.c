@@ -0,0 +1,264 @@
+/**
+ * @file capture.c
+ * @brief Non-hitching framebuffer capture over USB
+ * @ingroup debug
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "display.h"
+#include "surface.h"
+#include "n64sys.h"
+#include "timer.h"
+#include "interrupt.h"
+#include "usb.h"
+#include "compress/lz4_enc_internal.h"
+
+/**
+ * @defgroup capture Framebuffer capture
+ * @ingroup debug
+ * @brief Screenshots streamed over USB without stalling the frame loop.
+ *
+ * A traditional screenshot copies the framebuffer and pushes it through
+ * a blocking usb_write, which guarantees a dropped frame right in the
+ * scene being analyzed. This service avoids both costs: the frame that
+ * just left the screen is held out of the display rotation in place
+ * (see the retire hook in display.c), and a background timer trickles
+ * it out through the chunked USB write API a few kilobytes per tick.
+ * Optionally the frame is LZ4-compressed first, also a slice per tick,
+ * which returns the framebuffer to the rotation sooner and shrinks the
+ * USB transfer at the cost of a transient heap buffer.
+ */
+
+/** @brief Milliseconds between background ticks */
+#define CAPTURE_TICK_MS         10
+/** @brief Bytes compressed or streamed per tick (multiple of 4) */
+#define CAPTURE_CHUNK           8192
+/** @brief Ticks to keep retrying a busy USB before giving up */
+#define CAPTURE_START_RETRIES   250
+/** @brief Size of the compressed container header */
+#define CAPTURE_HEADER_SIZE     16
+
+/** @brief Capture progress states */
+typedef enum
+{
+    CAPTURE_IDLE,           ///< No capture in flight
+    CAPTURE_ARMED,          ///< Waiting for the next buffer flip
+    CAPTURE_COMPRESS,       ///< Compressing the held frame, a slice per tick
+    CAPTURE_START,          ///< Waiting for the USB to accept the packet
+    CAPTURE_STREAM,         ///< Trickling the payload out, a chunk per tick
+} capture_state_t;
+
+/** @brief Hold of the framebuffer rotation, implemented in display.c */
+extern void __display_set_retire_hook( bool (*hook)( surface_t *surf, int idx ) );
+/** @brief Release of a held framebuffer, implemented in display.c */
+extern void __display_capture_release( int idx );
+
+static volatile capture_state_t cap_state = CAPTURE_IDLE;   ///< Current state
+static timer_link_t *cap_timer;     ///< Background tick timer
+static bool cap_compressed;         ///< Current capture wants compression
+static int cap_index = -1;          ///< Index of the held framebuffer (-1 = none)
+static const uint8_t *cap_src;      ///< Held pixels (uncached view)
+static int cap_rawsize;             ///< Size of the raw frame in bytes
+static uint8_t *cap_zbuf;           ///< Compressed container (heap, transient)
+static int cap_zlen;                ///< Compressed bytes accumulated
+static int cap_pos;                 ///< Progress cursor within the current state
+static int cap_retries;             ///< Busy-USB retries left in CAPTURE_START
+static int cap_width;               ///< Captured frame width in pixels
+static int cap_height;              ///< Captured frame height in pixels
+static int cap_depth;               ///< Captured frame bytes per pixel
+
+/** @brief Return the held framebuffer (if any) to the display rotation */
+static void __capture_release(void)
+{
+    if (cap_index >= 0)
+    {
+        __display_capture_release(cap_index);
+        cap_index = -1;
+    }
+}
+
+/** @brief Abort the capture in flight, releasing everything it holds */
+static void __capture_abort(void)
+{
+    __capture_release();
+    free(cap_zbuf);
+    cap_zbuf = NULL;
+    cap_state = CAPTURE_IDLE;
+}
+
+/**
+ * @brief Retire hook: snapshot the frame that just left the screen.
+ *
+ * Runs in the VI interrupt at every buffer flip. When a capture is
+ * armed, the retired buffer is claimed in place (return true holds it
+ * out of the rotation) and the background ticks take over from there.
+ */
+static bool __capture_retire(surface_t *surf, int idx)
+{
+    if (cap_state != CAPTURE_ARMED)
+        return false;
+
+    cap_index = idx;
+    cap_src = UncachedAddr(surf->buffer);
+    cap_rawsize = surf->stride * surf->height;
+    cap_width = surf->width;
+    cap_height = surf->height;
+    cap_depth = TEX_FORMAT_BITDEPTH(surface_get_format(surf)) / 8;
+    cap_pos = 0;
+    cap_retries = CAPTURE_START_RETRIES;
+    cap_state = cap_compressed ? CAPTURE_COMPRESS : CAPTURE_START;
+    return true;
+}
+
+/** @brief Compress one slice of the held frame into the container */
+static void __capture_compress_tick(void)
+{
+    int block = cap_rawsize - cap_pos;
+    if (block > CAPTURE_CHUNK)
+        block = CAPTURE_CHUNK;
+
+    /* Each slice is an independent LZ4 block prefixed with its length,
+       so the decoder needs no state across slices */
+    int zlen = compress_lz4_full_mem(cap_src + cap_pos, block,
+        cap_zbuf + cap_zlen + 4, LZ4_COMPRESS_BOUND(CAPTURE_CHUNK));
+    cap_zbuf[cap_zlen + 0] = zlen >> 24;
+    cap_zbuf[cap_zlen + 1] = zlen >> 16;
+    cap_zbuf[cap_zlen + 2] = zlen >> 8;
+    cap_zbuf[cap_zlen + 3] = zlen;
+    cap_zlen += 4 + zlen;
+    cap_pos += block;
+
+    if (cap_pos >= cap_rawsize)
+    {
+        /* The frame now lives in the container, let the display reuse it */
+        __capture_release();
+        cap_pos = 0;
+        cap_state = CAPTURE_START;
+    }
+}
+
+/** @brief Try to open the USB packet for the capture payload */
+static void __capture_start_tick(void)
+{
+    char ok;
+
+    if (cap_compressed)
+    {
+        ok = usb_write_start(DATATYPE_RAWBINARY, cap_zlen);
+    }
+    else
+    {
+        /* Announce the screenshot the way UNFLoader expects it, so plain
+           captures show up directly in its debugger */
+        int header[4] = { DATATYPE_SCREENSHOT, cap_depth, cap_width, cap_height };
+        usb_write(DATATYPE_HEADER, header, sizeof(header));
+        ok = usb_write_start(DATATYPE_SCREENSHOT, cap_rawsize);
+    }
+
+    if (!ok)
+    {
+        /* USB busy (eg: a log burst); retry for a while, then give up */
+        if (--cap_retries <= 0)
+            __capture_abort();
+        return;
+    }
+
+    cap_pos = 0;
+    cap_state = CAPTURE_STREAM;
+}
+
+/** @brief Hand the next chunk of the payload to the USB */
+static void __capture_stream_tick(void)
+{
+    const uint8_t *src = cap_compressed ? cap_zbuf : cap_src;
+    int total = cap_compressed ? cap_zlen : cap_rawsize;
+
+    int block = total - cap_pos;
+    if (block > CAPTURE_CHUNK)
+        block = CAPTURE_CHUNK;
+
+    usb_write_chunk(src + cap_pos, block);
+    cap_pos += block;
+
+    if (cap_pos >= total)
+    {
+        usb_write_end();
+        __capture_abort();  /* doubles as the cleanup of a finished capture */
+    }
+}
+
+/** @brief Background tick: bounded work per state so the interrupt stays short */
+static void __capture_tick(int ovfl)
+{
+    switch (cap_state)
+    {
+        case CAPTURE_COMPRESS:  __capture_compress_tick(); break;
+        case CAPTURE_START:     __capture_start_tick(); break;
+        case CAPTURE_STREAM:    __capture_stream_tick(); break;
+        default: break;
+    }
+}
+
+bool capture_init(void)
+{
+    if (cap_timer)
+        return true;
+
+    usb_initialize();
+    if (usb_getcart() == CART_NONE)
+        return false;
+
+    __display_set_retire_hook(__capture_retire);
+    cap_timer = new_timer(TICKS_FROM_MS(CAPTURE_TICK_MS), TF_CONTINUOUS,
+        __capture_tick);
+    return cap_timer != NULL;
+}
+
+bool capture_frame(bool compressed)
+{
+    if (!cap_timer || cap_state != CAPTURE_IDLE)
+        return false;
+
+    /* Holding a buffer out of a double-buffered chain would stall the
+       frame loop, which defeats the point of this service */
+    if (display_get_num_buffers() < 3)
+        return false;
+
+    if (compressed)
+    {
+        /* Size the container for the worst case so compression cannot
+           overrun: a length-prefixed LZ4 block per slice plus the header */
+        int raw = display_get_width() * display_get_height() * display_get_bitdepth();
+        int blocks = (raw + CAPTURE_CHUNK - 1) / CAPTURE_CHUNK;
+        uint8_t *zbuf = malloc(CAPTURE_HEADER_SIZE +
+            blocks * (4 + LZ4_COMPRESS_BOUND(CAPTURE_CHUNK)));
+        if (!zbuf)
+            return false;
+
+        int w = display_get_width(), h = display_get_height();
+        memcpy(zbuf, "FBC1", 4);
+        zbuf[4] = w >> 8;  zbuf[5] = w;
+        zbuf[6] = h >> 8;  zbuf[7] = h;
+        zbuf[8] = display_get_bitdepth();
+        zbuf[9] = 0;
+        zbuf[10] = 0;      zbuf[11] = 0;
+        zbuf[12] = raw >> 24; zbuf[13] = raw >> 16;
+        zbuf[14] = raw >> 8;  zbuf[15] = raw;
+
+        cap_zbuf = zbuf;
+        cap_zlen = CAPTURE_HEADER_SIZE;
+    }
+
+    cap_compressed = compressed;
+
+    /* Publish the armed state last, the VI hook reads it asynchronously */
+    MEMORY_BARRIER();
+    cap_state = CAPTURE_ARMED;
+    return true;
+}
+
+bool capture_busy(void)
+{
+    return cap_state != CAPTURE_IDLE;
+}
@@ -0,0 +1,53 @@
+#ifndef LIBDRAGON_COMPRESS_DMA_RACE_INTERNAL_H
+#define LIBDRAGON_COMPRESS_DMA_RACE_INTERNAL_H
+
+#include <stdbool.h>
+
+#ifdef N64
+#include "dma.h"
+#endif
+
+/**
+ * @brief Throttle the CPU behind an in-flight PI DMA transfer.
+ *
+ * This helper allows a decompressor to run in parallel with the PI DMA
+ * transfer that is filling its source buffer ("racing" with it): before
+ * reading up to the address @p pIn (exclusive), call this function to
+ * spin until the DMA has gone past that point. Partial cachelines are
+ * ignored, as accessing them from the CPU would create coherency problems.
+ *
+ * Call with NULL to reset the internal state before starting a new race.
+ * Only one race can be in flight at any given time (which is a given,
+ * since there is only one PI bus).
+ *
+ * Defined here as static so that each decompressor can use it without
+ * requiring an extra translation unit in the tools, which compile the
+ * decompressors by direct inclusion. On PC builds this is a no-op.
+ *
+ * @param pIn   Pointer just past the last byte about to be read, or NULL
+ *              to reset the state for a new transfer.
+ */
+__attribute__((unused))
+static void __compress_wait_dma(const void *pIn) {
+   #ifdef N64
+   static void *ptr; static bool finished = false;
+   if (pIn == NULL) {
+      finished = false;
+      ptr = NULL;
+      return;
+   }
+   if (finished) return;
+   while (ptr < pIn) {
+      // Check if DMA is finished
+      if (!(*PI_STATUS & 1)) {
+         finished = true;
+         return;
+      }
+      // Read current DMA position. Ignore partial cachelines as they
+      // would create coherency problems if accessed by the CPU.
+      ptr = (void*)((*PI_DRAM_ADDR & ~0xF) | 0x80000000);
+   }
+   #endif
+}
+
+#endif
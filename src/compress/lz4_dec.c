@@ -5,6 +5,7 @@
 #include <string.h>
 #include "lz4_dec_internal.h"
 #include "ringbuf_internal.h"
+#include "dma_race_internal.h"
 #include "../utils.h"
 
 #ifdef N64
@@ -49,7 +50,7 @@
    unsigned int byte; \
    do { \
       if (unlikely(pInBlock >= pInBlockEnd)) return -1; \
-      if (dma_race) wait_dma(pInBlock+1); \
+      if (dma_race) __compress_wait_dma(pInBlock+1); \
       byte = (unsigned int)*pInBlock++; \
       __len += byte; \
    } while (unlikely(byte == 255)); \
@@ -59,28 +60,6 @@
 #include "dma.h"
 #endif
 
-static void wait_dma(const void *pIn) {
-   #ifdef N64
-   static void *ptr; static bool finished = false;
-   if (pIn == NULL) {
-      finished = false;
-      ptr = NULL;
-      return;
-   }
-   if (finished) return;
-   while (ptr < pIn) {
-      // Check if DMA is finished
-      if (!(*PI_STATUS & 1)) {
-         finished = true;
-         return;
-      }
-      // Read current DMA position. Ignore partial cachelines as they
-      // would create coherency problems if accessed by the CPU.
-      ptr = (void*)((*PI_DRAM_ADDR & ~0xF) | 0x80000000);
-   }
-   #endif
-}
-
 /**
  * Decompress one data block
  *
@@ -92,20 +71,20 @@ static void wait_dma(const void *pIn) {
  *
  * @return size of decompressed data in bytes, or -1 for error
  */
-int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nBlockMaxSize, bool dma_race) {
+int decompress_lz4_full_mem_dict(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nBlockMaxSize, const unsigned char *pDictStart, bool dma_race) {
    const unsigned char *pInBlockEnd = pInBlock + nBlockSize;
    unsigned char *pCurOutData = pOutData;
    const unsigned char *pOutDataEnd = pCurOutData + nBlockMaxSize;
    const unsigned char *pOutDataFastEnd = pOutDataEnd - 18;
 
-   if (dma_race) wait_dma(NULL);
+   if (dma_race) __compress_wait_dma(NULL);
    while (likely(pInBlock < pInBlockEnd)) {
-      if (dma_race) wait_dma(pInBlock+1);
+      if (dma_race) __compress_wait_dma(pInBlock+1);
       const unsigned int token = (unsigned int)*pInBlock++;
       unsigned int nLiterals = ((token & 0xf0) >> 4);
 
       if (nLiterals != LITERALS_RUN_LEN && pCurOutData <= pOutDataFastEnd && (pInBlock + 16) <= pInBlockEnd) {
-         if (dma_race) wait_dma(pInBlock+16);
+         if (dma_race) __compress_wait_dma(pInBlock+16);
          memcpy(pCurOutData, pInBlock, 16);
       }
       else {
@@ -115,7 +94,7 @@ int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsig
          if (unlikely((pInBlock + nLiterals) > pInBlockEnd)) return -1;
          if (unlikely((pCurOutData + nLiterals) > pOutDataEnd)) return -1;
 
-         if (dma_race) wait_dma(pInBlock+nLiterals);
+         if (dma_race) __compress_wait_dma(pInBlock+nLiterals);
          memcpy(pCurOutData, pInBlock, nLiterals);
       }
 
@@ -125,7 +104,7 @@ int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsig
       if (likely((pInBlock + 2) <= pInBlockEnd)) {
          unsigned int nMatchOffset;
 
-         if (dma_race) wait_dma(pInBlock+2);
+         if (dma_race) __compress_wait_dma(pInBlock+2);
          nMatchOffset = (unsigned int)*pInBlock++;
          nMatchOffset |= ((unsigned int)*pInBlock++) << 8;
 
@@ -135,7 +114,7 @@ int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsig
          if (nMatchLen != (MATCH_RUN_LEN + MIN_MATCH_SIZE) && nMatchOffset >= 8 && pCurOutData <= pOutDataFastEnd) {
             const unsigned char *pSrc = pCurOutData - nMatchOffset;
 
-            if (unlikely(pSrc < pOutData)) return -1;
+            if (unlikely(pSrc < pDictStart)) return -1;
 
             memcpy(pCurOutData, pSrc, 8);
             memcpy(pCurOutData + 8, pSrc + 8, 8);
@@ -150,7 +129,7 @@ int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsig
             if (unlikely((pCurOutData + nMatchLen) > pOutDataEnd)) return -1;
 
             const unsigned char *pSrc = pCurOutData - nMatchOffset;
-            if (unlikely(pSrc < pOutData)) return -1;
+            if (unlikely(pSrc < pDictStart)) return -1;
 
             if (nMatchOffset >= 16 && (pCurOutData + nMatchLen) <= pOutDataFastEnd) {
                const unsigned char *pCopySrc = pSrc;
@@ -177,6 +156,11 @@ int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsig
    return (int)(pCurOutData - pOutData);
 }
 
+int decompress_lz4_full_mem(const unsigned char *pInBlock, int nBlockSize, unsigned char *pOutData, int nBlockMaxSize, bool dma_race) {
+   // No dictionary: matches may only reference the output produced so far
+   return decompress_lz4_full_mem_dict(pInBlock, nBlockSize, pOutData, nBlockMaxSize, pOutData, dma_race);
+}
+
 void* decompress_lz4_full(const char *fn, FILE *fp, size_t cmp_size, size_t size)
 {
    int bufsize = size + LZ4_DECOMPRESS_INPLACE_MARGIN(cmp_size);
@@ -243,22 +227,63 @@ typedef struct lz4dec_faststate_s {
  * @brief State of the LZ4 algorithm (streaming version).
  */
 typedef struct lz4dec_state_s {
-   uint8_t buf[128] __attribute__((aligned(8)));     ///< File buffer
+   uint8_t buf[2][128] __attribute__((aligned(16)));  ///< File buffers (double buffered in ROM mode)
    FILE *fp;                        ///< File pointer to read from
-	int buf_idx;                     ///< Current index in the file buffer
+   /// Current index in the file buffer. Aligned so that the layout (and thus
+   /// #DECOMPRESS_LZ4_STATE_SIZE) is the same with 32-bit and 64-bit pointers.
+   int buf_idx __attribute__((aligned(8)));
 	int buf_size;                    ///< Size of the file buffer
    bool eof;                        ///< True if we reached the end of the file
+   bool rom_mode;                   ///< True if the input is DMA-fed straight from ROM
+   int cur_buf;                     ///< Buffer currently being decoded (ROM mode)
+   uint32_t rom_addr;               ///< ROM address of the next chunk to fetch (ROM mode)
+   int rom_left;                    ///< Compressed bytes left in ROM (ROM mode)
+   int next_size;                   ///< Size of the prefetch currently in flight (ROM mode)
    lz4dec_faststate_t st;           ///< Fast-access state
    decompress_ringbuf_t ringbuf;    ///< Ring buffer
 } lz4dec_state_t;
 
-#ifdef N64
 _Static_assert(sizeof(lz4dec_state_t) == DECOMPRESS_LZ4_STATE_SIZE, "decompress_lz4_state_t size mismatch");
+
+#ifdef N64
+/**
+ * @brief Start the DMA of the next input chunk into the idle buffer
+ *
+ * The transfer runs while the decoder consumes the other buffer, so the
+ * compressed bytes move cart -> buffer with no CPU copy and (mostly) no
+ * CPU waiting.
+ */
+static void lz4_prefetch(lz4dec_state_t *lz4)
+{
+   int n = MIN(lz4->rom_left, (int)sizeof(lz4->buf[0]));
+   lz4->next_size = n;
+   if (n == 0)
+      return;
+
+   uint8_t *dst = lz4->buf[lz4->cur_buf ^ 1];
+   data_cache_hit_invalidate(dst, sizeof(lz4->buf[0]));
+   dma_read_async(dst, lz4->rom_addr, n);
+   lz4->rom_addr += n;
+   lz4->rom_left -= n;
+}
 #endif
 
 static void lz4_refill(lz4dec_state_t *lz4)
 {
-   lz4->buf_size = fread(lz4->buf, 1, sizeof(lz4->buf), lz4->fp);
+   #ifdef N64
+   if (lz4->rom_mode) {
+      // Wait for the prefetch in flight, swap buffers, and immediately
+      // start fetching the next chunk behind the decoder's back.
+      dma_wait();
+      lz4->cur_buf ^= 1;
+      lz4->buf_size = lz4->next_size;
+      lz4->buf_idx = 0;
+      lz4->eof = (lz4->buf_size == 0);
+      lz4_prefetch(lz4);
+      return;
+   }
+   #endif
+   lz4->buf_size = fread(lz4->buf[lz4->cur_buf], 1, sizeof(lz4->buf[0]), lz4->fp);
    lz4->buf_idx = 0;
    lz4->eof = (lz4->buf_size == 0);
 }
@@ -267,14 +292,14 @@ static uint8_t lz4_readbyte(lz4dec_state_t *lz4)
 {
    if (lz4->buf_idx >= lz4->buf_size)
       lz4_refill(lz4);
-   return lz4->buf[lz4->buf_idx++];
+   return lz4->buf[lz4->cur_buf][lz4->buf_idx++];
 }
 
 static void lz4_read(lz4dec_state_t *lz4, void *buf, size_t len)
 {
    while (len > 0) {
       int n = MIN(len, lz4->buf_size - lz4->buf_idx);
-      memcpy(buf, lz4->buf + lz4->buf_idx, n);
+      memcpy(buf, lz4->buf[lz4->cur_buf] + lz4->buf_idx, n);
       buf += n;
       len -= n;
       lz4->buf_idx += n;
@@ -290,8 +315,34 @@ void decompress_lz4_init(void *state, FILE *fp)
    lz4->eof = false;
    lz4->buf_idx = 0;
    lz4->buf_size = 0;
+   lz4->rom_mode = false;
+   lz4->cur_buf = 0;
+   memset(&lz4->st, 0, sizeof(lz4->st));
+   __ringbuf_init(&lz4->ringbuf);
+}
+
+void decompress_lz4_init_rom(void *state, FILE *fp, uint32_t rom_addr, int cmp_size)
+{
+   #ifdef N64
+   lz4dec_state_t *lz4 = (lz4dec_state_t*)state;
+   lz4->fp = fp;
+   lz4->eof = false;
+   lz4->buf_idx = 0;
+   lz4->buf_size = 0;
+   lz4->rom_mode = true;
+   lz4->cur_buf = 1;       // the first refill swaps to buffer 0
+   lz4->rom_addr = rom_addr;
+   lz4->rom_left = cmp_size;
+   lz4->next_size = 0;
    memset(&lz4->st, 0, sizeof(lz4->st));
    __ringbuf_init(&lz4->ringbuf);
+
+   // Prime the first buffer; the decoder will wait for it on the first read.
+   lz4_prefetch(lz4);
+   #else
+   // On PC there is no DMA: just read through stdio.
+   decompress_lz4_init(state, fp);
+   #endif
 }
 
 ssize_t decompress_lz4_read(void *state, void *buf, size_t len)
@@ -58,8 +58,43 @@
 int decompress_lz4_full_mem(const unsigned char *src, int src_size,
     unsigned char *dst, int dst_size, bool dma_race);
 
+/**
+ * @brief Decompress a block of LZ4 data compressed with a shared dictionary.
+ *
+ * Like #decompress_lz4_full_mem, but matches are allowed to reference the
+ * window [ @p dict_start, @p dst ): the caller must have placed the shared
+ * dictionary the data was compressed against right before the destination
+ * buffer. Used by the asset library for dictionary-compressed assets
+ * (mkasset --dict).
+ *
+ * @param src           Pointer to source buffer (compressed data)
+ * @param src_size      Size of the compressed data in bytes
+ * @param dst           Pointer to destination buffer (decompressed data)
+ * @param dst_size      Size of the destination buffer in bytes
+ * @param dict_start    Start of the dictionary prefix (<= @p dst)
+ * @param dma_race      If true, the source data is currently being DMA'd.
+ * @return int          Number of bytes decompressed, or -1 on error.
+ */
+int decompress_lz4_full_mem_dict(const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_size, const unsigned char *dict_start, bool dma_race);
+
+/**
+ * @brief Initialize streaming decompression with input DMA-fed from ROM
+ *
+ * Like #decompress_lz4_init, but instead of reading the compressed input
+ * through stdio, the decoder double-buffers it with PI DMA transfers
+ * issued straight from the given ROM location: the next chunk is fetched
+ * while the current one is being decoded, with no CPU staging copy.
+ *
+ * @param state         Decompression state (DECOMPRESS_LZ4_STATE_SIZE bytes)
+ * @param fp            Underlying file (kept only so it can be closed later)
+ * @param rom_addr      ROM address of the compressed payload
+ * @param cmp_size      Size of the compressed payload in bytes
+ */
+void decompress_lz4_init_rom(void *state, FILE *fp, uint32_t rom_addr, int cmp_size);
+
 
-#define DECOMPRESS_LZ4_STATE_SIZE  (16552)
+#define DECOMPRESS_LZ4_STATE_SIZE  (16704)
 
 void decompress_lz4_init(void *state, FILE *fp);
 ssize_t decompress_lz4_read(void *state, void *buf, size_t len);
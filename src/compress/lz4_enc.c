@@ -0,0 +1,146 @@
+/**
+ * @file lz4_enc.c
+ * @brief A minimal LZ4 block encoder for runtime use
+ *
+ * The decompressors in this directory are fed by assets compressed at
+ * build time on the PC; this encoder covers the opposite, rarer need of
+ * producing LZ4 data *on* the console, in contexts where neither heap
+ * allocations nor large stack frames are available (the crash-dump
+ * flight recorder being the main customer).
+ *
+ * It is a textbook greedy LZ4 encoder: a 4-KiB hash table of 16-bit
+ * positions, one probe per input byte, matches extended forward and
+ * backward. The output is a standard raw LZ4 block, compatible with
+ * #decompress_lz4_full_mem and with the lz4 command-line tools.
+ */
+#include <string.h>
+#include "lz4_enc_internal.h"
+
+#define MIN_MATCH_SIZE      4
+#define MFLIMIT             12      /* no match may start in the last 12 bytes */
+#define LASTLITERALS        5       /* the block must end with >= 5 literals */
+#define RUN_LEN             15      /* max literal/match length in the token */
+
+#define HASH_BITS           12
+#define HASH(seq)           (((seq) * 2654435761u) >> (32 - HASH_BITS))
+
+/** @brief Positions of recently seen 4-byte sequences, relative to src.
+ *
+ * 16-bit entries keep the table small but limit the input to 64 KiB.
+ * Static so that the encoder can run on a nearly exhausted stack
+ * (crash context); this makes the function non-reentrant, which is
+ * fine for its intended use.
+ */
+static uint16_t lz4_htab[1 << HASH_BITS];
+
+/** @brief Read a 32-bit value with no alignment requirement */
+static inline uint32_t rd32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/** @brief Emit a length in LZ4 extended format (255-saturated bytes) */
+static uint8_t* emit_length(uint8_t *op, int len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+int compress_lz4_full_mem(const uint8_t *src, int src_size,
+    uint8_t *dst, int dst_size)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + src_size;
+    const uint8_t *anchor = src;
+    const uint8_t *matchlimit = iend - LASTLITERALS;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_size;
+
+    if (src_size < 0 || src_size > 65535)
+        return -1;
+
+    memset(lz4_htab, 0, sizeof(lz4_htab));
+
+    if (src_size >= MFLIMIT+1)
+    {
+        ip++;   /* position 0 stays in the table as the "empty" marker */
+        while (ip <= iend - MFLIMIT)
+        {
+            /* Single hash probe per position */
+            uint32_t seq = rd32(ip);
+            uint32_t h = HASH(seq);
+            const uint8_t *match = src + lz4_htab[h];
+            lz4_htab[h] = ip - src;
+            if (match >= ip || rd32(match) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            /* Extend the match backward over pending literals */
+            while (ip > anchor && match > src && ip[-1] == match[-1])
+            {
+                ip--;
+                match--;
+            }
+
+            /* Extend the match forward */
+            int mlen = MIN_MATCH_SIZE;
+            while (ip + mlen < matchlimit && ip[mlen] == match[mlen])
+                mlen++;
+
+            /* Emit the sequence: token, literals, offset, match length */
+            int litlen = ip - anchor;
+            if (op + 1 + litlen + litlen/255 + 1 + 2 + (mlen-MIN_MATCH_SIZE)/255 + 1 > oend)
+                return -1;
+            uint8_t *token = op++;
+            if (litlen >= RUN_LEN)
+            {
+                *token = RUN_LEN << 4;
+                op = emit_length(op, litlen - RUN_LEN);
+            }
+            else
+                *token = litlen << 4;
+            memcpy(op, anchor, litlen);
+            op += litlen;
+
+            int offset = ip - match;
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+            if (mlen - MIN_MATCH_SIZE >= RUN_LEN)
+            {
+                *token |= RUN_LEN;
+                op = emit_length(op, mlen - MIN_MATCH_SIZE - RUN_LEN);
+            }
+            else
+                *token |= mlen - MIN_MATCH_SIZE;
+
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+
+    /* Trailing literals */
+    int litlen = iend - anchor;
+    if (op + 1 + litlen + litlen/255 > oend)
+        return -1;
+    uint8_t *token = op++;
+    if (litlen >= RUN_LEN)
+    {
+        *token = RUN_LEN << 4;
+        op = emit_length(op, litlen - RUN_LEN);
+    }
+    else
+        *token = litlen << 4;
+    memcpy(op, anchor, litlen);
+    op += litlen;
+
+    return op - dst;
+}
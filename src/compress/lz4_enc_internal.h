@@ -0,0 +1,39 @@
+#ifndef LIBDRAGON_COMPRESS_LZ4_ENC_INTERNAL_H
+#define LIBDRAGON_COMPRESS_LZ4_ENC_INTERNAL_H
+
+#include <stdint.h>
+
+/**
+ * @brief Worst-case size of a LZ4 block for the given input size.
+ *
+ * Incompressible data expands slightly (one literal-run byte every 255
+ * input bytes, plus the final token). Size the destination buffer with
+ * this macro to guarantee that #compress_lz4_full_mem cannot fail for
+ * lack of space.
+ */
+#define LZ4_COMPRESS_BOUND(size)    ((size) + ((size) / 255) + 16)
+
+/**
+ * @brief Compress a block of data into LZ4 format (mem to mem).
+ *
+ * This is a small greedy encoder producing standard raw LZ4 blocks,
+ * decompressable by #decompress_lz4_full_mem as well as by the standard
+ * lz4 tools on PC. It is meant for runtime use in constrained contexts
+ * (eg: crash handlers): it allocates nothing and uses a small static
+ * hash table, so it is not reentrant.
+ *
+ * Compression ratio is traded for simplicity and determinism: matches
+ * are accepted greedily with a single hash probe. Inputs are limited to
+ * 64 KiB per call; compress larger data as independent blocks.
+ *
+ * @param src           Pointer to the data to compress
+ * @param src_size      Size of the input in bytes (max 65535)
+ * @param dst           Pointer to destination buffer (compressed data)
+ * @param dst_size      Size of the destination buffer in bytes
+ * @return int          Number of compressed bytes, or -1 if the input is
+ *                      too large or the destination buffer is too small.
+ */
+int compress_lz4_full_mem(const uint8_t *src, int src_size,
+    uint8_t *dst, int dst_size);
+
+#endif
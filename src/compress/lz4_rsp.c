@@ -0,0 +1,77 @@
+/**
+ * @file lz4_rsp.c
+ * @brief RSP LZ4 block decompression
+ *
+ * CPU-side wrapper of the LZ4 decompression overlay. See
+ * lz4_rsp_internal.h for the API documentation, and rsp_lz4.S for the
+ * RSP-side decoder.
+ */
+
+#include "lz4_rsp_internal.h"
+#include "rspq.h"
+#include "n64sys.h"
+#include "debug.h"
+
+/** @brief Overlay commands (see rsp_lz4.S) */
+enum {
+    LZ4_CMD_DECOMPRESS = 0x0,       ///< Decompress one LZ4 block
+};
+
+/** The LZ4 decompression ucode */
+DEFINE_RSP_UCODE(rsp_lz4);
+
+/** @brief Overlay ID assigned to the ucode (0 if not initialized) */
+static uint32_t lz4_ovl_id;
+
+void lz4_rsp_init(void)
+{
+    if (lz4_ovl_id)
+        return;
+
+    rspq_init();
+    lz4_ovl_id = rspq_overlay_register(&rsp_lz4);
+}
+
+void lz4_rsp_close(void)
+{
+    if (!lz4_ovl_id)
+        return;
+
+    rspq_overlay_unregister(lz4_ovl_id);
+    lz4_ovl_id = 0;
+}
+
+bool lz4_rsp_usable(int dst_size)
+{
+    return lz4_ovl_id != 0 && (dst_size & 7) == 0;
+}
+
+rspq_syncpoint_t lz4_rsp_decompress_async(const void *src, int src_size,
+    void *dst, int dst_size)
+{
+    assertf(lz4_ovl_id, "lz4_rsp_init was not called");
+    assertf(((uint32_t)dst & 7) == 0,
+        "output buffer must be 8-byte aligned: %p", dst);
+    assertf((dst_size & 7) == 0,
+        "output size must be a multiple of 8: %d", dst_size);
+    assertf(src_size > 0 && src_size < (1 << 24),
+        "invalid compressed size: %d", src_size);
+
+    // The RSP reads the input and writes the output via DMA: flush the
+    // input to RDRAM, and drop any cached output lines so they neither
+    // mask the results nor get written back over them later.
+    data_cache_hit_writeback(src, src_size);
+    data_cache_hit_writeback_invalidate(dst, dst_size);
+
+    rspq_write(lz4_ovl_id, LZ4_CMD_DECOMPRESS, src_size,
+        PhysicalAddr(src), PhysicalAddr(dst));
+    rspq_flush();
+    return rspq_syncpoint_new();
+}
+
+int decompress_lz4_full_mem_rsp(const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_size)
+{
+    rspq_syncpoint_wait(lz4_rsp_decompress_async(src, src_size, dst, dst_size));
+    return dst_size;
+}
@@ -0,0 +1,64 @@
+#ifndef LIBDRAGON_COMPRESS_LZ4_RSP_INTERNAL_H
+#define LIBDRAGON_COMPRESS_LZ4_RSP_INTERNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "rspq.h"
+
+/**
+ * @brief RSP LZ4 block decompression
+ *
+ * These functions offload raw LZ4 block decoding to an rspq overlay
+ * (see rsp_lz4.S), so asset loads can decompress in the background
+ * while the CPU does other work. The overlay is opt-in: call
+ * #lz4_rsp_init once (it initializes rspq if needed); until then,
+ * #lz4_rsp_usable returns false and callers fall back to the CPU
+ * decoder in lz4_dec.c.
+ */
+
+/** @brief Register the LZ4 overlay into the RSP queue engine */
+void lz4_rsp_init(void);
+
+/** @brief Unregister the LZ4 overlay */
+void lz4_rsp_close(void);
+
+/**
+ * @brief Check whether a buffer can be decompressed on the RSP.
+ *
+ * Returns false when the overlay is not initialized, or when the
+ * output size is not a multiple of 8 bytes: the RSP flushes its
+ * output in 8-byte DMA units, so an unpadded tail must go through
+ * the CPU decoder instead.
+ */
+bool lz4_rsp_usable(int dst_size);
+
+/**
+ * @brief Enqueue the decompression of one LZ4 block on the RSP.
+ *
+ * The call returns immediately; wait on the returned syncpoint before
+ * reading @p dst or reusing @p src. Source and destination caches are
+ * handled here (source written back, destination invalidated), so the
+ * CPU must not touch cache lines overlapping @p dst until the
+ * syncpoint has passed.
+ *
+ * @param src       Compressed data in RDRAM (any alignment)
+ * @param src_size  Compressed size in bytes
+ * @param dst       Output buffer (8-byte aligned, #lz4_rsp_usable size)
+ * @param dst_size  Decompressed size in bytes
+ * @return Syncpoint that passes once the output is fully in RDRAM
+ */
+rspq_syncpoint_t lz4_rsp_decompress_async(const void *src, int src_size,
+    void *dst, int dst_size);
+
+/**
+ * @brief Decompress one LZ4 block on the RSP, waiting for completion.
+ *
+ * Blocking counterpart of #lz4_rsp_decompress_async, signature-matched
+ * to #decompress_lz4_full_mem.
+ *
+ * @return The number of bytes decompressed (@p dst_size)
+ */
+int decompress_lz4_full_mem_rsp(const unsigned char *src, int src_size,
+    unsigned char *dst, int dst_size);
+
+#endif
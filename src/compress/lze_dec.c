@@ -0,0 +1,392 @@
+// Decoder for the LZE format, the level-3 asset compression.
+//
+// LZE is a LZ77 + static Huffman design, in the spirit of a DEFLATE with
+// fixed-per-file code tables and no dynamic blocks, tuned for decode speed
+// on the N64 CPU:
+//
+//  * One pair of canonical Huffman tables per file (literals/lengths and
+//    distances), transmitted as plain 4-bit code lengths. No code-length
+//    tree, no per-block table rebuilds.
+//  * Codes are limited to 11 bits, so decoding is a single table lookup
+//    per symbol instead of a bit-by-bit tree walk like LZH5.
+//  * The match window is 16 KiB, matching the ring buffer used by the
+//    streaming decompressors (see ringbuf_internal.h).
+//
+// Length and distance symbols use the same base/extra-bits buckets as
+// DEFLATE (lengths 3..258, distances 1..16384). The bit stream is MSB
+// first. The encoder lives in tools/common/lze_compress.c.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lze_dec_internal.h"
+#include "ringbuf_internal.h"
+#include "dma_race_internal.h"
+#include "../utils.h"
+
+#ifdef N64
+#include <malloc.h>
+#include "debug.h"
+#include "dma.h"
+#include "dragonfs.h"
+#include "n64sys.h"
+#else
+#include <stdlib.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define lze_likely(x)       __builtin_expect(!!(x), 1)
+#define lze_unlikely(x)     __builtin_expect(!!(x), 0)
+#else
+#define lze_likely(x)       (x)
+#define lze_unlikely(x)     (x)
+#endif
+
+#define LZE_NUM_LITLEN     286      // 256 literals + end-of-block + 29 length codes
+#define LZE_NUM_DIST       28       // distance codes covering 1..16384
+#define LZE_EOB            256      // end-of-block symbol
+#define LZE_MAX_BITS       11       // maximum Huffman code length
+#define LZE_TABLE_SIZE     (1 << LZE_MAX_BITS)
+
+// Base values and extra bits for length codes 0..28 (symbols 257..285).
+static const uint16_t lze_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t lze_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+
+// Base values and extra bits for distance codes 0..27.
+static const uint16_t lze_dist_base[28] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+};
+static const uint8_t lze_dist_extra[28] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+};
+
+/**
+ * @brief Bit reader state (MSB first).
+ *
+ * The source is either a FILE (streaming decompression, read through a
+ * small buffer) or a memory block (full decompression, optionally racing
+ * with the PI DMA that is filling it). The explicit alignments keep the
+ * struct layout identical between N64 and PC builds (which have different
+ * pointer sizes).
+ */
+typedef struct {
+    FILE *fp;                                       ///< File source (NULL if memory source)
+    uint8_t buf[128] __attribute__((aligned(8)));   ///< File read buffer
+    int buf_idx;                                    ///< Current index in the file buffer
+    int buf_size;                                   ///< Valid bytes in the file buffer
+    const uint8_t *mem;                             ///< Memory source (NULL if file source)
+    int mem_idx __attribute__((aligned(8)));        ///< Current index in the memory source
+    int mem_size;                                   ///< Size of the memory source
+    bool dma_race;                                  ///< True if the memory source is being DMA'd
+    uint64_t bits;                                  ///< Bit buffer (MSB aligned)
+    int nbits;                                      ///< Valid bits in the bit buffer
+} lze_bitreader_t;
+
+static void lze_bitreader_init(lze_bitreader_t *r, FILE *fp)
+{
+    memset(r, 0, sizeof(*r));
+    r->fp = fp;
+}
+
+static void lze_bitreader_init_mem(lze_bitreader_t *r, const void *buf, int size, bool dma_race)
+{
+    memset(r, 0, sizeof(*r));
+    r->mem = buf;
+    r->mem_size = size;
+    r->dma_race = dma_race;
+    if (dma_race)
+        __compress_wait_dma(NULL);
+}
+
+static uint8_t lze_nextbyte(lze_bitreader_t *r)
+{
+    if (r->mem) {
+        if (lze_unlikely(r->mem_idx >= r->mem_size))
+            return 0;
+        // Throttle behind the DMA once per 16-byte chunk, not per byte.
+        if (r->dma_race && !(r->mem_idx & 15))
+            __compress_wait_dma(r->mem + r->mem_idx + 16);
+        return r->mem[r->mem_idx++];
+    }
+    if (r->buf_idx >= r->buf_size) {
+        r->buf_size = fread(r->buf, 1, sizeof(r->buf), r->fp);
+        r->buf_idx = 0;
+        if (r->buf_size <= 0) {
+            r->buf_size = 0;
+            return 0;
+        }
+    }
+    return r->buf[r->buf_idx++];
+}
+
+// Top up the bit buffer to at least 57 valid bits. One refill covers the
+// longest possible decode step (11-bit code plus 13 extra bits).
+static inline void lze_refill(lze_bitreader_t *r)
+{
+    while (r->nbits <= 56) {
+        r->bits |= (uint64_t)lze_nextbyte(r) << (56 - r->nbits);
+        r->nbits += 8;
+    }
+}
+
+// Read n bits (1..24). The caller must have refilled the buffer.
+static inline uint32_t lze_getbits(lze_bitreader_t *r, int n)
+{
+    uint32_t v = r->bits >> (64 - n);
+    r->bits <<= n;
+    r->nbits -= n;
+    return v;
+}
+
+// Decode one symbol via the table: a single lookup indexed by the next
+// LZE_MAX_BITS bits. Returns -1 on invalid (corrupt) codes.
+static inline int lze_decode(lze_bitreader_t *r, const uint16_t *table)
+{
+    lze_refill(r);
+    uint16_t e = table[r->bits >> (64 - LZE_MAX_BITS)];
+    int len = e & 15;
+    if (lze_unlikely(len == 0))
+        return -1;
+    r->bits <<= len;
+    r->nbits -= len;
+    return e >> 4;
+}
+
+/**
+ * @brief Build a canonical Huffman decode table from code lengths.
+ *
+ * Each table entry, indexed by the next LZE_MAX_BITS bits of input, holds
+ * (symbol << 4) | code_length; zero entries mark invalid codes.
+ *
+ * @return false if the code lengths are invalid (oversubscribed).
+ */
+static bool lze_build_table(uint16_t *table, const uint8_t *lens, int num)
+{
+    int bl_count[LZE_MAX_BITS+1] = {0};
+    uint32_t next_code[LZE_MAX_BITS+1];
+
+    for (int i = 0; i < num; i++)
+        bl_count[lens[i]]++;
+    bl_count[0] = 0;
+
+    uint32_t code = 0;
+    for (int b = 1; b <= LZE_MAX_BITS; b++) {
+        code = (code + bl_count[b-1]) << 1;
+        next_code[b] = code;
+    }
+
+    memset(table, 0, LZE_TABLE_SIZE * sizeof(uint16_t));
+    for (int sym = 0; sym < num; sym++) {
+        int len = lens[sym];
+        if (!len)
+            continue;
+        uint32_t c = next_code[len]++;
+        if (c >= (1u << len))
+            return false;
+        int fill = 1 << (LZE_MAX_BITS - len);
+        uint16_t e = (sym << 4) | len;
+        for (int k = 0; k < fill; k++)
+            table[(c << (LZE_MAX_BITS - len)) + k] = e;
+    }
+    return true;
+}
+
+// Read the code length prelude (4 bits per symbol, high nibble first) and
+// build both decode tables. Returns false on corrupt data.
+static bool lze_read_tables(lze_bitreader_t *r, uint16_t *litlen_table, uint16_t *dist_table)
+{
+    uint8_t lens[LZE_NUM_LITLEN];
+
+    for (int i = 0; i < LZE_NUM_LITLEN; i += 2) {
+        uint8_t b = lze_nextbyte(r);
+        lens[i] = b >> 4;
+        lens[i+1] = b & 15;
+    }
+    if (!lze_build_table(litlen_table, lens, LZE_NUM_LITLEN))
+        return false;
+
+    for (int i = 0; i < LZE_NUM_DIST; i += 2) {
+        uint8_t b = lze_nextbyte(r);
+        lens[i] = b >> 4;
+        lens[i+1] = b & 15;
+    }
+    return lze_build_table(dist_table, lens, LZE_NUM_DIST);
+}
+
+int decompress_lze_full_mem(const uint8_t *src, int src_size, uint8_t *dst, int dst_size, bool dma_race)
+{
+    uint16_t litlen_table[LZE_TABLE_SIZE];
+    uint16_t dist_table[LZE_TABLE_SIZE];
+    lze_bitreader_t r;
+
+    lze_bitreader_init_mem(&r, src, src_size, dma_race);
+    if (!lze_read_tables(&r, litlen_table, dist_table))
+        return -1;
+
+    int pos = 0;
+    while (1) {
+        int sym = lze_decode(&r, litlen_table);
+        if (lze_likely(sym < 256)) {
+            if (lze_unlikely(sym < 0 || pos >= dst_size))
+                return -1;
+            dst[pos++] = sym;
+            continue;
+        }
+        if (sym == LZE_EOB)
+            break;
+
+        int lc = sym - 257;
+        int len = lze_len_base[lc];
+        if (lze_len_extra[lc])
+            len += lze_getbits(&r, lze_len_extra[lc]);
+
+        int dc = lze_decode(&r, dist_table);
+        if (lze_unlikely(dc < 0))
+            return -1;
+        int dist = lze_dist_base[dc];
+        if (lze_dist_extra[dc])
+            dist += lze_getbits(&r, lze_dist_extra[dc]);
+
+        if (lze_unlikely(dist > pos || pos + len > dst_size))
+            return -1;
+
+        // Byte-by-byte copy: matches can overlap themselves (dist < len).
+        uint8_t *out = &dst[pos];
+        const uint8_t *in = out - dist;
+        pos += len;
+        while (len--)
+            *out++ = *in++;
+    }
+
+    return pos;
+}
+
+void* decompress_lze_full(const char *fn, FILE *fp, size_t cmp_size, size_t size)
+{
+    void *s = memalign(16, size);
+    assertf(s, "asset_load: out of memory");
+
+    int n;
+
+    #ifdef N64
+    if (fn && strncmp(fn, "rom:/", 5) == 0) {
+        // Loading from ROM. Start an asynchronous DMA transfer of the whole
+        // compressed payload into a temporary buffer, and run the
+        // decompression racing with it, like the LZ4 and LZH5 paths do.
+        int cmp_bufsize = (cmp_size + 15) & ~15;
+        uint8_t *cmp = memalign(16, cmp_bufsize);
+        assertf(cmp, "asset_load: out of memory");
+        data_cache_hit_invalidate(cmp, cmp_bufsize);
+
+        uint32_t addr = dfs_rom_addr(fn+5) & 0x1FFFFFFF;
+        dma_read_async(cmp, addr+16, cmp_size);
+
+        n = decompress_lze_full_mem(cmp, cmp_size, s, size, true);
+        free(cmp);
+    } else
+    #endif
+    {
+        uint8_t *cmp = malloc(cmp_size);
+        assertf(cmp, "asset_load: out of memory");
+        fread(cmp, 1, cmp_size, fp);
+        n = decompress_lze_full_mem(cmp, cmp_size, s, size, false);
+        free(cmp);
+    }
+
+    (void)n;
+    assertf(n == size, "asset: decompression error on file %s: corrupted? (%d/%d)", fn, n, size);
+
+    return s;
+}
+
+/**
+ * @brief State of the LZE algorithm (streaming version).
+ */
+typedef struct lzedec_state_s {
+    lze_bitreader_t reader;                     ///< Bit reader (file source)
+    uint16_t litlen_table[LZE_TABLE_SIZE];      ///< Literal/length decode table
+    uint16_t dist_table[LZE_TABLE_SIZE];        ///< Distance decode table
+    bool tables_ready;                          ///< True once the prelude has been parsed
+    bool eof;                                   ///< True after the end-of-block symbol
+    int match_len;                              ///< Remaining bytes of the current match
+    int match_off;                              ///< Distance of the current match
+    decompress_ringbuf_t ringbuf;               ///< Ring buffer (match history)
+} lzedec_state_t;
+
+_Static_assert(sizeof(lzedec_state_t) == DECOMPRESS_LZE_STATE_SIZE, "lzedec_state_t size mismatch");
+
+void decompress_lze_init(void *state, FILE *fp)
+{
+    lzedec_state_t *lze = (lzedec_state_t*)state;
+    lze_bitreader_init(&lze->reader, fp);
+    lze->tables_ready = false;
+    lze->eof = false;
+    lze->match_len = 0;
+    lze->match_off = 0;
+    __ringbuf_init(&lze->ringbuf);
+}
+
+ssize_t decompress_lze_read(void *state, void *buf, size_t len)
+{
+    lzedec_state_t *lze = (lzedec_state_t*)state;
+    uint8_t *dst = buf;
+    uint8_t *dst_orig = buf;
+
+    if (!lze->tables_ready) {
+        if (!lze_read_tables(&lze->reader, lze->litlen_table, lze->dist_table)) {
+            lze->eof = true;
+            return 0;
+        }
+        lze->tables_ready = true;
+    }
+
+    while (len > 0 && !lze->eof) {
+        if (lze->match_len) {
+            int n = MIN(lze->match_len, len);
+            __ringbuf_copy(&lze->ringbuf, lze->match_off, dst, n);
+            dst += n;
+            len -= n;
+            lze->match_len -= n;
+            continue;
+        }
+
+        int sym = lze_decode(&lze->reader, lze->litlen_table);
+        if (lze_likely(sym >= 0 && sym < 256)) {
+            *dst++ = sym;
+            __ringbuf_writebyte(&lze->ringbuf, sym);
+            len--;
+            continue;
+        }
+        if (sym == LZE_EOB || sym < 0) {
+            lze->eof = true;
+            break;
+        }
+
+        int lc = sym - 257;
+        lze->match_len = lze_len_base[lc];
+        if (lze_len_extra[lc])
+            lze->match_len += lze_getbits(&lze->reader, lze_len_extra[lc]);
+
+        int dc = lze_decode(&lze->reader, lze->dist_table);
+        if (lze_unlikely(dc < 0)) {
+            lze->eof = true;
+            lze->match_len = 0;
+            break;
+        }
+        lze->match_off = lze_dist_base[dc];
+        if (lze_dist_extra[dc])
+            lze->match_off += lze_getbits(&lze->reader, lze_dist_extra[dc]);
+    }
+
+    return dst - dst_orig;
+}
@@ -0,0 +1,48 @@
+#ifndef LIBDRAGON_COMPRESS_LZE_DEC_INTERNAL_H
+#define LIBDRAGON_COMPRESS_LZE_DEC_INTERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * @brief Size of the LZE decompression state.
+ *
+ * Most of this is the two Huffman decode tables (8 KiB) and the 16 KiB
+ * ring buffer used for streaming decompression. Note that this can still
+ * be allocated on the stack, as the stack size configured by libdragon
+ * is 64KB.
+ */
+#define DECOMPRESS_LZE_STATE_SIZE     24776
+
+/**
+ * @brief Decompress a block of LZE data (mem to mem).
+ *
+ * LZE is the level-3 asset compression: LZ77 over a 16 KiB window, with
+ * literals, match lengths and match distances entropy-coded using static
+ * per-file canonical Huffman codes (same length/distance buckets as
+ * DEFLATE). Decoding is table-driven — one lookup per symbol — which makes
+ * it much faster than the tree-walking LZH5 decoder, at a better
+ * compression ratio than LZ4.
+ *
+ * Like the LZ4 decompressor, this function can be run in parallel with the
+ * PI DMA transfer that is filling the source buffer. If called with
+ * @p dma_race set to true, the function will throttle itself to never read
+ * past the current DMA position.
+ *
+ * @param src           Pointer to source buffer (compressed data)
+ * @param src_size      Size of the compressed data in bytes
+ * @param dst           Pointer to destination buffer (decompressed data)
+ * @param dst_size      Size of the destination buffer in bytes
+ * @param dma_race      If true, the source data is currently being DMA'd.
+ * @return int          Number of bytes decompressed, or -1 on error.
+ */
+int decompress_lze_full_mem(const uint8_t *src, int src_size,
+    uint8_t *dst, int dst_size, bool dma_race);
+
+void decompress_lze_init(void *state, FILE *fp);
+ssize_t decompress_lze_read(void *state, void *buf, size_t len);
+void* decompress_lze_full(const char *fn, FILE *fp, size_t cmp_size, size_t size);
+
+#endif
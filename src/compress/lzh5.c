@@ -8,11 +8,16 @@
 // bytes in the output buffer.
 // This file is ISC Licensed.
 
+#include <stdbool.h>
 #include "lzh5_internal.h"
+#include "dma_race_internal.h"
 
 #ifdef N64
 #include <malloc.h>
 #include "debug.h"
+#include "dma.h"
+#include "dragonfs.h"
+#include "n64sys.h"
 #else
 #include <stdlib.h>
 #endif
@@ -60,6 +65,17 @@ typedef struct {
 	int buf_idx;
 	int buf_size;
 
+	// Optional in-memory source. When set, refills copy from this
+	// buffer instead of reading from fp, optionally throttled behind
+	// an in-flight PI DMA transfer filling it. The explicit alignment
+	// keeps the struct layout identical between N64 and PC builds
+	// (which have different pointer sizes).
+
+	const uint8_t *mem;
+	int mem_idx __attribute__((aligned(8)));
+	int mem_size;
+	bool dma_race;
+
 	// Bits from the input stream that are waiting to be read.
 
 	uint64_t bit_buffer;
@@ -72,18 +88,53 @@ typedef struct {
 static void bit_stream_reader_init(BitStreamReader *reader, FILE *fp)
 {
 	reader->fp = fp;
+	reader->mem = NULL;
+	reader->mem_idx = 0;
+	reader->mem_size = 0;
+	reader->dma_race = false;
 	reader->buf_idx = 0;
 	reader->buf_size = 0;
 	reader->bits = 0;
 	reader->bit_buffer = 0;
 }
 
+// Initialize bit stream reader from a memory buffer. If dma_race is true,
+// the buffer is currently being DMA'd into memory, and reads will throttle
+// behind the current DMA position (see __compress_wait_dma).
+
+static void bit_stream_reader_init_mem(BitStreamReader *reader, const void *buf, int size, bool dma_race)
+{
+	reader->fp = NULL;
+	reader->mem = buf;
+	reader->mem_idx = 0;
+	reader->mem_size = size;
+	reader->dma_race = dma_race;
+	reader->buf_idx = 0;
+	reader->buf_size = 0;
+	reader->bits = 0;
+	reader->bit_buffer = 0;
+
+	if (dma_race)
+		__compress_wait_dma(NULL);
+}
+
 // Refill the bit buffer with other 64 bits from the input stream.
 
 static int refill_bits(BitStreamReader *reader)
 {
 	if (reader->buf_idx >= reader->buf_size) {
-		reader->buf_size = fread(reader->buf, 1, sizeof(reader->buf), reader->fp);
+		if (reader->mem) {
+			int n = sizeof(reader->buf);
+			if (n > reader->mem_size - reader->mem_idx)
+				n = reader->mem_size - reader->mem_idx;
+			if (reader->dma_race)
+				__compress_wait_dma(reader->mem + reader->mem_idx + n);
+			memcpy(reader->buf, reader->mem + reader->mem_idx, n);
+			reader->mem_idx += n;
+			reader->buf_size = n;
+		} else {
+			reader->buf_size = fread(reader->buf, 1, sizeof(reader->buf), reader->fp);
+		}
 		reader->buf_idx = 0;
 	}
 
@@ -590,6 +641,25 @@ static int lha_lh_new_init(LHANewDecoder *decoder, FILE *fp)
 	return 1;
 }
 
+__attribute__((unused))  // only used on N64, where ROM loads can race the DMA
+static int lha_lh_new_init_mem(LHANewDecoder *decoder, const void *buf, int size, bool dma_race)
+{
+	// Initialize input stream reader from the memory buffer.
+
+	bit_stream_reader_init_mem(&decoder->bit_stream_reader, buf, size, dma_race);
+
+	// First read starts the first block.
+
+	decoder->block_remaining = 0;
+
+	// Initialize tree tables to a known state.
+
+	init_tree(decoder->code_tree, NUM_CODES * 2);
+	init_tree(decoder->offset_tree, MAX_TEMP_CODES * 2);
+
+	return 1;
+}
+
 static int lha_lh_new_init_partial(LHANewDecoderPartial *decoder, FILE *fp)
 {
 	lha_lh_new_init(&decoder->decoder, fp);
@@ -1169,8 +1239,38 @@ void* decompress_lzh5_full(const char *fn, FILE *fp, size_t cmp_size, size_t siz
 	assertf(s, "asset_load: out of memory");
 
 	LHANewDecoder decoder;
-	lha_lh_new_init(&decoder, fp);
-	int n = lha_lh_new_read_full(&decoder, s, size); (void)n;
+	int n;
+
+	#ifdef N64
+	if (fn && strncmp(fn, "rom:/", 5) == 0) {
+		// Loading from ROM. Start an asynchronous DMA transfer of the whole
+		// compressed payload into a temporary buffer, and run the decompression
+		// racing with it, throttled behind the current DMA position. The total
+		// load time becomes close to max(PI time, decode time) instead of
+		// their sum. The same technique is used by the LZ4 decompressor,
+		// which can additionally decompress in-place.
+		int cmp_bufsize = (cmp_size + 15) & ~15;
+		uint8_t *cmp = memalign(16, cmp_bufsize);
+		assertf(cmp, "asset_load: out of memory");
+
+		// Invalidate the buffer in case (part of) it happens to be in cache:
+		// it is going to be filled via DMA.
+		data_cache_hit_invalidate(cmp, cmp_bufsize);
+
+		uint32_t addr = dfs_rom_addr(fn+5) & 0x1FFFFFFF;
+		dma_read_async(cmp, addr+16, cmp_size);
+
+		lha_lh_new_init_mem(&decoder, cmp, cmp_size, true);
+		n = lha_lh_new_read_full(&decoder, s, size);
+		free(cmp);
+	} else
+	#endif
+	{
+		lha_lh_new_init(&decoder, fp);
+		n = lha_lh_new_read_full(&decoder, s, size);
+	}
+
+	(void)n;
 	assertf(n == size, "asset: decompression error on file %s: corrupted? (%d/%d)", fn, n, size);
 
 	return s;
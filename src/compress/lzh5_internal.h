@@ -14,7 +14,7 @@ extern "C" {
  * Note that this can still be allocated on the stack, as the stack size
  * configured by libdragon is 64KB.
  */
-#define DECOMPRESS_LZH5_STATE_SIZE    18688
+#define DECOMPRESS_LZH5_STATE_SIZE    18712
 
 void decompress_lzh5_init(void *state, FILE *fp);
 ssize_t decompress_lzh5_read(void *state, void *buf, size_t len);
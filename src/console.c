@@ -45,8 +45,17 @@ static void __console_render(void);
 /** @brief Size of the console buffer in bytes */
 #define CONSOLE_SIZE        ((sizeof(char) * CONSOLE_WIDTH * CONSOLE_HEIGHT) + sizeof(char))
 
+/** @brief Maximum number of framebuffers tracked for dirty-cell rendering */
+#define MAX_SHADOWS         3
+
 /** @brief The console buffer */
 static char *render_buffer = 0;
+/** @brief Per-framebuffer copies of the text last drawn into it */
+static char *shadow_buffer[MAX_SHADOWS];
+/** @brief Framebuffer that each shadow copy refers to */
+static surface_t *shadow_surface[MAX_SHADOWS];
+/** @brief True if the console scrolled or was cleared, forcing a full redraw */
+static bool console_dirty_all = false;
 /** 
  * @brief Internal state of the render mode
  * @see #RENDER_AUTOMATIC and #RENDER_MANUAL
@@ -79,7 +88,8 @@ void console_set_render_mode(int mode)
  */
 #define move_buffer() \
     memmove(render_buffer, render_buffer + (sizeof(char) * CONSOLE_WIDTH), CONSOLE_SIZE - (CONSOLE_WIDTH * sizeof(char))); \
-    pos -= CONSOLE_WIDTH;
+    pos -= CONSOLE_WIDTH; \
+    console_dirty_all = true;
 
 /**
  * @brief Newlib hook to allow printf/iprintf to appear on console
@@ -182,6 +192,18 @@ void console_init()
 
     render_buffer = malloc(CONSOLE_SIZE);
 
+    /* Allocate the shadow copies used to track which cells changed between
+       frames; they are bound to framebuffers lazily at render time */
+    for(int i = 0; i < MAX_SHADOWS; i++)
+    {
+        if(!shadow_buffer[i])
+        {
+            shadow_buffer[i] = malloc(CONSOLE_SIZE);
+        }
+
+        shadow_surface[i] = 0;
+    }
+
     console_set_render_mode(RENDER_AUTOMATIC);
     console_clear();
     console_set_debug(true);
@@ -209,6 +231,17 @@ void console_close()
         render_buffer = 0;
     }
 
+    for(int i = 0; i < MAX_SHADOWS; i++)
+    {
+        if(shadow_buffer[i])
+        {
+            free(shadow_buffer[i]);
+            shadow_buffer[i] = 0;
+        }
+
+        shadow_surface[i] = 0;
+    }
+
     /* Unregister ourselves from newlib */
     stdio_t console_calls = { 0, __console_write, 0 };
     unhook_stdio_calls( &console_calls );
@@ -235,7 +268,8 @@ void console_clear()
 
     /* Remove all data */
     memset(render_buffer, 0, CONSOLE_SIZE);
-    
+    console_dirty_all = true;
+
     /* Should we display? */
     if(render_now == RENDER_AUTOMATIC)
     {
@@ -255,18 +289,71 @@ static void __console_render(void)
     /* Wait until we get a valid context */
     while(!(dc = display_lock()));
 
-    /* Background color! */
-    graphics_fill_screen( dc, 0 );
+    /* Find the shadow copy of what this framebuffer currently shows, binding
+       a free slot to the framebuffer the first time we render into it */
+    int shadow = -1;
+    for(int i = 0; i < MAX_SHADOWS; i++)
+    {
+        if(shadow_surface[i] == dc)
+        {
+            shadow = i;
+            break;
+        }
+
+        if(shadow < 0 && shadow_surface[i] == 0)
+        {
+            shadow = i;
+        }
+    }
 
+    /* A full redraw is needed after a scroll or clear, and for framebuffers
+       we never rendered into (whose shadow is still unbound) */
+    bool full_redraw = console_dirty_all || shadow < 0 || shadow_surface[shadow] != dc;
+
+    if(shadow >= 0)
+    {
+        shadow_surface[shadow] = dc;
+    }
+
+    if(full_redraw)
+    {
+        /* Background color! */
+        graphics_fill_screen( dc, 0 );
+    }
+
+    bool ended = false;
     for(int y = 0; y < CONSOLE_HEIGHT; y++)
     {
         for(int x = 0; x < CONSOLE_WIDTH; x++)
         {
-            char t_buf = render_buffer[y * CONSOLE_WIDTH + x];
+            /* Cells past the end of the text are blank */
+            char t_buf = ended ? 0 : render_buffer[y * CONSOLE_WIDTH + x];
 
             if(t_buf == 0)
             {
-                goto end;
+                ended = true;
+            }
+
+            if(!full_redraw)
+            {
+                /* Skip cells that this framebuffer already shows */
+                if(shadow_buffer[shadow][y * CONSOLE_WIDTH + x] == t_buf)
+                {
+                    continue;
+                }
+
+                /* Erase the cell back to the background before redrawing */
+                graphics_draw_box( dc, HORIZONTAL_PADDING + 8 * x, VERTICAL_PADDING + 8 * y, 8, 8, 0 );
+            }
+
+            if(shadow >= 0)
+            {
+                shadow_buffer[shadow][y * CONSOLE_WIDTH + x] = t_buf;
+            }
+
+            if(t_buf == 0)
+            {
+                continue;
             }
 
             /* Draw to the screen using the forecolor and backcolor set in the graphics
@@ -275,7 +362,8 @@ static void __console_render(void)
         }
     }
 
-end:;
+    console_dirty_all = false;
+
     /* If the interrupts are disabled, the console wouldn't show to the screen.
      * Since the console is only used for development and emergency context,
      * it is better to force display irrespective of vblank. */
@@ -9,6 +9,9 @@
 #include "joybus.h"
 #include "joybus_internal.h"
 #include "debug.h"
+#include "timer.h"
+#include "n64sys.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -40,7 +43,12 @@
  * return a structure consisting of all button states on all controllers currently
  * inserted. Note that this function takes about 10% of a frame's worth of time.
  *
- * Controllers can be enumerated with 
+ * The input stream can also be recorded to a file and replayed later with
+ * frame-accurate timing, so that a scenario can be reproduced
+ * deterministically (for example to benchmark it repeatedly); see
+ * #controller_record_start and #controller_replay_start.
+ *
+ * Controllers can be enumerated with
  * #get_controllers_present.  Similarly, accessories can be enumerated with
  * #get_accessories_present and #identify_accessory.
  *
@@ -72,10 +80,151 @@ static volatile bool controller_autoscan_in_progress = false;
 /** @brief True if the module was initialized */
 static bool controller_inited = false;
 
+/** @brief Mask of the button bits within SI_condat's data word */
+#define CONTROLLER_BUTTON_MASK     0xFFFF0000
+
+/** @brief Maximum number of buffered input events */
+#define MAX_CONTROLLER_EVENTS      64
+
+/** @brief The raw controller data of the previous background poll */
+static struct controller_data last_sample;
+/** @brief Input event ring buffer, filled at poll time */
+static controller_event_t events[MAX_CONTROLLER_EVENTS];
+/** @brief Event ring write index */
+static volatile int events_widx = 0;
+/** @brief Event ring read index */
+static volatile int events_ridx = 0;
+/** @brief The timer driving the background poll (NULL = VI-driven) */
+static timer_link_t *poll_timer = NULL;
+
+/** @brief Magic number at the start of an input recording ("CIR1") */
+#define RECORD_MAGIC               0x43495231
+/** @brief Number of recording records buffered between controller_scan calls */
+#define MAX_RECORD_PENDING         64
+
+/**
+ * @brief One record of an input recording.
+ *
+ * A record is emitted for every poll at which the state of any port
+ * changed, indexed by the number of polls since the recording started.
+ * Indexing by poll rather than by wall clock is what makes a replay
+ * deterministic: as long as the poll rate is the same, the replayed
+ * input lands on exactly the same poll it was captured on.
+ */
+typedef struct
+{
+    uint32_t poll;              ///< Poll index the state was observed at
+    uint32_t data[4];           ///< Raw SI data word of each port
+} controller_record_t;
+
+/** @brief Recording output file (NULL = not recording) */
+static FILE *record_fp = NULL;
+/** @brief Replay input file (NULL = not replaying) */
+static FILE *replay_fp = NULL;
+/** @brief Polls since the recording or replay started */
+static uint32_t poll_count = 0;
+/** @brief Last state written to the recording, per port */
+static uint32_t record_last[4];
+/** @brief Recording ring, filled at poll time and drained by #controller_scan */
+static controller_record_t record_ring[MAX_RECORD_PENDING];
+/** @brief Recording ring write index */
+static volatile int record_widx = 0;
+/** @brief Recording ring read index */
+static volatile int record_ridx = 0;
+/** @brief Records dropped because the ring overflowed */
+static int record_dropped = 0;
+/** @brief Next replay record waiting to be applied */
+static controller_record_t replay_next_rec;
+/** @brief True if #replay_next_rec holds an unapplied record */
+static volatile bool replay_next_valid = false;
+/** @brief Input state currently injected by the replay, per port */
+static uint32_t replay_data[4];
+
+/**
+ * @brief Record one input event at poll time.
+ *
+ * When the ring is full, the oldest event is dropped: recent input is
+ * more valuable than stale input.
+ *
+ * @note This function is called under interrupt.
+ */
+static void controller_push_event(int port, bool down, uint16_t buttons, uint32_t ticks)
+{
+    int next_widx = (events_widx + 1) % MAX_CONTROLLER_EVENTS;
+    if (next_widx == events_ridx)
+        events_ridx = (events_ridx + 1) % MAX_CONTROLLER_EVENTS;
+
+    events[events_widx] = (controller_event_t){
+        .port = port, .down = down, .buttons = buttons, .ticks = ticks,
+    };
+    events_widx = next_widx;
+}
+
 static void controller_interrupt_update(uint64_t *output, void *ctx)
 {
     memcpy((void*)&next, output, sizeof(struct controller_data));
     controller_autoscan_in_progress = false;
+
+    // While a replay is active, the sampled data is replaced with the
+    // recorded state before anything else looks at it, so the whole
+    // subsystem (scan, events, edge detection) sees the replayed input.
+    if (replay_fp)
+    {
+        if (replay_next_valid && replay_next_rec.poll <= poll_count)
+        {
+            memcpy(replay_data, replay_next_rec.data, sizeof(replay_data));
+            replay_next_valid = false;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            next.c[i].data = replay_data[i];
+            next.c[i].err = ERROR_NONE;
+        }
+    }
+
+    // While recording, buffer a record whenever the state of any port
+    // changed; controller_scan writes them out (no file I/O here, this
+    // runs under interrupt).
+    if (record_fp)
+    {
+        bool changed = false;
+        for (int i = 0; i < 4; i++)
+            changed |= (next.c[i].data != record_last[i]);
+        if (changed)
+        {
+            int next_widx = (record_widx + 1) % MAX_RECORD_PENDING;
+            if (next_widx == record_ridx)
+            {
+                record_dropped++;
+            }
+            else
+            {
+                controller_record_t *rec = &record_ring[record_widx];
+                rec->poll = poll_count;
+                for (int i = 0; i < 4; i++)
+                    rec->data[i] = record_last[i] = next.c[i].data;
+                record_widx = next_widx;
+            }
+        }
+    }
+
+    poll_count++;
+
+    // Detect button edges against the previous poll (not the previous
+    // controller_scan), so that presses shorter than a frame are still
+    // captured as events even when the game runs at a low frame rate.
+    uint32_t now = TICKS_READ();
+    for (int i = 0; i < 4; i++)
+    {
+        uint32_t old = last_sample.c[i].data, new = next.c[i].data;
+        uint32_t downs = (new & ~old) & CONTROLLER_BUTTON_MASK;
+        uint32_t ups = (~new & old) & CONTROLLER_BUTTON_MASK;
+        if (downs)
+            controller_push_event(i, true, downs >> 16, now);
+        if (ups)
+            controller_push_event(i, false, ups >> 16, now);
+    }
+    memcpy(&last_sample, (void*)&next, sizeof(struct controller_data));
 }
 
 static void controller_interrupt(void) 
@@ -111,21 +260,288 @@ void controller_init( void )
     memset(&prev, 0, sizeof(struct controller_data));
     memset(&current, 0, sizeof(struct controller_data));
     memset((void*)&next, 0, sizeof(struct controller_data));
+    memset(&last_sample, 0, sizeof(struct controller_data));
+    events_widx = events_ridx = 0;
     register_VI_handler(controller_interrupt);
     controller_inited = true;
 }
 
+/** @brief Timer callback driving the background poll at a custom rate */
+static void controller_poll_timer_cb(int ovfl)
+{
+    controller_interrupt();
+}
+
+/**
+ * @brief Change the rate of the background controller poll.
+ *
+ * By default, controllers are polled once per vertical blank (50/60 Hz),
+ * which ties input latency to the video refresh. This function switches
+ * the poll to a dedicated timer at the given frequency, decoupling input
+ * sampling from both the frame rate and the refresh rate. Polling faster
+ * than ~250 Hz gives diminishing returns as each full scan occupies the
+ * PIF for about 2 ms.
+ *
+ * Events captured by the poll are delivered via #controller_next_event;
+ * the #get_keys_down family keeps its frame-synchronous semantics based
+ * on #controller_scan.
+ *
+ * @note A custom rate requires the @ref timer "timer subsystem" to be
+ *       initialized.
+ *
+ * @param[in] hz   Poll frequency in Hertz (1-1000), or 0 to return to
+ *                 the default VI-driven poll.
+ */
+void controller_set_poll_rate( int hz )
+{
+    assertf(controller_inited, "controller_init() was not called");
+    assertf(hz >= 0 && hz <= 1000, "invalid poll rate: %d", hz);
+
+    if (hz == 0)
+    {
+        if (poll_timer)
+        {
+            delete_timer(poll_timer);
+            poll_timer = NULL;
+            register_VI_handler(controller_interrupt);
+        }
+        return;
+    }
+
+    if (poll_timer)
+    {
+        delete_timer(poll_timer);
+    }
+    else
+    {
+        unregister_VI_handler(controller_interrupt);
+    }
+    poll_timer = new_timer(TICKS_PER_SECOND / hz, TF_CONTINUOUS, controller_poll_timer_cb);
+    assertf(poll_timer != NULL, "controller_set_poll_rate requires timer_init");
+}
+
+/**
+ * @brief Fetch the next buffered input event, if any.
+ *
+ * Events are captured by the background poll whenever a button changes
+ * state, with a timestamp of the poll that observed the change. Unlike
+ * #get_keys_down / #get_keys_up, no edge is ever lost between frames:
+ * even a press shorter than a frame produces a press and a release
+ * event. Up to #MAX_CONTROLLER_EVENTS events are buffered; when the
+ * buffer overflows, the oldest events are dropped.
+ *
+ * @param[out] event   The oldest pending event
+ *
+ * @return True if an event was returned, false if the buffer is empty.
+ */
+bool controller_next_event( controller_event_t *event )
+{
+    assertf(controller_inited, "controller_init() was not called");
+
+    bool ret = false;
+    disable_interrupts();
+    if (events_ridx != events_widx)
+    {
+        *event = events[events_ridx];
+        events_ridx = (events_ridx + 1) % MAX_CONTROLLER_EVENTS;
+        ret = true;
+    }
+    enable_interrupts();
+    return ret;
+}
+
+/**
+ * @brief Write the buffered recording records out to the recording file.
+ *
+ * Called from thread context (#controller_scan or #controller_record_stop):
+ * the poll handler can only fill the ring, it cannot do file I/O.
+ */
+static void controller_record_drain( FILE *fp )
+{
+    while (record_ridx != record_widx)
+    {
+        fwrite(&record_ring[record_ridx], sizeof(controller_record_t), 1, fp);
+        record_ridx = (record_ridx + 1) % MAX_RECORD_PENDING;
+    }
+}
+
+/**
+ * @brief Read the next replay record ahead of the poll that needs it.
+ *
+ * Called from thread context; when the recording runs out, the replay
+ * stops itself and live input resumes.
+ */
+static void controller_replay_refill( void )
+{
+    if (replay_next_valid)
+        return;
+
+    controller_record_t rec;
+    if (fread(&rec, sizeof(rec), 1, replay_fp) == 1)
+    {
+        disable_interrupts();
+        replay_next_rec = rec;
+        replay_next_valid = true;
+        enable_interrupts();
+    }
+    else
+    {
+        controller_replay_stop();
+    }
+}
+
+/**
+ * @brief Start recording all controller input to a file.
+ *
+ * Every background poll at which the state of any port changes is
+ * appended to the file, indexed by poll number, so that the exact input
+ * sequence can later be re-injected with #controller_replay_start. The
+ * path can point anywhere a filesystem is mounted, typically the SD card
+ * or the debug USB filesystem (see #debug_init_sdfs / #debug_init_usblog).
+ *
+ * Records are buffered at poll time and written out during
+ * #controller_scan, so keep calling it once per frame while recording.
+ *
+ * @param[in] path   File to write the recording to
+ *
+ * @return True if the recording started, false if the file could not
+ *         be created.
+ */
+bool controller_record_start( const char *path )
+{
+    assertf(controller_inited, "controller_init() was not called");
+    assertf(record_fp == NULL, "input recording already in progress");
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return false;
+
+    const uint32_t magic = RECORD_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, fp);
+
+    disable_interrupts();
+    // Force the first poll to be recorded, whatever the state is
+    memset(record_last, 0xFF, sizeof(record_last));
+    record_widx = record_ridx = 0;
+    record_dropped = 0;
+    poll_count = 0;
+    record_fp = fp;
+    enable_interrupts();
+
+    return true;
+}
+
+/**
+ * @brief Stop recording controller input and close the recording file.
+ */
+void controller_record_stop( void )
+{
+    if (record_fp == NULL)
+        return;
+
+    disable_interrupts();
+    FILE *fp = record_fp;
+    record_fp = NULL;
+    enable_interrupts();
+
+    controller_record_drain(fp);
+    fclose(fp);
+
+    if (record_dropped > 0)
+        debugf("controller: %d input records lost (controller_scan called too rarely)\n",
+            record_dropped);
+}
+
+/**
+ * @brief Start replaying a recorded input stream.
+ *
+ * From the next background poll on, the whole controller subsystem
+ * (#controller_scan, #get_keys_down and friends, #controller_next_event,
+ * and direct #controller_read calls) sees the recorded input instead of
+ * the physical controllers. Records are applied at the same poll index
+ * they were captured on, so a scenario replays deterministically as long
+ * as the poll rate matches the one used while recording (see
+ * #controller_set_poll_rate).
+ *
+ * The replay stops by itself when the recording ends (live input then
+ * resumes), or when #controller_replay_stop is called. Keep calling
+ * #controller_scan once per frame while replaying: that is where the
+ * next records are read from the file.
+ *
+ * @param[in] path   File containing a recording made by
+ *                   #controller_record_start
+ *
+ * @return True if the replay started, false if the file could not be
+ *         opened or is not a valid recording.
+ */
+bool controller_replay_start( const char *path )
+{
+    assertf(controller_inited, "controller_init() was not called");
+    assertf(replay_fp == NULL, "input replay already in progress");
+
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return false;
+
+    uint32_t magic = 0;
+    controller_record_t first;
+    if (fread(&magic, sizeof(magic), 1, fp) != 1 || magic != RECORD_MAGIC
+        || fread(&first, sizeof(first), 1, fp) != 1)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    disable_interrupts();
+    replay_next_rec = first;
+    replay_next_valid = true;
+    memset(replay_data, 0, sizeof(replay_data));
+    poll_count = 0;
+    replay_fp = fp;
+    enable_interrupts();
+
+    return true;
+}
+
+/**
+ * @brief Stop an input replay and return to live controller input.
+ */
+void controller_replay_stop( void )
+{
+    if (replay_fp == NULL)
+        return;
+
+    disable_interrupts();
+    FILE *fp = replay_fp;
+    replay_fp = NULL;
+    replay_next_valid = false;
+    enable_interrupts();
+
+    fclose(fp);
+}
+
+/**
+ * @brief Check whether an input replay is currently running.
+ *
+ * @return True while recorded input is being injected; false once the
+ *         recording has run out or the replay was stopped.
+ */
+bool controller_replay_active( void )
+{
+    return replay_fp != NULL;
+}
+
 /**
  * @brief Read the controller button status for all controllers
  *
  * Read the controller button status immediately and return results to data.
- * 
+ *
  * @note This function is slow: it blocks for about 10% of a frame time. To avoid
  *       this hit, use the managed functions (#get_keys_down, etc.).
  *
  * @param[out] output
  *             Structure to place the returned controller button status
- *             
+ *
  */
 void controller_read( struct controller_data * output )
 {
@@ -142,6 +558,20 @@ void controller_read( struct controller_data * output )
     };
 
     joybus_exec( SI_read_con_block, output );
+
+    // Direct reads see the replayed input too, so code polling with
+    // controller_read replays just as deterministically as the managed
+    // functions.
+    disable_interrupts();
+    if (replay_fp)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            output->c[i].data = replay_data[i];
+            output->c[i].err = ERROR_NONE;
+        }
+    }
+    enable_interrupts();
 }
 
 /**
@@ -245,6 +675,13 @@ void controller_scan( void )
     disable_interrupts();
     memcpy(&current, (void*)&next, sizeof(struct controller_data));
     enable_interrupts();
+
+    // File I/O for recording and replay happens here, in thread context:
+    // the poll handler only touches the in-memory buffers.
+    if (record_fp)
+        controller_record_drain(record_fp);
+    if (replay_fp)
+        controller_replay_refill();
 }
 
 /**
@@ -484,6 +921,24 @@ static int __is_valid_accessory( uint32_t data )
     return 0;
 }
 
+/**
+ * @brief Joybus command block querying the status of all four ports
+ *
+ * Shared by the blocking #__get_accessories_present helper and the
+ * background accessory probe, which submits it asynchronously.
+ */
+static const unsigned long long SI_read_status_block[8] =
+{
+    0xff010300ffffffff,
+    0xff010300ffffffff,
+    0xff010300ffffffff,
+    0xff010300ffffffff,
+    0xfe00000000000000,
+    0,
+    0,
+    1
+};
+
 /**
  * @brief Query the PIF as to the status of accessories
  *
@@ -492,18 +947,6 @@ static int __is_valid_accessory( uint32_t data )
  */
 static void __get_accessories_present( struct controller_data *output )
 {
-    static const unsigned long long SI_read_status_block[8] =
-    {
-        0xff010300ffffffff,
-        0xff010300ffffffff,
-        0xff010300ffffffff,
-        0xff010300ffffffff,
-        0xfe00000000000000,
-        0,
-        0,
-        1
-    };
-
     joybus_exec( SI_read_status_block, output );
 }
 
@@ -691,6 +1134,165 @@ int read_mempak_address( int controller, uint16_t address, uint8_t *data )
     return ret;
 }
 
+/** @brief Number of in-flight joybus commands kept by #read_mempak_bulk */
+#define MEMPAK_BULK_WINDOW   4
+
+/** @brief State of the ongoing bulk mempak read (one at a time) */
+static struct {
+    int controller;             ///< Controller being read
+    uint16_t base_address;      ///< Mempak address of the first block
+    int total;                  ///< Total number of 32-byte blocks to read
+    int submitted;              ///< Blocks submitted to the joybus queue
+    volatile int completed;     ///< Blocks whose reply has been processed
+    volatile int error;         ///< First error encountered (0 = none)
+    uint8_t *data;              ///< Destination buffer
+    uint8_t cmd[64];            ///< PIF command template (address patched per block)
+    bool active;                ///< True while a bulk read is in progress
+} mempak_bulk;
+
+static void __mempak_bulk_callback(uint64_t *output, void *ctx);
+
+/**
+ * @brief Submit the next pending block of the bulk read to the joybus queue.
+ *
+ * @note Must be called with interrupts disabled (or from the SI interrupt).
+ */
+static void __mempak_bulk_submit(void)
+{
+    int idx = mempak_bulk.submitted++;
+    int c = mempak_bulk.controller;
+
+    /* Patch the address (with CRC) of this block into the command template.
+       joybus_exec_async copies the input block right away, so the template
+       can be safely reused for the next submission. */
+    uint16_t read_address = __calc_address_crc( mempak_bulk.base_address + idx * 32 );
+    mempak_bulk.cmd[c + 3] = (read_address >> 8) & 0xFF;
+    mempak_bulk.cmd[c + 4] = read_address & 0xFF;
+
+    joybus_exec_async( mempak_bulk.cmd, __mempak_bulk_callback, (void*)idx );
+}
+
+/**
+ * @brief Completion callback of one block of the bulk read.
+ *
+ * Verifies the data CRC, stores the payload, and keeps the PIF pipeline
+ * full by submitting the next block before the SI goes idle.
+ *
+ * @note This function is called under the SI interrupt.
+ */
+static void __mempak_bulk_callback(uint64_t *output, void *ctx)
+{
+    int idx = (int)ctx;
+    int c = mempak_bulk.controller;
+    uint8_t *payload = (uint8_t*)output + c + 5;
+
+    uint8_t crc = __calc_data_crc( payload );
+    if( crc == payload[32] )
+    {
+        memcpy( mempak_bulk.data + idx * 32, payload, 32 );
+    }
+    else if( !mempak_bulk.error )
+    {
+        /* Same error convention as read_mempak_address */
+        mempak_bulk.error = ( crc == (payload[32] ^ 0xFF) ) ? -2 : -3;
+    }
+
+    mempak_bulk.completed++;
+    if( !mempak_bulk.error && mempak_bulk.submitted < mempak_bulk.total )
+        __mempak_bulk_submit();
+}
+
+/**
+ * @brief Read a range of data from a mempak, keeping the PIF pipeline full.
+ *
+ * This function reads an arbitrary 32-byte aligned range from a mempak.
+ * Unlike looping over #read_mempak_address, several commands are kept
+ * in flight in the joybus queue at all times, so the next transfer is
+ * already prepared while the PIF processes the previous one; each block
+ * reply is CRC-verified as it arrives. A full 32 KiB pak read is roughly
+ * twice as fast as the one-command-at-a-time loop.
+ *
+ * The function blocks until the whole range has been read (interrupts
+ * must be enabled); the optional progress callback runs from normal
+ * context every time more blocks have completed, so it is safe to render
+ * a progress bar from it.
+ *
+ * @param[in]  controller
+ *             The controller (0-3) with the mempak to read from
+ * @param[in]  address
+ *             Start address (must be a multiple of 32)
+ * @param[in]  len
+ *             Number of bytes to read (must be a multiple of 32)
+ * @param[out] data
+ *             Buffer to place the read bytes
+ * @param[in]  progress
+ *             Optional callback invoked with (bytes_done, bytes_total)
+ *             as the read advances (can be NULL)
+ *
+ * @retval 0  if reading was successful
+ * @retval -1 if the parameters were invalid
+ * @retval -2 if the mempak was not present
+ * @retval -3 if the mempak returned corrupted data
+ */
+int read_mempak_bulk( int controller, uint16_t address, int len, uint8_t *data,
+    void (*progress)(int done, int total) )
+{
+    if( controller < 0 || controller > 3 ) { return -1; }
+    if( data == NULL ) { return -1; }
+    if( len <= 0 || (len & 31) || (address & 31) ) { return -1; }
+    /* The accessory address space is 16-bit: accessories like the Transfer
+       Pak map windows beyond the 32 KiB of a memory card (eg: 0xC000). */
+    if( (uint32_t)address + len > 0x10000 ) { return -1; }
+
+    assertf( !mempak_bulk.active, "only one bulk mempak transfer at a time" );
+    mempak_bulk.active = true;
+
+    /* Build the command template, identical to read_mempak_address */
+    memset( mempak_bulk.cmd, 0, 64 );
+    mempak_bulk.cmd[56] = 0xfe;
+    mempak_bulk.cmd[63] = 0x01;
+    mempak_bulk.cmd[controller]     = 0x03;
+    mempak_bulk.cmd[controller + 1] = 0x21;
+    mempak_bulk.cmd[controller + 2] = 0x02;
+    memset( &mempak_bulk.cmd[controller + 5], 0xFF, 33 );
+
+    mempak_bulk.controller = controller;
+    mempak_bulk.base_address = address;
+    mempak_bulk.total = len / 32;
+    mempak_bulk.submitted = 0;
+    mempak_bulk.completed = 0;
+    mempak_bulk.error = 0;
+    mempak_bulk.data = data;
+
+    /* Prime the pipeline with a window of commands; the SI interrupt
+       will keep it full from now on. */
+    disable_interrupts();
+    int window = MEMPAK_BULK_WINDOW < mempak_bulk.total ? MEMPAK_BULK_WINDOW : mempak_bulk.total;
+    for( int i = 0; i < window; i++ )
+        __mempak_bulk_submit();
+    enable_interrupts();
+
+    int last_done = 0;
+    while( 1 )
+    {
+        disable_interrupts();
+        int done = mempak_bulk.completed;
+        bool finished = ( done == mempak_bulk.submitted ) &&
+            ( mempak_bulk.error || mempak_bulk.submitted == mempak_bulk.total );
+        enable_interrupts();
+
+        if( progress && done != last_done )
+        {
+            progress( done * 32, len );
+            last_done = done;
+        }
+        if( finished ) { break; }
+    }
+
+    mempak_bulk.active = false;
+    return mempak_bulk.error;
+}
+
 /**
  * @brief Write a chunk of data to a mempak
  *
@@ -853,6 +1455,333 @@ int identify_accessory( int controller )
     return ACCESSORY_NONE;
 }
 
+/** @brief Interval in milliseconds between background accessory probes */
+#define ACCESSORY_PROBE_INTERVAL_MS 250
+
+/** @brief Cached accessory type per port (-1 if not yet identified) */
+static int accessory_cache[4] = { -1, -1, -1, -1 };
+/** @brief Accessory presence per port from the last status probe */
+static bool accessory_present[4] = { false, false, false, false };
+/** @brief Bitmask of ports whose accessory must be (re)identified */
+static uint8_t accessory_pending = 0;
+/** @brief True while a background status query or identify chain is in flight */
+static volatile bool accessory_probe_busy = false;
+/** @brief Timer driving the background accessory probe */
+static timer_link_t *accessory_probe_timer = NULL;
+/** @brief Callback notified of accessory insertions and removals */
+static void (*accessory_callback)( int controller, int accessory ) = NULL;
+
+/** @brief State of the in-flight background identify chain */
+static struct {
+    int controller;     ///< Port being identified
+    int step;           ///< Current step of the probe sequence
+    bool seen_0x84;     ///< Transfer Pak power probe pattern read back
+} accessory_chain;
+
+/**
+ * @brief Record a new accessory state for a port and notify the callback.
+ *
+ * Invoked from the SI interrupt by the background probe (and from normal
+ * context by #identify_accessory_cached when warming a cold cache entry).
+ */
+static void __accessory_update( int controller, int accessory )
+{
+    extern void __mempak_shadow_invalidate( int controller );
+
+    int prev = accessory_cache[controller];
+    if( prev == accessory ) { return; }
+
+    accessory_cache[controller] = accessory;
+
+    /* The mempak shadow image (if any) describes whatever pak just left */
+    __mempak_shadow_invalidate( controller );
+
+    /* Don't report an absent accessory on the very first probe */
+    if( prev < 0 && accessory == ACCESSORY_NONE ) { return; }
+
+    if( accessory_callback ) { accessory_callback( controller, accessory ); }
+}
+
+static void __accessory_chain_callback( uint64_t *output, void *ctx );
+
+/**
+ * @brief Submit one write step of the background identify chain.
+ *
+ * Asynchronous equivalent of the #write_mempak_address calls performed
+ * by #identify_accessory, always targeting the 0x8000 probe register.
+ */
+static void __accessory_chain_write( uint8_t fill )
+{
+    uint64_t block_dw[8] = { 0 };
+    uint8_t *block = (uint8_t *)block_dw;
+    int controller = accessory_chain.controller;
+
+    block[56] = 0xfe;
+    block[63] = 0x01;
+    block[controller]     = 0x23;
+    block[controller + 1] = 0x01;
+    block[controller + 2] = 0x03;
+    uint16_t write_address = __calc_address_crc( 0x8000 );
+    block[controller + 3] = (write_address >> 8) & 0xFF;
+    block[controller + 4] = write_address & 0xFF;
+    memset( &block[controller + 5], fill, 32 );
+    block[controller + 5 + 32] = 0xFF;
+
+    joybus_exec_async( block_dw, __accessory_chain_callback, NULL );
+}
+
+/**
+ * @brief Submit one read step of the background identify chain.
+ *
+ * Asynchronous equivalent of the #read_mempak_address calls performed
+ * by #identify_accessory, always targeting the 0x8000 probe register.
+ */
+static void __accessory_chain_read( void )
+{
+    uint64_t block_dw[8] = { 0 };
+    uint8_t *block = (uint8_t *)block_dw;
+    int controller = accessory_chain.controller;
+
+    block[56] = 0xfe;
+    block[63] = 0x01;
+    block[controller]     = 0x03;
+    block[controller + 1] = 0x21;
+    block[controller + 2] = 0x02;
+    uint16_t read_address = __calc_address_crc( 0x8000 );
+    block[controller + 3] = (read_address >> 8) & 0xFF;
+    block[controller + 4] = read_address & 0xFF;
+    memset( &block[controller + 5], 0xFF, 33 );
+
+    joybus_exec_async( block_dw, __accessory_chain_callback, NULL );
+}
+
+/**
+ * @brief Submit the next step of the background identify chain.
+ *
+ * The sequence mirrors #identify_accessory: two init-string writes and a
+ * readback to separate rumble paks from the mempak family, then the
+ * Transfer Pak power probe (write 0x84, read, write 0xfe, read).
+ */
+static void __accessory_chain_advance( void )
+{
+    switch( accessory_chain.step )
+    {
+        case 0: __accessory_chain_write( 0xfe ); break;
+        case 1: __accessory_chain_write( 0x80 ); break;
+        case 2: __accessory_chain_read(); break;
+        case 3: __accessory_chain_write( 0x84 ); break;
+        case 4: __accessory_chain_read(); break;
+        case 5: __accessory_chain_write( 0xfe ); break;
+        case 6: __accessory_chain_read(); break;
+    }
+}
+
+/**
+ * @brief Joybus completion callback of the background identify chain.
+ *
+ * Runs under the SI interrupt. Classifies the accessory as soon as the
+ * probe readbacks allow it and updates the cache, releasing the probe
+ * engine for the next cycle.
+ */
+static void __accessory_chain_callback( uint64_t *output, void *ctx )
+{
+    uint8_t *bytes = (uint8_t *)output;
+    int controller = accessory_chain.controller;
+    int step = accessory_chain.step;
+
+    if( step == 2 || step == 4 || step == 6 )
+    {
+        uint8_t *data = &bytes[controller + 5];
+
+        if( __calc_data_crc( data ) != data[32] )
+        {
+            /* Pak vanished mid-probe: report it absent and give up */
+            accessory_present[controller] = false;
+            __accessory_update( controller, ACCESSORY_NONE );
+            accessory_probe_busy = false;
+            return;
+        }
+
+        if( step == 2 )
+        {
+            if( data[0] == 0x80 )
+            {
+                __accessory_update( controller, ACCESSORY_RUMBLEPAK );
+                accessory_probe_busy = false;
+                return;
+            }
+            /* Mempak or Transfer Pak: continue with the power probe */
+        }
+        else if( step == 4 )
+        {
+            accessory_chain.seen_0x84 = (data[0] == 0x84);
+        }
+        else /* step == 6 */
+        {
+            bool tpak = accessory_chain.seen_0x84 && (data[0] == 0x00);
+            __accessory_update( controller, tpak ? ACCESSORY_TRANSFERPAK : ACCESSORY_MEMPAK );
+            accessory_probe_busy = false;
+            return;
+        }
+    }
+
+    accessory_chain.step++;
+    __accessory_chain_advance();
+}
+
+/**
+ * @brief Joybus completion callback of the background status query.
+ *
+ * Runs under the SI interrupt. Detects accessory insertions and removals
+ * by comparing the status response against the previous probe, then
+ * starts an identify chain for (at most) one newly-inserted accessory.
+ */
+static void __accessory_status_callback( uint64_t *output, void *ctx )
+{
+    struct controller_data *status = (struct controller_data *)output;
+
+    for( int i = 0; i < 4; i++ )
+    {
+        bool present = (status->c[i].err == ERROR_NONE)
+            && __is_valid_accessory( status->c[i].data );
+
+        if( !present )
+        {
+            accessory_present[i] = false;
+            accessory_pending &= ~(1 << i);
+            __accessory_update( i, ACCESSORY_NONE );
+            continue;
+        }
+
+        if( !accessory_present[i] || accessory_cache[i] < 0 )
+        {
+            accessory_pending |= (1 << i);
+        }
+        accessory_present[i] = true;
+
+        /* The VRU identifies itself directly in the status response */
+        if( ((status->c[i].data >> 8) & 0xFFFF) == 0x0100 )
+        {
+            accessory_pending &= ~(1 << i);
+            __accessory_update( i, ACCESSORY_VRU );
+        }
+    }
+
+    /* Identify one pending port per probe cycle */
+    for( int i = 0; i < 4; i++ )
+    {
+        if( accessory_pending & (1 << i) )
+        {
+            accessory_pending &= ~(1 << i);
+            accessory_chain.controller = i;
+            accessory_chain.step = 0;
+            accessory_chain.seen_0x84 = false;
+            __accessory_chain_advance();
+            return; /* Probe stays busy until the chain completes */
+        }
+    }
+
+    accessory_probe_busy = false;
+}
+
+/**
+ * @brief Timer tick that starts a background accessory probe cycle.
+ */
+static void __accessory_probe_tick( int ovfl )
+{
+    if( accessory_probe_busy ) { return; }
+
+    accessory_probe_busy = true;
+    joybus_exec_async( SI_read_status_block, __accessory_status_callback, NULL );
+}
+
+/**
+ * @brief Start the background accessory probe.
+ *
+ * Queries accessory presence on all four ports every
+ * #ACCESSORY_PROBE_INTERVAL_MS milliseconds through asynchronous Joybus
+ * transactions, and runs the full identify sequence whenever a port's
+ * accessory changes. The results are served by #identify_accessory_cached
+ * and reported through #accessory_changed_callback, so checking for a
+ * rumble pak before firing feedback no longer costs a Joybus round-trip.
+ *
+ * The Timer Subsystem must be initialized with #timer_init before
+ * starting the probe.
+ */
+void accessory_probe_start( void )
+{
+    if( accessory_probe_timer != NULL ) { return; }
+
+    accessory_probe_timer = new_timer(
+        TICKS_FROM_MS( ACCESSORY_PROBE_INTERVAL_MS ),
+        TF_CONTINUOUS, __accessory_probe_tick );
+}
+
+/**
+ * @brief Stop the background accessory probe.
+ *
+ * Cached accessory state is kept but no longer refreshed, and no further
+ * change callbacks will fire.
+ */
+void accessory_probe_stop( void )
+{
+    if( accessory_probe_timer == NULL ) { return; }
+
+    delete_timer( accessory_probe_timer );
+    accessory_probe_timer = NULL;
+}
+
+/**
+ * @brief Register a callback for accessory insertions and removals.
+ *
+ * The callback is invoked by the background probe (see
+ * #accessory_probe_start) whenever the identified accessory of a port
+ * changes, with the port number and the new #ACCESSORY_NONE,
+ * #ACCESSORY_MEMPAK, #ACCESSORY_RUMBLEPAK, #ACCESSORY_TRANSFERPAK or
+ * #ACCESSORY_VRU value. It runs in interrupt context; keep it short.
+ *
+ * @param[in] callback
+ *            Function called on accessory changes (NULL to unregister)
+ */
+void accessory_changed_callback( void (*callback)( int controller, int accessory ) )
+{
+    accessory_callback = callback;
+}
+
+/**
+ * @brief Return the cached accessory type for a controller port.
+ *
+ * Cheap (cache-lookup) alternative to #identify_accessory, backed by the
+ * background probe started with #accessory_probe_start. If the cache for
+ * the port is still cold and the probe is not running, this falls back
+ * to a blocking #identify_accessory call; if the probe is running, the
+ * cache warms within one probe interval.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to inspect
+ *
+ * @return the #ACCESSORY_NONE, #ACCESSORY_MEMPAK, #ACCESSORY_RUMBLEPAK,
+ *         #ACCESSORY_TRANSFERPAK or #ACCESSORY_VRU value for the port
+ */
+int identify_accessory_cached( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return ACCESSORY_NONE; }
+
+    int cached = accessory_cache[controller];
+    if( cached >= 0 ) { return cached; }
+
+    /* Cold cache with the probe running: it warms within one interval.
+       Don't issue a blocking probe that would interleave with the
+       background identify chain. */
+    if( accessory_probe_timer != NULL ) { return ACCESSORY_NONE; }
+
+    cached = identify_accessory( controller );
+    accessory_present[controller] = (cached != ACCESSORY_NONE);
+    __accessory_update( controller, cached );
+
+    return cached;
+}
+
 /**
  * @brief Turn rumble on for a particular controller
  *
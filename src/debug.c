@@ -21,12 +21,15 @@
 #include "usb.h"
 #include "utils.h"
 #include "interrupt.h"
+#include "timer.h"
 #include "backtrace.h"
 #include "exception_internal.h"
 #include "libcart/cart.h"
 #include "fatfs/ff.h"
 #include "fatfs/ffconf.h"
 #include "fatfs/diskio.h"
+#include "fat_cache_internal.h"
+#include "fat_wb_internal.h"
 
 /**
  * @defgroup debug Debugging Support
@@ -134,6 +137,141 @@ static void sdlog_write(const uint8_t *data, int len)
 	fwrite(data, 1, len, sdlog_file);
 }
 
+/*********************************************************************
+ * Deferred logging
+ *********************************************************************/
+
+/** @brief Deferred log record containing text (flushed to all writers) */
+#define DEFER_RECORD_TEXT      1
+/** @brief Deferred log record containing a binary event (flushed to USB) */
+#define DEFER_RECORD_BIN       2
+
+/** @brief Maximum bytes drained from the deferred ring per flusher tick */
+#define DEFER_FLUSH_CHUNK      512
+/** @brief Interval in milliseconds between background flusher ticks */
+#define DEFER_FLUSH_INTERVAL_MS 5
+
+/** @brief Deferred log ring buffer (NULL if deferred logging is off) */
+static uint8_t *defer_buf = NULL;
+/** @brief Size of the deferred log ring buffer */
+static int defer_size = 0;
+/** @brief Ring write index (next free byte) */
+static volatile int defer_widx = 0;
+/** @brief Ring read index (next byte to flush) */
+static volatile int defer_ridx = 0;
+/** @brief Bytes dropped because the ring was full */
+static volatile int defer_dropped = 0;
+/** @brief Timer driving the background flusher */
+static timer_link_t *defer_timer = NULL;
+
+/**
+ * @brief Append one record to the deferred log ring.
+ *
+ * Each record is framed as [type:1][len:2][payload] so that the flusher
+ * can route text and binary records to different backends. The only
+ * critical section is the index update, so this is cheap enough for hot
+ * paths and safe from interrupt context. If the ring is full the record
+ * is dropped and accounted, and the flusher emits a loss marker later.
+ */
+static void __defer_append(uint8_t type, const uint8_t *data, int len)
+{
+	disable_interrupts();
+
+	int used = (defer_widx - defer_ridx + defer_size) % defer_size;
+	if (used + len + 3 >= defer_size)
+	{
+		defer_dropped += len;
+		enable_interrupts();
+		return;
+	}
+
+	int widx = defer_widx;
+	uint8_t hdr[3] = { type, len >> 8, len & 0xFF };
+	for (int i=0; i<3; i++)
+	{
+		defer_buf[widx] = hdr[i];
+		widx = (widx + 1) % defer_size;
+	}
+	for (int i=0; i<len; i++)
+	{
+		defer_buf[widx] = data[i];
+		widx = (widx + 1) % defer_size;
+	}
+	defer_widx = widx;
+
+	enable_interrupts();
+}
+
+/**
+ * @brief Drain up to @p budget bytes worth of records from the ring.
+ *
+ * Records are copied out of the ring under disabled interrupts, but the
+ * (potentially slow) backend writes happen outside the critical section,
+ * so producers are never blocked on the cart link.
+ */
+static void __defer_drain(int budget)
+{
+	uint8_t payload[DEFER_FLUSH_CHUNK];
+
+	while (budget > 0)
+	{
+		disable_interrupts();
+
+		if (defer_dropped)
+		{
+			int dropped = defer_dropped;
+			defer_dropped = 0;
+			enable_interrupts();
+
+			char marker[48];
+			int mlen = snprintf(marker, sizeof(marker),
+				"[debug] log ring overflow: %d bytes lost\n", dropped);
+			for (int i=0; i<sizeof(debug_writer) / sizeof(debug_writer[0]); i++)
+				if (debug_writer[i])
+					debug_writer[i]((uint8_t*)marker, mlen);
+			continue;
+		}
+
+		if (defer_ridx == defer_widx)
+		{
+			enable_interrupts();
+			return;
+		}
+
+		int ridx = defer_ridx;
+		uint8_t type = defer_buf[ridx]; ridx = (ridx + 1) % defer_size;
+		int len  = defer_buf[ridx] << 8; ridx = (ridx + 1) % defer_size;
+		len     |= defer_buf[ridx]; ridx = (ridx + 1) % defer_size;
+		for (int i=0; i<len; i++)
+		{
+			payload[i] = defer_buf[ridx];
+			ridx = (ridx + 1) % defer_size;
+		}
+		defer_ridx = ridx;
+
+		enable_interrupts();
+
+		if (type == DEFER_RECORD_TEXT)
+		{
+			for (int i=0; i<sizeof(debug_writer) / sizeof(debug_writer[0]); i++)
+				if (debug_writer[i])
+					debug_writer[i](payload, len);
+		}
+		else if (type == DEFER_RECORD_BIN && (enabled_features & DEBUG_FEATURE_LOG_USB))
+		{
+			usb_write(DATATYPE_RAWBINARY, payload, len);
+		}
+
+		budget -= len + 3;
+	}
+}
+
+/** @brief Background flusher tick: drain a bounded chunk of the ring */
+static void __defer_flush_tick(int ovfl)
+{
+	__defer_drain(DEFER_FLUSH_CHUNK);
+}
+
 /*********************************************************************
  * FAT backend
  *********************************************************************/
@@ -224,35 +362,62 @@ DWORD get_fattime(void)
 
 static DSTATUS fat_disk_status_default(void) { return 0; }
 
-static DRESULT fat_disk_ioctl_default(BYTE cmd, void* buff)
+static DSTATUS fat_disk_initialize_sd(void)
 {
-	switch (cmd)
-	{
-		case CTRL_SYNC: return RES_OK;
-		default:        return RES_PARERR;
-	}
+	return cart_card_init() ? STA_NOINIT : 0;
 }
 
-static DSTATUS fat_disk_initialize_sd(void)
+static DRESULT fat_disk_read_sd_raw(BYTE* buff, LBA_t sector, UINT count)
 {
-	return cart_card_init() ? STA_NOINIT : 0;
+	return cart_card_rd_dram(buff, sector, count) ? RES_ERROR : RES_OK;
 }
 
 static DRESULT fat_disk_read_sd(BYTE* buff, LBA_t sector, UINT count)
 {
-	return cart_card_rd_dram(buff, sector, count) ? RES_ERROR : RES_OK;
+	// A read overlapping queued dirty sectors must not see stale data:
+	// drain the write-behind queue first (rare: write-then-read-back)
+	if (__fat_wb_active() && __fat_wb_overlaps(sector, count))
+		__fat_wb_sync();
+	return __fat_cache_read(buff, sector, count);
+}
+
+static int fat_disk_queue_sd(BYTE* buff, LBA_t sector, UINT count,
+	void (*callback)(void *ctx, int result), void *ctx)
+{
+	return cart_card_rd_queue(buff, sector, count, callback, ctx);
 }
 
 static DRESULT fat_disk_read_sdram_sd(BYTE* buff, LBA_t sector, UINT count)
 {
+	if (__fat_wb_active() && __fat_wb_overlaps(sector, count))
+		__fat_wb_sync();
 	return cart_card_rd_cart(PhysicalAddr(buff), sector, count) ? RES_ERROR : RES_OK;
 }
 
-static DRESULT fat_disk_write_sd(const BYTE* buff, LBA_t sector, UINT count)
+static DRESULT fat_disk_write_sd_raw(const BYTE* buff, LBA_t sector, UINT count)
 {
 	return cart_card_wr_dram(buff, sector, count) ? RES_ERROR : RES_OK;
 }
 
+static DRESULT fat_disk_write_sd(const BYTE* buff, LBA_t sector, UINT count)
+{
+	__fat_cache_invalidate(sector, count);
+	if (__fat_wb_active())
+		return __fat_wb_write(buff, sector, count);
+	return fat_disk_write_sd_raw(buff, sector, count);
+}
+
+static DRESULT fat_disk_ioctl_sd(BYTE cmd, void* buff)
+{
+	switch (cmd)
+	{
+		// f_sync/f_close end up here: a sync checkpoint must be on the
+		// card when it returns, so drain the write-behind queue
+		case CTRL_SYNC: return __fat_wb_active() ? __fat_wb_sync() : RES_OK;
+		default:        return RES_PARERR;
+	}
+}
+
 static fat_disk_t fat_disk_sd =
 {
 	fat_disk_initialize_sd,
@@ -260,7 +425,7 @@ static fat_disk_t fat_disk_sd =
 	fat_disk_read_sd,
 	fat_disk_read_sdram_sd,
 	fat_disk_write_sd,
-	fat_disk_ioctl_default
+	fat_disk_ioctl_sd
 };
 
 /*********************************************************************
@@ -272,6 +437,11 @@ static fat_disk_t fat_disk_sd =
 static FIL fat_files[MAX_FAT_FILES] = {0};
 static DIR find_dir;
 
+/** Length of the per-file cluster link map (fast seek); supports up to
+    (FAT_CLMT_LEN-2)/2 fragments per file. */
+#define FAT_CLMT_LEN 64
+static DWORD fat_clmt[MAX_FAT_FILES][FAT_CLMT_LEN];
+
 static void *__fat_open(char *name, int flags)
 {
 	int i;
@@ -306,6 +476,19 @@ static void *__fat_open(char *name, int flags)
 		fat_files[i].obj.fs = NULL;
 		return NULL;
 	}
+
+	if ((flags & O_ACCMODE) == O_RDONLY)
+	{
+		// Fast-seek mode: build the cluster link map once, so that seeks
+		// don't walk the FAT chain from the start of the file every time.
+		// Files more fragmented than the table can describe fall back to
+		// normal seeks (fast-seek also forbids growing a file, hence
+		// read-only files only).
+		fat_files[i].cltbl = fat_clmt[i];
+		fat_clmt[i][0] = FAT_CLMT_LEN;
+		if (f_lseek(&fat_files[i], CREATE_LINKMAP) != FR_OK)
+			fat_files[i].cltbl = NULL;
+	}
 	return &fat_files[i];
 }
 
@@ -450,6 +633,27 @@ static bool usb_initialize_once(void) {
 
 static int __stderr_write(char *buf, unsigned int len)
 {
+	// Feed the flight recorder's log-tail ring (no-op if not enabled).
+	// This happens before any deferral so the ring is always current.
+	extern void __flightrec_log(const uint8_t *buf, int len);
+	__flightrec_log((uint8_t*)buf, len);
+
+	if (defer_buf)
+	{
+		// Deferred mode: append to the ring (splitting lines longer than
+		// the flush chunk) and let the background flusher hit the wire.
+		uint8_t *data = (uint8_t*)buf;
+		unsigned int left = len;
+		while (left > 0)
+		{
+			unsigned int l = left < DEFER_FLUSH_CHUNK ? left : DEFER_FLUSH_CHUNK;
+			__defer_append(DEFER_RECORD_TEXT, data, l);
+			data += l;
+			left -= l;
+		}
+		return len;
+	}
+
 	for (int i=0; i<sizeof(debug_writer) / sizeof(debug_writer[0]); i++)
 		if (debug_writer[i])
 			debug_writer[i]((uint8_t*)buf, len);
@@ -500,6 +704,63 @@ bool debug_init_isviewer(void)
 	return true;
 }
 
+bool debug_init_deferred(int bufsize)
+{
+	if (defer_buf)
+		return true;
+	if (bufsize < DEFER_FLUSH_CHUNK * 2)
+		bufsize = DEFER_FLUSH_CHUNK * 2;
+
+	uint8_t *buf = malloc(bufsize);
+	if (!buf)
+		return false;
+
+	hook_init_once();
+
+	disable_interrupts();
+	defer_size = bufsize;
+	defer_widx = defer_ridx = defer_dropped = 0;
+	defer_buf = buf;
+	enable_interrupts();
+
+	// Background flusher; bounded work per tick so the interrupt stays short
+	defer_timer = new_timer(TICKS_FROM_MS(DEFER_FLUSH_INTERVAL_MS),
+		TF_CONTINUOUS, __defer_flush_tick);
+
+	return true;
+}
+
+void debug_flush(void)
+{
+	if (!defer_buf)
+		return;
+	while (defer_ridx != defer_widx || defer_dropped)
+		__defer_drain(DEFER_FLUSH_CHUNK);
+}
+
+void debug_binlog(uint16_t code, int nargs, const uint32_t *args)
+{
+	assertf(nargs >= 0 && nargs <= 8, "invalid binary log arity: %d", nargs);
+
+	uint8_t record[3 + 8*4];
+	record[0] = code >> 8;
+	record[1] = code & 0xFF;
+	record[2] = nargs;
+	for (int i=0; i<nargs; i++)
+	{
+		record[3 + i*4 + 0] = args[i] >> 24;
+		record[3 + i*4 + 1] = args[i] >> 16;
+		record[3 + i*4 + 2] = args[i] >> 8;
+		record[3 + i*4 + 3] = args[i];
+	}
+	int len = 3 + nargs*4;
+
+	if (defer_buf)
+		__defer_append(DEFER_RECORD_BIN, record, len);
+	else if (enabled_features & DEBUG_FEATURE_LOG_USB)
+		usb_write(DATATYPE_RAWBINARY, record, len);
+}
+
 bool debug_init_sdlog(const char *fn, const char *openfmt)
 {
 	sdlog_file = fopen(fn, openfmt);
@@ -518,6 +779,11 @@ bool debug_init_sdfs(const char *prefix, int npart)
 
 	fat_disks[FAT_VOLUME_SD] = fat_disk_sd;
 
+	// Sector cache between FatFS and the cart driver. If allocation
+	// fails, reads transparently fall through to the card.
+	__fat_cache_init(fat_disk_read_sd_raw, 0);
+	__fat_cache_set_async(fat_disk_queue_sd, cart_card_rd_flush);
+
 	if (npart >= 0) {
 		sdfs_logic_drive[0] = '0' + npart;
 		sdfs_logic_drive[1] = ':';
@@ -530,24 +796,100 @@ bool debug_init_sdfs(const char *prefix, int npart)
 	if (res != FR_OK)
 	{
 		debugf("Cannot mount SD FAT filesystem: %d\n", res);
+		__fat_cache_close();
 		return false;
 	}
 
+	// Pin FAT sectors now that we know where the FAT region lives
+	__fat_cache_set_fat_range(sd_fat.fatbase, sd_fat.database);
+
 	strlcpy(sdfs_prefix, prefix, sizeof(sdfs_prefix));
 	attach_filesystem(sdfs_prefix, &fat_fs);
 	enabled_features |= DEBUG_FEATURE_FILE_SD;
 	return true;
 }
 
+/** @brief Strip the filesystem prefix (eg: "sd:/") from a path, if present */
+static const char *sdfs_strip_prefix(const char *fn)
+{
+	int l = strlen(sdfs_prefix);
+	if (l > 0 && strncmp(fn, sdfs_prefix, l) == 0)
+		return fn + l;
+	return fn;
+}
+
+bool debug_sdfs_sectors(const char *fn, uint32_t *first_lba, uint32_t *num_sectors)
+{
+	if (!(enabled_features & DEBUG_FEATURE_FILE_SD))
+		return false;
+
+	FIL f;
+	if (f_open(&f, sdfs_strip_prefix(fn), FA_READ) != FR_OK)
+		return false;
+
+	// Build a tiny cluster link map: a contiguous file needs exactly one
+	// fragment, that is 4 items (count, length, start, terminator). A more
+	// fragmented file overflows the table, which is fine: we only need to
+	// know whether there is a single fragment, and where it starts.
+	DWORD clmt[8];
+	f.cltbl = clmt;
+	clmt[0] = sizeof(clmt) / sizeof(clmt[0]);
+	FRESULT res = f_lseek(&f, CREATE_LINKMAP);
+	bool contiguous = (res == FR_OK && clmt[0] == 4);
+	if (contiguous)
+	{
+		FATFS *fs = f.obj.fs;
+		if (first_lba)
+			*first_lba = fs->database + (uint32_t)fs->csize * (clmt[2] - 2);
+		if (num_sectors)
+			*num_sectors = (f_size(&f) + 511) / 512;
+	}
+	f_close(&f);
+	return contiguous;
+}
+
+bool debug_sdfs_preallocate(const char *fn, uint32_t size)
+{
+	if (!(enabled_features & DEBUG_FEATURE_FILE_SD) || size == 0)
+		return false;
+
+	// f_expand only works on empty files, so this truncates
+	FIL f;
+	if (f_open(&f, sdfs_strip_prefix(fn), FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+		return false;
+	bool ok = f_expand(&f, size, 1) == FR_OK;
+	f_close(&f);
+	return ok;
+}
+
 void debug_close_sdfs(void)
 {
 	if (enabled_features & DEBUG_FEATURE_FILE_SD)
 	{
 		detach_filesystem(sdfs_prefix);
 		f_mount(NULL, sdfs_logic_drive, 0);
+		__fat_wb_close();
+		__fat_cache_close();
 	}
 }
 
+bool debug_sdfs_writeback(int num_sectors)
+{
+	if (!(enabled_features & DEBUG_FEATURE_FILE_SD))
+		return false;
+	return __fat_wb_init(fat_disk_write_sd_raw, num_sectors);
+}
+
+void debug_sdfs_poll(void)
+{
+	__fat_wb_poll();
+}
+
+bool debug_sdfs_sync(void)
+{
+	return __fat_wb_sync() == RES_OK;
+}
+
 void debug_assert_func_f(const char *file, int line, const char *func, const char *failedexpr, const char *msg, ...)
 {
 	disable_interrupts();
@@ -4,10 +4,15 @@
  */
 
 #include "debug.h"
+#include "debugcpp.h"
 #include "exception_internal.h"
+#include "interrupt.h"
 #include <exception>
 #include <cxxabi.h>
 #include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <new>
 
 static void terminate_handler(void)
 {
@@ -33,6 +38,222 @@ static void terminate_handler(void)
     }    
 }
 
+/*********************************************************************
+ * Pool-backed operator new/delete
+ *********************************************************************/
+
+/** @brief Size classes served by the pools (chunk sizes in bytes) */
+static const int pool_class_size[] = { 16, 32, 64, 128, 256 };
+#define POOL_NUM_CLASSES (int)(sizeof(pool_class_size) / sizeof(pool_class_size[0]))
+
+/** @brief One per-size-class pool */
+typedef struct
+{
+    uint8_t *base;              ///< Start of the chunk slab
+    uint8_t *end;               ///< First byte past the slab
+    void *freelist;             ///< Singly-linked list threaded through free chunks
+    uint32_t *owner;            ///< Allocation site per chunk (0 = free), for leak reports
+    int chunk_size;             ///< Size of each chunk in bytes
+    int total_chunks;           ///< Number of chunks in the slab
+    uint32_t alloc_count;       ///< Total allocations served
+    int live;                   ///< Currently outstanding allocations
+    int live_peak;              ///< High-water mark of outstanding allocations
+} pool_class_t;
+
+static pool_class_t pool_classes[POOL_NUM_CLASSES];
+static bool pools_enabled = false;
+static uint32_t pool_fallbacks = 0;
+
+bool debug_cpp_pools_init(int pool_bytes)
+{
+    if (pools_enabled)
+        return true;
+    if (pool_bytes < POOL_NUM_CLASSES * 1024)
+        pool_bytes = POOL_NUM_CLASSES * 1024;
+
+    // Split the budget evenly across the size classes; the slab of each
+    // class is carved into chunks threaded on a free list.
+    int per_class = pool_bytes / POOL_NUM_CLASSES;
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        pool_class_t *pc = &pool_classes[c];
+        pc->chunk_size = pool_class_size[c];
+        pc->total_chunks = per_class / pc->chunk_size;
+        pc->base = (uint8_t*)malloc(pc->total_chunks * pc->chunk_size);
+        pc->owner = (uint32_t*)calloc(pc->total_chunks, sizeof(uint32_t));
+        if (!pc->base || !pc->owner)
+        {
+            for (int i = 0; i <= c; i++)
+            {
+                free(pool_classes[i].base); pool_classes[i].base = NULL;
+                free(pool_classes[i].owner); pool_classes[i].owner = NULL;
+            }
+            return false;
+        }
+        pc->end = pc->base + pc->total_chunks * pc->chunk_size;
+        pc->freelist = NULL;
+        for (int i = pc->total_chunks - 1; i >= 0; i--)
+        {
+            void *chunk = pc->base + i * pc->chunk_size;
+            *(void**)chunk = pc->freelist;
+            pc->freelist = chunk;
+        }
+        pc->alloc_count = 0;
+        pc->live = pc->live_peak = 0;
+    }
+    pool_fallbacks = 0;
+    pools_enabled = true;
+    return true;
+}
+
+/** @brief Serve an allocation from the smallest class that has a free chunk */
+static void* pool_alloc(size_t size, uint32_t caller)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        pool_class_t *pc = &pool_classes[c];
+        if (size > (size_t)pc->chunk_size)
+            continue;
+        disable_interrupts();
+        void *p = pc->freelist;
+        if (p)
+        {
+            pc->freelist = *(void**)p;
+            pc->owner[((uint8_t*)p - pc->base) / pc->chunk_size] = caller;
+            pc->alloc_count++;
+            if (++pc->live > pc->live_peak)
+                pc->live_peak = pc->live;
+        }
+        enable_interrupts();
+        if (p)
+            return p;
+        // Class exhausted: overflow into the next larger one
+    }
+    pool_fallbacks++;
+    return NULL;
+}
+
+/** @brief Return a chunk to its pool; false if the pointer is not pooled */
+static bool pool_free(void *ptr)
+{
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        pool_class_t *pc = &pool_classes[c];
+        if ((uint8_t*)ptr < pc->base || (uint8_t*)ptr >= pc->end)
+            continue;
+        disable_interrupts();
+        pc->owner[((uint8_t*)ptr - pc->base) / pc->chunk_size] = 0;
+        *(void**)ptr = pc->freelist;
+        pc->freelist = ptr;
+        pc->live--;
+        enable_interrupts();
+        return true;
+    }
+    return false;
+}
+
+void debug_cpp_pools_stats(void)
+{
+    if (!pools_enabled)
+    {
+        debugf("[debugcpp] pools not enabled\n");
+        return;
+    }
+    debugf("[debugcpp] C++ pool statistics:\n");
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        pool_class_t *pc = &pool_classes[c];
+        debugf("  %4d B: %5d chunks, %8ld allocs, live %5d (peak %5d)\n",
+            pc->chunk_size, pc->total_chunks,
+            (unsigned long)pc->alloc_count, pc->live, pc->live_peak);
+    }
+    debugf("  malloc fallbacks: %ld\n", (unsigned long)pool_fallbacks);
+}
+
+int debug_cpp_pools_leaks(void)
+{
+    if (!pools_enabled)
+        return 0;
+    enum { MAX_REPORT = 32 };
+    int leaks = 0;
+    for (int c = 0; c < POOL_NUM_CLASSES; c++)
+    {
+        pool_class_t *pc = &pool_classes[c];
+        for (int i = 0; i < pc->total_chunks; i++)
+        {
+            if (!pc->owner[i])
+                continue;
+            leaks++;
+            if (leaks <= MAX_REPORT)
+                debugf("[debugcpp] leak: %d bytes at %p, allocated from %p\n",
+                    pc->chunk_size, pc->base + i * pc->chunk_size,
+                    (void*)pc->owner[i]);
+        }
+    }
+    if (leaks > MAX_REPORT)
+        debugf("[debugcpp] ... and %d more\n", leaks - MAX_REPORT);
+    if (leaks)
+        debugf("[debugcpp] %d outstanding pool allocation(s)\n", leaks);
+    return leaks;
+}
+
+/* Global operator new/delete replacements. These are linked in place of the
+ * libstdc++ defaults for any C++ program using libdragon; until the pools
+ * are enabled (or for sizes/loads the pools cannot serve) they behave just
+ * like the defaults, falling through to malloc/free. */
+
+static void* cpp_alloc(size_t size, uint32_t caller)
+{
+    void *p = NULL;
+    if (pools_enabled)
+        p = pool_alloc(size, caller);
+    if (!p)
+        p = malloc(size ? size : 1);
+    return p;
+}
+
+void* operator new(size_t size)
+{
+    void *p = cpp_alloc(size, (uint32_t)__builtin_return_address(0));
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void *p = cpp_alloc(size, (uint32_t)__builtin_return_address(0));
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return cpp_alloc(size, (uint32_t)__builtin_return_address(0));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return cpp_alloc(size, (uint32_t)__builtin_return_address(0));
+}
+
+static void cpp_free(void *ptr)
+{
+    if (!ptr)
+        return;
+    if (pools_enabled && pool_free(ptr))
+        return;
+    free(ptr);
+}
+
+void operator delete(void *ptr) noexcept { cpp_free(ptr); }
+void operator delete[](void *ptr) noexcept { cpp_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { cpp_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { cpp_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { cpp_free(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { cpp_free(ptr); }
+
 /** @brief Initialize debug support for C++ programs */
 void __debug_init_cpp(void)
 {
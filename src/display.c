@@ -11,10 +11,12 @@
 #include "n64sys.h"
 #include "vi.h"
 #include "display.h"
+#include "rdp.h"
 #include "interrupt.h"
 #include "utils.h"
 #include "debug.h"
 #include "surface.h"
+#include "bootprof.h"
 
 /** @brief Maximum number of video backbuffers */
 #define NUM_BUFFERS         32
@@ -37,6 +39,55 @@ static int now_showing = -1;
 static uint32_t drawing_mask = 0;
 /** @brief Bitmask of surfaces that are ready to be shown */
 static volatile uint32_t ready_mask = 0;
+/** @brief Bitmask of surfaces held out of rotation by the retire hook */
+static volatile uint32_t capture_mask = 0;
+/** @brief Hook invoked at buffer flip with the surface that just left the screen */
+static bool (*__retire_hook)( surface_t *surf, int idx ) = NULL;
+
+/** @brief VI refresh rate in fields per second (60 for NTSC/MPAL, 50 for PAL) */
+static uint32_t __refresh_rate = 60;
+/** @brief Number of vertical blanks since #display_init */
+static volatile uint32_t __vblank_count = 0;
+/** @brief Number of buffer flips (new frames shown) since #display_init */
+static volatile uint32_t __frame_count = 0;
+/** @brief Number of frames shown at least one full frame period late */
+static volatile uint32_t __late_frames = 0;
+/** @brief Number of frame slots that went by without a new frame to show */
+static volatile uint32_t __dropped_frames = 0;
+/** @brief Target frame rate for pacing (0 = pacing disabled) */
+static int __target_fps = 0;
+/** @brief Frame period in vblanks, as a 24.8 fixed point number */
+static uint32_t __frame_period_fx = 0;
+/** @brief Vblank count (24.8) at which the next flip is due */
+static uint32_t __next_deadline_fx = 0;
+/** @brief Vblank count at the last buffer flip */
+static uint32_t __last_flip_vblank = 0;
+/** @brief Moving average of vblanks per frame, as a 24.8 fixed point number */
+static uint32_t __avg_flip_fx = 0;
+/** @brief #TICKS_READ timestamp of the last buffer flip */
+static volatile uint32_t __last_flip_ticks = 0;
+/** @brief True if freed framebuffers are cleared with the RDP before being handed out again */
+static bool __auto_clear = false;
+/** @brief Color used by the automatic RDP clear (packed framebuffer format) */
+static uint32_t __auto_clear_color = 0;
+/** @brief Index of the buffer currently being cleared by the RDP (-1 = none) */
+static volatile int __clearing_buffer = -1;
+/** @brief Duration of the last completed frame in hardware ticks */
+static volatile uint32_t __frame_duration_ticks = 0;
+
+/** @brief Interlace mode configured at #display_init */
+static interlace_mode_t __interlace = INTERLACE_OFF;
+
+/** @brief True if a #display_init_lazy is still waiting to be completed */
+static bool __lazy_init_pending = false;
+/** @brief Parameters stored by #display_init_lazy for the deferred init */
+static struct {
+    resolution_t res;           ///< Requested resolution
+    bitdepth_t bit;             ///< Requested bit depth
+    uint32_t num_buffers;       ///< Requested number of buffers
+    gamma_t gamma;              ///< Requested gamma setting
+    filter_options_t filters;   ///< Requested filtering options
+} __lazy_init_params;
 
 /** @brief Get the next buffer index (with wraparound) */
 static inline int buffer_next(int idx) {
@@ -46,6 +97,48 @@ static inline int buffer_next(int idx) {
     return idx;
 }
 
+/** @brief Completion callback of the automatic RDP clear (runs in the DP interrupt) */
+static void __display_clear_done( void *arg )
+{
+    __clearing_buffer = -1;
+}
+
+/**
+ * @brief Kick an RDP clear of the buffer that #display_lock will hand out next
+ *
+ * Called from #display_show when automatic clearing is enabled, so that the
+ * clear runs while the application is idle between frames and the buffer
+ * arrives pre-cleared by the time #display_lock returns it.
+ */
+static void __display_auto_clear( void )
+{
+    /* Find the buffer that display_lock would pick next (same search) */
+    int next = -1;
+    int idx = buffer_next(now_showing);
+    for (int i = 0; i < __buffers; i++, idx = buffer_next(idx)) {
+        if (idx != now_showing && ((drawing_mask | ready_mask | capture_mask) & (1 << idx)) == 0) {
+            next = idx;
+            break;
+        }
+    }
+
+    /* Nothing free to clear, or a clear is already in flight */
+    if (next < 0 || __clearing_buffer >= 0)
+        return;
+
+    __clearing_buffer = next;
+
+    /* Fill the buffer with the RDP; this overwrites the RDP attachment,
+       cycle mode and fill color, which the application is expected to
+       reconfigure per frame anyway when automatic clearing is enabled */
+    rdp_attach(&surfaces[next]);
+    rdp_set_clipping(0, 0, __width, __height);
+    rdp_enable_primitive_fill();
+    rdp_set_primitive_color(__auto_clear_color);
+    rdp_draw_filled_rectangle(0, 0, __width, __height);
+    rdp_detach_async(__display_clear_done, NULL);
+}
+
 /**
  * @brief Interrupt handler for vertical blank
  *
@@ -58,73 +151,97 @@ static void __display_callback()
     bool field = (*VI_V_CURRENT) & 1;
     bool interlaced = (*VI_CTRL) & (VI_CTRL_SERRATE);
 
+    __vblank_count++;
+    uint32_t now_fx = __vblank_count << 8;
+
     /* Check if the next buffer is ready to be displayed, otherwise just
        leave up the current frame */
     int next = buffer_next(now_showing);
     if (ready_mask & (1 << next)) {
-        now_showing = next;
-        ready_mask &= ~(1 << next);
+        /* When a target frame rate is configured, hold the frame until its
+           slot comes up, so that a fast frame doesn't display earlier than
+           the configured pace. */
+        if (!__target_fps || (int32_t)(now_fx - __next_deadline_fx) >= 0) {
+            int retired = now_showing;
+            now_showing = next;
+            ready_mask &= ~(1 << next);
+            __frame_count++;
+
+            /* Hand the buffer that just left the screen to the retire hook
+               before it can be reused; returning true holds it out of
+               rotation until __display_capture_release */
+            if (retired >= 0 && __retire_hook && __retire_hook(&surfaces[retired], retired))
+                capture_mask |= 1 << retired;
+
+            /* Per-frame timestamping */
+            uint32_t now_ticks = TICKS_READ();
+            __frame_duration_ticks = TICKS_DISTANCE(__last_flip_ticks, now_ticks);
+            __last_flip_ticks = now_ticks;
+
+            /* Update the moving average of vblanks per frame (24.8) */
+            uint32_t delta = __vblank_count - __last_flip_vblank;
+            __last_flip_vblank = __vblank_count;
+            __avg_flip_fx += (int32_t)((delta << 8) - __avg_flip_fx) >> 3;
+
+            if (__target_fps) {
+                /* A flip that comes a whole frame period (or more) after its
+                   deadline means we missed at least one vsync slot. */
+                if ((int32_t)(now_fx - (__next_deadline_fx + __frame_period_fx)) >= 0)
+                    __late_frames++;
+                __next_deadline_fx += __frame_period_fx;
+                /* Don't let the schedule run away if we are far behind,
+                   otherwise a long hiccup would be followed by a burst of
+                   unthrottled frames. */
+                if ((int32_t)(now_fx - __next_deadline_fx) > 0)
+                    __next_deadline_fx = now_fx;
+            }
+        }
+    } else if (__target_fps && (int32_t)(now_fx - (__next_deadline_fx + __frame_period_fx)) >= 0) {
+        /* A whole frame slot went by without a new frame being queued:
+           record the miss and let the schedule move on to the next slot. */
+        __dropped_frames++;
+        __next_deadline_fx += __frame_period_fx;
     }
 
-    vi_write_dram_register(__safe_buffer[now_showing] + (interlaced && !field ? __width * __bitdepth : 0));
+    /* In full-height interlaced mode, the odd field is displayed by
+       offsetting the origin by one line. Half-height (field rendering)
+       buffers are shown whole on either field, with no offset. */
+    vi_write_dram_register(__safe_buffer[now_showing] +
+        (interlaced && !field && __interlace != INTERLACE_HALF ? __width * __bitdepth : 0));
 }
 
-void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma_t gamma, filter_options_t filters )
+/**
+ * @brief Compute the VI_CTRL filter bits for the requested filter options
+ *
+ * This is shared between #display_init and #display_set_filters, so that the
+ * filter configuration can also be changed at runtime without reinitializing
+ * the display.
+ *
+ * @param[in] filters
+ *            The requested filter options
+ * @param[in] width
+ *            Horizontal resolution in pixels (some filters are prohibited
+ *            at low resolutions, see #FILTERS_DISABLED)
+ * @param[in] bit
+ *            The framebuffer bit depth
+ *
+ * @return The AA mode, divot and dedither bits to set in VI_CTRL
+ */
+static uint32_t __display_filter_control( filter_options_t filters, uint32_t width, bitdepth_t bit )
 {
-    uint32_t tv_type = get_tv_type();
-    uint32_t control = !sys_bbplayer()? VI_PIXEL_ADVANCE_DEFAULT : VI_PIXEL_ADVANCE_BBPLAYER;
-
-    /* Can't have the video interrupt happening here */
-    disable_interrupts();
-
-    /* Minimum is two buffers. */
-    __buffers = MAX(2, MIN(NUM_BUFFERS, num_buffers));
-
-
-    if( res.interlaced )
-    {
-        /* Serrate on to stop vertical jitter */
-        control |= VI_CTRL_SERRATE;
-    }
-
-    /* Copy over extra initializations */
-    vi_write_config(&vi_config_presets[res.interlaced][tv_type]);
-
-    /* Figure out control register based on input given */
-    switch( bit )
-    {
-        case DEPTH_16_BPP:
-            control |= VI_CTRL_TYPE_16_BPP;
-            break;
-        case DEPTH_32_BPP:
-            control |= VI_CTRL_TYPE_32_BPP;
-            break;
-    }
-
-    switch( gamma )
-    {
-        case GAMMA_NONE:
-            /* Nothing to set here */
-            break;
-        case GAMMA_CORRECT:
-            control |= VI_GAMMA_ENABLE;
-            break;
-        case GAMMA_CORRECT_DITHER:
-            control |= VI_GAMMA_ENABLE | VI_GAMMA_DITHER_ENABLE;
-            break;  
-    }
+    uint32_t control = 0;
 
     switch( filters )
     {
-        /* Libdragon uses preconfigured modes for enabling certain 
-        combinations of VI filters due to a large number of wrong/invalid configurations 
+        /* Libdragon uses preconfigured modes for enabling certain
+        combinations of VI filters due to a large number of wrong/invalid configurations
         with very strict conditions, and to simplify the options for the user.
-        Like for example antialiasing requiring resampling; dedithering not working with 
+        Like for example antialiasing requiring resampling; dedithering not working with
         resampling, unless always fetching; always enabling divot filter under AA etc.
         The cases below provide all possible configurations that are deemed useful. */
 
         case FILTERS_DISABLED:
-            /* Disabling resampling (AA_MODE = 0x3) on 16bpp hits a hardware bug on NTSC 
+            /* Disabling resampling (AA_MODE = 0x3) on 16bpp hits a hardware bug on NTSC
                consoles when the horizontal resolution is 320 or lower (see issue #66).
                It would work on PAL consoles, but we think users are better
                served by prohibiting it altogether.
@@ -134,7 +251,7 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
                after the display_init call. */
             if ( bit == DEPTH_16_BPP )
             {
-                assertf(res.width > 320,
+                assertf(width > 320,
                     "FILTERS_DISABLED is not supported by the hardware for widths <= 320.\n"
                     "Please use FILTERS_RESAMPLE instead.");
             }
@@ -151,11 +268,11 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
                as it will cause ugly vertical streaks */
             break;
         case FILTERS_DEDITHER:
-            /* Set AA off flag and dedither on 
+            /* Set AA off flag and dedither on
             (only on 16bpp mode, act as FILTERS_DISABLED on 32bpp) */
             if ( bit == DEPTH_16_BPP ) {
                 // Assert on width (see FILTERS_DISABLED)
-                assertf(res.width > 320,
+                assertf(width > 320,
                     "FILTERS_DEDITHER is not supported by the hardware for widths <= 320.\n"
                     "Please use FILTERS_RESAMPLE instead.");
                 control |= VI_AA_MODE_NONE | VI_DEDITHER_FILTER_ENABLE;
@@ -169,17 +286,72 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
 
             break;
         case FILTERS_RESAMPLE_ANTIALIAS_DEDITHER:
-            /* Set AA on resample always and fetch as well as dedither on 
+            /* Set AA on resample always and fetch as well as dedither on
             (only on 16bpp mode, act as FILTERS_RESAMPLE_ANTIALIAS on 32bpp) */
 
             /* Enable dither filter in 16bpp mode to give gradients
                a slightly smoother look */
-            if ( bit == DEPTH_16_BPP ) 
-                 control |= VI_AA_MODE_RESAMPLE_FETCH_ALWAYS | VI_DEDITHER_FILTER_ENABLE | VI_DIVOT_ENABLE; 
+            if ( bit == DEPTH_16_BPP )
+                 control |= VI_AA_MODE_RESAMPLE_FETCH_ALWAYS | VI_DEDITHER_FILTER_ENABLE | VI_DIVOT_ENABLE;
             else control |= VI_AA_MODE_RESAMPLE_FETCH_NEEDED | VI_DIVOT_ENABLE;
             break;
     }
 
+    return control;
+}
+
+void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma_t gamma, filter_options_t filters )
+{
+    uint32_t tv_type = get_tv_type();
+    uint32_t control = !sys_bbplayer()? VI_PIXEL_ADVANCE_DEFAULT : VI_PIXEL_ADVANCE_BBPLAYER;
+
+    /* Can't have the video interrupt happening here */
+    disable_interrupts();
+
+    /* One buffer selects the single-buffer (beam chasing) presentation
+       mode, see display_lock. Anything else is standard multi-buffering. */
+    __buffers = MAX(1, MIN(NUM_BUFFERS, num_buffers));
+
+    /* No RDP clear can be in flight on the new buffers */
+    __clearing_buffer = -1;
+
+
+    if( res.interlaced )
+    {
+        /* Serrate on to stop vertical jitter */
+        control |= VI_CTRL_SERRATE;
+    }
+    __interlace = res.interlaced;
+
+    /* Copy over extra initializations */
+    vi_write_config(&vi_config_presets[res.interlaced != INTERLACE_OFF][tv_type]);
+
+    /* Figure out control register based on input given */
+    switch( bit )
+    {
+        case DEPTH_16_BPP:
+            control |= VI_CTRL_TYPE_16_BPP;
+            break;
+        case DEPTH_32_BPP:
+            control |= VI_CTRL_TYPE_32_BPP;
+            break;
+    }
+
+    switch( gamma )
+    {
+        case GAMMA_NONE:
+            /* Nothing to set here */
+            break;
+        case GAMMA_CORRECT:
+            control |= VI_GAMMA_ENABLE;
+            break;
+        case GAMMA_CORRECT_DITHER:
+            control |= VI_GAMMA_ENABLE | VI_GAMMA_DITHER_ENABLE;
+            break;  
+    }
+
+    control |= __display_filter_control( filters, res.width, bit );
+
     /* Set the control register in our template */
     vi_write_safe(VI_CTRL, control);
 
@@ -196,13 +368,23 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
     {
         assertf(res.width % 2 == 0, "width must be divisible by 2 for 32-bit depth");
     }
+    if( res.interlaced == INTERLACE_HALF )
+    {
+        assertf(res.height % 2 == 0, "height must be even for INTERLACE_HALF");
+    }
+
+    /* In INTERLACE_HALF mode, the framebuffers hold a single field, so they
+       are half as tall as the output; each field then displays the whole
+       buffer, with no per-field origin offset. */
+    uint32_t fb_height = ( res.interlaced == INTERLACE_HALF ) ? res.height/2 : res.height;
+
     vi_write_safe(VI_WIDTH, res.width);
     vi_write_safe(VI_X_SCALE, VI_X_SCALE_SET(res.width));
-    vi_write_safe(VI_Y_SCALE, VI_Y_SCALE_SET(res.height));
+    vi_write_safe(VI_Y_SCALE, VI_Y_SCALE_SET(fb_height));
 
     /* Set up the display */
     __width = res.width;
-    __height = res.height;
+    __height = fb_height;
     __bitdepth = ( bit == DEPTH_16_BPP ) ? 2 : 4;
 
     surfaces = malloc(sizeof(surface_t) * __buffers);
@@ -225,6 +407,19 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
     now_showing = 0;
     drawing_mask = 0;
     ready_mask = 0;
+    capture_mask = 0;
+
+    /* Reset frame pacing and statistics */
+    __refresh_rate = (tv_type == TV_PAL) ? 50 : 60;
+    __vblank_count = 0;
+    __frame_count = 0;
+    __late_frames = 0;
+    __dropped_frames = 0;
+    __target_fps = 0;
+    __last_flip_vblank = 0;
+    __avg_flip_fx = 1 << 8;
+    __last_flip_ticks = TICKS_READ();
+    __frame_duration_ticks = 0;
 
     /* Show our screen normally. If display is already active, do that during vblank
        to avoid confusing the VI chip with in-frame modifications. */
@@ -237,10 +432,51 @@ void display_init( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma
     /* Set which line to call back on in order to flip screens */
     register_VI_handler( __display_callback );
     set_VI_interrupt( 1, VI_V_CURRENT_VBLANK );
+
+    /* A direct init supersedes any pending lazy one */
+    __lazy_init_pending = false;
+
+    bootprof_mark( "display_init" );
+}
+
+void display_init_lazy( resolution_t res, bitdepth_t bit, uint32_t num_buffers, gamma_t gamma, filter_options_t filters )
+{
+    /* Record the parameters; the actual init (framebuffer allocation and
+       clearing, VI programming) runs on the first #display_lock. Make the
+       configuration queries meaningful in the meantime. */
+    __lazy_init_params.res = res;
+    __lazy_init_params.bit = bit;
+    __lazy_init_params.num_buffers = num_buffers;
+    __lazy_init_params.gamma = gamma;
+    __lazy_init_params.filters = filters;
+
+    __width = res.width;
+    __height = ( res.interlaced == INTERLACE_HALF ) ? res.height/2 : res.height;
+    __bitdepth = ( bit == DEPTH_16_BPP ) ? 2 : 4;
+    __buffers = MAX(1, MIN(NUM_BUFFERS, num_buffers));
+
+    __lazy_init_pending = true;
+}
+
+/** @brief Complete a deferred #display_init_lazy, if one is pending */
+static void __display_ensure_init( void )
+{
+    if( !__lazy_init_pending )
+    {
+        return;
+    }
+
+    __lazy_init_pending = false;
+    display_init( __lazy_init_params.res, __lazy_init_params.bit,
+        __lazy_init_params.num_buffers, __lazy_init_params.gamma,
+        __lazy_init_params.filters );
 }
 
 void display_close()
 {
+    /* A deferred init that never ran has nothing to tear down */
+    __lazy_init_pending = false;
+
     /* Can't have the video interrupt happening here */
     disable_interrupts();
 
@@ -250,9 +486,12 @@ void display_close()
     now_showing = -1;
     drawing_mask = 0;
     ready_mask = 0;
+    capture_mask = 0;
+    __clearing_buffer = -1;
 
     __width = 0;
     __height = 0;
+    __interlace = INTERLACE_OFF;
 
     /* If display is active, wait for vblank before touching the registers */
     if( vi_is_active() ) { vi_wait_for_vblank(); }
@@ -280,22 +519,44 @@ surface_t* display_lock(void)
     surface_t* retval = NULL;
     int next;
 
+    __display_ensure_init();
+
     /* Can't have the video interrupt happening here */
     disable_interrupts();
 
-    /* Calculate index of next display context to draw on. We need
-       to find the first buffer which is not being drawn upon nor
-       being ready to be displayed. */
-    for (next = buffer_next(now_showing); next != now_showing; next = buffer_next(next)) {
-        if (((drawing_mask | ready_mask) & (1 << next)) == 0)  {
+    if (__buffers == 1) {
+        /* Single-buffer (beam chasing) mode: there is no hidden buffer, so
+           hand out the surface currently being displayed. The application
+           is expected to draw behind the raster, using
+           #display_get_current_scanline (possibly paired with
+           #register_VI_scanline_handler) to track the beam position. */
+        next = now_showing;
+        if (((drawing_mask | ready_mask) & (1 << next)) == 0) {
             retval = &surfaces[next];
             drawing_mask |= 1 << next;
-            break;
+        }
+    } else {
+        /* Calculate index of next display context to draw on. We need
+           to find the first buffer which is not being drawn upon nor
+           being ready to be displayed. */
+        for (next = buffer_next(now_showing); next != now_showing; next = buffer_next(next)) {
+            if (((drawing_mask | ready_mask | capture_mask) & (1 << next)) == 0)  {
+                retval = &surfaces[next];
+                drawing_mask |= 1 << next;
+                break;
+            }
         }
     }
 
     enable_interrupts();
 
+    /* If the RDP is still busy pre-clearing this buffer, wait for it to
+       finish before handing it out (normally it is long done by now) */
+    if( retval )
+    {
+        while( __clearing_buffer == next ) {  }
+    }
+
     /* Possibility of returning nothing, or a valid display context */
     return retval;
 }
@@ -323,6 +584,12 @@ void display_show( surface_t* surf )
     ready_mask |= 1 << i;
 
     enable_interrupts();
+
+    /* Pre-clear the next free buffer while the application is idle */
+    if( __auto_clear )
+    {
+        __display_auto_clear();
+    }
 }
 
 /**
@@ -346,6 +613,44 @@ void display_show_force( display_context_t disp )
     enable_interrupts();
 }
 
+/**
+ * @brief Register a hook receiving framebuffers as they leave the screen
+ *
+ * The hook runs in the VI interrupt at every buffer flip, with the surface
+ * that was being displayed until that flip. Returning true holds the buffer
+ * out of the rotation (it is not handed out by #display_lock) until
+ * #__display_capture_release is called with its index; this is how the
+ * capture service snapshots a frame without copying it.
+ *
+ * NOTE: this is not part of the public API, it exists for the capture
+ * service in capture.c.
+ *
+ * @param[in] hook
+ *            Hook to invoke at every flip, or NULL to unregister
+ */
+void __display_set_retire_hook( bool (*hook)( surface_t *surf, int idx ) )
+{
+    disable_interrupts();
+    __retire_hook = hook;
+    enable_interrupts();
+}
+
+/**
+ * @brief Return a framebuffer held by the retire hook to the rotation
+ *
+ * NOTE: this is not part of the public API, it exists for the capture
+ * service in capture.c.
+ *
+ * @param[in] idx
+ *            Index of the buffer to release, as passed to the hook
+ */
+void __display_capture_release( int idx )
+{
+    disable_interrupts();
+    capture_mask &= ~(1 << idx);
+    enable_interrupts();
+}
+
 uint32_t display_get_width()
 {
     return __width;
@@ -365,3 +670,89 @@ uint32_t display_get_num_buffers()
 {
     return __buffers;
 }
+
+void display_set_auto_clear( bool enable, uint32_t color )
+{
+    __auto_clear = enable;
+    __auto_clear_color = color;
+}
+
+void display_set_filters( filter_options_t filters )
+{
+    assertf(surfaces != NULL, "display_set_filters called before display_init");
+
+    bitdepth_t bit = ( __bitdepth == 2 ) ? DEPTH_16_BPP : DEPTH_32_BPP;
+
+    /* Replace the AA mode, divot and dedither bits, keeping everything else
+       (bit depth, serrate, gamma, pixel advance) as configured at init.
+       VI_AA_MODE_NONE has both AA mode bits set, so it doubles as the mask. */
+    uint32_t control = *VI_CTRL;
+    control &= ~(VI_AA_MODE_NONE | VI_DIVOT_ENABLE | VI_DEDITHER_FILTER_ENABLE);
+    control |= __display_filter_control( filters, __width, bit );
+
+    vi_write_safe(VI_CTRL, control);
+}
+
+void display_set_target_fps( int fps )
+{
+    assertf(fps >= 0, "invalid target fps %d", fps);
+
+    /* Can't have the video interrupt happening here */
+    disable_interrupts();
+
+    __target_fps = fps;
+    if( fps > 0 )
+    {
+        __frame_period_fx = (__refresh_rate << 8) / fps;
+        /* Restart the schedule from the current position */
+        __next_deadline_fx = __vblank_count << 8;
+    }
+
+    enable_interrupts();
+}
+
+bool display_should_skip_frame( void )
+{
+    if( !__target_fps ) { return false; }
+
+    /* We are behind schedule if the next flip deadline already passed while
+       nothing new is being shown: another full frame rendered now would only
+       be later. Suggest skipping the rendering part of this iteration. */
+    return (int32_t)((__vblank_count << 8) - __next_deadline_fx) > 0;
+}
+
+float display_get_fps( void )
+{
+    if( __avg_flip_fx == 0 ) { return 0.0f; }
+    return (float)(__refresh_rate << 8) / (float)__avg_flip_fx;
+}
+
+uint32_t display_get_frame_count( void )
+{
+    return __frame_count;
+}
+
+uint32_t display_get_vblank_count( void )
+{
+    return __vblank_count;
+}
+
+uint32_t display_get_late_frames( void )
+{
+    return __late_frames;
+}
+
+uint32_t display_get_dropped_frames( void )
+{
+    return __dropped_frames;
+}
+
+uint32_t display_get_frame_duration( void )
+{
+    return __frame_duration_ticks;
+}
+
+uint32_t display_get_current_scanline( void )
+{
+    return *VI_V_CURRENT;
+}
@@ -360,7 +360,7 @@ void dma_read_async(void *ram_pointer, unsigned long pi_address, unsigned long l
     enable_interrupts();
 }
 
-/** 
+/**
  * @brief Wait until an async DMA or I/O transfer is finished.
  */
 void dma_wait(void)
@@ -368,6 +368,231 @@ void dma_wait(void)
     while (__dma_busy()) {}
 }
 
+/**
+ * @brief A queued PI DMA transfer, with its completion callback.
+ */
+typedef struct dma_msg_s {
+    void *ram_address;              ///< RDRAM address (must be 8-byte aligned)
+    uint32_t pi_address;            ///< PI bus address (must be 2-byte aligned)
+    uint32_t len;                   ///< Transfer length (must be multiple of 2)
+    bool write;                     ///< True if RDRAM -> PI, false if PI -> RDRAM
+    int priority;                   ///< Priority (higher values are served first)
+    void (*callback)(void *ctx);    ///< Callback for completion (can be NULL)
+    void *context;                  ///< Callback context
+    struct dma_msg_s *next;         ///< Next message in the list
+} dma_msg_t;
+
+#define MAX_DMA_MSGS           16   ///< Maximum number of pending PI transfers
+
+/** @brief Static pool of queued transfers */
+static dma_msg_t dma_msgs[MAX_DMA_MSGS];
+/** @brief Free list of unused pool entries */
+static dma_msg_t *dma_msgs_free = NULL;
+/** @brief Pending transfers, sorted by descending priority (FIFO within a priority) */
+static dma_msg_t *dma_msgs_head = NULL;
+/** @brief Transfer currently programmed into the PI (NULL if none) */
+static dma_msg_t *dma_msg_cur = NULL;
+/** @brief True once the queue machinery has been lazily initialized */
+static bool dma_queue_inited = false;
+
+/**
+ * @brief Program the highest-priority pending transfer into the PI, if possible.
+ *
+ * @note This function must be called with interrupts disabled.
+ *
+ * If the PI is currently busy (eg: because of a blocking #dma_read issued
+ * by other code), nothing is done: the PI interrupt raised when that
+ * transfer finishes will call us again.
+ */
+static void __dma_queue_kick(void)
+{
+    if (dma_msg_cur != NULL || dma_msgs_head == NULL || __dma_busy())
+        return;
+
+    dma_msg_t *msg = dma_msgs_head;
+    dma_msgs_head = msg->next;
+    dma_msg_cur = msg;
+
+    MEMORY_BARRIER();
+    PI_regs->ram_address = msg->ram_address;
+    MEMORY_BARRIER();
+    PI_regs->pi_address = msg->pi_address;
+    MEMORY_BARRIER();
+    if (msg->write)
+        PI_regs->read_length = msg->len-1;
+    else
+        PI_regs->write_length = msg->len-1;
+    MEMORY_BARRIER();
+}
+
+/**
+ * @brief PI interrupt handler: completes the current transfer and starts the next.
+ */
+static void __dma_queue_interrupt(void)
+{
+    // The interrupt might have been raised by a transfer issued outside the
+    // queue (eg: a blocking #dma_read): in that case, there is no current
+    // message to complete, but we still try to drain the queue.
+    if (dma_msg_cur != NULL) {
+        dma_msg_t *msg = dma_msg_cur;
+        void (*callback)(void *ctx) = msg->callback;
+        void *context = msg->context;
+        dma_msg_cur = NULL;
+
+        // Return the entry to the free list before the callback runs, so
+        // that the callback itself can enqueue a new transfer.
+        msg->next = dma_msgs_free;
+        dma_msgs_free = msg;
+
+        if (callback)
+            callback(context);
+    }
+
+    __dma_queue_kick();
+}
+
+/**
+ * @brief Lazily initialize the PI transfer queue.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void __dma_queue_init(void)
+{
+    for (int i = 0; i < MAX_DMA_MSGS; i++) {
+        dma_msgs[i].next = dma_msgs_free;
+        dma_msgs_free = &dma_msgs[i];
+    }
+
+    register_PI_handler(__dma_queue_interrupt);
+    set_PI_interrupt(1);
+    dma_queue_inited = true;
+}
+
+/**
+ * @brief Add a transfer to the PI queue (common backend of read/write).
+ */
+static void __dma_queue_submit(void *ram_address, unsigned long pi_address,
+    unsigned long len, bool write, int priority, void (*callback)(void *ctx), void *ctx)
+{
+    assert(len > 0);
+    assert(((uint32_t)ram_address & 7) == 0);
+    assert((pi_address & 1) == 0 && (len & 1) == 0);
+
+    disable_interrupts();
+
+    if (!dma_queue_inited)
+        __dma_queue_init();
+
+    dma_msg_t *msg = dma_msgs_free;
+    assertf(msg != NULL, "PI transfer queue is full (%d pending transfers)", MAX_DMA_MSGS);
+    dma_msgs_free = msg->next;
+
+    msg->ram_address = ram_address;
+    msg->pi_address = pi_address;
+    msg->len = len;
+    msg->write = write;
+    msg->priority = priority;
+    msg->callback = callback;
+    msg->context = ctx;
+
+    // Sorted insertion: skip past all messages with same or higher priority,
+    // so that transfers of equal priority are executed in submission order.
+    dma_msg_t **link = &dma_msgs_head;
+    while (*link != NULL && (*link)->priority >= priority)
+        link = &(*link)->next;
+    msg->next = *link;
+    *link = msg;
+
+    __dma_queue_kick();
+
+    enable_interrupts();
+}
+
+/**
+ * @brief Enqueue an asynchronous PI DMA read with priority and callback.
+ *
+ * This function adds a transfer to the PI transfer queue and returns
+ * immediately. Transfers are executed one at a time under the PI interrupt,
+ * in priority order (higher priorities first, FIFO within the same priority),
+ * and the optional callback is invoked when each transfer completes.
+ *
+ * This allows multiple subsystems (eg: audio streaming, level streaming,
+ * overlay loading) to share the PI bus without polling #dma_busy or
+ * coordinating manually: each one just enqueues its transfers with an
+ * appropriate priority.
+ *
+ * The queue can hold up to #MAX_DMA_MSGS pending transfers; this function
+ * asserts if the queue is full. Like #dma_read_raw_async, the transfer is
+ * well-defined only for RAM addresses which are multiple of 8, PI addresses
+ * which are multiple of 2, and lengths which are multiple of 2.
+ *
+ * @note The callback function will be called under interrupt; keep it short.
+ *       It is allowed to enqueue a new transfer from within the callback.
+ *
+ * @param[out] ram_address
+ *             Pointer to a buffer to place read data (must be 8-byte aligned)
+ * @param[in]  pi_address
+ *             Memory address of the peripheral to read from (must be 2-byte aligned)
+ * @param[in]  len
+ *             Length in bytes to read into ram_address (must be multiple of 2)
+ * @param[in]  priority
+ *             Priority of the transfer (higher values are served first)
+ * @param[in]  callback
+ *             Function called when the transfer is finished (can be NULL)
+ * @param[in]  ctx
+ *             Opaque context pointer passed to the callback
+ */
+void dma_queue_read(void *ram_address, unsigned long pi_address, unsigned long len,
+    int priority, void (*callback)(void *ctx), void *ctx)
+{
+    __dma_queue_submit(ram_address, pi_address, len, false, priority, callback, ctx);
+}
+
+/**
+ * @brief Enqueue an asynchronous PI DMA write with priority and callback.
+ *
+ * Like #dma_queue_read, but transfers data from RDRAM to the peripheral.
+ * See #dma_queue_read for a description of the queue semantics.
+ *
+ * @param[in]  ram_address
+ *             Pointer to a buffer to read data from (must be 8-byte aligned)
+ * @param[in]  pi_address
+ *             Memory address of the peripheral to write to (must be 2-byte aligned)
+ * @param[in]  len
+ *             Length in bytes to write into pi_address (must be multiple of 2)
+ * @param[in]  priority
+ *             Priority of the transfer (higher values are served first)
+ * @param[in]  callback
+ *             Function called when the transfer is finished (can be NULL)
+ * @param[in]  ctx
+ *             Opaque context pointer passed to the callback
+ */
+void dma_queue_write(const void *ram_address, unsigned long pi_address, unsigned long len,
+    int priority, void (*callback)(void *ctx), void *ctx)
+{
+    __dma_queue_submit((void*)ram_address, pi_address, len, true, priority, callback, ctx);
+}
+
+/**
+ * @brief Return the number of PI transfers currently in flight or pending.
+ *
+ * This counts the transfer programmed into the PI (if any) plus all the
+ * transfers still waiting in the queue. It is a snapshot useful for
+ * diagnostics (eg: the inspector performance HUD); the value can change
+ * at any time as the PI interrupt drains the queue.
+ *
+ * @return Number of queued plus in-flight transfers (0 = PI queue idle)
+ */
+int dma_queue_depth(void)
+{
+    disable_interrupts();
+    int depth = (dma_msg_cur != NULL) ? 1 : 0;
+    for (dma_msg_t *msg = dma_msgs_head; msg != NULL; msg = msg->next)
+        depth++;
+    enable_interrupts();
+    return depth;
+}
+
 
 /** 
  * @brief Read data from a peripheral through PI DMA, waiting for completion.
@@ -474,4 +699,157 @@ void io_write(uint32_t pi_address, uint32_t data)
     enable_interrupts();
 }
 
+/**
+ * @brief Configure the PI bus timings for a cartridge domain.
+ *
+ * The PI bus has two address domains (1 is used by the cartridge ROM,
+ * 2 by N64DD and cartridge SRAM), each with configurable access timings.
+ * At boot, IPL2 programs domain 1 with the values stored in the ROM
+ * header, which are often conservative; many flashcarts and mask ROMs
+ * can sustain faster timings, increasing PI DMA bandwidth by 20% or more.
+ *
+ * All values are in RCP clock cycles (~15.6 ns), minus one: for instance,
+ * a @p latency of 3 means 4 cycles. The page size is expressed as log2 of
+ * the page size in bytes, minus 2 (eg: 5 means 128-byte pages): within a
+ * page, only the pulse width is paid per 16-bit word, while crossing a
+ * page boundary pays the full latency again.
+ *
+ * Lowering these values beyond what the cartridge hardware can sustain
+ * will silently corrupt DMA transfers, so any tuning should be validated,
+ * for instance by reading back a known block of ROM data and comparing.
+ * Use #dma_measure_bandwidth to quantify the effect of a configuration.
+ *
+ * The register writes are guarded against an ongoing DMA transfer, so it
+ * is safe to call this function at any time.
+ *
+ * @param[in] domain
+ *            PI address domain to configure (1 or 2)
+ * @param[in] latency
+ *            Cycles (minus one) before the first word of an access (0-255)
+ * @param[in] pulse_width
+ *            Cycles (minus one) the read/write strobe is held (0-255)
+ * @param[in] page_size
+ *            Log2 of the page size in bytes, minus 2 (0-15)
+ * @param[in] release
+ *            Cycles (minus one) between consecutive accesses (0-3)
+ *
+ * @see #dma_measure_bandwidth
+ */
+void dma_set_domain_timings(int domain, uint8_t latency, uint8_t pulse_width,
+    uint8_t page_size, uint8_t release)
+{
+    assertf(domain == 1 || domain == 2, "invalid PI domain: %d", domain);
+    assertf(page_size <= 15, "invalid PI page size: %d", page_size);
+    assertf(release <= 3, "invalid PI release: %d", release);
+
+    disable_interrupts();
+
+    // Writing the timing registers during an ongoing DMA transfer is
+    // unreliable, so wait for the PI to be idle first.
+    while (__dma_busy()) ;
+    MEMORY_BARRIER();
+    if (domain == 1) {
+        PI_regs->dom1_latency = latency;
+        PI_regs->dom1_pulse_width = pulse_width;
+        PI_regs->dom1_page_size = page_size;
+        PI_regs->dom1_release = release;
+    } else {
+        PI_regs->dom2_latency = latency;
+        PI_regs->dom2_pulse_width = pulse_width;
+        PI_regs->dom2_page_size = page_size;
+        PI_regs->dom2_release = release;
+    }
+    MEMORY_BARRIER();
+
+    enable_interrupts();
+}
+
+/**
+ * @brief Read back the currently configured PI bus timings for a domain.
+ *
+ * This is useful to save the boot configuration before experimenting
+ * with #dma_set_domain_timings, so it can be restored on failure.
+ *
+ * @param[in]  domain
+ *             PI address domain to query (1 or 2)
+ * @param[out] latency
+ *             If not NULL, filled with the configured latency
+ * @param[out] pulse_width
+ *             If not NULL, filled with the configured pulse width
+ * @param[out] page_size
+ *             If not NULL, filled with the configured page size
+ * @param[out] release
+ *             If not NULL, filled with the configured release duration
+ */
+void dma_get_domain_timings(int domain, uint8_t *latency, uint8_t *pulse_width,
+    uint8_t *page_size, uint8_t *release)
+{
+    assertf(domain == 1 || domain == 2, "invalid PI domain: %d", domain);
+
+    if (domain == 1) {
+        if (latency) *latency = PI_regs->dom1_latency;
+        if (pulse_width) *pulse_width = PI_regs->dom1_pulse_width;
+        if (page_size) *page_size = PI_regs->dom1_page_size;
+        if (release) *release = PI_regs->dom1_release;
+    } else {
+        if (latency) *latency = PI_regs->dom2_latency;
+        if (pulse_width) *pulse_width = PI_regs->dom2_pulse_width;
+        if (page_size) *page_size = PI_regs->dom2_page_size;
+        if (release) *release = PI_regs->dom2_release;
+    }
+}
+
+/**
+ * @brief Measure the actual PI DMA throughput at the current timings.
+ *
+ * This function repeatedly DMAs a block of data from the given PI address
+ * into the provided RDRAM buffer, timing the transfers with the COP0
+ * counter, and returns the measured bandwidth in bytes per second. It can
+ * be used to calibrate #dma_set_domain_timings: apply a candidate
+ * configuration, verify that a known block of data still reads back
+ * correctly, then measure whether the configuration is actually faster.
+ *
+ * The measurement performs several full transfers, so with a sizeable
+ * @p len (recommended: 64 KiB or more, for precision) it takes a few
+ * milliseconds to run.
+ *
+ * @param[out] ram_address
+ *             Scratch buffer for the transfers (must be 8-byte aligned;
+ *             contents are overwritten)
+ * @param[in]  pi_address
+ *             PI address to read from (must be 2-byte aligned)
+ * @param[in]  len
+ *             Length in bytes of each transfer (must be a multiple of 2)
+ *
+ * @return Measured PI read bandwidth, in bytes per second
+ *
+ * @see #dma_set_domain_timings
+ */
+uint32_t dma_measure_bandwidth(void *ram_address, unsigned long pi_address, unsigned long len)
+{
+    const int NUM_TRANSFERS = 8;
+
+    assert(len > 0);
+    assert(((uint32_t)ram_address & 7) == 0);
+    assert((pi_address & 1) == 0 && (len & 1) == 0);
+
+    disable_interrupts();
+
+    // Make sure the bus is quiet before starting the measurement
+    while (__dma_busy()) ;
+
+    uint32_t t0 = TICKS_READ();
+    for (int i = 0; i < NUM_TRANSFERS; i++) {
+        dma_read_raw_async(ram_address, pi_address, len);
+        while (__dma_busy()) ;
+    }
+    uint32_t elapsed = TICKS_READ() - t0;
+
+    enable_interrupts();
+
+    // bytes/sec = total_bytes * TICKS_PER_SECOND / elapsed, computed in
+    // 64-bit to avoid overflow with large transfers.
+    return (uint64_t)len * NUM_TRANSFERS * TICKS_PER_SECOND / elapsed;
+}
+
 /** @} */ /* dma */
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include <debug.h>
+#include <bootprof.h>
 
 /**
  * @addtogroup system
@@ -61,6 +62,7 @@ void __do_global_ctors()
 		if (*ctor_addr) (*ctor_addr)();
 		ctor_addr--;
 	}
+	bootprof_mark("ctors");
 }
 
 /**
@@ -95,6 +97,7 @@ void __wrap___do_global_ctors()
 		(*ctor_addr)();
 		ctor_addr--;
 	}
+	bootprof_mark("ctors");
 }
 
 /** @} */
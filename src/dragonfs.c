@@ -8,10 +8,13 @@
 #include <stdint.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <malloc.h>
 #include "libdragon.h"
 #include "system.h"
+#include "cop0.h"
 #include "dfsinternal.h"
 #include "rompak_internal.h"
+#include "utils.h"
 
 /**
  * @defgroup dfs DragonFS
@@ -80,12 +83,59 @@ enum
 static uint32_t base_ptr = 0;
 /** @brief Open file tracking */
 static open_file_t open_files[MAX_OPEN_FILES];
+/** @brief Stack of free slots in #open_files, for O(1) acquire/release */
+static uint8_t free_slots[MAX_OPEN_FILES];
+/** @brief Number of entries in #free_slots */
+static int num_free_slots = 0;
+
+/** @brief State of the (single) in-flight asynchronous read */
+static struct {
+    open_file_t *file;              ///< File being read
+    uint8_t *data;                  ///< Destination of the DMA'd body
+    int body;                       ///< Bytes being transferred by DMA
+    int tail;                       ///< Bytes to read on the CPU after the DMA
+    int total;                      ///< Bytes already read before the DMA (head)
+    dfs_read_callback_t callback;   ///< Completion callback (can be NULL)
+    void *ctx;                      ///< Opaque argument for the callback
+    volatile bool pending;          ///< True while the DMA is in flight
+} read_async;
+
+/** @brief State of the (single) in-flight read-ahead DMA */
+static struct {
+    open_file_t *file;              ///< File being prefetched
+    int len;                        ///< Bytes being transferred by DMA
+    volatile bool pending;          ///< True while the DMA is in flight
+} prefetch_async;
 /** @brief Directory pointer stack */
 static uint32_t directories[MAX_DIRECTORY_DEPTH];
 /** @brief Depth into directory pointer stack */
 static uint32_t directory_top = 0;
 /** @brief Pointer to next directory entry set when doing a directory walk */
 static directory_entry_t *next_entry = 0;
+/** @brief Location of the path lookup index in cartspace (0 = image has no index) */
+static uint32_t lookup_ptr = 0;
+/** @brief Number of entries in the path lookup index */
+static uint32_t lookup_count = 0;
+/** @brief Overlay (patch) filesystem pointer (0 = no overlay mounted) */
+static uint32_t overlay_ptr = 0;
+/** @brief Location of the overlay's path lookup index in cartspace */
+static uint32_t overlay_lookup_ptr = 0;
+/** @brief Number of entries in the overlay's path lookup index */
+static uint32_t overlay_lookup_count = 0;
+/** @brief True if a #dfs_init_lazy is still waiting to be completed */
+static bool lazy_init_pending = false;
+/** @brief Filesystem location stored by #dfs_init_lazy */
+static uint32_t lazy_init_loc = 0;
+/** @brief True while #dfs_profile_start is recording first-open order */
+static bool profile_recording = false;
+/** @brief Paths recorded so far, in first-open order */
+static char **profile_paths = NULL;
+/** @brief Number of recorded paths */
+static int profile_count = 0;
+/** @brief Allocated capacity of #profile_paths */
+static int profile_capacity = 0;
+
+static int __dfs_ensure_init(void);
 
 /**
  * @brief Read a sector from cartspace
@@ -107,23 +157,59 @@ static inline void grab_sector(void *cart_loc, void *ram_loc)
 }
 
 /**
- * @brief Find a free open file structure
+ * @brief Acquire a free open file structure from the handle pool
  *
- * @return A pointer to an open file structure or NULL if no more open file structures.
+ * The pool is a preallocated stack of slots, so acquiring never touches
+ * the heap and runs in O(1). The operation is guarded against interrupts,
+ * so files can be opened from interrupt handlers (eg: async I/O
+ * completion callbacks).
+ *
+ * The returned structure already has its unique handle assigned. The
+ * handle encodes the slot index (see #find_open_file), which is what
+ * makes handle lookups O(1) as well.
+ *
+ * @return A pointer to an open file structure or NULL if the pool is exhausted.
  */
-static open_file_t *find_free_file()
+static open_file_t *file_alloc(void)
 {
-    for(int i = 0; i < MAX_OPEN_FILES; i++)
+    /* Ensure we always open with a unique handle */
+    static uint32_t next_handle = 0;
+
+    open_file_t *file = 0;
+
+    disable_interrupts();
+
+    if(num_free_slots > 0)
     {
-        if(!open_files[i].handle)
-        {
-            /* Found one! */
-            return &open_files[i];
-        }
+        int slot = free_slots[--num_free_slots];
+        file = &open_files[slot];
+        file->handle = (next_handle++ * MAX_OPEN_FILES) + slot + 1;
     }
 
-    /* No free files */
-    return 0;
+    enable_interrupts();
+
+    return file;
+}
+
+/**
+ * @brief Release an open file structure back to the handle pool
+ *
+ * Like #file_alloc, this is O(1), heap-free and interrupt-safe.
+ *
+ * @param[in] file
+ *            Open file structure acquired with #file_alloc
+ */
+static void file_free(open_file_t *file)
+{
+    int slot = file - open_files;
+
+    /* Invalidate the handle (and the rest of the bookkeeping) before
+       pushing the slot: nobody can acquire it until it is pushed. */
+    memset(file, 0, sizeof(open_file_t));
+
+    disable_interrupts();
+    free_slots[num_free_slots++] = slot;
+    enable_interrupts();
 }
 
 /**
@@ -138,13 +224,14 @@ static open_file_t *find_open_file(uint32_t x)
 {
     if(x == 0) { return 0; }
 
-    for(int i = 0; i < MAX_OPEN_FILES; i++)
+    /* Handles are allocated as counter * MAX_OPEN_FILES + slot + 1
+       (see #file_alloc), so the slot index can be recovered directly
+       and the lookup is O(1). Stale handles fail the comparison. */
+    open_file_t *file = &open_files[(x - 1) % MAX_OPEN_FILES];
+
+    if(file->handle == x)
     {
-        if(open_files[i].handle == x)
-        {
-            /* Found it! */
-            return &open_files[i];
-        }
+        return file;
     }
 
     /* Couldn't find handle */
@@ -465,6 +552,122 @@ static directory_entry_t *find_dirent(char *name, directory_entry_t *cur_node)
     return 0;
 }
 
+/**
+ * @brief Hash an absolute path for the path lookup index
+ *
+ * Computes the FNV-1a hash of the path as stored in the index by mkdfs:
+ * relative to the filesystem root, without a leading slash. Only plain
+ * absolute paths can be hashed; paths containing ".", ".." or empty
+ * tokens must be resolved through the linear walk instead.
+ *
+ * @param[in]  path
+ *             Absolute path (pointing after the leading '/')
+ * @param[out] hash
+ *             The computed hash of the path
+ *
+ * @return True if the path could be hashed, false if the caller must
+ *         fall back to #recurse_path.
+ */
+static bool hash_path(const char *path, uint64_t *hash)
+{
+    uint64_t h = DFS_FNV1A_OFFSET;
+    int token_len = 0;
+
+    for(;; path++)
+    {
+        if(path[0] == '/' || path[0] == 0)
+        {
+            /* Reject empty, "." and ".." tokens: the index stores none of
+               those, and they would hash a different string than the
+               canonical path. */
+            if(token_len == 0 || (token_len <= 2 && strncmp(path - token_len, "..", token_len) == 0))
+            {
+                return false;
+            }
+
+            if(path[0] == 0)
+            {
+                break;
+            }
+
+            token_len = 0;
+        }
+        else
+        {
+            token_len++;
+        }
+
+        h = (h ^ (uint8_t)path[0]) * DFS_FNV1A_PRIME;
+    }
+
+    *hash = h;
+    return true;
+}
+
+/**
+ * @brief Find a file's directory entry through the path lookup index
+ *
+ * Binary searches the hash index appended to the image by mkdfs, reading
+ * one entry per probe from ROM. This turns a file open from a linear walk
+ * of one sector DMA per directory entry into O(log n) word reads.
+ *
+ * The image to search is passed explicitly, so that the same search serves
+ * both the base filesystem and a mounted overlay (see #dfs_init_overlay).
+ *
+ * @param[in] path
+ *            Path of the file to find
+ * @param[in] fs_base
+ *            Location of the filesystem the index belongs to
+ * @param[in] lkp_ptr
+ *            Location of the path lookup index (0 = image has no index)
+ * @param[in] lkp_count
+ *            Number of entries in the path lookup index
+ *
+ * @return The directory entry of the file, or NULL if the image has no
+ *         index, the path cannot be hashed, or no entry matches (the
+ *         caller must then fall back to the linear walk).
+ */
+static directory_entry_t *find_dirent_hashed(const char *path, uint32_t fs_base, uint32_t lkp_ptr, uint32_t lkp_count)
+{
+    if(!lkp_ptr || path[0] != '/')
+    {
+        return 0;
+    }
+
+    uint64_t hash;
+    if(!hash_path(path + 1, &hash))
+    {
+        return 0;
+    }
+
+    uint32_t entries = (lkp_ptr + sizeof(struct dfs_lookup_header)) & 0x1FFFFFFF;
+    int lo = 0, hi = lkp_count - 1;
+
+    while(lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        uint32_t addr = entries + mid * sizeof(struct dfs_lookup_entry);
+
+        uint64_t probe = ((uint64_t)io_read(addr) << 32) | io_read(addr + 4);
+
+        if(probe == hash)
+        {
+            return (directory_entry_t *)(io_read(addr + 8) + fs_base);
+        }
+
+        if(probe < hash)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * @brief Walk a path string, either changing directories or finding the right path
  *
@@ -622,6 +825,76 @@ static int recurse_path(const char * const path, int mode, directory_entry_t **d
     return ret;
 }
 
+/**
+ * @brief Find the directory entry of a file, using the lookup index if possible
+ *
+ * Resolves a path to a file through the hash index when the image has one,
+ * falling back to the linear directory walk for old images, relative paths
+ * and (astronomically unlikely) hash collisions.
+ *
+ * When an overlay is mounted (see #dfs_init_overlay), its index is searched
+ * first: files present in the patch image shadow their base counterparts,
+ * and everything else falls through to the base filesystem.
+ *
+ * @param[in]  path
+ *             Path of the file to find
+ * @param[out] node
+ *             The directory entry of the file, fetched from ROM
+ *
+ * @return DFS_ESUCCESS on success or a negative value on error.
+ */
+static int find_file_entry(const char * const path, directory_entry_t *node)
+{
+    directory_entry_t *dirent;
+
+    if(overlay_ptr)
+    {
+        dirent = find_dirent_hashed(path, overlay_ptr, overlay_lookup_ptr, overlay_lookup_count);
+
+        if(dirent)
+        {
+            grab_sector(dirent, node);
+
+            /* Guard against a hash collision: the entry must be a file with
+               the same name as the last token of the path. On a collision,
+               fall through to the base filesystem. */
+            const char *leaf = strrchr(path, '/') + 1;
+
+            if(FILETYPE(get_flags(node)) == FLAGS_FILE && strcmp(node->path, leaf) == 0)
+            {
+                return DFS_ESUCCESS;
+            }
+        }
+    }
+
+    dirent = find_dirent_hashed(path, base_ptr, lookup_ptr, lookup_count);
+
+    if(dirent)
+    {
+        grab_sector(dirent, node);
+
+        /* Guard against a hash collision: the entry must be a file with the
+           same name as the last token of the path. */
+        const char *leaf = strrchr(path, '/') + 1;
+
+        if(FILETYPE(get_flags(node)) == FLAGS_FILE && strcmp(node->path, leaf) == 0)
+        {
+            return DFS_ESUCCESS;
+        }
+    }
+
+    /* No index, unhashable path or collision: walk the directory entries */
+    int ret = recurse_path(path, WALK_OPEN, &dirent, TYPE_FILE);
+
+    if(ret != DFS_ESUCCESS)
+    {
+        return ret;
+    }
+
+    grab_sector(dirent, node);
+    return DFS_ESUCCESS;
+}
+
 /**
  * @brief Helper functioner to initialize the filesystem
  *
@@ -643,7 +916,35 @@ static int __dfs_init(uint32_t base_fs_loc)
         base_ptr = base_fs_loc;
         clear_directory();
 
+        /* Reset the handle pool: all slots free */
         memset(open_files, 0, sizeof(open_files));
+        num_free_slots = 0;
+        for(int i = MAX_OPEN_FILES - 1; i >= 0; i--)
+        {
+            free_slots[num_free_slots++] = i;
+        }
+
+        /* A fresh init always starts without an overlay: #dfs_init_overlay
+           mounts it again afterwards */
+        overlay_ptr = 0;
+        overlay_lookup_ptr = 0;
+        overlay_lookup_count = 0;
+
+        /* Look for the optional path lookup index: mkdfs stores its offset
+           in the (otherwise unused) file_pointer of the root sector. */
+        lookup_ptr = 0;
+        lookup_count = 0;
+
+        if(id_node.file_pointer)
+        {
+            uint32_t index = (base_fs_loc + id_node.file_pointer) & 0x1FFFFFFF;
+
+            if(io_read(index) == DFS_LOOKUP_MAGIC)
+            {
+                lookup_ptr = base_fs_loc + id_node.file_pointer;
+                lookup_count = io_read(index + 4);
+            }
+        }
 
         /* Good FS */
         return DFS_ESUCCESS;
@@ -654,7 +955,45 @@ static int __dfs_init(uint32_t base_fs_loc)
 }
 
 /**
- * @brief Change directories to the specified path.  
+ * @brief Mount a patch image over the base filesystem
+ *
+ * Validates the patch image the same way #__dfs_init validates the base
+ * one, and records the location of its path lookup index. The overlay is
+ * only ever consulted through that index (see #find_file_entry), so a
+ * patch image without one cannot be mounted; mkdfs always emits it.
+ *
+ * @param[in] patch_fs_loc
+ *            Location of the patch filesystem
+ *
+ * @return DFS_ESUCCESS on success or a negative error on failure.
+ */
+static int __dfs_overlay_mount(uint32_t patch_fs_loc)
+{
+    directory_entry_t id_node;
+    grab_sector((void *)patch_fs_loc, &id_node);
+
+    if(id_node.flags != ROOT_FLAGS || id_node.next_entry != ROOT_NEXT_ENTRY ||
+        strcmp(id_node.path, ROOT_PATH) != 0 || !id_node.file_pointer)
+    {
+        return DFS_EBADFS;
+    }
+
+    uint32_t index = (patch_fs_loc + id_node.file_pointer) & 0x1FFFFFFF;
+
+    if(io_read(index) != DFS_LOOKUP_MAGIC)
+    {
+        return DFS_EBADFS;
+    }
+
+    overlay_lookup_ptr = patch_fs_loc + id_node.file_pointer;
+    overlay_lookup_count = io_read(index + 4);
+    overlay_ptr = patch_fs_loc;
+
+    return DFS_ESUCCESS;
+}
+
+/**
+ * @brief Change directories to the specified path.
  *
  * Supports absolute and relative 
  *
@@ -665,6 +1004,12 @@ static int __dfs_init(uint32_t base_fs_loc)
  */
 int dfs_chdir(const char * const path)
 {
+    int err = __dfs_ensure_init();
+    if(err != DFS_ESUCCESS)
+    {
+        return err;
+    }
+
     /* Reset directory listing */
     next_entry = 0;
 
@@ -677,6 +1022,49 @@ int dfs_chdir(const char * const path)
     return recurse_path(path, WALK_CHDIR, 0, TYPE_ANY);
 }
 
+/**
+ * @brief Yield one directory entry from the sector already in RAM
+ *
+ * Copies the name (and, for the extended iteration API, the metadata)
+ * out of a directory sector, and returns the entry flags. All fields
+ * come from the same sector, so no extra PI reads are performed.
+ *
+ * @param[in]  t_node
+ *             Directory sector of the entry
+ * @param[out] buf
+ *             Buffer to place the name of the entry, or NULL
+ * @param[out] entry
+ *             Structure to fill with name and metadata, or NULL
+ *
+ * @return The flags (#FLAGS_FILE, #FLAGS_DIR) of the entry
+ */
+static int dir_entry_yield(directory_entry_t *t_node, char *buf, dfs_dirent_t *entry)
+{
+    if(buf)
+    {
+        strcpy(buf, t_node->path);
+    }
+
+    if(entry)
+    {
+        strcpy(entry->name, t_node->path);
+        entry->flags = get_flags(t_node);
+
+        if(FILETYPE(entry->flags) == FLAGS_FILE)
+        {
+            entry->size = get_size(t_node);
+            entry->rom_addr = get_start_location(t_node);
+        }
+        else
+        {
+            entry->size = 0;
+            entry->rom_addr = 0;
+        }
+    }
+
+    return get_flags(t_node);
+}
+
 /**
  * @brief Find the first file or directory in a directory listing.
  *
@@ -686,12 +1074,20 @@ int dfs_chdir(const char * const path)
  * @param[in]  path
  *             The path to look for files in
  * @param[out] buf
- *             Buffer to place the name of the file or directory found
+ *             Buffer to place the name of the file or directory found, or NULL
+ * @param[out] entry
+ *             Structure to fill with name and metadata, or NULL
  *
  * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
  */
-int dfs_dir_findfirst(const char * const path, char *buf)
+static int __dfs_dir_findfirst(const char * const path, char *buf, dfs_dirent_t *entry)
 {
+    int err = __dfs_ensure_init();
+    if(err != DFS_ESUCCESS)
+    {
+        return err;
+    }
+
     directory_entry_t *dirent;
     int ret = recurse_path(path, WALK_OPEN, &dirent, TYPE_DIR);
 
@@ -708,28 +1104,64 @@ int dfs_dir_findfirst(const char * const path, char *buf)
     directory_entry_t t_node;
     grab_sector(dirent, &t_node);
 
-    if(buf)
-    {
-        strcpy(buf, t_node.path);    
-    }
-    
     /* Set up directory to point to next entry */
     next_entry = get_next_entry(&t_node);
 
-    return get_flags(&t_node);
+    return dir_entry_yield(&t_node, buf, entry);
+}
+
+/**
+ * @brief Find the first file or directory in a directory listing.
+ *
+ * Supports absolute and relative.  If the path is invalid, returns a negative DFS_errno.  If
+ * a file or directory is found, returns the flags of the entry and copies the name into buf.
+ *
+ * @param[in]  path
+ *             The path to look for files in
+ * @param[out] buf
+ *             Buffer to place the name of the file or directory found
+ *
+ * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
+ */
+int dfs_dir_findfirst(const char * const path, char *buf)
+{
+    return __dfs_dir_findfirst(path, buf, 0);
+}
+
+/**
+ * @brief Find the first file or directory in a directory listing, with metadata.
+ *
+ * Like #dfs_dir_findfirst, but also fills a #dfs_dirent_t with the size,
+ * type and starting ROM address of the entry, straight from the directory
+ * sector that the iteration has already read. This makes it possible to
+ * list a directory with full metadata in one pass, without a
+ * #dfs_open/#dfs_size/#dfs_close round-trip (and its PI reads) per entry.
+ *
+ * @param[in]  path
+ *             The path to look for files in
+ * @param[out] entry
+ *             Structure filled with the name and metadata of the entry found
+ *
+ * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
+ */
+int dfs_dir_findfirst_ext(const char * const path, dfs_dirent_t *entry)
+{
+    return __dfs_dir_findfirst(path, 0, entry);
 }
 
 /**
- * @brief Find the next file or directory in a directory listing. 
+ * @brief Find the next file or directory in a directory listing.
  *
  * @note Should be called after doing a #dfs_dir_findfirst.
  *
  * @param[out] buf
- *             Buffer to place the name of the next file or directory found
+ *             Buffer to place the name of the next file or directory found, or NULL
+ * @param[out] entry
+ *             Structure to fill with name and metadata, or NULL
  *
  * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
  */
-int dfs_dir_findnext(char *buf)
+static int __dfs_dir_findnext(char *buf, dfs_dirent_t *entry)
 {
     if(!next_entry)
     {
@@ -741,58 +1173,151 @@ int dfs_dir_findnext(char *buf)
     directory_entry_t t_node;
     grab_sector(next_entry, &t_node);
 
-    if(buf)
-    {
-        strcpy(buf, t_node.path);    
-    }
-    
     /* Set up directory to point to next entry */
     next_entry = get_next_entry(&t_node);
 
-    return get_flags(&t_node);
+    return dir_entry_yield(&t_node, buf, entry);
 }
 
 /**
- * @brief Open a file given a path
+ * @brief Find the next file or directory in a directory listing.
  *
- * Check if we have any free file handles, and if we do, try
- * to open the file specified.  Supports absolute and relative
- * paths
+ * @note Should be called after doing a #dfs_dir_findfirst.
  *
- * @param[in] path
- *            Path of the file to open
+ * @param[out] buf
+ *             Buffer to place the name of the next file or directory found
  *
- * @return A valid file handle to reference the file by or a negative error on failure.
+ * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
  */
-int dfs_open(const char * const path)
+int dfs_dir_findnext(char *buf)
 {
-    /* Ensure we always open with a unique handle */
-    static uint32_t next_handle = 1;
+    return __dfs_dir_findnext(buf, 0);
+}
 
-    /* Try to find a free slot */
-    open_file_t *file = find_free_file();
+/**
+ * @brief Find the next file or directory in a directory listing, with metadata.
+ *
+ * @note Should be called after doing a #dfs_dir_findfirst_ext.
+ *
+ * @param[out] entry
+ *             Structure filled with the name and metadata of the next entry found
+ *
+ * @return The flags (#FLAGS_FILE, #FLAGS_DIR, #FLAGS_EOF) or a negative value on error.
+ */
+int dfs_dir_findnext_ext(dfs_dirent_t *entry)
+{
+    return __dfs_dir_findnext(0, entry);
+}
 
-    if(!file)
+/**
+ * @brief Record a path in the load-order profile, the first time it is opened
+ *
+ * @param[in] path
+ *            Path of the file being opened
+ */
+static void profile_record(const char *path)
+{
+    /* Store paths relative to the image root, matching mkdfs */
+    if(path[0] == '/')
     {
-        return DFS_ENFILE;        
+        path++;
     }
 
-    /* Try to find file */
-    directory_entry_t *dirent;
-    int ret = recurse_path(path, WALK_OPEN, &dirent, TYPE_FILE);
-
-    if(ret != DFS_ESUCCESS)
+    for(int i = 0; i < profile_count; i++)
     {
-        /* File not found, or other error */
-        return ret;
+        if(strcmp(profile_paths[i], path) == 0)
+        {
+            return;
+        }
     }
 
-    /* We now have the pointer to the file entry */
+    if(profile_count == profile_capacity)
+    {
+        profile_capacity = profile_capacity ? profile_capacity * 2 : 64;
+        profile_paths = realloc(profile_paths, profile_capacity * sizeof(char *));
+    }
+
+    profile_paths[profile_count++] = strdup(path);
+}
+
+/**
+ * @brief Discard any recorded load order and stop recording
+ */
+static void profile_clear(void)
+{
+    for(int i = 0; i < profile_count; i++)
+    {
+        free(profile_paths[i]);
+    }
+
+    free(profile_paths);
+    profile_paths = NULL;
+    profile_count = 0;
+    profile_capacity = 0;
+    profile_recording = false;
+}
+
+void dfs_profile_start(void)
+{
+    profile_clear();
+    profile_recording = true;
+}
+
+void dfs_profile_dump(void)
+{
+    for(int i = 0; i < profile_count; i++)
+    {
+        debugf("%s\n", profile_paths[i]);
+    }
+
+    profile_clear();
+}
+
+/**
+ * @brief Open a file given a path
+ *
+ * Check if we have any free file handles, and if we do, try
+ * to open the file specified.  Supports absolute and relative
+ * paths
+ *
+ * @param[in] path
+ *            Path of the file to open
+ *
+ * @return A valid file handle to reference the file by or a negative error on failure.
+ */
+int dfs_open(const char * const path)
+{
+    int err = __dfs_ensure_init();
+    if(err != DFS_ESUCCESS)
+    {
+        return err;
+    }
+
+    /* Try to acquire a slot from the handle pool */
+    open_file_t *file = file_alloc();
+
+    if(!file)
+    {
+        return DFS_ENFILE;
+    }
+
+    /* Try to find file */
     directory_entry_t t_node;
-    grab_sector(dirent, &t_node);
+    int ret = find_file_entry(path, &t_node);
+
+    if(ret != DFS_ESUCCESS)
+    {
+        /* File not found, or other error */
+        file_free(file);
+        return ret;
+    }
+
+    if(profile_recording)
+    {
+        profile_record(path);
+    }
 
     /* Set up file handle */
-    file->handle = next_handle++;
     file->size = get_size(&t_node);
     file->loc = 0;
     file->cart_start_loc = get_start_location(&t_node);
@@ -818,8 +1343,16 @@ int dfs_close(uint32_t handle)
         return DFS_EBADHANDLE;
     }
 
-    /* Closing the handle is easy as zeroing out the file */
-    memset(file, 0, sizeof(open_file_t));
+    /* Release the read-ahead buffer, if any (waiting for an in-flight
+       prefetch DMA, which targets the buffer we are about to free) */
+    if(file->prefetch_buf)
+    {
+        while(prefetch_async.pending && prefetch_async.file == file) { ; }
+        free(file->prefetch_buf);
+    }
+
+    /* Closing the handle just returns the slot to the pool */
+    file_free(file);
 
     return DFS_ESUCCESS;
 }
@@ -898,6 +1431,13 @@ int dfs_seek(uint32_t handle, int offset, int origin)
         file->loc = file->size;
     }
 
+    /* Seeking invalidates the read-ahead window */
+    if(file->prefetch_window)
+    {
+        while(prefetch_async.pending && prefetch_async.file == file) { ; }
+        file->prefetch_valid = 0;
+    }
+
     return DFS_ESUCCESS;
 }
 
@@ -922,6 +1462,307 @@ int dfs_tell(uint32_t handle)
     return file->loc;
 }
 
+/**
+ * @brief Read file data through the per-file cached buffer
+ *
+ * This is the slow path shared by #dfs_read and #dfs_read_async: data is
+ * DMA'd into the 8-byte aligned cached buffer of the file and then copied
+ * to the destination with the CPU, which realigns it in the process. Used
+ * for reads whose ROM location, destination or length do not satisfy the
+ * PI DMA alignment rules, and for the unaligned head/tail of async reads.
+ *
+ * @param[in]  file
+ *             The open file to read from (its location is advanced)
+ * @param[out] data
+ *             Buffer to read into
+ * @param[in]  to_read
+ *             Number of bytes to read (already bounds-checked)
+ *
+ * @return The number of bytes read
+ */
+static int __dfs_read_cached(open_file_t *file, uint8_t *data, int to_read)
+{
+    const int CACHED_SIZE = sizeof(file->cached_data);
+    int did_read = 0;
+
+    /* Loop in, reading data in the cached buffer */
+    while(to_read)
+    {
+        /* Check if we need to read into the cached buffer */
+        if (file->loc < file->cached_loc || file->loc >= file->cached_loc+CACHED_SIZE)
+        {
+            /* We need to read from a 8-byte aligned location, so calculate it */
+            file->cached_loc = file->loc & ~7;
+
+            /* Invalidate the cached data. No need to writeback here because
+               CACHE_SIZE is a multiple of 16 bytes and the data is aligned,
+               so the cachelines are not shared with other variables. */
+            data_cache_hit_invalidate(file->cached_data, CACHED_SIZE);
+
+            dma_read((void *)(((uint32_t)file->cached_data) & 0x1FFFFFFF),
+                file->cart_start_loc + file->cached_loc, CACHED_SIZE);
+        }
+
+        /* Pull as much data as we can from the current buffer */
+        int copy = file->cached_loc+CACHED_SIZE - file->loc;
+        if (copy > to_read)
+            copy = to_read;
+
+        memcpy(data, file->cached_data + (file->loc - file->cached_loc), copy);
+
+        file->loc += copy;
+        data += copy;
+        to_read -= copy;
+        did_read += copy;
+    }
+
+    return did_read;
+}
+
+/** @brief Cache holding the most recently fetched small-file cluster */
+static uint8_t cluster_cache[CLUSTER_SIZE] __attribute__((aligned(16)));
+/** @brief Absolute cartspace address of the cached cluster (0: cache empty;
+ *         valid cluster addresses are always in cartridge space, never 0) */
+static uint32_t cluster_cache_base = 0;
+
+/**
+ * @brief Read a small file through the shared cluster cache
+ *
+ * mkdfs packs small files back to back into #CLUSTER_SIZE clusters, so
+ * fetching the whole aligned cluster around the requested data with one DMA
+ * typically also brings in the neighboring tiny files: a burst of small
+ * reads (entity definitions, scripts) costs one PI transaction instead of
+ * one per read. The ROM is immutable, so the cache can never go stale; it
+ * is simply replaced when a read falls outside of it. Like the rest of the
+ * synchronous read path, this is not reentrant.
+ *
+ * @param[in]  file
+ *             The open file to read from (its location is advanced)
+ * @param[out] data
+ *             Buffer to read into
+ * @param[in]  to_read
+ *             Number of bytes to read (already bounds-checked)
+ *
+ * @return The number of bytes read
+ */
+static int __dfs_read_clustered(open_file_t *file, uint8_t *data, int to_read)
+{
+    int did_read = 0;
+
+    while(to_read)
+    {
+        uint32_t loc = file->cart_start_loc + file->loc;
+        uint32_t cluster = loc & ~(CLUSTER_SIZE - 1);
+
+        if(cluster_cache_base != cluster)
+        {
+            data_cache_hit_writeback_invalidate(cluster_cache, CLUSTER_SIZE);
+
+            dma_read((void *)(((uint32_t)cluster_cache) & 0x1FFFFFFF),
+                cluster, CLUSTER_SIZE);
+
+            cluster_cache_base = cluster;
+        }
+
+        /* Pull as much data as the cached cluster covers */
+        int copy = cluster + CLUSTER_SIZE - loc;
+        if (copy > to_read)
+            copy = to_read;
+
+        memcpy(data, cluster_cache + (loc - cluster), copy);
+
+        file->loc += copy;
+        data += copy;
+        to_read -= copy;
+        did_read += copy;
+    }
+
+    return did_read;
+}
+
+/**
+ * @brief Opportunistically start a read-ahead DMA for a sequential file
+ *
+ * Called after a read completes on a file with a read-ahead window
+ * configured (see #dfs_advise_sequential). If the PI bus is idle and the
+ * next window is not already buffered, start an asynchronous DMA of the
+ * next #open_file_t::prefetch_window bytes; completion is handled by the
+ * PI interrupt. This is only a hint: whenever alignment or bus state make
+ * the prefetch inconvenient, it is simply skipped.
+ *
+ * @param[in] file
+ *            File to prefetch
+ */
+static void __dfs_prefetch_start(open_file_t *file)
+{
+    if(!file->prefetch_window || prefetch_async.pending)
+    {
+        return;
+    }
+
+    uint32_t loc = file->loc;
+
+    /* Nothing to do if the current position is already buffered */
+    if(file->prefetch_valid && loc >= file->prefetch_loc &&
+        loc < file->prefetch_loc + file->prefetch_valid)
+    {
+        return;
+    }
+
+    /* Clamp at EOF, and keep the DMA length even (see the alignment
+       rules in #dfs_read) */
+    int len = file->prefetch_window;
+    if(loc + len > file->size)
+    {
+        len = file->size - loc;
+    }
+    len &= ~1;
+
+    /* The ROM location must be 2-byte aligned for DMA */
+    if(len <= 0 || ((file->cart_start_loc + loc) & 1))
+    {
+        return;
+    }
+
+    disable_interrupts();
+
+    if(!prefetch_async.pending && !read_async.pending && !dma_busy())
+    {
+        data_cache_hit_writeback_invalidate(file->prefetch_buf, len);
+
+        file->prefetch_loc = loc;
+        file->prefetch_valid = 0;
+
+        prefetch_async.file = file;
+        prefetch_async.len = len;
+        prefetch_async.pending = true;
+
+        dma_read_raw_async((void *)(((uint32_t)file->prefetch_buf) & 0x1FFFFFFF),
+            file->cart_start_loc + loc, len);
+    }
+
+    enable_interrupts();
+}
+
+/**
+ * @brief Serve (part of) a read from the read-ahead buffer
+ *
+ * If the requested data is covered by the prefetched window (or by the
+ * prefetch DMA currently in flight, in which case we wait for it: it was
+ * started well before the read, so it is typically already done), copy it
+ * out and advance the file position. Partial coverage is fine: the caller
+ * reads the remainder through the normal path.
+ *
+ * @param[in]  file
+ *             File being read
+ * @param[out] buf
+ *             Destination buffer
+ * @param[in]  to_read
+ *             Number of bytes requested
+ *
+ * @return The number of bytes served from the buffer (possibly 0)
+ */
+static int __dfs_prefetch_serve(open_file_t *file, uint8_t *buf, int to_read)
+{
+    /* If the window covering this position is still in flight, wait for it */
+    if(prefetch_async.pending && prefetch_async.file == file &&
+        file->loc >= file->prefetch_loc &&
+        file->loc < file->prefetch_loc + prefetch_async.len)
+    {
+        while(prefetch_async.pending) { ; }
+    }
+
+    if(!file->prefetch_valid || file->loc < file->prefetch_loc ||
+        file->loc >= file->prefetch_loc + file->prefetch_valid)
+    {
+        return 0;
+    }
+
+    int offset = file->loc - file->prefetch_loc;
+    int copy = file->prefetch_valid - offset;
+    if(copy > to_read)
+    {
+        copy = to_read;
+    }
+
+    memcpy(buf, file->prefetch_buf + offset, copy);
+    file->loc += copy;
+
+    return copy;
+}
+
+/**
+ * @brief Enable sequential read-ahead on an open file
+ *
+ * Advises DragonFS that the file will be read sequentially. After each
+ * #dfs_read, the next @p window bytes are prefetched with an asynchronous
+ * PI DMA, so subsequent reads are served straight from RDRAM with
+ * near-zero latency; the DMA runs while the caller is processing the data
+ * it just read. This is ideal for streaming (video, music), where reads
+ * are strictly sequential and the window can be sized to one streaming
+ * chunk.
+ *
+ * This is purely a hint: reads outside the prefetched window, or files
+ * read while the PI bus happens to be busy, simply take the normal path.
+ * Seeking invalidates the window. Call with a @p window of 0 to disable
+ * read-ahead and free the buffer (this also happens on #dfs_close).
+ *
+ * @param[in] handle
+ *            A valid file handle as returned from #dfs_open.
+ * @param[in] window
+ *            Size of the read-ahead window in bytes (rounded up to a
+ *            multiple of 16), or 0 to disable read-ahead
+ *
+ * @return DFS_ESUCCESS on success or a negative value on error.
+ */
+int dfs_advise_sequential(uint32_t handle, int window)
+{
+    open_file_t *file = find_open_file(handle);
+
+    if(!file)
+    {
+        return DFS_EBADHANDLE;
+    }
+
+    if(window < 0)
+    {
+        return DFS_EBADINPUT;
+    }
+
+    /* Tear down any previous window */
+    if(file->prefetch_buf)
+    {
+        while(prefetch_async.pending && prefetch_async.file == file) { ; }
+        free(file->prefetch_buf);
+        file->prefetch_buf = 0;
+        file->prefetch_window = 0;
+        file->prefetch_valid = 0;
+    }
+
+    if(window == 0)
+    {
+        return DFS_ESUCCESS;
+    }
+
+    /* Round up to a multiple of 16, so the buffer never shares a cacheline
+       with other data (see the coherency notes on open_file_t) */
+    window = (window + 15) & ~15;
+
+    file->prefetch_buf = memalign(16, window);
+    if(!file->prefetch_buf)
+    {
+        return DFS_ENOMEM;
+    }
+
+    file->prefetch_window = window;
+    file->prefetch_valid = 0;
+
+    /* Warm the window immediately */
+    __dfs_prefetch_start(file);
+
+    return DFS_ESUCCESS;
+}
+
 /**
  * @brief Read data from a file
  *
@@ -953,7 +1794,6 @@ int dfs_read(void * const buf, int size, int count, uint32_t handle)
     }
 
     int to_read = size * count;
-    int did_read = 0;
 
     /* Bounds check to make sure we don't read past the end */
     if(file->loc + to_read > file->size)
@@ -965,6 +1805,32 @@ int dfs_read(void * const buf, int size, int count, uint32_t handle)
     if (!to_read)
         return 0;
 
+    /* Serve what we can from the read-ahead buffer (see
+     * #dfs_advise_sequential); the remainder goes through the normal
+     * path, and a new prefetch is kicked off before returning. */
+    uint8_t *data = buf;
+    int served = 0;
+    if (file->prefetch_window)
+    {
+        served = __dfs_prefetch_serve(file, data, to_read);
+        data += served;
+        to_read -= served;
+
+        if (!to_read)
+        {
+            __dfs_prefetch_start(file);
+            return served;
+        }
+    }
+
+    /* Small files are served through the shared cluster cache: mkdfs packs
+     * them adjacently, so one cluster fetch covers many of them (see
+     * #__dfs_read_clustered). */
+    if (file->size <= CLUSTER_FILE_MAX)
+    {
+        return served + __dfs_read_clustered(file, data, to_read);
+    }
+
     /* Fast-path. If possibly, we want to DMA directly into the destination
      * buffer, without using any intermediate buffers. The rules are convoluted
      * because we try to squeeze maximum performance here and thus we rely also
@@ -977,61 +1843,208 @@ int dfs_read(void * const buf, int size, int count, uint32_t handle)
      *     or even.
      */
     bool rom_aligned = (file->loc & 1) == 0;
-    bool ram_aligned = ((uint32_t)buf & 7) == 0;
+    bool ram_aligned = ((uint32_t)data & 7) == 0;
     bool len_aligned = (to_read < 0x7F) || ((to_read & 1) == 0);
     if (rom_aligned && ram_aligned && len_aligned)
     {
         /* 16-byte alignment: we can simply invalidate the buffer.
          * 8-byte alignment: we need to also writeback in case the partial
          *  cachelines have hot data to write back. */
-        if ((((uint32_t)buf | to_read) & 15) == 0)
-            data_cache_hit_invalidate(buf, to_read);
+        if ((((uint32_t)data | to_read) & 15) == 0)
+            data_cache_hit_invalidate(data, to_read);
         else
-            data_cache_hit_writeback_invalidate(buf, to_read);
+            data_cache_hit_writeback_invalidate(data, to_read);
 
-        dma_read((void *)(((uint32_t)buf) & 0x1FFFFFFF),
+        dma_read((void *)(((uint32_t)data) & 0x1FFFFFFF),
             file->cart_start_loc + file->loc, to_read);
 
         file->loc += to_read;
-        return to_read;
+
+        if (file->prefetch_window)
+            __dfs_prefetch_start(file);
+
+        return served + to_read;
     }
 
-    /* Something we can actually increment! */
-    uint8_t *data = buf;
-    const int CACHED_SIZE = sizeof(file->cached_data);
+    /* Read through the file's cached buffer, realigning on the CPU */
+    int ret = __dfs_read_cached(file, data, to_read);
 
-    /* Loop in, reading data in the cached buffer */
-    while(to_read)
+    if (file->prefetch_window)
+        __dfs_prefetch_start(file);
+
+    return served + ret;
+}
+
+/**
+ * @brief PI interrupt handler for asynchronous reads
+ *
+ * Invoked at the end of every PI DMA transfer. If an asynchronous read is
+ * in flight, finish it: read the odd tail byte (if any) through the cached
+ * buffer, then notify the caller.
+ */
+static void __dfs_pi_callback(void)
+{
+    /* Read-ahead and asynchronous reads are never in flight together
+       (see #__dfs_prefetch_start), so the attribution is unambiguous. */
+    if (prefetch_async.pending)
     {
-        /* Check if we need to read into the cached buffer */
-        if (file->loc < file->cached_loc || file->loc >= file->cached_loc+CACHED_SIZE)
-        {
-            /* We need to read from a 8-byte aligned location, so calculate it */
-            file->cached_loc = file->loc & ~7;
+        prefetch_async.file->prefetch_valid = prefetch_async.len;
+        prefetch_async.pending = false;
+        return;
+    }
 
-            /* Invalidate the cached data. No need to writeback here because
-               CACHE_SIZE is a multiple of 16 bytes and the data is aligned,
-               so the cachelines are not shared with other variables. */
-            data_cache_hit_invalidate(file->cached_data, CACHED_SIZE);
+    if (!read_async.pending)
+        return;
 
-            dma_read((void *)(((uint32_t)file->cached_data) & 0x1FFFFFFF),
-                file->cart_start_loc + file->cached_loc, CACHED_SIZE);
-        }
+    open_file_t *file = read_async.file;
+    file->loc += read_async.body;
+
+    int total = read_async.total + read_async.body;
+    if (read_async.tail)
+        total += __dfs_read_cached(file, read_async.data + read_async.body, read_async.tail);
+
+    read_async.pending = false;
+    if (read_async.callback)
+        read_async.callback(total, read_async.ctx);
+}
+
+/**
+ * @brief Start an asynchronous read from a file
+ *
+ * This is the asynchronous version of #dfs_read: it starts a PI DMA transfer
+ * into the destination buffer and returns immediately, so the CPU is free to
+ * do other work while the data is being fetched from ROM. Completion is
+ * notified via the PI interrupt: the optional callback is invoked (in
+ * interrupt context) with the number of bytes read, and #dfs_read_async_busy
+ * can be polled as an alternative.
+ *
+ * The same alignment rules of #dfs_read apply. An unaligned head and an odd
+ * tail are read on the CPU through the file's cached buffer (the head before
+ * starting the DMA, the tail from the completion interrupt), so any buffer,
+ * file position and length are accepted. When the alignment between the ROM
+ * location and the destination buffer makes DMA impossible (they have a
+ * different parity), the read silently degrades to a synchronous one: the
+ * callback is invoked before this function returns.
+ *
+ * Only one asynchronous read can be in flight at any given time; starting a
+ * second one before the first has completed is an error. Calling #dfs_read
+ * or #dfs_seek on the same file while a read is in flight is also an error.
+ *
+ * @param[out] buf
+ *             Buffer to read into
+ * @param[in]  size
+ *             Size of each element to read
+ * @param[in]  count
+ *             Number of elements to read
+ * @param[in]  handle
+ *             A valid file handle as returned from #dfs_open.
+ * @param[in]  callback
+ *             Function invoked when the read completes (can be NULL)
+ * @param[in]  ctx
+ *             Opaque argument passed to the callback
+ *
+ * @return The number of bytes that will be read, or a negative value on
+ *         failure (in which case the callback is not invoked).
+ */
+int dfs_read_async(void * const buf, int size, int count, uint32_t handle,
+    dfs_read_callback_t callback, void *ctx)
+{
+    open_file_t *file = find_open_file(handle);
+
+    if(!file)
+    {
+        return DFS_EBADHANDLE;
+    }
+
+    if(!buf)
+    {
+        return DFS_EBADINPUT;
+    }
+
+    assertf(!read_async.pending, "dfs_read_async: a read is already in flight");
+
+    /* Wait out any in-flight read-ahead DMA: only one DFS transfer can be
+       pending at a time, or the completion interrupt becomes ambiguous */
+    while(prefetch_async.pending) { ; }
+
+    int to_read = size * count;
+
+    /* Bounds check to make sure we don't read past the end */
+    if(file->loc + to_read > file->size)
+    {
+        to_read = file->size - file->loc;
+    }
 
-        /* Pull as much data as we can from the current buffer */
-        int copy = file->cached_loc+CACHED_SIZE - file->loc;
-        if (copy > to_read)
-            copy = to_read;
+    if (!to_read)
+    {
+        if (callback)
+            callback(0, ctx);
+        return 0;
+    }
 
-        memcpy(data, file->cached_data + (file->loc - file->cached_loc), copy);
+    uint8_t *data = buf;
+    int did_read = 0;
 
-        file->loc += copy;
-        data += copy;
-        to_read -= copy;
-        did_read += copy;
+    /* Read the unaligned head on the CPU, so that the destination of the DMA
+     * is 8-byte aligned (see the alignment rules in #dfs_read). */
+    int head = (8 - ((uint32_t)data & 7)) & 7;
+    if (head > to_read)
+        head = to_read;
+
+    /* The head realignment only works if ROM and RAM have the same parity:
+     * the ROM location must still be even once the destination is aligned.
+     * If it is not (or nothing would be left for the DMA anyway), fall back
+     * to a synchronous read and complete immediately. */
+    if (((file->loc + head) & 1) || head == to_read)
+    {
+        int ret = dfs_read(buf, 1, to_read, handle);
+        if (callback)
+            callback(ret, ctx);
+        return ret;
     }
 
-    return did_read;
+    if (head)
+    {
+        did_read = __dfs_read_cached(file, data, head);
+        data += head;
+    }
+
+    /* Split off an odd tail byte if the length does not satisfy the DMA
+     * length rule; it will be read on the CPU from the completion handler. */
+    int body = to_read - head;
+    int tail = (body >= 0x7F && (body & 1)) ? 1 : 0;
+    body -= tail;
+
+    /* Same cache handling as the #dfs_read fast path */
+    if ((((uint32_t)data | body) & 15) == 0)
+        data_cache_hit_invalidate(data, body);
+    else
+        data_cache_hit_writeback_invalidate(data, body);
+
+    disable_interrupts();
+    read_async.file = file;
+    read_async.data = data;
+    read_async.body = body;
+    read_async.tail = tail;
+    read_async.total = did_read;
+    read_async.callback = callback;
+    read_async.ctx = ctx;
+    read_async.pending = true;
+    dma_read_raw_async((void *)(((uint32_t)data) & 0x1FFFFFFF),
+        file->cart_start_loc + file->loc, body);
+    enable_interrupts();
+
+    return did_read + body + tail;
+}
+
+/**
+ * @brief Check whether an asynchronous read is still in flight
+ *
+ * @return True if a read started by #dfs_read_async has not completed yet.
+ */
+bool dfs_read_async_busy(void)
+{
+    return read_async.pending;
 }
 
 /**
@@ -1075,9 +2088,14 @@ int dfs_size(uint32_t handle)
  */
 uint32_t dfs_rom_addr(const char *path)
 {
+    if(__dfs_ensure_init() != DFS_ESUCCESS)
+    {
+        return 0;
+    }
+
     /* Try to find file */
-    directory_entry_t *dirent;
-    int ret = recurse_path(path, WALK_OPEN, &dirent, TYPE_FILE);
+    directory_entry_t t_node;
+    int ret = find_file_entry(path, &t_node);
 
     if(ret != DFS_ESUCCESS)
     {
@@ -1085,14 +2103,294 @@ uint32_t dfs_rom_addr(const char *path)
         return 0;
     }
 
-    /* We now have the pointer to the file entry */
-    directory_entry_t t_node;
-    grab_sector(dirent, &t_node);
-
     /* Return the starting location in ROM */
     return get_start_location(&t_node);
 }
 
+/** @brief Base of the virtual address window used by #dfs_map */
+#define MAP_VADDR_BASE          0x20000000
+/** @brief Size of a mapped page (one TLB slot maps an even/odd pair of 4 KiB pages) */
+#define MAP_PAGE_SIZE           0x2000
+/** @brief Maximum number of page frames (bounded by the 32 TLB slots) */
+#define MAP_MAX_FRAMES          32
+/** @brief Default number of page frames used by the paged cache */
+#define MAP_DEFAULT_FRAMES      8
+/** @brief Maximum number of files that can be mapped via #dfs_map */
+#define MAX_MAPPED_FILES        8
+
+/** @brief Files currently mapped via #dfs_map */
+static struct {
+    /** @brief Base virtual address of the mapping */
+    uint32_t vaddr;
+    /** @brief Cart address of the file body */
+    uint32_t rom_addr;
+    /** @brief File size in bytes */
+    uint32_t size;
+} mapped_files[MAX_MAPPED_FILES];
+
+/** @brief Number of files currently mapped via #dfs_map */
+static int num_mapped_files = 0;
+/** @brief First virtual address after all current mappings */
+static uint32_t map_vaddr_top = MAP_VADDR_BASE;
+/** @brief Page frames backing the paged cache (frame i is owned by TLB slot i) */
+static uint8_t *map_frames[MAP_MAX_FRAMES];
+/** @brief Number of page frames in use (configurable via #dfs_map_cache_init) */
+static int map_num_frames = MAP_DEFAULT_FRAMES;
+/** @brief Virtual address of the page held by each frame (0: frame is empty) */
+static uint32_t map_frame_page[MAP_MAX_FRAMES];
+/** @brief Per-frame referenced bit for the clock eviction policy */
+static bool map_frame_ref[MAP_MAX_FRAMES];
+/** @brief True if the frame's TLB slot has been soft-invalidated by the clock hand */
+static bool map_frame_soft[MAP_MAX_FRAMES];
+/** @brief Clock hand: next frame considered for eviction */
+static int map_frame_hand = 0;
+/** @brief Exception handler that was registered before ours */
+static exception_handler_t map_prev_handler = NULL;
+
+/**
+ * @brief Program the TLB slot owning a frame
+ *
+ * Each frame is permanently owned by the TLB slot with the same index. An
+ * invalid page unmaps the slot while keeping the frame contents around, so
+ * that it can be remapped later without a DMA (soft-invalidation).
+ */
+static void __dfs_map_write_slot(int frame, uint32_t page, bool valid)
+{
+    uint32_t phys = ((uint32_t)map_frames[frame]) & 0x1FFFFFFF;
+    uint32_t lo_valid = valid ? C0_ENTRYLO_VALID : 0;
+    C0_WRITE_INDEX(frame);
+    C0_WRITE_PAGEMASK(0);
+    C0_WRITE_ENTRYHI(page);
+    C0_WRITE_ENTRYLO0(((phys >> 12) << 6) | (3 << 3) | lo_valid | C0_ENTRYLO_GLOBAL);
+    C0_WRITE_ENTRYLO1((((phys + 0x1000) >> 12) << 6) | (3 << 3) | lo_valid | C0_ENTRYLO_GLOBAL);
+    C0_TLBWI();
+}
+
+/**
+ * @brief Exception handler implementing the #dfs_map paged cache
+ *
+ * TLB misses within the mapping window are resolved by DMA'ing the missing
+ * page from ROM into one of the page frames, and pointing the corresponding
+ * TLB slot at it. Execution then resumes at the faulting instruction, which
+ * this time finds a valid mapping.
+ *
+ * Frames are recycled with a clock (second-chance) policy, approximating
+ * LRU: the hand does not evict a recently used frame right away, but
+ * soft-invalidates its TLB slot and moves on. If the page is touched again
+ * before the hand comes back around, the resulting miss finds the data
+ * still in its frame and revalidates the slot without any DMA, marking the
+ * frame as recently used. The MIPS TLB has no hardware access bit, so these
+ * soft misses are the only way recency can be observed at all.
+ *
+ * Anything else (misses outside the window, writes to mapped pages) is
+ * forwarded to the previously registered exception handler.
+ */
+static void __dfs_map_exception(exception_t *ex)
+{
+    uint32_t vaddr = C0_BADVADDR();
+
+    if(ex->code == EXCEPTION_CODE_TLB_LOAD_I_MISS &&
+       vaddr >= MAP_VADDR_BASE && vaddr < map_vaddr_top)
+    {
+        uint32_t page = vaddr & ~(MAP_PAGE_SIZE-1);
+
+        /* Soft miss: the page is still in a frame whose slot was
+           soft-invalidated by the clock hand. Revalidate, no DMA needed. */
+        for(int i = 0; i < map_num_frames; i++)
+        {
+            if(map_frame_soft[i] && map_frame_page[i] == page)
+            {
+                __dfs_map_write_slot(i, page, true);
+                map_frame_soft[i] = false;
+                map_frame_ref[i] = true;
+                return;
+            }
+        }
+
+        for(int i = 0; i < num_mapped_files; i++)
+        {
+            uint32_t offset = vaddr - mapped_files[i].vaddr;
+            if(offset >= ROUND_UP(mapped_files[i].size, MAP_PAGE_SIZE)) { continue; }
+
+            /* Advance the clock hand until a frame without a second chance
+               comes up. Recently used frames get soft-invalidated instead,
+               so that a later touch can report them as still hot. The hand
+               terminates: each pass clears one referenced bit. */
+            int frame;
+            while(1)
+            {
+                frame = map_frame_hand;
+                map_frame_hand = (map_frame_hand + 1) % map_num_frames;
+                if(!map_frame_ref[frame]) { break; }
+
+                map_frame_ref[frame] = false;
+                if(!map_frame_soft[frame])
+                {
+                    /* Drop the cache lines now, while the mapping is still
+                       valid: the cache is physically tagged, and these lines
+                       would survive a remap of the frame. The lines are
+                       clean by construction (pages are mapped read-only). */
+                    data_cache_hit_invalidate((void *)map_frame_page[frame], MAP_PAGE_SIZE);
+                    __dfs_map_write_slot(frame, map_frame_page[frame], false);
+                    map_frame_soft[frame] = true;
+                }
+            }
+
+            uint8_t *buf = map_frames[frame];
+            if(map_frame_page[frame] && !map_frame_soft[frame])
+            {
+                /* Evicting a still-mapped page: drop its cache lines while
+                   the mapping is valid (see above). */
+                data_cache_hit_invalidate((void *)map_frame_page[frame], MAP_PAGE_SIZE);
+            }
+
+            /* Flush any dirty line for the frame, so that it cannot be
+               written back on top of the data we are about to DMA. */
+            data_cache_hit_writeback_invalidate(buf, MAP_PAGE_SIZE);
+            dma_read(buf, mapped_files[i].rom_addr + (page - mapped_files[i].vaddr), MAP_PAGE_SIZE);
+
+            /* Point the TLB slot that owns this frame at the new page. This
+               also unmaps whatever page the frame held before. The page is
+               mapped cached and clean (not dirty), so writes to it fault. */
+            __dfs_map_write_slot(frame, page, true);
+            map_frame_page[frame] = page;
+            map_frame_soft[frame] = false;
+            map_frame_ref[frame] = true;
+            return;
+        }
+    }
+
+    if((ex->code == EXCEPTION_CODE_TLB_STORE_MISS ||
+        ex->code == EXCEPTION_CODE_TLB_MODIFICATION) &&
+       vaddr >= MAP_VADDR_BASE && vaddr < map_vaddr_top)
+    {
+        assertf(0, "write to read-only memory mapped by dfs_map: %08lx", vaddr);
+    }
+
+    if(map_prev_handler) { map_prev_handler(ex); }
+}
+
+/**
+ * @brief Initialize the paged cache used by #dfs_map
+ *
+ * Called lazily by the first #dfs_map: allocates the page frames, puts the
+ * TLB in a known state, and hooks the exception handler.
+ */
+static void __dfs_map_init(void)
+{
+    /* The TLB contents are undefined at boot, and nothing else in libdragon
+       uses the TLB. Invalidate all slots, giving each a distinct virtual
+       address in KSEG0 (which is never looked up in the TLB), so that no
+       stale slot can match or conflict with the pages we will map. */
+    C0_WRITE_PAGEMASK(0);
+    C0_WRITE_ENTRYLO0(0);
+    C0_WRITE_ENTRYLO1(0);
+    for(int i = 0; i < 32; i++)
+    {
+        C0_WRITE_INDEX(i);
+        C0_WRITE_ENTRYHI(0x80000000 + i*MAP_PAGE_SIZE);
+        C0_TLBWI();
+    }
+
+    for(int i = 0; i < map_num_frames; i++)
+    {
+        map_frames[i] = memalign(0x1000, MAP_PAGE_SIZE);
+        assertf(map_frames[i], "out of memory allocating dfs_map page frames");
+    }
+
+    map_prev_handler = register_exception_handler(__dfs_map_exception);
+}
+
+/**
+ * @brief Configure the size of the paged cache used by #dfs_map
+ *
+ * By default the cache uses #MAP_DEFAULT_FRAMES page frames of 8 KiB each.
+ * Applications that page a large working set through #dfs_map can enlarge
+ * the cache (up to the 32 TLB slots of the CPU) to reduce fault traffic,
+ * or shrink it to 1 frame to give back RDRAM.
+ *
+ * Must be called before the first #dfs_map.
+ *
+ * @param[in] frames
+ *            Number of 8 KiB page frames to use (1-32)
+ */
+void dfs_map_cache_init(int frames)
+{
+    assertf(!map_prev_handler, "dfs_map_cache_init must be called before the first dfs_map");
+    assertf(frames >= 1 && frames <= MAP_MAX_FRAMES,
+        "invalid number of page frames: %d (max %d)", frames, MAP_MAX_FRAMES);
+    map_num_frames = frames;
+}
+
+/**
+ * @brief Map a file for direct (execute-in-place style) read access
+ *
+ * This function returns a pointer through which the contents of a file can
+ * be read directly, without loading the file into RDRAM first. Reads are
+ * served by a small paged cache: accessing an unmapped page triggers a TLB
+ * miss, which is transparently resolved by DMA'ing that 8 KiB page from ROM
+ * into a recycled page frame (see #dfs_map_cache_init to size the cache).
+ * Frames are recycled with a clock policy that approximates LRU, so the
+ * hottest pages tend to stay resident. Only the cache frames occupy RDRAM,
+ * no matter how large the mapped files are.
+ *
+ * This is meant for large, read-only, sparsely accessed data such as lookup
+ * tables: random accesses with some locality perform well, while streaming
+ * through a file is better served by #dfs_read. The mapping is read-only;
+ * writing through the returned pointer will raise an exception. The pointer
+ * is page aligned (mkdfs aligns file bodies to 256 bytes in the image, so
+ * any in-file alignment up to that is preserved relative to the pointer).
+ *
+ * Pages are faulted in with a blocking PI DMA, so accesses to unmapped
+ * pages briefly stall the CPU, and code run from interrupt handlers should
+ * not touch mapped memory while a PI transfer might be in flight.
+ *
+ * @param[in] path
+ *            Name of the file to map
+ *
+ * @return A read-only pointer to the file contents, or NULL if the file
+ *         was not found.
+ */
+const void *dfs_map(const char *path)
+{
+    /* Try to find file */
+    directory_entry_t t_node;
+    int ret = find_file_entry(path, &t_node);
+
+    if(ret != DFS_ESUCCESS)
+    {
+        /* File not found, or other error */
+        return NULL;
+    }
+
+    assertf(num_mapped_files < MAX_MAPPED_FILES, "too many files mapped via dfs_map");
+
+    if(!map_prev_handler)
+    {
+        __dfs_map_init();
+    }
+
+    /* Reuse the existing mapping if the file was already mapped */
+    uint32_t rom_addr = get_start_location(&t_node);
+    for(int i = 0; i < num_mapped_files; i++)
+    {
+        if(mapped_files[i].rom_addr == rom_addr)
+        {
+            return (const void *)mapped_files[i].vaddr;
+        }
+    }
+
+    /* Carve a page-aligned range out of the virtual window. The pages
+       themselves are only faulted in on first access. */
+    mapped_files[num_mapped_files].vaddr = map_vaddr_top;
+    mapped_files[num_mapped_files].rom_addr = rom_addr;
+    mapped_files[num_mapped_files].size = get_size(&t_node);
+    map_vaddr_top += ROUND_UP(mapped_files[num_mapped_files].size, MAP_PAGE_SIZE);
+    num_mapped_files++;
+
+    return (const void *)mapped_files[num_mapped_files-1].vaddr;
+}
+
 /**
  * @brief Return whether the end of file has been reached
  *
@@ -1218,6 +2516,68 @@ static int __read( void *file, uint8_t *ptr, int len )
     return dfs_read( ptr, 1, len, (uint32_t)file );
 }
 
+/**
+ * @brief Newlib-compatible vectored read
+ *
+ * Reads each buffer of the vector in turn with a single hook dispatch.
+ * Small adjacent ranges are naturally coalesced into single PI DMAs by
+ * the per-file cached buffer: the first small read fills it with one
+ * DMA and the following ones are served from it with plain memcpys.
+ *
+ * @param[in]  file
+ *             File pointer as returned by #__open
+ * @param[in]  iov
+ *             Array of destination buffers
+ * @param[in]  iovcnt
+ *             Number of entries in iov
+ *
+ * @return The total amount of data read.
+ */
+static int __readv( void *file, const struct iovec *iov, int iovcnt )
+{
+    int total = 0;
+
+    for( int i = 0; i < iovcnt; i++ )
+    {
+        int ret = dfs_read( iov[i].iov_base, 1, iov[i].iov_len, (uint32_t)file );
+        if( ret < 0 ) { return total > 0 ? total : ret; }
+        total += ret;
+        if( ret < (int)iov[i].iov_len ) { break; }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Newlib-compatible positioned read
+ *
+ * Reads at an absolute offset without disturbing the file position.
+ *
+ * @param[in]  file
+ *             File pointer as returned by #__open
+ * @param[out] ptr
+ *             Pointer to buffer to read to
+ * @param[in]  len
+ *             Length in bytes to read
+ * @param[in]  offset
+ *             Absolute byte offset to read from
+ *
+ * @return The actual amount of data read.
+ */
+static int __pread( void *file, uint8_t *ptr, int len, int offset )
+{
+    open_file_t *f = find_open_file( (uint32_t)file );
+    if( !f ) { return DFS_EBADHANDLE; }
+    if( offset < 0 || offset > (int)f->size ) { return DFS_EBADINPUT; }
+
+    int save = f->loc;
+    f->loc = offset;
+    int ret = dfs_read( ptr, 1, len, (uint32_t)file );
+    f->loc = save;
+
+    return ret;
+}
+
 /**
  * @brief Newlib-compatible close
  *
@@ -1316,7 +2676,9 @@ static filesystem_t dragon_fs = {
     __close,
     0,
     __findfirst,
-    __findnext
+    __findnext,
+    __readv,
+    __pread
 };
 
 /**
@@ -1345,30 +2707,17 @@ static void __dfs_check_emulation(void)
 }
 
 /**
- * @brief Initialize the filesystem.
+ * @brief Helper to perform the actual filesystem setup
  *
- * Given a base offset where the filesystem should be found, this function will
- * initialize the filesystem to read from cartridge space.  This function will
- * also register DragonFS with newlib so that standard POSIX/C file operations
- * work with DragonFS, using the "rom:/" prefix".
- * 
- * The function needs to know where the DFS image is located within the cartridge
- * space. To simplify this, you can pass #DFS_DEFAULT_LOCATION which tells
- * #dfs_init to search for the DFS image by itself, using the rompak TOC (see
- * rompak_internal.h). Most users should use this option.
- * 
- * Otherwise, if the ROM cannot be built with a rompak TOC for some reason,
- * a virtual address should be passed. This is normally 0xB0000000 + the offset
- * used when building your ROM + the size of the header file used (typically 0x1000). 
+ * Contains everything #dfs_init does except registering with newlib, so
+ * that it can be shared with the deferred path of #dfs_init_lazy.
  *
  * @param[in] base_fs_loc
- *            Virtual address in cartridge space at which to find the filesystem, or
- *            DFS_DEFAULT_LOCATION to automatically search for the filesystem in the
- *            cartridge (using the rompak).
+ *            Location of the filesystem (or #DFS_DEFAULT_LOCATION)
  *
  * @return DFS_ESUCCESS on success or a negative error otherwise.
  */
-int dfs_init(uint32_t base_fs_loc)
+static int __dfs_init_fs(uint32_t base_fs_loc)
 {
     /* Detect if we are running on emulator accurate enough to emulate DragonFS. */
     __dfs_check_emulation();
@@ -1397,12 +2746,149 @@ int dfs_init(uint32_t base_fs_loc)
         return ret;
     }
 
+    /* Hook the PI interrupt to complete asynchronous reads */
+    register_PI_handler( __dfs_pi_callback );
+    set_PI_interrupt( 1 );
+
+    return DFS_ESUCCESS;
+}
+
+/**
+ * @brief Initialize the filesystem.
+ *
+ * Given a base offset where the filesystem should be found, this function will
+ * initialize the filesystem to read from cartridge space.  This function will
+ * also register DragonFS with newlib so that standard POSIX/C file operations
+ * work with DragonFS, using the "rom:/" prefix".
+ * 
+ * The function needs to know where the DFS image is located within the cartridge
+ * space. To simplify this, you can pass #DFS_DEFAULT_LOCATION which tells
+ * #dfs_init to search for the DFS image by itself, using the rompak TOC (see
+ * rompak_internal.h). Most users should use this option.
+ * 
+ * Otherwise, if the ROM cannot be built with a rompak TOC for some reason,
+ * a virtual address should be passed. This is normally 0xB0000000 + the offset
+ * used when building your ROM + the size of the header file used (typically 0x1000). 
+ *
+ * @param[in] base_fs_loc
+ *            Virtual address in cartridge space at which to find the filesystem, or
+ *            DFS_DEFAULT_LOCATION to automatically search for the filesystem in the
+ *            cartridge (using the rompak).
+ *
+ * @return DFS_ESUCCESS on success or a negative error otherwise.
+ */
+int dfs_init(uint32_t base_fs_loc)
+{
+    int ret = __dfs_init_fs( base_fs_loc );
+
+    if( ret != DFS_ESUCCESS )
+    {
+        return ret;
+    }
+
     /* Succeeded, push our filesystem into newlib */
     attach_filesystem( "rom:/", &dragon_fs );
 
+    bootprof_mark( "dfs_init" );
+    return DFS_ESUCCESS;
+}
+
+/**
+ * @brief Initialize the filesystem with a patch image mounted over it.
+ *
+ * Same as #dfs_init, but additionally mounts a second, typically much
+ * smaller DFS image as an overlay: files present in the patch image shadow
+ * their counterparts in the base image, and every other path falls through
+ * to the base. This is meant for on-hardware iteration with large asset
+ * images: instead of regenerating and re-uploading the full image after
+ * touching a few files, the build runs mkdfs on just the changed files
+ * (laid out at their full paths) and uploads only the resulting patch.
+ *
+ * The overlay applies to file lookups (#dfs_open, #dfs_rom_addr, stat and
+ * the `rom:/` newlib hooks). Directory iteration (#dfs_dir_findfirst) and
+ * #dfs_chdir see the base image only, and the overlay only resolves plain
+ * absolute paths (the ones the path lookup index covers): files the patch
+ * adds on top of the base are found, but only through such paths.
+ *
+ * There is no automatic search for patch images: pass the virtual address
+ * the patch was uploaded at. The base location can still be
+ * #DFS_DEFAULT_LOCATION.
+ *
+ * @param[in] base_fs_loc
+ *            Virtual address in cartridge space of the base filesystem, or
+ *            DFS_DEFAULT_LOCATION to automatically search for it in the
+ *            cartridge (using the rompak).
+ * @param[in] patch_fs_loc
+ *            Virtual address in cartridge space of the patch filesystem.
+ *
+ * @return DFS_ESUCCESS on success or a negative error otherwise.
+ */
+int dfs_init_overlay(uint32_t base_fs_loc, uint32_t patch_fs_loc)
+{
+    int ret = dfs_init( base_fs_loc );
+
+    if( ret != DFS_ESUCCESS )
+    {
+        return ret;
+    }
+
+    return __dfs_overlay_mount( patch_fs_loc );
+}
+
+/**
+ * @brief Initialize the filesystem, deferring the expensive work.
+ *
+ * Same as #dfs_init, but the ROM scan for the DFS image and the
+ * filesystem validation are postponed until the first filesystem access
+ * (e.g. the first #dfs_open or `fopen("rom:/...")`). This shortens the
+ * boot sequence when the first file is not needed until later; in
+ * exchange, any initialization error (e.g. #DFS_EBADFS) is reported by
+ * that first access instead of by this function.
+ *
+ * @param[in] base_fs_loc
+ *            Virtual address in cartridge space at which to find the filesystem, or
+ *            DFS_DEFAULT_LOCATION to automatically search for the filesystem in the
+ *            cartridge (using the rompak).
+ *
+ * @return DFS_ESUCCESS (the deferred initialization cannot fail yet).
+ */
+int dfs_init_lazy(uint32_t base_fs_loc)
+{
+    /* Register with newlib right away (it is cheap), but defer the ROM
+       scan and filesystem validation until the first access. */
+    lazy_init_pending = true;
+    lazy_init_loc = base_fs_loc;
+
+    attach_filesystem( "rom:/", &dragon_fs );
+
     return DFS_ESUCCESS;
 }
 
+/**
+ * @brief Complete a deferred #dfs_init_lazy, if one is pending.
+ *
+ * Called at the beginning of every filesystem entry point. Any
+ * initialization error surfaces from the first access instead of from
+ * #dfs_init_lazy itself.
+ *
+ * @return DFS_ESUCCESS on success or a negative error otherwise.
+ */
+static int __dfs_ensure_init(void)
+{
+    if( !lazy_init_pending )
+    {
+        return DFS_ESUCCESS;
+    }
+
+    lazy_init_pending = false;
+    int ret = __dfs_init_fs( lazy_init_loc );
+    if( ret == DFS_ESUCCESS )
+    {
+        bootprof_mark( "dfs_init (lazy)" );
+    }
+    return ret;
+}
+
 /**
  * @brief Convert DFS error code into an error string
  */
@@ -6,8 +6,14 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "eeprom.h"
 #include "joybus.h"
+#include "joybus_internal.h"
+#include "timer.h"
+#include "n64sys.h"
+#include "debug.h"
+#include "utils.h"
 
 /**
  * @brief Read the status of the EEPROM.
@@ -140,6 +146,45 @@ uint8_t eeprom_write( uint8_t block, const uint8_t * src )
     return output[2] >> 56;
 }
 
+/**
+ * @brief Write a block to EEPROM without waiting for completion.
+ *
+ * This queues the same Joybus command as #eeprom_write but returns
+ * immediately; the optional callback is invoked (under interrupt) once
+ * the PIF has acknowledged the command. Note that the EEPROM itself
+ * needs roughly 15 milliseconds to commit a block internally, so
+ * back-to-back writes should be paced by the caller.
+ *
+ * @param[in] block
+ *            Block to write data to. Joybus accesses EEPROM in 8-byte blocks.
+ * @param[in] src
+ *            Source buffer for the eight bytes of data to write to EEPROM.
+ * @param[in] callback
+ *            Function called when the command completes (can be NULL).
+ *            It runs in interrupt context; keep it short.
+ * @param[in] ctx
+ *            Opaque context pointer passed to the callback.
+ */
+void eeprom_write_async( uint8_t block, const uint8_t * src,
+    void (*callback)(uint64_t *output, void *ctx), void *ctx )
+{
+    uint64_t input[JOYBUS_BLOCK_DWORDS] =
+    {
+        0x000000000a010500 | block,
+        0x0000000000000000,
+        0xfffe000000000000,
+        0,
+        0,
+        0,
+        0,
+        1
+    };
+
+    memcpy( &input[1], src, EEPROM_BLOCK_SIZE );
+
+    joybus_exec_async( input, callback, ctx );
+}
+
 /**
  * @brief Read a buffer of bytes from EEPROM.
  *
@@ -240,3 +285,196 @@ void eeprom_write_bytes( const uint8_t * src, size_t start, size_t len )
         eeprom_write( current_block, buf );
     }
 }
+
+/**
+ * @name Background EEPROM write engine
+ *
+ * State for #eeprom_write_bytes_async. One block is in flight at a time;
+ * after each block command completes, a one-shot timer paces the next
+ * submission by the ~15 millisecond internal programming time of the
+ * EEPROM, so the main thread never waits.
+ * @{
+ */
+/** @brief Delay between block submissions (EEPROM programming time) */
+#define EEPROM_WRITE_DELAY_MS     15
+/** @brief Timer used to pace background block writes */
+static timer_link_t *bg_timer = NULL;
+/** @brief Caller's source buffer (must stay valid until completion) */
+static const uint8_t *bg_src = NULL;
+/** @brief Byte offset in EEPROM of the first byte being written */
+static size_t bg_start = 0;
+/** @brief First EEPROM block touched by the operation */
+static uint8_t bg_first_block = 0;
+/** @brief Number of blocks in the operation */
+static int bg_total_blocks = 0;
+/** @brief Index of the next block to submit */
+static volatile int bg_next_block = 0;
+/** @brief True if the last submitted block must be retried (EEPROM busy) */
+static volatile bool bg_retry = false;
+/** @brief True while a background write is in progress */
+static volatile bool bg_active = false;
+/** @brief Read-modify-write staging for a partial first block */
+static uint8_t bg_head_buf[EEPROM_BLOCK_SIZE];
+/** @brief Read-modify-write staging for a partial last block */
+static uint8_t bg_tail_buf[EEPROM_BLOCK_SIZE];
+/** @brief True if the first block goes through #bg_head_buf */
+static bool bg_head_partial = false;
+/** @brief True if the last block goes through #bg_tail_buf */
+static bool bg_tail_partial = false;
+/** @} */
+
+/**
+ * @brief Return the source bytes for block index @p idx of the
+ *        in-progress background write.
+ */
+static const uint8_t * __eeprom_bg_block_src( int idx )
+{
+    if ( idx == 0 && bg_head_partial )
+        return bg_head_buf;
+    if ( idx == bg_total_blocks - 1 && bg_tail_partial )
+        return bg_tail_buf;
+    return bg_src + ( (size_t)( bg_first_block + idx ) * EEPROM_BLOCK_SIZE - bg_start );
+}
+
+static void __eeprom_bg_callback( uint64_t *output, void *ctx );
+
+/**
+ * @brief Submit the block at #bg_next_block to the joybus queue.
+ */
+static void __eeprom_bg_submit( void )
+{
+    eeprom_write_async( bg_first_block + bg_next_block,
+        __eeprom_bg_block_src( bg_next_block ),
+        __eeprom_bg_callback, NULL );
+}
+
+/**
+ * @brief Timer tick of the background write engine.
+ *
+ * Fires #EEPROM_WRITE_DELAY_MS after the previous block command was
+ * acknowledged, which is enough for the EEPROM to finish programming it.
+ * Submits the next block (or retries the current one), or marks the
+ * operation as finished once the last block has settled.
+ */
+static void __eeprom_bg_tick( int ovfl )
+{
+    if ( !bg_active )
+        return;
+    if ( !bg_retry && bg_next_block >= bg_total_blocks )
+    {
+        /* Last block has had time to program: we are done. */
+        bg_active = false;
+        return;
+    }
+    bg_retry = false;
+    __eeprom_bg_submit();
+}
+
+/**
+ * @brief Joybus completion callback of the background write engine.
+ *
+ * Runs under the SI interrupt. Checks the EEPROM status byte: if the
+ * busy bit is set the block was rejected and will be retried on the
+ * next tick, otherwise the engine advances to the following block.
+ * Either way, the pacing timer is re-armed.
+ */
+static void __eeprom_bg_callback( uint64_t *output, void *ctx )
+{
+    uint8_t status = output[2] >> 56;
+
+    if ( status & 0x80 )
+        bg_retry = true;
+    else
+        bg_next_block++;
+
+    restart_timer( bg_timer );
+}
+
+/**
+ * @brief Write a buffer of bytes to EEPROM in the background.
+ *
+ * Non-blocking equivalent of #eeprom_write_bytes: this function queues
+ * the first block and returns immediately. Subsequent blocks are
+ * submitted from a timer tick, paced by the ~15 millisecond programming
+ * time of the EEPROM, so even a full 16k EEPROM save costs no
+ * main-thread time. Poll #eeprom_write_pending to learn when the data
+ * has been fully committed.
+ *
+ * If @p start or @p len are not multiples of #EEPROM_BLOCK_SIZE, the
+ * partial first/last blocks are read back synchronously before the
+ * background operation starts (two blocking block reads at most).
+ *
+ * The timer subsystem must be initialized with #timer_init, and only
+ * one background write can be in progress at a time. @p src must stay
+ * valid until the operation completes.
+ *
+ * @param[in] src
+ *            Source buffer containing data to write
+ * @param[in] start
+ *            Byte offset in EEPROM to start writing data to
+ * @param[in] len
+ *            Byte length of the src buffer
+ */
+void eeprom_write_bytes_async( const uint8_t * src, size_t start, size_t len )
+{
+    assertf( !bg_active, "background EEPROM write already in progress" );
+    if ( len == 0 )
+        return;
+
+    if ( !bg_timer )
+        bg_timer = new_timer( TICKS_FROM_MS( EEPROM_WRITE_DELAY_MS ),
+            TF_ONE_SHOT | TF_DISABLED, __eeprom_bg_tick );
+
+    bg_src = src;
+    bg_start = start;
+    bg_first_block = start / EEPROM_BLOCK_SIZE;
+    uint8_t last_block = ( start + len - 1 ) / EEPROM_BLOCK_SIZE;
+    bg_total_blocks = last_block - bg_first_block + 1;
+    bg_next_block = 0;
+    bg_retry = false;
+
+    /* Stage partial first/last blocks with a synchronous read-modify. */
+    size_t head_offset = start % EEPROM_BLOCK_SIZE;
+    size_t tail_end = ( start + len ) % EEPROM_BLOCK_SIZE;
+    bg_head_partial = ( head_offset != 0 );
+    bg_tail_partial = ( tail_end != 0 );
+    if ( bg_head_partial )
+    {
+        eeprom_read( bg_first_block, bg_head_buf );
+        size_t head_bytes = MIN( EEPROM_BLOCK_SIZE - head_offset, len );
+        memcpy( bg_head_buf + head_offset, src, head_bytes );
+    }
+    if ( bg_tail_partial )
+    {
+        if ( bg_total_blocks == 1 )
+        {
+            /* Single block: fold the tail into the head staging buffer. */
+            if ( !bg_head_partial )
+            {
+                eeprom_read( bg_first_block, bg_head_buf );
+                memcpy( bg_head_buf, src, len );
+                bg_head_partial = true;
+            }
+            bg_tail_partial = false;
+        }
+        else
+        {
+            eeprom_read( last_block, bg_tail_buf );
+            memcpy( bg_tail_buf, src + len - tail_end, tail_end );
+        }
+    }
+
+    bg_active = true;
+    __eeprom_bg_submit();
+}
+
+/**
+ * @brief Check whether a background EEPROM write is still in progress.
+ *
+ * @return true if data queued by #eeprom_write_bytes_async has not yet
+ *         been fully committed to the EEPROM.
+ */
+bool eeprom_write_pending( void )
+{
+    return bg_active;
+}
@@ -64,6 +64,164 @@ static eepfs_file_t * eepfs_files = NULL;
  */
 static uint16_t eepfs_files_checksum = 0;
 
+/**
+ * @brief Period of the background flush timer (in microseconds).
+ *
+ * The EEPROM needs roughly 15 milliseconds to commit a block internally,
+ * so flushing one block per 16 millisecond tick keeps the writes paced
+ * without the CPU ever waiting on them.
+ */
+#define EEPFS_FLUSH_PERIOD 16000
+
+/**
+ * @brief RAM mirror of every block of the filesystem.
+ *
+ * #eepfs_init reads the whole filesystem out of EEPROM once, and from
+ * then on the mirror always holds the newest copy of every block: the
+ * EEPROM cannot change underneath us, and all writes go through here.
+ * #eepfs_read is therefore a plain memcpy, and #eepfs_write and
+ * #eepfs_erase only touch the mirror and mark the affected blocks
+ * dirty; a background timer then trickles the dirty blocks out to
+ * EEPROM one per tick, in block order.
+ *
+ * Allocated by #eepfs_init; freed by #eepfs_close.
+ */
+static uint8_t * eepfs_cache = NULL;
+
+/**
+ * @brief Dirty bitmap: one bit per block in #eepfs_cache.
+ *
+ * A set bit means the cached copy is newer than the EEPROM contents.
+ */
+static uint8_t * eepfs_dirty_map = NULL;
+
+/** @brief Number of blocks covered by #eepfs_cache. */
+static size_t eepfs_cache_blocks = 0;
+
+/** @brief Number of dirty blocks waiting to be flushed. */
+static volatile size_t eepfs_dirty_count = 0;
+
+/** @brief True while an asynchronous block write is in flight. */
+static volatile bool eepfs_flush_pending = false;
+
+/** @brief Block currently being written asynchronously (-1 if none). */
+static volatile int eepfs_flush_block = -1;
+
+/** @brief Timer driving the background flush (created lazily). */
+static timer_link_t * eepfs_flush_timer = NULL;
+
+/** @brief Checks whether a block is marked dirty in the cache. */
+static inline bool eepfs_block_dirty(size_t block)
+{
+    return eepfs_dirty_map[block / 8] & (1 << (block % 8));
+}
+
+/** @brief Joybus callback: the in-flight block write has been accepted. */
+static void eepfs_flush_done(uint64_t *output, void *ctx)
+{
+    eepfs_flush_block = -1;
+    eepfs_flush_pending = false;
+}
+
+/**
+ * @brief Timer callback: flush the lowest dirty block to EEPROM.
+ *
+ * Runs under interrupt. One block is written per tick so that the
+ * EEPROM always has time to commit the previous write; when no dirty
+ * blocks remain, the timer stops itself until the next #eepfs_write.
+ */
+static void eepfs_flush_tick(int ovfl)
+{
+    /* Leave the previous write alone if it hasn't completed yet */
+    if ( eepfs_flush_pending )
+    {
+        return;
+    }
+
+    /* Flush dirty blocks in ascending order, one per tick */
+    for ( size_t block = 0; block < eepfs_cache_blocks; ++block )
+    {
+        if ( !eepfs_block_dirty(block) )
+        {
+            continue;
+        }
+
+        /* Clear the dirty bit before issuing the write: if the block is
+           modified again while the write is in flight, it will simply
+           be re-marked dirty and flushed again on a later tick. */
+        eepfs_dirty_map[block / 8] &= ~(1 << (block % 8));
+        eepfs_dirty_count -= 1;
+        eepfs_flush_block = block;
+        eepfs_flush_pending = true;
+        eeprom_write_async(block, &eepfs_cache[block * EEPROM_BLOCK_SIZE],
+            eepfs_flush_done, NULL);
+        return;
+    }
+
+    /* Nothing left to do: go quiet until the next write dirties a block */
+    stop_timer(eepfs_flush_timer);
+}
+
+/**
+ * @brief Copies data into the write-back cache and marks it dirty.
+ *
+ * This is the common backend of #eepfs_write and #eepfs_erase: it never
+ * touches the EEPROM on the calling path (except to fill a partial
+ * trailing block that was not cached yet), so it returns in microseconds.
+ *
+ * @param[in] file
+ *            File descriptor of the destination file
+ * @param[in] src
+ *            Source buffer of `file->num_bytes` bytes, or NULL to zero-fill
+ */
+static void eepfs_cache_write(const eepfs_file_t * file, const uint8_t * src)
+{
+    const size_t num_blocks = DIVIDE_CEIL(file->num_bytes, EEPROM_BLOCK_SIZE);
+
+    disable_interrupts();
+
+    for ( size_t i = 0; i < num_blocks; ++i )
+    {
+        const size_t block = file->start_block + i;
+        uint8_t * const cached = &eepfs_cache[block * EEPROM_BLOCK_SIZE];
+        const size_t num_bytes =
+            MIN(EEPROM_BLOCK_SIZE, file->num_bytes - (i * EEPROM_BLOCK_SIZE));
+
+        /* A partial trailing block needs no read-modify-write: the cache
+           already holds the latest copy of every block, so the bytes
+           beyond the end of the file are preserved by just not touching
+           them. */
+        if ( src != NULL )
+        {
+            memcpy(cached, &src[i * EEPROM_BLOCK_SIZE], num_bytes);
+        }
+        else
+        {
+            memset(cached, 0, num_bytes);
+        }
+
+        if ( !eepfs_block_dirty(block) )
+        {
+            eepfs_dirty_map[block / 8] |= 1 << (block % 8);
+            eepfs_dirty_count += 1;
+        }
+    }
+
+    /* Make sure the background flush is ticking */
+    if ( eepfs_flush_timer == NULL )
+    {
+        eepfs_flush_timer = new_timer(TIMER_TICKS(EEPFS_FLUSH_PERIOD),
+            TF_CONTINUOUS, eepfs_flush_tick);
+    }
+    else
+    {
+        start_timer(eepfs_flush_timer, TIMER_TICKS(EEPFS_FLUSH_PERIOD),
+            TF_CONTINUOUS, eepfs_flush_tick);
+    }
+
+    enable_interrupts();
+}
+
 /**
  * @brief Calculates a CRC-16 checksum from an array of bytes.
  * 
@@ -303,6 +461,25 @@ int eepfs_init(const eepfs_entry_t * entries, size_t count)
         return EEPFS_EBADFS;
     }
 
+    /* Allocate the write-back cache and its dirty bitmap */
+    eepfs_cache_blocks = total_blocks;
+    eepfs_cache = (uint8_t *)malloc(total_blocks * EEPROM_BLOCK_SIZE);
+    eepfs_dirty_map = (uint8_t *)malloc(DIVIDE_CEIL(total_blocks, 8));
+
+    if ( eepfs_cache == NULL || eepfs_dirty_map == NULL )
+    {
+        eepfs_close();
+        return EEPFS_ENOMEM;
+    }
+
+    memset(eepfs_dirty_map, 0, DIVIDE_CEIL(total_blocks, 8));
+    eepfs_dirty_count = 0;
+
+    /* Mirror the filesystem contents into RAM. This is the only time the
+       EEPROM is ever read: it cannot change underneath us, so from here
+       on every read is served from the mirror at memcpy speed. */
+    eeprom_read_bytes(eepfs_cache, 0, total_blocks * EEPROM_BLOCK_SIZE);
+
     /* Calculate and store the CRC-16 checksum for the declared entries */
     const size_t entries_size = sizeof(eepfs_entry_t) * count;
     eepfs_files_checksum = calculate_crc16((void *)entries, entries_size);
@@ -327,6 +504,27 @@ int eepfs_close(void)
         return EEPFS_EBADFS;
     }
 
+    /* Push any pending writes out to EEPROM first */
+    if ( eepfs_cache != NULL )
+    {
+        eepfs_sync();
+    }
+
+    /* Tear down the background flush */
+    if ( eepfs_flush_timer != NULL )
+    {
+        delete_timer(eepfs_flush_timer);
+        eepfs_flush_timer = NULL;
+    }
+
+    /* Clear the write-back cache */
+    free(eepfs_cache);
+    free(eepfs_dirty_map);
+    eepfs_cache = NULL;
+    eepfs_dirty_map = NULL;
+    eepfs_cache_blocks = 0;
+    eepfs_dirty_count = 0;
+
     /* Clear the file descriptor table */
     free(eepfs_files);
     eepfs_files = NULL;
@@ -339,6 +537,10 @@ int eepfs_close(void)
 /**
  * @brief Reads an entire file from the EEPROM filesystem.
  *
+ * The data is copied out of the RAM mirror of the EEPROM, so this
+ * returns at memcpy speed without any joybus transaction; it is cheap
+ * enough to call every frame.
+ *
  * @param[in]  path
  *             Path of file in EEPROM filesystem to read from
  * @param[out] dest
@@ -364,17 +566,27 @@ int eepfs_read(const char * path, void * dest, size_t size)
         return EEPFS_EBADINPUT;
     }
 
-    const size_t start_bytes = file->start_block * EEPROM_BLOCK_SIZE;
-    eeprom_read_bytes(dest, start_bytes, file->num_bytes);
+    /* The mirror always holds the newest copy of every block (writes go
+       through it first), so the file contents are just memcpy'd out.
+       Interrupts are disabled so that a write from an interrupt handler
+       cannot tear the copy. */
+    disable_interrupts();
+    memcpy(dest, &eepfs_cache[file->start_block * EEPROM_BLOCK_SIZE],
+        file->num_bytes);
+    enable_interrupts();
 
     return EEPFS_ESUCCESS;
 }
 
 /**
  * @brief Writes an entire file to the EEPROM filesystem.
- * 
- * Each EEPROM block write takes approximately 15 milliseconds;
- * this operation may block for a while!
+ *
+ * The data is copied into a write-back cache and the call returns in
+ * microseconds; dirty blocks then trickle out to EEPROM in the background,
+ * one block every #EEPFS_FLUSH_PERIOD microseconds. Background flushing
+ * is timer-driven, so #timer_init must have been called. Use #eepfs_sync
+ * if you need to make sure the data has actually reached the EEPROM
+ * (for example before a reset).
  *
  * @param[in] path
  *            Path of file in EEPROM filesystem to write to
@@ -401,8 +613,7 @@ int eepfs_write(const char * path, const void * src, size_t size)
         return EEPFS_EBADINPUT;
     }
 
-    const size_t start_bytes = file->start_block * EEPROM_BLOCK_SIZE;
-    eeprom_write_bytes(src, start_bytes, file->num_bytes);
+    eepfs_cache_write(file, src);
 
     return EEPFS_ESUCCESS;
 }
@@ -413,10 +624,10 @@ int eepfs_write(const char * path, const void * src, size_t size)
  * Note that "erasing" a file just means writing it full of zeroes.
  * All files in the filesystem must always exist at the size specified
  * during #eepfs_init
- * 
- * Each EEPROM block write takes approximately 15 milliseconds;
- * this operation may block for a while!
- * 
+ *
+ * Like #eepfs_write, this only updates the write-back cache and returns
+ * immediately; the zeroes reach the EEPROM in the background.
+ *
  * Be advised: this is a destructive operation that cannot be undone!
  * 
  * @retval EEPFS_ESUCCESS if successful
@@ -434,16 +645,61 @@ int eepfs_erase(const char * path)
         return EEPFS_ENOFILE;
     }
 
-    const size_t num_blocks = DIVIDE_CEIL(file->num_bytes, EEPROM_BLOCK_SIZE);
-    size_t current_block = file->start_block;
+    eepfs_cache_write(file, NULL);
 
-    /* eeprom_buf is initialized to all zeroes */
-    const uint8_t eeprom_buf[EEPROM_BLOCK_SIZE] = {0};
+    return EEPFS_ESUCCESS;
+}
 
-    /* Write the blocks in with zeroes */
-    while ( current_block < file->start_block + num_blocks )
+/**
+ * @brief Flushes all pending writes out to EEPROM.
+ *
+ * #eepfs_write and #eepfs_erase return as soon as the data is in the
+ * write-back cache; this function is the barrier that waits until every
+ * dirty block has actually been committed to the EEPROM. Call it before
+ * anything that must observe the data on the cartridge itself, such as
+ * resetting the console or probing the EEPROM directly.
+ *
+ * Each pending block takes approximately 15 milliseconds to commit,
+ * so this may block for a while if many writes are outstanding.
+ *
+ * @retval EEPFS_ESUCCESS if successful
+ * @retval EEPFS_EBADFS if the filesystem is not initialized
+ */
+int eepfs_sync(void)
+{
+    /* Sanity check */
+    if ( eepfs_files == NULL || eepfs_cache == NULL )
     {
-        eeprom_write(current_block++, eeprom_buf);
+        return EEPFS_EBADFS;
+    }
+
+    /* Wait for a write the background flush may have in flight */
+    while ( eepfs_flush_pending ) { /* Spin; the SI interrupt completes it */ }
+
+    for (;;)
+    {
+        /* Claim the lowest dirty block, racing with the flush timer */
+        disable_interrupts();
+        int block = -1;
+        for ( size_t b = 0; b < eepfs_cache_blocks; ++b )
+        {
+            if ( eepfs_block_dirty(b) )
+            {
+                eepfs_dirty_map[b / 8] &= ~(1 << (b % 8));
+                eepfs_dirty_count -= 1;
+                block = b;
+                break;
+            }
+        }
+        enable_interrupts();
+
+        if ( block < 0 )
+        {
+            break;
+        }
+
+        while ( eepfs_flush_pending ) { /* Spin */ }
+        eeprom_write(block, &eepfs_cache[block * EEPROM_BLOCK_SIZE]);
     }
 
     return EEPFS_ESUCCESS;
@@ -505,10 +761,29 @@ bool eepfs_verify_signature(void)
  */
 void eepfs_wipe(void)
 {
+    /* Drop any pending cached writes: everything is being erased anyway */
+    if ( eepfs_dirty_map != NULL )
+    {
+        while ( eepfs_flush_pending ) { /* Spin */ }
+        disable_interrupts();
+        memset(eepfs_dirty_map, 0, DIVIDE_CEIL(eepfs_cache_blocks, 8));
+        eepfs_dirty_count = 0;
+        enable_interrupts();
+    }
+
     /* Write the filesystem signature into the first block */
     const uint64_t signature = eepfs_generate_signature();
     eeprom_write(0, (uint8_t *)&signature);
 
+    /* Keep the RAM mirror coherent with what is being written: the
+       signature in block 0 and zeroes everywhere else. */
+    if ( eepfs_cache != NULL )
+    {
+        memcpy(eepfs_cache, &signature, EEPROM_BLOCK_SIZE);
+        memset(eepfs_cache + EEPROM_BLOCK_SIZE, 0,
+            (eepfs_cache_blocks - 1) * EEPROM_BLOCK_SIZE);
+    }
+
     /* eeprom_buf is initialized to all zeroes */
     const uint8_t eeprom_buf[EEPROM_BLOCK_SIZE] = {0};
 
@@ -251,6 +251,10 @@ void exception_default_handler(exception_t* ex) {
 	__debug_backtrace(stderr, true);
 	backtrace_exception = false;
 
+	// Dump the flight recorder (if active). This runs after the log spew
+	// above so that the log ring also contains the crash report itself.
+	__flightrec_crash(ex);
+
 	// Run the inspector
 	__inspector_exception(ex);
 	#endif
@@ -310,6 +314,14 @@ static const char* __get_exception_name(exception_t *ex)
 	uint32_t epc = ex->regs->epc + (ex->regs->cr & C0_CAUSE_BD ? 4 : 0);
 	uint32_t badvaddr = C0_BADVADDR();
 
+	// If the exception handler had to abandon the stack because the stack
+	// pointer had crossed into a TLB stack guard (see stackguard.c), this
+	// is a stack overflow, whatever TLB exception code it surfaced as.
+	extern uint32_t __stackguard_crashed_sp;
+	if (__stackguard_crashed_sp) {
+		return "Stack overflow";
+	}
+
 	switch (ex->code) {
 	case EXCEPTION_CODE_FLOATING_POINT:
 		if (ex->regs->fc31 & C1_CAUSE_DIV_BY_0) {
@@ -478,5 +490,29 @@ void __onSyscallException( reg_block_t* regs )
 	e.regs->epc += 4;
 }
 
+/** @brief Nonzero when the denormal flush-to-zero fast path is armed (read by inthandler.S) */
+uint32_t __fpu_ftz_enabled = 0;
+/** @brief Number of denormal operands flushed by the fast path (see inthandler.S) */
+uint32_t __fpu_ftz_count = 0;
+/** @brief GPR spill area for the fast path, which runs without an exception frame */
+uint64_t __fpu_ftz_scratch[6];
+
+void fpu_flush_denormals(bool enable)
+{
+	// FCR31.FS makes the hardware flush denormal *results* (underflow)
+	// without trapping; denormal *inputs* still raise the unimplemented
+	// exception on VR4300 regardless, which is what the fast path in
+	// inthandler.S emulates.
+	if (enable)
+		C1_WRITE_FCR31(C1_FCR31() | C1_FCR31_FS);
+	else
+		C1_WRITE_FCR31(C1_FCR31() & ~C1_FCR31_FS);
+	__fpu_ftz_enabled = enable;
+}
+
+uint32_t fpu_flush_denormals_count(void)
+{
+	return __fpu_ftz_count;
+}
 
 /** @} */
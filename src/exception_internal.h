@@ -17,6 +17,8 @@ void __exception_dump_header(FILE *out, exception_t* ex);
 void __exception_dump_gpr(exception_t* ex, void (*cb)(void *arg, const char *regname, char* value), void *arg);
 void __exception_dump_fpr(exception_t* ex, void (*cb)(void *arg, const char *regname, char* hexvalue, char *singlevalue, char *doublevalue), void *arg);
 
+void __flightrec_crash(exception_t* ex);
+
 __attribute__((noreturn))
 void __inspector_exception(exception_t* ex);
 
@@ -0,0 +1,280 @@
+/**
+ * @file fat_cache.c
+ * @brief Sector cache with read-ahead for the FatFS SD backend
+ *
+ * FatFS itself keeps a single sector window per volume, so FAT chain
+ * walks and small reads each go to the SD card through libcart. This
+ * module sits between the diskio glue and the cart driver and keeps a
+ * small pool of 512-byte sectors in RAM:
+ *
+ *  * Sectors in the FAT region of the volume are pinned once cached,
+ *    since cluster chain walks revisit them constantly.
+ *  * Data sectors are kept in a LRU pool. Bulk reads larger than the
+ *    read-ahead window bypass the pool so streaming does not flush it.
+ *  * When consecutive requests are detected, the sectors following the
+ *    request are fetched eagerly so the next read is served from RAM.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fat_cache_internal.h"
+
+/** @brief Sector size, asserted to be 512 by the diskio glue */
+#define SECTOR_SIZE        512
+
+/** @brief One cached sector */
+typedef struct
+{
+	LBA_t sector;           ///< Media sector held in this slot
+	uint32_t stamp;         ///< Last-use counter for LRU eviction
+	bool valid;             ///< True if the slot holds a sector
+	bool pinned;            ///< True if the slot is never evicted (FAT region)
+} fat_cache_entry_t;
+
+static fat_cache_read_fn_t cache_read_fn = NULL;
+static fat_cache_queue_fn_t cache_queue_fn = NULL;
+static fat_cache_flush_fn_t cache_flush_fn = NULL;
+static fat_cache_entry_t *cache_entries = NULL;
+static uint8_t *cache_data = NULL;
+static uint8_t *cache_staging = NULL;
+static int cache_nsec = 0;
+static int cache_npinned = 0;
+static uint32_t cache_stamp = 0;
+
+/** @brief FAT region of the mounted volume: [fat_start, fat_end) */
+static LBA_t cache_fat_start = 0, cache_fat_end = 0;
+
+/** @brief End of the previous read request, to detect sequential access */
+static LBA_t cache_seq_next = 0;
+
+/** @brief Read-ahead in flight through the async backend */
+static bool cache_ra_pending = false;
+static LBA_t cache_ra_sector = 0;
+static UINT cache_ra_count = 0;
+
+/** @brief Pointer to the data of the specified cache slot */
+static uint8_t* slot_data(int idx)
+{
+	return cache_data + idx * SECTOR_SIZE;
+}
+
+/** @brief Return the slot holding the specified sector, or -1 */
+static int cache_lookup(LBA_t sector)
+{
+	for (int i = 0; i < cache_nsec; i++)
+		if (cache_entries[i].valid && cache_entries[i].sector == sector)
+			return i;
+	return -1;
+}
+
+/** @brief Pick a slot to evict: an empty one, or the LRU non-pinned one */
+static int cache_victim(void)
+{
+	int lru = -1;
+	for (int i = 0; i < cache_nsec; i++)
+	{
+		if (!cache_entries[i].valid)
+			return i;
+		if (!cache_entries[i].pinned &&
+			(lru < 0 || cache_entries[i].stamp < cache_entries[lru].stamp))
+			lru = i;
+	}
+	return lru;
+}
+
+/** @brief Store a sector into the cache, evicting if necessary */
+static void cache_insert(LBA_t sector, const uint8_t *src)
+{
+	int idx = cache_lookup(sector);
+	if (idx < 0)
+	{
+		idx = cache_victim();
+		if (idx < 0)
+			return;     // everything is pinned; nothing we can do
+		cache_entries[idx].sector = sector;
+		cache_entries[idx].valid = true;
+		cache_entries[idx].pinned = false;
+		if (sector >= cache_fat_start && sector < cache_fat_end &&
+			cache_npinned < FAT_CACHE_PINNED_MAX)
+		{
+			cache_entries[idx].pinned = true;
+			cache_npinned++;
+		}
+	}
+	memcpy(slot_data(idx), src, SECTOR_SIZE);
+	cache_entries[idx].stamp = ++cache_stamp;
+}
+
+bool __fat_cache_init(fat_cache_read_fn_t read_fn, int num_sectors)
+{
+	__fat_cache_close();
+
+	if (num_sectors <= 0)
+		num_sectors = FAT_CACHE_SECTORS;
+
+	cache_read_fn = read_fn;
+	cache_entries = calloc(num_sectors, sizeof(fat_cache_entry_t));
+	cache_data = malloc(num_sectors * SECTOR_SIZE);
+	cache_staging = malloc(FAT_CACHE_READAHEAD * SECTOR_SIZE);
+	if (!cache_entries || !cache_data || !cache_staging)
+	{
+		__fat_cache_close();
+		cache_read_fn = read_fn;
+		return false;
+	}
+
+	cache_nsec = num_sectors;
+	cache_npinned = 0;
+	cache_stamp = 0;
+	cache_fat_start = cache_fat_end = 0;
+	cache_seq_next = 0;
+	return true;
+}
+
+void __fat_cache_set_async(fat_cache_queue_fn_t queue_fn,
+	fat_cache_flush_fn_t flush_fn)
+{
+	cache_queue_fn = queue_fn;
+	cache_flush_fn = flush_fn;
+}
+
+void __fat_cache_set_fat_range(LBA_t fatbase, LBA_t database)
+{
+	cache_fat_start = fatbase;
+	cache_fat_end = database;
+}
+
+/** @brief Completion callback for an asynchronously queued read-ahead */
+static void cache_readahead_done(void *ctx, int result)
+{
+	if (result == 0)
+		for (UINT i = 0; i < cache_ra_count; i++)
+			cache_insert(cache_ra_sector + i, cache_staging + i * SECTOR_SIZE);
+	cache_ra_pending = false;
+}
+
+/** @brief Fetch ahead the sectors following a sequential request */
+static void cache_readahead(LBA_t sector)
+{
+	// Skip sectors we already hold, then fetch the rest in one burst.
+	UINT skip = 0;
+	while (skip < FAT_CACHE_READAHEAD && cache_lookup(sector) >= 0)
+	{
+		sector++;
+		skip++;
+	}
+	if (skip == FAT_CACHE_READAHEAD)
+		return;
+	UINT n = FAT_CACHE_READAHEAD - skip;
+
+	// Queue the fetch through the async backend if there is one, so it
+	// can overlap with whatever the caller does between reads.
+	if (cache_queue_fn)
+	{
+		cache_ra_sector = sector;
+		cache_ra_count = n;
+		cache_ra_pending =
+			cache_queue_fn(cache_staging, sector, n, cache_readahead_done, NULL) == 0;
+		return;
+	}
+
+	if (cache_read_fn(cache_staging, sector, n) != RES_OK)
+		return;
+	for (UINT i = 0; i < n; i++)
+		cache_insert(sector + i, cache_staging + i * SECTOR_SIZE);
+}
+
+DRESULT __fat_cache_read(BYTE *buff, LBA_t sector, UINT count)
+{
+	if (!cache_read_fn)
+		return RES_NOTRDY;
+	if (!cache_data)
+		return cache_read_fn(buff, sector, count);
+
+	// A queued read-ahead may still be in flight; drain it before
+	// looking anything up, both for the data and to keep the media
+	// access strictly ordered.
+	if (cache_ra_pending && cache_flush_fn)
+		cache_flush_fn();
+
+	bool sequential = (cache_seq_next != 0 && sector == cache_seq_next);
+	cache_seq_next = sector + count;
+
+	UINT i = 0;
+	while (i < count)
+	{
+		int idx = cache_lookup(sector + i);
+		if (idx >= 0)
+		{
+			memcpy(buff + i * SECTOR_SIZE, slot_data(idx), SECTOR_SIZE);
+			cache_entries[idx].stamp = ++cache_stamp;
+			i++;
+			continue;
+		}
+
+		// Fetch the maximal run of missing sectors in one transaction,
+		// straight into the destination buffer.
+		UINT run = 1;
+		while (i + run < count && cache_lookup(sector + i + run) < 0)
+			run++;
+		DRESULT res = cache_read_fn(buff + i * SECTOR_SIZE, sector + i, run);
+		if (res != RES_OK)
+			return res;
+
+		// Keep a copy of what we fetched, except for bulk runs that would
+		// just flush the pool; FAT sectors are always worth keeping.
+		for (UINT j = 0; j < run; j++)
+		{
+			LBA_t s = sector + i + j;
+			if (run <= FAT_CACHE_READAHEAD ||
+				(s >= cache_fat_start && s < cache_fat_end))
+				cache_insert(s, buff + (i + j) * SECTOR_SIZE);
+		}
+		i += run;
+	}
+
+	// On a sequential pattern of small reads, fetch ahead so the next
+	// request is served from RAM. Bulk reads amortize the card latency
+	// by themselves and are left alone.
+	if (sequential && count <= FAT_CACHE_READAHEAD)
+		cache_readahead(sector + count);
+
+	return RES_OK;
+}
+
+void __fat_cache_invalidate(LBA_t sector, UINT count)
+{
+	// Complete any in-flight read-ahead first, so the write cannot race
+	// with the read and stale sectors get invalidated below.
+	if (cache_ra_pending && cache_flush_fn)
+		cache_flush_fn();
+
+	for (int i = 0; i < cache_nsec; i++)
+	{
+		if (!cache_entries[i].valid)
+			continue;
+		if (cache_entries[i].sector >= sector &&
+			cache_entries[i].sector < sector + count)
+		{
+			if (cache_entries[i].pinned)
+				cache_npinned--;
+			cache_entries[i].valid = false;
+			cache_entries[i].pinned = false;
+		}
+	}
+}
+
+void __fat_cache_close(void)
+{
+	// The staging buffer is about to go away: no read may target it
+	if (cache_ra_pending && cache_flush_fn)
+		cache_flush_fn();
+	cache_ra_pending = false;
+
+	free(cache_entries); cache_entries = NULL;
+	free(cache_data); cache_data = NULL;
+	free(cache_staging); cache_staging = NULL;
+	cache_nsec = 0;
+	cache_npinned = 0;
+	cache_read_fn = NULL;
+}
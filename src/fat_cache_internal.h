@@ -0,0 +1,97 @@
+/**
+ * @file fat_cache_internal.h
+ * @brief Sector cache with read-ahead for the FatFS SD backend
+ */
+#ifndef __LIBDRAGON_FAT_CACHE_INTERNAL_H
+#define __LIBDRAGON_FAT_CACHE_INTERNAL_H
+
+#include <stdbool.h>
+#include "fatfs/ff.h"
+#include "fatfs/diskio.h"
+
+/**
+ * @brief Number of 512-byte sectors kept in the cache.
+ *
+ * Can be overridden at build time. The default (64 sectors, 32 KiB)
+ * is sized for streaming assets off SD while keeping the FAT hot.
+ */
+#ifndef FAT_CACHE_SECTORS
+#define FAT_CACHE_SECTORS       64
+#endif
+
+/**
+ * @brief Maximum number of cache slots that can be pinned.
+ *
+ * Sectors belonging to the FAT region are pinned when cached: cluster
+ * chain walks touch them over and over, so they are never evicted by
+ * streaming data. Once this budget is exhausted, further FAT sectors
+ * compete with data sectors in the LRU pool.
+ */
+#ifndef FAT_CACHE_PINNED_MAX
+#define FAT_CACHE_PINNED_MAX    16
+#endif
+
+/**
+ * @brief Number of sectors fetched ahead on sequential reads.
+ */
+#ifndef FAT_CACHE_READAHEAD
+#define FAT_CACHE_READAHEAD     8
+#endif
+
+/** @brief Backend function reading raw sectors from the media. */
+typedef DRESULT (*fat_cache_read_fn_t)(BYTE *buff, LBA_t sector, UINT count);
+
+/** @brief Backend function queuing an asynchronous sector read. */
+typedef int (*fat_cache_queue_fn_t)(BYTE *buff, LBA_t sector, UINT count,
+	void (*callback)(void *ctx, int result), void *ctx);
+
+/** @brief Backend function draining all queued asynchronous reads. */
+typedef int (*fat_cache_flush_fn_t)(void);
+
+/**
+ * @brief Initialize the sector cache.
+ *
+ * @param read_fn       Backend used to fetch sectors on a cache miss
+ * @param num_sectors   Cache size in sectors, or 0 for #FAT_CACHE_SECTORS
+ *
+ * @return true on success, false if the cache memory could not be allocated
+ *         (in which case reads fall through to the backend uncached).
+ */
+bool __fat_cache_init(fat_cache_read_fn_t read_fn, int num_sectors);
+
+/**
+ * @brief Provide an asynchronous read backend for read-ahead.
+ *
+ * When set, sequential read-ahead is queued through @p queue_fn instead
+ * of being fetched inline, so it can overlap with whatever the caller
+ * does between reads; @p flush_fn is invoked to drain pending reads
+ * before the cache is consulted again. Optional: without this call,
+ * read-ahead is fetched synchronously.
+ */
+void __fat_cache_set_async(fat_cache_queue_fn_t queue_fn,
+	fat_cache_flush_fn_t flush_fn);
+
+/**
+ * @brief Inform the cache of the FAT region of the mounted volume.
+ *
+ * Sectors in [@p fatbase, @p database) are pinned when cached. Call
+ * after a successful mount; without this call no sector is pinned.
+ */
+void __fat_cache_set_fat_range(LBA_t fatbase, LBA_t database);
+
+/**
+ * @brief Read sectors, serving from the cache when possible.
+ *
+ * Misses are fetched from the backend directly into @p buff. When a
+ * sequential access pattern is detected, extra sectors are fetched
+ * ahead and kept in the cache so the next request is served from RAM.
+ */
+DRESULT __fat_cache_read(BYTE *buff, LBA_t sector, UINT count);
+
+/** @brief Drop any cached copy of the specified sector range. */
+void __fat_cache_invalidate(LBA_t sector, UINT count);
+
+/** @brief Release the cache memory (eg: on unmount). */
+void __fat_cache_close(void);
+
+#endif
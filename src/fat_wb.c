@@ -0,0 +1,192 @@
+/**
+ * @file fat_wb.c
+ * @brief Write-behind sector queue for the FatFS SD backend
+ *
+ * SD write latency is spiky: a single sector write can stall for tens
+ * of milliseconds when the card hits an erase-block boundary, and with
+ * synchronous writes that stall lands on whatever frame happened to
+ * call fwrite. This module sits between the diskio glue and the cart
+ * driver on the write side (mirroring the read-side cache in
+ * fat_cache.c): dirty sectors are copied into a RAM queue and the call
+ * returns immediately; the queue is drained in bounded bursts from an
+ * idle point (#__fat_wb_poll) or completely at a checkpoint
+ * (#__fat_wb_sync).
+ *
+ * Ordering is preserved by keeping the queue strictly FIFO: sectors
+ * reach the card in the order they were first dirtied, so FAT metadata
+ * updates are never reordered against the data writes they describe.
+ * Rewriting an already-queued sector (common for FAT and directory
+ * sectors) updates it in place, coalescing the card traffic.
+ *
+ * Everything runs in the caller's context — FatFS itself is not
+ * interrupt-safe — so no locking is needed.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "fat_wb_internal.h"
+
+/** @brief Sector size, asserted to be 512 by the diskio glue */
+#define SECTOR_SIZE        512
+
+static fat_wb_write_fn_t wb_write_fn = NULL;
+/** @brief Sector number of each queue slot (FIFO ring) */
+static LBA_t *wb_sectors = NULL;
+/** @brief Sector data paired with each queue slot */
+static uint8_t *wb_data = NULL;
+/** @brief Staging buffer used to gather a contiguous flush burst */
+static uint8_t *wb_staging = NULL;
+static int wb_nsec = 0;      ///< Queue capacity in sectors
+static int wb_head = 0;      ///< Ring index of the oldest queued sector
+static int wb_count = 0;     ///< Number of queued sectors
+/** @brief First error hit by a deferred flush, not yet reported */
+static DRESULT wb_error = RES_OK;
+
+/** @brief Pointer to the data of the specified queue slot */
+static uint8_t* wb_slot(int idx)
+{
+	return wb_data + idx * SECTOR_SIZE;
+}
+
+/** @brief Return the slot queuing the specified sector, or -1 */
+static int wb_find(LBA_t sector)
+{
+	for (int i = 0; i < wb_count; i++)
+	{
+		int idx = (wb_head + i) % wb_nsec;
+		if (wb_sectors[idx] == sector)
+			return idx;
+	}
+	return -1;
+}
+
+bool __fat_wb_init(fat_wb_write_fn_t write_fn, int num_sectors)
+{
+	__fat_wb_close();
+
+	if (num_sectors <= 0)
+		num_sectors = FAT_WB_SECTORS;
+
+	wb_write_fn = write_fn;
+	wb_sectors = malloc(num_sectors * sizeof(LBA_t));
+	wb_data = malloc(num_sectors * SECTOR_SIZE);
+	wb_staging = malloc(FAT_WB_BURST * SECTOR_SIZE);
+	if (!wb_sectors || !wb_data || !wb_staging)
+	{
+		__fat_wb_close();
+		return false;
+	}
+
+	wb_nsec = num_sectors;
+	wb_head = wb_count = 0;
+	wb_error = RES_OK;
+	return true;
+}
+
+bool __fat_wb_active(void)
+{
+	return wb_data != NULL;
+}
+
+int __fat_wb_poll(void)
+{
+	if (wb_count == 0)
+		return 0;
+
+	// Gather the oldest run of media-contiguous sectors into the
+	// staging buffer, so the burst goes out as one multi-sector write
+	LBA_t first = wb_sectors[wb_head];
+	int burst = 0;
+	while (burst < FAT_WB_BURST && burst < wb_count)
+	{
+		int idx = (wb_head + burst) % wb_nsec;
+		if (wb_sectors[idx] != first + burst)
+			break;
+		memcpy(wb_staging + burst * SECTOR_SIZE, wb_slot(idx), SECTOR_SIZE);
+		burst++;
+	}
+
+	// Write the burst. On error, record it and drop the sectors anyway:
+	// retrying a dead card forever would turn every poll into a stall.
+	DRESULT res = wb_write_fn(wb_staging, first, burst);
+	if (res != RES_OK && wb_error == RES_OK)
+		wb_error = res;
+
+	wb_head = (wb_head + burst) % wb_nsec;
+	wb_count -= burst;
+	return wb_count;
+}
+
+DRESULT __fat_wb_sync(void)
+{
+	while (wb_count > 0)
+		__fat_wb_poll();
+
+	DRESULT res = wb_error;
+	wb_error = RES_OK;
+	return res;
+}
+
+DRESULT __fat_wb_write(const BYTE *buff, LBA_t sector, UINT count)
+{
+	// Requests too large to be worth staging (bulk file data) are
+	// written directly; the queue is drained first so the write cannot
+	// overtake metadata queued before it
+	if ((int)count > wb_nsec / 2)
+	{
+		DRESULT res = __fat_wb_sync();
+		if (res != RES_OK)
+			return res;
+		return wb_write_fn(buff, sector, count);
+	}
+
+	for (UINT i = 0; i < count; i++)
+	{
+		// A sector already queued keeps its FIFO position and just
+		// gets the new content
+		int idx = wb_find(sector + i);
+		if (idx < 0)
+		{
+			// Make room by flushing the oldest burst (this is where
+			// backpressure lands if the card cannot keep up)
+			while (wb_count == wb_nsec)
+				__fat_wb_poll();
+			idx = (wb_head + wb_count) % wb_nsec;
+			wb_sectors[idx] = sector + i;
+			wb_count++;
+		}
+		memcpy(wb_slot(idx), buff + i * SECTOR_SIZE, SECTOR_SIZE);
+	}
+
+	// Report (and clear) any error hit by earlier deferred flushes, so
+	// write failures eventually surface to FatFS instead of vanishing
+	DRESULT res = wb_error;
+	wb_error = RES_OK;
+	return res;
+}
+
+bool __fat_wb_overlaps(LBA_t sector, UINT count)
+{
+	for (int i = 0; i < wb_count; i++)
+	{
+		int idx = (wb_head + i) % wb_nsec;
+		if (wb_sectors[idx] >= sector && wb_sectors[idx] < sector + count)
+			return true;
+	}
+	return false;
+}
+
+void __fat_wb_close(void)
+{
+	if (wb_data)
+		__fat_wb_sync();
+	if (wb_sectors) free(wb_sectors);
+	if (wb_data) free(wb_data);
+	if (wb_staging) free(wb_staging);
+	wb_sectors = NULL;
+	wb_data = NULL;
+	wb_staging = NULL;
+	wb_write_fn = NULL;
+	wb_nsec = wb_head = wb_count = 0;
+	wb_error = RES_OK;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file fat_wb_internal.h
+ * @brief Write-behind sector queue for the FatFS SD backend
+ */
+#ifndef __LIBDRAGON_FAT_WB_INTERNAL_H
+#define __LIBDRAGON_FAT_WB_INTERNAL_H
+
+#include <stdbool.h>
+#include "fatfs/ff.h"
+#include "fatfs/diskio.h"
+
+/**
+ * @brief Default number of 512-byte dirty sectors the queue can hold.
+ *
+ * Can be overridden per-call in #__fat_wb_init. 64 sectors (32 KiB)
+ * absorbs several frames of replay-recording appends together with the
+ * FAT/directory metadata updates they cause.
+ */
+#ifndef FAT_WB_SECTORS
+#define FAT_WB_SECTORS      64
+#endif
+
+/**
+ * @brief Maximum sectors written to the card per flush step.
+ *
+ * A flush step gathers at most this many media-contiguous sectors from
+ * the front of the queue into one multi-sector write, bounding the work
+ * done by a single #__fat_wb_poll call.
+ */
+#ifndef FAT_WB_BURST
+#define FAT_WB_BURST        8
+#endif
+
+/** @brief Backend function writing raw sectors to the media. */
+typedef DRESULT (*fat_wb_write_fn_t)(const BYTE *buff, LBA_t sector, UINT count);
+
+/**
+ * @brief Initialize the write-behind queue.
+ *
+ * @param write_fn      Backend used to write sectors to the media
+ * @param num_sectors   Queue capacity in sectors, or 0 for #FAT_WB_SECTORS
+ *
+ * @return true on success, false if the queue memory could not be
+ *         allocated (writes then stay synchronous).
+ */
+bool __fat_wb_init(fat_wb_write_fn_t write_fn, int num_sectors);
+
+/** @brief Whether the write-behind queue is active. */
+bool __fat_wb_active(void);
+
+/**
+ * @brief Queue sectors for deferred writing.
+ *
+ * The data is copied into the queue and the call returns without any
+ * card traffic, unless the queue is full (the oldest sectors are then
+ * flushed to make room) or the request is too large to be worth
+ * staging (it is then written directly, after draining the queue so
+ * ordering is preserved). A sector already queued is updated in place.
+ *
+ * Returns a deferred write error recorded since the last report, if any.
+ */
+DRESULT __fat_wb_write(const BYTE *buff, LBA_t sector, UINT count);
+
+/** @brief Check whether any queued sector falls in the given range. */
+bool __fat_wb_overlaps(LBA_t sector, UINT count);
+
+/**
+ * @brief Flush one burst of queued sectors to the card.
+ *
+ * Performs one bounded write (at most #FAT_WB_BURST media-contiguous
+ * sectors from the front of the queue) so the latency of a single call
+ * stays predictable. Call from an idle point, eg: once per frame.
+ *
+ * @return the number of sectors still queued
+ */
+int __fat_wb_poll(void);
+
+/**
+ * @brief Drain the whole queue to the card.
+ *
+ * Returns the first error hit while flushing (also covering errors from
+ * earlier deferred flushes not yet reported), RES_OK otherwise.
+ */
+DRESULT __fat_wb_sync(void);
+
+/** @brief Drain the queue and release its memory (eg: on unmount). */
+void __fat_wb_close(void);
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file flightrec.c
+ * @brief Crash-dump flight recorder
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flightrec.h"
+#include "exception.h"
+#include "exception_internal.h"
+#include "n64sys.h"
+#include "usb.h"
+#include "compress/lz4_enc_internal.h"
+
+/**
+ * @defgroup flightrec Crash-dump flight recorder
+ * @ingroup debug
+ * @brief Always-on ring of recent activity, dumped compressed on crash.
+ *
+ * The recorder keeps three sources of history: the tail of the debug
+ * log (captured transparently by hooking the debug spew), fixed-size
+ * application events (#flightrec_event), and the tail of the current
+ * rspq buffer (read directly at dump time, so it costs nothing while
+ * running). On an unhandled exception the rings plus the register
+ * file are LZ4-compressed and streamed to USB and/or a file on SD.
+ *
+ * Dump format (all values big-endian, as written by the console):
+ *
+ *     'FLR1' <ticks u32>
+ *     per section: <fourcc u32> <raw_size u32> <cmp_size u32> <data>
+ *
+ * A section whose cmp_size equals raw_size is stored uncompressed;
+ * anything else is a raw LZ4 block. Sections: 'REGS' (reg_block_t),
+ * 'EVNT' (event records, oldest first), 'LOGT' (log tail bytes),
+ * 'RSPQ' (32-bit rspq command words).
+ */
+
+/** @brief Size of the log-tail ring in bytes (power of two) */
+#define FLIGHTREC_LOG_SIZE      8192
+/** @brief Number of event records kept (power of two) */
+#define FLIGHTREC_EVENTS        256
+/** @brief Maximum number of rspq command words dumped */
+#define FLIGHTREC_RSPQ_WORDS    256
+
+/** @brief Build a big-endian fourcc */
+#define FOURCC(a,b,c,d)   (((a)<<24) | ((b)<<16) | ((c)<<8) | (d))
+
+/** @brief One recorded event (16 bytes, so the ring write is trivial) */
+typedef struct
+{
+    uint32_t ticks;             ///< COP0 tick count at record time
+    uint16_t code;              ///< Application-defined event code
+    uint16_t _pad;              ///< Unused (keeps arguments aligned)
+    uint32_t arg0;              ///< First event argument
+    uint32_t arg1;              ///< Second event argument
+} flr_event_t;
+
+static uint8_t *flr_log;                ///< Log-tail ring (FLIGHTREC_LOG_SIZE)
+static uint32_t flr_log_widx;           ///< Monotonic log write index
+static flr_event_t *flr_events;         ///< Event ring (FLIGHTREC_EVENTS)
+static uint32_t flr_evt_widx;           ///< Monotonic event write index
+static uint8_t *flr_staging;            ///< Linearized ring, pre-compression
+static uint8_t *flr_out;                ///< Compressed section output
+static const char *flr_path;            ///< Dump file path (or NULL)
+static const reg_block_t *flr_regs;     ///< Registers of the crashed context
+static FILE *flr_fp;                    ///< Dump file while writing
+static bool flr_usb;                    ///< True if also dumping to USB
+
+/** @brief rspq crash hook; weak so rspq is not forced into the link */
+extern void __rspq_crash_tail(uint32_t **start, uint32_t **end) __attribute__((weak));
+
+bool flightrec_init(void)
+{
+    if (flr_log)
+        return true;
+
+    flr_log = malloc(FLIGHTREC_LOG_SIZE);
+    flr_events = calloc(FLIGHTREC_EVENTS, sizeof(flr_event_t));
+    flr_staging = malloc(FLIGHTREC_LOG_SIZE);
+    flr_out = malloc(LZ4_COMPRESS_BOUND(FLIGHTREC_LOG_SIZE));
+    if (!flr_log || !flr_events || !flr_staging || !flr_out)
+    {
+        free(flr_log); flr_log = NULL;
+        free(flr_events); flr_events = NULL;
+        free(flr_staging); flr_staging = NULL;
+        free(flr_out); flr_out = NULL;
+        return false;
+    }
+    flr_log_widx = 0;
+    flr_evt_widx = 0;
+    return true;
+}
+
+void flightrec_event(uint16_t code, uint32_t arg0, uint32_t arg1)
+{
+    if (!flr_events)
+        return;
+    flr_event_t *e = &flr_events[flr_evt_widx++ & (FLIGHTREC_EVENTS-1)];
+    e->ticks = TICKS_READ();
+    e->code = code;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+}
+
+/** @brief Append debug log spew to the log-tail ring (called by debug.c) */
+void __flightrec_log(const uint8_t *buf, int len)
+{
+    if (!flr_log)
+        return;
+    if (len > FLIGHTREC_LOG_SIZE)
+    {
+        buf += len - FLIGHTREC_LOG_SIZE;
+        len = FLIGHTREC_LOG_SIZE;
+    }
+    while (len > 0)
+    {
+        int pos = flr_log_widx & (FLIGHTREC_LOG_SIZE-1);
+        int chunk = FLIGHTREC_LOG_SIZE - pos;
+        if (chunk > len) chunk = len;
+        memcpy(flr_log + pos, buf, chunk);
+        flr_log_widx += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+}
+
+void flightrec_dump_file(const char *fn)
+{
+    flr_path = fn;
+}
+
+/** @brief Write to every active dump output */
+static void dump_write(const void *buf, int len)
+{
+    if (flr_fp)
+        fwrite(buf, 1, len, flr_fp);
+    if (flr_usb)
+        usb_write(DATATYPE_RAWBINARY, buf, len);
+}
+
+/** @brief Emit one section, compressed if that actually saves space */
+static void dump_section(uint32_t fourcc, const uint8_t *data, int size)
+{
+    uint32_t hdr[3] = { fourcc, size, size };
+    int cmp = -1;
+    if (size <= FLIGHTREC_LOG_SIZE)
+        cmp = compress_lz4_full_mem(data, size, flr_out,
+            LZ4_COMPRESS_BOUND(FLIGHTREC_LOG_SIZE));
+    if (cmp >= 0 && cmp < size)
+    {
+        hdr[2] = cmp;
+        dump_write(hdr, sizeof(hdr));
+        dump_write(flr_out, cmp);
+    }
+    else
+    {
+        dump_write(hdr, sizeof(hdr));
+        dump_write(data, size);
+    }
+}
+
+bool flightrec_dump(void)
+{
+    if (!flr_log)
+        return false;
+
+    flr_usb = usb_getcart() != CART_NONE;
+    flr_fp = flr_path ? fopen(flr_path, "wb") : NULL;
+    if (!flr_fp && !flr_usb)
+        return false;
+
+    uint32_t hdr[2] = { FOURCC('F','L','R','1'), TICKS_READ() };
+    dump_write(hdr, sizeof(hdr));
+
+    if (flr_regs)
+        dump_section(FOURCC('R','E','G','S'),
+            (const uint8_t*)flr_regs, sizeof(reg_block_t));
+
+    // Events, linearized oldest-first
+    uint32_t nevt = flr_evt_widx < FLIGHTREC_EVENTS ? flr_evt_widx : FLIGHTREC_EVENTS;
+    for (uint32_t i = 0; i < nevt; i++)
+        memcpy(flr_staging + i*sizeof(flr_event_t),
+            &flr_events[(flr_evt_widx - nevt + i) & (FLIGHTREC_EVENTS-1)],
+            sizeof(flr_event_t));
+    if (nevt > 0)
+        dump_section(FOURCC('E','V','N','T'), flr_staging, nevt*sizeof(flr_event_t));
+
+    // Log tail, linearized
+    uint32_t nlog = flr_log_widx < FLIGHTREC_LOG_SIZE ? flr_log_widx : FLIGHTREC_LOG_SIZE;
+    for (uint32_t i = 0; i < nlog; i++)
+        flr_staging[i] = flr_log[(flr_log_widx - nlog + i) & (FLIGHTREC_LOG_SIZE-1)];
+    if (nlog > 0)
+        dump_section(FOURCC('L','O','G','T'), flr_staging, nlog);
+
+    // Tail of the current rspq buffer, if rspq is linked and running
+    if (__rspq_crash_tail)
+    {
+        uint32_t *start, *end;
+        __rspq_crash_tail(&start, &end);
+        if (end && end > start)
+        {
+            if (end - start > FLIGHTREC_RSPQ_WORDS)
+                start = end - FLIGHTREC_RSPQ_WORDS;
+            dump_section(FOURCC('R','S','P','Q'),
+                (const uint8_t*)start, (end - start) * 4);
+        }
+    }
+
+    if (flr_fp)
+    {
+        fclose(flr_fp);
+        flr_fp = NULL;
+    }
+    return true;
+}
+
+/** @brief Dump the recorder from the unhandled exception path */
+void __flightrec_crash(exception_t *ex)
+{
+    static bool in_crash = false;
+    if (!flr_log || in_crash)
+        return;
+    in_crash = true;
+    flr_regs = ex->regs;
+    flightrec_dump();
+}
@@ -0,0 +1,195 @@
+/**
+ * @file fmath.c
+ * @brief Fixed-point math for the VR4300
+ * @ingroup fmath
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "fmath.h"
+#include "fmath_tables.h"
+
+fx32_t fm_sin(fm_angle_t angle)
+{
+    /* 1024 table steps per turn: the top 10 bits index, the bottom 6
+       interpolate linearly between adjacent entries */
+    int idx = angle >> 6;
+    int frac = angle & 63;
+    int32_t s0 = __fm_sintable[idx];
+    return s0 + (((__fm_sintable[idx + 1] - s0) * frac) >> 6);
+}
+
+fx32_t fm_cos(fm_angle_t angle)
+{
+    /* cos(a) = sin(a + 90 degrees); binary angles wrap for free */
+    return fm_sin((fm_angle_t)(angle + 0x4000));
+}
+
+fm_angle_t fm_atan2(fx32_t y, fx32_t x)
+{
+    if (x == 0 && y == 0)
+        return 0;
+
+    /* Octant reduction: fold into 0..45 degrees where the table lives,
+       by always dividing the smaller magnitude by the larger one */
+    uint32_t ax = x < 0 ? -(uint32_t)x : (uint32_t)x;
+    uint32_t ay = y < 0 ? -(uint32_t)y : (uint32_t)y;
+    uint32_t num = ay, den = ax;
+    bool swap = ay > ax;
+    if (swap) { num = ax; den = ay; }
+
+    /* num/den in 0.16, split into table index and interpolation weight */
+    uint32_t t = (uint32_t)(((uint64_t)num << 16) / den);
+    uint16_t base;
+    if (t >= 0x10000)
+    {
+        base = __fm_atantable[256];
+    }
+    else
+    {
+        int idx = t >> 8;
+        int frac = t & 255;
+        base = __fm_atantable[idx]
+             + (((__fm_atantable[idx + 1] - __fm_atantable[idx]) * frac) >> 8);
+    }
+
+    /* Unfold the octant, then the quadrant, using binary angle wraparound */
+    uint16_t ang = swap ? 0x4000 - base : base;
+    if (x < 0)
+        ang = 0x8000 - ang;
+    if (y < 0)
+        ang = -ang;
+    return ang;
+}
+
+fx32_t fx32_sqrt(fx32_t x)
+{
+    if (x <= 0)
+        return 0;
+
+    /* Classic bit-by-bit integer square root over the 48-bit value
+       x << 16, yielding the root directly in s16.16 */
+    uint64_t v = (uint64_t)(uint32_t)x << 16;
+    uint64_t res = 0;
+    uint64_t bit = 1ull << 46;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit)
+    {
+        if (v >= res + bit)
+        {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else
+        {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (fx32_t)res;
+}
+
+fx32_t fm_vec3_len(fm_vec3_t a)
+{
+    /* The squared length is accumulated at 64 bits, then narrowed to
+       s16.16 for the square root: lengths up to ~181.0 are exact */
+    int64_t sq = (int64_t)a.x * a.x + (int64_t)a.y * a.y + (int64_t)a.z * a.z;
+    return fx32_sqrt((fx32_t)(sq >> 16));
+}
+
+fm_vec3_t fm_vec3_normalize(fm_vec3_t a)
+{
+    fx32_t len = fm_vec3_len(a);
+    if (len == 0)
+        return a;
+    fx32_t inv = fx32_div(FX32_ONE, len);
+    return fm_vec3_scale(a, inv);
+}
+
+void fm_mat4_identity(fm_mat4_t *out)
+{
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            out->m[i][j] = i == j ? FX32_ONE : 0;
+}
+
+void fm_mat4_translate(fm_mat4_t *out, fx32_t x, fx32_t y, fx32_t z)
+{
+    fm_mat4_identity(out);
+    out->m[3][0] = x;
+    out->m[3][1] = y;
+    out->m[3][2] = z;
+}
+
+void fm_mat4_scale(fm_mat4_t *out, fx32_t x, fx32_t y, fx32_t z)
+{
+    fm_mat4_identity(out);
+    out->m[0][0] = x;
+    out->m[1][1] = y;
+    out->m[2][2] = z;
+}
+
+void fm_mat4_rotate(fm_mat4_t *out, int axis, fm_angle_t angle)
+{
+    fx32_t s = fm_sin(angle);
+    fx32_t c = fm_cos(angle);
+    /* The two axes that rotate into each other, in cyclic order so the
+       rotation is counterclockwise looking down the chosen axis */
+    int a = axis == 0 ? 1 : 0;
+    int b = axis == 2 ? 1 : 2;
+
+    fm_mat4_identity(out);
+    out->m[a][a] = c;
+    out->m[a][b] = s;
+    out->m[b][a] = -s;
+    out->m[b][b] = c;
+}
+
+void fm_mat4_mul(fm_mat4_t *out, const fm_mat4_t *a, const fm_mat4_t *b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        for (int j = 0; j < 4; j++)
+        {
+            /* 64-bit accumulation: four MULTs back to back, the adds
+               overlap the multiplier latency */
+            int64_t acc = (int64_t)a->m[i][0] * b->m[0][j]
+                        + (int64_t)a->m[i][1] * b->m[1][j]
+                        + (int64_t)a->m[i][2] * b->m[2][j]
+                        + (int64_t)a->m[i][3] * b->m[3][j];
+            out->m[i][j] = (fx32_t)(acc >> 16);
+        }
+    }
+}
+
+fm_vec3_t fm_mat4_transform(const fm_mat4_t *m, fm_vec3_t v)
+{
+    fm_vec3_t out;
+    out.x = (fx32_t)((((int64_t)v.x * m->m[0][0] + (int64_t)v.y * m->m[1][0]
+                     + (int64_t)v.z * m->m[2][0]) >> 16) + m->m[3][0]);
+    out.y = (fx32_t)((((int64_t)v.x * m->m[0][1] + (int64_t)v.y * m->m[1][1]
+                     + (int64_t)v.z * m->m[2][1]) >> 16) + m->m[3][1]);
+    out.z = (fx32_t)((((int64_t)v.x * m->m[0][2] + (int64_t)v.y * m->m[1][2]
+                     + (int64_t)v.z * m->m[2][2]) >> 16) + m->m[3][2]);
+    return out;
+}
+
+fm_vec3_t fm_mat4_transform_vec(const fm_mat4_t *m, fm_vec3_t v)
+{
+    fm_vec3_t out;
+    out.x = (fx32_t)(((int64_t)v.x * m->m[0][0] + (int64_t)v.y * m->m[1][0]
+                    + (int64_t)v.z * m->m[2][0]) >> 16);
+    out.y = (fx32_t)(((int64_t)v.x * m->m[0][1] + (int64_t)v.y * m->m[1][1]
+                    + (int64_t)v.z * m->m[2][1]) >> 16);
+    out.z = (fx32_t)(((int64_t)v.x * m->m[0][2] + (int64_t)v.y * m->m[1][2]
+                    + (int64_t)v.z * m->m[2][2]) >> 16);
+    return out;
+}
+
+void fm_mat4_to_float(const fm_mat4_t *m, float out[4][4])
+{
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            out[i][j] = m->m[i][j] * (1.0f / 65536.0f);
+}
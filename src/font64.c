@@ -0,0 +1,140 @@
+/**
+ * @file font64.c
+ * @brief Variable-width bitmap fonts with kerning
+ * @ingroup graphics
+ */
+
+#include "font64.h"
+#include "rdp.h"
+#include "asset.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/** @brief Look up the glyph of a character (NULL if the font does not cover it) */
+static font64_glyph_t *font64_glyph(font64_t *font, int ch) {
+	if (ch < font->first_char || ch >= font->first_char + font->num_chars)
+		return NULL;
+	return &font->glyphs[ch - font->first_char];
+}
+
+/** @brief Binary search the kerning adjustment of a glyph pair */
+static int font64_kerning(font64_t *font, int first, int second) {
+	int lo = 0, hi = font->num_kerns - 1;
+	int key = (first << 8) | second;
+
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int probe = (font->kerns[mid].first << 8) | font->kerns[mid].second;
+
+		if (probe == key)
+			return font->kerns[mid].amount;
+		if (probe < key)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+
+	return 0;
+}
+
+font64_t *font64_load(const char *fn) {
+	int sz;
+	font64_header_t *head = asset_load(fn, &sz);
+
+	assertf(sz >= sizeof(font64_header_t) && memcmp(head->magic, "FNT1", 4) == 0,
+		"invalid FONT64 file: %s", fn);
+
+	font64_t *font = malloc(sizeof(font64_t));
+	assert(font != NULL);
+
+	font->data = head;
+	font->glyphs = (font64_glyph_t*)((uint8_t*)head + sizeof(font64_header_t));
+	font->kerns = (font64_kern_t*)(font->glyphs + head->num_chars);
+	font->palette = head->palette;
+	font->first_char = head->first_char;
+	font->num_chars = head->num_chars;
+	font->num_kerns = head->num_kerns;
+	font->line_height = head->line_height;
+	font->baseline = head->baseline;
+
+	memset(font->sheets, 0, sizeof(font->sheets));
+	for (int i = 0; i < head->num_sheets; i++)
+		font->sheets[i] = (sprite_t*)((uint8_t*)head + head->sheet_offset[i]);
+
+	return font;
+}
+
+void font64_free(font64_t *font) {
+	if (!font)
+		return;
+	free(font->data);
+	free(font);
+}
+
+int font64_text_width(font64_t *font, const char *text) {
+	int width = 0, line = 0;
+	int last = -1;
+
+	for (; *text; text++) {
+		if (*text == '\n') {
+			if (line > width) width = line;
+			line = 0; last = -1;
+			continue;
+		}
+
+		font64_glyph_t *glyph = font64_glyph(font, (uint8_t)*text);
+		if (!glyph)
+			continue;
+
+		if (last >= 0)
+			line += font64_kerning(font, last, (uint8_t)*text);
+		line += glyph->xadvance;
+		last = (uint8_t)*text;
+	}
+
+	return line > width ? line : width;
+}
+
+void font64_draw_text(uint32_t texslot, font64_t *font, int x, int y, const char *text) {
+	int tx = x, ty = y;
+	int last = -1;
+	int cur_sheet = -1;
+
+	/* Shared across every sheet; the palette tracker makes repeats free */
+	rdp_load_palette(font->palette, 16);
+
+	for (; *text; text++) {
+		if (*text == '\n') {
+			tx = x; ty += font->line_height;
+			last = -1;
+			continue;
+		}
+
+		font64_glyph_t *glyph = font64_glyph(font, (uint8_t)*text);
+		if (!glyph)
+			continue;
+
+		if (last >= 0)
+			tx += font64_kerning(font, last, (uint8_t)*text);
+
+		if (glyph->width) {
+			/* Hop to the sheet holding this glyph.  The TMEM residency
+			   tracker skips the load when the sheet is already resident,
+			   so runs of glyphs from one sheet cost a single upload */
+			if (glyph->sheet != cur_sheet) {
+				if (cur_sheet >= 0)
+					rdp_sync(SYNC_PIPE);
+				rdp_load_texture(texslot, 0, MIRROR_DISABLED, font->sheets[glyph->sheet]);
+				cur_sheet = glyph->sheet;
+			}
+
+			rdp_draw_textured_sub_rectangle(texslot, tx + glyph->xofs, ty + glyph->yofs,
+				glyph->x, glyph->y, glyph->width, glyph->height);
+		}
+
+		tx += glyph->xadvance;
+		last = (uint8_t)*text;
+	}
+}
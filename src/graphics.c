@@ -4,12 +4,14 @@
  * @ingroup graphics
  */
 #include <stdint.h>
+#include <stdbool.h>
 #include <malloc.h>
 #include <string.h>
 #include "display.h"
 #include "graphics.h"
 #include "font.h"
 #include "surface.h"
+#include "n64types.h"
 
 /**
  * @defgroup graphics 2D Graphics
@@ -34,10 +36,21 @@
  *
  * The graphics subsystem makes use of the same contexts as the @ref rdp.  Thus,
  * with careful coding, both hardware and software routines can be used to draw
- * to the display context with no ill effects.  The colors returned by 
+ * to the display context with no ill effects.  The colors returned by
  * #graphics_make_color and #graphics_convert_color are also compatible with both
  * hardware and software graphics routines.
  *
+ * Besides 16 and 32-bit framebuffers, the drawing routines also accept 8-bit
+ * indexed surfaces (#FMT_CI8, see #surface_alloc).  On those, the color
+ * argument is a palette index (0-255) rather than a packed color, at half the
+ * memory traffic per pixel of a 16-bit buffer; the index-to-color conversion
+ * is left to the RDP, which can expand the surface to the framebuffer in a
+ * single hardware pass with #rdp_draw_surface_ci8.  Since the actual colors
+ * only materialize at expansion time, no software alpha blending is possible
+ * on indexed surfaces: palette index 0 is conventionally transparent, and the
+ * "trans" variants of the drawing functions fall back to that binary
+ * transparency.
+ *
  * @{
  */
 
@@ -205,7 +218,13 @@ void graphics_set_color( uint32_t forecolor, uint32_t backcolor )
  */
 static int __is_transparent( int bitdepth, uint32_t color )
 {
-    if( bitdepth == 2 )
+    if( bitdepth == 1 )
+    {
+        /* Indexed surfaces carry no alpha in the pixel itself: by convention,
+           palette index 0 is the transparent entry */
+        if( (color & 0xFF) == 0x00 ) { return 1; }
+    }
+    else if( bitdepth == 2 )
     {
         /* Is alpha bit set? */
         if( (color & 0x1) == 0x0 ) { return 1; }
@@ -240,7 +259,12 @@ void graphics_draw_pixel( surface_t* disp, int x, int y, uint32_t color )
     if( disp == 0 ) { return; }
     int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
 
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    int bitdepth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
+    if( bitdepth == 8 )
+    {
+        __set_pixel( (uint8_t *)__get_buffer( disp ), x, y, color );
+    }
+    else if( bitdepth == 16 )
     {
         __set_pixel( (uint16_t *)__get_buffer( disp ), x, y, color );
     }
@@ -271,7 +295,18 @@ void graphics_draw_pixel_trans( surface_t* disp, int x, int y, uint32_t color )
     if( disp == 0 ) { return; }
     int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
 
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    int bitdepth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
+    if( bitdepth == 8 )
+    {
+        /* Indexed surfaces cannot blend in software: the actual color (and
+           its alpha) only materializes when the palette is applied.  Only
+           binary transparency via index 0 is supported. */
+        if( !__is_transparent( 1, color ) )
+        {
+            __set_pixel( (uint8_t *)__get_buffer( disp ), x, y, color );
+        }
+    }
+    else if( bitdepth == 16 )
     {
         /* Only display the pixel if alpha bit is set */
         if( !__is_transparent( 2, color ) )
@@ -469,6 +504,380 @@ void graphics_draw_line_trans( surface_t* disp, int x0, int y0, int x1, int y1,
 	}
 }
 
+/**
+ * @brief Copy a row of 16-bit pixels
+ *
+ * This is the hot loop of all opaque blits on 16-bit surfaces. It aligns the
+ * destination to 8 bytes and then copies with (unrolled) 64-bit stores; the
+ * source is read through #u_uint64_t so that it can sit at any 2-byte phase
+ * relative to the destination.
+ *
+ * @param[out] dst
+ *             Pointer to the first destination pixel
+ * @param[in]  src
+ *             Pointer to the first source pixel
+ * @param[in]  w
+ *             Number of pixels to copy
+ */
+static void __blit_row_16( uint16_t *dst, const uint16_t *src, int w )
+{
+    while( w > 0 && ((uint32_t)dst & 7) )
+    {
+        *dst++ = *src++;
+        w--;
+    }
+
+    uint64_t *dst64 = (uint64_t *)dst;
+    const u_uint64_t *src64 = (const u_uint64_t *)src;
+    while( w >= 16 )
+    {
+        dst64[0] = src64[0];
+        dst64[1] = src64[1];
+        dst64[2] = src64[2];
+        dst64[3] = src64[3];
+        dst64 += 4; src64 += 4;
+        w -= 16;
+    }
+    while( w >= 4 )
+    {
+        *dst64++ = *src64++;
+        w -= 4;
+    }
+
+    dst = (uint16_t *)dst64;
+    src = (const uint16_t *)src64;
+    while( w-- > 0 )
+        *dst++ = *src++;
+}
+
+/**
+ * @brief Copy a row of 32-bit pixels
+ *
+ * 32-bit counterpart of #__blit_row_16: destination-aligned, unrolled
+ * 64-bit stores.
+ *
+ * @param[out] dst
+ *             Pointer to the first destination pixel
+ * @param[in]  src
+ *             Pointer to the first source pixel
+ * @param[in]  w
+ *             Number of pixels to copy
+ */
+static void __blit_row_32( uint32_t *dst, const uint32_t *src, int w )
+{
+    if( w > 0 && ((uint32_t)dst & 7) )
+    {
+        *dst++ = *src++;
+        w--;
+    }
+
+    uint64_t *dst64 = (uint64_t *)dst;
+    const u_uint64_t *src64 = (const u_uint64_t *)src;
+    while( w >= 8 )
+    {
+        dst64[0] = src64[0];
+        dst64[1] = src64[1];
+        dst64[2] = src64[2];
+        dst64[3] = src64[3];
+        dst64 += 4; src64 += 4;
+        w -= 8;
+    }
+    while( w >= 2 )
+    {
+        *dst64++ = *src64++;
+        w -= 2;
+    }
+
+    if( w > 0 )
+        *(uint32_t *)dst64 = *(const uint32_t *)src64;
+}
+
+/**
+ * @brief Copy a row of 16-bit pixels, skipping transparent ones
+ *
+ * Instead of testing and storing pixel by pixel, the row is scanned for
+ * spans of consecutive opaque pixels (alpha bit set), and each span is
+ * copied with #__blit_row_16. UI graphics are typically made of solid areas
+ * on a transparent background, so spans are long and the per-pixel
+ * branching mostly disappears.
+ *
+ * @param[out] dst
+ *             Pointer to the first destination pixel
+ * @param[in]  src
+ *             Pointer to the first source pixel
+ * @param[in]  w
+ *             Number of pixels to process
+ */
+static void __blit_row_trans_16( uint16_t *dst, const uint16_t *src, int w )
+{
+    int i = 0;
+    while( i < w )
+    {
+        /* Skip the transparent span (alpha bit clear) */
+        while( i < w && !(src[i] & 0x1) )
+            i++;
+
+        /* Measure the opaque span and blit it in one go */
+        int start = i;
+        while( i < w && (src[i] & 0x1) )
+            i++;
+        if( i > start )
+            __blit_row_16( dst + start, src + start, i - start );
+    }
+}
+
+/**
+ * @brief Blend a row of 32-bit pixels, with fast paths for spans
+ *
+ * Fully transparent pixels (alpha 0) are skipped and spans of fully opaque
+ * pixels (alpha 255) are copied with #__blit_row_32; only translucent
+ * pixels go through the read-modify-write blending math. Notice that this
+ * means that fully transparent and fully opaque pixels are no longer
+ * subject to the 1/256 rounding loss of the blend equation.
+ *
+ * @param[out] dst
+ *             Pointer to the first destination pixel
+ * @param[in]  src
+ *             Pointer to the first source pixel
+ * @param[in]  w
+ *             Number of pixels to process
+ */
+static void __blit_row_trans_32( uint32_t *dst, const uint32_t *src, int w )
+{
+    int i = 0;
+    while( i < w )
+    {
+        uint32_t color = src[i];
+        uint32_t st = color & 0xFF;
+
+        if( st == 0x00 )
+        {
+            i++;
+            continue;
+        }
+
+        if( st == 0xFF )
+        {
+            int start = i;
+            do i++; while( i < w && (src[i] & 0xFF) == 0xFF );
+            __blit_row_32( dst + start, src + start, i - start );
+            continue;
+        }
+
+        /* Get 32bit representations */
+        uint32_t cur_color = dst[i];
+
+        /* Get current color */
+        uint32_t cr = (cur_color >> 24) & 0xFF;
+        uint32_t cg = (cur_color >> 16) & 0xFF;
+        uint32_t cb = (cur_color >> 8) & 0xFF;
+
+        /* Get new color */
+        uint32_t sr = (color >> 24) & 0xFF;
+        uint32_t sg = (color >> 16) & 0xFF;
+        uint32_t sb = (color >> 8) & 0xFF;
+
+        /* Transparencies */
+        uint32_t ct = 255 - st;
+
+        /* Mixed color (full alpha, since we are doing mixing anyway) */
+        uint32_t mixed_color;
+        mixed_color  = (((cr * ct) + (sr * st)) >> 8) << 24;
+        mixed_color |= (((cg * ct) + (sg * st)) >> 8) << 16;
+        mixed_color |= (((cb * ct) + (sb * st)) >> 8) << 8;
+        mixed_color |= 0xFF;
+
+        dst[i] = mixed_color;
+        i++;
+    }
+}
+
+/**
+ * @brief Advance a sprite span stream past one row
+ *
+ * Span metadata (see #SPRITE_FORMAT_ALPHA_SPANS) is a single stream shared
+ * by all rows; rows clipped away still have to be walked to find the next
+ * row's entries, which only costs reading the counts.
+ *
+ * @param[in] span
+ *            Pointer to the first span entry of the row
+ * @param[in] width
+ *            Width of the sprite in pixels
+ *
+ * @return Pointer to the first span entry of the next row
+ */
+static const uint16_t *__skip_row_spans( const uint16_t *span, int width )
+{
+    int pos = 0;
+    while( pos < width )
+        pos += *span++ & 0x3FFF;
+    return span;
+}
+
+/**
+ * @brief Blit a row of 16-bit pixels by walking precomputed spans
+ *
+ * Transparent spans are skipped without reading the pixel data and opaque
+ * spans go straight to #__blit_row_16; the per-pixel alpha test of
+ * #__blit_row_trans_16 only remains as a fallback for span opcodes the
+ * 16-bit converter never emits.  Every span is clipped against [sx, ex).
+ *
+ * @param[out] dst
+ *             Pointer to the destination pixel of column 0 of the row
+ * @param[in]  src
+ *             Pointer to the first source pixel of the row
+ * @param[in]  span
+ *             Pointer to the first span entry of the row
+ * @param[in]  width
+ *             Width of the sprite in pixels
+ * @param[in]  sx
+ *             First column to draw
+ * @param[in]  ex
+ *             One past the last column to draw
+ *
+ * @return Pointer to the first span entry of the next row
+ */
+static const uint16_t *__blit_row_spans_16( uint16_t *dst, const uint16_t *src, const uint16_t *span, int width, int sx, int ex )
+{
+    int pos = 0;
+    while( pos < width )
+    {
+        uint16_t entry = *span++;
+        int op = entry >> 14;
+        int start = pos > sx ? pos : sx;
+        int end = pos + (entry & 0x3FFF);
+
+        pos = end;
+        if( end > ex ) { end = ex; }
+
+        if( op && end > start )
+        {
+            if( op == 1 )
+                __blit_row_16( dst + start, src + start, end - start );
+            else
+                __blit_row_trans_16( dst + start, src + start, end - start );
+        }
+    }
+    return span;
+}
+
+/**
+ * @brief Blit a row of 32-bit pixels by walking precomputed spans
+ *
+ * 32-bit counterpart of #__blit_row_spans_16: transparent spans are
+ * skipped, opaque spans are copied whole, and only translucent spans pay
+ * for the read-modify-write blending of #__blit_row_trans_32.
+ *
+ * @param[out] dst
+ *             Pointer to the destination pixel of column 0 of the row
+ * @param[in]  src
+ *             Pointer to the first source pixel of the row
+ * @param[in]  span
+ *             Pointer to the first span entry of the row
+ * @param[in]  width
+ *             Width of the sprite in pixels
+ * @param[in]  sx
+ *             First column to draw
+ * @param[in]  ex
+ *             One past the last column to draw
+ *
+ * @return Pointer to the first span entry of the next row
+ */
+static const uint16_t *__blit_row_spans_32( uint32_t *dst, const uint32_t *src, const uint16_t *span, int width, int sx, int ex )
+{
+    int pos = 0;
+    while( pos < width )
+    {
+        uint16_t entry = *span++;
+        int op = entry >> 14;
+        int start = pos > sx ? pos : sx;
+        int end = pos + (entry & 0x3FFF);
+
+        pos = end;
+        if( end > ex ) { end = ex; }
+
+        if( op && end > start )
+        {
+            if( op == 1 )
+                __blit_row_32( dst + start, src + start, end - start );
+            else
+                __blit_row_trans_32( dst + start, src + start, end - start );
+        }
+    }
+    return span;
+}
+
+/**
+ * @brief Fill a row of pixels with a solid color
+ *
+ * Works for 8-bit, 16-bit and 32-bit surfaces: the row is described in
+ * bytes, and "color" must contain the pixel replicated to fill 32 bits
+ * (which is what #graphics_convert_color returns for 16-bit modes). The
+ * destination is aligned to 8 bytes and then filled with 64-bit stores.
+ *
+ * @param[out] dst
+ *             Pointer to the first byte of the row
+ * @param[in]  color
+ *             Pixel color, replicated to 32 bits
+ * @param[in]  nbytes
+ *             Length of the row in bytes
+ */
+static void __fill_row( void *dst, uint32_t color, int nbytes )
+{
+    uint8_t *d = (uint8_t *)dst;
+
+    /* Align to 8 bytes. Notice that the sub-word phases can only happen on
+       surfaces of matching depth, where any aligned chunk of the replicated
+       color is the packed pixel itself (the 1-byte phase only on 8-bit
+       surfaces, the 2-byte phase on 8 and 16-bit ones). */
+    if( nbytes >= 1 && ((uint32_t)d & 1) )
+    {
+        *d = color;
+        d += 1; nbytes -= 1;
+    }
+    if( nbytes >= 2 && ((uint32_t)d & 2) )
+    {
+        *(uint16_t *)d = color;
+        d += 2; nbytes -= 2;
+    }
+    if( nbytes >= 4 && ((uint32_t)d & 4) )
+    {
+        *(uint32_t *)d = color;
+        d += 4; nbytes -= 4;
+    }
+
+    uint64_t color64 = ((uint64_t)color << 32) | color;
+    uint64_t *dst64 = (uint64_t *)d;
+    while( nbytes >= 32 )
+    {
+        dst64[0] = color64;
+        dst64[1] = color64;
+        dst64[2] = color64;
+        dst64[3] = color64;
+        dst64 += 4;
+        nbytes -= 32;
+    }
+    while( nbytes >= 8 )
+    {
+        *dst64++ = color64;
+        nbytes -= 8;
+    }
+
+    d = (uint8_t *)dst64;
+    if( nbytes >= 4 )
+    {
+        *(uint32_t *)d = color;
+        d += 4; nbytes -= 4;
+    }
+    if( nbytes >= 2 )
+    {
+        *(uint16_t *)d = color;
+        d += 2; nbytes -= 2;
+    }
+    if( nbytes >= 1 )
+        *d = color;
+}
+
 /**
  * @brief Draw a filled rectangle to a display context
  *
@@ -494,16 +903,32 @@ void graphics_draw_box( surface_t* disp, int x, int y, int width, int height, ui
     if( disp == 0 ) { return; }
 
     int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    int bitdepth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
+    if( bitdepth == 8 )
+    {
+        uint8_t *buffer8 = (uint8_t *)__get_buffer( disp );
+
+        /* Replicate the palette index to 32 bits, as required by __fill_row */
+        color &= 0xFF;
+        color *= 0x01010101;
+
+        for(int j = y; j < y + height; j++)
+        {
+            __fill_row( buffer8 + x + (j * pix_stride), color, width );
+        }
+    }
+    else if( bitdepth == 16 )
     {
         uint16_t *buffer16 = (uint16_t *)__get_buffer( disp );
 
+        /* Replicate the packed pixel to 32 bits, as required by __fill_row.
+           graphics_convert_color already does this, but accept bare 16-bit
+           colors too. */
+        color = (color << 16) | (color & 0xFFFF);
+
         for(int j = y; j < y + height; j++)
         {
-            for(int i = x; i < x + width; i++)
-            {
-                __set_pixel( buffer16, i, j, color );
-            }
+            __fill_row( buffer16 + x + (j * pix_stride), color, width * 2 );
         }
     }
     else
@@ -512,10 +937,7 @@ void graphics_draw_box( surface_t* disp, int x, int y, int width, int height, ui
 
         for(int j = y; j < y + height; j++)
         {
-            for(int i = x; i < x + width; i++)
-            {
-                __set_pixel( buffer32, i, j, color );
-            }
+            __fill_row( buffer32 + x + (j * pix_stride), color, width * 4 );
         }
     }
 }
@@ -545,26 +967,53 @@ void graphics_draw_box_trans( surface_t* disp, int x, int y, int width, int heig
     if( disp == 0 ) { return; }
 
     int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
-    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 16 )
+    int bitdepth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
+    if( bitdepth == 8 )
     {
+        /* Binary transparency only: indexed surfaces cannot blend in
+           software (see #graphics_draw_pixel_trans) */
+        if( __is_transparent( 1, color ) ) { return; }
+
+        uint8_t *buffer8 = (uint8_t *)__get_buffer( disp );
+        color &= 0xFF;
+        color *= 0x01010101;
+
+        for(int j = y; j < y + height; j++)
+        {
+            __fill_row( buffer8 + x + (j * pix_stride), color, width );
+        }
+    }
+    else if( bitdepth == 16 )
+    {
+        /* Binary transparency: the box is either fully drawn or not at all */
+        if( __is_transparent( 2, color ) ) { return; }
+
         uint16_t *buffer16 = (uint16_t *)__get_buffer( disp );
+        color = (color << 16) | (color & 0xFFFF);
 
         for(int j = y; j < y + height; j++)
         {
-            for(int i = x; i < x + width; i++)
-            {
-                /* Only display the pixel if alpha bit is set */
-                if( !__is_transparent( 2, color ) )
-                {
-                    __set_pixel( buffer16, i, j, color );
-                }
-            }
+            __fill_row( buffer16 + x + (j * pix_stride), color, width * 2 );
         }
     }
     else
     {
         uint32_t *buffer32 = (uint32_t *)__get_buffer( disp );
 
+        /* Get new color (invariant over the whole box) */
+        uint32_t sr = (color >> 24) & 0xFF;
+        uint32_t sg = (color >> 16) & 0xFF;
+        uint32_t sb = (color >> 8) & 0xFF;
+
+        /* Transparencies */
+        uint32_t st = color & 0xFF;
+        uint32_t ct = 255 - st;
+
+        /* Premultiplied source terms */
+        uint32_t pr = sr * st;
+        uint32_t pg = sg * st;
+        uint32_t pb = sb * st;
+
         for(int j = y; j < y + height; j++)
         {
             for(int i = x; i < x + width; i++)
@@ -577,25 +1026,12 @@ void graphics_draw_box_trans( surface_t* disp, int x, int y, int width, int heig
                 uint32_t cg = (cur_color >> 16) & 0xFF;
                 uint32_t cb = (cur_color >> 8) & 0xFF;
 
-                /* Get new color */
-                uint32_t sr = (color >> 24) & 0xFF;
-                uint32_t sg = (color >> 16) & 0xFF;
-                uint32_t sb = (color >> 8) & 0xFF;
-
-                /* Transparencies */
-                uint32_t st = color & 0xFF;
-                uint32_t ct = 255 - st;
-
-                /* Mixed color */
+                /* Mixed color (full alpha, since we are doing mixing anyway) */
                 uint32_t mixed_color;
-                uint8_t *final_color = (uint8_t *)(&mixed_color);
-
-                final_color[0] = ((cr * ct) + (sr * st)) >> 8;
-                final_color[1] = ((cg * ct) + (sg * st)) >> 8;
-                final_color[2] = ((cb * ct) + (sb * st)) >> 8;
-
-                /* Since we are doing mixing anyway */
-                final_color[3] = 255;
+                mixed_color  = (((cr * ct) + pr) >> 8) << 24;
+                mixed_color |= (((cg * ct) + pg) >> 8) << 16;
+                mixed_color |= (((cb * ct) + pb) >> 8) << 8;
+                mixed_color |= 0xFF;
 
                 __set_pixel( buffer32, i, j, mixed_color );
             }
@@ -621,6 +1057,10 @@ void graphics_fill_screen( surface_t* disp, uint32_t c )
 
     int len = TEX_FORMAT_PIX2BYTES(surface_get_format(disp), disp->width * disp->height) / 8;
 
+    /* On indexed surfaces, replicate the palette index to fill the word */
+    if( TEX_FORMAT_BITDEPTH(surface_get_format( disp )) == 8 )
+        c = (c & 0xFF) * 0x01010101;
+
     uint64_t c64 = ((uint64_t)c << 32) | c;
     uint64_t *buffer = (uint64_t *)__get_buffer(disp);
     for( int i = 0; i < len; i++ )
@@ -659,38 +1099,31 @@ void graphics_set_font_sprite( sprite_t *font )
 }
 
 /**
- * @brief Draw a character to the screen using the built-in font
+ * @brief Render a character of the current font into a pixel buffer
  *
- * Draw a character from the built-in font to the screen.  This function does not support alpha blending, 
- * only binary transparency.  If the background color is fully transparent, the font is drawn with no
- * background.  Otherwise, the font is drawn on a fully colored background.  The foreground and background
- * can be set using #graphics_set_color.
+ * This is the internal workhorse of #graphics_draw_character,
+ * #graphics_draw_text and #graphics_render_text: all the per-call setup
+ * (font selection, transparency check, buffer/stride/depth computation)
+ * is hoisted into the callers, so that drawing a whole string doesn't
+ * repeat it for every glyph.
  *
- * @param[in] disp
- *            The currently active display context.
- * @param[in] x
- *            The X coordinate to place the top left pixel of the character drawn.
- * @param[in] y
- *            The Y coordinate to place the top left pixel of the character drawn.
- * @param[in] ch
- *            The ASCII character to draw to the screen.
+ * @param[out] vbuffer
+ *             Pixel buffer to draw into (uint8_t, uint16_t or uint32_t array)
+ * @param[in]  pix_stride
+ *             Width of a buffer row, in pixels
+ * @param[in]  depth
+ *             Either 1, 2 or 4 for indexed 8 bpp, 16 bpp or 32 bpp mode
+ * @param[in]  trans
+ *             Whether the background should be left untouched
+ * @param[in]  x
+ *             The X coordinate to place the top left pixel of the character
+ * @param[in]  y
+ *             The Y coordinate to place the top left pixel of the character
+ * @param[in]  ch
+ *             The ASCII character to draw
  */
-void graphics_draw_character( surface_t* disp, int x, int y, char ch )
+static void __draw_character( void *vbuffer, int pix_stride, int depth, int trans, int x, int y, char ch )
 {
-    if( disp == 0 ) { return; }
-
-    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
-    int depth = display_get_bitdepth();
-
-    // setting default font if none was set previously
-    if( sprite_font.sprite == NULL || depth != sprite_font.sprite->bitdepth )
-    {
-        graphics_set_default_font();
-    }
-
-    /* Figure out if they want the background to be transparent */
-    int trans = __is_transparent( depth, b_color );
-
     const int sx = ( ch % sprite_font.sprite->hslices ) * sprite_font.font_width;
     const int sy = ( ch / sprite_font.sprite->hslices ) * sprite_font.font_height;
     const int ex = sx + sprite_font.font_width;
@@ -701,7 +1134,7 @@ void graphics_draw_character( surface_t* disp, int x, int y, char ch )
 
     if( depth == 2 )
     {
-        uint16_t *buffer = (uint16_t *)__get_buffer( disp );
+        uint16_t *buffer = (uint16_t *)vbuffer;
         uint16_t *sp_data = (uint16_t *)sprite_font.sprite->data;
 
         for( int yp = sy; yp < ey; yp++ )
@@ -725,9 +1158,43 @@ void graphics_draw_character( surface_t* disp, int x, int y, char ch )
             }
         }
     }
+    else if( depth == 1 )
+    {
+        /* Indexed surfaces use the font glyphs as a coverage mask only: the
+           pixels written are the palette indices held in f_color/b_color, so
+           both the 16 and 32-bit font sprites work. */
+        uint8_t *buffer = (uint8_t *)vbuffer;
+        bool font16 = sprite_font.sprite->bitdepth == 2;
+
+        for( int yp = sy; yp < ey; yp++ )
+        {
+            const register int run = yp * sprite_font.sprite->width;
+
+            for( int xp = sx; xp < ex; xp++ )
+            {
+                bool set;
+                if( font16 )
+                    set = ( ((uint16_t *)sprite_font.sprite->data)[xp + run] & 0x1 ) != 0x0;
+                else
+                    set = ( ((uint32_t *)sprite_font.sprite->data)[xp + run] & 0xFF ) != 0x00;
+
+                if( trans )
+                {
+                    if( set )
+                    {
+                        __set_pixel( buffer, tx + xp, ty + yp, f_color );
+                    }
+                }
+                else
+                {
+                    __set_pixel( buffer, tx + xp, ty + yp, set ? f_color : b_color );
+                }
+            }
+        }
+    }
     else
     {
-        uint32_t *buffer = (uint32_t *)__get_buffer( disp );
+        uint32_t *buffer = (uint32_t *)vbuffer;
         uint32_t *sp_data = (uint32_t *)sprite_font.sprite->data;
 
         for( int yp = sy; yp < ey; yp++ )
@@ -753,6 +1220,45 @@ void graphics_draw_character( surface_t* disp, int x, int y, char ch )
     }
 }
 
+/**
+ * @brief Draw a character to the screen using the built-in font
+ *
+ * Draw a character from the built-in font to the screen.  This function does not support alpha blending,
+ * only binary transparency.  If the background color is fully transparent, the font is drawn with no
+ * background.  Otherwise, the font is drawn on a fully colored background.  The foreground and background
+ * can be set using #graphics_set_color.
+ *
+ * @param[in] disp
+ *            The currently active display context.
+ * @param[in] x
+ *            The X coordinate to place the top left pixel of the character drawn.
+ * @param[in] y
+ *            The Y coordinate to place the top left pixel of the character drawn.
+ * @param[in] ch
+ *            The ASCII character to draw to the screen.
+ */
+void graphics_draw_character( surface_t* disp, int x, int y, char ch )
+{
+    if( disp == 0 ) { return; }
+
+    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
+
+    /* Indexed surfaces draw with palette indices, at one byte per pixel;
+       any font works there since glyphs are only used as a mask */
+    int depth = TEX_FORMAT_BITDEPTH(surface_get_format(disp)) == 8 ? 1 : display_get_bitdepth();
+
+    // setting default font if none was set previously
+    if( sprite_font.sprite == NULL || ( depth != 1 && depth != sprite_font.sprite->bitdepth ) )
+    {
+        graphics_set_default_font();
+    }
+
+    /* Figure out if they want the background to be transparent */
+    int trans = __is_transparent( depth, b_color );
+
+    __draw_character( __get_buffer( disp ), pix_stride, depth, trans, x, y, ch );
+}
+
 /**
  * @brief Draw a null terminated string to a display context
  *
@@ -778,6 +1284,25 @@ void graphics_draw_text( surface_t* disp, int x, int y, const char * const msg )
     if( disp == 0 ) { return; }
     if( msg == 0 ) { return; }
 
+    /* Hoist the per-character setup out of the loop: for long strings this
+       is a significant part of the cost of drawing a glyph. */
+    int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
+
+    /* Indexed surfaces draw with palette indices, at one byte per pixel;
+       any font works there since glyphs are only used as a mask */
+    int depth = TEX_FORMAT_BITDEPTH(surface_get_format(disp)) == 8 ? 1 : display_get_bitdepth();
+
+    // setting default font if none was set previously
+    if( sprite_font.sprite == NULL || ( depth != 1 && depth != sprite_font.sprite->bitdepth ) )
+    {
+        graphics_set_default_font();
+    }
+
+    /* Figure out if they want the background to be transparent */
+    int trans = __is_transparent( depth, b_color );
+
+    void *buffer = __get_buffer( disp );
+
     int tx = x;
     int ty = y;
     const char *text = (const char *)msg;
@@ -798,7 +1323,7 @@ void graphics_draw_text( surface_t* disp, int x, int y, const char * const msg )
                 tx += sprite_font.font_width * 5;
                 break;
             default:
-                graphics_draw_character( disp, tx, ty, *text );
+                __draw_character( buffer, pix_stride, depth, trans, tx, ty, *text );
                 tx += sprite_font.font_width;
                 break;
         }
@@ -807,6 +1332,120 @@ void graphics_draw_text( surface_t* disp, int x, int y, const char * const msg )
     }
 }
 
+/**
+ * @brief Render a string into a newly allocated sprite
+ *
+ * This function rasterizes a string (with the same layout rules and colors
+ * as #graphics_draw_text) into a sprite, using the current font. The
+ * returned sprite can then be drawn every frame with #graphics_draw_sprite
+ * (or #graphics_draw_sprite_trans if the background color is transparent),
+ * which blits whole pixel runs at a time and is thus much faster than
+ * re-rendering the text glyph by glyph.
+ *
+ * This is meant for text that is displayed for many frames, such as
+ * dialogue boxes or HUD labels: render it once, draw the cached sprite
+ * each frame, and render again only when the string changes. Release the
+ * sprite with free() when it is not needed anymore.
+ *
+ * The sprite is rendered at the current display bitdepth. If the
+ * background color is not transparent, the whole sprite rectangle is
+ * filled with it, like #graphics_draw_text does for each glyph cell.
+ *
+ * @param[in] msg
+ *            The ASCII null terminated string to render
+ *
+ * @return A newly allocated sprite containing the rendered text, or NULL
+ *         if the string contains no printable characters.
+ */
+sprite_t* graphics_render_text( const char * const msg )
+{
+    if( msg == 0 ) { return NULL; }
+
+    int depth = display_get_bitdepth();
+
+    // setting default font if none was set previously
+    if( sprite_font.sprite == NULL || depth != sprite_font.sprite->bitdepth )
+    {
+        graphics_set_default_font();
+    }
+
+    /* Measure the text, following the same cursor rules as graphics_draw_text */
+    int tx = 0, ty = 0, width = 0, height = 0;
+    for( const char *text = msg; *text; text++ )
+    {
+        switch( *text )
+        {
+            case '\r':
+            case '\n':
+                tx = 0;
+                ty += sprite_font.font_height;
+                break;
+            case ' ':
+                tx += sprite_font.font_width;
+                break;
+            case '\t':
+                tx += sprite_font.font_width * 5;
+                break;
+            default:
+                tx += sprite_font.font_width;
+                if( tx > width ) { width = tx; }
+                if( ty + sprite_font.font_height > height ) { height = ty + sprite_font.font_height; }
+                break;
+        }
+    }
+
+    if( width == 0 || height == 0 ) { return NULL; }
+
+    sprite_t *sp = malloc( sizeof(sprite_t) + width * height * depth );
+    if( sp == NULL ) { return NULL; }
+    sp->width = width;
+    sp->height = height;
+    sp->bitdepth = depth;
+    sp->format = 0;
+    sp->hslices = 1;
+    sp->vslices = 1;
+
+    /* Fill the background: fully transparent pixels if the background color
+       is transparent (so that the sprite can be drawn with
+       graphics_draw_sprite_trans), the background color otherwise. */
+    int trans = __is_transparent( depth, b_color );
+    if( trans )
+    {
+        memset( sp->data, 0, width * height * depth );
+    }
+    else
+    {
+        uint32_t bg = b_color;
+        if( depth == 2 ) { bg = (bg << 16) | (bg & 0xFFFF); }
+        __fill_row( sp->data, bg, width * height * depth );
+    }
+
+    tx = 0; ty = 0;
+    for( const char *text = msg; *text; text++ )
+    {
+        switch( *text )
+        {
+            case '\r':
+            case '\n':
+                tx = 0;
+                ty += sprite_font.font_height;
+                break;
+            case ' ':
+                tx += sprite_font.font_width;
+                break;
+            case '\t':
+                tx += sprite_font.font_width * 5;
+                break;
+            default:
+                __draw_character( sp->data, width, depth, trans, tx, ty, *text );
+                tx += sprite_font.font_width;
+                break;
+        }
+    }
+
+    return sp;
+}
+
 /**
  * @brief Draw a sprite to a display context
  *
@@ -952,12 +1591,8 @@ void graphics_draw_sprite_stride( surface_t* disp, int x, int y, sprite_t *sprit
 
         for( int yp = sy; yp < ey; yp++ )
         {
-            const register int run = yp * sprite->width;
-
-            for( int xp = sx; xp < ex; xp++ )
-            {
-                __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-            }
+            __blit_row_16( buffer + (tx + sx) + ((ty + yp) * pix_stride),
+                sp_data + sx + (yp * sprite->width), ex - sx );
         }
     }
     else if( depth == 32 && sprite->bitdepth == 4 )
@@ -967,12 +1602,8 @@ void graphics_draw_sprite_stride( surface_t* disp, int x, int y, sprite_t *sprit
 
         for( int yp = sy; yp < ey; yp++ )
         {
-            const register int run = yp * sprite->width;
-
-            for( int xp = sx; xp < ex; xp++ )
-            {
-                __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-            }
+            __blit_row_32( buffer + (tx + sx) + ((ty + yp) * pix_stride),
+                sp_data + sx + (yp * sprite->width), ex - sx );
         }
     }
 }
@@ -1115,24 +1746,38 @@ void graphics_draw_sprite_trans_stride( surface_t* disp, int x, int y, sprite_t
     int pix_stride = TEX_FORMAT_BYTES2PIX(surface_get_format(disp), disp->stride);
     int depth = TEX_FORMAT_BITDEPTH(surface_get_format( disp ));
 
+    /* Span metadata lives right after the pixel data; the stream has no row
+       index, so rows above the clip window are walked without drawing */
+    bool spans = (sprite->format & SPRITE_FORMAT_ALPHA_SPANS) != 0;
+
     /* Only display sprite if it matches the bitdepth */
     if( depth == 16 && sprite->bitdepth == 2 )
     {
         uint16_t *buffer = (uint16_t *)__get_buffer( disp );
         uint16_t *sp_data = (uint16_t *)sprite->data;
 
-        for( int yp = sy; yp < ey; yp++ )
+        if( spans )
         {
-            const register int run = yp * sprite->width;
+            const uint16_t *span = sp_data + (sprite->width * sprite->height);
 
-            for( int xp = sx; xp < ex; xp++ )
+            for( int yp = 0; yp < sy; yp++ )
             {
-                /* Only display the pixel if alpha bit is set */
-                if( !__is_transparent( 2, sp_data[xp + run] ) )
-                {
-                    __set_pixel( buffer, tx + xp, ty + yp, sp_data[xp + run] );
-                }
+                span = __skip_row_spans( span, sprite->width );
+            }
+
+            for( int yp = sy; yp < ey; yp++ )
+            {
+                span = __blit_row_spans_16( buffer + tx + ((ty + yp) * pix_stride),
+                    sp_data + (yp * sprite->width), span, sprite->width, sx, ex );
             }
+
+            return;
+        }
+
+        for( int yp = sy; yp < ey; yp++ )
+        {
+            __blit_row_trans_16( buffer + (tx + sx) + ((ty + yp) * pix_stride),
+                sp_data + sx + (yp * sprite->width), ex - sx );
         }
     }
     else if( depth == 32 && sprite->bitdepth == 4 )
@@ -1140,43 +1785,28 @@ void graphics_draw_sprite_trans_stride( surface_t* disp, int x, int y, sprite_t
         uint32_t *buffer = (uint32_t *)__get_buffer( disp );
         uint32_t *sp_data = (uint32_t *)sprite->data;
 
-        for( int yp = sy; yp < ey; yp++ )
+        if( spans )
         {
-            const int run = yp * sprite->width;
+            const uint16_t *span = (const uint16_t *)(sp_data + (sprite->width * sprite->height));
 
-            for( int xp = sx; xp < ex; xp++ )
+            for( int yp = 0; yp < sy; yp++ )
             {
-                /* Get 32bit representations */
-                uint8_t *new_color = (uint8_t *)(&sp_data[xp + run]);
-                uint32_t cur_color = __get_pixel( buffer, tx + xp, ty + yp );
-
-                /* Get current color */
-                uint32_t cr = (cur_color >> 24) & 0xFF;
-                uint32_t cg = (cur_color >> 16) & 0xFF;
-                uint32_t cb = (cur_color >> 8) & 0xFF;
-
-                /* Get new color */
-                uint32_t sr = new_color[0];
-                uint32_t sg = new_color[1];
-                uint32_t sb = new_color[2];
-
-                /* Transparencies */
-                uint32_t st = new_color[3];
-                uint32_t ct = 255 - st;
-
-                /* Mixed color */
-                uint32_t mixed_color;
-                uint8_t *final_color = (uint8_t *)(&mixed_color);
+                span = __skip_row_spans( span, sprite->width );
+            }
 
-                final_color[0] = ((cr * ct) + (sr * st)) >> 8;
-                final_color[1] = ((cg * ct) + (sg * st)) >> 8;
-                final_color[2] = ((cb * ct) + (sb * st)) >> 8;
+            for( int yp = sy; yp < ey; yp++ )
+            {
+                span = __blit_row_spans_32( buffer + tx + ((ty + yp) * pix_stride),
+                    sp_data + (yp * sprite->width), span, sprite->width, sx, ex );
+            }
 
-                /* Since we are doing mixing anyway */
-                final_color[3] = 255;
+            return;
+        }
 
-                __set_pixel( buffer, tx + xp, ty + yp, mixed_color );
-            }
+        for( int yp = sy; yp < ey; yp++ )
+        {
+            __blit_row_trans_32( buffer + (tx + sx) + ((ty + yp) * pix_stride),
+                sp_data + sx + (yp * sprite->width), ex - sx );
         }
     }
 }
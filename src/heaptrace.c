@@ -0,0 +1,323 @@
+/**
+ * @file heaptrace.c
+ * @brief Heap instrumentation and fragmentation reporting
+ * @ingroup system
+ */
+#include <malloc.h>
+#include <reent.h>
+#include <string.h>
+#include "heaptrace.h"
+#include "interrupt.h"
+#include "debug.h"
+
+/**
+ * The public allocator entry points are overridden here (this library is
+ * searched before libc at link time, like the memcpy override in memory.c)
+ * and forward to the newlib reentrant implementations. While tracing is
+ * off the wrappers cost one predicted branch; once #heap_trace_init is
+ * called they additionally maintain the counters and, in guard mode,
+ * surround each block with check words.
+ *
+ * Note that allocations newlib makes internally through _malloc_r (eg:
+ * stdio buffers) bypass the wrappers and stay invisible to the counters;
+ * they still show up in the mallinfo() numbers of the report.
+ */
+
+/** @brief Guard head/tail size in bytes (head keeps 8-byte alignment) */
+#define GUARD_BYTES     8
+/** @brief Magic marking a guarded block (xor'd with the user pointer) */
+#define GUARD_MAGIC     0x48454150
+/** @brief Fill byte of the tail guard */
+#define GUARD_FILL      0xA5
+
+/** @brief Number of call-site slots (hash table, linear probing) */
+#define SITE_SLOTS      64
+/** @brief Probe length before falling into the overflow counter */
+#define SITE_PROBES     4
+
+static bool trace_enabled = false;
+static bool guard_enabled = false;
+static heap_stats_t stats;
+static heap_site_t site_tab[SITE_SLOTS];
+static uint32_t site_overflow;
+
+void heap_trace_init(bool guard)
+{
+    guard_enabled = guard;
+    trace_enabled = true;
+}
+
+bool heap_trace_active(void)
+{
+    return trace_enabled;
+}
+
+bool heap_trace_stats(heap_stats_t *st)
+{
+    disable_interrupts();
+    *st = stats;
+    enable_interrupts();
+    return trace_enabled;
+}
+
+int heap_trace_sites(heap_site_t *sites, int max)
+{
+    int n = 0;
+    disable_interrupts();
+    for (int i = 0; i < SITE_SLOTS && n < max; i++)
+        if (site_tab[i].pc)
+            sites[n++] = site_tab[i];
+    enable_interrupts();
+    return n;
+}
+
+/** @brief Account one allocation from the given call site */
+static void site_record(uint32_t pc, uint32_t bytes)
+{
+    uint32_t h = ((pc >> 2) * 2654435761u) >> 26;
+    for (int i = 0; i < SITE_PROBES; i++)
+    {
+        heap_site_t *s = &site_tab[(h + i) % SITE_SLOTS];
+        if (s->pc == pc || s->pc == 0)
+        {
+            s->pc = pc;
+            s->count++;
+            s->bytes += bytes;
+            return;
+        }
+    }
+    site_overflow++;
+}
+
+/** @brief Update the counters for an allocation result */
+static void track_alloc(void *user, uint32_t bytes, uint32_t pc)
+{
+    disable_interrupts();
+    if (!user)
+        stats.failed_allocs++;
+    else
+    {
+        stats.total_allocs++;
+        stats.live_bytes += bytes;
+        if (stats.live_bytes > stats.peak_bytes)
+            stats.peak_bytes = stats.live_bytes;
+        site_record(pc, bytes);
+    }
+    enable_interrupts();
+}
+
+/** @brief True if the pointer carries our guard head */
+static bool is_guarded(void *ptr)
+{
+    uint32_t *head = (uint32_t*)ptr - 2;
+    return head[0] == (GUARD_MAGIC ^ (uint32_t)ptr);
+}
+
+/** @brief Verify the tail guard of a block, reporting corruptions */
+static void guard_check(void *user, uint32_t size)
+{
+    uint8_t *tail = (uint8_t*)user + size;
+    for (int i = 0; i < GUARD_BYTES; i++)
+    {
+        if (tail[i] != GUARD_FILL)
+        {
+            disable_interrupts();
+            stats.guard_hits++;
+            enable_interrupts();
+            debugf("[heaptrace] guard corrupted: block %p (%lu bytes), %d byte(s) past the end\n",
+                user, (unsigned long)size, i+1);
+            break;
+        }
+    }
+}
+
+/** @brief Shared allocation path, so calloc records its own call site */
+static void *do_malloc(size_t size, uint32_t pc)
+{
+    if (!trace_enabled)
+        return _malloc_r(_REENT, size);
+
+    void *user;
+    uint32_t bytes;
+    if (guard_enabled)
+    {
+        uint32_t *raw = _malloc_r(_REENT, size + 2*GUARD_BYTES);
+        user = raw ? raw + 2 : NULL;
+        if (user)
+        {
+            raw[0] = GUARD_MAGIC ^ (uint32_t)user;
+            raw[1] = size;
+            memset((uint8_t*)user + size, GUARD_FILL, GUARD_BYTES);
+        }
+        bytes = size;
+    }
+    else
+    {
+        user = _malloc_r(_REENT, size);
+        bytes = user ? malloc_usable_size(user) : 0;
+    }
+    track_alloc(user, bytes, pc);
+    return user;
+}
+
+void *malloc(size_t size)
+{
+    return do_malloc(size, (uint32_t)__builtin_return_address(0));
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t total = nmemb * size;
+    void *p = do_malloc(total, (uint32_t)__builtin_return_address(0));
+    if (p)
+        memset(p, 0, total);
+    return p;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    /* Aligned blocks are never guarded (the head would break the
+       requested alignment); they are still counted. */
+    void *p = _memalign_r(_REENT, align, size);
+    if (trace_enabled)
+        track_alloc(p, p ? malloc_usable_size(p) : 0,
+            (uint32_t)__builtin_return_address(0));
+    return p;
+}
+
+void free(void *ptr)
+{
+    if (!ptr)
+        return;
+
+    if (guard_enabled && is_guarded(ptr))
+    {
+        uint32_t *head = (uint32_t*)ptr - 2;
+        guard_check(ptr, head[1]);
+        disable_interrupts();
+        stats.total_frees++;
+        stats.live_bytes -= head[1];
+        enable_interrupts();
+        head[0] = 0;    // so a double free is not mistaken for a guarded block
+        _free_r(_REENT, head);
+        return;
+    }
+
+    if (trace_enabled)
+    {
+        disable_interrupts();
+        stats.total_frees++;
+        stats.live_bytes -= malloc_usable_size(ptr);
+        enable_interrupts();
+    }
+    _free_r(_REENT, ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    uint32_t pc = (uint32_t)__builtin_return_address(0);
+
+    if (!trace_enabled)
+        return _realloc_r(_REENT, ptr, size);
+
+    if (guard_enabled && ptr && is_guarded(ptr))
+    {
+        // Guarded blocks cannot be resized in place (the tail guard has
+        // to move): allocate, copy, free through the guarded paths.
+        uint32_t old = ((uint32_t*)ptr)[-1];
+        guard_check(ptr, old);
+        void *p = do_malloc(size, pc);
+        if (p)
+        {
+            memcpy(p, ptr, old < size ? old : size);
+            free(ptr);
+        }
+        return p;
+    }
+
+    uint32_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *p = _realloc_r(_REENT, ptr, size);
+    disable_interrupts();
+    if (!p && size > 0)
+        stats.failed_allocs++;
+    else
+    {
+        if (ptr)
+        {
+            stats.total_frees++;
+            stats.live_bytes -= old;
+        }
+        if (p)
+        {
+            stats.total_allocs++;
+            stats.live_bytes += malloc_usable_size(p);
+            if (stats.live_bytes > stats.peak_bytes)
+                stats.peak_bytes = stats.live_bytes;
+            site_record(pc, size);
+        }
+    }
+    enable_interrupts();
+    return p;
+}
+
+int heap_trace_largest_free(void)
+{
+    // Binary composition of trial allocations: each probe that succeeds
+    // is freed immediately and its size kept as the new lower bound.
+    size_t total = 0;
+    for (size_t bit = 1u << 23; bit >= 16; bit >>= 1)
+    {
+        void *p = _malloc_r(_REENT, total + bit);
+        if (p)
+        {
+            _free_r(_REENT, p);
+            total += bit;
+        }
+    }
+    return total;
+}
+
+void heap_trace_report(void)
+{
+    heap_stats_t st;
+    bool active = heap_trace_stats(&st);
+    struct mallinfo mi = mallinfo();
+    int largest = heap_trace_largest_free();
+    int frag = mi.fordblks > 0 ? 100 - (int)((uint64_t)largest * 100 / mi.fordblks) : 0;
+    if (frag < 0) frag = 0;
+
+    debugf("[heaptrace] heap summary:\n");
+    debugf("  arena %u KiB: in use %u KiB, free %u KiB in %u chunks\n",
+        (unsigned)mi.arena/1024, (unsigned)mi.uordblks/1024,
+        (unsigned)mi.fordblks/1024, (unsigned)mi.ordblks);
+    debugf("  largest allocatable block: %d KiB (fragmentation %d%%)\n",
+        largest/1024, frag);
+    if (!active)
+    {
+        debugf("  tracing not enabled (heap_trace_init)\n");
+        return;
+    }
+    debugf("  traced: live %lu KiB (peak %lu KiB), %lu allocs, %lu frees, %lu failed, %lu guard hits\n",
+        (unsigned long)st.live_bytes/1024, (unsigned long)st.peak_bytes/1024,
+        (unsigned long)st.total_allocs, (unsigned long)st.total_frees,
+        (unsigned long)st.failed_allocs, (unsigned long)st.guard_hits);
+
+    // Busiest call sites by bytes requested
+    heap_site_t sites[SITE_SLOTS];
+    int n = heap_trace_sites(sites, SITE_SLOTS);
+    for (int rank = 0; rank < 5; rank++)
+    {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+            if (sites[i].pc && (best < 0 || sites[i].bytes > sites[best].bytes))
+                best = i;
+        if (best < 0)
+            break;
+        debugf("  site %p: %lu allocs, %lu bytes\n",
+            (void*)sites[best].pc, (unsigned long)sites[best].count,
+            (unsigned long)sites[best].bytes);
+        sites[best].pc = 0;
+    }
+    if (site_overflow)
+        debugf("  (%lu allocs from untracked sites)\n", (unsigned long)site_overflow);
+}
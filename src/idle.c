@@ -0,0 +1,111 @@
+/**
+ * @file idle.c
+ * @brief Idle-task scheduler for spare frame time
+ * @ingroup display
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "idle.h"
+#include "vi.h"
+#include "debug.h"
+
+/**
+ * Most frames finish with spare milliseconds between #display_show and the
+ * vblank that flips the buffer; some frames spike instead. The idle
+ * scheduler converts that average-case slack into background progress
+ * (prefetching, decompression, log flushing) so that the work is already
+ * done when a spiking frame would otherwise have to pay for it.
+ *
+ * The deadline comes straight from the VI line counter: tasks are
+ * dispatched while the current halfline is farther than a safety margin
+ * from the vblank line. Dispatch is round-robin so one hungry task cannot
+ * starve the others, and a full cycle of "no work" answers ends the idle
+ * period early.
+ */
+
+/** @brief Maximum number of registered idle tasks */
+#define MAX_IDLE_TASKS  8
+
+/** @brief One idle task slot */
+typedef struct {
+    idle_task_t task;       ///< Task callback (NULL = free slot)
+    void *ctx;              ///< Opaque argument for the callback
+} idle_slot_t;
+
+/** @brief Registered idle tasks */
+static idle_slot_t idle_tasks[MAX_IDLE_TASKS];
+/** @brief Round-robin dispatch position, persistent across frames */
+static int idle_rr = 0;
+/** @brief Halflines before vblank at which dispatching stops */
+static uint32_t idle_margin = 16;
+
+int idle_task_add(idle_task_t task, void *ctx)
+{
+    assert(task != NULL);
+
+    for (int i = 0; i < MAX_IDLE_TASKS; i++)
+    {
+        if (!idle_tasks[i].task)
+        {
+            idle_tasks[i].ctx = ctx;
+            idle_tasks[i].task = task;
+            return i;
+        }
+    }
+
+    assertf(0, "too many idle tasks (max %d)", MAX_IDLE_TASKS);
+    return -1;
+}
+
+void idle_task_remove(int id)
+{
+    assert(id >= 0 && id < MAX_IDLE_TASKS && idle_tasks[id].task != NULL);
+    idle_tasks[id].task = NULL;
+}
+
+void idle_set_margin(uint32_t halflines)
+{
+    idle_margin = halflines;
+}
+
+/**
+ * @brief Halflines left before the scan reaches the vblank line
+ *
+ * The count decreases monotonically through the frame (including across
+ * the counter wrap at the bottom of the screen), so comparing it against
+ * the margin is a race-free deadline check.
+ */
+static uint32_t idle_lines_left(void)
+{
+    uint32_t vtotal = *VI_V_SYNC & 0x3FF;
+    uint32_t cur = *VI_V_CURRENT & 0x3FF;
+
+    return (VI_V_CURRENT_VBLANK + vtotal - cur) % vtotal;
+}
+
+void idle_run(void)
+{
+    /* No video signal, no deadline: don't run unbounded */
+    if ((*VI_V_SYNC & 0x3FF) == 0)
+    {
+        return;
+    }
+
+    int idle_streak = 0;
+
+    while (idle_streak < MAX_IDLE_TASKS && idle_lines_left() > idle_margin)
+    {
+        idle_slot_t *slot = &idle_tasks[idle_rr];
+        idle_rr = (idle_rr + 1) % MAX_IDLE_TASKS;
+
+        if (slot->task && slot->task(slot->ctx))
+        {
+            idle_streak = 0;
+        }
+        else
+        {
+            idle_streak++;
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "graphics.h"
 #include "debug.h"
+#include "inspector.h"
 #include "controller.h"
 #include "exception_internal.h"
 #include "system.h"
@@ -8,6 +9,11 @@
 #include "backtrace_internal.h"
 #include "cop0.h"
 #include "n64sys.h"
+#include "rsp.h"
+#include "timer.h"
+#include "dma.h"
+#include "heaptrace.h"
+#include <malloc.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -49,6 +55,10 @@ static int disasm_bt_idx = 0;
 static int disasm_max_frames = 0;
 static int disasm_offset = 0;
 static bool first_backtrace = true;
+static bool first_rspq_dump = true;
+
+/** @brief rspq inspector hook; weak so rspq is not forced into the link */
+extern void __rspq_inspector_dump(FILE *out) __attribute__((weak));
 
 const char *__mips_gpr[34] = {
 	"zr", "at", "v0", "v1", "a0", "a1", "a2", "a3",
@@ -415,6 +425,25 @@ static void inspector_page_disasm(surface_t *disp, exception_t* ex, struct contr
     }
 }
 
+static void inspector_page_rspq(surface_t *disp, exception_t* ex) {
+    title("RSP Queue");
+
+    if (!__rspq_inspector_dump) {
+        printf("\n\trspq is not in use in this application\n");
+        return;
+    }
+
+    __rspq_inspector_dump(stdout);
+
+    // On the first visit, also dump the same decode over the debugging
+    // channel (USB), like the first backtrace.
+    if (first_rspq_dump) {
+        debugf("RSPQ state:\n");
+        __rspq_inspector_dump(stderr);
+        first_rspq_dump = false;
+    }
+}
+
 __attribute__((noreturn))
 static void inspector(exception_t* ex, enum Mode mode) {
     static bool in_inspector = false;
@@ -429,8 +458,9 @@ static void inspector(exception_t* ex, enum Mode mode) {
 		PAGE_GPR,
 		PAGE_FPR,
 		PAGE_CODE,
+		PAGE_RSPQ,
 	};
-	enum { PAGE_COUNT = PAGE_CODE+1 };
+	enum { PAGE_COUNT = PAGE_RSPQ+1 };
 
 	hook_stdio_calls(&(stdio_t){ NULL, inspector_stdout, NULL });
 
@@ -475,6 +505,9 @@ static void inspector(exception_t* ex, enum Mode mode) {
             break;
         case PAGE_CODE:
             inspector_page_disasm(disp, ex, &key_pressed);
+            break;
+        case PAGE_RSPQ:
+            inspector_page_rspq(disp, ex);
             break;
 		}
 
@@ -555,3 +588,188 @@ void __inspector_init(void) {
     register_syscall_handler(handler, 0x00001, 0x00002);
 }
 #endif
+
+/* ============================================================================
+ * Performance HUD
+ *
+ * Unlike the exception pages above (which take over the machine), the HUD
+ * renders on top of the application's own frames: the application calls
+ * #inspector_hud_draw once per frame on the surface it is about to show.
+ *
+ * Metrics:
+ *  - CPU: time between two consecutive draws, against the refresh budget.
+ *  - RSP: fraction of SP status samples (taken from a 1 kHz timer) in
+ *    which the RSP was not halted.
+ *  - RDP: per-frame delta of the free-running DP busy/pipe-busy counters
+ *    against the DP clock counter delta.
+ *  - Heap usage from mallinfo(), PI queue depth from #dma_queue_depth.
+ * ============================================================================
+ */
+
+/** @brief DP free-running counters (24-bit): clock, busy, pipe busy */
+#define DP_CLOCK_REG        (((volatile uint32_t*)0xA4100000)[4])
+#define DP_BUSY_REG         (((volatile uint32_t*)0xA4100000)[5])
+#define DP_PIPE_BUSY_REG    (((volatile uint32_t*)0xA4100000)[6])
+/** @brief Wrap-safe delta of a 24-bit free-running counter */
+#define DP_COUNTER_DELTA(now, prev)  (((now) - (prev)) & 0xFFFFFF)
+
+/** @brief Number of frames of history shown in the HUD graphs */
+#define HUD_HISTORY 64
+
+/** @brief True when the HUD has been initialized */
+static bool hud_enabled = false;
+/** @brief The RSP status sampling timer */
+static timer_link_t *hud_timer = NULL;
+/** @brief Number of SP status samples taken this frame */
+static volatile uint32_t hud_sp_samples = 0;
+/** @brief Number of samples in which the RSP was running */
+static volatile uint32_t hud_sp_busy = 0;
+/** @brief Timestamp of the previous #inspector_hud_draw call */
+static uint32_t hud_last_ticks = 0;
+/** @brief DP counter values at the previous draw */
+static uint32_t hud_last_dp_clock, hud_last_dp_busy, hud_last_dp_pipe;
+/** @brief Per-frame utilization history (percent, clamped to 100) */
+static uint8_t hud_history[3][HUD_HISTORY];
+/** @brief Next write position in the history rings */
+static int hud_history_pos = 0;
+
+/** @brief Timer callback: sample whether the RSP is currently running */
+static void __hud_sample_rsp(int ovfl)
+{
+    hud_sp_samples++;
+    if (!(*SP_STATUS & SP_STATUS_HALTED))
+        hud_sp_busy++;
+}
+
+void inspector_hud_init(void)
+{
+    assertf(!hud_enabled, "inspector_hud_init called twice");
+
+    hud_timer = new_timer(TICKS_FROM_MS(1), TF_CONTINUOUS, __hud_sample_rsp);
+    assertf(hud_timer != NULL, "the performance HUD requires timer_init");
+
+    hud_sp_samples = hud_sp_busy = 0;
+    hud_last_ticks = TICKS_READ();
+    hud_last_dp_clock = DP_CLOCK_REG;
+    hud_last_dp_busy = DP_BUSY_REG;
+    hud_last_dp_pipe = DP_PIPE_BUSY_REG;
+    memset(hud_history, 0, sizeof(hud_history));
+    hud_history_pos = 0;
+    hud_enabled = true;
+}
+
+void inspector_hud_close(void)
+{
+    assertf(hud_enabled, "inspector_hud_close without inspector_hud_init");
+    delete_timer(hud_timer);
+    hud_timer = NULL;
+    hud_enabled = false;
+}
+
+/** @brief Pick the bar color for a utilization percentage */
+static uint32_t hud_bar_color(int percent)
+{
+    if (percent >= 95) return COLOR_RED;
+    if (percent >= 75) return COLOR_YELLOW;
+    return COLOR_GREEN;
+}
+
+/** @brief Draw one HUD row: label, percentage bar, history graph, text */
+static void hud_row(surface_t *disp, int x, int y, const char *label, int percent, const char *text)
+{
+    enum { BAR_W = 100, BAR_H = 8, GRAPH_W = HUD_HISTORY, GRAPH_H = 8 };
+    int clamped = MIN(percent, 100);
+
+    graphics_set_color(COLOR_WHITE, 0);
+    graphics_draw_text(disp, x, y, label);
+
+    int bar_x = x + 4*8 + 4;
+    graphics_draw_box(disp, bar_x, y, BAR_W, BAR_H, COLOR_HIGHLIGHT);
+    graphics_draw_box(disp, bar_x, y, BAR_W * clamped / 100, BAR_H, hud_bar_color(percent));
+
+    graphics_draw_text(disp, bar_x + BAR_W + 4, y, text);
+
+    graphics_draw_box(disp, disp->width - 16 - GRAPH_W, y, GRAPH_W, GRAPH_H, COLOR_HIGHLIGHT);
+}
+
+/** @brief Draw the history graph for one metric at the given row position */
+static void hud_graph(surface_t *disp, int y, int metric)
+{
+    enum { GRAPH_W = HUD_HISTORY, GRAPH_H = 8 };
+    int gx = disp->width - 16 - GRAPH_W;
+    for (int i = 0; i < HUD_HISTORY; i++) {
+        int v = hud_history[metric][(hud_history_pos + i) % HUD_HISTORY];
+        int h = (v * GRAPH_H + 99) / 100;
+        if (h > 0)
+            graphics_draw_box(disp, gx + i, y + GRAPH_H - h, 1, h, hud_bar_color(v));
+    }
+}
+
+void inspector_hud_draw(surface_t *disp)
+{
+    assertf(hud_enabled, "inspector_hud_draw without inspector_hud_init");
+
+    /* ---- Update metrics (once per frame) ---- */
+    uint32_t now = TICKS_READ();
+    uint32_t frame_ticks = TICKS_DISTANCE(hud_last_ticks, now);
+    hud_last_ticks = now;
+    if (frame_ticks == 0) frame_ticks = 1;
+
+    int refresh = (get_tv_type() == TV_PAL) ? 50 : 60;
+    uint32_t budget_ticks = TICKS_PER_SECOND / refresh;
+    int cpu_percent = (uint64_t)frame_ticks * 100 / budget_ticks;
+
+    disable_interrupts();
+    uint32_t sp_samples = hud_sp_samples, sp_busy = hud_sp_busy;
+    hud_sp_samples = hud_sp_busy = 0;
+    enable_interrupts();
+    int rsp_percent = sp_samples ? sp_busy * 100 / sp_samples : 0;
+
+    uint32_t dp_clock = DP_CLOCK_REG, dp_busy = DP_BUSY_REG, dp_pipe = DP_PIPE_BUSY_REG;
+    uint32_t d_clock = DP_COUNTER_DELTA(dp_clock, hud_last_dp_clock);
+    uint32_t d_busy = DP_COUNTER_DELTA(dp_busy, hud_last_dp_busy);
+    uint32_t d_pipe = DP_COUNTER_DELTA(dp_pipe, hud_last_dp_pipe);
+    hud_last_dp_clock = dp_clock; hud_last_dp_busy = dp_busy; hud_last_dp_pipe = dp_pipe;
+    int rdp_percent = d_clock ? (uint64_t)d_busy * 100 / d_clock : 0;
+    int pipe_percent = d_clock ? (uint64_t)d_pipe * 100 / d_clock : 0;
+
+    hud_history[0][hud_history_pos] = MIN(cpu_percent, 100);
+    hud_history[1][hud_history_pos] = MIN(rsp_percent, 100);
+    hud_history[2][hud_history_pos] = MIN(rdp_percent, 100);
+    hud_history_pos = (hud_history_pos + 1) % HUD_HISTORY;
+
+    struct mallinfo mi = mallinfo();
+    int pi_depth = dma_queue_depth();
+
+    /* ---- Render ---- */
+    char buf[64];
+    int x = 16, y = disp->height - 8 - 4*10;
+
+    snprintf(buf, sizeof(buf), "%2ld.%01ldms %3d%%",
+        (long)TIMER_MICROS(frame_ticks) / 1000, ((long)TIMER_MICROS(frame_ticks) / 100) % 10,
+        cpu_percent);
+    hud_row(disp, x, y, "CPU", cpu_percent, buf);
+    hud_graph(disp, y, 0);
+    y += 10;
+
+    snprintf(buf, sizeof(buf), "%3d%%", rsp_percent);
+    hud_row(disp, x, y, "RSP", rsp_percent, buf);
+    hud_graph(disp, y, 1);
+    y += 10;
+
+    snprintf(buf, sizeof(buf), "%3d%% pipe %3d%%", rdp_percent, pipe_percent);
+    hud_row(disp, x, y, "RDP", rdp_percent, buf);
+    hud_graph(disp, y, 2);
+    y += 10;
+
+    heap_stats_t hst;
+    if (heap_trace_stats(&hst))
+        snprintf(buf, sizeof(buf), "HEAP %4ld/%4dK pk%4ldK PIq %d",
+            (long)hst.live_bytes / 1024, mi.arena / 1024,
+            (long)hst.peak_bytes / 1024, pi_depth);
+    else
+        snprintf(buf, sizeof(buf), "HEAP %4d/%4dK  PIq %d",
+            mi.uordblks / 1024, mi.arena / 1024, pi_depth);
+    graphics_set_color(COLOR_WHITE, 0);
+    graphics_draw_text(disp, x, y, buf);
+}
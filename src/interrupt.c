@@ -4,6 +4,7 @@
  * @ingroup interrupt
  */
 #include <malloc.h>
+#include <string.h>
 #include "libdragon.h"
 #include "regsinternal.h"
 
@@ -145,6 +146,13 @@ static volatile struct SI_regs_s * const SI_regs = (struct SI_regs_s *)0xa480000
 /** @brief Static structure to address SP registers */
 static volatile struct SP_regs_s * const SP_regs = (struct SP_regs_s *)0xa4040000;
 
+/** @brief Leaf handler for the AI interrupt (dispatched by inthandler.S) */
+void (*__AI_leaf_handler)(void) = 0;
+/** @brief Leaf handler for the timer interrupt (dispatched by inthandler.S) */
+void (*__TI_leaf_handler)(void) = 0;
+/** @brief Register spill area for the leaf dispatch path (see inthandler.S) */
+uint64_t __leaf_scratch[15];
+
 /** @brief Linked list of AI callbacks */
 struct callback_link * AI_callback = 0;
 /** @brief Linked list of VI callbacks */
@@ -261,63 +269,264 @@ static void __unregister_callback( struct callback_link ** head, void (*callback
     }
 }
 
+/** @brief MI interrupt bit of each source, indexed by #interrupt_source_t */
+static const uint32_t __mi_intr_bits[INTERRUPT_SOURCE_COUNT] = {
+    MI_INTR_SP, MI_INTR_SI, MI_INTR_AI, MI_INTR_VI, MI_INTR_PI, MI_INTR_DP
+};
+
+/** @brief MI mask-clear command of each source, indexed by #interrupt_source_t */
+static const uint32_t __mi_mask_clr[INTERRUPT_SOURCE_COUNT] = {
+    MI_MASK_CLR_SP, MI_MASK_CLR_SI, MI_MASK_CLR_AI, MI_MASK_CLR_VI, MI_MASK_CLR_PI, MI_MASK_CLR_DP
+};
+
+/** @brief MI mask-set command of each source, indexed by #interrupt_source_t */
+static const uint32_t __mi_mask_set[INTERRUPT_SOURCE_COUNT] = {
+    MI_MASK_SET_SP, MI_MASK_SET_SI, MI_MASK_SET_AI, MI_MASK_SET_VI, MI_MASK_SET_PI, MI_MASK_SET_DP
+};
+
+/** @brief Priority of each source (higher values are dispatched first).
+ *
+ * The defaults reproduce the historical dispatch order: SP, SI, AI, VI, PI, DP.
+ */
+static int __mi_priority[INTERRUPT_SOURCE_COUNT] = { 5, 4, 3, 2, 1, 0 };
+
+/** @brief Sources sorted by descending priority (dispatch order) */
+static uint8_t __mi_order[INTERRUPT_SOURCE_COUNT] = { 0, 1, 2, 3, 4, 5 };
+
+/** @brief True if higher-priority sources may preempt long callbacks */
+static bool __mi_preemption = false;
+
+/** @brief Dispatch statistics, indexed by #interrupt_source_t */
+static interrupt_stats_t __mi_stats[INTERRUPT_SOURCE_COUNT];
+
+/** @brief Cumulative ticks spent in interrupt dispatch (outermost only) */
+static volatile uint64_t __int_total_ticks = 0;
+/** @brief Current interrupt dispatch nesting depth */
+static uint32_t __int_nest = 0;
+/** @brief Timestamp at which the outermost dispatch was entered */
+static uint32_t __int_enter_ticks = 0;
+
 /**
- * @brief Handle an MI interrupt
+ * @brief Open an interrupt accounting window (interrupts are disabled here)
  *
- * @note This function handles most of the interrupts on the system as
- *       they come through the MI.
+ * Nested dispatches (timer interrupts during a preempted MI callback, or
+ * preempting MI sources) fall entirely inside the outermost window, so
+ * only the outermost open/close pair accumulates time; this keeps
+ * #interrupt_total_time free of double counting.
  */
-void __MI_handler(void)
+static inline void __int_account_enter(uint32_t now)
 {
-    unsigned long status = MI_regs->intr & MI_regs->mask;
+    if (__int_nest++ == 0)
+        __int_enter_ticks = now;
+}
 
-    if( status & MI_INTR_SP )
-    {
-        /* Clear interrupt */
-        SP_regs->status=SP_CLEAR_INTERRUPT;
+/** @brief Close an interrupt accounting window */
+static inline void __int_account_exit(void)
+{
+    if (--__int_nest == 0)
+        __int_total_ticks += TICKS_READ() - __int_enter_ticks;
+}
 
-        __call_callback(SP_callback);
+/**
+ * @brief Acknowledge the interrupt of the specified MI source
+ */
+static void __mi_ack(int source)
+{
+    switch (source)
+    {
+        case INTERRUPT_SOURCE_SP: SP_regs->status = SP_CLEAR_INTERRUPT;   break;
+        case INTERRUPT_SOURCE_SI: SI_regs->status = SI_CLEAR_INTERRUPT;   break;
+        case INTERRUPT_SOURCE_AI: AI_regs->status = AI_CLEAR_INTERRUPT;   break;
+        case INTERRUPT_SOURCE_VI: VI_regs->cur_line = VI_regs->cur_line;  break;
+        case INTERRUPT_SOURCE_PI: PI_regs->status = PI_CLEAR_INTERRUPT;   break;
+        case INTERRUPT_SOURCE_DP: MI_regs->mode = DP_CLEAR_INTERRUPT;     break;
     }
+}
 
-    if( status & MI_INTR_SI )
+/**
+ * @brief Return the callback list of the specified MI source
+ */
+static struct callback_link *__mi_callbacks(int source)
+{
+    switch (source)
     {
-        /* Clear interrupt */
-        SI_regs->status=SI_CLEAR_INTERRUPT;
-
-        __call_callback(SI_callback);
+        case INTERRUPT_SOURCE_SP: return SP_callback;
+        case INTERRUPT_SOURCE_SI: return SI_callback;
+        case INTERRUPT_SOURCE_AI: return AI_callback;
+        case INTERRUPT_SOURCE_VI: return VI_callback;
+        case INTERRUPT_SOURCE_PI: return PI_callback;
+        case INTERRUPT_SOURCE_DP: return DP_callback;
     }
+    return NULL;
+}
 
-    if( status & MI_INTR_AI )
-    {
-        /* Clear interrupt */
-    	AI_regs->status=AI_CLEAR_INTERRUPT;
+/** @brief Maximum number of VI scanline handlers (see #register_VI_scanline_handler) */
+#define MAX_VI_SCANLINE_HANDLERS 8
 
-	    __call_callback(AI_callback);
-    }
+/** @brief A callback scheduled at a specific VI scanline */
+typedef struct
+{
+    /** @brief Callback function */
+    void (*callback)();
+    /** @brief TV output line at which the callback fires */
+    uint32_t line;
+} vi_scanline_handler_t;
+
+/** @brief Registered VI scanline handlers (the first #__vi_scanline_count entries are valid) */
+static vi_scanline_handler_t __vi_scanline_handlers[MAX_VI_SCANLINE_HANDLERS];
+/** @brief Number of registered VI scanline handlers */
+static int __vi_scanline_count = 0;
+/** @brief Line configured via #set_VI_interrupt, at which the regular VI callbacks fire */
+static uint32_t __vi_base_line = 0;
+/** @brief Schedule slot serviced by the next VI interrupt (-1 is the base slot) */
+static int __vi_scanline_cur = -1;
 
-    if( status & MI_INTR_VI )
-    {
-        /* Clear interrupt */
-    	VI_regs->cur_line=VI_regs->cur_line;
+/**
+ * @brief Return the line of the specified scanline schedule slot
+ *
+ * Slot -1 is the base slot, that is the line configured via #set_VI_interrupt,
+ * at which the regular VI callbacks (#register_VI_handler) fire.
+ */
+static uint32_t __vi_scanline_line(int slot)
+{
+    return slot < 0 ? __vi_base_line : __vi_scanline_handlers[slot].line;
+}
 
-    	__call_callback(VI_callback);
+/**
+ * @brief Return the scanline schedule slot that follows the specified one
+ *
+ * Slots are visited in ascending line order, wrapping around to the lowest
+ * line at the end of the frame.
+ */
+static int __vi_scanline_succ(int slot)
+{
+    uint32_t cur = __vi_scanline_line(slot);
+    int succ = slot, first = slot;
+    for (int i = -1; i < __vi_scanline_count; i++)
+    {
+        uint32_t l = __vi_scanline_line(i);
+        if (l > cur && (succ == slot || l < __vi_scanline_line(succ)))
+            succ = i;
+        if (l < __vi_scanline_line(first))
+            first = i;
     }
+    return succ != slot ? succ : first;
+}
 
-    if( status & MI_INTR_PI )
-    {
-        /* Clear interrupt */
-        PI_regs->status=PI_CLEAR_INTERRUPT;
+/**
+ * @brief Service a VI interrupt when scanline handlers are registered
+ *
+ * Calls the callback(s) scheduled at the line that fired, then reprograms
+ * VI_V_INT to the next scheduled line, cycling through all the slots within
+ * each frame. The regular VI callbacks run when the base slot fires.
+ */
+static void __vi_scanline_dispatch(void)
+{
+    int cur = __vi_scanline_cur;
+    int next = __vi_scanline_succ(cur);
+    __vi_scanline_cur = next;
 
-        __call_callback(PI_callback);
-    }
+    /* Arm the next phase before running the callbacks, so that a
+       long-running callback does not push it back. */
+    VI_regs->v_int = __vi_scanline_line(next);
+
+    if (cur < 0)
+        __call_callback(VI_callback);
+    else
+        __vi_scanline_handlers[cur].callback();
+}
+
+/**
+ * @brief Invoke the callbacks of the specified MI source
+ *
+ * VI is special-cased when scanline handlers are registered
+ * (see #register_VI_scanline_handler), as the interrupt must then be
+ * demultiplexed by scanline rather than fanned out to all callbacks.
+ */
+static void __mi_dispatch_callbacks(int src)
+{
+    if (src == INTERRUPT_SOURCE_VI && __vi_scanline_count > 0)
+        __vi_scanline_dispatch();
+    else
+        __call_callback(__mi_callbacks(src));
+}
+
+/**
+ * @brief Handle an MI interrupt
+ *
+ * @note This function handles most of the interrupts on the system as
+ *       they come through the MI.
+ *
+ * Sources are dispatched in priority order (see #interrupt_set_priority);
+ * per-source latency and duration counters are updated along the way
+ * (see #interrupt_get_stats). If preemption has been enabled with
+ * #interrupt_set_preemption, strictly higher-priority sources are allowed
+ * to interrupt the callbacks of lower-priority ones.
+ */
+void __MI_handler(void)
+{
+    uint32_t entry = TICKS_READ();
+    __int_account_enter(entry);
 
-    if( status & MI_INTR_DP )
+    for (int i = 0; i < INTERRUPT_SOURCE_COUNT; i++)
     {
+        int src = __mi_order[i];
+
+        /* Re-read the live status at each step: if preemption is enabled, a
+           nested dispatch might have already serviced some of the sources
+           that were pending when we started. */
+        if (!(MI_regs->intr & MI_regs->mask & __mi_intr_bits[src]))
+            continue;
+
         /* Clear interrupt */
-        MI_regs->mode=DP_CLEAR_INTERRUPT;
+        __mi_ack(src);
+
+        uint32_t t0 = TICKS_READ();
+        interrupt_stats_t *stats = &__mi_stats[src];
+        stats->count++;
+        if (t0 - entry > stats->max_latency)
+            stats->max_latency = t0 - entry;
 
-        __call_callback(DP_callback);
+        if (__mi_preemption)
+        {
+            /* Mask this source and everything at the same or lower priority,
+               then re-enable interrupts: a higher-priority source can now
+               preempt this callback via a nested exception. Track the set/clr
+               commands for exactly the sources we mask here: the restore must
+               re-apply only those bits, so that any mask change made during
+               the callback (eg: a handler masking another source, or a nested
+               higher-priority dispatch adjusting its own sources) is not
+               silently reverted when this dispatch unwinds. */
+            uint32_t mask = MI_regs->mask;
+            uint32_t mask_cmd = 0, restore_cmd = 0;
+            for (int j = 0; j < INTERRUPT_SOURCE_COUNT; j++)
+                if (__mi_priority[j] <= __mi_priority[src] && (mask & __mi_intr_bits[j]))
+                {
+                    mask_cmd |= __mi_mask_clr[j];
+                    restore_cmd |= __mi_mask_set[j];
+                }
+            MI_regs->mask = mask_cmd;
+            MEMORY_BARRIER();
+            C0_WRITE_STATUS(C0_STATUS() | C0_STATUS_IE);
+
+            __mi_dispatch_callbacks(src);
+
+            C0_WRITE_STATUS(C0_STATUS() & ~C0_STATUS_IE);
+            MEMORY_BARRIER();
+            MI_regs->mask = restore_cmd;
+        }
+        else
+        {
+            __mi_dispatch_callbacks(src);
+        }
+
+        uint32_t duration = TICKS_READ() - t0;
+        stats->total_duration += duration;
+        if (duration > stats->max_duration)
+            stats->max_duration = duration;
     }
+
+    __int_account_exit();
 }
 
 /**
@@ -326,7 +535,9 @@ void __MI_handler(void)
 void __TI_handler(void)
 {
 	/* NOTE: the timer interrupt is already acknowledged in inthandler.S */
+    __int_account_enter(TICKS_READ());
     __call_callback(TI_callback);
+    __int_account_exit();
 }
 
 /**
@@ -383,6 +594,7 @@ void __RESET_handler( void )
  */
 void register_AI_handler( void (*callback)() )
 {
+    assertf(__AI_leaf_handler == NULL, "AI callbacks cannot coexist with an AI leaf handler");
     __register_callback(&AI_callback,callback);
 }
 
@@ -397,6 +609,30 @@ void unregister_AI_handler( void (*callback)() )
     __unregister_callback(&AI_callback,callback);
 }
 
+/**
+ * @brief Register a leaf handler for the AI interrupt
+ *
+ * See #register_AI_leaf_handler in interrupt.h for the leaf handler
+ * contract. The handler is dispatched directly by inthandler.S, bypassing
+ * the regular callback machinery (and thus also #interrupt_stats).
+ */
+void register_AI_leaf_handler( void (*callback)(void) )
+{
+    assertf(callback != NULL, "callback is NULL");
+    assertf(AI_callback == NULL, "AI leaf handler cannot coexist with AI callbacks");
+    assertf(__AI_leaf_handler == NULL, "AI leaf handler already registered");
+    __AI_leaf_handler = callback;
+}
+
+/**
+ * @brief Unregister the leaf handler for the AI interrupt
+ */
+void unregister_AI_leaf_handler( void (*callback)(void) )
+{
+    assertf(__AI_leaf_handler == callback, "AI leaf handler does not match");
+    __AI_leaf_handler = NULL;
+}
+
 /**
  * @brief Register a VI callback
  *
@@ -419,6 +655,76 @@ void unregister_VI_handler( void (*callback)() )
     __unregister_callback(&VI_callback,callback);
 }
 
+/**
+ * @brief Register a VI callback to be called at a specific scanline
+ *
+ * While the callbacks registered via #register_VI_handler all fire at the
+ * single line configured via #set_VI_interrupt, this function schedules a
+ * callback at an arbitrary additional scanline. The interrupt controller
+ * cycles VI_V_INT through all the scheduled lines, so a frame can be split
+ * into budgeted phases: for instance, kick audio processing at the top of
+ * the display area, start RDP work mid-frame, and begin asset streaming
+ * during vblank.
+ *
+ * Handlers registered via #register_VI_handler keep firing once per frame,
+ * at the line configured with #set_VI_interrupt.
+ *
+ * The line number follows the same convention of #set_VI_interrupt: it
+ * refers to the final TV output (range 0..524 on NTSC, 0..624 on PAL).
+ * Notice that in non-interlaced modes the VI only draws on even lines, so
+ * a callback scheduled on an odd line never fires.
+ *
+ * @param[in] line
+ *            The vertical line at which to invoke the callback
+ * @param[in] callback
+ *            Function to call when the VI begins displaying the specified line
+ */
+void register_VI_scanline_handler( unsigned long line, void (*callback)() )
+{
+    disable_interrupts();
+    assertf(__vi_scanline_count < MAX_VI_SCANLINE_HANDLERS,
+        "maximum number of VI scanline handlers reached (%d)", MAX_VI_SCANLINE_HANDLERS);
+    assertf(line != __vi_base_line,
+        "line %lu is already used by the base VI interrupt (see set_VI_interrupt)", line);
+    for (int i = 0; i < __vi_scanline_count; i++)
+        assertf(__vi_scanline_handlers[i].line != line,
+            "line %lu already has a registered VI scanline handler", line);
+
+    __vi_scanline_handlers[__vi_scanline_count++] = (vi_scanline_handler_t){ callback, line };
+    if (__vi_scanline_count == 1)
+    {
+        /* VI_V_INT currently holds the base line, so the next interrupt
+           services the base slot; the schedule takes over from there. */
+        __vi_scanline_cur = -1;
+    }
+    enable_interrupts();
+}
+
+/**
+ * @brief Unregister a VI scanline callback
+ *
+ * @param[in] callback
+ *            Function that was registered via #register_VI_scanline_handler
+ */
+void unregister_VI_scanline_handler( void (*callback)() )
+{
+    disable_interrupts();
+    for (int i = 0; i < __vi_scanline_count; i++)
+    {
+        if (__vi_scanline_handlers[i].callback != callback)
+            continue;
+        for (int j = i; j < __vi_scanline_count-1; j++)
+            __vi_scanline_handlers[j] = __vi_scanline_handlers[j+1];
+        __vi_scanline_count--;
+        /* Restart the schedule from the base line: the slot indices have
+           changed, and the removed line might be the one currently armed. */
+        __vi_scanline_cur = -1;
+        VI_regs->v_int = __vi_base_line;
+        break;
+    }
+    enable_interrupts();
+}
+
 /**
  * @brief Register a PI callback
  *
@@ -528,6 +834,7 @@ void unregister_SP_handler( void (*callback)() )
  */
 void register_TI_handler( void (*callback)() )
 {
+    assertf(__TI_leaf_handler == NULL, "TI callbacks cannot coexist with a TI leaf handler");
     __register_callback(&TI_callback,callback);
 }
 
@@ -546,6 +853,30 @@ void unregister_TI_handler( void (*callback)() )
     __unregister_callback(&TI_callback,callback);
 }
 
+/**
+ * @brief Register a leaf handler for the timer interrupt
+ *
+ * See #register_AI_leaf_handler in interrupt.h for the leaf handler
+ * contract. The timer interrupt is acknowledged by the dispatch code, so
+ * the handler only needs to reprogram C0_COMPARE if it wants another tick.
+ */
+void register_TI_leaf_handler( void (*callback)(void) )
+{
+    assertf(callback != NULL, "callback is NULL");
+    assertf(TI_callback == NULL, "TI leaf handler cannot coexist with TI callbacks (including the timer library)");
+    assertf(__TI_leaf_handler == NULL, "TI leaf handler already registered");
+    __TI_leaf_handler = callback;
+}
+
+/**
+ * @brief Unregister the leaf handler for the timer interrupt
+ */
+void unregister_TI_leaf_handler( void (*callback)(void) )
+{
+    assertf(__TI_leaf_handler == callback, "TI leaf handler does not match");
+    __TI_leaf_handler = NULL;
+}
+
 /**
  * @brief Register a CART interrupt callback.
  * 
@@ -689,7 +1020,12 @@ void set_VI_interrupt(int active, unsigned long line)
     if( active )
     {
     	MI_regs->mask=MI_MASK_SET_VI;
-	    VI_regs->v_int=line;
+        __vi_base_line = line;
+        /* When scanline handlers are registered, VI_V_INT is owned by the
+           scanline scheduler (see __vi_scanline_dispatch); the new base line
+           is picked up when its slot in the schedule comes up. */
+        if (__vi_scanline_count == 0)
+            VI_regs->v_int=line;
     }
     else
     {
@@ -835,6 +1171,119 @@ void set_RESET_interrupt(int active)
     }
 }
 
+/**
+ * @brief Change the dispatch priority of a MI interrupt source
+ *
+ * When multiple MI interrupts are pending at the same time, they are
+ * dispatched in order of descending priority. By default the order is
+ * SP, SI, AI, VI, PI, DP; a latency-sensitive application can for instance
+ * raise the AI priority above everything else to minimize audio jitter.
+ *
+ * If preemption is enabled with #interrupt_set_preemption, the priority also
+ * decides which sources are allowed to interrupt a running callback: only
+ * sources with a strictly higher priority can do so.
+ *
+ * @param[in] source
+ *            The MI interrupt source to configure
+ * @param[in] priority
+ *            The new priority. Any integer is accepted; only the relative
+ *            order between sources matters. Ties preserve the default order.
+ */
+void interrupt_set_priority( interrupt_source_t source, int priority )
+{
+    assertf(source >= 0 && source < INTERRUPT_SOURCE_COUNT, "invalid interrupt source: %d", source);
+
+    disable_interrupts();
+    __mi_priority[source] = priority;
+
+    /* Stable insertion sort by descending priority, so that sources with
+       equal priority keep the default SP, SI, AI, VI, PI, DP order. */
+    for (int i = 0; i < INTERRUPT_SOURCE_COUNT; i++)
+        __mi_order[i] = i;
+    for (int i = 1; i < INTERRUPT_SOURCE_COUNT; i++)
+    {
+        uint8_t src = __mi_order[i];
+        int j = i;
+        while (j > 0 && __mi_priority[__mi_order[j-1]] < __mi_priority[src])
+        {
+            __mi_order[j] = __mi_order[j-1];
+            j--;
+        }
+        __mi_order[j] = src;
+    }
+    enable_interrupts();
+}
+
+/**
+ * @brief Enable or disable preemption of MI interrupt callbacks
+ *
+ * When preemption is enabled, before running the callbacks of a MI source
+ * the dispatcher masks that source and all sources with the same or lower
+ * priority, and re-enables interrupts. A long-running callback (for instance
+ * a VI handler doing heavy work) can thus be preempted by higher-priority
+ * sources such as AI or SP, keeping their latency low.
+ *
+ * Preemption is disabled by default. Before enabling it, make sure that all
+ * registered callbacks tolerate being interrupted by other handlers: any
+ * state shared between handlers of different sources must be accessed with
+ * interrupts disabled.
+ *
+ * @param[in] active
+ *            Flag to specify whether preemption should be active
+ */
+void interrupt_set_preemption( int active )
+{
+    __mi_preemption = active;
+}
+
+/**
+ * @brief Read the dispatch statistics of a MI interrupt source
+ *
+ * Returns a consistent snapshot of the counters accumulated since boot
+ * (or since the last #interrupt_reset_stats). Latencies and durations are
+ * expressed in hardware ticks and can be converted with #TIMER_MICROS.
+ *
+ * @param[in]  source
+ *             The MI interrupt source to query
+ * @param[out] stats
+ *             Structure filled with the current counters
+ */
+void interrupt_get_stats( interrupt_source_t source, interrupt_stats_t *stats )
+{
+    assertf(source >= 0 && source < INTERRUPT_SOURCE_COUNT, "invalid interrupt source: %d", source);
+
+    disable_interrupts();
+    *stats = __mi_stats[source];
+    enable_interrupts();
+}
+
+/**
+ * @brief Reset the dispatch statistics of all MI interrupt sources
+ */
+void interrupt_reset_stats( void )
+{
+    disable_interrupts();
+    memset(__mi_stats, 0, sizeof(__mi_stats));
+    enable_interrupts();
+}
+
+/**
+ * @brief Return the total time spent servicing interrupts
+ *
+ * This is the cumulative wall-clock time spent inside interrupt dispatch
+ * (MI sources and the timer interrupt) since boot, in hardware ticks.
+ * Nested dispatches are counted once: only the outermost handler
+ * accumulates, so the value can be subtracted from an elapsed-time
+ * measurement to obtain the time a code region actually ran.
+ */
+uint64_t interrupt_total_time( void )
+{
+    disable_interrupts();
+    uint64_t total = __int_total_ticks;
+    enable_interrupts();
+    return total;
+}
+
 
 /**
  * @brief Initialize the interrupt controller
@@ -943,8 +1392,18 @@ interrupt_state_t get_interrupts_state()
     }
 }
 
+/**
+ * @brief Check whether the CPU is currently servicing an interrupt
+ *
+ * @return true if called from an interrupt callback, false otherwise
+ */
+bool interrupt_in_handler( void )
+{
+    return __int_nest > 0;
+}
 
-/** 
+
+/**
  * @brief Check whether the RESET button was pressed and how long we are into
  *        the reset process.
  * 
@@ -233,6 +233,23 @@ static void si_interrupt(void) {
     }
 }
 
+/**
+ * @brief Manually service a pending SI interrupt, if any.
+ *
+ * This allows the blocking paths to make progress even when interrupts
+ * are disabled by the caller: the SI interrupt is polled and dispatched
+ * by hand.
+ */
+static void joybus_poll_si_interrupt(void) {
+    disable_interrupts();
+    unsigned long status = MI_regs->intr & MI_regs->mask;
+    if (status & MI_INTR_SI) {
+        SI_regs->status = 0;    // clear interrupt
+        si_interrupt();
+    }
+    enable_interrupts();
+}
+
 /**
  * @brief Execute an asynchronous joybus message.
  * 
@@ -264,15 +281,23 @@ static void si_interrupt(void) {
  */
 void joybus_exec_async(const void * input, void (*callback)(uint64_t *output, void *ctx), void *ctx)
 {
-    // Make sure that the task queue is not full. If it is, just assert for now.
-    // It is not easy to understand what we should do when the queue is full;
-    // blocking would be an option, but if we are under interrupt, we would be
-    // deadlocking. So punt for now: we can revisit this later.
-    assertf((msgs_widx + 1) % MAX_JOYBUS_MSGS != msgs_ridx,
-        "joybus task queue is full");
-
     disable_interrupts();
 
+    // If the queue is full, wait for the SI to drain a message and free a
+    // slot. This can only be done from normal context: the wait re-enables
+    // interrupts, which must not happen in the middle of an interrupt
+    // callback, so in that case the queue being full is a hard error.
+    // Notice that checking EXL would not work here: inthandler.S clears it
+    // before dispatching the C callbacks, so we rely on the interrupt
+    // controller's own nesting flag instead.
+    while ((msgs_widx + 1) % MAX_JOYBUS_MSGS == msgs_ridx) {
+        assertf(!interrupt_in_handler(),
+            "joybus task queue is full (cannot wait under interrupt)");
+        enable_interrupts();
+        joybus_poll_si_interrupt();
+        disable_interrupts();
+    }
+
     // Write the new task into the ring buffer.
     joybus_msg_t *msg = &joybus_msgs[msgs_widx];
     memcpy(msg->input, input, JOYBUS_BLOCK_SIZE);
@@ -317,13 +342,7 @@ void joybus_exec( const void * input, void * output )
         // We want the blocking function to also work with interrupts disabled.
         // So while we spin loop, poll SI interrupts manually in case they
         // are disabled.
-        disable_interrupts();
-        unsigned long status = MI_regs->intr & MI_regs->mask;
-        if (status & MI_INTR_SI) {
-            SI_regs->status = 0;    // clear interrupt
-            si_interrupt();
-        }
-        enable_interrupts();
+        joybus_poll_si_interrupt();
     }
 }
 
@@ -0,0 +1,296 @@
+/**
+ * @file joybus_sched.c
+ * @brief Joybus command scheduler
+ * @ingroup lowlevel
+ */
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "debug.h"
+#include "interrupt.h"
+#include "joybus.h"
+#include "joybus_internal.h"
+
+/**
+ * @defgroup joybus_sched Joybus command scheduler
+ * @ingroup lowlevel
+ * @brief Coalescing of Joybus commands into shared PIF blocks.
+ *
+ * Each Joybus transaction transfers a full 64-byte PIF block, but a block
+ * can carry one command for every PIF channel: the four controller ports
+ * plus the cartridge channel (EEPROM and RTC). Subsystems that each issue
+ * their own transaction therefore waste most of the block and multiply
+ * the number of SI round-trips, adding both total stall time and jitter
+ * to input sampling.
+ *
+ * The scheduler keeps a small FIFO of pending commands per channel.
+ * #joybus_sched_flush (invoked once per frame from the VI interrupt after
+ * #joybus_sched_init) packs the head of each channel queue into a single
+ * shared block and submits it asynchronously, dispatching the per-command
+ * callbacks when the block completes. Channels are packed in port order,
+ * so controller input commands always come first in the block and are
+ * never displaced by cartridge traffic, which has its own channel slot.
+ *
+ * Commands are expressed as raw Joybus transmit bytes (command id
+ * followed by its arguments) plus the expected receive length, matching
+ * the on-wire PIF command format.
+ * @{
+ */
+
+/** @brief Number of PIF channels (4 controller ports + cartridge) */
+#define JOYBUS_SCHED_CHANNELS 5
+/** @brief Depth of the per-channel pending command FIFO */
+#define JOYBUS_SCHED_QUEUE    4
+/** @brief Maximum transmit length of a scheduled command */
+#define JOYBUS_SCHED_MAX_TX   36
+
+/** @brief One command pending in a channel queue */
+typedef struct joybus_sched_cmd_s
+{
+    /** @brief Number of bytes to transmit */
+    uint8_t tx_len;
+    /** @brief Number of bytes to receive */
+    uint8_t rx_len;
+    /** @brief Transmit bytes (command id followed by arguments) */
+    uint8_t tx[JOYBUS_SCHED_MAX_TX];
+    /** @brief Completion callback (receives the raw received bytes) */
+    joybus_sched_callback_t callback;
+    /** @brief Opaque context pointer for the callback */
+    void *ctx;
+} joybus_sched_cmd_t;
+
+/** @brief Per-channel pending command queues */
+static joybus_sched_cmd_t sched_queue[JOYBUS_SCHED_CHANNELS][JOYBUS_SCHED_QUEUE];
+/** @brief Per-channel queue read index */
+static int sched_ridx[JOYBUS_SCHED_CHANNELS];
+/** @brief Per-channel count of pending commands */
+static volatile int sched_count[JOYBUS_SCHED_CHANNELS];
+/** @brief Offset of each channel's receive data in the in-flight block (-1 if none) */
+static int sched_rx_offset[JOYBUS_SCHED_CHANNELS];
+/** @brief Shared PIF block being packed and submitted */
+static uint64_t sched_block[JOYBUS_BLOCK_DWORDS] __attribute__((aligned(8)));
+/** @brief True while a shared block is in flight */
+static volatile bool sched_busy = false;
+/** @brief True while the scheduler VI hook is registered */
+static bool sched_running = false;
+
+/**
+ * @brief Joybus completion callback for the shared block.
+ *
+ * Runs under the SI interrupt. Pops the completed command of each packed
+ * channel and invokes its callback with a pointer to the received bytes.
+ * Commands are popped before their callback runs, so callbacks may
+ * resubmit immediately.
+ */
+static void __joybus_sched_callback( uint64_t *output, void *ctx )
+{
+    uint8_t *bytes = (uint8_t *)output;
+
+    for( int ch = 0; ch < JOYBUS_SCHED_CHANNELS; ch++ )
+    {
+        int rx_offset = sched_rx_offset[ch];
+        if( rx_offset < 0 ) { continue; }
+
+        joybus_sched_cmd_t cmd = sched_queue[ch][sched_ridx[ch]];
+        sched_ridx[ch] = (sched_ridx[ch] + 1) % JOYBUS_SCHED_QUEUE;
+        sched_count[ch]--;
+        sched_rx_offset[ch] = -1;
+
+        if( cmd.callback ) { cmd.callback( &bytes[rx_offset], cmd.ctx ); }
+    }
+
+    sched_busy = false;
+}
+
+/**
+ * @brief Queue a command for a PIF channel.
+ *
+ * The command is transmitted as part of the next shared block flushed by
+ * #joybus_sched_flush. If the channel's queue is full the command is
+ * rejected; the caller can retry on a later frame.
+ *
+ * This function is safe to call both from normal and interrupt context
+ * (including from a scheduler callback, to resubmit a periodic command).
+ *
+ * @param[in] channel
+ *            PIF channel the command addresses: 0-3 for the controller
+ *            ports, 4 for the cartridge (EEPROM/RTC)
+ * @param[in] tx
+ *            Transmit bytes: the Joybus command id followed by its
+ *            arguments. Copied internally; need not stay valid.
+ * @param[in] tx_len
+ *            Number of transmit bytes (1 to #JOYBUS_SCHED_MAX_TX)
+ * @param[in] rx_len
+ *            Number of bytes the command receives
+ * @param[in] callback
+ *            Function called (under the SI interrupt) with a pointer to
+ *            the received bytes once the command completes (can be NULL)
+ * @param[in] ctx
+ *            Opaque context pointer passed to the callback
+ *
+ * @return true if the command was queued, false if the channel queue is full
+ */
+bool joybus_sched_submit( int channel, const uint8_t *tx, int tx_len, int rx_len,
+    joybus_sched_callback_t callback, void *ctx )
+{
+    assertf( channel >= 0 && channel < JOYBUS_SCHED_CHANNELS,
+        "invalid PIF channel: %d", channel );
+    assertf( tx_len > 0 && tx_len <= JOYBUS_SCHED_MAX_TX,
+        "invalid transmit length: %d", tx_len );
+    assertf( rx_len >= 0 && tx_len + rx_len + 2 <= JOYBUS_BLOCK_SIZE - 8,
+        "command does not fit in a PIF block" );
+
+    disable_interrupts();
+
+    if( sched_count[channel] == JOYBUS_SCHED_QUEUE )
+    {
+        enable_interrupts();
+        return false;
+    }
+
+    int widx = (sched_ridx[channel] + sched_count[channel]) % JOYBUS_SCHED_QUEUE;
+    joybus_sched_cmd_t *cmd = &sched_queue[channel][widx];
+    cmd->tx_len = tx_len;
+    cmd->rx_len = rx_len;
+    memcpy( cmd->tx, tx, tx_len );
+    cmd->callback = callback;
+    cmd->ctx = ctx;
+    sched_count[channel]++;
+
+    enable_interrupts();
+    return true;
+}
+
+/**
+ * @brief Pack all pending commands into one shared block and submit it.
+ *
+ * Takes the head of each channel queue (in port order, so controller
+ * input commands lead the block) and coalesces them into a single PIF
+ * block submitted through the asynchronous Joybus engine. Channels whose
+ * command would overflow the block stay queued for the next flush.
+ *
+ * This is invoked automatically once per frame from the VI interrupt
+ * after #joybus_sched_init, but can also be called manually when the
+ * scheduler is used without the VI hook.
+ */
+void joybus_sched_flush( void )
+{
+    disable_interrupts();
+
+    /* The previous block is still in flight: coalesce into the next frame */
+    if( sched_busy )
+    {
+        enable_interrupts();
+        return;
+    }
+
+    uint8_t *block = (uint8_t *)sched_block;
+    memset( block, 0, JOYBUS_BLOCK_SIZE );
+
+    int off = 0;
+    bool any = false;
+    for( int ch = 0; ch < JOYBUS_SCHED_CHANNELS; ch++ )
+    {
+        sched_rx_offset[ch] = -1;
+
+        if( sched_count[ch] == 0 )
+        {
+            /* 0x00 skips over a channel with nothing to send */
+            block[off++] = 0x00;
+            continue;
+        }
+
+        joybus_sched_cmd_t *cmd = &sched_queue[ch][sched_ridx[ch]];
+
+        /* Leave room for the 0xfe end marker and the process flag */
+        if( off + 2 + cmd->tx_len + cmd->rx_len + 1 > JOYBUS_BLOCK_SIZE - 2 )
+        {
+            block[off++] = 0x00;
+            continue;
+        }
+
+        block[off++] = cmd->tx_len;
+        block[off++] = cmd->rx_len;
+        memcpy( &block[off], cmd->tx, cmd->tx_len );
+        off += cmd->tx_len;
+        sched_rx_offset[ch] = off;
+        memset( &block[off], 0xff, cmd->rx_len );
+        off += cmd->rx_len;
+        any = true;
+    }
+
+    if( any )
+    {
+        block[off] = 0xfe;
+        block[JOYBUS_BLOCK_SIZE - 1] = 0x01;
+        sched_busy = true;
+        joybus_exec_async( sched_block, __joybus_sched_callback, NULL );
+    }
+
+    enable_interrupts();
+}
+
+/** @brief VI interrupt hook flushing the scheduler once per frame */
+static void __joybus_sched_vi( void )
+{
+    joybus_sched_flush();
+}
+
+/**
+ * @brief Start the Joybus command scheduler.
+ *
+ * Registers a VI interrupt hook that flushes the pending command queues
+ * into one shared PIF block per frame. Subsystems that detect a running
+ * scheduler (see #joybus_sched_active) route their periodic traffic
+ * through it instead of issuing standalone transactions.
+ */
+void joybus_sched_init( void )
+{
+    if( sched_running ) { return; }
+
+    for( int ch = 0; ch < JOYBUS_SCHED_CHANNELS; ch++ )
+    {
+        sched_ridx[ch] = 0;
+        sched_count[ch] = 0;
+        sched_rx_offset[ch] = -1;
+    }
+    sched_busy = false;
+    sched_running = true;
+
+    register_VI_handler( __joybus_sched_vi );
+}
+
+/**
+ * @brief Stop the Joybus command scheduler.
+ *
+ * Unregisters the VI flush hook. Commands still pending in the channel
+ * queues are dropped without their callbacks being invoked.
+ */
+void joybus_sched_close( void )
+{
+    if( !sched_running ) { return; }
+
+    unregister_VI_handler( __joybus_sched_vi );
+    sched_running = false;
+
+    disable_interrupts();
+    for( int ch = 0; ch < JOYBUS_SCHED_CHANNELS; ch++ )
+    {
+        sched_count[ch] = 0;
+        sched_rx_offset[ch] = -1;
+    }
+    enable_interrupts();
+}
+
+/**
+ * @brief Return whether the Joybus command scheduler is running.
+ *
+ * @return true between #joybus_sched_init and #joybus_sched_close
+ */
+bool joybus_sched_active( void )
+{
+    return sched_running;
+}
+
+/** @} */ /* joybus_sched */
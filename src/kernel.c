@@ -0,0 +1,290 @@
+/**
+ * @file kernel.c
+ * @brief Cooperative threading kernel
+ * @ingroup kernel
+ */
+#include <malloc.h>
+#include <string.h>
+#include "libdragon.h"
+#include "regsinternal.h"
+
+/**
+ * @defgroup kernel Cooperative threading kernel
+ * @ingroup libdragon
+ * @brief Small cooperative threading kernel for overlapping I/O and computation
+ *
+ * See kernel.h for an overview of the programming model. The implementation
+ * is deliberately small:
+ *
+ *  * The scheduler is a FIFO of ready threads, serviced round-robin. There
+ *    are no priorities: a thread runs until it yields, sleeps or suspends.
+ *  * A context switch (__kswitch, in kswitch.S) only saves the callee-saved
+ *    registers, because switches happen exclusively at function call sites
+ *    where everything else is dead by ABI contract. This makes a switch
+ *    cost roughly as much as a cache-cold function call.
+ *  * Waking a thread just appends it to the ready queue, so #kthread_wake
+ *    can be called from interrupt handlers; the actual switch happens the
+ *    next time the running thread reaches a scheduling point.
+ *  * When no thread is ready, the scheduler idles with interrupts enabled
+ *    until a handler wakes one up.
+ *
+ * A thread that exits cannot free its own stack (it is still running on it),
+ * so it parks itself in a one-entry "zombie" slot which is reaped by the
+ * next thread right after the switch.
+ */
+
+/** @brief Indices of the saved registers inside kthread_t::ctx (see kswitch.S) */
+#define KCTX_RA     0
+/** @brief Index of the saved stack pointer */
+#define KCTX_SP     1
+/** @brief Index of the saved frame pointer */
+#define KCTX_FP     2
+/** @brief Index of the saved global pointer */
+#define KCTX_GP     3
+/** @brief Index of the saved FPU control register */
+#define KCTX_FCR31  18
+
+/** @brief Low-level context switch (kswitch.S) */
+extern void __kswitch(uint64_t *save_ctx, uint64_t *load_ctx);
+
+/** @brief Thread structure of the main thread */
+static kthread_t kernel_main_thread;
+/** @brief Currently running thread */
+static kthread_t *kthread_cur = NULL;
+/** @brief Head of the ready queue (volatile: appended to by interrupt handlers) */
+static kthread_t * volatile kthread_ready_head = NULL;
+/** @brief Tail of the ready queue */
+static kthread_t * volatile kthread_ready_tail = NULL;
+/** @brief Thread that exited and waits for its memory to be freed */
+static kthread_t *kthread_zombie = NULL;
+/** @brief True if the kernel has been initialized */
+static bool kernel_inited = false;
+
+/**
+ * @brief Append a thread to the ready queue.
+ *
+ * Must be called with interrupts disabled (or from an interrupt handler).
+ */
+static void __kthread_enqueue(kthread_t *thread)
+{
+    thread->state = KTHREAD_READY;
+    thread->next = NULL;
+    if (kthread_ready_tail)
+        kthread_ready_tail->next = thread;
+    else
+        kthread_ready_head = thread;
+    kthread_ready_tail = thread;
+}
+
+/** @brief Pop the first ready thread, or return NULL. Interrupts must be disabled. */
+static kthread_t *__kthread_dequeue(void)
+{
+    kthread_t *thread = kthread_ready_head;
+    if (thread) {
+        kthread_ready_head = thread->next;
+        if (!kthread_ready_head)
+            kthread_ready_tail = NULL;
+        thread->next = NULL;
+    }
+    return thread;
+}
+
+/** @brief Free the memory of a thread that exited, if any. Interrupts must be disabled. */
+static void __kthread_reap(void)
+{
+    if (kthread_zombie) {
+        free(kthread_zombie);
+        kthread_zombie = NULL;
+    }
+}
+
+/**
+ * @brief Switch to the next ready thread.
+ *
+ * Must be called with interrupts disabled; returns (with interrupts still
+ * disabled) when the calling thread is scheduled again. The current thread
+ * must have been either re-enqueued (yield) or marked blocked/zombie.
+ */
+static void __kthread_schedule(void)
+{
+    kthread_t *next;
+    while (!(next = __kthread_dequeue())) {
+        /* No thread is ready to run. Open an interrupt window so that a
+           handler can wake one up, then look again. */
+        enable_interrupts();
+        MEMORY_BARRIER();
+        disable_interrupts();
+    }
+
+    kthread_t *prev = kthread_cur;
+    kthread_cur = next;
+    next->state = KTHREAD_RUNNING;
+    if (prev != next)
+        __kswitch(prev->ctx, next->ctx);
+
+    /* We are running again (on the stack of whoever called schedule last
+       on this thread). If the thread we came from exited, free it now. */
+    __kthread_reap();
+}
+
+/**
+ * @brief Entry point of every new thread (reached via the context set up
+ *        by #kthread_new).
+ */
+__attribute__((noreturn))
+static void __kthread_entry(void)
+{
+    /* We were switched in from __kthread_schedule with interrupts disabled:
+       reap like schedule would, then balance the disable done by the thread
+       that scheduled us. */
+    __kthread_reap();
+    enable_interrupts();
+
+    kthread_cur->entry(kthread_cur->arg);
+    kthread_exit();
+}
+
+void kernel_init(void)
+{
+    assertf(!kernel_inited, "kernel_init called twice");
+
+    memset(&kernel_main_thread, 0, sizeof(kernel_main_thread));
+    kernel_main_thread.name = "main";
+    kernel_main_thread.state = KTHREAD_RUNNING;
+    kthread_cur = &kernel_main_thread;
+    kernel_inited = true;
+}
+
+void kernel_close(void)
+{
+    assertf(kernel_inited, "kernel not initialized");
+    assertf(kthread_cur == &kernel_main_thread,
+        "kernel_close must be called from the main thread");
+    assertf(!kthread_ready_head, "kernel_close called with threads still ready");
+
+    disable_interrupts();
+    __kthread_reap();
+    enable_interrupts();
+    kthread_cur = NULL;
+    kernel_inited = false;
+}
+
+kthread_t *kthread_new(const char *name, int stack_size, void (*entry)(void *arg), void *arg)
+{
+    assertf(kernel_inited, "kernel not initialized");
+    assertf(stack_size >= 1024, "stack size too small: %d", stack_size);
+
+    kthread_t *thread = malloc(sizeof(kthread_t) + stack_size);
+    if (!thread)
+        return NULL;
+    memset(thread, 0, sizeof(kthread_t));
+    thread->name = name;
+    thread->entry = entry;
+    thread->arg = arg;
+
+    /* Build the initial context: the first switch to this thread "returns"
+       into __kthread_entry, on a fresh stack growing down from the end of
+       the allocation. gp is shared by all threads; the FPU control register
+       is inherited from the creator. */
+    uint64_t gp_reg;
+    asm volatile("move %0, $28" : "=r"(gp_reg));
+    thread->ctx[KCTX_RA] = (int32_t)(uintptr_t)__kthread_entry;
+    thread->ctx[KCTX_SP] = (int32_t)(((uintptr_t)(thread + 1) + stack_size) & ~0xF);
+    thread->ctx[KCTX_GP] = gp_reg;
+    thread->ctx[KCTX_FCR31] = C1_FCR31();
+
+    disable_interrupts();
+    __kthread_enqueue(thread);
+    enable_interrupts();
+    return thread;
+}
+
+kthread_t *kthread_current(void)
+{
+    return kthread_cur;
+}
+
+void kthread_yield(void)
+{
+    assertf(kernel_inited, "kernel not initialized");
+
+    disable_interrupts();
+    if (kthread_ready_head) {
+        __kthread_enqueue(kthread_cur);
+        __kthread_schedule();
+    }
+    enable_interrupts();
+}
+
+void kthread_suspend(void)
+{
+    assertf(kernel_inited, "kernel not initialized");
+
+    disable_interrupts();
+    if (kthread_cur->wake_pending) {
+        /* A wake arrived before we got here: consume it and keep running. */
+        kthread_cur->wake_pending = false;
+    } else {
+        kthread_cur->state = KTHREAD_BLOCKED;
+        __kthread_schedule();
+    }
+    enable_interrupts();
+}
+
+/** @brief Timer callback used by #kthread_sleep */
+static void __kthread_sleep_cb(int ovfl, void *ctx)
+{
+    kthread_wake((kthread_t *)ctx);
+}
+
+void kthread_sleep(int ticks)
+{
+    assertf(kernel_inited, "kernel not initialized");
+
+    disable_interrupts();
+    if (kthread_cur->wake_pending) {
+        kthread_cur->wake_pending = false;
+    } else {
+        start_timer_context(&kthread_cur->sleep_timer, ticks, TF_ONE_SHOT,
+            __kthread_sleep_cb, kthread_cur);
+        kthread_cur->state = KTHREAD_BLOCKED;
+        __kthread_schedule();
+    }
+    enable_interrupts();
+}
+
+void kthread_wake(kthread_t *thread)
+{
+    disable_interrupts();
+    switch (thread->state) {
+    case KTHREAD_BLOCKED:
+        /* Cancel a pending sleep timer, so that a thread woken early does
+           not get a second, spurious wake later. */
+        stop_timer(&thread->sleep_timer);
+        __kthread_enqueue(thread);
+        break;
+    case KTHREAD_RUNNING:
+    case KTHREAD_READY:
+        /* Not suspended (yet): latch the wake so that the next suspend or
+           sleep returns immediately instead of losing the event. */
+        thread->wake_pending = true;
+        break;
+    case KTHREAD_ZOMBIE:
+        break;
+    }
+    enable_interrupts();
+}
+
+void kthread_exit(void)
+{
+    assertf(kernel_inited, "kernel not initialized");
+    assertf(kthread_cur != &kernel_main_thread, "the main thread cannot exit");
+
+    disable_interrupts();
+    /* Park in the zombie slot; the next thread to run will free us right
+       after the switch, when our stack is no longer in use. */
+    kthread_cur->state = KTHREAD_ZOMBIE;
+    kthread_zombie = kthread_cur;
+    __kthread_schedule();
+    __builtin_unreachable();
+}
@@ -341,6 +341,93 @@ int cart_card_rd_cart(uint32_t cart, uint32_t lba, uint32_t count)
     return card_rd_cart[cart_type](cart, lba, count);
 }
 
+/* Queued multi-sector reads.  Each cart backend already streams a whole
+ * request with a single CMD18, so the queue's job is to let callers file
+ * reads ahead of time and to merge adjacent requests into one stream:
+ * back-to-back single-sector reads pay the full command latency per
+ * sector, while one merged CMD18 pays it once. */
+#define CART_RDQ_MAX    8
+
+static struct
+{
+    void *dram;
+    uint32_t lba;
+    uint32_t count;
+    void (*callback)(void *ctx, int result);
+    void *ctx;
+}
+cart_rdq[CART_RDQ_MAX];
+static int cart_rdq_head;
+static int cart_rdq_len;
+
+int cart_card_rd_queue(
+    void *dram, uint32_t lba, uint32_t count,
+    void (*callback)(void *ctx, int result), void *ctx)
+{
+    int tail;
+    if (cart_type < 0) return -1;
+    if (count == 0) return -1;
+    /* Merge with the newest pending entry when this request continues it
+     * in both card and memory space.  Only callback-less entries merge,
+     * as a merged entry can report just one completion. */
+    if (cart_rdq_len > 0)
+    {
+        tail = (cart_rdq_head+cart_rdq_len-1) % CART_RDQ_MAX;
+        if (
+            callback == NULL && cart_rdq[tail].callback == NULL &&
+            cart_rdq[tail].lba + cart_rdq[tail].count == lba &&
+            (char *)cart_rdq[tail].dram + 512*cart_rdq[tail].count == dram
+        )
+        {
+            cart_rdq[tail].count += count;
+            return 0;
+        }
+    }
+    /* Queue full: retire the oldest entry to make room */
+    if (cart_rdq_len == CART_RDQ_MAX && cart_card_rd_poll() < 0) return -1;
+    tail = (cart_rdq_head+cart_rdq_len) % CART_RDQ_MAX;
+    cart_rdq[tail].dram = dram;
+    cart_rdq[tail].lba = lba;
+    cart_rdq[tail].count = count;
+    cart_rdq[tail].callback = callback;
+    cart_rdq[tail].ctx = ctx;
+    cart_rdq_len++;
+    return 0;
+}
+
+int cart_card_rd_poll(void)
+{
+    void (*callback)(void *ctx, int result);
+    void *dram;
+    void *ctx;
+    uint32_t lba;
+    uint32_t count;
+    int result;
+    if (cart_rdq_len == 0) return 0;
+    /* Pop before reading so a callback may queue further reads */
+    dram = cart_rdq[cart_rdq_head].dram;
+    lba = cart_rdq[cart_rdq_head].lba;
+    count = cart_rdq[cart_rdq_head].count;
+    callback = cart_rdq[cart_rdq_head].callback;
+    ctx = cart_rdq[cart_rdq_head].ctx;
+    cart_rdq_head = (cart_rdq_head+1) % CART_RDQ_MAX;
+    cart_rdq_len--;
+    result = cart_card_rd_dram(dram, lba, count);
+    if (callback) callback(ctx, result);
+    if (result < 0) return -1;
+    return cart_rdq_len;
+}
+
+int cart_card_rd_flush(void)
+{
+    int result = 0;
+    while (cart_rdq_len > 0)
+    {
+        if (cart_card_rd_poll() < 0) result = -1;
+    }
+    return result;
+}
+
 int cart_card_wr_dram(const void *dram, uint32_t lba, uint32_t count)
 {
     static int (*const card_wr_dram[CART_MAX])(
@@ -38,6 +38,17 @@ extern int cart_card_byteswap(int flag);
 extern int cart_card_rd_dram(void *dram, uint32_t lba, uint32_t count);
 /* Read sectors from card to cartridge SDRAM */
 extern int cart_card_rd_cart(uint32_t cart, uint32_t lba, uint32_t count);
+/* Queue a read from card to system RDRAM; adjacent queued reads are
+   merged into a single multi-sector stream.  The optional callback is
+   invoked with the read result when the entry is executed. */
+extern int cart_card_rd_queue(
+    void *dram, uint32_t lba, uint32_t count,
+    void (*callback)(void *ctx, int result), void *ctx);
+/* Execute the oldest queued read; returns the number of reads still
+   pending, or -1 if the read failed */
+extern int cart_card_rd_poll(void);
+/* Execute all queued reads */
+extern int cart_card_rd_flush(void);
 /* Write sectors from system RDRAM to card */
 extern int cart_card_wr_dram(const void *dram, uint32_t lba, uint32_t count);
 /* Write sectors from cartridge SDRAM to card */
@@ -0,0 +1,177 @@
+/**
+ * @file memory.c
+ * @brief RDRAM-tuned memcpy/memset/memmove
+ * @ingroup n64sys
+ *
+ * These functions override the newlib implementations (this library is
+ * searched before libc at link time), so every libdragon program picks
+ * them up without changes. They are tuned for the way RDRAM is accessed
+ * on the N64:
+ *
+ *  * bulk transfers use 64-bit loads and stores, which newlib's generic
+ *    C loops never emit, doubling the bytes moved per RDRAM transaction;
+ *  * misaligned sources are handled with unaligned 64-bit loads (the
+ *    compiler lowers them to ldl/ldr pairs), so mixed alignment does not
+ *    fall back to byte loops;
+ *  * large memsets to cached RDRAM mark the target cachelines dirty
+ *    (without fetching them first) before storing, removing the useless
+ *    RDRAM reads that a store miss would otherwise perform.
+ */
+#include <string.h>
+#include "n64sys.h"
+#include "debug.h"
+#include "utils.h"
+
+/** @brief A uint64_t the compiler may load from any address (lowered to ldl/ldr) */
+typedef uint64_t u64_unaligned __attribute__((aligned(1)));
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (n >= 16)
+    {
+        /* Align the destination to 8 bytes: stores are the expensive side
+           on RDRAM, so they always run full width and aligned. */
+        while ((uint32_t)d & 7) { *d++ = *s++; n--; }
+
+        uint64_t *d64 = (uint64_t *)d;
+        if (((uint32_t)s & 7) == 0)
+        {
+            const uint64_t *s64 = (const uint64_t *)s;
+            while (n >= 32) {
+                uint64_t a = s64[0], b = s64[1], c = s64[2], e = s64[3];
+                d64[0] = a; d64[1] = b; d64[2] = c; d64[3] = e;
+                d64 += 4; s64 += 4; n -= 32;
+            }
+            while (n >= 8) { *d64++ = *s64++; n -= 8; }
+            s = (const uint8_t *)s64;
+        }
+        else
+        {
+            const u64_unaligned *s64 = (const u64_unaligned *)s;
+            while (n >= 32) {
+                uint64_t a = s64[0], b = s64[1], c = s64[2], e = s64[3];
+                d64[0] = a; d64[1] = b; d64[2] = c; d64[3] = e;
+                d64 += 4; s64 += 4; n -= 32;
+            }
+            while (n >= 8) { *d64++ = *s64++; n -= 8; }
+            s = (const uint8_t *)s64;
+        }
+        d = (uint8_t *)d64;
+    }
+
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+void *memset(void *dst, int value, size_t n)
+{
+    uint8_t *d = dst;
+
+    if (n >= 16)
+    {
+        uint64_t v = (uint8_t)value * 0x0101010101010101ull;
+
+        while ((uint32_t)d & 7) { *d++ = value; n--; }
+
+        /* For large fills into cached RDRAM (KSEG0), mark the fully covered
+           cachelines dirty before storing: the cache then never fetches
+           their stale contents from RDRAM, halving the memory traffic. */
+        if (n >= 256 && ((uint32_t)d >> 29) == 4)
+        {
+            uint8_t *line_start = (uint8_t *)ROUND_UP((uint32_t)d, 16);
+            uint32_t line_len = ((uint32_t)d + n - (uint32_t)line_start) & ~15;
+            if (line_len)
+                data_cache_hit_create_dirty(line_start, line_len);
+        }
+
+        uint64_t *d64 = (uint64_t *)d;
+        while (n >= 32) {
+            d64[0] = v; d64[1] = v; d64[2] = v; d64[3] = v;
+            d64 += 4; n -= 32;
+        }
+        while (n >= 8) { *d64++ = v; n -= 8; }
+        d = (uint8_t *)d64;
+    }
+
+    while (n--) *d++ = value;
+    return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    /* Forward copy is safe unless the ranges overlap with dst inside src. */
+    if (dst <= src || (uint8_t *)dst >= (const uint8_t *)src + n)
+        return memcpy(dst, src, n);
+
+    uint8_t *d = (uint8_t *)dst + n;
+    const uint8_t *s = (const uint8_t *)src + n;
+
+    if (n >= 16)
+    {
+        while ((uint32_t)d & 7) { *--d = *--s; n--; }
+
+        uint64_t *d64 = (uint64_t *)d;
+        if (((uint32_t)s & 7) == 0)
+        {
+            const uint64_t *s64 = (const uint64_t *)s;
+            while (n >= 8) { *--d64 = *--s64; n -= 8; }
+            s = (const uint8_t *)s64;
+        }
+        else
+        {
+            const u64_unaligned *s64 = (const u64_unaligned *)s;
+            while (n >= 8) { *--d64 = *--s64; n -= 8; }
+            s = (const uint8_t *)s64;
+        }
+        d = (uint8_t *)d64;
+    }
+
+    while (n--) *--d = *--s;
+    return dst;
+}
+
+/**
+ * @brief Copy memory without polluting the data cache with the destination
+ *
+ * This is a streaming variant of #memcpy for filling buffers that the CPU
+ * is not going to read back soon (DMA staging areas, framebuffers): the
+ * destination is written through the uncached segment, so the copy does not
+ * evict a destination-sized chunk of the working set from the data cache.
+ * Any cachelines the destination range currently occupies are flushed first,
+ * so the function is safe to use on ordinary cached buffers.
+ *
+ * The source is still read through the cache. The destination must be in
+ * RDRAM. Writing uncached is slower per byte than a fully cached copy, so
+ * use this only when cache pollution matters more than raw copy speed.
+ *
+ * @param[in] dst
+ *            Destination buffer (cached or uncached RDRAM address)
+ * @param[in] src
+ *            Source buffer
+ * @param[in] n
+ *            Number of bytes to copy
+ *
+ * @return dst
+ */
+void *memcpy_stream(void *dst, const void *src, size_t n)
+{
+    assertf(((uint32_t)dst >> 29) == 4 || ((uint32_t)dst >> 29) == 5,
+        "memcpy_stream destination must be in RDRAM: %p", dst);
+
+    if (n && ((uint32_t)dst >> 29) == 4)
+    {
+        /* Flush (writeback+invalidate) the lines covering the destination:
+           a dirty line left behind could later be written back on top of
+           the data we are about to store uncached. Rounding out to full
+           cachelines is safe, the flush preserves memory contents. */
+        uint8_t *line_start = (uint8_t *)((uint32_t)dst & ~15);
+        uint32_t line_len = ROUND_UP((uint32_t)dst + n, 16) - (uint32_t)line_start;
+        data_cache_hit_writeback_invalidate(line_start, line_len);
+    }
+
+    memcpy(UncachedAddr(dst), src, n);
+    return dst;
+}
@@ -3,6 +3,7 @@
  * @brief Mempak Filesystem Routine
  * @ingroup mempak
  */
+#include <stdlib.h>
 #include <string.h>
 #include "libdragon.h"
 #include "regsinternal.h"
@@ -45,6 +46,61 @@
 #define BLOCK_VALID_LAST    0x7F
 /** @} */
 
+/** @brief Number of 256-byte sectors on a mempak */
+#define MEMPAK_NUM_SECTORS  128
+
+/**
+ * @name RDRAM shadow of the pak contents
+ *
+ * When enabled with #mempak_shadow_enable, a full 32 KiB image of the
+ * pak is kept in RDRAM and filled on demand: reads are served from the
+ * image when the sectors are present, and fetch them from the pak in
+ * bulk otherwise. Writes go through to the pak and patch the image, so
+ * it never goes stale from our own activity. The image is dropped when
+ * the controller subsystem notices an accessory change on the port
+ * (see #accessory_probe_start), covering pak swaps.
+ *
+ * The TOC validation result is cached alongside, so checksumming also
+ * happens once per image instead of once per operation.
+ * @{
+ */
+/** @brief Shadow image per controller (NULL when not enabled) */
+static uint8_t *shadow_data[4] = { 0 };
+/** @brief Bitmap of sectors present in the shadow image */
+static uint8_t shadow_present[4][MEMPAK_NUM_SECTORS / 8];
+/** @brief Cached result of __get_valid_toc (0 = unknown) */
+static volatile int8_t shadow_toc[4];
+/** @} */
+
+/** @brief Whether the given sector is present in the shadow image */
+static int __shadow_has_sector( int controller, int sector )
+{
+    return shadow_present[controller][sector >> 3] & (1 << (sector & 7));
+}
+
+/** @brief Mark a range of sectors as present in the shadow image */
+static void __shadow_mark_sectors( int controller, int sector, int num_sectors )
+{
+    for( int i = sector; i < sector + num_sectors; i++ )
+    {
+        shadow_present[controller][i >> 3] |= 1 << (i & 7);
+    }
+}
+
+/**
+ * @brief Drop the shadow image of a controller port.
+ *
+ * Called by the controller subsystem (possibly from the SI interrupt)
+ * whenever the accessory on a port changes, so a swapped pak is never
+ * served from the old pak's image. The memory stays allocated: the
+ * image simply refills from the new pak on demand.
+ */
+void __mempak_shadow_invalidate( int controller )
+{
+    memset( shadow_present[controller], 0, sizeof(shadow_present[controller]) );
+    shadow_toc[controller] = 0;
+}
+
 /**
  * @brief Read a sector from a mempak
  *
@@ -64,20 +120,82 @@
  */
 int read_mempak_sector( int controller, int sector, uint8_t *sector_data )
 {
-    if( sector < 0 || sector >= 128 ) { return -1; }
+    return read_mempak_sectors( controller, sector, 1, sector_data, NULL );
+}
+
+/**
+ * @brief Read a range of sectors from a mempak
+ *
+ * This reads a contiguous range of 256-byte sectors in one pipelined
+ * bulk transfer (see #read_mempak_bulk): multiple commands are kept in
+ * flight on the PIF at all times and every 32-byte block is
+ * CRC-verified as it arrives, making large reads (eg: a full 32 KiB
+ * pak dump for a save-import screen) much faster than looping over
+ * #read_mempak_sector.
+ *
+ * @param[in]  controller
+ *             The controller (0-3) to read from
+ * @param[in]  sector
+ *             The first sector (0-127) to read
+ * @param[in]  num_sectors
+ *             Number of sectors to read
+ * @param[out] sector_data
+ *             Buffer to place the read data (num_sectors * 256 bytes)
+ * @param[in]  progress
+ *             Optional callback invoked with (bytes_done, bytes_total)
+ *             as the read advances (can be NULL)
+ *
+ * @retval 0 if reading was successful
+ * @retval -1 if the sector range was out of bounds or sector_data was null
+ * @retval -2 if there was an error reading part of a sector
+ */
+int read_mempak_sectors( int controller, int sector, int num_sectors, uint8_t *sector_data,
+    void (*progress)(int done, int total) )
+{
+    if( sector < 0 || num_sectors <= 0 || sector + num_sectors > 128 ) { return -1; }
     if( sector_data == 0 ) { return -1; }
 
-    /* Sectors are 256 bytes, a mempak reads 32 bytes at a time */
-    for( int i = 0; i < 8; i++ )
+    /* With the shadow enabled, fetch only the sectors not yet in the
+       image (in contiguous bulk runs) and serve the read from RDRAM */
+    if( controller >= 0 && controller < 4 && shadow_data[controller] )
     {
-        if( read_mempak_address( controller, (sector * MEMPAK_BLOCK_SIZE) + (i * 32), sector_data + (i * 32) ) )
+        uint8_t *shadow = shadow_data[controller];
+        int cur = sector;
+
+        while( cur < sector + num_sectors )
         {
-            /* Failed to read a block */
-            return -2;
+            if( __shadow_has_sector( controller, cur ) )
+            {
+                cur++;
+                continue;
+            }
+
+            /* Extend the run of missing sectors so they go over the
+               wire as a single pipelined transfer */
+            int run = cur + 1;
+            while( run < sector + num_sectors && !__shadow_has_sector( controller, run ) ) { run++; }
+
+            int ret = read_mempak_bulk( controller, cur * MEMPAK_BLOCK_SIZE,
+                (run - cur) * MEMPAK_BLOCK_SIZE, shadow + (cur * MEMPAK_BLOCK_SIZE), NULL );
+            if( ret != 0 )
+            {
+                return ret == -1 ? -1 : -2;
+            }
+
+            __shadow_mark_sectors( controller, cur, run - cur );
+            cur = run;
         }
+
+        memcpy( sector_data, shadow + (sector * MEMPAK_BLOCK_SIZE), num_sectors * MEMPAK_BLOCK_SIZE );
+        if( progress ) { progress( num_sectors * MEMPAK_BLOCK_SIZE, num_sectors * MEMPAK_BLOCK_SIZE ); }
+        return 0;
     }
 
-    return 0;
+    int ret = read_mempak_bulk( controller, sector * MEMPAK_BLOCK_SIZE,
+        num_sectors * MEMPAK_BLOCK_SIZE, sector_data, progress );
+
+    /* Keep the historical error convention of read_mempak_sector */
+    return ret == 0 ? 0 : (ret == -1 ? -1 : -2);
 }
 
 /**
@@ -112,9 +230,65 @@ int write_mempak_sector( int controller, int sector, uint8_t *sector_data )
         }
     }
 
+    /* Write through to the shadow image so it stays coherent with the
+       pak; writes to the filesystem sectors force a revalidation */
+    if( controller >= 0 && controller < 4 && shadow_data[controller] )
+    {
+        memcpy( shadow_data[controller] + (sector * MEMPAK_BLOCK_SIZE), sector_data, MEMPAK_BLOCK_SIZE );
+        __shadow_mark_sectors( controller, sector, 1 );
+        if( sector <= 2 ) { shadow_toc[controller] = 0; }
+    }
+
     return 0;
 }
 
+/**
+ * @brief Read 32 bytes from a mempak, through the shadow if enabled
+ *
+ * Drop-in replacement for #read_mempak_address used by the note table
+ * accessors: when the shadow image is enabled, the whole containing
+ * sector is pulled through the shadow (the neighbouring note entries
+ * are what these callers scan next anyway), so repeated entry
+ * enumeration costs a single pak read.
+ */
+static int __mempak_read_address( int controller, int address, uint8_t *data )
+{
+    if( controller < 0 || controller > 3 || !shadow_data[controller] )
+    {
+        return read_mempak_address( controller, address, data );
+    }
+
+    uint8_t sector[MEMPAK_BLOCK_SIZE];
+    if( read_mempak_sector( controller, address / MEMPAK_BLOCK_SIZE, sector ) )
+    {
+        return -1;
+    }
+
+    memcpy( data, sector + (address % MEMPAK_BLOCK_SIZE), 32 );
+    return 0;
+}
+
+/**
+ * @brief Write 32 bytes to a mempak, patching the shadow if enabled
+ *
+ * Drop-in replacement for #write_mempak_address used by the note table
+ * writers.  The pak write always happens; on success the bytes are also
+ * patched into the shadow image when its containing sector is present
+ * (a 32-byte write cannot make a missing sector present).
+ */
+static int __mempak_write_address( int controller, int address, uint8_t *data )
+{
+    int ret = write_mempak_address( controller, address, data );
+
+    if( ret == 0 && controller >= 0 && controller < 4 && shadow_data[controller]
+        && __shadow_has_sector( controller, address / MEMPAK_BLOCK_SIZE ) )
+    {
+        memcpy( shadow_data[controller] + address, data, 32 );
+    }
+
+    return ret;
+}
+
 /**
  * @brief Calculate the checksum of a header
  *
@@ -658,6 +832,14 @@ static int __get_valid_toc( int controller )
     /* We will need only one sector at a time */
     uint8_t data[MEMPAK_BLOCK_SIZE];
 
+    /* With the shadow enabled, the header and TOC checksums only need
+       to pass once per image: reuse the cached result until a write to
+       the filesystem sectors or an accessory change drops it */
+    if( controller >= 0 && controller < 4 && shadow_data[controller] && shadow_toc[controller] > 0 )
+    {
+        return shadow_toc[controller];
+    }
+
     /* First check to see that the header block is valid */
     if( read_mempak_sector( controller, 0, data ) )
     {
@@ -695,12 +877,14 @@ static int __get_valid_toc( int controller )
         else
         {
             /* Found a good TOC! */
+            if( controller >= 0 && controller < 4 && shadow_data[controller] ) { shadow_toc[controller] = 2; }
             return 2;
         }
     }
     else
     {
         /* Found a good TOC! */
+        if( controller >= 0 && controller < 4 && shadow_data[controller] ) { shadow_toc[controller] = 1; }
         return 1;
     }
 }
@@ -768,7 +952,7 @@ int get_mempak_entry( int controller, int entry, entry_structure_t *entry_data )
 
     /* Entries are spread across two sectors, but we can luckly grab just one
        with a single mempak read */
-    if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry * 32), data ) )
+    if( __mempak_read_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry * 32), data ) )
     {
         /* Couldn't read note database */
         return -2;
@@ -1097,7 +1281,7 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
     {
         entry_structure_t tmp_entry;
 
-        if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (i * 32), tmp_data ) )
+        if( __mempak_read_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (i * 32), tmp_data ) )
         {
             /* Couldn't read note database */
             return -2;
@@ -1140,7 +1324,7 @@ int write_mempak_entry_data( int controller, entry_structure_t *entry, uint8_t *
     __write_note( entry, tmp_data );
 
     /* Store entry to empty slot on mempak */
-    if( write_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), tmp_data ) )
+    if( __mempak_write_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), tmp_data ) )
     {
         /* Couldn't update note database */
         return -2;
@@ -1177,7 +1361,7 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
     if( entry->inode < BLOCK_VALID_FIRST || entry->inode > BLOCK_VALID_LAST ) { return -1; }
 
     /* Ensure that the entry passed in matches what's on the mempak */
-    if( read_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
+    if( __mempak_read_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
     {
         /* Couldn't read note database */
         return -2;
@@ -1197,7 +1381,7 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
 
     /* The entry matches, so blank it */
     memset( data, 0, 32 );
-    if( write_mempak_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
+    if( __mempak_write_address( controller, (3 * MEMPAK_BLOCK_SIZE) + (entry->entry_id * 32), data ) )
     {
         /* Couldn't update note database */
         return -2;
@@ -1271,4 +1455,62 @@ int delete_mempak_entry( int controller, entry_structure_t *entry )
     return 0;
 }
 
+/**
+ * @brief Enable the RDRAM shadow image for a controller's mempak
+ *
+ * Allocates a 32 KiB image of the pak in RDRAM.  Sectors are fetched
+ * from the pak on first use and served from the image afterwards, and
+ * the header/TOC checksum validation performed by operations like
+ * #get_mempak_entry happens once per image instead of once per call,
+ * making repeated browsing of the note table near-instant.
+ *
+ * Writes issued through this module keep the image coherent.  Pak swaps
+ * are covered by the accessory change detection of the controller
+ * subsystem, which drops the image: make sure the background accessory
+ * probe (#accessory_probe_start) is running, or the shadow will keep
+ * serving the contents of a removed pak.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to shadow the mempak of
+ *
+ * @retval 0 if the shadow was enabled
+ * @retval -1 if the controller was out of bounds or memory was exhausted
+ */
+int mempak_shadow_enable( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return -1; }
+
+    if( !shadow_data[controller] )
+    {
+        shadow_data[controller] = malloc( MEMPAK_NUM_SECTORS * MEMPAK_BLOCK_SIZE );
+        if( !shadow_data[controller] ) { return -1; }
+    }
+
+    /* Start from an empty image even when re-enabling */
+    __mempak_shadow_invalidate( controller );
+    return 0;
+}
+
+/**
+ * @brief Disable the RDRAM shadow image for a controller's mempak
+ *
+ * Releases the shadow image; all operations go back to talking to the
+ * physical pak directly.
+ *
+ * @param[in] controller
+ *            The controller (0-3) to stop shadowing
+ */
+void mempak_shadow_disable( int controller )
+{
+    if( controller < 0 || controller > 3 ) { return; }
+
+    if( shadow_data[controller] )
+    {
+        free( shadow_data[controller] );
+        shadow_data[controller] = NULL;
+    }
+
+    __mempak_shadow_invalidate( controller );
+}
+
 /** @} */ /* controller */
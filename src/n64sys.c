@@ -122,6 +122,36 @@ void data_cache_hit_writeback_invalidate(volatile void * addr, unsigned long len
     cache_op(0x15, 16);
 }
 
+/**
+ * @brief Allocate a memory region in the data cache without fetching it
+ *
+ * This runs the "create dirty exclusive" cache operation over the region,
+ * which marks the covering cache lines valid and dirty without reading
+ * their previous contents from RDRAM. Use it on buffers that are about to
+ * be completely overwritten: write misses then skip the useless fetch of
+ * the old data, roughly halving the memory traffic of a large copy or fill.
+ *
+ * Cache lines only partially covered by the region are left untouched
+ * (their old contents would otherwise be lost), so callers need not worry
+ * about alignment; unaligned edges simply don't get the optimization.
+ *
+ * @param[in] addr
+ *            Pointer to memory in question
+ * @param[in] length
+ *            Length in bytes of the data pointed at by addr
+ */
+void data_cache_hit_create_dirty(volatile void * addr, unsigned long length)
+{
+    /* Round inwards to whole cache lines: only lines that will be fully
+       overwritten may skip the fetch */
+    void *cur = (void*)(((unsigned long)addr + 15) & ~15);
+    void *end = (void*)(((unsigned long)addr + length) & ~15);
+    while (cur < end) {
+        asm ("\tcache %0,(%1)\n"::"i" (0x0D), "r" (cur));
+        cur += 16;
+    }
+}
+
 /**
  * @brief Force a data cache index writeback invalidate over a memory region
  *
@@ -202,6 +232,49 @@ void inst_cache_invalidate_all(void)
     inst_cache_hit_invalidate(KSEG0_START_ADDR, get_memory_size());
 }
 
+/**
+ * @brief Prefetch a memory region into the instruction cache
+ *
+ * This runs the "fill" cache operation over the region, which fetches the
+ * covering cache lines from RDRAM without executing them. Use it to warm
+ * up code ahead of time, so that its first execution does not pay the
+ * instruction cache miss cost.
+ *
+ * The VR4300 instruction cache is direct-mapped and 16 KB; prefetching a
+ * region larger than that just makes its head evict its tail, and any
+ * prefetched line can still be evicted later by code mapping to the same
+ * index. Also see #HOT_CODE for keeping frequently-run code free of such
+ * conflicts.
+ *
+ * @param[in] addr
+ *            Pointer to memory in question
+ * @param[in] length
+ *            Length in bytes of the data pointed at by addr
+ */
+void inst_cache_prefetch(volatile const void * addr, unsigned long length)
+{
+    cache_op(0x14, 32);
+}
+
+/**
+ * @brief Prefetch the hot code region into the instruction cache
+ *
+ * This warms up the region where #HOT_CODE functions are gathered by the
+ * linker script, so that the first frame does not pay their compulsory
+ * instruction cache misses. Call it once at boot, after initialization
+ * code (which competes for the same cache) has run.
+ *
+ * The VR4300 cannot lock instruction cache lines, so the region is not
+ * pinned; it stays resident simply because being contiguous and smaller
+ * than the 16 KB cache, it cannot evict itself, and by construction it is
+ * the code that keeps running.
+ */
+void hot_text_prefetch(void)
+{
+    extern char __text_hot_start[], __text_hot_end[];
+    inst_cache_prefetch(__text_hot_start, __text_hot_end - __text_hot_start);
+}
+
 /**
  * @brief Allocate a buffer that will be accessed as uncached memory.
  * 
@@ -275,6 +348,107 @@ void free_uncached(void *buf)
     free(CachedAddr(buf));
 }
 
+/**
+ * @brief Allocate a DMA-visible buffer
+ *
+ * This is the #dma_buffer_t counterpart of #malloc_uncached: the returned
+ * buffer covers exclusively full cachelines and is accessed uncached by
+ * default, but because the buffer size travels with the pointer, switching
+ * to cached accesses (#dma_buffer_cached / #dma_buffer_sync) can never
+ * invalidate the wrong range.
+ *
+ * If the allocation fails, the returned buffer has a NULL pointer and zero
+ * size.
+ *
+ * @param[in]  size  The size of the buffer to allocate
+ *
+ * @return the allocated buffer
+ *
+ * @see #dma_buffer_free
+ */
+dma_buffer_t dma_buffer_alloc(size_t size)
+{
+    return dma_buffer_alloc_aligned(16, size);
+}
+
+/**
+ * @brief Allocate a DMA-visible buffer, specifying alignment
+ *
+ * Like #dma_buffer_alloc, but forces a higher alignment (eg: 64 for
+ * buffers that feed 64-byte-aligned hardware structures).
+ *
+ * @param[in]  align The alignment of the buffer in bytes
+ * @param[in]  size  The size of the buffer to allocate
+ *
+ * @return the allocated buffer
+ */
+dma_buffer_t dma_buffer_alloc_aligned(int align, size_t size)
+{
+    size = ROUND_UP(size, 16);
+    void *buf = malloc_uncached_aligned(align, size);
+    return (dma_buffer_t){ .buf = buf, .size = buf ? size : 0 };
+}
+
+/**
+ * @brief Free a DMA-visible buffer
+ *
+ * @param[in]  dmabuf  The buffer to free (reset to NULL/0 on return)
+ */
+void dma_buffer_free(dma_buffer_t *dmabuf)
+{
+    if (dmabuf->buf)
+        free_uncached(dmabuf->buf);
+    dmabuf->buf = NULL;
+    dmabuf->size = 0;
+}
+
+/**
+ * @brief Return the uncached (hardware) view of a DMA-visible buffer
+ *
+ * This is the pointer to hand to DMA engines and hardware, and to use for
+ * sparse CPU accesses. No cache maintenance is ever needed through it.
+ *
+ * @param[in]  dmabuf  The buffer
+ *
+ * @return pointer to the buffer in the uncached segment
+ */
+void *dma_buffer_uncached(const dma_buffer_t *dmabuf)
+{
+    return dmabuf->buf;
+}
+
+/**
+ * @brief Return the cached (CPU) view of a DMA-visible buffer
+ *
+ * Use this pointer for CPU-intensive processing of the buffer contents:
+ * repeated accesses go at full cache speed instead of stalling on RDRAM.
+ * Before the hardware reads or writes the buffer again, the cached view
+ * must be released with #dma_buffer_sync.
+ *
+ * @param[in]  dmabuf  The buffer
+ *
+ * @return pointer to the buffer in the cached segment
+ */
+void *dma_buffer_cached(const dma_buffer_t *dmabuf)
+{
+    return CachedAddr(dmabuf->buf);
+}
+
+/**
+ * @brief Make CPU writes through the cached view visible to the hardware
+ *
+ * Writes back and invalidates all cachelines of the buffer, so that data
+ * written through #dma_buffer_cached reaches RDRAM and no stale line can
+ * shadow a later hardware write. Always covers exactly the whole buffer,
+ * which is what removes the classic missed/short invalidate bug.
+ *
+ * @param[in]  dmabuf  The buffer
+ */
+void dma_buffer_sync(const dma_buffer_t *dmabuf)
+{
+    data_cache_hit_writeback_invalidate(CachedAddr(dmabuf->buf), dmabuf->size);
+}
+
 /**
  * @brief Get amount of available memory.
  *
@@ -0,0 +1,214 @@
+/**
+ * @file perf.c
+ * @brief Scoped performance counters and cache characterization
+ * @ingroup lowlevel
+ */
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "perf.h"
+#include "n64sys.h"
+#include "interrupt.h"
+
+/**
+ * @defgroup perf Performance counters
+ * @ingroup lowlevel
+ * @brief Exact measurement of code regions built on the COP0 count register.
+ *
+ * The VR4300 has no hardware event counters, so everything here derives
+ * from the one counter it does have: COP0 COUNT (see #TICKS_READ).
+ * Spans time a region and subtract both the measurement overhead
+ * (calibrated at first use) and the time stolen by interrupt handlers
+ * (accounted in interrupt.c, see #interrupt_total_time). Cache behavior
+ * is characterized indirectly: a region is timed warm and after a full
+ * cache invalidation, and the difference is divided by the calibrated
+ * cost of a single line miss to estimate how many lines it touches.
+ */
+
+/** @brief D-cache line size of the VR4300, in bytes */
+#define DCACHE_LINE_SIZE    16
+/** @brief I-cache line size of the VR4300, in bytes */
+#define ICACHE_LINE_SIZE    32
+/** @brief Lines of the calibration buffers (covers the whole 8 KiB D-cache) */
+#define CALIB_LINES         512
+/** @brief Empty spans timed to calibrate the measurement overhead */
+#define CALIB_SPANS         32
+
+static uint32_t span_overhead;          ///< Ticks an empty begin/end pair costs
+static bool span_calibrated = false;    ///< Overhead calibration done
+static uint32_t dmiss_ticks;            ///< Calibrated D-cache line miss cost
+static uint32_t imiss_ticks;            ///< Calibrated I-cache line miss cost
+
+/** @brief Raw begin: order matters, the tick read must come last */
+static inline void __span_begin(perf_span_t *span)
+{
+    span->start_int_ticks = interrupt_total_time();
+    span->start_ticks = TICKS_READ();
+}
+
+/** @brief Raw end: mirror of #__span_begin, the tick read comes first */
+static inline void __span_end(perf_span_t *span)
+{
+    uint32_t end = TICKS_READ();
+    span->ticks = end - span->start_ticks;
+    span->interrupt_ticks = interrupt_total_time() - span->start_int_ticks;
+}
+
+/** @brief Measure the cost of an empty span, to subtract it from real ones */
+static void __span_calibrate(void)
+{
+    perf_span_t span;
+    uint32_t best = ~0u;
+
+    disable_interrupts();
+    for (int i = 0; i < CALIB_SPANS; i++)
+    {
+        __span_begin(&span);
+        __span_end(&span);
+        /* Take the minimum: anything above it is cache or pipeline noise */
+        if (span.ticks < best)
+            best = span.ticks;
+    }
+    enable_interrupts();
+
+    span_overhead = best;
+    span_calibrated = true;
+}
+
+void perf_span_begin(perf_span_t *span)
+{
+    if (!span_calibrated)
+        __span_calibrate();
+    __span_begin(span);
+}
+
+void perf_span_end(perf_span_t *span)
+{
+    __span_end(span);
+    span->ticks = span->ticks > span_overhead ? span->ticks - span_overhead : 0;
+}
+
+/**
+ * @brief Calibrate the cost of one D-cache line miss.
+ *
+ * Reads one word per cache line across a buffer as large as the whole
+ * D-cache, once cold (after a full writeback-invalidate) and once warm;
+ * the difference divided by the line count is the per-miss cost. The
+ * warm pass cancels out the loop itself, leaving only the memory stalls.
+ */
+static void __dmiss_calibrate(void)
+{
+    volatile uint32_t *buf = malloc(CALIB_LINES * DCACHE_LINE_SIZE);
+    uint32_t cold, warm, t0;
+
+    disable_interrupts();
+
+    data_cache_writeback_invalidate_all();
+    t0 = TICKS_READ();
+    for (int i = 0; i < CALIB_LINES; i++)
+        (void)buf[i * (DCACHE_LINE_SIZE / 4)];
+    cold = TICKS_READ() - t0;
+
+    t0 = TICKS_READ();
+    for (int i = 0; i < CALIB_LINES; i++)
+        (void)buf[i * (DCACHE_LINE_SIZE / 4)];
+    warm = TICKS_READ() - t0;
+
+    enable_interrupts();
+    free((void *)buf);
+
+    dmiss_ticks = cold > warm ? (cold - warm) / CALIB_LINES : 1;
+    if (dmiss_ticks == 0)
+        dmiss_ticks = 1;
+}
+
+/**
+ * @brief Calibrate the cost of one I-cache line miss.
+ *
+ * Generates a straight-line code buffer (nops ending in `jr ra`),
+ * flushes it to memory and out of the I-cache, and times the first call
+ * against a warm second call; the difference divided by the line count
+ * is the per-miss cost.
+ */
+static void __imiss_calibrate(void)
+{
+    const int size = CALIB_LINES / 4 * ICACHE_LINE_SIZE;
+    const int words = size / 4;
+    uint32_t *raw = malloc(size + ICACHE_LINE_SIZE);
+    uint32_t *code = (uint32_t *)(((uint32_t)raw + ICACHE_LINE_SIZE - 1) & ~(ICACHE_LINE_SIZE - 1));
+    uint32_t cold, warm, t0;
+
+    for (int i = 0; i < words; i++)
+        code[i] = 0x00000000;           /* nop */
+    code[words - 2] = 0x03e00008;       /* jr ra (delay slot is the last nop) */
+
+    disable_interrupts();
+
+    data_cache_hit_writeback(code, size);
+    inst_cache_hit_invalidate(code, size);
+    void (*fn)(void) = (void (*)(void))code;
+    t0 = TICKS_READ();
+    fn();
+    cold = TICKS_READ() - t0;
+
+    t0 = TICKS_READ();
+    fn();
+    warm = TICKS_READ() - t0;
+
+    enable_interrupts();
+    free(raw);
+
+    imiss_ticks = cold > warm ? (cold - warm) / (size / ICACHE_LINE_SIZE) : 1;
+    if (imiss_ticks == 0)
+        imiss_ticks = 1;
+}
+
+uint32_t perf_dcache_miss_ticks(void)
+{
+    if (!dmiss_ticks)
+        __dmiss_calibrate();
+    return dmiss_ticks;
+}
+
+uint32_t perf_icache_miss_ticks(void)
+{
+    if (!imiss_ticks)
+        __imiss_calibrate();
+    return imiss_ticks;
+}
+
+void perf_cache_profile(void (*fn)(void *arg), void *arg, perf_cache_profile_t *out)
+{
+    uint32_t t0;
+
+    /* Calibrate outside the measurement window */
+    uint32_t dmiss = perf_dcache_miss_ticks();
+    uint32_t imiss = perf_icache_miss_ticks();
+
+    disable_interrupts();
+
+    /* Warm everything up, then time the steady state */
+    fn(arg);
+    t0 = TICKS_READ();
+    fn(arg);
+    out->warm_ticks = TICKS_READ() - t0;
+
+    /* Cold data cache: every line the region touches must be refetched */
+    data_cache_writeback_invalidate_all();
+    t0 = TICKS_READ();
+    fn(arg);
+    out->cold_d_ticks = TICKS_READ() - t0;
+
+    /* Cold instruction cache: every line the region executes must be refetched */
+    inst_cache_invalidate_all();
+    t0 = TICKS_READ();
+    fn(arg);
+    out->cold_i_ticks = TICKS_READ() - t0;
+
+    enable_interrupts();
+
+    out->est_dcache_lines = out->cold_d_ticks > out->warm_ticks
+        ? (out->cold_d_ticks - out->warm_ticks) / dmiss : 0;
+    out->est_icache_lines = out->cold_i_ticks > out->warm_ticks
+        ? (out->cold_i_ticks - out->warm_ticks) / imiss : 0;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file profiler.c
+ * @brief CPU sampling profiler
+ * @ingroup lowlevel
+ *
+ * The profiler piggybacks on the timer subsystem: a continuous timer
+ * fires at the configured rate, and its callback (which runs within the
+ * interrupt handler, with the interrupted state still in COP0) reads the
+ * EPC register to learn which instruction was executing when the
+ * interrupt hit. The program counters are accumulated into a ring
+ * buffer, and aggregated only at dump time, so the per-sample cost is a
+ * handful of instructions.
+ *
+ * Samples are attributed to functions with the same SYMT symbol table
+ * used by exception backtraces (see backtrace.c), generated by the
+ * n64sym tool. Symbol lookups hit the cartridge via PI, so they are
+ * performed exclusively at dump time, never in the sampling hot path.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+#include "timer.h"
+#include "cop0.h"
+#include "debug.h"
+#include "n64sys.h"
+#include "interrupt.h"
+#include "utils.h"
+#include "backtrace_internal.h"
+
+/** @brief Maximum number of distinct functions tracked by #profiler_dump */
+#define PROFILER_MAX_FUNCS      64
+/** @brief Maximum length of a function name in the flat profile */
+#define PROFILER_NAME_LEN       56
+
+/** @brief Ring buffer of sampled program counters */
+static uint32_t *sample_ring = NULL;
+/** @brief Capacity of the sample ring */
+static int ring_size = 0;
+/** @brief Next write position in the ring */
+static volatile int ring_head = 0;
+/** @brief Total number of samples recorded (may exceed #ring_size) */
+static volatile uint32_t total_samples = 0;
+/** @brief The sampling timer */
+static timer_link_t *sample_timer = NULL;
+/** @brief Configured sampling frequency */
+static int sample_hz = 0;
+/** @brief True while the sampling timer is running */
+static bool sampling = false;
+
+/** @brief One row of the aggregated flat profile */
+typedef struct {
+    char name[PROFILER_NAME_LEN];   ///< Function name (or raw address)
+    uint32_t hits;                  ///< Number of samples in this function
+} profile_row_t;
+
+/**
+ * @brief Timer callback: record one PC sample.
+ *
+ * This runs from the interrupt handler, before the interrupted context
+ * is restored, so COP0 EPC still holds the address at which the
+ * interrupt occurred.
+ */
+static void __profiler_sample(int ovfl)
+{
+    sample_ring[ring_head] = C0_EPC();
+    ring_head = (ring_head + 1 == ring_size) ? 0 : ring_head + 1;
+    total_samples++;
+}
+
+void profiler_init(int hz, int max_samples)
+{
+    assertf(sample_ring == NULL, "profiler_init called twice");
+    assertf(hz >= 1 && hz <= 10000, "invalid sampling frequency: %d", hz);
+    assertf(max_samples > 0, "invalid sample buffer capacity: %d", max_samples);
+
+    sample_ring = malloc(max_samples * sizeof(uint32_t));
+    assertf(sample_ring != NULL, "out of memory");
+    ring_size = max_samples;
+    ring_head = 0;
+    total_samples = 0;
+    sample_hz = hz;
+
+    sample_timer = new_timer(TICKS_PER_SECOND / hz, TF_CONTINUOUS, __profiler_sample);
+    assertf(sample_timer != NULL, "profiler requires timer_init");
+    sampling = true;
+}
+
+void profiler_close(void)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+    delete_timer(sample_timer);
+    sample_timer = NULL;
+    sampling = false;
+    free(sample_ring);
+    sample_ring = NULL;
+    ring_size = 0;
+}
+
+void profiler_pause(void)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+    if (sampling) {
+        stop_timer(sample_timer);
+        sampling = false;
+    }
+}
+
+void profiler_resume(void)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+    if (!sampling) {
+        restart_timer(sample_timer);
+        sampling = true;
+    }
+}
+
+void profiler_reset(void)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+    disable_interrupts();
+    ring_head = 0;
+    total_samples = 0;
+    enable_interrupts();
+}
+
+uint32_t profiler_sample_count(void)
+{
+    return total_samples;
+}
+
+/** @brief qsort comparator for raw PC values */
+static int __pc_cmp(const void *a, const void *b)
+{
+    uint32_t pa = *(const uint32_t*)a, pb = *(const uint32_t*)b;
+    return (pa > pb) - (pa < pb);
+}
+
+/** @brief qsort comparator for profile rows (descending hit count) */
+static int __row_cmp(const void *a, const void *b)
+{
+    const profile_row_t *ra = a, *rb = b;
+    return (ra->hits < rb->hits) - (ra->hits > rb->hits);
+}
+
+void profiler_dump(int max_rows)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+
+    bool was_sampling = sampling;
+    profiler_pause();
+
+    int n = MIN(total_samples, (uint32_t)ring_size);
+    if (n == 0) {
+        debugf("profiler: no samples recorded\n");
+        if (was_sampling) profiler_resume();
+        return;
+    }
+
+    /* Sort a copy of the samples so that identical and adjacent PCs
+       (which usually belong to the same function) cluster together,
+       minimizing the number of symbol lookups. */
+    uint32_t *pcs = malloc(n * sizeof(uint32_t));
+    assertf(pcs != NULL, "out of memory");
+    memcpy(pcs, sample_ring, n * sizeof(uint32_t));
+    qsort(pcs, n, sizeof(uint32_t), __pc_cmp);
+
+    profile_row_t *rows = calloc(PROFILER_MAX_FUNCS, sizeof(profile_row_t));
+    assertf(rows != NULL, "out of memory");
+    int num_rows = 0;
+    uint32_t other_hits = 0;
+
+    char sym[PROFILER_NAME_LEN + 16];
+    char cur_name[PROFILER_NAME_LEN] = "";
+    int cur_row = -1;
+
+    for (int i = 0; i < n; i++) {
+        /* Runs of the same PC resolve to the same function for sure */
+        if (i > 0 && pcs[i] == pcs[i-1]) {
+            if (cur_row >= 0) rows[cur_row].hits++;
+            else other_hits++;
+            continue;
+        }
+
+        __symbolize((void*)pcs[i], sym, sizeof(sym));
+        /* Strip the "+0x..." offset: we aggregate per function */
+        char *plus = strrchr(sym, '+');
+        if (plus) *plus = '\0';
+
+        if (cur_row < 0 || strcmp(sym, cur_name) != 0) {
+            strlcpy(cur_name, sym, sizeof(cur_name));
+            cur_row = -1;
+            for (int j = 0; j < num_rows; j++) {
+                if (strcmp(rows[j].name, cur_name) == 0) {
+                    cur_row = j;
+                    break;
+                }
+            }
+            if (cur_row < 0 && num_rows < PROFILER_MAX_FUNCS) {
+                cur_row = num_rows++;
+                strlcpy(rows[cur_row].name, cur_name, PROFILER_NAME_LEN);
+            }
+        }
+
+        if (cur_row >= 0) rows[cur_row].hits++;
+        else other_hits++;
+    }
+
+    qsort(rows, num_rows, sizeof(profile_row_t), __row_cmp);
+
+    debugf("Sampling profile: %lu samples @ %d Hz (%d in buffer)\n",
+        (unsigned long)total_samples, sample_hz, n);
+    if (max_rows <= 0 || max_rows > num_rows) max_rows = num_rows;
+    for (int i = 0; i < max_rows; i++) {
+        uint32_t permille = rows[i].hits * 1000 / n;
+        debugf("  %3lu.%lu%%  %8lu  %s\n", permille / 10, permille % 10,
+            (unsigned long)rows[i].hits, rows[i].name);
+    }
+    if (other_hits) {
+        uint32_t permille = other_hits * 1000 / n;
+        debugf("  %3lu.%lu%%  %8lu  <other>\n", permille / 10, permille % 10,
+            (unsigned long)other_hits);
+    }
+
+    free(rows);
+    free(pcs);
+    if (was_sampling) profiler_resume();
+}
+
+void profiler_dump_raw(void)
+{
+    assertf(sample_ring != NULL, "profiler not initialized");
+
+    bool was_sampling = sampling;
+    profiler_pause();
+
+    int n = MIN(total_samples, (uint32_t)ring_size);
+    debugf("PROFILER-RAW-BEGIN %d %d\n", n, sample_hz);
+    for (int i = 0; i < n; i++)
+        debugf("%08lx%c", (unsigned long)sample_ring[i], (i % 8 == 7 || i == n-1) ? '\n' : ' ');
+    debugf("PROFILER-RAW-END\n");
+
+    if (was_sampling) profiler_resume();
+}
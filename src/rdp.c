@@ -4,6 +4,7 @@
  * @ingroup rdp
  */
 #include <stdint.h>
+#include <stdlib.h>
 #include <malloc.h>
 #include <string.h>
 #include "libdragon.h"
@@ -54,12 +55,15 @@
 /** @brief Size of the internal ringbuffer that holds pending RDP commands */
 #define RINGBUFFER_SIZE  4096
 
-/** 
+/** @brief Size of RDP texture memory in bytes */
+#define TMEM_SIZE        4096
+
+/**
  * @brief Size of the slack are of the ring buffer
  *
  * Data can be written into the slack area of the ring buffer by functions creating RDP commands.
  * However, when sending a completed command to the RDP, if the buffer has advanced into the slack,
- * it will be cleared and the pointer reset to start.  This is to stop any commands from being
+ * the module switches to the other command bank.  This is to stop any commands from being
  * split in the middle during wraparound.
  */
 #define RINGBUFFER_SLACK 1024
@@ -81,24 +85,262 @@ typedef struct
     uint16_t real_width;
     /** @brief Height of the texture rounded up to next power of 2 */
     uint16_t real_height;
+    /** @brief Sprite whose data is currently resident in this slot (NULL if unknown) */
+    sprite_t *sprite;
+    /** @brief TMEM offset the texture was loaded at */
+    uint32_t texloc;
+    /** @brief Amount of TMEM in bytes consumed by the texture */
+    uint32_t tmem_size;
+    /** @brief S location in the sprite of the region that was loaded */
+    uint32_t key_s;
+    /** @brief T location in the sprite of the region that was loaded */
+    uint32_t key_t;
+    /** @brief Mirror setting the texture was loaded with */
+    mirror_t mirror;
+    /** @brief True if the texture was loaded with a block transfer */
+    bool block;
 } sprite_cache;
 
-/** @brief Ringbuffer where partially assembled commands will be placed before sending to the RDP */
-static uint32_t rdp_ringbuffer[RINGBUFFER_SIZE / 4];
-/** @brief Start of the command in the ringbuffer */
+/**
+ * @brief Double-buffered command memory where assembled commands are placed before sending to the RDP
+ *
+ * While the RDP consumes commands submitted from one bank, the CPU keeps
+ * assembling new commands into the other bank, so command building and
+ * rasterization overlap instead of serializing on the DP busy state.
+ */
+static uint32_t rdp_ringbuffer[2][RINGBUFFER_SIZE / 4];
+/** @brief Bank of #rdp_ringbuffer that commands are currently assembled into */
+static int rdp_bank = 0;
+/** @brief Start of the commands not yet submitted to the RDP in the active bank */
 static uint32_t rdp_start = 0;
-/** @brief End of the command in the ringbuffer */
+/** @brief End of the commands not yet submitted to the RDP in the active bank */
 static uint32_t rdp_end = 0;
 
 /** @brief The current cache flushing strategy */
 static flush_t flush_strategy = FLUSH_STRATEGY_AUTOMATIC;
 
+/** @brief True if the RDP is in a one cycle texture mode rather than copy mode */
+static bool texture_1cycle = false;
+
+/** @brief Width in pixels of the currently attached surface (0 if none) */
+static uint32_t attach_width = 0;
+/** @brief Height in pixels of the currently attached surface (0 if none) */
+static uint32_t attach_height = 0;
+
 /** @brief Interrupt wait flag */
 static volatile uint32_t wait_intr = 0;
 
+/** @brief Callback to invoke from the DP interrupt when an async detach completes */
+static void (*detach_callback)( void *arg ) = NULL;
+/** @brief Argument to pass to #detach_callback */
+static void *detach_arg = NULL;
+
 /** @brief Array of cached textures in RDP TMEM indexed by the RDP texture slot */
 static sprite_cache cache[8];
 
+/** @brief Number of texture loads skipped because the texture was already resident */
+static uint32_t tmem_hits = 0;
+/** @brief Number of texture loads that actually transferred data into TMEM */
+static uint32_t tmem_misses = 0;
+
+/** @brief Palette currently resident in the RDP color lookup table (NULL if unknown) */
+static uint16_t *tlut_palette = NULL;
+
+/** @brief Number of colors of #tlut_palette */
+static int tlut_colors = 0;
+
+/** @brief True if the last loaded texture samples through the color lookup table */
+static bool tlut_active = false;
+
+/** @brief Render state groups tracked by the deferred state machinery */
+enum
+{
+    /** @brief Set Other Modes command pair */
+    RDP_DIRTY_MODES       = (1 << 0),
+    /** @brief Set Combine Mode command pair */
+    RDP_DIRTY_COMBINE     = (1 << 1),
+    /** @brief Set Convert command pair */
+    RDP_DIRTY_CONVERT     = (1 << 2),
+    /** @brief Set Fill Color payload */
+    RDP_DIRTY_PRIM_COLOR  = (1 << 3),
+    /** @brief Set Blend Color payload */
+    RDP_DIRTY_BLEND_COLOR = (1 << 4),
+    /** @brief Set Fog Color payload */
+    RDP_DIRTY_FOG_COLOR   = (1 << 5),
+    /** @brief Set Primitive Depth payload */
+    RDP_DIRTY_PRIM_DEPTH  = (1 << 6),
+};
+
+/**
+ * @brief Shadowed render state
+ *
+ * Render state setters do not emit commands: they record the requested
+ * state here, and #__rdp_flush_state emits it right before the next
+ * primitive is drawn. Holding two copies (the pending state requested by
+ * the setters, and a shadow of what the RDP last received) allows the
+ * flush to drop commands that would program the state the RDP already
+ * holds: callers can then set the full render state per primitive out of
+ * convenience, without flooding the RDP with redundant mode changes.
+ */
+typedef struct
+{
+    /** @brief Set Other Modes command words */
+    uint32_t other_modes[2];
+    /** @brief Set Combine Mode command words */
+    uint32_t combine[2];
+    /** @brief Set Convert command words */
+    uint32_t convert[2];
+    /** @brief Set Fill Color payload word */
+    uint32_t prim_color;
+    /** @brief Set Blend Color payload word */
+    uint32_t blend_color;
+    /** @brief Set Fog Color payload word */
+    uint32_t fog_color;
+    /** @brief Set Primitive Depth payload word */
+    uint32_t prim_depth;
+} rdp_render_state_t;
+
+/** @brief Render state requested by the setters, not yet emitted */
+static rdp_render_state_t state_pending;
+/** @brief Render state last emitted to the RDP */
+static rdp_render_state_t state_shadow;
+/** @brief Groups of #state_pending modified since the last flush */
+static uint32_t state_dirty = 0;
+/** @brief Groups of #state_shadow that reflect commands actually emitted */
+static uint32_t state_valid = 0;
+/** @brief True if a primitive was drawn since the last pipeline sync */
+static bool mode_sync_needed = false;
+
+static void __rdp_ringbuffer_queue( uint32_t data );
+static void __rdp_ringbuffer_send( void );
+
+/**
+ * @brief Emit the pending render state before drawing a primitive
+ *
+ * Every draw function calls this before queuing its primitive. Dirty state
+ * groups whose value matches the shadow of what the RDP already holds are
+ * dropped; the remaining ones are emitted back to back, preceded by a
+ * single pipeline sync if any primitive was rasterized since the last
+ * mode change (the RDP requires in-flight primitives to complete before
+ * the state feeding them is reprogrammed).
+ */
+static void __rdp_flush_state( void )
+{
+    /* Drop pending changes that match what the RDP already holds */
+    uint32_t emit = state_dirty;
+    state_dirty = 0;
+
+    /* Whether texels index the color lookup table is a property of the
+       loaded texture, not of the render mode the caller picked: fold the
+       bit into the mode words here so both stay oblivious of each other */
+    uint32_t modes0 = state_pending.other_modes[0] | (tlut_active ? 0x8000 : 0);
+
+    if( (emit & RDP_DIRTY_MODES) && (state_valid & RDP_DIRTY_MODES) &&
+        state_shadow.other_modes[0] == modes0 &&
+        state_shadow.other_modes[1] == state_pending.other_modes[1] )
+    {
+        emit &= ~RDP_DIRTY_MODES;
+    }
+    if( (emit & RDP_DIRTY_COMBINE) && (state_valid & RDP_DIRTY_COMBINE) &&
+        state_shadow.combine[0] == state_pending.combine[0] &&
+        state_shadow.combine[1] == state_pending.combine[1] )
+    {
+        emit &= ~RDP_DIRTY_COMBINE;
+    }
+    if( (emit & RDP_DIRTY_CONVERT) && (state_valid & RDP_DIRTY_CONVERT) &&
+        state_shadow.convert[0] == state_pending.convert[0] &&
+        state_shadow.convert[1] == state_pending.convert[1] )
+    {
+        emit &= ~RDP_DIRTY_CONVERT;
+    }
+    if( (emit & RDP_DIRTY_PRIM_COLOR) && (state_valid & RDP_DIRTY_PRIM_COLOR) &&
+        state_shadow.prim_color == state_pending.prim_color )
+    {
+        emit &= ~RDP_DIRTY_PRIM_COLOR;
+    }
+    if( (emit & RDP_DIRTY_BLEND_COLOR) && (state_valid & RDP_DIRTY_BLEND_COLOR) &&
+        state_shadow.blend_color == state_pending.blend_color )
+    {
+        emit &= ~RDP_DIRTY_BLEND_COLOR;
+    }
+    if( (emit & RDP_DIRTY_FOG_COLOR) && (state_valid & RDP_DIRTY_FOG_COLOR) &&
+        state_shadow.fog_color == state_pending.fog_color )
+    {
+        emit &= ~RDP_DIRTY_FOG_COLOR;
+    }
+    if( (emit & RDP_DIRTY_PRIM_DEPTH) && (state_valid & RDP_DIRTY_PRIM_DEPTH) &&
+        state_shadow.prim_depth == state_pending.prim_depth )
+    {
+        emit &= ~RDP_DIRTY_PRIM_DEPTH;
+    }
+
+    if( !emit ) { return; }
+
+    /* A single pipeline sync covers all the merged state changes */
+    if( mode_sync_needed )
+    {
+        __rdp_ringbuffer_queue( 0xE7000000 );
+        __rdp_ringbuffer_queue( 0x00000000 );
+        __rdp_ringbuffer_send();
+        mode_sync_needed = false;
+    }
+
+    if( emit & RDP_DIRTY_CONVERT )
+    {
+        __rdp_ringbuffer_queue( state_pending.convert[0] );
+        __rdp_ringbuffer_queue( state_pending.convert[1] );
+        __rdp_ringbuffer_send();
+        state_shadow.convert[0] = state_pending.convert[0];
+        state_shadow.convert[1] = state_pending.convert[1];
+    }
+    if( emit & RDP_DIRTY_COMBINE )
+    {
+        __rdp_ringbuffer_queue( state_pending.combine[0] );
+        __rdp_ringbuffer_queue( state_pending.combine[1] );
+        __rdp_ringbuffer_send();
+        state_shadow.combine[0] = state_pending.combine[0];
+        state_shadow.combine[1] = state_pending.combine[1];
+    }
+    if( emit & RDP_DIRTY_MODES )
+    {
+        __rdp_ringbuffer_queue( modes0 );
+        __rdp_ringbuffer_queue( state_pending.other_modes[1] );
+        __rdp_ringbuffer_send();
+        state_shadow.other_modes[0] = modes0;
+        state_shadow.other_modes[1] = state_pending.other_modes[1];
+    }
+    if( emit & RDP_DIRTY_PRIM_COLOR )
+    {
+        __rdp_ringbuffer_queue( 0xF7000000 );
+        __rdp_ringbuffer_queue( state_pending.prim_color );
+        __rdp_ringbuffer_send();
+        state_shadow.prim_color = state_pending.prim_color;
+    }
+    if( emit & RDP_DIRTY_BLEND_COLOR )
+    {
+        __rdp_ringbuffer_queue( 0xF9000000 );
+        __rdp_ringbuffer_queue( state_pending.blend_color );
+        __rdp_ringbuffer_send();
+        state_shadow.blend_color = state_pending.blend_color;
+    }
+    if( emit & RDP_DIRTY_FOG_COLOR )
+    {
+        __rdp_ringbuffer_queue( 0xF8000000 );
+        __rdp_ringbuffer_queue( state_pending.fog_color );
+        __rdp_ringbuffer_send();
+        state_shadow.fog_color = state_pending.fog_color;
+    }
+    if( emit & RDP_DIRTY_PRIM_DEPTH )
+    {
+        __rdp_ringbuffer_queue( 0xEE000000 );
+        __rdp_ringbuffer_queue( state_pending.prim_depth );
+        __rdp_ringbuffer_send();
+        state_shadow.prim_depth = state_pending.prim_depth;
+    }
+
+    state_valid |= emit;
+}
+
 /**
  * @brief RDP interrupt handler
  *
@@ -109,6 +351,14 @@ static void __rdp_interrupt()
 {
     /* Flag that the interrupt happened */
     wait_intr++;
+
+    /* Complete a pending asynchronous detach */
+    if( detach_callback )
+    {
+        void (*callback)( void *arg ) = detach_callback;
+        detach_callback = NULL;
+        callback( detach_arg );
+    }
 }
 
 /**
@@ -163,9 +413,64 @@ static inline uint32_t __rdp_log2( uint32_t number )
 }
 
 /**
- * @brief Return the size of the current command buffered in the ring buffer
+ * @brief Check whether a texture region is already resident in a texture slot
+ *
+ * Compares the load parameters against what was last loaded into the slot.
+ * If they match, the load can be skipped entirely as TMEM already holds the
+ * right data.  Note that the tracker keys on the sprite pointer: if sprite
+ * data is modified in place, call #rdp_tmem_invalidate to force a reload.
+ *
+ * @return True if the slot already holds this exact texture region
+ */
+static bool __rdp_tmem_resident( uint32_t texslot, uint32_t texloc, mirror_t mirror, bool block, sprite_t *sprite, int sl, int tl, int sh, int th )
+{
+    sprite_cache *slot = &cache[texslot & 0x7];
+
+    return slot->sprite == sprite &&
+           slot->texloc == texloc &&
+           slot->mirror == mirror &&
+           slot->block == block &&
+           slot->key_s == sl &&
+           slot->key_t == tl &&
+           slot->width == sh - sl &&
+           slot->height == th - tl;
+}
+
+/**
+ * @brief Record a completed texture load in the residency tracker
+ *
+ * Marks the given slot as holding the texture region, and evicts any other
+ * slot whose TMEM range overlaps the newly loaded one, since its data has
+ * just been overwritten.
+ */
+static void __rdp_tmem_mark_resident( uint32_t texslot, uint32_t texloc, uint32_t tmem_size, mirror_t mirror, bool block, sprite_t *sprite, int sl, int tl )
+{
+    sprite_cache *slot = &cache[texslot & 0x7];
+
+    for( int i = 0; i < 8; i++ )
+    {
+        if( i == (texslot & 0x7) || !cache[i].sprite ) { continue; }
+
+        /* Evict slots whose TMEM range overlaps the new texture */
+        if( texloc < cache[i].texloc + cache[i].tmem_size && cache[i].texloc < texloc + tmem_size )
+        {
+            cache[i].sprite = NULL;
+        }
+    }
+
+    slot->sprite = sprite;
+    slot->texloc = texloc;
+    slot->tmem_size = tmem_size;
+    slot->mirror = mirror;
+    slot->block = block;
+    slot->key_s = sl;
+    slot->key_t = tl;
+}
+
+/**
+ * @brief Return the size of the commands buffered in the ring buffer
  *
- * @return The size of the command in bytes
+ * @return The size of the pending commands in bytes
  */
 static inline uint32_t __rdp_ringbuffer_size( void )
 {
@@ -173,6 +478,16 @@ static inline uint32_t __rdp_ringbuffer_size( void )
     return rdp_end - rdp_start;
 }
 
+/**
+ * @brief Check whether the RDP is still consuming previously submitted commands
+ *
+ * @return True if a command DMA transfer is still in progress
+ */
+static inline bool __rdp_dp_busy( void )
+{
+    return (((volatile uint32_t *)0xA4100000)[3] & 0x600) != 0;
+}
+
 /**
  * @brief Queue 32 bits of a command to the ring buffer
  *
@@ -182,32 +497,24 @@ static inline uint32_t __rdp_ringbuffer_size( void )
 static void __rdp_ringbuffer_queue( uint32_t data )
 {
     /* Only add commands if we have room */
-    if( __rdp_ringbuffer_size() + sizeof(uint32_t) >= RINGBUFFER_SIZE ) { return; }
+    if( rdp_end + sizeof(uint32_t) >= RINGBUFFER_SIZE ) { return; }
 
     /* Add data to queue to be sent to RDP */
-    rdp_ringbuffer[rdp_end / 4] = data;
+    rdp_ringbuffer[rdp_bank][rdp_end / 4] = data;
     rdp_end += 4;
 }
 
 /**
- * @brief Send a completed command to the RDP that is queued in the ring buffer
+ * @brief Submit all pending commands in the active bank to the RDP
  *
- * Given a validly constructred command in the ring buffer, this command will prepare the
- * memory region in the ring buffer to be sent to the RDP and then start a DMA transfer,
- * kicking off execution of the command in the RDP.  After calling this function, it is
- * safe to start writing to the ring buffer again.
+ * Kicks off a DMA transfer of everything queued since the last submission.
+ * The caller must have verified that the RDP is not consuming a previous
+ * transfer.  If the submission advanced into the slack area, command
+ * assembly switches to the other bank; its contents are guaranteed to have
+ * been consumed already, since submissions only happen when the RDP is idle.
  */
-static void __rdp_ringbuffer_send( void )
+static void __rdp_ringbuffer_submit( void )
 {
-    /* Don't send nothingness */
-    if( __rdp_ringbuffer_size() == 0 ) { return; }
-
-    /* Ensure the cache is fixed up */
-    data_cache_hit_writeback_invalidate(&rdp_ringbuffer[rdp_start / 4], __rdp_ringbuffer_size());
-    
-    /* Best effort to be sure we can write once we disable interrupts */
-    while( (((volatile uint32_t *)0xA4100000)[3] & 0x600) ) ;
-
     /* Make sure another thread doesn't attempt to render */
     disable_interrupts();
 
@@ -218,13 +525,13 @@ static void __rdp_ringbuffer_send( void )
     /* Don't saturate the RDP command buffer.  Another command could have been written
      * since we checked before disabling interrupts, but it is unlikely, so we probably
      * won't stall in this critical section long. */
-    while( (((volatile uint32_t *)0xA4100000)[3] & 0x600) ) ;
+    while( __rdp_dp_busy() ) ;
 
     /* Send start and end of buffer location to kick off the command transfer */
     MEMORY_BARRIER();
-    ((volatile uint32_t *)0xA4100000)[0] = ((uint32_t)rdp_ringbuffer | 0xA0000000) + rdp_start;
+    ((volatile uint32_t *)0xA4100000)[0] = ((uint32_t)rdp_ringbuffer[rdp_bank] | 0xA0000000) + rdp_start;
     MEMORY_BARRIER();
-    ((volatile uint32_t *)0xA4100000)[1] = ((uint32_t)rdp_ringbuffer | 0xA0000000) + rdp_end;
+    ((volatile uint32_t *)0xA4100000)[1] = ((uint32_t)rdp_ringbuffer[rdp_bank] | 0xA0000000) + rdp_end;
     MEMORY_BARRIER();
 
     /* We are good now */
@@ -233,7 +540,8 @@ static void __rdp_ringbuffer_send( void )
     /* Commands themselves can't wrap around */
     if( rdp_end > (RINGBUFFER_SIZE - RINGBUFFER_SLACK) )
     {
-        /* Wrap around before a command can be split */
+        /* Switch banks before a command can be split */
+        rdp_bank ^= 1;
         rdp_start = 0;
         rdp_end = 0;
     }
@@ -244,6 +552,59 @@ static void __rdp_ringbuffer_send( void )
     }
 }
 
+/**
+ * @brief Send a completed command to the RDP that is queued in the ring buffer
+ *
+ * Given a validly constructed command in the ring buffer, this function submits
+ * all pending commands to the RDP if it is ready to receive them.  If the RDP is
+ * still consuming a previous transfer, the command is left buffered and will be
+ * submitted together with later commands, so the CPU keeps assembling commands
+ * instead of spin-waiting on the DP busy state.  After calling this function, it
+ * is safe to start writing to the ring buffer again.
+ */
+static void __rdp_ringbuffer_send( void )
+{
+    /* Don't send nothingness */
+    if( __rdp_ringbuffer_size() == 0 ) { return; }
+
+    /* Ensure the cache is fixed up */
+    data_cache_hit_writeback_invalidate(&rdp_ringbuffer[rdp_bank][rdp_start / 4], __rdp_ringbuffer_size());
+
+    if( __rdp_dp_busy() )
+    {
+        /* The RDP is still consuming a previous submission.  Leave the commands
+           buffered unless the bank is running out of room, in which case we have
+           no choice but to wait for the RDP to catch up. */
+        if( rdp_end <= (RINGBUFFER_SIZE - RINGBUFFER_SLACK) ) { return; }
+
+        while( __rdp_dp_busy() ) ;
+    }
+
+    __rdp_ringbuffer_submit();
+}
+
+/**
+ * @brief Force submission of any commands still buffered in the ring buffer
+ *
+ * Commands deferred by #__rdp_ringbuffer_send because the RDP was busy are
+ * normally submitted together with a later command.  Call this before waiting
+ * on RDP completion to guarantee that everything queued so far (in particular
+ * a trailing #SYNC_FULL) actually reaches the RDP.
+ */
+static void __rdp_ringbuffer_flush( void )
+{
+    /* Nothing pending means nothing to do */
+    if( __rdp_ringbuffer_size() == 0 ) { return; }
+
+    /* Ensure the cache is fixed up */
+    data_cache_hit_writeback_invalidate(&rdp_ringbuffer[rdp_bank][rdp_start / 4], __rdp_ringbuffer_size());
+
+    /* Wait for the previous submission to be consumed */
+    while( __rdp_dp_busy() ) ;
+
+    __rdp_ringbuffer_submit();
+}
+
 /**
  * @brief Initialize the RDP system
  */
@@ -253,8 +614,21 @@ void rdp_init( void )
     flush_strategy = FLUSH_STRATEGY_AUTOMATIC;
 
     /* Set the ringbuffer up */
+    rdp_bank = 0;
     rdp_start = 0;
     rdp_end = 0;
+    detach_callback = NULL;
+
+    /* Reset the TMEM residency tracker */
+    rdp_tmem_invalidate();
+    tmem_hits = 0;
+    tmem_misses = 0;
+
+    /* Reset the deferred render state: nothing pending, shadow unknown */
+    state_dirty = 0;
+    state_valid = 0;
+    mode_sync_needed = false;
+    tlut_active = false;
 
     /* Set up interrupt for SYNC_FULL */
     register_DP_handler( __rdp_interrupt );
@@ -298,6 +672,38 @@ void rdp_attach( surface_t* surface )
     __rdp_ringbuffer_queue( 0xFF000000 | ((TEX_FORMAT_BITDEPTH(surface_get_format(surface)) == 16) ? 0x00100000 : 0x00180000) | (surface->width - 1) );
     __rdp_ringbuffer_queue( PhysicalAddr(surface->buffer) );
     __rdp_ringbuffer_send();
+
+    /* Remember the surface size for full-surface operations (see #rdp_post_tint) */
+    attach_width = surface->width;
+    attach_height = surface->height;
+}
+
+/**
+ * @brief Attach the RDP to a Z-buffer surface
+ *
+ * After this call, primitives drawn in a Z-buffered render mode (see
+ * #rdp_enable_blend_fill_zbuffer and #rdp_enable_texture_zbuffer) are
+ * depth-compared against the Z-buffer and only drawn where they are closer
+ * than what is already on screen, removing the need to sort primitives on
+ * the CPU.
+ *
+ * The Z-buffer must be a 16 bpp surface with the same size as the color
+ * surface, normally allocated with #surface_alloc_zbuffer. To clear it at
+ * the start of a frame, attach it as the color surface with #rdp_attach,
+ * set the fill color to 0xFFFCFFFC (two packed far-plane depth values) and
+ * draw a filled rectangle over it in primitive fill mode.
+ *
+ * @param[in] zbuffer
+ *            A surface pointer to use as the Z-buffer
+ */
+void rdp_attach_zbuffer( surface_t* zbuffer )
+{
+    if( zbuffer == 0 ) { return; }
+
+    /* Set the Z image */
+    __rdp_ringbuffer_queue( 0xFE000000 );
+    __rdp_ringbuffer_queue( PhysicalAddr(zbuffer->buffer) );
+    __rdp_ringbuffer_send();
 }
 
 /**
@@ -316,6 +722,7 @@ void rdp_detach( void )
 
     /* Force the RDP to rasterize everything and then interrupt us */
     rdp_sync( SYNC_FULL );
+    __rdp_ringbuffer_flush();
 
     if( INTERRUPTS_ENABLED == get_interrupts_state() )
     {
@@ -327,6 +734,40 @@ void rdp_detach( void )
     wait_intr = 0;
 }
 
+/**
+ * @brief Detach the RDP from the current surface without blocking
+ *
+ * Asynchronous version of #rdp_detach: instead of spin-waiting for the RDP
+ * to finish rasterizing, this function queues a #SYNC_FULL and returns
+ * immediately.  The callback is invoked from the DP interrupt handler once
+ * the RDP has finished writing to the surface, at which point it is safe to
+ * show it with #display_show or to reuse it with software rendering.
+ *
+ * Since the callback runs in interrupt context, it should do as little work
+ * as possible, typically just calling #display_show or flagging the frame
+ * as complete.  Only one asynchronous detach can be in flight at a time.
+ *
+ * @note This function requires interrupts to be enabled to operate properly.
+ *
+ * @param[in] callback
+ *            Function to invoke when the RDP has finished with the surface
+ * @param[in] arg
+ *            Argument passed to the callback
+ */
+void rdp_detach_async( void (*callback)( void *arg ), void *arg )
+{
+    assertf( !detach_callback, "rdp_detach_async called while a detach is already pending" );
+
+    /* Arm the callback before issuing the sync, as the interrupt could
+       fire before this function returns */
+    detach_arg = arg;
+    detach_callback = callback;
+
+    /* Force the RDP to rasterize everything and then interrupt us */
+    rdp_sync( SYNC_FULL );
+    __rdp_ringbuffer_flush();
+}
+
 /**
  * @brief Perform a sync operation
  *
@@ -359,6 +800,10 @@ void rdp_sync( sync_t sync )
     }
     __rdp_ringbuffer_queue( 0x00000000 );
     __rdp_ringbuffer_send();
+
+    /* An explicit sync also covers the one a deferred mode change would
+       need (see #__rdp_flush_state) */
+    if( sync == SYNC_FULL || sync == SYNC_PIPE ) { mode_sync_needed = false; }
 }
 
 /**
@@ -398,9 +843,9 @@ void rdp_set_default_clipping( void )
 void rdp_enable_primitive_fill( void )
 {
     /* Set other modes to fill and other defaults */
-    __rdp_ringbuffer_queue( 0xEFB000FF );
-    __rdp_ringbuffer_queue( 0x00004000 );
-    __rdp_ringbuffer_send();
+    state_pending.other_modes[0] = 0xEFB000FF;
+    state_pending.other_modes[1] = 0x00004000;
+    state_dirty |= RDP_DIRTY_MODES;
 }
 
 /**
@@ -410,9 +855,9 @@ void rdp_enable_primitive_fill( void )
  */
 void rdp_enable_blend_fill( void )
 {
-    __rdp_ringbuffer_queue( 0xEF0000FF );
-    __rdp_ringbuffer_queue( 0x80000000 );
-    __rdp_ringbuffer_send();
+    state_pending.other_modes[0] = 0xEF0000FF;
+    state_pending.other_modes[1] = 0x80000000;
+    state_dirty |= RDP_DIRTY_MODES;
 }
 
 /**
@@ -424,17 +869,149 @@ void rdp_enable_blend_fill( void )
 void rdp_enable_texture_copy( void )
 {
     /* Set other modes to copy and other defaults */
-    __rdp_ringbuffer_queue( 0xEFA000FF );
-    __rdp_ringbuffer_queue( 0x00004001 );
-    __rdp_ringbuffer_send();
+    state_pending.other_modes[0] = 0xEFA000FF;
+    state_pending.other_modes[1] = 0x00004001;
+    state_dirty |= RDP_DIRTY_MODES;
+
+    texture_1cycle = false;
 }
 
 /**
- * @brief Load a texture from RDRAM into RDP TMEM
+ * @brief Enable display of 2D filled primitives compared against the Z-buffer
  *
- * This function will take a texture from a sprite and place it into RDP TMEM at the offset and 
- * texture slot specified.  It is capable of pulling out a smaller texture from a larger sprite
- * map.
+ * Like #rdp_enable_blend_fill, but pixels are depth-compared against the
+ * attached Z-buffer (see #rdp_attach_zbuffer) using the current primitive
+ * depth (see #rdp_set_primitive_depth), and the Z-buffer is updated where
+ * they pass. Both #rdp_draw_filled_triangle and #rdp_draw_filled_rectangle
+ * can be used in this mode.
+ */
+void rdp_enable_blend_fill_zbuffer( void )
+{
+    /* Blend fill plus Z compare/update with the primitive depth as source */
+    state_pending.other_modes[0] = 0xEF0000FF;
+    state_pending.other_modes[1] = 0x80000034;
+    state_dirty |= RDP_DIRTY_MODES;
+}
+
+/**
+ * @brief Enable display of 2D sprites compared against the Z-buffer
+ *
+ * Like #rdp_enable_texture_copy, but pixels are depth-compared against the
+ * attached Z-buffer (see #rdp_attach_zbuffer) using the current primitive
+ * depth (see #rdp_set_primitive_depth), and the Z-buffer is updated where
+ * they pass.
+ *
+ * Since copy mode bypasses the depth unit, this mode renders in one cycle
+ * mode, which is somewhat slower than copy mode (one pixel per cycle
+ * instead of four): use it only for primitives that actually need depth
+ * comparison.
+ */
+void rdp_enable_texture_zbuffer( void )
+{
+    /* Route the texel straight through the color combiner in both cycles */
+    state_pending.combine[0] = 0xFC887F10;
+    state_pending.combine[1] = 0x88FCF279;
+
+    /* One cycle mode, opaque surface blend, Z compare/update with the
+       primitive depth as source */
+    state_pending.other_modes[0] = 0xEF0000FF;
+    state_pending.other_modes[1] = 0x0C084034;
+    state_dirty |= RDP_DIRTY_COMBINE | RDP_DIRTY_MODES;
+
+    texture_1cycle = true;
+}
+
+/**
+ * @brief Enable display of packed YUV images
+ *
+ * This must be called before drawing an image loaded with
+ * #rdp_load_yuv_texture: it configures the hardware YUV to RGB conversion,
+ * so that packed YUV pixels are converted on the fly while the rectangle
+ * is rasterized, with chroma interpolated between adjacent macropixels.
+ *
+ * The conversion happens in two steps. The texture filter applies the
+ * chroma coefficients (K0-K3 of Set Convert), and the color combiner
+ * completes the luma scaling by computing (TEXEL0 - K4) * K5 + TEXEL0.
+ * The coefficients are the standard ITU-R BT.601 ones for TV-range
+ * (16-235) luma, which is what video encoders emit by default.
+ *
+ * Since the conversion requires the texture filter, this mode renders in
+ * one cycle mode, which is somewhat slower than copy mode (one pixel per
+ * cycle instead of four).
+ */
+void rdp_enable_texture_yuv( void )
+{
+    /* YUV -> RGB conversion coefficients, ITU-R BT.601 TV-range (x128) */
+    const int k0 = 175, k1 = -43, k2 = -89, k3 = 222, k4 = 114, k5 = 42;
+    state_pending.convert[0] = 0xEC000000 | ((k0 & 0x1FF) << 13) | ((k1 & 0x1FF) << 4) | ((k2 & 0x1FF) >> 5);
+    state_pending.convert[1] = ((k2 & 0x1F) << 27) | ((k3 & 0x1FF) << 18) | ((k4 & 0x1FF) << 9) | (k5 & 0x1FF);
+
+    /* Combiner computes (TEXEL0 - K4) * K5 + TEXEL0 in both cycles,
+       completing the conversion started by the texture filter */
+    state_pending.combine[0] = 0xFC17FE2F;
+    state_pending.combine[1] = 0x77FCFC7E;
+
+    /* One cycle mode, 2x2 chroma interpolation, texture convert enabled,
+       opaque surface blend */
+    state_pending.other_modes[0] = 0xEF0020FF;
+    state_pending.other_modes[1] = 0x0C084000;
+    state_dirty |= RDP_DIRTY_CONVERT | RDP_DIRTY_COMBINE | RDP_DIRTY_MODES;
+
+    texture_1cycle = true;
+}
+
+/**
+ * @brief Set the depth used for Z-buffered primitives
+ *
+ * This function sets the depth that all primitives drawn in a Z-buffered
+ * render mode (see #rdp_enable_blend_fill_zbuffer and
+ * #rdp_enable_texture_zbuffer) are compared and written with, until the
+ * next call. Lower values are closer to the viewer: a primitive is drawn
+ * only where its depth is less than or equal to the Z-buffer contents.
+ *
+ * @param[in] depth
+ *            Primitive depth, 0 (nearest) to 0x7FFF (farthest)
+ */
+void rdp_set_primitive_depth( uint16_t depth )
+{
+    /* Set primitive depth, with a zero delta Z */
+    state_pending.prim_depth = (uint32_t)depth << 16;
+    state_dirty |= RDP_DIRTY_PRIM_DEPTH;
+}
+
+/**
+ * @brief Toggle color lookup table sampling to match the loaded texture
+ *
+ * The en_tlut bit lives in the Set Other Modes words, but whether it must be
+ * set depends on the texture being sampled rather than on the render mode the
+ * caller picked, so the texture loaders track it here and #__rdp_flush_state
+ * folds it into the emitted mode words.  Toggling it re-dirties the mode
+ * group so the next primitive picks the change up.
+ *
+ * @param[in] enable
+ *            Whether the loaded texture samples through the lookup table
+ */
+static void __rdp_tlut_enable( bool enable )
+{
+    if( tlut_active == enable ) { return; }
+
+    tlut_active = enable;
+
+    /* Nothing to re-emit if no render mode was ever configured */
+    if( state_pending.other_modes[0] ) { state_dirty |= RDP_DIRTY_MODES; }
+}
+
+/**
+ * @brief Load a pre-swizzled sprite into RDP TMEM with a raw block transfer
+ *
+ * Sprites marked with #SPRITE_FORMAT_TMEM_SWIZZLED already store their odd
+ * rows in the interleaved layout the RDP expects inside TMEM, so the whole
+ * sprite can be uploaded with a single Load Block command with a zero per-word
+ * T increment: the RDP copies the data verbatim at full DMA bandwidth instead
+ * of interleaving each line during the load.
+ *
+ * mksprite guarantees that such sprites fit TMEM whole and that their rows are
+ * a whole number of 64-bit words, which is all this loader relies on.
  *
  * @param[in] texslot
  *            The texture slot (0-7) to assign this texture to
@@ -443,86 +1020,688 @@ void rdp_enable_texture_copy( void )
  * @param[in] mirror_enabled
  *            Whether to mirror this texture when displaying
  * @param[in] sprite
- *            Pointer to the sprite structure to load the texture out of
- * @param[in] sl
- *            The pixel offset S of the top left of the texture relative to sprite space
- * @param[in] tl
- *            The pixel offset T of the top left of the texture relative to sprite space
- * @param[in] sh
- *            The pixel offset S of the bottom right of the texture relative to sprite space
- * @param[in] th
- *            The pixel offset T of the bottom right of the texture relative to sprite space
+ *            Pointer to the pre-swizzled sprite structure to load
  *
  * @return The amount of texture memory in bytes that was consumed by this texture.
  */
-static uint32_t __rdp_load_texture( uint32_t texslot, uint32_t texloc, mirror_t mirror_enabled, sprite_t *sprite, int sl, int tl, int sh, int th )
+static uint32_t __rdp_load_texture_swizzled( uint32_t texslot, uint32_t texloc, mirror_t mirror_enabled, sprite_t *sprite )
 {
+    int twidth = sprite->width;
+    int theight = sprite->height;
+
+    /* Skip the load entirely if this exact texture is already resident */
+    if( __rdp_tmem_resident( texslot, texloc, mirror_enabled, true, sprite, 0, 0, twidth - 1, theight - 1 ) )
+    {
+        tmem_hits++;
+        return cache[texslot & 0x7].tmem_size;
+    }
+    tmem_misses++;
+
     /* Invalidate data associated with sprite in cache */
     if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
     {
-        data_cache_hit_writeback_invalidate( sprite->data, sprite->width * sprite->height * sprite->bitdepth );
+        data_cache_hit_writeback_invalidate( sprite->data, twidth * theight * sprite->bitdepth );
     }
 
     /* Point the RDP at the actual sprite data */
-    __rdp_ringbuffer_queue( 0xFD000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | (sprite->width - 1) );
+    __rdp_ringbuffer_queue( 0xFD000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | (twidth - 1) );
     __rdp_ringbuffer_queue( (uint32_t)sprite->data );
     __rdp_ringbuffer_send();
 
-    /* Figure out the s,t coordinates of the sprite we are copying out of */
-    int twidth = sh - sl + 1;
-    int theight = th - tl + 1;
-
     /* Figure out the power of two this sprite fits into */
     uint32_t real_width  = __rdp_round_to_power( twidth );
     uint32_t real_height = __rdp_round_to_power( theight );
     uint32_t wbits = __rdp_log2( real_width );
     uint32_t hbits = __rdp_log2( real_height );
 
-    /* Because we are dividing by 8, we want to round up if we have a remainder */
-    int round_amount = (real_width % 8) ? 1 : 0;
+    /* Number of 64-bit words per row; mksprite guarantees rows are whole words */
+    uint32_t words = (twidth * sprite->bitdepth) / 8;
 
-    /* Instruct the RDP to copy the sprite data out */
-    __rdp_ringbuffer_queue( 0xF5000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | 
-                                       (((((real_width / 8) + round_amount) * sprite->bitdepth) & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+    /* Instruct the RDP to interpret TMEM rows at the real pitch */
+    __rdp_ringbuffer_queue( 0xF5000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) |
+                                       ((words & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
     __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (mirror_enabled != MIRROR_DISABLED ? 0x40100 : 0) | (hbits << 14 ) | (wbits << 4) );
     __rdp_ringbuffer_send();
 
-    /* Copying out only a chunk this time */
-    __rdp_ringbuffer_queue( 0xF4000000 | (((sl << 2) & 0xFFF) << 12) | ((tl << 2) & 0xFFF) );
-    __rdp_ringbuffer_queue( (((sh << 2) & 0xFFF) << 12) | ((th << 2) & 0xFFF) );
+    /* Copy the sprite out in one burst.  The T increment is zero because the
+       data is already interleaved; the RDP must not swizzle it a second time */
+    uint32_t npixels = twidth * theight;
+    __rdp_ringbuffer_queue( 0xF3000000 );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (((npixels - 1) & 0xFFF) << 12) );
     __rdp_ringbuffer_send();
 
     /* Save sprite width and height for managed sprite commands */
     cache[texslot & 0x7].width = twidth - 1;
     cache[texslot & 0x7].height = theight - 1;
-    cache[texslot & 0x7].s = sl;
-    cache[texslot & 0x7].t = tl;
+    cache[texslot & 0x7].s = 0;
+    cache[texslot & 0x7].t = 0;
     cache[texslot & 0x7].real_width = real_width;
     cache[texslot & 0x7].real_height = real_height;
-    
+
+    /* Remember what is now resident so an identical load can be skipped */
+    uint32_t tmem_size = words * 8 * real_height;
+    __rdp_tmem_mark_resident( texslot, texloc, tmem_size, mirror_enabled, true, sprite, 0, 0 );
+
     /* Return the amount of texture memory consumed by this texture */
-    return ((real_width / 8) + round_amount) * 8 * real_height * sprite->bitdepth;
+    return tmem_size;
 }
 
 /**
- * @brief Load a sprite into RDP TMEM
+ * @brief Load a texture from RDRAM into RDP TMEM
+ *
+ * This function will take a texture from a sprite and place it into RDP TMEM at the offset and
+ * texture slot specified.  It is capable of pulling out a smaller texture from a larger sprite
+ * map.
  *
  * @param[in] texslot
- *            The RDP texture slot to load this sprite into (0-7)
+ *            The texture slot (0-7) to assign this texture to
  * @param[in] texloc
- *            The RDP TMEM offset to place the texture at
- * @param[in] mirror
- *            Whether the sprite should be mirrored when displaying past boundaries
+ *            The offset in RDP TMEM to place this texture
+ * @param[in] mirror_enabled
+ *            Whether to mirror this texture when displaying
  * @param[in] sprite
- *            Pointer to sprite structure to load the texture from
+ *            Pointer to the sprite structure to load the texture out of
+ * @param[in] sl
+ *            The pixel offset S of the top left of the texture relative to sprite space
+ * @param[in] tl
+ *            The pixel offset T of the top left of the texture relative to sprite space
+ * @param[in] sh
+ *            The pixel offset S of the bottom right of the texture relative to sprite space
+ * @param[in] th
+ *            The pixel offset T of the bottom right of the texture relative to sprite space
  *
- * @return The number of bytes consumed in RDP TMEM by loading this sprite
+ * @return The amount of texture memory in bytes that was consumed by this texture.
  */
-uint32_t rdp_load_texture( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite )
+static uint32_t __rdp_load_texture( uint32_t texslot, uint32_t texloc, mirror_t mirror_enabled, sprite_t *sprite, int sl, int tl, int sh, int th )
 {
-    if( !sprite ) { return 0; }
+    bool ci4 = (sprite->format & SPRITE_FORMAT_CI4) != 0;
+
+    /* Color-indexed sprites sample through the color lookup table.  Make the
+       palette resident first (#rdp_load_palette skips redundant uploads, so
+       sprites sharing a palette group pay for a single one) and toggle the
+       lookup to match the sprite.  Shared-palette sprites embed no palette:
+       the group palette must have been loaded explicitly */
+    if( ci4 && !(sprite->format & SPRITE_FORMAT_SHARED_PALETTE) )
+    {
+        rdp_load_palette( (uint16_t *)((uint8_t *)sprite->data + (sprite->width * sprite->height / 2)), 16 );
+    }
+    __rdp_tlut_enable( ci4 );
 
-    return __rdp_load_texture( texslot, texloc, mirror, sprite, 0, 0, sprite->width - 1, sprite->height - 1 );
+    /* Pre-swizzled sprites are laid out for a raw block transfer and would be
+       corrupted by the interleave the regular load performs on odd lines */
+    if( sprite->format & SPRITE_FORMAT_TMEM_SWIZZLED )
+    {
+        assertf( sl == 0 && tl == 0 && sh == sprite->width - 1 && th == sprite->height - 1,
+            "pre-swizzled sprites can only be loaded whole" );
+        return __rdp_load_texture_swizzled( texslot, texloc, mirror_enabled, sprite );
+    }
+
+    /* Skip the load entirely if this exact texture region is already resident */
+    if( __rdp_tmem_resident( texslot, texloc, mirror_enabled, false, sprite, sl, tl, sh, th ) )
+    {
+        tmem_hits++;
+        return cache[texslot & 0x7].tmem_size;
+    }
+    tmem_misses++;
+
+    /* Invalidate data associated with sprite in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        uint32_t data_size = ci4 ? (sprite->width * sprite->height / 2)
+                                 : (sprite->width * sprite->height * sprite->bitdepth);
+        data_cache_hit_writeback_invalidate( sprite->data, data_size );
+    }
+
+    /* Figure out the s,t coordinates of the sprite we are copying out of */
+    int twidth = sh - sl + 1;
+    int theight = th - tl + 1;
+
+    /* Figure out the power of two this sprite fits into */
+    uint32_t real_width  = __rdp_round_to_power( twidth );
+    uint32_t real_height = __rdp_round_to_power( theight );
+    uint32_t wbits = __rdp_log2( real_width );
+    uint32_t hbits = __rdp_log2( real_height );
+
+    /* Because we are dividing by 8, we want to round up if we have a remainder */
+    int round_amount = (real_width % 8) ? 1 : 0;
+
+    /* 64-bit words per TMEM row: half a byte per pixel for CI4 */
+    uint32_t line = ci4 ? (((real_width / 2) + 7) / 8)
+                        : (((real_width / 8) + round_amount) * sprite->bitdepth);
+    uint32_t tmem_size = line * 8 * real_height;
+
+    if( ci4 )
+    {
+        /* The RDP cannot transfer 4-bit texels: load the rows as 16-bit data
+           a quarter as wide, then describe the same TMEM as CI4 for sampling */
+        assertf( (sl & 3) == 0 && (twidth & 3) == 0,
+            "CI4 textures can only be loaded at multiples of 4 pixels" );
+        assertf( texloc + tmem_size <= 2048,
+            "CI4 textures can only be loaded in the low half of TMEM: the high half holds the color lookup table" );
+
+        __rdp_ringbuffer_queue( 0xFD000000 | 0x00100000 | ((sprite->width / 4) - 1) );
+        __rdp_ringbuffer_queue( (uint32_t)sprite->data );
+        __rdp_ringbuffer_send();
+
+        __rdp_ringbuffer_queue( 0xF5000000 | 0x00100000 | ((line & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) );
+        __rdp_ringbuffer_send();
+
+        __rdp_ringbuffer_queue( 0xF4000000 | ((((sl / 4) << 2) & 0xFFF) << 12) | ((tl << 2) & 0xFFF) );
+        __rdp_ringbuffer_queue( (((((sl + twidth) / 4 - 1) << 2) & 0xFFF) << 12) | ((th << 2) & 0xFFF) );
+        __rdp_ringbuffer_send();
+
+        /* The transfer must finish before the tile is described again */
+        __rdp_ringbuffer_queue( 0xE6000000 );
+        __rdp_ringbuffer_queue( 0x00000000 );
+        __rdp_ringbuffer_send();
+
+        __rdp_ringbuffer_queue( 0xF5000000 | 0x00400000 | ((line & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (mirror_enabled != MIRROR_DISABLED ? 0x40100 : 0) | (hbits << 14 ) | (wbits << 4) );
+        __rdp_ringbuffer_send();
+    }
+    else
+    {
+        /* Point the RDP at the actual sprite data */
+        __rdp_ringbuffer_queue( 0xFD000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | (sprite->width - 1) );
+        __rdp_ringbuffer_queue( (uint32_t)sprite->data );
+        __rdp_ringbuffer_send();
+
+        /* Instruct the RDP to copy the sprite data out */
+        __rdp_ringbuffer_queue( 0xF5000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) |
+                                           ((line & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (mirror_enabled != MIRROR_DISABLED ? 0x40100 : 0) | (hbits << 14 ) | (wbits << 4) );
+        __rdp_ringbuffer_send();
+
+        /* Copying out only a chunk this time */
+        __rdp_ringbuffer_queue( 0xF4000000 | (((sl << 2) & 0xFFF) << 12) | ((tl << 2) & 0xFFF) );
+        __rdp_ringbuffer_queue( (((sh << 2) & 0xFFF) << 12) | ((th << 2) & 0xFFF) );
+        __rdp_ringbuffer_send();
+    }
+
+    /* Save sprite width and height for managed sprite commands */
+    cache[texslot & 0x7].width = twidth - 1;
+    cache[texslot & 0x7].height = theight - 1;
+    cache[texslot & 0x7].s = sl;
+    cache[texslot & 0x7].t = tl;
+    cache[texslot & 0x7].real_width = real_width;
+    cache[texslot & 0x7].real_height = real_height;
+
+    /* Remember what is now resident so an identical load can be skipped */
+    __rdp_tmem_mark_resident( texslot, texloc, tmem_size, mirror_enabled, false, sprite, sl, tl );
+
+    /* Return the amount of texture memory consumed by this texture */
+    return tmem_size;
+}
+
+/**
+ * @brief Load one level of a mipmapped sprite into RDP TMEM
+ *
+ * Mipmap levels are stored consecutively after the base image, each half
+ * the size of the previous one, so the level is located by walking the
+ * chain.  Level rows are contiguous, which makes this a whole-image tile
+ * load at the level's own width.
+ *
+ * The residency tracker keys on the S coordinate of the loaded region; the
+ * level number is folded into it so different levels of the same sprite are
+ * told apart.
+ *
+ * @param[in] texslot
+ *            The texture slot (0-7) to assign this texture to
+ * @param[in] texloc
+ *            The offset in RDP TMEM to place this texture
+ * @param[in] mirror_enabled
+ *            Whether to mirror this texture when displaying
+ * @param[in] sprite
+ *            Pointer to the mipmapped sprite structure to load
+ * @param[in] level
+ *            Mipmap level to load (0 is the base image)
+ *
+ * @return The amount of texture memory in bytes that was consumed by this texture.
+ */
+static uint32_t __rdp_load_texture_mipmap( uint32_t texslot, uint32_t texloc, mirror_t mirror_enabled, sprite_t *sprite, int level )
+{
+    /* Mipmap chains only hold direct-color levels */
+    __rdp_tlut_enable( false );
+
+    /* Walk the chain to the requested level */
+    uint8_t *data = (uint8_t *)sprite->data;
+    int twidth = sprite->width;
+    int theight = sprite->height;
+
+    for( int l = 0; l < level; l++ )
+    {
+        data += twidth * theight * sprite->bitdepth;
+        twidth = (twidth > 1) ? twidth / 2 : 1;
+        theight = (theight > 1) ? theight / 2 : 1;
+    }
+
+    /* Fold the level into the S key so levels don't alias each other */
+    int key = level << 16;
+
+    /* Skip the load entirely if this exact level is already resident */
+    if( __rdp_tmem_resident( texslot, texloc, mirror_enabled, false, sprite, key, 0, key + twidth - 1, theight - 1 ) )
+    {
+        tmem_hits++;
+        return cache[texslot & 0x7].tmem_size;
+    }
+    tmem_misses++;
+
+    /* Invalidate data associated with the level in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        data_cache_hit_writeback_invalidate( data, twidth * theight * sprite->bitdepth );
+    }
+
+    /* Point the RDP at the level data */
+    __rdp_ringbuffer_queue( 0xFD000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | (twidth - 1) );
+    __rdp_ringbuffer_queue( (uint32_t)data );
+    __rdp_ringbuffer_send();
+
+    /* Figure out the power of two this level fits into */
+    uint32_t real_width  = __rdp_round_to_power( twidth );
+    uint32_t real_height = __rdp_round_to_power( theight );
+    uint32_t wbits = __rdp_log2( real_width );
+    uint32_t hbits = __rdp_log2( real_height );
+
+    /* Because we are dividing by 8, we want to round up if we have a remainder */
+    int round_amount = (real_width % 8) ? 1 : 0;
+
+    /* Instruct the RDP to copy the level data out */
+    __rdp_ringbuffer_queue( 0xF5000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) |
+                                       (((((real_width / 8) + round_amount) * sprite->bitdepth) & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (mirror_enabled != MIRROR_DISABLED ? 0x40100 : 0) | (hbits << 14 ) | (wbits << 4) );
+    __rdp_ringbuffer_send();
+
+    /* Copying out the whole level */
+    __rdp_ringbuffer_queue( 0xF4000000 );
+    __rdp_ringbuffer_queue( ((((twidth - 1) << 2) & 0xFFF) << 12) | (((theight - 1) << 2) & 0xFFF) );
+    __rdp_ringbuffer_send();
+
+    /* Save level width and height for managed sprite commands */
+    cache[texslot & 0x7].width = twidth - 1;
+    cache[texslot & 0x7].height = theight - 1;
+    cache[texslot & 0x7].s = 0;
+    cache[texslot & 0x7].t = 0;
+    cache[texslot & 0x7].real_width = real_width;
+    cache[texslot & 0x7].real_height = real_height;
+
+    /* Remember what is now resident so an identical load can be skipped */
+    uint32_t tmem_size = ((real_width / 8) + round_amount) * 8 * real_height * sprite->bitdepth;
+    __rdp_tmem_mark_resident( texslot, texloc, tmem_size, mirror_enabled, false, sprite, key, 0 );
+
+    /* Return the amount of texture memory consumed by this texture */
+    return tmem_size;
+}
+
+/**
+ * @brief Return the number of mipmap levels stored in a sprite
+ *
+ * @param[in] sprite
+ *            Pointer to the sprite structure to inspect
+ *
+ * @return The number of levels (1 for sprites without a mipmap chain)
+ */
+int rdp_sprite_mipmap_levels( sprite_t *sprite )
+{
+    if( !sprite || !(sprite->format & SPRITE_FORMAT_MIPMAPPED) ) { return 1; }
+
+    int w = sprite->width, h = sprite->height, levels = 1;
+
+    while( w > 1 || h > 1 )
+    {
+        w = (w > 1) ? w / 2 : 1;
+        h = (h > 1) ? h / 2 : 1;
+        levels++;
+    }
+
+    return levels;
+}
+
+/**
+ * @brief Load one mipmap level of a sprite into RDP TMEM
+ *
+ * Sprites converted with "mksprite --mipmap" carry a full box-filtered
+ * mipmap chain (see #SPRITE_FORMAT_MIPMAPPED).  This function loads the
+ * requested level; pick the level whose size best matches the on-screen
+ * footprint of the primitive to cut TMEM load traffic and aliasing when
+ * drawing minified textures.
+ *
+ * @param[in] texslot
+ *            The RDP texture slot to load this sprite into (0-7)
+ * @param[in] texloc
+ *            The RDP TMEM offset to place the texture at
+ * @param[in] mirror
+ *            Whether the sprite should be mirrored when displaying past boundaries
+ * @param[in] sprite
+ *            Pointer to mipmapped sprite structure to load the texture from
+ * @param[in] level
+ *            Mipmap level to load, 0 (base image) to
+ *            #rdp_sprite_mipmap_levels - 1; out of range values are clamped
+ *
+ * @return The number of bytes consumed in RDP TMEM by loading this level
+ */
+uint32_t rdp_load_texture_mipmap( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite, int level )
+{
+    if( !sprite ) { return 0; }
+
+    assertf( !(sprite->format & SPRITE_FORMAT_TMEM_SWIZZLED),
+        "mipmapped sprites are never pre-swizzled" );
+
+    if( !(sprite->format & SPRITE_FORMAT_MIPMAPPED) || level <= 0 )
+    {
+        return __rdp_load_texture( texslot, texloc, mirror, sprite, 0, 0, sprite->width - 1, sprite->height - 1 );
+    }
+
+    int max_level = rdp_sprite_mipmap_levels( sprite ) - 1;
+    if( level > max_level ) { level = max_level; }
+
+    return __rdp_load_texture_mipmap( texslot, texloc, mirror, sprite, level );
+}
+
+/**
+ * @brief Load a packed YUV image into RDP TMEM
+ *
+ * The buffer holds a packed 4:2:2 YUV image (U Y0 V Y1 macropixels, 2 bytes
+ * per pixel).  The load splits it the way the YUV texture format requires:
+ * luma bytes end up in the low half of TMEM and chroma bytes in the high
+ * half, which is why the luma plane of the image (1 byte per pixel) must
+ * fit in 2 KiB.  Draw the image with #rdp_draw_textured_rectangle after
+ * setting up the YUV render mode with #rdp_enable_texture_yuv.
+ *
+ * Unlike sprite loads, no residency tracking is performed: image buffers
+ * are expected to hold different pixels on every load (eg: video frames),
+ * so the texture is always transferred.
+ *
+ * @param[in] texslot
+ *            The RDP texture slot to load this image into (0-7)
+ * @param[in] texloc
+ *            The RDP TMEM offset to place the texture at (low half only)
+ * @param[in] buffer
+ *            Pointer to the packed YUV image data
+ * @param[in] width
+ *            Width of the image in pixels (must be even)
+ * @param[in] height
+ *            Height of the image in pixels
+ *
+ * @return The number of bytes consumed in RDP TMEM by loading this image
+ */
+uint32_t rdp_load_yuv_texture( uint32_t texslot, uint32_t texloc, void *buffer, int width, int height )
+{
+    assertf( (width & 7) == 0, "YUV images must have a width multiple of 8" );
+    assertf( width * height <= 2048, "YUV image does not fit TMEM: the luma plane is limited to 2048 bytes" );
+    assertf( texloc + width * height <= 2048, "YUV images can only be loaded in the low half of TMEM" );
+
+    /* Invalidate data associated with the buffer in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        data_cache_hit_writeback_invalidate( buffer, width * height * 2 );
+    }
+
+    /* Point the RDP at the image data (format YUV, 16 bits per pixel) */
+    __rdp_ringbuffer_queue( 0xFD000000 | 0x00300000 | (width - 1) );
+    __rdp_ringbuffer_queue( (uint32_t)buffer );
+    __rdp_ringbuffer_send();
+
+    /* Figure out the power of two this image fits into */
+    uint32_t real_width  = __rdp_round_to_power( width );
+    uint32_t real_height = __rdp_round_to_power( height );
+    uint32_t wbits = __rdp_log2( real_width );
+    uint32_t hbits = __rdp_log2( real_height );
+
+    /* Instruct the RDP to copy the image data out. The tile line count is
+       measured on the luma plane (1 byte per pixel) */
+    __rdp_ringbuffer_queue( 0xF5000000 | 0x00300000 | (((width / 8) & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (hbits << 14 ) | (wbits << 4) );
+    __rdp_ringbuffer_send();
+
+    __rdp_ringbuffer_queue( 0xF4000000 );
+    __rdp_ringbuffer_queue( ((((width - 1) << 2) & 0xFFF) << 12) | (((height - 1) << 2) & 0xFFF) );
+    __rdp_ringbuffer_send();
+
+    /* Save width and height so the rectangle draw commands work */
+    cache[texslot & 0x7].width = width - 1;
+    cache[texslot & 0x7].height = height - 1;
+    cache[texslot & 0x7].s = 0;
+    cache[texslot & 0x7].t = 0;
+    cache[texslot & 0x7].real_width = real_width;
+    cache[texslot & 0x7].real_height = real_height;
+
+    /* Invalidate in the residency tracker the slot itself (buffer contents
+       are not keyed, so the next sprite load must not be skipped) and any
+       slot whose TMEM range was overwritten. YUV loads write the luma bytes
+       at texloc and the chroma bytes at the same offset in the high half */
+    for( int i = 0; i < 8; i++ )
+    {
+        if( !cache[i].sprite ) { continue; }
+
+        if( (texloc < cache[i].texloc + cache[i].tmem_size && cache[i].texloc < texloc + width * height) ||
+            (texloc + 2048 < cache[i].texloc + cache[i].tmem_size && cache[i].texloc < texloc + 2048 + width * height) )
+        {
+            cache[i].sprite = NULL;
+        }
+    }
+    cache[texslot & 0x7].sprite = NULL;
+    cache[texslot & 0x7].texloc = texloc;
+    cache[texslot & 0x7].tmem_size = width * height * 2;
+    tmem_misses++;
+
+    /* The chroma bytes land where the color lookup table lives */
+    tlut_palette = NULL;
+    __rdp_tlut_enable( false );
+
+    return width * height * 2;
+}
+
+/**
+ * @brief Load a palette into the RDP color lookup table
+ *
+ * Loads RGBA16 palette entries into the color lookup table in the high half
+ * of TMEM, where color-indexed textures sample them.  The load is skipped
+ * when the same palette is already resident: sprites converted against a
+ * shared palette group (#SPRITE_FORMAT_SHARED_PALETTE) thus cost a single
+ * palette upload no matter how many of them are drawn.
+ *
+ * #rdp_load_texture calls this automatically for CI4 sprites that embed
+ * their own palette; call it manually, once, with the palette produced by
+ * "mksprite --make-palette" before drawing the sprites of a palette group.
+ *
+ * @param[in] palette
+ *            Pointer to the RGBA16 palette entries
+ * @param[in] num_colors
+ *            Number of colors to load (1-256; CI4 palettes hold 16)
+ */
+void rdp_load_palette( uint16_t *palette, int num_colors )
+{
+    assertf( num_colors > 0 && num_colors <= 256, "the color lookup table holds at most 256 entries" );
+
+    /* Skip the load entirely if this exact palette is already resident */
+    if( tlut_palette == palette && tlut_colors == num_colors )
+    {
+        tmem_hits++;
+        return;
+    }
+    tmem_misses++;
+
+    /* Invalidate data associated with the palette in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        data_cache_hit_writeback_invalidate( palette, num_colors * 2 );
+    }
+
+    /* Point the RDP at the palette entries (RGBA16) */
+    __rdp_ringbuffer_queue( 0xFD000000 | 0x00100000 | (num_colors - 1) );
+    __rdp_ringbuffer_queue( (uint32_t)palette );
+    __rdp_ringbuffer_send();
+
+    /* Describe the lookup table area with the last tile */
+    __rdp_ringbuffer_queue( 0xF5000000 | 0x00100000 | ((2048 / 8) & 0x1FF) );
+    __rdp_ringbuffer_queue( 0x7 << 24 );
+    __rdp_ringbuffer_send();
+
+    /* Load Tlut replicates every entry across the four TMEM banks */
+    __rdp_ringbuffer_queue( 0xF0000000 );
+    __rdp_ringbuffer_queue( (0x7 << 24) | ((((num_colors - 1) << 2) & 0xFFF) << 12) );
+    __rdp_ringbuffer_send();
+
+    /* The table must be fully written before a texel samples it */
+    __rdp_ringbuffer_queue( 0xE6000000 );
+    __rdp_ringbuffer_queue( 0x00000000 );
+    __rdp_ringbuffer_send();
+
+    /* Each replicated entry occupies 8 bytes of TMEM starting at the high
+       half; evict any texture the table overwrote */
+    for( int i = 0; i < 8; i++ )
+    {
+        if( !cache[i].sprite ) { continue; }
+
+        if( 2048 < cache[i].texloc + cache[i].tmem_size && cache[i].texloc < 2048 + num_colors * 8 )
+        {
+            cache[i].sprite = NULL;
+        }
+    }
+
+    tlut_palette = palette;
+    tlut_colors = num_colors;
+}
+
+/**
+ * @brief Expand an 8-bit indexed surface to the framebuffer in one RDP pass
+ *
+ * Draws a whole #FMT_CI8 surface at (x, y) on the attached framebuffer,
+ * converting each palette index to a color through the lookup table as it is
+ * copied.  This is the companion of software rendering into an indexed
+ * surface (see @ref graphics): the CPU touches one byte per pixel, and the
+ * format expansion is done by the RDP while it blits.
+ *
+ * The surface is streamed through TMEM in horizontal strips sized to the
+ * 2 KiB of texel memory left over by the lookup table, so it can be
+ * arbitrarily tall; one textured rectangle is emitted per strip.  No
+ * residency tracking is performed: like video frames, UI surfaces are
+ * expected to hold different pixels on every pass.
+ *
+ * Set up the copy render mode with #rdp_enable_texture_copy before calling
+ * this function.  As with any copy-mode blit, the attached framebuffer must
+ * be 16-bit.
+ *
+ * @param[in] texslot
+ *            The RDP texture slot to stream the strips through (0-7)
+ * @param[in] surface
+ *            The #FMT_CI8 surface to draw
+ * @param[in] palette
+ *            Pointer to the RGBA16 palette entries to expand the indices
+ *            with (see #rdp_load_palette), or NULL if the palette currently
+ *            resident in the lookup table should be used
+ * @param[in] num_colors
+ *            Number of colors in the palette (1-256; ignored if palette is NULL)
+ * @param[in] x
+ *            The pixel X location of the top left of the drawn surface
+ * @param[in] y
+ *            The pixel Y location of the top left of the drawn surface
+ */
+void rdp_draw_surface_ci8( uint32_t texslot, surface_t *surface, uint16_t *palette, int num_colors, int x, int y )
+{
+    assertf( surface_get_format( surface ) == FMT_CI8,
+        "rdp_draw_surface_ci8 requires a FMT_CI8 surface" );
+
+    int width = surface->width;
+    int height = surface->height;
+
+    assertf( (width & 7) == 0, "CI8 surfaces must have a width multiple of 8 to be expanded" );
+    assertf( width <= 2048, "CI8 surface rows are limited to the 2048 bytes of texel TMEM" );
+    assertf( x >= 0 && y >= 0, "CI8 surfaces can only be expanded at non-negative coordinates" );
+
+    /* Make the palette resident (skipped if it already is) and sample
+       through it */
+    if( palette ) { rdp_load_palette( palette, num_colors ); }
+    __rdp_tlut_enable( true );
+
+    /* Invalidate data associated with the surface in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        data_cache_hit_writeback_invalidate( surface->buffer, surface->stride * height );
+    }
+
+    /* The lookup toggle lives in the mode words: they must be emitted
+       before the rectangles */
+    __rdp_flush_state();
+
+    /* Point the RDP at the surface; the stride is in bytes, which for CI8
+       is also pixels */
+    __rdp_ringbuffer_queue( 0xFD000000 | 0x00480000 | (surface->stride - 1) );
+    __rdp_ringbuffer_queue( (uint32_t)surface->buffer );
+    __rdp_ringbuffer_send();
+
+    /* 64-bit words per TMEM row, and surface rows per strip */
+    uint32_t line = width / 8;
+    int rows = 2048 / width;
+
+    for( int tl = 0; tl < height; tl += rows )
+    {
+        int th = tl + rows - 1;
+        if( th > height - 1 ) { th = height - 1; }
+
+        /* The previous strip must be fully fetched before its TMEM is
+           overwritten */
+        __rdp_ringbuffer_queue( 0xE6000000 );
+        __rdp_ringbuffer_queue( 0x00000000 );
+        __rdp_ringbuffer_send();
+
+        /* Describe the strip: CI8, at the bottom of TMEM, no mirroring or
+           masking (the strip is drawn exactly once at 1:1) */
+        __rdp_ringbuffer_queue( 0xF5000000 | 0x00480000 | ((line & 0x1FF) << 9) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) );
+        __rdp_ringbuffer_send();
+
+        /* Load rows tl-th of the surface into the strip */
+        __rdp_ringbuffer_queue( 0xF4000000 | ((tl << 2) & 0xFFF) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | ((((width - 1) << 2) & 0xFFF) << 12) | ((th << 2) & 0xFFF) );
+        __rdp_ringbuffer_send();
+
+        /* One rectangle per strip.  T addressing is absolute: the tile was
+           loaded starting at row tl, so sampling starts there too.  Copy
+           mode fetches four texels per clock, so S advances at 4x */
+        __rdp_ringbuffer_queue( 0xE4000000 | ((x + width - 1) << 14) | ((y + th) << 2) );
+        __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (x << 14) | ((y + tl) << 2) );
+        __rdp_ringbuffer_queue( (tl << 5) & 0xFFFF );
+        __rdp_ringbuffer_queue( ((texture_1cycle ? 1024 : 4096) << 16) | 1024 );
+        __rdp_ringbuffer_send();
+    }
+
+    mode_sync_needed = true;
+
+    /* The strips went through the low half of TMEM: invalidate any slot
+       whose texture they overwrote, including the slot used for streaming */
+    for( int i = 0; i < 8; i++ )
+    {
+        if( cache[i].sprite && cache[i].texloc < 2048 )
+        {
+            cache[i].sprite = NULL;
+        }
+    }
+    cache[texslot & 0x7].sprite = NULL;
+    tmem_misses++;
+}
+
+/**
+ * @brief Load a sprite into RDP TMEM
+ *
+ * @param[in] texslot
+ *            The RDP texture slot to load this sprite into (0-7)
+ * @param[in] texloc
+ *            The RDP TMEM offset to place the texture at
+ * @param[in] mirror
+ *            Whether the sprite should be mirrored when displaying past boundaries
+ * @param[in] sprite
+ *            Pointer to sprite structure to load the texture from
+ *
+ * @return The number of bytes consumed in RDP TMEM by loading this sprite
+ */
+uint32_t rdp_load_texture( uint32_t texslot, uint32_t texloc, mirror_t mirror, sprite_t *sprite )
+{
+    if( !sprite ) { return 0; }
+
+    return __rdp_load_texture( texslot, texloc, mirror, sprite, 0, 0, sprite->width - 1, sprite->height - 1 );
 }
 
 /**
@@ -570,6 +1749,203 @@ uint32_t rdp_load_texture_stride( uint32_t texslot, uint32_t texloc, mirror_t mi
     return __rdp_load_texture( texslot, texloc, mirror, sprite, sl, tl, sh, th );
 }
 
+/**
+ * @brief Calculate the amount of RDP TMEM consumed by a texture region
+ *
+ * This mirrors the rounding performed by #__rdp_load_texture so that callers
+ * can decide whether a region fits in TMEM before attempting to load it.
+ *
+ * @param[in] twidth
+ *            Width of the texture region in pixels
+ * @param[in] theight
+ *            Height of the texture region in pixels
+ * @param[in] bitdepth
+ *            Bit depth of the texture expressed in bytes
+ *
+ * @return The amount of texture memory in bytes the region would consume
+ */
+static uint32_t __rdp_texture_tmem_size( int twidth, int theight, int bitdepth )
+{
+    uint32_t real_width  = __rdp_round_to_power( twidth );
+    uint32_t real_height = __rdp_round_to_power( theight );
+
+    /* Because we are dividing by 8, we want to round up if we have a remainder */
+    int round_amount = (real_width % 8) ? 1 : 0;
+
+    return ((real_width / 8) + round_amount) * 8 * real_height * bitdepth;
+}
+
+/**
+ * @brief Load full-width rows of a sprite into RDP TMEM with a single block transfer
+ *
+ * When the rows to load span the entire width of the sprite, they are contiguous
+ * in RDRAM and can be fetched with one Load Block command instead of a row-by-row
+ * Load Tile.  Block loads run at full DMA bandwidth, roughly twice as fast as tile
+ * loads, which matters when large sprites are streamed through TMEM in slices.
+ *
+ * The caller must guarantee that the row pitch in 64-bit words is a power of two
+ * (so that the per-word T increment is exact) and that the region covers at most
+ * 2048 pixels.
+ *
+ * @param[in] texslot
+ *            The texture slot (0-7) to assign this texture to
+ * @param[in] texloc
+ *            The offset in RDP TMEM to place this texture
+ * @param[in] sprite
+ *            Pointer to the sprite structure to load the texture out of
+ * @param[in] tl
+ *            The pixel offset T of the first row to load
+ * @param[in] th
+ *            The pixel offset T of the last row to load
+ *
+ * @return The amount of texture memory in bytes that was consumed by this texture.
+ */
+static uint32_t __rdp_load_texture_block( uint32_t texslot, uint32_t texloc, sprite_t *sprite, int tl, int th )
+{
+    /* Block loads only handle direct-color sprites */
+    __rdp_tlut_enable( false );
+
+    /* Skip the load entirely if this exact texture region is already resident */
+    if( __rdp_tmem_resident( texslot, texloc, MIRROR_DISABLED, true, sprite, 0, tl, sprite->width - 1, th ) )
+    {
+        tmem_hits++;
+        return cache[texslot & 0x7].tmem_size;
+    }
+    tmem_misses++;
+
+    /* Invalidate data associated with sprite in cache */
+    if( flush_strategy == FLUSH_STRATEGY_AUTOMATIC )
+    {
+        data_cache_hit_writeback_invalidate( sprite->data, sprite->width * sprite->height * sprite->bitdepth );
+    }
+
+    int twidth = sprite->width;
+    int theight = th - tl + 1;
+
+    /* Point the RDP at the first row of the region; the block transfer is
+       linear, so the row offset is folded into the image address */
+    __rdp_ringbuffer_queue( 0xFD000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) | (twidth - 1) );
+    __rdp_ringbuffer_queue( (uint32_t)sprite->data + (tl * twidth * sprite->bitdepth) );
+    __rdp_ringbuffer_send();
+
+    /* Figure out the power of two this region fits into */
+    uint32_t real_width  = __rdp_round_to_power( twidth );
+    uint32_t real_height = __rdp_round_to_power( theight );
+    uint32_t wbits = __rdp_log2( real_width );
+    uint32_t hbits = __rdp_log2( real_height );
+
+    /* Number of 64-bit words per row, guaranteed a power of two by the caller */
+    uint32_t words = (twidth * sprite->bitdepth) / 8;
+
+    /* Instruct the RDP to interpret TMEM rows at the real pitch */
+    __rdp_ringbuffer_queue( 0xF5000000 | ((sprite->bitdepth == 2) ? 0x00100000 : 0x00180000) |
+                                       ((words & 0x1FF) << 9) | ((texloc / 8) & 0x1FF) );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (hbits << 14 ) | (wbits << 4) );
+    __rdp_ringbuffer_send();
+
+    /* Copy all rows out in one contiguous burst; the T coordinate advances by
+       one full line every (2048 / dxt) 64-bit words */
+    uint32_t npixels = twidth * theight;
+    uint32_t dxt = 2048 / words;
+    __rdp_ringbuffer_queue( 0xF3000000 );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (((npixels - 1) & 0xFFF) << 12) | (dxt & 0xFFF) );
+    __rdp_ringbuffer_send();
+
+    /* Save sprite width and height for managed sprite commands.  The block was
+       loaded at T=0, so the cached S,T origin is the top left of the region */
+    cache[texslot & 0x7].width = twidth - 1;
+    cache[texslot & 0x7].height = theight - 1;
+    cache[texslot & 0x7].s = 0;
+    cache[texslot & 0x7].t = 0;
+    cache[texslot & 0x7].real_width = real_width;
+    cache[texslot & 0x7].real_height = real_height;
+
+    /* Remember what is now resident so an identical load can be skipped */
+    uint32_t tmem_size = words * 8 * real_height;
+    __rdp_tmem_mark_resident( texslot, texloc, tmem_size, MIRROR_DISABLED, true, sprite, 0, tl );
+
+    /* Return the amount of texture memory consumed by this texture */
+    return tmem_size;
+}
+
+/**
+ * @brief Draw a sprite of any size, slicing it through RDP TMEM automatically
+ *
+ * Sprites larger than the 4 KB of RDP TMEM cannot be loaded with #rdp_load_texture
+ * and normally have to be pre-sliced by hand.  This function slices the sprite into
+ * TMEM-sized tiles automatically and emits one load+draw pair per tile, so a sprite
+ * of any size can be drawn with a single call.
+ *
+ * Slices that span the full sprite width are contiguous in RDRAM and are loaded
+ * with a fast block transfer when the row pitch allows it; other slices fall back
+ * to regular tile loads.  The texture slot is reused for every tile, so whatever
+ * texture was previously loaded into it is lost.
+ *
+ * Before using this command to draw a sprite, use #rdp_enable_texture_copy to set
+ * the RDP up in texture mode, and perform a #SYNC_PIPE if a texture operation has
+ * been performed since the last sync.
+ *
+ * @param[in] texslot
+ *            The texture slot (0-7) to stream the sprite through
+ * @param[in] x
+ *            The pixel X location of the top left of the sprite
+ * @param[in] y
+ *            The pixel Y location of the top left of the sprite
+ * @param[in] sprite
+ *            Pointer to sprite structure to draw
+ */
+void rdp_draw_sprite_tiled( uint32_t texslot, int x, int y, sprite_t *sprite )
+{
+    if( !sprite ) { return; }
+
+    int width = sprite->width;
+    int height = sprite->height;
+    int bitdepth = sprite->bitdepth;
+
+    /* Widest slice the RDP can address as a single tile */
+    int tile_w = (width > 256) ? 256 : width;
+
+    /* Tallest slice that fits in TMEM together with that width.  Keep it a
+       power of two so that the height rounding in the loader wastes no TMEM */
+    int tile_h = 4;
+    while( tile_h < 256 && __rdp_texture_tmem_size( tile_w, tile_h * 2, bitdepth ) <= TMEM_SIZE )
+    {
+        tile_h *= 2;
+    }
+
+    /* Full-width slices are contiguous in RDRAM and eligible for block loads,
+       provided the row pitch in 64-bit words is an exact power of two */
+    uint32_t words = (width * bitdepth) / 8;
+    int can_block = (tile_w == width) && (words > 0) &&
+                    ((words & (words - 1)) == 0) && ((width * bitdepth) % 8) == 0 &&
+                    !(sprite->format & (SPRITE_FORMAT_TMEM_SWIZZLED | SPRITE_FORMAT_CI4));
+
+    for( int ty = 0; ty < height; ty += tile_h )
+    {
+        int chunk_h = (height - ty < tile_h) ? (height - ty) : tile_h;
+
+        for( int tx = 0; tx < width; tx += tile_w )
+        {
+            int chunk_w = (width - tx < tile_w) ? (width - tx) : tile_w;
+
+            /* Ensure the previous tile has been rasterized before its TMEM
+               contents are overwritten by the next load */
+            if( tx || ty ) { rdp_sync( SYNC_PIPE ); }
+
+            if( can_block && (width * chunk_h) <= 2048 )
+            {
+                __rdp_load_texture_block( texslot, 0, sprite, ty, ty + chunk_h - 1 );
+            }
+            else
+            {
+                __rdp_load_texture( texslot, 0, MIRROR_DISABLED, sprite, tx, ty, tx + chunk_w - 1, ty + chunk_h - 1 );
+            }
+
+            rdp_draw_textured_rectangle( texslot, x + tx, y + ty, x + tx + chunk_w - 1, y + ty + chunk_h - 1, MIRROR_DISABLED );
+        }
+    }
+}
+
 /**
  * @brief Draw a textured rectangle with a scaled texture
  *
@@ -600,6 +1976,8 @@ uint32_t rdp_load_texture_stride( uint32_t texslot, uint32_t texloc, mirror_t mi
  */
 void rdp_draw_textured_rectangle_scaled( uint32_t texslot, int tx, int ty, int bx, int by, double x_scale, double y_scale,  mirror_t mirror)
 {
+    __rdp_flush_state();
+
     uint16_t s = cache[texslot & 0x7].s << 5;
     uint16_t t = cache[texslot & 0x7].t << 5;
     uint32_t width = cache[texslot & 0x7].width;
@@ -630,8 +2008,9 @@ void rdp_draw_textured_rectangle_scaled( uint32_t texslot, int tx, int ty, int b
             t += ( (height+1) + ((cache[texslot & 0x7].real_height-(height+1))<<1) ) << 5;	
     }	
 
-    /* Calculate the scaling constants based on a 6.10 fixed point system */
-    int xs = (int)((1.0 / x_scale) * 4096.0);
+    /* Calculate the scaling constants based on a 6.10 fixed point system.
+       Copy mode fetches four texels per clock, so S advances at 4x there */
+    int xs = (int)((1.0 / x_scale) * (texture_1cycle ? 1024.0 : 4096.0));
     int ys = (int)((1.0 / y_scale) * 1024.0);
 
     /* Set up rectangle position in screen space */
@@ -644,6 +2023,8 @@ void rdp_draw_textured_rectangle_scaled( uint32_t texslot, int tx, int ty, int b
 
     /* Send command */
     __rdp_ringbuffer_send();
+
+    mode_sync_needed = true;
 }
 
 /**
@@ -675,6 +2056,75 @@ void rdp_draw_textured_rectangle( uint32_t texslot, int tx, int ty, int bx, int
     rdp_draw_textured_rectangle_scaled( texslot, tx, ty, bx, by, 1.0, 1.0, mirror );
 }
 
+/**
+ * @brief Draw a rectangle textured with a region of the loaded texture
+ *
+ * Given an already loaded texture, this function draws a width x height
+ * rectangle sampling only the region of the texture starting at (s, t),
+ * measured in pixels from the top left of the loaded region.  This lets
+ * many small images be drawn out of a single TMEM load: load an atlas
+ * sheet or font atlas once, then pick each entry's rectangle out of it.
+ *
+ * Before using this command, use #rdp_enable_texture_copy to set the RDP
+ * up in texture mode.
+ *
+ * @param[in] texslot
+ *            The texture slot that the texture was previously loaded into (0-7)
+ * @param[in] tx
+ *            The pixel X location of the top left of the rectangle
+ * @param[in] ty
+ *            The pixel Y location of the top left of the rectangle
+ * @param[in] s
+ *            The pixel S offset of the region inside the loaded texture
+ * @param[in] t
+ *            The pixel T offset of the region inside the loaded texture
+ * @param[in] width
+ *            Width of the rectangle (and region) in pixels
+ * @param[in] height
+ *            Height of the rectangle (and region) in pixels
+ */
+void rdp_draw_textured_sub_rectangle( uint32_t texslot, int tx, int ty, int s, int t, int width, int height )
+{
+    __rdp_flush_state();
+
+    uint16_t ss = (cache[texslot & 0x7].s + s) << 5;
+    uint16_t tt = (cache[texslot & 0x7].t + t) << 5;
+
+    int bx = tx + width - 1;
+    int by = ty + height - 1;
+
+    if( bx < 0 || by < 0 ) { return; }
+
+    /* Cant display < 0, so must clip size and move S,T coord accordingly */
+    if( tx < 0 )
+    {
+        ss += (-tx) << 5;
+        tx = 0;
+    }
+
+    if( ty < 0 )
+    {
+        tt += (-ty) << 5;
+        ty = 0;
+    }
+
+    /* Copy mode fetches four texels per clock, so S advances at 4x there */
+    int xs = texture_1cycle ? 1024 : 4096;
+
+    /* Set up rectangle position in screen space */
+    __rdp_ringbuffer_queue( 0xE4000000 | (bx << 14) | (by << 2) );
+    __rdp_ringbuffer_queue( ((texslot & 0x7) << 24) | (tx << 14) | (ty << 2) );
+
+    /* Set up texture position and scaling to 1:1 copy */
+    __rdp_ringbuffer_queue( (ss << 16) | tt );
+    __rdp_ringbuffer_queue( (xs & 0xFFFF) << 16 | 1024 );
+
+    /* Send command */
+    __rdp_ringbuffer_send();
+
+    mode_sync_needed = true;
+}
+
 /**
  * @brief Draw a texture to the screen as a sprite
  *
@@ -729,6 +2179,93 @@ void rdp_draw_sprite_scaled( uint32_t texslot, int x, int y, double x_scale, dou
     rdp_draw_textured_rectangle_scaled( texslot, x, y, x + new_width, y + new_height, x_scale, y_scale, mirror );
 }
 
+/**
+ * @brief Comparison function used to sort a sprite batch by texture
+ *
+ * Instances are grouped by sprite pointer first and mirror setting second,
+ * since both determine the TMEM load that has to precede their rectangles.
+ */
+static int __rdp_batch_compare( const void *a, const void *b )
+{
+    const rdp_sprite_instance_t *ia = a;
+    const rdp_sprite_instance_t *ib = b;
+
+    if( ia->sprite != ib->sprite ) { return (ia->sprite < ib->sprite) ? -1 : 1; }
+    if( ia->mirror != ib->mirror ) { return (ia->mirror < ib->mirror) ? -1 : 1; }
+
+    return 0;
+}
+
+/**
+ * @brief Draw a batch of sprites, grouping TMEM loads by texture
+ *
+ * Drawing many small sprites individually pays the texture load overhead on
+ * every draw, even when most of them share a handful of textures.  This
+ * function draws a whole array of sprite instances in one pass: instances are
+ * sorted by texture, each distinct (sprite, mirror) combination is loaded into
+ * TMEM exactly once, and one textured rectangle is emitted per instance.
+ * Together with the TMEM residency tracker, a batch that reuses the textures
+ * of the previous one does not reload them at all.
+ *
+ * Sprites that do not fit in TMEM whole are drawn through the automatic
+ * tiling path (see #rdp_draw_sprite_tiled), ignoring their mirror setting.
+ *
+ * Note that the instance array is sorted in place by texture as a side
+ * effect, and that instances are drawn in texture order rather than array
+ * order: overlapping instances with different textures may therefore stack
+ * differently than when drawn one by one.
+ *
+ * Before using this command, use #rdp_enable_texture_copy to set the RDP up
+ * in texture mode.
+ *
+ * @param[in] instances
+ *            Array of sprite instances to draw (reordered in place)
+ * @param[in] count
+ *            Number of entries in the instances array
+ */
+void rdp_draw_sprite_batch( rdp_sprite_instance_t *instances, int count )
+{
+    if( !instances || count <= 0 ) { return; }
+
+    /* Group instances that share a TMEM load */
+    qsort( instances, count, sizeof(rdp_sprite_instance_t), __rdp_batch_compare );
+
+    sprite_t *loaded = NULL;
+    mirror_t loaded_mirror = MIRROR_DISABLED;
+
+    for( int i = 0; i < count; i++ )
+    {
+        rdp_sprite_instance_t *in = &instances[i];
+
+        if( !in->sprite ) { continue; }
+
+        /* Oversized sprites stream through TMEM in slices on their own */
+        if( in->sprite->width > 256 || in->sprite->height > 256 ||
+            __rdp_texture_tmem_size( in->sprite->width, in->sprite->height, in->sprite->bitdepth ) > TMEM_SIZE )
+        {
+            if( loaded || i ) { rdp_sync( SYNC_PIPE ); }
+            rdp_draw_sprite_tiled( 0, in->x, in->y, in->sprite );
+
+            /* The tiled draw reloaded the texture slot behind our back */
+            loaded = NULL;
+            continue;
+        }
+
+        if( in->sprite != loaded || in->mirror != loaded_mirror )
+        {
+            /* Ensure the previous group has been rasterized before its
+               texture is overwritten by the next load */
+            if( i ) { rdp_sync( SYNC_PIPE ); }
+
+            __rdp_load_texture( 0, 0, in->mirror, in->sprite, 0, 0, in->sprite->width - 1, in->sprite->height - 1 );
+            loaded = in->sprite;
+            loaded_mirror = in->mirror;
+        }
+
+        rdp_draw_sprite( 0, in->x, in->y, in->mirror );
+    }
+}
+
 /**
  * @brief Set the primitive draw color for subsequent filled primitive operations
  *
@@ -743,9 +2280,8 @@ void rdp_draw_sprite_scaled( uint32_t texslot, int x, int y, double x_scale, dou
 void rdp_set_primitive_color( uint32_t color )
 {
     /* Set packed color */
-    __rdp_ringbuffer_queue( 0xF7000000 );
-    __rdp_ringbuffer_queue( color );
-    __rdp_ringbuffer_send();
+    state_pending.prim_color = color;
+    state_dirty |= RDP_DIRTY_PRIM_COLOR;
 }
 
 /**
@@ -758,9 +2294,8 @@ void rdp_set_primitive_color( uint32_t color )
  */
 void rdp_set_blend_color( uint32_t color )
 {
-    __rdp_ringbuffer_queue( 0xF9000000 );
-    __rdp_ringbuffer_queue( color );
-    __rdp_ringbuffer_send();
+    state_pending.blend_color = color;
+    state_dirty |= RDP_DIRTY_BLEND_COLOR;
 }
 
 /**
@@ -786,12 +2321,119 @@ void rdp_set_blend_color( uint32_t color )
  */
 void rdp_draw_filled_rectangle( int tx, int ty, int bx, int by )
 {
+    __rdp_flush_state();
+
     if( tx < 0 ) { tx = 0; }
     if( ty < 0 ) { ty = 0; }
 
-    __rdp_ringbuffer_queue( 0xF6000000 | ( bx << 14 ) | ( by << 2 ) ); 
+    __rdp_ringbuffer_queue( 0xF6000000 | ( bx << 14 ) | ( by << 2 ) );
     __rdp_ringbuffer_queue( ( tx << 14 ) | ( ty << 2 ) );
     __rdp_ringbuffer_send();
+
+    mode_sync_needed = true;
+}
+
+/**
+ * @brief Apply a full-surface tint post-pass
+ *
+ * Blends every pixel of the attached surface toward the given color:
+ * each pixel becomes pixel * (1 - level/255) + color * (level/255). This
+ * is the building block for post effects that would otherwise need a CPU
+ * loop over the framebuffer: screen fades, damage flashes, palette tints.
+ * The blender applies it while rasterizing a single full-surface
+ * rectangle, so the cost is one framebuffer pass in hardware, with the
+ * CPU only queuing a handful of commands.
+ *
+ * Call it after composing the frame, while the surface is still attached
+ * (after the draws, before #rdp_detach and #display_show). The pass is
+ * internally sequenced after the pending primitives, so it reads the
+ * fully composed frame. It changes the render mode: to draw more
+ * primitives afterwards, set the render mode again (eg:
+ * #rdp_enable_texture_copy).
+ *
+ * See #rdp_post_fade, #rdp_post_flash and #rdp_post_desaturate for the
+ * packaged common cases.
+ *
+ * @param[in] color
+ *            Color to blend toward, in the format #graphics_make_color
+ *            returns (the alpha component is ignored)
+ * @param[in] level
+ *            Blend strength, 0 (no effect) to 255 (solid color)
+ */
+void rdp_post_tint( uint32_t color, uint8_t level )
+{
+    assertf( attach_width > 0, "post-pass with no surface attached" );
+
+    if( level == 0 ) { return; }
+
+    /* Make sure the pending primitives have been rasterized before the
+       pass reads the framebuffer back */
+    rdp_sync( SYNC_PIPE );
+
+    /* The tint color and strength travel in the fog register, whose alpha
+       is the only constant the blender can use as coefficient */
+    state_pending.fog_color = (color & 0xFFFFFF00) | level;
+
+    /* One cycle mode with framebuffer read-back, blending the memory
+       pixel with the fog color by the fog alpha */
+    state_pending.other_modes[0] = 0xEF0000FF;
+    state_pending.other_modes[1] = 0xF5504040;
+    state_dirty |= RDP_DIRTY_FOG_COLOR | RDP_DIRTY_MODES;
+    __rdp_flush_state();
+
+    /* Cover the whole surface. In one cycle mode the bottom right edge of
+       a rectangle is exclusive, so the full size is passed as-is */
+    __rdp_ringbuffer_queue( 0xF6000000 | ( attach_width << 14 ) | ( attach_height << 2 ) );
+    __rdp_ringbuffer_queue( 0 );
+    __rdp_ringbuffer_send();
+
+    mode_sync_needed = true;
+}
+
+/**
+ * @brief Apply a full-surface fade-to-black post-pass
+ *
+ * Darkens the attached surface by the given amount (see #rdp_post_tint).
+ * Sweep the level from 0 to 255 over a few frames for a screen fade.
+ *
+ * @param[in] level
+ *            Fade strength, 0 (no effect) to 255 (fully black)
+ */
+void rdp_post_fade( uint8_t level )
+{
+    rdp_post_tint( 0x00000000, level );
+}
+
+/**
+ * @brief Apply a full-surface white flash post-pass
+ *
+ * Brightens the attached surface toward white by the given amount (see
+ * #rdp_post_tint). Typically flashed for one or two frames on impacts.
+ *
+ * @param[in] level
+ *            Flash strength, 0 (no effect) to 255 (fully white)
+ */
+void rdp_post_flash( uint8_t level )
+{
+    rdp_post_tint( 0xFFFFFF00, level );
+}
+
+/**
+ * @brief Apply a full-surface desaturation post-pass
+ *
+ * Washes out the attached surface by blending it toward mid gray (see
+ * #rdp_post_tint). Note that this is the blender approximation of
+ * desaturation: the hardware cannot compute per-pixel luminance in a
+ * framebuffer pass, so colors lose contrast along with saturation. For
+ * the typical use cases (pause screens, hit-stun effects) the difference
+ * is not noticeable.
+ *
+ * @param[in] level
+ *            Desaturation strength, 0 (no effect) to 255 (flat gray)
+ */
+void rdp_post_desaturate( uint8_t level )
+{
+    rdp_post_tint( 0x80808000, level );
 }
 
 /**
@@ -818,6 +2460,8 @@ void rdp_draw_filled_rectangle( int tx, int ty, int bx, int by )
  */
 void rdp_draw_filled_triangle( float x1, float y1, float x2, float y2, float x3, float y3 )
 {
+    __rdp_flush_state();
+
     float temp_x, temp_y;
     const float to_fixed_11_2 = 4.0f;
     const float to_fixed_16_16 = 65536.0f;
@@ -855,6 +2499,8 @@ void rdp_draw_filled_triangle( float x1, float y1, float x2, float y2, float x3,
     __rdp_ringbuffer_queue( xm );
     __rdp_ringbuffer_queue( dxmdy );
     __rdp_ringbuffer_send();
+
+    mode_sync_needed = true;
 }
 
 /**
@@ -876,4 +2522,48 @@ void rdp_set_texture_flush( flush_t flush )
     flush_strategy = flush;
 }
 
+/**
+ * @brief Invalidate the TMEM residency tracker
+ *
+ * Texture loads are skipped when the exact same sprite region is already
+ * resident in the requested texture slot.  The tracker keys residency on the
+ * sprite pointer, so it cannot detect sprite data being modified in place.
+ * Call this function after changing sprite contents in memory to force the
+ * next load of each slot to actually transfer data into TMEM.
+ */
+void rdp_tmem_invalidate( void )
+{
+    for( int i = 0; i < 8; i++ )
+    {
+        cache[i].sprite = NULL;
+    }
+
+    /* The color lookup table is keyed on the palette pointer the same way */
+    tlut_palette = NULL;
+}
+
+/**
+ * @brief Get the number of texture loads skipped because the texture was
+ *        already resident in TMEM
+ *
+ * Together with #rdp_get_tmem_misses, this can be used to measure how well
+ * draw ordering exploits texture residency: a low hit rate on tile-based
+ * scenes usually means tiles should be drawn grouped by texture.
+ */
+uint32_t rdp_get_tmem_hits( void )
+{
+    return tmem_hits;
+}
+
+/**
+ * @brief Get the number of texture loads that actually transferred data
+ *        into TMEM
+ *
+ * @see #rdp_get_tmem_hits
+ */
+uint32_t rdp_get_tmem_misses( void )
+{
+    return tmem_misses;
+}
+
 /** @} */
@@ -7,9 +7,11 @@
 #include "n64sys.h"
 #include "dma.h"
 #include "debug.h"
+#include "utils.h"
 #include <stdalign.h>
 #include <string.h>
 #include <stdlib.h>
+#include <malloc.h>
 
 #define TOC_MAGIC    0x544F4330         ///< Magic ID "TOC0"
 
@@ -30,6 +32,13 @@ typedef struct {
     char name[];            ///< Name of the file
 } entry_t;
 
+/** @brief TOC header, valid once #toc_cache is set */
+static header_t toc_header;
+/** @brief TOC entries cached in RDRAM (read from ROM once, at first lookup) */
+static uint8_t *toc_cache = NULL;
+/** @brief True if the TOC is missing or corrupted: don't probe the ROM again */
+static bool toc_absent = false;
+
 static bool extension_match(const char *ext, const char *name)
 {
     int ext_len = strlen(ext);
@@ -40,32 +49,55 @@ static bool extension_match(const char *ext, const char *name)
     return strcmp(ext, name + name_len - ext_len) == 0;
 }
 
-uint32_t rompak_search_ext(const char *ext)
+/**
+ * @brief Read the TOC from ROM into the RDRAM cache (once).
+ *
+ * Lookups can run dozens of times in a row (eg: symbol resolution during
+ * backtraces probes the TOC per extension), and PI reads are slow on some
+ * flashcarts, so the TOC is walked over PI only the first time; subsequent
+ * lookups are served from memory. The TOC is tiny (a handful of entries),
+ * so it is kept resident forever.
+ */
+static bool toc_load(void)
 {
-    static bool rompak_corrupted = false;
+    if (toc_cache)
+        return true;
+    if (toc_absent)
+        return false;
 
-    if (rompak_corrupted || io_read(TOC_ADDR) != TOC_MAGIC) {
-        return 0;
+    if (io_read(TOC_ADDR) != TOC_MAGIC) {
+        toc_absent = true;
+        return false;
     }
 
-    header_t header;
-    data_cache_hit_writeback_invalidate(&header, sizeof(header_t));
-    dma_read(&header, TOC_ADDR, sizeof(header_t));
+    data_cache_hit_writeback_invalidate(&toc_header, sizeof(header_t));
+    dma_read(&toc_header, TOC_ADDR, sizeof(header_t));
 
     // These asserts prevent a miscompiled TOC from causing a hard-to-diagnose
-    // stack overflow because of alloca. The number 1024 is arbitrary, we just
-    // want to protect against important corruptions (eg: little-endian / big-endian mistakes).
-    if (header.entry_size >= 1024 || header.num_entries >= 1024) {
-        rompak_corrupted = true;
-        assertf(header.entry_size < 1024, "Corrupted rompak TOC: entry size too big (0x%lx)", header.entry_size);
-        assertf(header.num_entries < 1024, "Corrupted rompak TOC: too many entries (0x%lx)", header.num_entries);
+    // huge allocation. The number 1024 is arbitrary, we just want to protect
+    // against important corruptions (eg: little-endian / big-endian mistakes).
+    if (toc_header.entry_size >= 1024 || toc_header.num_entries >= 1024) {
+        toc_absent = true;
+        assertf(toc_header.entry_size < 1024, "Corrupted rompak TOC: entry size too big (0x%lx)", toc_header.entry_size);
+        assertf(toc_header.num_entries < 1024, "Corrupted rompak TOC: too many entries (0x%lx)", toc_header.num_entries);
+        return false;
     }
 
-    entry_t *entry = alloca(header.entry_size);
-    for (int i=0; i < header.num_entries; i++) {
-        data_cache_hit_writeback_invalidate(entry, header.entry_size);
-        dma_read(entry, TOC_ADDR + sizeof(header_t) + i*header.entry_size, header.entry_size);
+    int size = toc_header.entry_size * toc_header.num_entries;
+    toc_cache = memalign(16, ROUND_UP(size, 16));
+    assertf(toc_cache != NULL, "Out of memory caching rompak TOC (%d bytes)", size);
+    data_cache_hit_writeback_invalidate(toc_cache, ROUND_UP(size, 16));
+    dma_read(toc_cache, TOC_ADDR + sizeof(header_t), size);
+    return true;
+}
+
+uint32_t rompak_search_ext(const char *ext)
+{
+    if (!toc_load())
+        return 0;
 
+    for (int i=0; i < toc_header.num_entries; i++) {
+        entry_t *entry = (entry_t *)(toc_cache + i*toc_header.entry_size);
         if (extension_match(ext, entry->name))
             return 0x10000000 + entry->offset;
     }
@@ -11,12 +11,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <malloc.h>
 #include "rsp.h"
 #include "debug.h"
 #include "console.h"
 #include "regsinternal.h"
 #include "n64sys.h"
 #include "interrupt.h"
+#include "timer.h"
+#include "utils.h"
 
 /**
  * RSP crash handler ucode (rsp_crash.S)
@@ -29,6 +32,18 @@ static volatile struct SP_regs_s * const SP_regs = (struct SP_regs_s *)0xa404000
 /** @brief Current ucode being loaded */
 static rsp_ucode_t *cur_ucode = NULL;
 
+/** @brief IMEM offset at which the current ucode's code was loaded */
+static uint32_t cur_pc_offset = 0;
+
+/** @brief Ucode resident in each IMEM partition (see #rsp_load_partitioned) */
+static rsp_ucode_t *part_ucode[2] = { NULL, NULL };
+
+/** @brief Number of IMEM code reloads performed by #rsp_load / #rsp_load_partitioned */
+static uint32_t ucode_reloads = 0;
+
+/** @brief Number of loads satisfied by already-resident code */
+static uint32_t ucode_hits = 0;
+
 /**
  * @brief Wait until the SI is finished with a DMA request
  */
@@ -54,11 +69,55 @@ void rsp_init(void)
 }
 
 void rsp_load(rsp_ucode_t *ucode) {
-    if (cur_ucode != ucode) {
+    if (cur_ucode != ucode || cur_pc_offset != 0) {
         rsp_load_code(ucode->code, (uint8_t*)ucode->code_end - ucode->code, 0);
         rsp_load_data(ucode->data, (uint8_t*)ucode->data_end - ucode->data, 0);
         cur_ucode = ucode;
+        ucode_reloads++;
+    } else {
+        ucode_hits++;
+    }
+}
+
+void rsp_load_partitioned(rsp_ucode_t *ucode, int partition) {
+    assertf(partition == 0 || partition == 1, "invalid IMEM partition: %d", partition);
+    uint32_t code_size = (uint8_t*)ucode->code_end - ucode->code;
+    assertf(code_size <= 2048, "ucode %s too large for an IMEM partition: %ld bytes",
+        ucode->name, code_size);
+
+    uint32_t offset = partition * 2048;
+    if (cur_ucode == ucode && cur_pc_offset == offset) {
+        ucode_hits++;
+        return;
+    }
+
+    if (part_ucode[partition] != ucode) {
+        /* Code not resident in this partition: DMA it in. rsp_load_code
+           invalidates the residency tracking, so refresh it afterwards. */
+        rsp_ucode_t *other = part_ucode[1 - partition];
+        rsp_load_code(ucode->code, code_size, offset);
+        part_ucode[partition] = ucode;
+        part_ucode[1 - partition] = other;
+        ucode_reloads++;
+    } else {
+        ucode_hits++;
     }
+
+    /* DMEM is not partitioned: the incoming ucode's data segment is loaded
+       on every switch, exactly like rsp_load does. */
+    rsp_load_data(ucode->data, (uint8_t*)ucode->data_end - ucode->data, 0);
+    cur_ucode = ucode;
+    cur_pc_offset = offset;
+}
+
+void rsp_load_stats(uint32_t *reloads, uint32_t *hits) {
+    if (reloads) *reloads = ucode_reloads;
+    if (hits) *hits = ucode_hits;
+}
+
+void rsp_load_stats_reset(void) {
+    ucode_reloads = 0;
+    ucode_hits = 0;
 }
 
 void rsp_load_code(void* start, unsigned long size, unsigned int imem_offset)
@@ -69,6 +128,10 @@ void rsp_load_code(void* start, unsigned long size, unsigned int imem_offset)
     if (cur_ucode != NULL) {
         cur_ucode = NULL;
     }
+    // Arbitrary IMEM writes invalidate both the run dispatch offset and
+    // the partitioned residency tracking.
+    cur_pc_offset = 0;
+    part_ucode[0] = part_ucode[1] = NULL;
 
     disable_interrupts();
     __SP_DMA_wait();
@@ -144,11 +207,153 @@ void rsp_read_data(void* start, unsigned long size, unsigned int dmem_offset)
     enable_interrupts();
 }
 
+/** @brief Telemetry: one watched DMEM region (see #rsp_telemetry_add) */
+typedef struct {
+    uint32_t dmem_offset;            ///< DMEM byte offset of the watched region
+    uint32_t size;                   ///< Size of the region in bytes
+    int sync_offset;                 ///< DMEM byte offset of the ucode sync word (-1 = none)
+    uint8_t *samples;                ///< Ring of captured samples
+    uint32_t stride;                 ///< Bytes per ring entry (header + padded body)
+    int num_samples;                 ///< Capacity of the ring
+    int head;                        ///< Next ring slot to capture into
+    uint32_t captures;               ///< Total number of captures performed
+    rsp_telemetry_sample_t *latest;  ///< Most recent complete sample (NULL = none yet)
+} rsp_telemetry_region_t;
+
+/** @brief Telemetry: watched regions */
+static rsp_telemetry_region_t telemetry_regions[RSP_TELEMETRY_MAX_REGIONS];
+/** @brief Telemetry: number of registered regions */
+static int telemetry_num_regions = 0;
+/** @brief Telemetry: periodic capture timer (NULL = never started) */
+static timer_link_t *telemetry_timer = NULL;
+
+/**
+ * @brief DMA a DMEM region to RDRAM without disturbing a running RSP
+ *
+ * Same transfer as #rsp_read_data, but meant to run while the RSP is
+ * executing: it also waits for #SP_STATUS_DMA_FULL, so a transfer the ucode
+ * has already queued is not overwritten, and it does not touch the halt
+ * state. Runs in interrupt context (no interrupt bracketing needed).
+ */
+static void __rsp_telemetry_dma(void *dest, uint32_t size, uint32_t dmem_offset)
+{
+    data_cache_hit_writeback_invalidate(dest, size);
+
+    while (SP_regs->status & (SP_STATUS_DMA_BUSY | SP_STATUS_DMA_FULL | SP_STATUS_IO_BUSY)) ;
+
+    SP_regs->DRAM_addr = dest;
+    MEMORY_BARRIER();
+    SP_regs->RSP_addr = SP_DMEM + dmem_offset/4;
+    MEMORY_BARRIER();
+    SP_regs->rsp_write_length = size - 1;
+    MEMORY_BARRIER();
+    while (SP_regs->status & (SP_STATUS_DMA_BUSY | SP_STATUS_IO_BUSY)) ;
+}
+
+/** @brief Timer callback: capture every registered telemetry region */
+static void __rsp_telemetry_capture(int ovfl)
+{
+    for (int i = 0; i < telemetry_num_regions; i++)
+    {
+        rsp_telemetry_region_t *r = &telemetry_regions[i];
+        rsp_telemetry_sample_t *s = (rsp_telemetry_sample_t *)(r->samples + r->head * r->stride);
+
+        /* Bracket the DMA with direct reads of the ucode sync word: if it
+           changed (or was odd, ie: an update was in flight), the capture
+           may mix old and new state and is flagged as torn. */
+        uint32_t sync0 = 0, sync1 = 0;
+        if (r->sync_offset >= 0)
+            sync0 = SP_DMEM[r->sync_offset / 4];
+
+        __rsp_telemetry_dma(s->data, r->size, r->dmem_offset);
+
+        if (r->sync_offset >= 0)
+            sync1 = SP_DMEM[r->sync_offset / 4];
+
+        s->seqno = ++r->captures;
+        s->ticks = TICKS_READ();
+        s->sync = sync1;
+        s->torn = r->sync_offset >= 0 && (sync0 != sync1 || (sync0 & 1));
+
+        /* Publish the sample only once complete: readers polling
+           rsp_telemetry_latest never see a partial capture. */
+        r->latest = s;
+        r->head = (r->head + 1) % r->num_samples;
+    }
+}
+
+int rsp_telemetry_add(uint32_t dmem_offset, uint32_t size, int sync_offset, int num_samples)
+{
+    assertf(telemetry_num_regions < RSP_TELEMETRY_MAX_REGIONS,
+        "too many telemetry regions (max %d)", RSP_TELEMETRY_MAX_REGIONS);
+    assertf((dmem_offset % 8) == 0 && (size % 8) == 0 && dmem_offset + size <= 4096,
+        "telemetry regions must be 8-byte aligned and within DMEM");
+    assertf(sync_offset < 0 || ((sync_offset % 4) == 0 && sync_offset < 4096),
+        "the telemetry sync word must be a 32-bit word in DMEM");
+    assertf(num_samples >= 1, "the telemetry sample ring needs at least one entry");
+
+    rsp_telemetry_region_t *r = &telemetry_regions[telemetry_num_regions];
+
+    r->dmem_offset = dmem_offset;
+    r->size = size;
+    r->sync_offset = sync_offset;
+    /* Keep every header and body cacheline-aligned: the DMA invalidates the
+       body's lines, and must not take the CPU-written header with it. */
+    r->stride = sizeof(rsp_telemetry_sample_t) + ROUND_UP(size, 16);
+    r->num_samples = num_samples;
+    r->head = 0;
+    r->captures = 0;
+    r->latest = NULL;
+    r->samples = memalign(16, r->stride * num_samples);
+    assert(r->samples != NULL);
+
+    return telemetry_num_regions++;
+}
+
+void rsp_telemetry_start(uint32_t period_us)
+{
+    assertf(telemetry_num_regions > 0, "no telemetry regions registered");
+
+    if (!telemetry_timer)
+        telemetry_timer = new_timer(TIMER_TICKS(period_us), TF_CONTINUOUS, __rsp_telemetry_capture);
+    else
+        start_timer(telemetry_timer, TIMER_TICKS(period_us), TF_CONTINUOUS, __rsp_telemetry_capture);
+}
+
+void rsp_telemetry_stop(void)
+{
+    if (telemetry_timer)
+        stop_timer(telemetry_timer);
+}
+
+const rsp_telemetry_sample_t *rsp_telemetry_latest(int region)
+{
+    assert(region >= 0 && region < telemetry_num_regions);
+    return telemetry_regions[region].latest;
+}
+
+void rsp_telemetry_close(void)
+{
+    if (telemetry_timer)
+    {
+        delete_timer(telemetry_timer);
+        telemetry_timer = NULL;
+    }
+
+    for (int i = 0; i < telemetry_num_regions; i++)
+    {
+        free(telemetry_regions[i].samples);
+        telemetry_regions[i].samples = NULL;
+        telemetry_regions[i].latest = NULL;
+    }
+    telemetry_num_regions = 0;
+}
+
 /** @brief Internal implementation of #rsp_run_async */
 void __rsp_run_async(uint32_t status_flags)
 {
-    // set RSP program counter
-    *SP_PC = cur_ucode ? cur_ucode->start_pc : 0;
+    // set RSP program counter, dispatching into the resident IMEM partition
+    *SP_PC = cur_ucode ? cur_ucode->start_pc + cur_pc_offset : 0;
     MEMORY_BARRIER();
     *SP_STATUS = SP_WSTATUS_CLEAR_HALT | SP_WSTATUS_CLEAR_BROKE | status_flags;
 }
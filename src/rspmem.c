@@ -0,0 +1,74 @@
+/**
+ * @file rspmem.c
+ * @brief RSP bulk memory operations
+ * @ingroup rspmem
+ *
+ * CPU-side glue for the bulk memory overlay. See rspmem.h for the API
+ * documentation, and rsp_mem.S for the RSP-side streaming loops.
+ */
+
+#include "rspmem.h"
+#include "rspq.h"
+#include "rsp.h"
+#include "n64sys.h"
+#include "debug.h"
+
+/** @brief Overlay commands (see rsp_mem.S) */
+enum {
+    MEM_CMD_COPY = 0x0,     ///< Copy a block of RDRAM through DMEM
+    MEM_CMD_SET  = 0x1,     ///< Fill a block of RDRAM with a pattern
+};
+
+/** The bulk memory ucode */
+DEFINE_RSP_UCODE(rsp_mem);
+
+/** @brief Overlay ID assigned to the ucode (0 if not initialized) */
+static uint32_t mem_ovl_id;
+
+void rspmem_init(void)
+{
+    if (mem_ovl_id)
+        return;
+
+    rspq_init();
+    mem_ovl_id = rspq_overlay_register(&rsp_mem);
+}
+
+void rspmem_close(void)
+{
+    if (!mem_ovl_id)
+        return;
+
+    rspq_overlay_unregister(mem_ovl_id);
+    mem_ovl_id = 0;
+}
+
+/** @brief Validate the arguments shared by both operations */
+static void __rspmem_check(void *dst, uint32_t len)
+{
+    assertf(mem_ovl_id, "rspmem not initialized: call rspmem_init first");
+    assertf(((uint32_t)dst & 7) == 0, "destination must be 8-byte aligned: %p", dst);
+    assertf((len & 7) == 0, "length must be a multiple of 8: %ld", len);
+    assertf(len < (1<<24), "length too large: %ld", len);
+}
+
+void rsp_memcpy(void *dst, const void *src, uint32_t len)
+{
+    __rspmem_check(dst, len);
+    assertf(((uint32_t)src & 7) == 0, "source must be 8-byte aligned: %p", src);
+    if (!len)
+        return;
+
+    rspq_write(mem_ovl_id, MEM_CMD_COPY, len,
+        PhysicalAddr(dst), PhysicalAddr(src));
+}
+
+void rsp_memset(void *dst, uint32_t pattern, uint32_t len)
+{
+    __rspmem_check(dst, len);
+    if (!len)
+        return;
+
+    rspq_write(mem_ovl_id, MEM_CMD_SET, len,
+        PhysicalAddr(dst), pattern);
+}
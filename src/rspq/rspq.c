@@ -170,6 +170,7 @@
 #include "rspq.h"
 #include "rspq_constants.h"
 #include "interrupt.h"
+#include "timer.h"
 #include "utils.h"
 #include "n64sys.h"
 #include "debug.h"
@@ -275,7 +276,17 @@ enum {
      * interrupt to be processed (coalescing interrupts would cause syncpoints
      * to be missed).
      */
-    RSPQ_CMD_TEST_WRITE_STATUS = 0x08
+    RSPQ_CMD_TEST_WRITE_STATUS = 0x08,
+
+    /**
+     * @brief RSPQ Command: Prefetch an overlay
+     *
+     * This command loads the specified overlay into IMEM/DMEM without
+     * executing any of its commands, so that the load cost is paid at a
+     * point chosen by the CPU rather than at the first command of the
+     * overlay. See #rspq_overlay_prefetch.
+     */
+    RSPQ_CMD_PREFETCH_OVERLAY  = 0x09
 };
 
 
@@ -381,10 +392,22 @@ typedef struct rsp_queue_s {
     uint32_t rspq_pointer_stack[RSPQ_MAX_BLOCK_NESTING_LEVEL];
     uint32_t rspq_dram_lowpri_addr;      ///< Address of the lowpri queue (special slot in the pointer stack)
     uint32_t rspq_dram_highpri_addr;     ///< Address of the highpri queue  (special slot in the pointer stack)
+    uint32_t rspq_dram_generated_addr;   ///< Return position for RSP-generated lists (special slot in the pointer stack)
     uint32_t rspq_dram_addr;             ///< Current RDRAM address being processed
     int16_t current_ovl;                 ///< Current overlay index
+#if RSPQ_PROFILE
+    uint16_t profile_padding;            ///< Padding (to match DMEM alignment)
+    uint32_t profile_last_clock;         ///< DP_CLOCK value at the last profiling sample
+    rspq_profile_slot_t profile_slots[RSPQ_MAX_OVERLAY_COUNT]; ///< Per-overlay profiling counters
+#endif
 } __attribute__((aligned(16), packed)) rsp_queue_t;
 
+#if RSPQ_PROFILE
+/// @cond
+_Static_assert(RSPQ_PROFILE_SLOT_COUNT == RSPQ_MAX_OVERLAY_COUNT);
+/// @endcond
+#endif
+
 /** @brief Address of the RSPQ data header in DMEM (see #rsp_queue_t) */
 #define RSPQ_DATA_ADDRESS                32
 
@@ -440,6 +463,29 @@ static rsp_queue_t rspq_data;
 /** @brief True if the queue system has been initialized. */
 static bool rspq_initialized = 0;
 
+/** @brief Size of the lowpri queue buffers (in words), configurable before #rspq_init. */
+static int rspq_lowpri_buf_size = RSPQ_DRAM_LOWPRI_BUFFER_SIZE;
+/** @brief Size of the highpri queue buffers (in words), configurable before #rspq_init. */
+static int rspq_highpri_buf_size = RSPQ_DRAM_HIGHPRI_BUFFER_SIZE;
+
+/** @brief Queue usage statistics (see #rspq_get_stats). */
+static rspq_stats_t rspq_stats;
+
+/** @brief Highpri usage statistics (see #rspq_highpri_get_stats). */
+static rspq_highpri_stats_t rspq_highpri_stats;
+/** @brief True while a highpri occupancy period is open (lowpri starved). */
+static bool rspq_hp_active = false;
+/** @brief #TICKS_READ timestamp of the start of the current occupancy period. */
+static uint32_t rspq_hp_active_since;
+/** @brief Highpri budget slice in hardware ticks (0: budget mode disabled). */
+static uint32_t rspq_hp_budget_slice = 0;
+/** @brief Duration of a forced yield to lowpri, in hardware ticks. */
+static uint32_t rspq_hp_budget_gap = 0;
+/** @brief One-shot timer ending a forced yield (NULL until budget mode is used). */
+static timer_link_t *rspq_hp_budget_timer = NULL;
+/** @brief True while a highpri request is being held back by a forced yield. */
+static volatile bool rspq_hp_deferred = false;
+
 /** @brief Pointer to the current block being built, or NULL. */
 static rspq_block_t *rspq_block;
 /** @brief Size of the current block memory buffer (in 32-bit words). */
@@ -450,12 +496,37 @@ static int rspq_syncpoints_genid;
 /** @brief ID of the last syncpoint reached by RSP. */
 static volatile int rspq_syncpoints_done;
 
+/** @brief A pending syncpoint callback (see #rspq_syncpoint_new_cb). */
+typedef struct rspq_syncpoint_cb_s {
+    rspq_syncpoint_t sync_id;   ///< Syncpoint the callback is waiting for (0 = slot free)
+    void (*func)(void *ctx);    ///< Callback function
+    void *ctx;                  ///< Callback context
+} rspq_syncpoint_cb_t;
+
+/** @brief Pool of pending syncpoint callbacks. */
+static rspq_syncpoint_cb_t rspq_syncpoint_callbacks[RSPQ_MAX_SYNCPOINT_CALLBACKS];
+
 /** @brief True if the RSP queue engine is running in the RSP. */
 static bool rspq_is_running;
 
 /** @brief Dummy state used for overlay 0 */
 static uint64_t dummy_overlay_state;
 
+/** @brief Trace capture state (see #rspq_trace_start). */
+static struct {
+    uint32_t *buffer;               ///< Destination buffer provided by the user (NULL = not tracing)
+    int size;                       ///< Size of the destination buffer in words
+    int wpos;                       ///< Number of words captured so far
+    volatile uint32_t *mark;        ///< Position in the queue up to which we have captured
+    bool overflow;                  ///< True if the capture buffer overflowed
+} rspq_trace;
+
+/** @brief Staging buffer for commands written from interrupt context
+ *         (see #rspq_write_deferred). */
+static uint32_t rspq_deferred_buf[RSPQ_DEFERRED_BUFFER_SIZE];
+/** @brief Number of words currently staged in #rspq_deferred_buf. */
+static volatile int rspq_deferred_wpos;
+
 static void rspq_flush_internal(void);
 
 /** @brief RSP interrupt handler, used for syncpoints. */
@@ -469,6 +540,17 @@ static void rspq_sp_interrupt(void)
     if (status & SP_STATUS_SIG_SYNCPOINT) {
         wstatus |= SP_WSTATUS_CLEAR_SIG_SYNCPOINT;
         ++rspq_syncpoints_done;
+
+        // Fire the callbacks registered for syncpoints that have been
+        // crossed. Notice that we are under interrupt here, so the callbacks
+        // must behave accordingly (see #rspq_syncpoint_new_cb).
+        for (int i = 0; i < RSPQ_MAX_SYNCPOINT_CALLBACKS; i++) {
+            rspq_syncpoint_cb_t *cb = &rspq_syncpoint_callbacks[i];
+            if (cb->sync_id && rspq_syncpoint_check(cb->sync_id)) {
+                cb->sync_id = 0;
+                cb->func(cb->ctx);
+            }
+        }
     }
 
     MEMORY_BARRIER();
@@ -528,6 +610,168 @@ static void rspq_crash_handler(rsp_snapshot_t *state)
     }
 }
 
+/**
+ * @brief Report the valid tail of the current queue buffer (for crash dumps).
+ *
+ * Used by the flight recorder (referenced as a weak symbol, so that it does
+ * not force rspq into the link) to include the most recent commands in a
+ * crash dump. Returns the writable range [start, end) of the buffer being
+ * built; while a block is being recorded the buffer bounds are unknown, so
+ * an empty range is returned.
+ */
+void __rspq_crash_tail(uint32_t **start, uint32_t **end)
+{
+    *start = *end = NULL;
+    if (!rspq_cur_pointer)
+        return;
+    *end = (uint32_t*)rspq_cur_pointer;
+    *start = rspq_ctx ? (uint32_t*)rspq_ctx->buffers[rspq_ctx->buf_idx] : *end;
+}
+
+/** @brief Names and sizes (in bytes) of the builtin engine commands, for #__rspq_inspector_dump. */
+static const struct { const char *name; uint8_t size; } rspq_internal_command_descs[] = {
+    { "WAIT_NEW_INPUT",    0 },  { "NOOP",              4 },
+    { "JUMP",              4 },  { "CALL",              8 },
+    { "RET",               4 },  { "DMA",              16 },
+    { "WRITE_STATUS",      4 },  { "SWAP_BUFFERS",     12 },
+    { "TEST_WRITE_STATUS", 8 },  { "PREFETCH_OVERLAY",  4 },
+};
+
+/**
+ * @brief Disassemble one queue command for #__rspq_inspector_dump.
+ *
+ * Decodes the overlay and command ID of the command starting at \p cmd, using
+ * the registered overlay names and the same command tables the RSP itself
+ * dispatches from (so the command size is known and the walk can continue at
+ * the next command). Returns the command size in words, or 0 if the word is
+ * not a valid command start (that is, the end of the written data).
+ */
+static int rspq_disasm_cmd(FILE *out, uint32_t *cmd)
+{
+    uint8_t cmd_byte = cmd[0] >> 24;
+    int size;
+
+    if (cmd_byte == RSPQ_CMD_INVALID)
+        return 0;
+
+    if (cmd_byte < 0x10) {
+        // Builtin command of the queue engine (overlay ID 0)
+        if (cmd_byte >= sizeof(rspq_internal_command_descs) / sizeof(rspq_internal_command_descs[0]))
+            return 0;
+        size = rspq_internal_command_descs[cmd_byte].size;
+        fprintf(out, "    %08lx  rspq+%02x %s", cmd[0], cmd_byte, rspq_internal_command_descs[cmd_byte].name);
+    } else {
+        // Overlay command: resolve the overlay via the same table the RSP uses
+        int ovl_idx = rspq_data.tables.overlay_table[cmd_byte >> 4] / sizeof(rspq_overlay_t);
+        if (ovl_idx == 0 || ovl_idx >= RSPQ_MAX_OVERLAY_COUNT || !rspq_overlay_ucodes[ovl_idx]) {
+            fprintf(out, "    %08lx  <unregistered overlay 0x%x>\n", cmd[0], cmd_byte >> 4);
+            return 1;
+        }
+        rsp_ucode_t *uc = rspq_overlay_ucodes[ovl_idx];
+        uint32_t rspq_data_size = rsp_queue_data_end - rsp_queue_data_start;
+        rspq_overlay_header_t *hdr = (rspq_overlay_header_t*)(uc->data + rspq_data_size);
+        // command_base is the byte offset of the overlay's base slot in the
+        // halfword command table, so >>1 yields the base command byte.
+        int cmd_idx = cmd_byte - (hdr->command_base >> 1);
+        uint16_t entry = (cmd_idx >= 0 && cmd_idx < RSPQ_MAX_OVERLAY_COMMAND_COUNT)
+            ? hdr->commands[cmd_idx] : 0;
+        if (entry == 0) {
+            fprintf(out, "    %08lx  %s+%02x <invalid command>\n", cmd[0], uc->name, cmd_idx);
+            return 1;
+        }
+        size = (entry >> 8) & 0xFC;
+        fprintf(out, "    %08lx  %s+%02x", cmd[0], uc->name, cmd_idx);
+    }
+
+    int words = size / 4 > 0 ? size / 4 : 1;
+    for (int i = 1; i < words && i < 4; i++)
+        fprintf(out, " %08lx", cmd[i]);
+    if (words > 4)
+        fprintf(out, " ...");
+    fprintf(out, "\n");
+    return words;
+}
+
+/**
+ * @brief Dump the live rspq state (inspector hook).
+ *
+ * Called by the inspector (via a weak reference, so that merely linking the
+ * inspector does not force rspq into the binary) to decode the current state
+ * of the queue when diagnosing a stall: write pointers and fill level of both
+ * queues, the RSP fetch position, the highpri signals, the current overlay,
+ * and the commands in the current fetch window disassembled by overlay.
+ * \p out is either the inspector screen (stdout) or the debugging channel
+ * (stderr), so everything is printed as plain text.
+ */
+void __rspq_inspector_dump(FILE *out)
+{
+    if (!rspq_initialized) {
+        fprintf(out, "rspq not initialized\n");
+        return;
+    }
+
+    uint32_t status = *SP_STATUS;
+
+    // Fetch the live queue engine state from DMEM. If the RSP is still
+    // running this is racy, but the inspector only needs a diagnostic
+    // snapshot, and a stalled RSP (the interesting case) is not moving.
+    rsp_queue_t rspq __attribute__((aligned(16)));
+    rsp_read_data(&rspq, sizeof(rspq), RSPQ_DATA_ADDRESS);
+
+    int ovl_idx; const char *ovl_name;
+    rspq_get_current_ovl(&rspq, &ovl_idx, &ovl_name);
+
+    fprintf(out, "SP status: %04lx (%s%s%s%s)\n", status,
+        status & SP_STATUS_HALTED ? "halted" : "running",
+        status & SP_STATUS_BROKE ? " broke" : "",
+        status & SP_STATUS_SIG_HIGHPRI_REQUESTED ? " highpri-requested" : "",
+        status & SP_STATUS_SIG_HIGHPRI_RUNNING ? " highpri-running" : "");
+    if ((status & SP_STATUS_SIG_HIGHPRI_REQUESTED) && !(status & SP_STATUS_SIG_HIGHPRI_RUNNING))
+        fprintf(out, "highpri: requested but not entered; RSP is stuck before the queue switch\n");
+    else if (status & SP_STATUS_SIG_HIGHPRI_RUNNING)
+        fprintf(out, "highpri: running; the lowpri queue is paused behind it\n");
+
+    rspq_ctx_t *ctxs[2] = { &lowpri, &highpri };
+    const char *ctx_names[2] = { "Lowpri ", "Highpri" };
+    for (int i = 0; i < 2; i++) {
+        rspq_ctx_t *ctx = ctxs[i];
+        // The write pointer of the current context lives in the global copy
+        volatile uint32_t *cur = ctx == rspq_ctx ? rspq_cur_pointer : ctx->cur;
+        uint32_t buf_start = PhysicalAddr(ctx->buffers[ctx->buf_idx]);
+        fprintf(out, "%s queue: write ptr %08lx (buf %d: %08lx, %d/%d words)%s\n",
+            ctx_names[i], PhysicalAddr(cur), ctx->buf_idx, buf_start,
+            (int)(cur - (volatile uint32_t*)ctx->buffers[ctx->buf_idx]), ctx->buf_size,
+            ctx == rspq_ctx ? " <- current" : "");
+        if (rspq.rspq_dram_addr >= buf_start && rspq.rspq_dram_addr < buf_start + ctx->buf_size*4)
+            fprintf(out, "%s queue: ~%d words pending (fetch granularity: one DMEM refill)\n",
+                ctx_names[i], (int)(PhysicalAddr(cur) - rspq.rspq_dram_addr) / 4);
+    }
+    if (!rspq_ctx)
+        fprintf(out, "(a block is being recorded; write ptr %08lx)\n", PhysicalAddr(rspq_cur_pointer));
+
+    fprintf(out, "RSP fetch address: %08lx (saved lowpri: %08lx, highpri: %08lx)\n",
+        rspq.rspq_dram_addr, rspq.rspq_dram_lowpri_addr, rspq.rspq_dram_highpri_addr);
+    fprintf(out, "Current overlay: %s (0x%x)\n", ovl_name, ovl_idx);
+
+    if (rspq.rspq_dram_addr == 0)
+        return;
+
+    // Walk the commands in the buffer the RSP is currently fetching from,
+    // starting at the last refill point: these are the most recently executed
+    // and the pending commands, in execution order.
+    fprintf(out, "Commands at the fetch address (oldest first):\n");
+    uint32_t *q = (uint32_t*)(0xA0000000 | (rspq.rspq_dram_addr & 0xFFFFFF));
+    int words = 0;
+    for (int i = 0; i < 16 && words < 64; i++) {
+        int n = rspq_disasm_cmd(out, q + words);
+        if (n == 0) {
+            fprintf(out, "    <end of written commands>\n");
+            break;
+        }
+        words += n;
+    }
+}
+
 /** @brief Special RSP assert handler for ASSERT_INVALID_COMMAND */
 static void rspq_assert_invalid_command(rsp_snapshot_t *state)
 {
@@ -672,6 +916,29 @@ static void rspq_close_context(rspq_ctx_t *ctx)
     free_uncached(ctx->buffers[0]);
 }
 
+void rspq_config_buffer_size(int lowpri_words, int highpri_words)
+{
+    assertf(!rspq_initialized, "rspq_config_buffer_size must be called before rspq_init");
+    assertf(lowpri_words >= RSPQ_MAX_COMMAND_SIZE*2 && highpri_words >= RSPQ_MAX_COMMAND_SIZE*2,
+        "queue buffers must be at least %d words", RSPQ_MAX_COMMAND_SIZE*2);
+    rspq_lowpri_buf_size = lowpri_words;
+    rspq_highpri_buf_size = highpri_words;
+}
+
+void rspq_get_stats(rspq_stats_t *stats)
+{
+    disable_interrupts();
+    *stats = rspq_stats;
+    enable_interrupts();
+}
+
+void rspq_reset_stats(void)
+{
+    disable_interrupts();
+    memset(&rspq_stats, 0, sizeof(rspq_stats));
+    enable_interrupts();
+}
+
 void rspq_init(void)
 {
     // Do nothing if rspq_init has already been called
@@ -682,13 +949,19 @@ void rspq_init(void)
     rspq_cur_pointer = NULL;
     rspq_cur_sentinel = NULL;
 
+    // Reset usage statistics
+    memset(&rspq_stats, 0, sizeof(rspq_stats));
+    memset(&rspq_highpri_stats, 0, sizeof(rspq_highpri_stats));
+    rspq_hp_active = false;
+    rspq_hp_deferred = false;
+
     // Allocate RSPQ contexts
-    rspq_init_context(&lowpri, RSPQ_DRAM_LOWPRI_BUFFER_SIZE);
+    rspq_init_context(&lowpri, rspq_lowpri_buf_size);
     lowpri.sp_status_bufdone = SP_STATUS_SIG_BUFDONE_LOW;
     lowpri.sp_wstatus_set_bufdone = SP_WSTATUS_SET_SIG_BUFDONE_LOW;
     lowpri.sp_wstatus_clear_bufdone = SP_WSTATUS_CLEAR_SIG_BUFDONE_LOW;
 
-    rspq_init_context(&highpri, RSPQ_DRAM_HIGHPRI_BUFFER_SIZE);
+    rspq_init_context(&highpri, rspq_highpri_buf_size);
     highpri.sp_status_bufdone = SP_STATUS_SIG_BUFDONE_HIGH;
     highpri.sp_wstatus_set_bufdone = SP_WSTATUS_SET_SIG_BUFDONE_HIGH;
     highpri.sp_wstatus_clear_bufdone = SP_WSTATUS_CLEAR_SIG_BUFDONE_HIGH;
@@ -740,9 +1013,17 @@ static void rspq_stop(void)
 void rspq_close(void)
 {
     rspq_stop();
-    
+
     rspq_initialized = 0;
 
+    if (rspq_hp_budget_timer) {
+        delete_timer(rspq_hp_budget_timer);
+        rspq_hp_budget_timer = NULL;
+        rspq_hp_budget_slice = 0;
+        rspq_hp_budget_gap = 0;
+        rspq_hp_deferred = false;
+    }
+
     rspq_close_context(&highpri);
     rspq_close_context(&lowpri);
 
@@ -988,6 +1269,60 @@ void rspq_overlay_unregister(uint32_t overlay_id)
  * we need to switch buffer (double buffering strategy), making sure the
  * other buffer has been already fully executed by the RSP.
  */
+/** @brief Append the commands written since the last capture mark to the trace. */
+static void rspq_trace_capture(void)
+{
+    if (!rspq_trace.buffer || rspq_ctx != &lowpri)
+        return;
+
+    int nwords = rspq_cur_pointer - rspq_trace.mark;
+    if (nwords > rspq_trace.size - rspq_trace.wpos) {
+        nwords = rspq_trace.size - rspq_trace.wpos;
+        rspq_trace.overflow = true;
+    }
+    memcpy(&rspq_trace.buffer[rspq_trace.wpos], (const uint32_t*)rspq_trace.mark,
+        nwords * sizeof(uint32_t));
+    rspq_trace.wpos += nwords;
+    rspq_trace.mark = rspq_cur_pointer;
+}
+
+void rspq_trace_start(uint32_t *buffer, int size)
+{
+    assertf(!rspq_trace.buffer, "a trace capture is already in progress");
+    assertf(rspq_ctx == &lowpri, "trace capture must be started from the lowpri queue");
+    rspq_trace.buffer = buffer;
+    rspq_trace.size = size;
+    rspq_trace.wpos = 0;
+    rspq_trace.overflow = false;
+    rspq_trace.mark = rspq_cur_pointer;
+}
+
+int rspq_trace_stop(void)
+{
+    assertf(rspq_trace.buffer, "no trace capture in progress");
+    rspq_trace_capture();
+    rspq_trace.buffer = NULL;
+    if (rspq_trace.overflow)
+        debugf("rspq_trace: capture buffer overflow, trace is truncated\n");
+    return rspq_trace.wpos;
+}
+
+rspq_block_t* rspq_trace_to_block(const uint32_t *words, int nwords)
+{
+    // Wrap the captured stream into a block, so that it can be replayed
+    // with #rspq_block_run without having to split it at (unknown) command
+    // boundaries. Captured streams do not contain the internal
+    // buffer-management commands (they are filtered out at capture time),
+    // so terminating them with a RET makes them valid blocks.
+    rspq_block_t *b = malloc_uncached(sizeof(rspq_block_t) + (nwords+1)*sizeof(uint32_t));
+    // Use the top nesting level: the captured stream might contain CALLs
+    // to blocks of any level, and this block must not clash with them.
+    b->nesting_level = RSPQ_MAX_BLOCK_NESTING_LEVEL-1;
+    memcpy(b->cmds, words, nwords * sizeof(uint32_t));
+    b->cmds[nwords] = (RSPQ_CMD_RET<<24) | (b->nesting_level<<2);
+    return b;
+}
+
 __attribute__((noinline))
 void rspq_next_buffer(void) {
     // If we're creating a block
@@ -1006,6 +1341,13 @@ void rspq_next_buffer(void) {
         return;
     }
 
+    // Keep track of queue usage: count the switch, and record the number of
+    // words that were written into the buffer being retired.
+    rspq_stats.switches++;
+    int used = rspq_cur_pointer - (uint32_t*)rspq_ctx->buffers[rspq_ctx->buf_idx];
+    if (used > rspq_stats.highwater_mark)
+        rspq_stats.highwater_mark = used;
+
     // Wait until the previous buffer is executed by the RSP.
     // We cannot write to it if it's still being executed.
     // FIXME: this should probably transition to a sync-point,
@@ -1013,20 +1355,31 @@ void rspq_next_buffer(void) {
     // if the overhead of an interrupt is obviously higher.
     MEMORY_BARRIER();
     if (!(*SP_STATUS & rspq_ctx->sp_status_bufdone)) {
+        // The CPU is outpacing the RSP: record how long we stall here, so
+        // that applications can size the queue buffers from measurements
+        // instead of guessing.
+        rspq_stats.stalls++;
+        uint32_t stall_start = TICKS_READ();
         rspq_flush_internal();
         RSP_WAIT_LOOP(200) {
             if (*SP_STATUS & rspq_ctx->sp_status_bufdone)
                 break;
         }
+        rspq_stats.stall_ticks += TICKS_DISTANCE(stall_start, TICKS_READ());
     }
     MEMORY_BARRIER();
     *SP_STATUS = rspq_ctx->sp_wstatus_clear_bufdone;
     MEMORY_BARRIER();
 
+    // If a trace capture is in progress, save the commands written into this
+    // buffer before it is terminated and recycled.
+    rspq_trace_capture();
+
     // Switch current buffer
     rspq_ctx->buf_idx = 1-rspq_ctx->buf_idx;
     uint32_t *new = rspq_ctx->buffers[rspq_ctx->buf_idx];
     volatile uint32_t *prev = rspq_switch_buffer(new, rspq_ctx->buf_size, true);
+    if (rspq_trace.buffer) rspq_trace.mark = rspq_cur_pointer;
 
     // Terminate the previous buffer with an op to set SIG_BUFDONE
     // (to notify when the RSP finishes the buffer), plus a jump to
@@ -1063,14 +1416,150 @@ static void rspq_flush_internal(void)
     MEMORY_BARRIER();
 }
 
+bool rspq_write_deferred(const uint32_t *words, int nwords)
+{
+    assertf(nwords > 0 && nwords <= RSPQ_DEFERRED_BUFFER_SIZE,
+        "invalid deferred write size (%d words)", nwords);
+    assertf(words[0]>>24 != 0, "first word of a deferred write must contain a command ID");
+
+    // Append to the staging buffer. Interrupts are disabled for the copy, so
+    // this is safe both from interrupt handlers (where interrupts are already
+    // disabled) and from the main loop, without racing with the queue write
+    // pointer used by #rspq_write.
+    disable_interrupts();
+    bool ok = rspq_deferred_wpos + nwords <= RSPQ_DEFERRED_BUFFER_SIZE;
+    if (ok) {
+        memcpy(&rspq_deferred_buf[rspq_deferred_wpos], words, nwords * sizeof(uint32_t));
+        rspq_deferred_wpos += nwords;
+    }
+    enable_interrupts();
+    return ok;
+}
+
+/** @brief Move the commands staged by #rspq_write_deferred into the queue. */
+static void rspq_deferred_drain(void)
+{
+    // Only drain into the lowpri queue, from non-interrupt context: the
+    // queue write pointer must not be touched while the main loop might be
+    // in the middle of a #rspq_write. Calling #rspq_flush from an interrupt
+    // handler is legal (it just pokes the SP status), so the guard must be
+    // enforced here rather than assumed: under interrupt, leave the staged
+    // commands in place for the next flush from the main loop.
+    if (interrupt_in_handler() || get_interrupts_state() == INTERRUPTS_DISABLED)
+        return;
+    if (rspq_ctx != &lowpri || !rspq_deferred_wpos)
+        return;
+
+    disable_interrupts();
+    if (rspq_deferred_wpos) {
+        rspq_write_bulk(rspq_deferred_buf, rspq_deferred_wpos);
+        rspq_deferred_wpos = 0;
+    }
+    enable_interrupts();
+}
+
 void rspq_flush(void)
 {
     // If we are recording a block, flushes can be ignored.
     if (rspq_block) return;
 
+    // Drain commands that were staged from interrupt context.
+    rspq_deferred_drain();
+
     rspq_flush_internal();
 }
 
+/**
+ * @brief Update the highpri occupancy tracking from the current SP status.
+ *
+ * An occupancy period is the time during which the highpri mechanism keeps
+ * the RSP away from the lowpri queue, i.e. the time the lowpri queue is
+ * starved. The CPU cannot observe the exact moment the RSP leaves highpri
+ * mode, so periods are closed lazily, whenever this function finds both
+ * highpri signals clear: the durations are thus conservative (they may
+ * include some slack between the actual exit and the observation).
+ *
+ * Must be called with interrupts disabled.
+ */
+static void rspq_highpri_sample(void)
+{
+    if (!rspq_hp_active)
+        return;
+    if (*SP_STATUS & (SP_STATUS_SIG_HIGHPRI_REQUESTED | SP_STATUS_SIG_HIGHPRI_RUNNING))
+        return;
+
+    uint32_t span = TICKS_DISTANCE(rspq_hp_active_since, TICKS_READ());
+    rspq_highpri_stats.occupancy_ticks += span;
+    if (span > rspq_highpri_stats.max_occupancy_ticks)
+        rspq_highpri_stats.max_occupancy_ticks = span;
+    rspq_hp_active = false;
+}
+
+/** @brief Timer callback: the forced yield is over, re-request highpri mode. */
+static void rspq_highpri_budget_tick(int ovfl)
+{
+    rspq_highpri_sample();
+    rspq_hp_deferred = false;
+    if (!rspq_hp_active) {
+        rspq_hp_active = true;
+        rspq_hp_active_since = TICKS_READ();
+    }
+    MEMORY_BARRIER();
+    *SP_STATUS = SP_WSTATUS_SET_SIG_HIGHPRI_REQUESTED;
+}
+
+void rspq_highpri_get_stats(rspq_highpri_stats_t *stats)
+{
+    disable_interrupts();
+    rspq_highpri_sample();
+    *stats = rspq_highpri_stats;
+
+    // Fold in the occupancy period that may still be open, so that an
+    // ongoing starvation shows up without waiting for it to end.
+    if (rspq_hp_active) {
+        uint32_t span = TICKS_DISTANCE(rspq_hp_active_since, TICKS_READ());
+        stats->occupancy_ticks += span;
+        if (span > stats->max_occupancy_ticks)
+            stats->max_occupancy_ticks = span;
+    }
+    enable_interrupts();
+}
+
+void rspq_highpri_reset_stats(void)
+{
+    disable_interrupts();
+    memset(&rspq_highpri_stats, 0, sizeof(rspq_highpri_stats));
+    // Restart the current occupancy period (if any) from now, so that the
+    // new measurement window doesn't inherit time from the old one.
+    rspq_hp_active_since = TICKS_READ();
+    enable_interrupts();
+}
+
+void rspq_highpri_set_budget(int slice_us, int gap_us)
+{
+    assertf((slice_us > 0) == (gap_us > 0),
+        "slice and gap must be both positive (enable) or both zero (disable)");
+
+    if (slice_us > 0 && rspq_hp_budget_timer == NULL) {
+        rspq_hp_budget_timer = new_timer(TIMER_TICKS(gap_us),
+            TF_ONE_SHOT | TF_DISABLED, rspq_highpri_budget_tick);
+        assertf(rspq_hp_budget_timer != NULL,
+            "rspq_highpri_set_budget requires timer_init");
+    }
+
+    disable_interrupts();
+    rspq_hp_budget_slice = TIMER_TICKS(slice_us);
+    rspq_hp_budget_gap = TIMER_TICKS(gap_us);
+
+    // If budget mode is being turned off while a request is held back,
+    // release it right away: nothing will fire the timer's job anymore.
+    if (slice_us == 0 && rspq_hp_deferred) {
+        stop_timer(rspq_hp_budget_timer);
+        rspq_highpri_budget_tick(0);
+    }
+    enable_interrupts();
+}
+
 void rspq_highpri_begin(void)
 {
     assertf(rspq_ctx != &highpri, "already in highpri mode");
@@ -1078,6 +1567,28 @@ void rspq_highpri_begin(void)
 
     rspq_switch_context(&highpri);
 
+    // Update the occupancy tracking, and decide whether the budget forces
+    // this section to yield to lowpri first: if highpri has continuously
+    // occupied the RSP for more than the configured slice, the request
+    // signal is held back for the configured gap (via a one-shot timer),
+    // guaranteeing the lowpri queue a window to make progress.
+    bool defer = false;
+    disable_interrupts();
+    rspq_highpri_sample();
+    rspq_highpri_stats.sections++;
+    if (rspq_hp_budget_slice && rspq_hp_active && !rspq_hp_deferred &&
+        TICKS_DISTANCE(rspq_hp_active_since, TICKS_READ()) > (int32_t)rspq_hp_budget_slice)
+    {
+        defer = true;
+        rspq_hp_deferred = true;
+        rspq_highpri_stats.budget_yields++;
+    }
+    if (!rspq_hp_active && !rspq_hp_deferred) {
+        rspq_hp_active = true;
+        rspq_hp_active_since = TICKS_READ();
+    }
+    enable_interrupts();
+
     // If we're continuing on the same buffer another highpri sequence,
     // try to skip the highpri epilog and jump to the buffer continuation.
     // This is a small performance gain (the RSP doesn't need to exit and re-enter
@@ -1092,11 +1603,16 @@ void rspq_highpri_begin(void)
     // change (it sees the epilog) or after the change (it sees the new JUMP).
     // 
     // In the first case, it will run the epilog and then reenter the highpri
-    // mode soon (as we're turning on SIG_HIGHPRI_REQUESTED anyway). In the 
+    // mode soon (as we're turning on SIG_HIGHPRI_REQUESTED anyway). In the
     // second case, it's going to see the JUMP, skip the epilog and continue.
     // The SIG_HIGHPRI_REQUESTED bit will be set but this function, and reset
     // at the beginning of the new segment, but it doesn't matter at this point.
-    if (rspq_cur_pointer[-3]>>24 == RSPQ_CMD_SWAP_BUFFERS) {
+    //
+    // When the budget forces a yield (defer), the epilog of the previous
+    // section is deliberately left in place for the RSP to run, so that it
+    // actually exits to lowpri; this new section resumes from the saved
+    // highpri pointer when the deferred request is finally raised.
+    if (!defer && rspq_cur_pointer[-3]>>24 == RSPQ_CMD_SWAP_BUFFERS) {
         volatile uint32_t *epilog = rspq_cur_pointer-4;
         rspq_append1(epilog, RSPQ_CMD_JUMP, PhysicalAddr(rspq_cur_pointer));
         rspq_append1(epilog, RSPQ_CMD_JUMP, PhysicalAddr(rspq_cur_pointer));
@@ -1110,7 +1626,18 @@ void rspq_highpri_begin(void)
     rspq_append1(rspq_cur_pointer, RSPQ_CMD_WRITE_STATUS,
         SP_WSTATUS_CLEAR_SIG_HIGHPRI_REQUESTED | SP_WSTATUS_SET_SIG_HIGHPRI_RUNNING);
     MEMORY_BARRIER();
-    *SP_STATUS = SP_WSTATUS_SET_SIG_HIGHPRI_REQUESTED;
+    if (defer)
+    {
+        // Forced yield: raise the request only after the configured gap.
+        start_timer(rspq_hp_budget_timer, rspq_hp_budget_gap, TF_ONE_SHOT,
+            rspq_highpri_budget_tick);
+    }
+    else if (!rspq_hp_deferred)
+    {
+        // A deferred request from an earlier section may still be pending;
+        // in that case its timer will raise the signal for us too.
+        *SP_STATUS = SP_WSTATUS_SET_SIG_HIGHPRI_REQUESTED;
+    }
     rspq_flush_internal();
 }
 
@@ -1134,10 +1661,25 @@ void rspq_highpri_sync(void)
 {
     assertf(rspq_ctx != &highpri, "this function can only be called outside of highpri mode");
 
+    // A request held back by the budget would make this wait for the whole
+    // yield gap: release it now, the caller explicitly wants completion.
+    disable_interrupts();
+    if (rspq_hp_deferred) {
+        stop_timer(rspq_hp_budget_timer);
+        rspq_highpri_budget_tick(0);
+    }
+    enable_interrupts();
+
     RSP_WAIT_LOOP(200) {
         if (!(*SP_STATUS & (SP_STATUS_SIG_HIGHPRI_REQUESTED | SP_STATUS_SIG_HIGHPRI_RUNNING)))
             break;
     }
+
+    // The queue is provably idle now: close the occupancy period with an
+    // exact observation point.
+    disable_interrupts();
+    rspq_highpri_sample();
+    enable_interrupts();
 }
 
 void rspq_block_begin(void)
@@ -1206,6 +1748,100 @@ void rspq_block_free(rspq_block_t *block)
     }
 }
 
+/**
+ * @brief Header of a serialized block image (see #rspq_block_serialize).
+ *
+ * The header is followed by a #rspq_block_t, so that after validation the
+ * image can be run in-place without any per-command rewriting.
+ */
+typedef struct rspq_serialized_block_s {
+    uint32_t magic;             ///< Magic word (#RSPQ_BLOCK_SERIALIZED_MAGIC)
+    uint32_t num_words;         ///< Number of command words in the block
+    rspq_block_t block;         ///< The flattened block itself
+} rspq_serialized_block_t;
+
+/**
+ * @brief Walk the chunks of a block, invoking a callback for each chunk.
+ *
+ * The callback receives the pointer to the chunk contents and the number of
+ * command words in it (excluding the JUMP/RET terminator). Returns the
+ * total number of command words across all chunks.
+ */
+static int rspq_block_walk(rspq_block_t *block, void (*chunk_cb)(uint32_t *cmds, int nwords, void *ctx), void *ctx)
+{
+    int size = RSPQ_BLOCK_MIN_SIZE;
+    uint32_t *start = block->cmds;
+    uint32_t *ptr = start + size;
+    int total = 0;
+    while (1) {
+        // Rollback until we find a non-zero command (the chunk terminator)
+        while (*--ptr == 0x00) {}
+        uint32_t cmd = *ptr;
+
+        if (chunk_cb) chunk_cb(start, ptr - start, ctx);
+        total += ptr - start;
+
+        // Follow the JUMP to the next chunk, or stop at the final RET.
+        if (cmd>>24 == RSPQ_CMD_JUMP) {
+            start = UncachedAddr(0x80000000 | (cmd & 0xFFFFFF));
+            if (size < RSPQ_BLOCK_MAX_SIZE) size *= 2;
+            ptr = start + size;
+            continue;
+        }
+        if (cmd>>24 == RSPQ_CMD_RET)
+            return total;
+        assertf(0, "invalid terminator command in block: %08lx\n", cmd);
+    }
+}
+
+/** @brief Chunk callback for #rspq_block_serialize: append the chunk contents. */
+static void rspq_block_serialize_chunk(uint32_t *cmds, int nwords, void *ctx)
+{
+    uint32_t **dst = (uint32_t**)ctx;
+    memcpy(*dst, cmds, nwords * sizeof(uint32_t));
+    *dst += nwords;
+}
+
+int rspq_block_serialized_size(rspq_block_t *block)
+{
+    int num_words = rspq_block_walk(block, NULL, NULL);
+    return sizeof(rspq_serialized_block_t) + (num_words + 1) * sizeof(uint32_t);
+}
+
+void rspq_block_serialize(rspq_block_t *block, void *dest)
+{
+    // Blocks that call other blocks embed RDRAM addresses that are only
+    // valid within the current process image, so they cannot be serialized.
+    assertf(block->nesting_level == 0,
+        "cannot serialize a block that calls other blocks");
+
+    rspq_serialized_block_t *s = dest;
+    s->magic = RSPQ_BLOCK_SERIALIZED_MAGIC;
+    s->block.nesting_level = 0;
+
+    // Flatten all the chunks into a single contiguous command stream,
+    // dropping the internal JUMPs that linked them.
+    uint32_t *dst = s->block.cmds;
+    s->num_words = rspq_block_walk(block, rspq_block_serialize_chunk, &dst);
+
+    // Terminate the flattened block with a RET (nesting level 0).
+    *dst++ = (RSPQ_CMD_RET<<24) | (0<<2);
+}
+
+rspq_block_t* rspq_block_from_serialized(void *buf, int size)
+{
+    rspq_serialized_block_t *s = buf;
+    assertf(((uint32_t)buf & 7) == 0, "serialized block buffer must be 8-byte aligned");
+    assertf(s->magic == RSPQ_BLOCK_SERIALIZED_MAGIC, "invalid serialized block (magic: %08lx)", s->magic);
+    assertf(size >= (int)(sizeof(rspq_serialized_block_t) + (s->num_words+1)*sizeof(uint32_t)),
+        "serialized block is truncated (size: %d)", size);
+
+    // Make sure the RSP sees the commands: the buffer was likely loaded
+    // via standard (cached) reads, so write back the cache to RDRAM.
+    data_cache_hit_writeback_invalidate(buf, sizeof(rspq_serialized_block_t) + (s->num_words+1)*sizeof(uint32_t));
+    return &s->block;
+}
+
 void rspq_block_run(rspq_block_t *block)
 {
     // TODO: add support for block execution in highpri mode. This would be
@@ -1230,11 +1866,73 @@ void rspq_block_run(rspq_block_t *block)
     }
 }
 
+/**
+ * @brief Make sure that at least \p nwords contiguous words can be written
+ *        in the current queue buffer, switching buffer if necessary.
+ */
+static void rspq_ensure_capacity(int nwords)
+{
+    if (rspq_ctx)
+        assertf(nwords <= rspq_ctx->buf_size - RSPQ_MAX_COMMAND_SIZE,
+            "bulk write too large for the queue buffer (%d words)", nwords);
+    else
+        assertf(nwords <= RSPQ_BLOCK_MAX_SIZE/2,
+            "bulk write too large for a block (%d words)", nwords);
+
+    while (rspq_cur_sentinel - rspq_cur_pointer < nwords)
+        rspq_next_buffer();
+}
+
+void rspq_write_bulk(const uint32_t *words, int nwords)
+{
+    assertf(nwords > 0, "empty bulk write");
+    assertf(words[0]>>24 != 0, "first word of a bulk write must contain a command ID");
+
+    rspq_ensure_capacity(nwords);
+
+    // Copy the batch into the queue, writing the first word last. The RSP
+    // cannot advance past the start of the batch while the first command ID
+    // is still zero, so the rest of the batch can be copied in any order
+    // with a single sentinel check and pointer update for the whole batch.
+    volatile uint32_t *ptr = rspq_cur_pointer;
+    for (int i = nwords-1; i > 0; i--)
+        ptr[i] = words[i];
+    MEMORY_BARRIER();
+    ptr[0] = words[0];
+    rspq_cur_pointer += nwords;
+}
+
+volatile uint32_t* rspq_write_reserve(int nwords)
+{
+    assertf(nwords > 0, "empty bulk reservation");
+    rspq_ensure_capacity(nwords);
+
+    // Reserve the region by bumping the write pointer past it. The region
+    // is guaranteed to be zero-filled (buffers are cleared when switched to),
+    // so the RSP will stall at its first word until rspq_write_commit writes
+    // a valid command ID there, even if more commands are enqueued after it.
+    volatile uint32_t *ptr = rspq_cur_pointer;
+    rspq_cur_pointer += nwords;
+    return ptr;
+}
+
+void rspq_write_commit(volatile uint32_t *ptr, uint32_t first_word)
+{
+    assertf(first_word>>24 != 0, "first word of a bulk commit must contain a command ID");
+    MEMORY_BARRIER();
+    ptr[0] = first_word;
+}
+
 void rspq_noop()
 {
     rspq_int_write(RSPQ_CMD_NOOP);
 }
 
+void rspq_overlay_prefetch(uint32_t ovl_id)
+{
+    rspq_int_write(RSPQ_CMD_PREFETCH_OVERLAY, ovl_id >> 28);
+}
+
 rspq_syncpoint_t rspq_syncpoint_new(void)
 {   
     assertf(!rspq_block, "cannot create syncpoint in a block");
@@ -1245,7 +1943,35 @@ rspq_syncpoint_t rspq_syncpoint_new(void)
     return ++rspq_syncpoints_genid;
 }
 
-bool rspq_syncpoint_check(rspq_syncpoint_t sync_id) 
+rspq_syncpoint_t rspq_syncpoint_new_cb(void (*func)(void *ctx), void *ctx)
+{
+    assertf(func, "callback function cannot be NULL");
+
+    // Find a free slot for the callback. We must register it before creating
+    // the syncpoint itself, otherwise the SP interrupt could cross the
+    // syncpoint before the callback is visible.
+    disable_interrupts();
+    rspq_syncpoint_cb_t *cb = NULL;
+    for (int i = 0; i < RSPQ_MAX_SYNCPOINT_CALLBACKS; i++) {
+        if (rspq_syncpoint_callbacks[i].sync_id == 0) {
+            cb = &rspq_syncpoint_callbacks[i];
+            break;
+        }
+    }
+    assertf(cb, "too many pending syncpoint callbacks (max: %d)", RSPQ_MAX_SYNCPOINT_CALLBACKS);
+
+    cb->func = func;
+    cb->ctx = ctx;
+    cb->sync_id = rspq_syncpoints_genid + 1;
+
+    rspq_syncpoint_t sync_id = rspq_syncpoint_new();
+    assert(sync_id == cb->sync_id);
+    enable_interrupts();
+
+    return sync_id;
+}
+
+bool rspq_syncpoint_check(rspq_syncpoint_t sync_id)
 {
     int difference = (int)((uint32_t)(sync_id) - (uint32_t)(rspq_syncpoints_done));
     return difference <= 0;
@@ -1271,6 +1997,51 @@ void rspq_syncpoint_wait(rspq_syncpoint_t sync_id)
     }
 }
 
+void rspq_profile_get(rspq_profile_t *profile)
+{
+#if RSPQ_PROFILE
+    // Snapshot the profiling counters by asking the RSP itself to DMA them
+    // to RDRAM. Going through the queue (rather than halting the RSP) makes
+    // sure that we don't perturb what we are measuring, and that the counters
+    // are coherent with the commands executed so far.
+    static rspq_profile_t buffer __attribute__((aligned(16)));
+    data_cache_hit_writeback_invalidate(&buffer, sizeof(buffer));
+    rspq_dma_to_rdram(&buffer,
+        RSPQ_DATA_ADDRESS + offsetof(rsp_queue_t, profile_slots),
+        sizeof(rspq_profile_slot_t) * RSPQ_MAX_OVERLAY_COUNT, false);
+    rspq_wait();
+    memcpy(profile, &buffer, sizeof(rspq_profile_t));
+
+    // Resolve overlay names for easier reporting
+    for (int i = 0; i < RSPQ_PROFILE_SLOT_COUNT; i++) {
+        if (i == 0)
+            profile->slot_names[i] = "builtin";
+        else if (rspq_overlay_ucodes[i])
+            profile->slot_names[i] = rspq_overlay_ucodes[i]->name;
+        else
+            profile->slot_names[i] = NULL;
+    }
+#else
+    assertf(0, "rspq profiling is disabled; set RSPQ_PROFILE to 1 in rspq_constants.h");
+#endif
+}
+
+void rspq_profile_reset(void)
+{
+#if RSPQ_PROFILE
+    // Zero the counters in DMEM. The RSP keeps updating them concurrently,
+    // so the reset is not perfectly atomic, but that is fine for profiling.
+    static rspq_profile_slot_t zeros[RSPQ_MAX_OVERLAY_COUNT] __attribute__((aligned(16)));
+    memset(zeros, 0, sizeof(zeros));
+    data_cache_hit_writeback_invalidate(zeros, sizeof(zeros));
+    rspq_dma_to_dmem(
+        RSPQ_DATA_ADDRESS + offsetof(rsp_queue_t, profile_slots),
+        zeros, sizeof(zeros), false);
+#else
+    assertf(0, "rspq profiling is disabled; set RSPQ_PROFILE to 1 in rspq_constants.h");
+#endif
+}
+
 void rspq_signal(uint32_t signal)
 {
     const uint32_t allowed_mask = SP_WSTATUS_CLEAR_SIG0|SP_WSTATUS_SET_SIG0|SP_WSTATUS_CLEAR_SIG1|SP_WSTATUS_SET_SIG1;
@@ -0,0 +1,58 @@
+/**
+ * @file rspq_rdp.c
+ * @brief RDP command bridging through the RSP queue
+ * @ingroup rsp
+ *
+ * CPU-side implementation of the RDP bridge. See rspq_rdp.h for the API
+ * documentation, and rsp_rdp.S for the RSP-side forwarding code.
+ */
+
+#include "rspq.h"
+#include "rspq_rdp.h"
+#include "debug.h"
+#include <stdbool.h>
+
+/** @brief Bridge overlay commands */
+enum {
+    RDP_CMD_PASSTHROUGH1 = 0x0,     ///< Forward one 64-bit RDP command
+    RDP_CMD_PASSTHROUGH2 = 0x1,     ///< Forward two 64-bit RDP commands
+};
+
+/** The RDP bridge ucode */
+DEFINE_RSP_UCODE(rsp_rdp);
+
+/** @brief Overlay ID assigned to the bridge (0 if not initialized) */
+static uint32_t rspq_rdp_ovl_id;
+
+void rspq_rdp_init(void)
+{
+    if (rspq_rdp_ovl_id)
+        return;
+
+    rspq_init();
+    rspq_rdp_ovl_id = rspq_overlay_register(&rsp_rdp);
+}
+
+void rspq_rdp_close(void)
+{
+    if (!rspq_rdp_ovl_id)
+        return;
+
+    rspq_overlay_unregister(rspq_rdp_ovl_id);
+    rspq_rdp_ovl_id = 0;
+}
+
+void rspq_rdp_write(uint64_t cmd)
+{
+    assertf(rspq_rdp_ovl_id, "rspq_rdp_init was not called");
+    rspq_write(rspq_rdp_ovl_id, RDP_CMD_PASSTHROUGH1, 0,
+        (uint32_t)(cmd >> 32), (uint32_t)cmd);
+}
+
+void rspq_rdp_write2(uint64_t cmd0, uint64_t cmd1)
+{
+    assertf(rspq_rdp_ovl_id, "rspq_rdp_init was not called");
+    rspq_write(rspq_rdp_ovl_id, RDP_CMD_PASSTHROUGH2, 0,
+        (uint32_t)(cmd0 >> 32), (uint32_t)cmd0,
+        (uint32_t)(cmd1 >> 32), (uint32_t)cmd1);
+}
@@ -8,6 +8,7 @@
 #include <time.h>
 #include "libdragon.h"
 #include "system.h"
+#include "joybus_internal.h"
 
 /**
  * @defgroup rtc Real-Time Clock Subsystem
@@ -154,17 +155,43 @@
 #define JOYBUS_RTC_CONTROL_MODE_RUN 0x0300
 
 /**
- * @brief Invalidate the most-recent RTC time cache after 1 second.
+ * @brief Interval between background resynchronizations with the hardware.
+ *
+ * Between resyncs, #rtc_get extrapolates the time from the COP0 count
+ * register, which drifts from the RTC crystal by a few parts per million
+ * at most: well under a second over this interval.
  */
-#define RTC_GET_CACHE_INVALIDATE_TICKS (TICKS_PER_SECOND)
+#define RTC_RESYNC_INTERVAL_TICKS (TICKS_PER_SECOND * 30)
 
 /**
- * @brief Tick counter state when #rtc_get cache was last updated.
+ * @name RTC tick anchor state
  *
- * Set to 0 to manually invalidate the #rtc_get cache.
- * Cache will invalidate every #RTC_GET_CACHE_INVALIDATE_TICKS.
+ * #rtc_get serves time queries by extrapolating from a hardware read
+ * ("anchor") using the free-running COP0 count, so reading the clock
+ * costs a few cycles instead of a blocking serial transaction. A slow
+ * timer re-reads the hardware asynchronously and the fresh reading is
+ * folded into the anchor on the next #rtc_get, correcting any drift.
+ * @{
  */
-static int64_t rtc_get_cache_ticks = 0;
+/** @brief RTC time (as a UNIX timestamp) at the anchor point */
+static time_t rtc_anchor_secs = 0;
+/** @brief #timer_ticks value at the anchor point */
+static int64_t rtc_anchor_ticks = 0;
+/** @brief True if the anchor holds a valid hardware reading */
+static bool rtc_anchor_valid = false;
+/** @brief Slow timer driving background resynchronization */
+static timer_link_t *rtc_resync_timer = NULL;
+/** @brief True while an async RTC read is in flight */
+static volatile bool rtc_resync_busy = false;
+/** @brief True if #rtc_resync_data holds a reading not yet folded in */
+static volatile bool rtc_resync_ready = false;
+/** @brief Raw block 2 data from the last async RTC read */
+static uint64_t rtc_resync_data = 0;
+/** @brief #timer_ticks value when the last async RTC read completed */
+static int64_t rtc_resync_stamp = 0;
+/** @} */
+
+bool __rtc_get_anchor( time_t *secs, int64_t *ticks );
 
 /**
  * @brief Real-time clock detection values.
@@ -379,20 +406,20 @@ static void joybus_rtc_read_control( uint16_t * control, uint32_t * calibration
 }
 
 /**
- * @brief Read the current date/time from the Joybus real-time clock.
+ * @brief Decode a raw Joybus RTC block 2 response into a date/time.
  *
- * The result of calling this function when the Joybus RTC is not
- * present is undefined and may not be safe. #rtc_get will not
- * call this function if the Joybus RTC was not detected.
+ * Shared by the blocking #joybus_rtc_read_time path and the background
+ * resynchronization callback, which receives the raw block data from an
+ * asynchronous Joybus transaction.
+ *
+ * @param[in]   data
+ *              Raw block 2 data as returned by the RTC read command
  *
  * @param[out]  rtc_time
  *              Destination pointer for the RTC time data structure
  */
-static void joybus_rtc_read_time( rtc_time_t * rtc_time )
+static void joybus_rtc_decode_time( uint64_t data, rtc_time_t * rtc_time )
 {
-    uint64_t data;
-    joybus_rtc_read( 2, &data );
-
     uint8_t * bytes = (uint8_t *)&data;
 
     rtc_time->sec = bcd_to_byte(bytes[0]);
@@ -406,6 +433,24 @@ static void joybus_rtc_read_time( rtc_time_t * rtc_time )
     rtc_time->year += 1900;
 }
 
+/**
+ * @brief Read the current date/time from the Joybus real-time clock.
+ *
+ * The result of calling this function when the Joybus RTC is not
+ * present is undefined and may not be safe. #rtc_get will not
+ * call this function if the Joybus RTC was not detected.
+ *
+ * @param[out]  rtc_time
+ *              Destination pointer for the RTC time data structure
+ */
+static void joybus_rtc_read_time( rtc_time_t * rtc_time )
+{
+    uint64_t data;
+    joybus_rtc_read( 2, &data );
+
+    joybus_rtc_decode_time( data, rtc_time );
+}
+
 /**
  * @brief Write the control block to the Joybus real-time clock.
  *
@@ -521,6 +566,119 @@ static rtc_type_t rtc_present( void )
     }
 }
 
+/**
+ * @brief Convert an #rtc_time_t date/time into a UNIX timestamp.
+ *
+ * @param[in]   rtc_time
+ *              Source pointer for the RTC time data structure
+ *
+ * @return seconds elapsed since the UNIX epoch
+ */
+static time_t rtc_time_to_secs( const rtc_time_t * rtc_time )
+{
+    struct tm time;
+    time.tm_sec = rtc_time->sec;
+    time.tm_min = rtc_time->min;
+    time.tm_hour = rtc_time->hour;
+    time.tm_mday = rtc_time->day;
+    time.tm_mon = rtc_time->month;
+    time.tm_year = rtc_time->year - 1900;
+    time.tm_isdst = -1; /* Auto-detect Daylight Saving Time */
+
+    return mktime( &time );
+}
+
+/**
+ * @brief Convert a UNIX timestamp into an #rtc_time_t date/time.
+ *
+ * @param[in]   secs
+ *              Seconds elapsed since the UNIX epoch
+ *
+ * @param[out]  rtc_time
+ *              Destination pointer for the RTC time data structure
+ */
+static void rtc_secs_to_time( time_t secs, rtc_time_t * rtc_time )
+{
+    struct tm time;
+    gmtime_r( &secs, &time );
+
+    rtc_time->year = time.tm_year + 1900;
+    rtc_time->month = time.tm_mon;
+    rtc_time->day = time.tm_mday;
+    rtc_time->week_day = time.tm_wday;
+    rtc_time->hour = time.tm_hour;
+    rtc_time->min = time.tm_min;
+    rtc_time->sec = time.tm_sec;
+}
+
+/**
+ * @brief Joybus completion callback for the background resynchronization.
+ *
+ * Runs under the SI interrupt: just stash the raw block 2 data and the
+ * tick counter it was received at. The reading is folded into the tick
+ * anchor from normal context on the next #rtc_get call.
+ */
+static void rtc_resync_callback( uint64_t *output, void *ctx )
+{
+    rtc_resync_data = output[1];
+    rtc_resync_stamp = timer_ticks();
+    rtc_resync_ready = true;
+    rtc_resync_busy = false;
+}
+
+/**
+ * @brief Scheduler variant of #rtc_resync_callback.
+ *
+ * Same handling, but receives the raw received bytes of the coalesced
+ * PIF block entry (8 time bytes followed by the status byte) instead of
+ * a full Joybus output block.
+ */
+static void rtc_resync_sched_callback( uint8_t *rx, void *ctx )
+{
+    memcpy( &rtc_resync_data, rx, sizeof(uint64_t) );
+    rtc_resync_stamp = timer_ticks();
+    rtc_resync_ready = true;
+    rtc_resync_busy = false;
+}
+
+/**
+ * @brief Timer tick that starts a background RTC resynchronization.
+ *
+ * Queues an asynchronous Joybus read of the RTC time block so that the
+ * tick anchor used by #rtc_get can be drift-corrected without ever
+ * blocking on a serial transaction. If the Joybus command scheduler is
+ * running, the read is coalesced into the shared per-frame PIF block
+ * instead of a standalone transaction.
+ */
+static void rtc_resync_tick( int ovfl )
+{
+    if( rtc_resync_busy ) return;
+
+    if( joybus_sched_active() )
+    {
+        /* RTC read command: id 0x07, block 2; reads 8 bytes + status */
+        const uint8_t tx[2] = { 0x07, 0x02 };
+        rtc_resync_busy = joybus_sched_submit( 4, tx, sizeof(tx), 9,
+            rtc_resync_sched_callback, NULL );
+        return;
+    }
+
+    const uint64_t input[JOYBUS_BLOCK_DWORDS] =
+    {
+        0x0000000002090702,
+        0xffffffffffffffff,
+        0xfffe000000000000,
+        0,
+        0,
+        0,
+        0,
+        1
+    };
+
+    rtc_resync_busy = true;
+    joybus_exec_async( input, rtc_resync_callback, NULL );
+}
+
 /**
  * @brief Hook function for newlib gettimeofday to get the current date/time.
  *
@@ -531,16 +689,7 @@ static time_t newlib_time_hook( void )
     static rtc_time_t rtc_time;
     if( !rtc_get( &rtc_time ) ) return -1;
 
-    struct tm time;
-    time.tm_sec = rtc_time.sec;
-    time.tm_min = rtc_time.min;
-    time.tm_hour = rtc_time.hour;
-    time.tm_mday = rtc_time.day;
-    time.tm_mon = rtc_time.month;
-    time.tm_year = rtc_time.year - 1900;
-    time.tm_isdst = -1; /* Auto-detect Daylight Saving Time */
-
-    return mktime( &time );
+    return rtc_time_to_secs( &rtc_time );
 }
 
 /**
@@ -567,8 +716,9 @@ bool rtc_init( void )
     /* libdragon currently only supports Joybus RTC! */
     if( rtc_present() != RTC_JOYBUS ) return false;
 
-    /* Invalidate the #rtc_get cache */
-    rtc_get_cache_ticks = 0;
+    /* Invalidate the #rtc_get tick anchor */
+    rtc_anchor_valid = false;
+    rtc_resync_ready = false;
 
     /* Read the calibration data from the control block */
     uint32_t calibration;
@@ -581,6 +731,13 @@ bool rtc_init( void )
     /* Enable newlib `gettimeofday` integration */
     hook_time_call( &newlib_time_hook );
 
+    /* Periodically resynchronize the tick anchor with the hardware */
+    if( rtc_resync_timer == NULL )
+    {
+        rtc_resync_timer = new_timer( RTC_RESYNC_INTERVAL_TICKS,
+            TF_CONTINUOUS, rtc_resync_tick );
+    }
+
     return true;
 }
 
@@ -600,8 +757,15 @@ void rtc_close( void )
 {
     /* Disable newlib `gettimeofday` integration */
     unhook_time_call( &newlib_time_hook );
-    /* Invalidate the #rtc_get cache */
-    rtc_get_cache_ticks = 0;
+    /* Stop the background resynchronization timer */
+    if( rtc_resync_timer != NULL )
+    {
+        delete_timer( rtc_resync_timer );
+        rtc_resync_timer = NULL;
+    }
+    /* Invalidate the #rtc_get tick anchor */
+    rtc_anchor_valid = false;
+    rtc_resync_ready = false;
 }
 
 /**
@@ -671,18 +835,16 @@ void rtc_normalize_time( rtc_time_t * rtc_time )
  * If the RTC is not detected or supported, this function will
  * not modify the destination rtc_time parameter.
  *
- * Your code should call this once per frame to update the #rtc_time_t
- * data structure. The RTC Subsystem maintains a cache of the
- * most-recent RTC time that was read and will only perform an
- * actual RTC read command if the cache is invalidated. The
- * destination rtc_time parameter will be updated regardless of
- * the cache validity.
- *
- * Cache will invalidate every #RTC_GET_CACHE_INVALIDATE_TICKS.
- * Calling #rtc_set will also invalidate the cache.
+ * Your code can safely call this once per frame (or more) to update the
+ * #rtc_time_t data structure: the hardware is only read once, and
+ * subsequent queries extrapolate from that reading using the COP0 count
+ * register, so this function normally costs a few cycles. The anchor
+ * reading is resynchronized with the hardware every
+ * #RTC_RESYNC_INTERVAL_TICKS through an asynchronous Joybus transaction,
+ * correcting any accumulated drift without blocking.
  *
- * If an actual RTC read command is needed, this function can take
- * a few milliseconds to complete.
+ * Only the first call after #rtc_init or #rtc_set performs a blocking
+ * RTC read command, which can take a few milliseconds to complete.
  *
  * @param[out]  rtc_time
  *              Destination pointer for the RTC time data structure
@@ -690,27 +852,68 @@ void rtc_normalize_time( rtc_time_t * rtc_time )
  * @return whether the rtc_time destination pointer data was modified
  */
 bool rtc_get( rtc_time_t * rtc_time )
+{
+    time_t anchor_secs;
+    int64_t anchor_ticks;
+    if( !__rtc_get_anchor( &anchor_secs, &anchor_ticks ) ) return false;
+
+    /* Extrapolate the current time from the anchor using the COP0 count */
+    time_t now_secs = anchor_secs +
+        ( timer_ticks() - anchor_ticks ) / TICKS_PER_SECOND;
+    rtc_secs_to_time( now_secs, rtc_time );
+
+    return true;
+}
+
+/**
+ * @brief Report the current RTC tick anchor (clock_gettime hook).
+ *
+ * Called by #clock_gettime in system.c (through a weak reference, so that
+ * using the realtime clock does not force the RTC driver into the link) to
+ * obtain the hardware reading that COP0-based timestamps extrapolate from.
+ * Folds in a completed background resync first, and performs the one-time
+ * blocking hardware read if no anchor exists yet (see #rtc_get).
+ *
+ * @param[out]  secs
+ *              RTC time (as a UNIX timestamp) at the anchor point
+ * @param[out]  ticks
+ *              #timer_ticks value at the anchor point
+ *
+ * @return whether a valid anchor was returned
+ */
+bool __rtc_get_anchor( time_t *secs, int64_t *ticks )
 {
     /* libdragon currently only supports getting the time for Joybus RTC! */
     if( rtc_present() != RTC_JOYBUS ) return false;
 
-    /* This should be overwritten the first time this function is called */
-    static rtc_time_t cache_time = { 2000, 0, 1, 0, 0, 0, 6 };
-
-    /* Check if the cached time is still valid */
-    int64_t now = timer_ticks();
-    if(
-        rtc_get_cache_ticks == 0 || /* cache manually invalidated */
-        (now - rtc_get_cache_ticks) > RTC_GET_CACHE_INVALIDATE_TICKS
-    )
+    /* Fold a completed background resync into the tick anchor */
+    if( rtc_resync_ready )
     {
-        /* Update the cache */
-        joybus_rtc_read_time( &cache_time );
-        rtc_get_cache_ticks = now;
+        disable_interrupts();
+        uint64_t data = rtc_resync_data;
+        int64_t stamp = rtc_resync_stamp;
+        rtc_resync_ready = false;
+        enable_interrupts();
+
+        rtc_time_t resync_time;
+        joybus_rtc_decode_time( data, &resync_time );
+        rtc_anchor_secs = rtc_time_to_secs( &resync_time );
+        rtc_anchor_ticks = stamp;
+        rtc_anchor_valid = true;
     }
 
-    memcpy( rtc_time, &cache_time, sizeof(rtc_time_t) );
+    /* First read (or first read after #rtc_set): anchor on the hardware */
+    if( !rtc_anchor_valid )
+    {
+        rtc_time_t read_time;
+        joybus_rtc_read_time( &read_time );
+        rtc_anchor_secs = rtc_time_to_secs( &read_time );
+        rtc_anchor_ticks = timer_ticks();
+        rtc_anchor_valid = true;
+    }
 
+    *secs = rtc_anchor_secs;
+    *ticks = rtc_anchor_ticks;
     return true;
 }
 
@@ -754,8 +957,9 @@ bool rtc_set( rtc_time_t * write_time )
     /* Wait for the RTC to start running */
     while( joybus_rtc_is_stopped() ) { /* Spinloop */ }
     wait_ms( JOYBUS_RTC_WRITE_FINISHED_DELAY );
-    /* Invalidate the #rtc_get cache */
-    rtc_get_cache_ticks = 0;
+    /* Invalidate the #rtc_get tick anchor */
+    rtc_anchor_valid = false;
+    rtc_resync_ready = false;
     return true;
 }
 
@@ -0,0 +1,129 @@
+/**
+ * @file skin.c
+ * @brief RSP matrix-palette skinning
+ * @ingroup rsp
+ *
+ * CPU-side implementation of the skinning overlay. See skin.h for the API
+ * documentation, and rsp_skin.S for the RSP-side blending code.
+ */
+
+#include "skin.h"
+#include "rspq.h"
+#include "n64sys.h"
+#include "debug.h"
+#include <stdbool.h>
+#include <string.h>
+
+/** @brief Overlay commands (see rsp_skin.S) */
+enum {
+    SKIN_CMD_SET_PALETTE = 0x0,     ///< Load bone matrices into the palette
+    SKIN_CMD_BLEND       = 0x1,     ///< Blend a batch of vertices
+};
+
+/** @brief Size in bytes of a packed matrix as DMA'd to the RSP */
+#define SKIN_MATRIX_SIZE    64
+
+/**
+ * @brief Number of palette staging slots
+ *
+ * Palette uploads are packed into uncached staging slots that the RSP
+ * fetches asynchronously; the slots are reused round-robin, so this
+ * bounds how many palette loads can be enqueued before the oldest one
+ * must have been consumed. Each slot holds a full palette worth of
+ * matrices, so one slot is consumed per #skin_palette_load call.
+ */
+#define SKIN_STAGING_SLOTS  8
+
+/** The skinning ucode */
+DEFINE_RSP_UCODE(rsp_skin);
+
+/** @brief Overlay ID assigned to the ucode (0 if not initialized) */
+static uint32_t skin_ovl_id;
+
+/** @brief Ring of uncached palette staging slots */
+static int16_t *skin_staging;
+
+/** @brief Next palette staging slot to use */
+static int skin_staging_idx;
+
+void skin_init(void)
+{
+    if (skin_ovl_id)
+        return;
+
+    rspq_init();
+    skin_ovl_id = rspq_overlay_register(&rsp_skin);
+
+    skin_staging = malloc_uncached(SKIN_STAGING_SLOTS *
+        SKIN_PALETTE_SIZE * SKIN_MATRIX_SIZE);
+    skin_staging_idx = 0;
+}
+
+void skin_close(void)
+{
+    if (!skin_ovl_id)
+        return;
+
+    rspq_overlay_unregister(skin_ovl_id);
+    skin_ovl_id = 0;
+
+    free_uncached(skin_staging);
+    skin_staging = NULL;
+}
+
+void skin_palette_load(const fm_mat4_t *matrices, int first, int count)
+{
+    assertf(skin_ovl_id, "skin_init was not called");
+    assertf(first >= 0 && count > 0 && first + count <= SKIN_PALETTE_SIZE,
+        "invalid palette range: %d..%d", first, first + count);
+
+    int16_t *slot = skin_staging + skin_staging_idx *
+        (SKIN_PALETTE_SIZE * SKIN_MATRIX_SIZE / 2);
+    skin_staging_idx = (skin_staging_idx + 1) % SKIN_STAGING_SLOTS;
+
+    // Split each matrix into integer and fractional 4x4 halves. The RSP
+    // broadcasts one vertex component against one DMEM row at a time, and
+    // vertices transform as v * M, so DMEM row r holds row r of the
+    // matrix: the coefficients that component r contributes to all four
+    // outputs (the translation lands in row 3, picked up by W=1).
+    for (int n = 0; n < count; n++) {
+        int16_t *m = slot + n * (SKIN_MATRIX_SIZE / 2);
+        for (int row = 0; row < 4; row++) {
+            for (int col = 0; col < 4; col++) {
+                fx32_t fx = matrices[n].m[row][col];
+                m[row*4 + col] = fx >> 16;
+                m[16 + row*4 + col] = fx & 0xFFFF;
+            }
+        }
+    }
+
+    rspq_write(skin_ovl_id, SKIN_CMD_SET_PALETTE,
+        (first << 8) | count, PhysicalAddr(slot));
+}
+
+void skin_blend(const skin_vertex_t *vertices, tnl_vertex_t *output, int count)
+{
+    assertf(skin_ovl_id, "skin_init was not called");
+    assertf(((uint32_t)vertices & 7) == 0,
+        "vertex array must be 8-byte aligned: %p", vertices);
+    assertf(((uint32_t)output & 7) == 0,
+        "output array must be 8-byte aligned: %p", output);
+    assertf(count > 0, "invalid vertex count: %d", count);
+
+    // The RSP reads the input and writes the output via DMA: flush the
+    // input to RDRAM, and drop any cached output lines so they neither
+    // mask the results nor get written back over them later.
+    data_cache_hit_writeback((void*)vertices, count * sizeof(skin_vertex_t));
+    data_cache_hit_writeback_invalidate(output, count * sizeof(tnl_vertex_t));
+
+    while (count > 0) {
+        int batch = count > SKIN_BATCH_SIZE ? SKIN_BATCH_SIZE : count;
+
+        rspq_write(skin_ovl_id, SKIN_CMD_BLEND, batch,
+            PhysicalAddr(vertices), PhysicalAddr(output));
+
+        vertices += batch;
+        output += batch;
+        count -= batch;
+    }
+}
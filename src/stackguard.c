@@ -0,0 +1,150 @@
+/**
+ * @file stackguard.c
+ * @brief Stack overflow detection via TLB guard pages
+ * @ingroup stackguard
+ */
+#include "stackguard.h"
+#include "n64sys.h"
+#include "cop0.h"
+#include "interrupt.h"
+#include "debug.h"
+#include <malloc.h>
+#include <stdlib.h>
+
+/** @brief ENTRYLO coherency field: cacheable noncoherent */
+#define ENTRYLO_CACHED          (3<<3)
+
+/** @brief Size of the guard area below each stack (one TLB entry pair) */
+#define GUARD_SIZE              8192
+
+/** @brief Size of the private stack used to handle overflow exceptions */
+#define EXC_STACK_SIZE          8192
+
+/**
+ * @brief Bottom of the active guarded stack (0 = guard disabled).
+ *
+ * Read by inthandler.S at exception entry: when the stack pointer is below
+ * this address, the current stack cannot hold the exception frame (pushing
+ * it would fault again, recursing forever), so the handler switches to
+ * #__stackguard_exc_stack_top and records the faulting stack pointer in
+ * #__stackguard_crashed_sp.
+ */
+uint32_t __stackguard_limit = 0;
+/** @brief Top of the private exception stack (see #__stackguard_limit) */
+uint32_t __stackguard_exc_stack_top = 0;
+/** @brief Stack pointer at the time of an overflow trap (0 = no overflow) */
+uint32_t __stackguard_crashed_sp = 0;
+
+/** @brief Bottom of the main stack mapping (for #stackguard_set_active) */
+static uint32_t main_stack_base = 0;
+/** @brief Next free TLB entry (libdragon does not otherwise use the TLB) */
+static int tlb_next_index = 0;
+
+/** @brief Write one TLB entry mapping a pair of pages at their identity address */
+static void tlb_map_pair(uint32_t vaddr, uint32_t pgsize, uint32_t flags)
+{
+    assertf(tlb_next_index < 32, "Out of TLB entries");
+
+    disable_interrupts();
+    C0_WRITE_INDEX(tlb_next_index++);
+    C0_WRITE_PAGEMASK(((pgsize >> 12) - 1) << 13);
+    C0_WRITE_ENTRYHI(vaddr);
+    C0_WRITE_ENTRYLO0(((vaddr          ) >> 12 << 6) | flags);
+    C0_WRITE_ENTRYLO1(((vaddr + pgsize ) >> 12 << 6) | flags);
+    C0_TLBWI();
+    enable_interrupts();
+}
+
+/**
+ * @brief Pick the largest page size that tiles the region exactly.
+ *
+ * Each TLB entry maps a pair of pages, and its virtual address must be
+ * aligned to the pair, so larger pages need better-aligned regions. Larger
+ * pages spend fewer of the 32 TLB entries per stack.
+ */
+static uint32_t choose_page_size(uint32_t base, uint32_t size)
+{
+    for (uint32_t pgsize = 4*1024*1024; pgsize >= 4096; pgsize >>= 2) {
+        if ((base % (2*pgsize)) == 0 && (size % (2*pgsize)) == 0)
+            return pgsize;
+    }
+    return 0;
+}
+
+/** @brief Identity-map a physical region into KUSEG through the TLB */
+static void map_region(uint32_t base, uint32_t size, bool writable)
+{
+    uint32_t pgsize = choose_page_size(base, size);
+    assertf(pgsize != 0, "Stack not aligned: base 0x%lx size 0x%lx (8 KiB alignment required)", base, size);
+
+    uint32_t flags = C0_ENTRYLO_GLOBAL | C0_ENTRYLO_VALID | ENTRYLO_CACHED;
+    if (writable) flags |= C0_ENTRYLO_DIRTY;
+    for (uint32_t offset = 0; offset < size; offset += 2*pgsize)
+        tlb_map_pair(base + offset, pgsize, flags);
+}
+
+/** @brief Map a stack region plus its guard, and prepare the private exception stack */
+static void guard_install(uint32_t base, uint32_t size)
+{
+    // The stack pages are mapped writable at their identity address; the
+    // guard below is mapped read-only (writes raise a TLB modification
+    // exception), so that the exception handler and the backtrace code can
+    // still *read* around an overflowed stack pointer without faulting
+    // again. Everything further below is simply not mapped, which catches
+    // stack pointers thrown far away (eg: by a huge alloca).
+    map_region(base, size, true);
+    map_region(base - GUARD_SIZE, GUARD_SIZE, false);
+
+    // The overflow exception itself cannot run on the overflowed stack:
+    // allocate the private stack that inthandler switches to, the first
+    // time a guard is installed.
+    if (!__stackguard_exc_stack_top) {
+        void *exc_stack = malloc(EXC_STACK_SIZE);
+        assertf(exc_stack != NULL, "Out of memory allocating exception stack");
+        __stackguard_exc_stack_top = (uint32_t)exc_stack + EXC_STACK_SIZE;
+    }
+}
+
+void stackguard_init(int stack_size)
+{
+    assertf(main_stack_base == 0, "stackguard_init called twice");
+    assertf(stack_size > 0 && (stack_size % GUARD_SIZE) == 0,
+        "Invalid stack size %d (must be a multiple of 8 KiB)", stack_size);
+
+    // The main stack starts at the top of RDRAM (see entrypoint.S)
+    uint32_t top = get_memory_size();
+    uint32_t base = top - stack_size;
+
+    // The current stack depth must fit the region we are about to enforce
+    assertf(PhysicalAddr(&top) >= base + 1024,
+        "Stack already deeper than %d bytes; increase the guarded stack size", stack_size);
+
+    guard_install(base, stack_size);
+    main_stack_base = base;
+    MEMORY_BARRIER();
+    __stackguard_limit = base;      // arm the exception-handler check
+
+    // Move the stack pointer to the mapped alias: clearing the KSEG0 bits
+    // yields the identical KUSEG address, so every address already saved on
+    // the stack (frames, pointers to locals) keeps working through KSEG0
+    // while all further stack growth goes through the TLB.
+    asm volatile("and $sp, $sp, %0" :: "r"(0x1FFFFFFF));
+}
+
+void *stackguard_map(void *stack, int size)
+{
+    uint32_t base = PhysicalAddr(stack);
+    assertf((base % GUARD_SIZE) == 0 && size > 0 && (size % GUARD_SIZE) == 0,
+        "Invalid stack %p/%d (8 KiB alignment and size required)", stack, size);
+    assertf(base >= GUARD_SIZE, "Stack too low in RAM for a guard page");
+
+    guard_install(base, size);
+    return (void*)base;
+}
+
+void stackguard_set_active(void *stack)
+{
+    assertf(stack != NULL || main_stack_base != 0,
+        "stackguard_init must be called before tracking the main stack");
+    __stackguard_limit = stack ? (uint32_t)stack : main_stack_base;
+}
@@ -7,9 +7,120 @@
 #include "surface.h"
 #include "n64sys.h"
 #include "debug.h"
+#include "utils.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <string.h>
 
+/** @brief Minimum buffer size for which the surface pool is considered */
+#define SURFACE_POOL_MIN_SIZE    (32*1024)
+/** @brief Maximum number of buffers tracked by the surface pool */
+#define SURFACE_POOL_NUM_SLOTS   8
+
+/** @brief A buffer tracked by the surface pool */
+typedef struct {
+    void *buffer;           ///< Uncached pointer to the buffer (NULL = empty slot)
+    uint32_t capacity;      ///< Allocated size of the buffer in bytes
+    bool in_use;            ///< True if the buffer is currently part of a surface
+} surface_pool_slot_t;
+
+/** @brief Pool of large surface buffers, recycled across alloc/free cycles */
+static surface_pool_slot_t surface_pool[SURFACE_POOL_NUM_SLOTS];
+/** @brief Maximum total capacity of the surface pool (0 = pool disabled) */
+static uint32_t surface_pool_limit = 0;
+
+/** @brief Return the total capacity currently tracked by the pool */
+static uint32_t surface_pool_capacity(void)
+{
+    uint32_t total = 0;
+    for (int i = 0; i < SURFACE_POOL_NUM_SLOTS; i++)
+        total += surface_pool[i].capacity;
+    return total;
+}
+
+/**
+ * @brief Try to serve a buffer allocation from the surface pool.
+ *
+ * Picks the smallest cached buffer whose capacity can hold the requested
+ * size (best fit), so that big framebuffers are not wasted on small
+ * surfaces. Returns NULL if the pool has no suitable buffer.
+ */
+static void *surface_pool_acquire(uint32_t size)
+{
+    surface_pool_slot_t *best = NULL;
+    for (int i = 0; i < SURFACE_POOL_NUM_SLOTS; i++) {
+        surface_pool_slot_t *s = &surface_pool[i];
+        if (s->buffer && !s->in_use && s->capacity >= size &&
+            (!best || s->capacity < best->capacity))
+            best = s;
+    }
+    if (!best)
+        return NULL;
+    best->in_use = true;
+    return best->buffer;
+}
+
+/**
+ * @brief Register a freshly-allocated buffer with the surface pool.
+ *
+ * The buffer keeps being tracked (with its real capacity) for its whole
+ * life, so that it can be recycled at full size even after being reused
+ * for a smaller surface. Registration is best-effort: if the pool is full
+ * or over its configured limit, the buffer is simply not tracked.
+ */
+static void surface_pool_register(void *buffer, uint32_t size)
+{
+    if (size < SURFACE_POOL_MIN_SIZE || surface_pool_capacity() + size > surface_pool_limit)
+        return;
+    for (int i = 0; i < SURFACE_POOL_NUM_SLOTS; i++) {
+        surface_pool_slot_t *s = &surface_pool[i];
+        if (!s->buffer) {
+            s->buffer = buffer;
+            s->capacity = size;
+            s->in_use = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Give a buffer back to the surface pool, if it is tracked by it.
+ *
+ * @return true if the buffer belongs to the pool (and must not be freed),
+ *         false if it is a regular heap allocation.
+ */
+static bool surface_pool_release(void *buffer)
+{
+    for (int i = 0; i < SURFACE_POOL_NUM_SLOTS; i++) {
+        surface_pool_slot_t *s = &surface_pool[i];
+        if (s->buffer == buffer) {
+            assertf(s->in_use, "surface buffer %p freed twice", buffer);
+            s->in_use = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void surface_pool_set_limit(uint32_t max_bytes)
+{
+    surface_pool_limit = max_bytes;
+    if (!max_bytes)
+        surface_pool_flush();
+}
+
+void surface_pool_flush(void)
+{
+    for (int i = 0; i < SURFACE_POOL_NUM_SLOTS; i++) {
+        surface_pool_slot_t *s = &surface_pool[i];
+        if (s->buffer && !s->in_use) {
+            free_uncached(s->buffer);
+            s->buffer = NULL;
+            s->capacity = 0;
+        }
+    }
+}
+
 const char* tex_format_name(tex_format_t fmt)
 {
     switch (fmt) {
@@ -36,19 +147,41 @@ surface_t surface_alloc(tex_format_t format, uint32_t width, uint32_t height)
     // to test weird RDP formats (e.g. RGBA8) to find out what happens.
     assertf((format & ~SURFACE_FLAGS_TEXFORMAT) == 0,
         "invalid surface format: 0x%x (%d)", format, format);
-    return (surface_t){ 
+
+    uint32_t size = height * TEX_FORMAT_PIX2BYTES(format, width);
+
+    // Recycle a buffer from the surface pool if possible, otherwise go
+    // through the heap (and track the new buffer in the pool, if enabled).
+    void *buffer = surface_pool_acquire(size);
+    if (!buffer) {
+        buffer = malloc_uncached_aligned(64, size);
+        if (surface_pool_limit)
+            surface_pool_register(buffer, size);
+    }
+
+    return (surface_t){
         .flags = format | SURFACE_FLAGS_OWNEDBUFFER,
         .width = width,
         .height = height,
         .stride = TEX_FORMAT_PIX2BYTES(format, width),
-        .buffer = malloc_uncached_aligned(64, height * TEX_FORMAT_PIX2BYTES(format, width)),
+        .buffer = buffer,
     };
 }
 
+surface_t surface_alloc_zbuffer(uint32_t width, uint32_t height)
+{
+    // The Z-buffer is a 16-bit per pixel buffer with the same layout as a
+    // 16-bit color image, so allocate it as RGBA16: size, stride and the
+    // 64-byte alignment all match, and the surface can also be attached as
+    // a color image (see #rdp_attach) to clear it with a fill rectangle.
+    return surface_alloc(FMT_RGBA16, width, height);
+}
+
 void surface_free(surface_t *surface)
 {
     if (surface->buffer && surface->flags & SURFACE_FLAGS_OWNEDBUFFER) {
-        free_uncached(surface->buffer);
+        if (!surface_pool_release(surface->buffer))
+            free_uncached(surface->buffer);
         surface->buffer = NULL;
     }
     memset(surface, 0, sizeof(surface_t));
@@ -72,6 +205,60 @@ surface_t surface_make_sub(surface_t *parent, uint32_t x0, uint32_t y0, uint32_t
     return sub;
 }
 
+void surface_foreach_tile(surface_t *surface, uint32_t tile_width, uint32_t tile_height,
+    surface_tile_callback_t callback, void *ctx)
+{
+    // Default tile size: full rows, with enough of them that the tile fits
+    // half of the 8 KB data cache, leaving the other half to a second
+    // operand (eg: the source surface of a copy).
+    if (tile_width == 0)
+        tile_width = surface->width;
+    if (tile_height == 0) {
+        uint32_t rowbytes = TEX_FORMAT_PIX2BYTES(surface_get_format(surface), tile_width);
+        tile_height = MAX(1, (4*1024) / MAX(1, rowbytes));
+    }
+
+    for (uint32_t y = 0; y < surface->height; y += tile_height) {
+        uint32_t th = MIN(tile_height, (uint32_t)surface->height - y);
+        for (uint32_t x = 0; x < surface->width; x += tile_width) {
+            uint32_t tw = MIN(tile_width, (uint32_t)surface->width - x);
+            surface_t tile = surface_make_sub(surface, x, y, tw, th);
+            callback(&tile, x, y, ctx);
+        }
+    }
+}
+
+/** @brief Tile callback of #surface_copy: copy one tile row by row */
+static void __surface_copy_tile(surface_t *tile, uint32_t x0, uint32_t y0, void *ctx)
+{
+    surface_t src = surface_make_sub(ctx, x0, y0, tile->width, tile->height);
+    uint32_t rowbytes = TEX_FORMAT_PIX2BYTES(surface_get_format(tile), tile->width);
+
+    // Write misses on a cached destination can skip fetching the old pixels,
+    // as each row is completely overwritten. Uncached buffers (eg: those
+    // from surface_alloc) bypass the cache altogether, so leave them alone.
+    bool cached = ((uint32_t)tile->buffer & 0xE0000000) == 0x80000000;
+
+    for (uint32_t y = 0; y < tile->height; y++) {
+        void *d = tile->buffer + y * tile->stride;
+        if (cached)
+            data_cache_hit_create_dirty(d, rowbytes);
+        memcpy(d, src.buffer + y * src.stride, rowbytes);
+    }
+}
+
+void surface_copy(surface_t *dest, surface_t *source)
+{
+    assertf(surface_get_format(dest) == surface_get_format(source),
+        "surface_copy requires surfaces of the same format (%s / %s)",
+        tex_format_name(surface_get_format(dest)), tex_format_name(surface_get_format(source)));
+    assertf(dest->width == source->width && dest->height == source->height,
+        "surface_copy requires surfaces of the same size (%dx%d / %dx%d)",
+        dest->width, dest->height, source->width, source->height);
+
+    surface_foreach_tile(dest, 0, 0, __surface_copy_tile, source);
+}
+
 extern inline surface_t surface_make(void *buffer, tex_format_t format, uint32_t width, uint32_t height, uint32_t stride);
 extern inline tex_format_t surface_get_format(const surface_t *surface);
 extern inline surface_t surface_make_linear(void *buffer, tex_format_t format, uint32_t width, uint32_t height);
@@ -18,6 +18,7 @@
 #include <time.h>
 #include "system.h"
 #include "n64sys.h"
+#include "timer.h"
 
 /** 
  * @defgroup system newlib Interface Hooks
@@ -722,21 +723,91 @@ int getpid( void )
  */
 int gettimeofday( struct timeval *ptimeval, void *ptimezone )
 {
-    if( time_hook != NULL )
+    /* Prefer the COP0-based realtime clock, which has sub-second precision */
+    struct timespec now;
+    if( clock_gettime( CLOCK_REALTIME, &now ) == 0 )
     {
-        time_t time = time_hook();
-        if( time != -1 )
-        {
-            ptimeval->tv_sec = time;
-            ptimeval->tv_usec = 0;
-            return 0;
-        }
+        ptimeval->tv_sec = now.tv_sec;
+        ptimeval->tv_usec = now.tv_nsec / 1000;
+        return 0;
     }
 
     errno = ENOSYS;
     return -1;
 }
 
+/**
+ * @brief Return the current time of the requested clock
+ *
+ * Both supported clocks are backed by the free-running COP0 count register
+ * (through #timer_ticks, which extends it to 64 bits in an overflow-safe
+ * way), so reading them costs a handful of cycles: cheap enough to stamp
+ * thousands of events per second. #timer_init must have been called.
+ *
+ * - #CLOCK_MONOTONIC counts from when the timer module was initialized.
+ * - #CLOCK_REALTIME additionally requires the RTC driver (rtc.c): the COP0
+ *   count is anchored to a single hardware reading, which the driver
+ *   resynchronizes in the background on a slow timer, so no query after the
+ *   first one pays for a Joybus transaction. Without an RTC, it falls back
+ *   to the #gettimeofday time hook with second granularity.
+ *
+ * @param[in]  clock_id
+ *             Clock to query (#CLOCK_REALTIME or #CLOCK_MONOTONIC)
+ * @param[out] tp
+ *             Time structure to be filled with the current time.
+ *
+ * @return 0 on success or a negative value on error.
+ */
+int clock_gettime( clockid_t clock_id, struct timespec *tp )
+{
+    /* RTC anchor hook; weak so the RTC driver is not forced into the link */
+    extern bool __rtc_get_anchor( time_t *secs, int64_t *ticks ) __attribute__((weak));
+
+    long long ticks = timer_ticks();
+
+    switch( clock_id )
+    {
+        case CLOCK_MONOTONIC:
+        {
+            tp->tv_sec = ticks / TICKS_PER_SECOND;
+            tp->tv_nsec = ( ticks % TICKS_PER_SECOND ) * 1000000000LL / TICKS_PER_SECOND;
+            return 0;
+        }
+        case CLOCK_REALTIME:
+        {
+            time_t anchor_secs;
+            int64_t anchor_ticks;
+            if( __rtc_get_anchor && __rtc_get_anchor( &anchor_secs, &anchor_ticks ) )
+            {
+                int64_t delta = ticks - anchor_ticks;
+                tp->tv_sec = anchor_secs + delta / TICKS_PER_SECOND;
+                tp->tv_nsec = ( delta % TICKS_PER_SECOND ) * 1000000000LL / TICKS_PER_SECOND;
+                return 0;
+            }
+
+            /* No RTC: fall back to the time hook, with second granularity */
+            if( time_hook != NULL )
+            {
+                time_t time = time_hook();
+                if( time != -1 )
+                {
+                    tp->tv_sec = time;
+                    tp->tv_nsec = 0;
+                    return 0;
+                }
+            }
+
+            errno = ENOSYS;
+            return -1;
+        }
+        default:
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+}
+
 /**
  * @brief Return whether a file is a TTY or a regular file
  *
@@ -982,6 +1053,115 @@ int read( int file, char *ptr, int len )
     }
 }
 
+/**
+ * @brief Read from a file into multiple buffers
+ *
+ * Reads into each buffer of the vector in turn, as if by consecutive
+ * #read calls, but with a single descriptor lookup and hook dispatch.
+ * Filesystems providing the vectored hook can additionally coalesce
+ * adjacent ranges into fewer media transfers.
+ *
+ * @param[in]  file
+ *             File handle
+ * @param[in]  iov
+ *             Array of destination buffers
+ * @param[in]  iovcnt
+ *             Number of entries in iov
+ *
+ * @return Total number of bytes read or a negative value on error.
+ */
+ssize_t readv( int file, const struct iovec *iov, int iovcnt )
+{
+    filesystem_t *fs = __get_fs_pointer_by_handle( file );
+    void *handle = __get_fs_handle( file );
+
+    if( fs == 0 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if( fs->readv )
+    {
+        return fs->readv( handle, iov, iovcnt );
+    }
+
+    if( fs->read == 0 )
+    {
+        /* Filesystem doesn't support read */
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* Fall back to looping over the scalar hook */
+    ssize_t total = 0;
+    for( int i = 0; i < iovcnt; i++ )
+    {
+        int ret = fs->read( handle, (uint8_t *)iov[i].iov_base, iov[i].iov_len );
+        if( ret < 0 )
+        {
+            return total > 0 ? total : ret;
+        }
+        total += ret;
+        if( ret < (int)iov[i].iov_len )
+        {
+            break;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Read from a file at a given offset
+ *
+ * Reads at the given absolute offset without moving the file position.
+ *
+ * @param[in]  file
+ *             File handle
+ * @param[out] ptr
+ *             Data pointer to read data to
+ * @param[in]  len
+ *             Length in bytes of data to read
+ * @param[in]  offset
+ *             Absolute byte offset to read from
+ *
+ * @return Actual number of bytes read or a negative value on error.
+ */
+ssize_t pread( int file, void *ptr, size_t len, off_t offset )
+{
+    filesystem_t *fs = __get_fs_pointer_by_handle( file );
+    void *handle = __get_fs_handle( file );
+
+    if( fs == 0 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if( fs->pread )
+    {
+        return fs->pread( handle, (uint8_t *)ptr, len, offset );
+    }
+
+    if( fs->read == 0 || fs->lseek == 0 )
+    {
+        /* Filesystem doesn't support the scalar fallback */
+        errno = ENOSYS;
+        return -1;
+    }
+
+    /* Fall back to a seek/read/seek-back sequence through the hooks */
+    int save = fs->lseek( handle, 0, SEEK_CUR );
+    if( save < 0 || fs->lseek( handle, offset, SEEK_SET ) < 0 )
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int ret = fs->read( handle, (uint8_t *)ptr, len );
+    fs->lseek( handle, save, SEEK_SET );
+    return ret;
+}
+
 /**
  * @brief Read a link
  *
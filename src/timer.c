@@ -4,6 +4,7 @@
  * @ingroup timer
  */
 #include <malloc.h>
+#include <string.h>
 #include "timer.h"
 #include "interrupt.h"
 #include "debug.h"
@@ -36,11 +37,40 @@
  * TICKS_READ), it's not possible to schedule a timer more than 90 seconds
  * in the future.
  *
+ * Internally, active timers are kept in a hierarchical timing wheel: an
+ * array of bucket lists indexed by the upcoming deadline, in three levels
+ * of increasing coarseness. Insertion and removal are O(1), and the
+ * interrupt handler only ever inspects the single bucket whose time window
+ * has come up (plus the occasional constant-bound cascade from the coarser
+ * levels), so dispatch cost does not grow with the number of active timers.
+ *
  * @{
  */
 
-/** @brief Internal linked list of timers */
-static timer_link_t *TI_timers = 0;
+/** @brief Number of bits used as bucket index in each wheel level */
+#define WHEEL_SLOT_BITS  6
+/** @brief Number of buckets in each wheel level */
+#define WHEEL_SLOTS      (1 << WHEEL_SLOT_BITS)
+/** @brief Number of wheel levels (enough to cover the full 32-bit tick range) */
+#define WHEEL_LEVELS     3
+/** @brief Log2 of the tick span covered by one level-0 bucket (~1.4 ms) */
+#define WHEEL_L0_SHIFT   16
+
+/** @brief Log2 of the tick span covered by one bucket of the specified level */
+#define WHEEL_SHIFT(level)   (WHEEL_L0_SHIFT + (level) * WHEEL_SLOT_BITS)
+/** @brief Tick span covered by one bucket of the specified level */
+#define WHEEL_SPAN(level)    ((uint32_t)1 << WHEEL_SHIFT(level))
+/** @brief Bucket index within its level for the specified absolute tick */
+#define WHEEL_SLOT(level, ticks)  (((ticks) >> WHEEL_SHIFT(level)) & (WHEEL_SLOTS-1))
+
+/** @brief The timing wheel: bucket heads for each level/slot */
+static timer_link_t *wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+/** @brief Number of timers currently linked in each wheel level */
+static int wheel_count[WHEEL_LEVELS];
+/** @brief Absolute tick up to which the wheel buckets have been processed */
+static uint32_t wheel_clock;
+/** @brief True if the timer subsystem has been initialized */
+static bool timer_active = false;
 
 /** @brief Higher-part of 64-bit tick counter */
 volatile uint32_t ticks64_high;
@@ -51,166 +81,275 @@ extern volatile uint32_t interrupt_disabled_tick;
 /** @brief Timer callback expects a context parameter */
 #define TF_CONTEXT     0x20
 
-/** @brief Timer is the special overflow timer. */
-#define TF_OVERFLOW    0x40
+/** @brief Timer is currently linked into the wheel. */
+#define TF_LINKED      0x100
+
+/** @brief Timer is backed by the preallocated pool (never free()d). */
+#define TF_POOLED      0x200
+
+/** @brief Backing array of the preallocated timer pool (NULL if not initialized) */
+static timer_link_t *timer_pool_mem = NULL;
+/** @brief Free list of pool entries, chained via their next pointer */
+static timer_link_t *timer_pool_free_list = NULL;
+/** @brief Number of entries in the timer pool */
+static int timer_pool_size = 0;
+
+/**
+ * @brief Link a timer into the wheel bucket matching its deadline
+ *
+ * The level is selected from the distance of the deadline from the wheel
+ * clock: the closer the deadline, the finer the level. Timers whose
+ * deadline has already passed are linked into the bucket currently being
+ * processed, so that the next poll fires them immediately.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void timer_insert(timer_link_t *timer)
+{
+	uint32_t delta = timer->left - wheel_clock;
+	uint32_t ref = timer->left;
+	int level;
+
+	if ((int32_t)delta <= 0)
+	{
+		/* Deadline already passed: file it under the current bucket */
+		level = 0;
+		ref = wheel_clock;
+	}
+	else if (delta < WHEEL_SPAN(1))
+		level = 0;
+	else if (delta < WHEEL_SPAN(2))
+		level = 1;
+	else
+		level = 2;
+
+	timer_link_t **bucket = &wheel[level][WHEEL_SLOT(level, ref)];
+	timer->bucket = bucket;
+	timer->prev = NULL;
+	timer->next = *bucket;
+	if (*bucket)
+		(*bucket)->prev = timer;
+	*bucket = timer;
+	timer->flags |= TF_LINKED;
+	wheel_count[level]++;
+}
 
-/** @brief Timer has been called once in this interrupt. */
-#define TF_CALLED      0x80
+/**
+ * @brief Unlink a timer from its wheel bucket (O(1))
+ *
+ * @note This function must be called with interrupts disabled, and the
+ *       timer must be currently linked (TF_LINKED).
+ */
+static void timer_unlink(timer_link_t *timer)
+{
+	if (timer->prev)
+		timer->prev->next = timer->next;
+	else
+		*timer->bucket = timer->next;
+	if (timer->next)
+		timer->next->prev = timer->prev;
+
+	int level = (timer->bucket - &wheel[0][0]) >> WHEEL_SLOT_BITS;
+	wheel_count[level]--;
+
+	timer->next = NULL;
+	timer->prev = NULL;
+	timer->bucket = NULL;
+	timer->flags &= ~TF_LINKED;
+}
+
+/**
+ * @brief Cascade one bucket of a coarse level down into the finer levels
+ *
+ * Called when the wheel clock enters a new time window of the specified
+ * level: all timers parked in the bucket for that window are re-inserted,
+ * which files them into the appropriate finer-grained bucket.
+ *
+ * @note This function must be called with interrupts disabled.
+ */
+static void timer_cascade(int level)
+{
+	timer_link_t *head = wheel[level][WHEEL_SLOT(level, wheel_clock)];
+	while (head)
+	{
+		timer_link_t *next = head->next;
+		timer_unlink(head);
+		timer_insert(head);
+		head = next;
+	}
+}
 
 /** @brief Update the compare register to match the first expiring timer. */
 __attribute__((noinline))
-static void timer_update_compare(timer_link_t *head, uint32_t now)
+static void timer_update_compare(uint32_t now)
 {
-	uint32_t smallest = 0xFFFFFFFF;
+	/* Default: wake up within half a counter wrap, so that the wheel clock
+	   always advances often enough to keep tick distances unambiguous (and
+	   the 64-bit counter in timer_ticks() coherent). */
+	uint32_t next = now + 0x7FFFFFFF;
 
-	while (head)
+	if (wheel_count[0])
 	{
-		/* See how much time is left before the timer expires. Notice that
-		   the subtraction is also safe with overflows. */
-		uint32_t left = head->left - now;
-		if (left < smallest)
-			smallest = left;
-
-		/* Go to next */
-		head = head->next;
+		/* Scan level-0 buckets forward in time from the current one: the
+		   first non-empty bucket contains the next deadline. This is at
+		   most WHEEL_SLOTS iterations regardless of timer population. */
+		uint32_t t = wheel_clock;
+		for (int i = 0; i < WHEEL_SLOTS; i++)
+		{
+			timer_link_t *head = wheel[0][WHEEL_SLOT(0, t)];
+			if (head)
+			{
+				/* See how much time is left before each timer expires.
+				   Notice that the subtraction is also safe with overflows. */
+				uint32_t smallest = 0xFFFFFFFF;
+				while (head)
+				{
+					uint32_t left = head->left - now;
+					if (left < smallest)
+						smallest = left;
+					head = head->next;
+				}
+				uint32_t cand = now + smallest;
+				if (TICKS_DISTANCE(cand, next) > 0)
+					next = cand;
+				break;
+			}
+
+			/* Advance to the start of the next bucket. The scan deliberately
+			   continues past the next level-1 window boundary: timer_insert
+			   files any deadline closer than WHEEL_SPAN(1) directly into
+			   level 0, even when its bucket lies in the next window, so all
+			   WHEEL_SLOTS buckets (which uniquely cover that range) must be
+			   examined. */
+			t = (t | (WHEEL_SPAN(0)-1)) + 1;
+		}
+	}
+
+	/* If timers are parked at the coarser levels, make sure we wake up at
+	   the next cascade boundary to pull them down. */
+	if (wheel_count[1] || wheel_count[2])
+	{
+		uint32_t boundary = (wheel_clock | (WHEEL_SPAN(1)-1)) + 1;
+		if (TICKS_DISTANCE(boundary, next) > 0)
+			next = boundary;
 	}
 
-	/* set compare to shortest time left */
-	C0_WRITE_COMPARE(now + smallest);
+	/* Never sleep past the counter wrap: wake up exactly at the wrap instead,
+	   so that the high part of the 64-bit counter is incremented promptly
+	   (timer_ticks() relies on that). */
+	if (next < now)
+		next = 0;
+
+	C0_WRITE_COMPARE(next);
 }
 
 /**
- * @brief Process linked list of timers
+ * @brief Advance the wheel clock and fire expired timers
  *
- * Walk the linked list of timers and call the callbacks of any that
- * have expired.
+ * Walk the wheel buckets from the current wheel clock up to the present
+ * time, calling the callbacks of any timer that has expired, and cascading
+ * the coarser levels at each window boundary.
  *
- * @note This function will remove one-shot timers from the list after
+ * @note This function will remove one-shot timers from the wheel after
  *       they have fired.
  *
- * @param[in] head
- *            Head of the linked list of timers
- *
- * @retval 1 The list needs reprocessing
+ * @retval 1 The wheel needs reprocessing
  * @retval 0 All timer operations were handled successfully
  */
-static int __proc_timers(timer_link_t * thead)
+static int __proc_timers(void)
 {
-	timer_link_t *head = thead;
-	timer_link_t *last = 0;
-	uint32_t start = C0_COMPARE();
 	uint32_t now = TICKS_READ();
 
-	while (head)
+	/* Consider a timer as expired if its deadline is up to 5 microseconds
+	 * in the future. This 5 microseconds window is useful to cluster
+	 * timers that expire close to each other; eg: if the client creates
+	 * many timers with the same period, they will be created in a fast
+	 * sequence and have a little delay between each other. */
+	uint32_t limit = now + TIMER_TICKS(5);
+
+	for (;;)
 	{
-		/* Consider a timer as expired if its deadline is at the
-		 * COMPARE value (time at which the interrupt triggered) or up to 5
-		 * microseconds after. This 5 microseconds window is useful to cluster
-		 * timers that expire close to each other; eg: if the client creates
-		 * many timers with the same period, they will be created in a fast
-		 * sequence and have a little delay between each other. */
-		if (!(head->flags & TF_CALLED) && 
-			!(head->flags & TF_DISABLED) &&
-			TICKS_DISTANCE(start, head->left) >= 0 && 
-			TICKS_DISTANCE(head->left, now+TIMER_TICKS(5)) >= 0)
+		/* Fire the due timers in the bucket the wheel clock is in */
+		if (wheel_count[0])
 		{
-			/* yes - timed out, do callback */
-			head->ovfl = TICKS_DISTANCE(head->left, now);
-
-			/* invoke the appropriate callback function */
-			if (head->flags & TF_CONTEXT && head->callback_with_context)
-				head->callback_with_context(head->ovfl, head->ctx);
-			else if (head->callback)
-				head->callback(head->ovfl);
-
-			if (head->flags & TF_DISABLED)
-			{
-				/* Timer was disabled during the callback. We need to
-				 * reprocess the list to see if there are other timers
-				 * that need to be called. */
-				return 1;
-			}
-
-			/* reset ticks if continuous */
-			if (head->flags & TF_CONTINUOUS)
-			{
-				head->left += head->set;
-				last = head;
-
-				/* Special case: the internal overflow timer has a period
-				 * of 2**32, so next occurrence will look exactly like the
-				 * current one. Since we're going to reprocess the list, we
-				 * would keep executing it many times until we eventually
-				 * exit the 5 microseconds window.
-				 * So we mark this timer as already called (TF_CALLED) and
-				 * avoid calling it again. 
-				 *
-				 * Notice that we do this only for overflow because other timers
-				 * with a short period might actually be called multiple times
-				 * under interrupt. For instance, if a continuous timer with
-				 * a short period is followed by a very slow one-shot timer,
-				 * when the latter is finished the former might need to fire again.
-				 */
-				if (head->flags & TF_OVERFLOW)
-					head->flags |= TF_CALLED;
-			}
-			else
+			timer_link_t *head = wheel[0][WHEEL_SLOT(0, wheel_clock)];
+			while (head)
 			{
-				/* one-shot, remove from list */
-				if (last)
-					last->next = head->next;
-				else
-					TI_timers = head->next;
+				timer_link_t *next = head->next;
+				if (!(head->flags & TF_DISABLED) &&
+					TICKS_DISTANCE(head->left, limit) >= 0)
+				{
+					/* yes - timed out, unlink it and do callback. Unlinking
+					   first makes it safe for the callback to stop or restart
+					   any timer, including this one. */
+					timer_unlink(head);
+					head->ovfl = TICKS_DISTANCE(head->left, now);
+
+					/* invoke the appropriate callback function */
+					if (head->flags & TF_CONTEXT && head->callback_with_context)
+						head->callback_with_context(head->ovfl, head->ctx);
+					else if (head->callback)
+						head->callback(head->ovfl);
+
+					/* relink if continuous (and not disabled by the callback).
+					   Notice that a continuous timer with a short period might
+					   be relinked into the current bucket and actually be
+					   called multiple times under a single interrupt. */
+					if ((head->flags & TF_CONTINUOUS) && !(head->flags & TF_DISABLED))
+					{
+						head->left += head->set;
+						timer_insert(head);
+					}
+
+					/* Go through the wheel again. If the callback was slow,
+					   maybe other timers have expired. */
+					return 1;
+				}
+				head = next;
 			}
-
-			/* Go through timer list again. If the callback was slow, maybe
-			   other timers have expired. */
-			return 1;
 		}
 
-		/* Go to next */
-		last = head;
-		head = head->next;
-	}
-
-	/* Clear the TF_CALLED flag from the overflow timer (if any) */
-	while (thead) {
-		thead->flags &= ~TF_CALLED;
-		thead = thead->next;
+		/* Advance the wheel clock. If level 0 is empty we can jump straight
+		   to the next cascade boundary; otherwise step bucket by bucket so
+		   that no bucket is skipped without being fired. */
+		uint32_t step = wheel_count[0] ? WHEEL_SPAN(0) : WHEEL_SPAN(1);
+		uint32_t clock_next = (wheel_clock | (step-1)) + 1;
+		if (TICKS_DISTANCE(clock_next, now) < 0)
+			return 0;						// caught up with present time
+		wheel_clock = clock_next;
+
+		/* Keep the 64-bit tick counter (timer_ticks) up to date */
+		if (wheel_clock == 0)
+			ticks64_high++;
+
+		/* Entering a new coarse window: pull down the parked timers */
+		if ((wheel_clock & (WHEEL_SPAN(1)-1)) == 0)
+		{
+			if ((wheel_clock & (WHEEL_SPAN(2)-1)) == 0)
+				timer_cascade(2);
+			timer_cascade(1);
+		}
 	}
-	return 0;							// exit timer callback
 }
 
 /**
- * @brief Poll the timer list and run callbacks for expired timers
+ * @brief Poll the timing wheel and run callbacks for expired timers
  *
- * This function is called by the interrupt handler whenever 
+ * This function is called by the interrupt handler whenever
  * compare == count, and also when inserting into or removing
- * from the timers list to improve handling timers with tiny delays
+ * from the wheel to improve handling timers with tiny delays
  */
 static void timer_poll(void)
 {
 	uint32_t loop_count = 0;
-	while (__proc_timers(TI_timers)) {
+	while (__proc_timers()) {
 		++loop_count; (void)loop_count; // avoid warning (loop_count is used in assertf)
 		assertf(loop_count < 1000, "timer interrupt is stuck in an infinite loop.\n"
 			"Check continuous timers with a very short period.\n");
 	}
 
 	// Update counter for next interrupt.
-	timer_update_compare(TI_timers, TICKS_READ());
-}
-
-/**
- * @brief Timer callback overflow function
- *
- * This function is the callback of the internal overflow timer, which
- * is configured by timer_init() and is used to create a 64-bit timer
- * accessed by timer_ticks().
- */
-static void timer_overflow_callback(int ovfl)
-{
-	ticks64_high++;
+	timer_update_compare(TICKS_READ());
 }
 
 /**
@@ -225,29 +364,20 @@ static void timer_overflow_callback(int ovfl)
  */
 void timer_init(void)
 {
-	assertf(!TI_timers, "timer module already initialized");
-	/* Create first timer for overflows: expires when counter is 0 and
-	 * has a period of 2**32. */
-	timer_link_t *timer = malloc(sizeof(timer_link_t));
-	if (timer)
-	{
-		timer->left = 0;
-		timer->set = 0;
-		timer->flags = TF_CONTINUOUS | TF_OVERFLOW;
-		timer->callback = timer_overflow_callback;
-		timer->ctx = NULL;
-		timer->next = NULL;
+	assertf(!timer_active, "timer module already initialized");
 
-		TI_timers = timer;
-	}
-
-	/* Reset the count and compare registers. Avoid to accidentally trigger
-	   an interrupt by setting count to 1 and compare to 0. Also enable
-	   timer interrupts in COP0. */
+	/* Reset the count register and the wheel. The compare register is set
+	   half a counter wrap away: even with no active timers, the handler runs
+	   often enough to advance the wheel clock unambiguously and keep the
+	   64-bit counter accessed by timer_ticks() up to date. */
 	disable_interrupts();
+	memset(wheel, 0, sizeof(wheel));
+	memset(wheel_count, 0, sizeof(wheel_count));
+	wheel_clock = 0;
 	ticks64_high = 0;
+	timer_active = true;
 	C0_WRITE_COUNT(1);
-	C0_WRITE_COMPARE(0);
+	C0_WRITE_COMPARE(0x7FFFFFFF);
 	set_TI_interrupt(1);
 	register_TI_handler(timer_poll);
 	enable_interrupts();
@@ -255,7 +385,7 @@ void timer_init(void)
 
 /**
  * @brief Create a new timer and add to list
- * 
+ *
  * If you need to associate some data with the timer, consider using
  * #new_timer_context to include a pointer in the callback.
  *
@@ -270,7 +400,7 @@ void timer_init(void)
  */
 timer_link_t *new_timer(int ticks, int flags, timer_callback1_t callback)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	timer_link_t *timer = malloc(sizeof(timer_link_t));
 	if (timer)
 	{
@@ -282,12 +412,12 @@ timer_link_t *new_timer(int ticks, int flags, timer_callback1_t callback)
 		timer->flags = flags;
 		timer->callback = callback;
 		timer->ctx = NULL;
+		timer->next = timer->prev = NULL;
+		timer->bucket = NULL;
 
 		if (!(flags & TF_DISABLED))
 		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
+			timer_insert(timer);
 			timer_poll();
 		}
 
@@ -298,7 +428,7 @@ timer_link_t *new_timer(int ticks, int flags, timer_callback1_t callback)
 
 /**
  * @brief Create a new timer with context and add to list
- * 
+ *
  * If you don't need the context, consider using #new_timer instead.
  *
  * @param[in] ticks
@@ -314,7 +444,7 @@ timer_link_t *new_timer(int ticks, int flags, timer_callback1_t callback)
  */
 timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback, void *ctx)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	timer_link_t *timer = malloc(sizeof(timer_link_t));
 	if (timer)
 	{
@@ -326,12 +456,12 @@ timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback
 		timer->flags = flags | TF_CONTEXT;
 		timer->callback_with_context = callback;
 		timer->ctx = ctx;
+		timer->next = timer->prev = NULL;
+		timer->bucket = NULL;
 
 		if (!(flags & TF_DISABLED))
 		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
+			timer_insert(timer);
 			timer_poll();
 		}
 
@@ -342,7 +472,7 @@ timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback
 
 /**
  * @brief Start a timer (not currently in the list)
- * 
+ *
  * If you need to associate some data with the timer, consider using
  * #start_timer_context to include a pointer in the callback.
  *
@@ -357,11 +487,14 @@ timer_link_t *new_timer_context(int ticks, int flags, timer_callback2_t callback
  */
 void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t callback)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	if (timer)
 	{
 		disable_interrupts();
 
+		if (timer->flags & TF_LINKED)
+			timer_unlink(timer);
+
 		uint32_t now = TICKS_READ();
 		timer->left = now + (int32_t)ticks;
 		timer->set = ticks;
@@ -371,9 +504,7 @@ void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t ca
 
 		if (!(flags & TF_DISABLED))
 		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
+			timer_insert(timer);
 			timer_poll();
 		}
 
@@ -383,7 +514,7 @@ void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t ca
 
 /**
  * @brief Start a timer (not currently in the list) with context
- * 
+ *
  * If you don't need the context, consider using #start_timer instead.
  *
  * @param[in] timer
@@ -399,11 +530,14 @@ void start_timer(timer_link_t *timer, int ticks, int flags, timer_callback1_t ca
  */
 void start_timer_context(timer_link_t *timer, int ticks, int flags, timer_callback2_t callback, void *ctx)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	if (timer)
 	{
 		disable_interrupts();
 
+		if (timer->flags & TF_LINKED)
+			timer_unlink(timer);
+
 		uint32_t now = TICKS_READ();
 		timer->left = now + (int32_t)ticks;
 		timer->set = ticks;
@@ -411,11 +545,9 @@ void start_timer_context(timer_link_t *timer, int ticks, int flags, timer_callba
 		timer->callback_with_context = callback;
 		timer->ctx = ctx;
 
-		if (flags & TF_DISABLED)
+		if (!(flags & TF_DISABLED))
 		{
-			timer->next = TI_timers;
-			TI_timers = timer;
-			timer_update_compare(TI_timers, now);
+			timer_insert(timer);
 			timer_poll();
 		}
 
@@ -423,6 +555,165 @@ void start_timer_context(timer_link_t *timer, int ticks, int flags, timer_callba
 	}
 }
 
+/**
+ * @brief Preallocate a pool of timers
+ *
+ * This function allocates (in one go) a pool of @p n timers that can then
+ * be created and destroyed with #timer_pool_new, #timer_pool_new_context
+ * and #timer_pool_delete without any further heap activity. This avoids
+ * heap fragmentation when one-shot timers are created and destroyed at a
+ * high rate, and makes timer creation safe from interrupt context (where
+ * malloc is not).
+ *
+ * @param[in] n
+ *            Number of timers the pool must be able to hold
+ */
+void timer_pool_init(int n)
+{
+	assertf(timer_active, "timer module not initialized");
+	assertf(!timer_pool_mem, "timer pool already initialized");
+	assertf(n > 0, "invalid timer pool size: %d", n);
+
+	timer_pool_mem = malloc(sizeof(timer_link_t) * n);
+	assertf(timer_pool_mem, "cannot allocate timer pool");
+	timer_pool_size = n;
+
+	disable_interrupts();
+	timer_pool_free_list = NULL;
+	for (int i = 0; i < n; i++)
+	{
+		timer_pool_mem[i].next = timer_pool_free_list;
+		timer_pool_free_list = &timer_pool_mem[i];
+	}
+	enable_interrupts();
+}
+
+/**
+ * @brief Create a new timer from the preallocated pool
+ *
+ * Like #new_timer, but the timer comes from the pool created with
+ * #timer_pool_init instead of the heap, so this function is safe to call
+ * from interrupt context (eg: from another timer's callback). The returned
+ * pointer stays valid until passed to #timer_pool_delete.
+ *
+ * @param[in] ticks
+ *            Number of ticks before the timer should fire
+ * @param[in] flags
+ *            Timer flags.  See #TF_ONE_SHOT, #TF_CONTINUOUS and #TF_DISABLED
+ * @param[in] callback
+ *            Callback function to call when the timer expires
+ *
+ * @return A pointer to the timer structure created, or NULL if the pool
+ *         is exhausted
+ */
+timer_link_t *timer_pool_new(int ticks, int flags, timer_callback1_t callback)
+{
+	assertf(timer_pool_mem, "timer pool not initialized");
+	disable_interrupts();
+
+	timer_link_t *timer = timer_pool_free_list;
+	if (timer)
+	{
+		timer_pool_free_list = timer->next;
+		timer->next = timer->prev = NULL;
+		timer->bucket = NULL;
+		timer->flags = TF_POOLED;
+		start_timer(timer, ticks, flags | TF_POOLED, callback);
+	}
+
+	enable_interrupts();
+	return timer;
+}
+
+/**
+ * @brief Create a new timer with context from the preallocated pool
+ *
+ * Like #timer_pool_new, but the callback receives an opaque context
+ * pointer. See #timer_pool_new for the pool semantics.
+ *
+ * @param[in] ticks
+ *            Number of ticks before the timer should fire
+ * @param[in] flags
+ *            Timer flags.  See #TF_ONE_SHOT, #TF_CONTINUOUS and #TF_DISABLED
+ * @param[in] callback
+ *            Callback function to call when the timer expires
+ * @param[in] ctx
+ *            Opaque pointer to pass as an argument to callback
+ *
+ * @return A pointer to the timer structure created, or NULL if the pool
+ *         is exhausted
+ */
+timer_link_t *timer_pool_new_context(int ticks, int flags, timer_callback2_t callback, void *ctx)
+{
+	assertf(timer_pool_mem, "timer pool not initialized");
+	disable_interrupts();
+
+	timer_link_t *timer = timer_pool_free_list;
+	if (timer)
+	{
+		timer_pool_free_list = timer->next;
+		timer->next = timer->prev = NULL;
+		timer->bucket = NULL;
+		timer->flags = TF_POOLED;
+		start_timer_context(timer, ticks, flags | TF_POOLED, callback, ctx);
+	}
+
+	enable_interrupts();
+	return timer;
+}
+
+/**
+ * @brief Stop a pool-backed timer and return it to the pool
+ *
+ * Like #delete_timer, but for timers created with #timer_pool_new or
+ * #timer_pool_new_context: the entry is returned to the pool instead of
+ * being freed, so this function is safe to call from interrupt context.
+ *
+ * @note Like #delete_timer, it is not safe to call this function from
+ *       the timer's own callback. Use #stop_timer there instead, and
+ *       delete the timer later.
+ *
+ * @param[in] timer
+ *            Pool timer to stop, remove and recycle
+ */
+void timer_pool_delete(timer_link_t *timer)
+{
+	assertf(timer_pool_mem, "timer pool not initialized");
+	if (timer)
+	{
+		assertf(timer->flags & TF_POOLED, "timer was not created from the pool");
+		disable_interrupts();
+		if (timer->flags & TF_LINKED)
+			timer_unlink(timer);
+		timer->flags = TF_POOLED | TF_DISABLED;
+		timer->next = timer_pool_free_list;
+		timer_pool_free_list = timer;
+		enable_interrupts();
+	}
+}
+
+/**
+ * @brief Free the preallocated timer pool
+ *
+ * Any pool timer still running is stopped before the pool memory is
+ * released.
+ */
+void timer_pool_close(void)
+{
+	assertf(timer_pool_mem, "timer pool not initialized");
+	disable_interrupts();
+	for (int i = 0; i < timer_pool_size; i++)
+	{
+		if (timer_pool_mem[i].flags & TF_LINKED)
+			timer_unlink(&timer_pool_mem[i]);
+	}
+	free(timer_pool_mem);
+	timer_pool_mem = NULL;
+	timer_pool_free_list = NULL;
+	timer_pool_size = 0;
+	enable_interrupts();
+}
+
 /**
  * @brief Reset a timer and add to list
  *
@@ -435,13 +726,14 @@ void restart_timer(timer_link_t *timer)
 	{
 		disable_interrupts();
 
+		if (timer->flags & TF_LINKED)
+			timer_unlink(timer);
+
 		uint32_t now = TICKS_READ();
 		timer->left = now + (int32_t)timer->set;
 		timer->flags &= ~TF_DISABLED;
 
-		timer->next = TI_timers;
-		TI_timers = timer;
-		timer_update_compare(TI_timers, now);
+		timer_insert(timer);
 		timer_poll();
 
 		enable_interrupts();
@@ -453,7 +745,7 @@ void restart_timer(timer_link_t *timer)
  *
  * @note This function does not free a timer structure, use #delete_timer
  *       to do this.
- * 
+ *
  * @note It is safe to call this function from a timer callback, including
  *       to stop a timer from its own callback.
  *
@@ -462,32 +754,14 @@ void restart_timer(timer_link_t *timer)
  */
 void stop_timer(timer_link_t *timer)
 {
-	timer_link_t *head;
-	timer_link_t *last = 0;
-
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	if (timer)
 	{
 		disable_interrupts();
-		head = TI_timers;
-		while (head)
-		{
-			if (head == timer)
-			{
-				/* remove from list */
-				if (last)
-					last->next = head->next;
-				else
-					TI_timers = head->next;
-
-				break;
-			}
-
-			last = head;
-			head = head->next;
-		}
+		if (timer->flags & TF_LINKED)
+			timer_unlink(timer);
 		timer->flags |= TF_DISABLED;
-		timer_update_compare(TI_timers, TICKS_READ());
+		timer_update_compare(TICKS_READ());
 		enable_interrupts();
 	}
 }
@@ -502,7 +776,7 @@ void stop_timer(timer_link_t *timer)
  */
 void delete_timer(timer_link_t *timer)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	if (timer)
 	{
 		stop_timer(timer);
@@ -513,38 +787,45 @@ void delete_timer(timer_link_t *timer)
 /**
  * @brief Free and close the timer subsystem
  *
- * This function will ensure all recurring timers are deleted from the list 
+ * This function will ensure all recurring timers are deleted from the list
  * before closing.  One-shot timers that have expired will need to be
  * manually deleted with #delete_timer.
  */
 void timer_close(void)
 {
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 	disable_interrupts();
-	
+
 	/* Disable generation of timer interrupt. */
 	set_TI_interrupt(0);
 	unregister_TI_handler(timer_poll);
 
-	timer_link_t *head = TI_timers;
-	while (head)
+	for (int level = 0; level < WHEEL_LEVELS; level++)
 	{
-		timer_link_t *last = head;
-		head = head->next;
-
-		if (last->flags & TF_CONTINUOUS)
+		for (int slot = 0; slot < WHEEL_SLOTS; slot++)
 		{
-			/* Only free if it is a continuous timer as one-shot timers are
-			 * freed by the user.  If we free a timer here, the user will
-			 * never know if a one shot expired and needs to be removed or
-			 * was removed automatically by timer_close.  We avoid this race
-			 * condition by ensuring that the timer system never frees a 
-			 * one shot timer.
-			 */
-			free(last);
+			timer_link_t *head = wheel[level][slot];
+			while (head)
+			{
+				timer_link_t *last = head;
+				head = head->next;
+
+				timer_unlink(last);
+				if ((last->flags & TF_CONTINUOUS) && !(last->flags & TF_POOLED))
+				{
+					/* Only free if it is a continuous timer as one-shot timers are
+					 * freed by the user.  If we free a timer here, the user will
+					 * never know if a one shot expired and needs to be removed or
+					 * was removed automatically by timer_close.  We avoid this race
+					 * condition by ensuring that the timer system never frees a
+					 * one shot timer.
+					 */
+					free(last);
+				}
+			}
 		}
 	}
-	TI_timers = 0;
+	timer_active = false;
 	enable_interrupts();
 }
 
@@ -557,7 +838,7 @@ void timer_close(void)
 long long timer_ticks(void)
 {
 	uint32_t low, high;
-	assertf(TI_timers, "timer module not initialized");
+	assertf(timer_active, "timer module not initialized");
 
 	/* Check whether interrupts are enabled or not. We need a different strategy
 	 * to account for race conditions. */
@@ -581,7 +862,7 @@ long long timer_ticks(void)
 		 * than 2**32 ticks, it's game over because we can't know how many times
 		 * the counter has overflown.
 		 * So assuming they were disabled for not too long, check whether there
-		 * was a counter overflow between now and when they were disabled. 
+		 * was a counter overflow between now and when they were disabled.
 		 * If there was, increment high. */
 		low = TICKS_READ();
 		high = ticks64_high;
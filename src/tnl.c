@@ -0,0 +1,151 @@
+/**
+ * @file tnl.c
+ * @brief RSP transform & triangle setup
+ * @ingroup rsp
+ *
+ * CPU-side implementation of the geometry pipeline. See tnl.h for the API
+ * documentation, and rsp_tnl.S for the RSP-side transform and setup code.
+ */
+
+#include "tnl.h"
+#include "rspq.h"
+#include "n64sys.h"
+#include "debug.h"
+#include "utils.h"
+#include <stdbool.h>
+#include <string.h>
+
+/** @brief Overlay commands (see rsp_tnl.S) */
+enum {
+    TNL_CMD_SET_MATRIX    = 0x0,    ///< Load the transformation matrix
+    TNL_CMD_SET_VIEWPORT  = 0x1,    ///< Set the viewport scale/offset
+    TNL_CMD_LOAD_VERTICES = 0x2,    ///< Transform vertices into the cache
+    TNL_CMD_TRIANGLE      = 0x3,    ///< Set up and draw one triangle
+};
+
+/** @brief Size in bytes of a packed matrix as DMA'd to the RSP */
+#define TNL_MATRIX_SIZE     64
+
+/**
+ * @brief Number of matrix staging slots
+ *
+ * Matrices are packed into uncached staging slots that the RSP fetches
+ * asynchronously; the slots are reused round-robin, so this bounds how
+ * many matrix loads can be enqueued before the oldest one must have been
+ * consumed. Keep it a power of two.
+ */
+#define TNL_MATRIX_SLOTS    8
+
+/** The transform & setup ucode */
+DEFINE_RSP_UCODE(rsp_tnl);
+
+/** @brief Overlay ID assigned to the ucode (0 if not initialized) */
+static uint32_t tnl_ovl_id;
+
+/** @brief Ring of uncached matrix staging slots */
+static int16_t *tnl_matrix_slots;
+
+/** @brief Next matrix staging slot to use */
+static int tnl_matrix_idx;
+
+void tnl_init(void)
+{
+    if (tnl_ovl_id)
+        return;
+
+    rspq_init();
+    tnl_ovl_id = rspq_overlay_register(&rsp_tnl);
+
+    tnl_matrix_slots = malloc_uncached(TNL_MATRIX_SLOTS * TNL_MATRIX_SIZE);
+    tnl_matrix_idx = 0;
+}
+
+void tnl_close(void)
+{
+    if (!tnl_ovl_id)
+        return;
+
+    rspq_overlay_unregister(tnl_ovl_id);
+    tnl_ovl_id = 0;
+
+    free_uncached(tnl_matrix_slots);
+    tnl_matrix_slots = NULL;
+}
+
+void tnl_matrix_load(const float mtx[4][4])
+{
+    assertf(tnl_ovl_id, "tnl_init was not called");
+
+    int16_t *slot = tnl_matrix_slots + tnl_matrix_idx * (TNL_MATRIX_SIZE / 2);
+    tnl_matrix_idx = (tnl_matrix_idx + 1) % TNL_MATRIX_SLOTS;
+
+    // Convert to 16.16 fixed point, splitting integer and fractional parts
+    // into separate 4x4 halves. The RSP multiplies by broadcasting one input
+    // component across all output lanes, so each DMEM row holds the
+    // coefficients that one component contributes to all four outputs,
+    // which is the transpose of the row-major input.
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 4; col++) {
+            float v = mtx[col][row];
+            assertf(v >= -32768.0f && v < 32768.0f,
+                "matrix coefficient out of 16.16 range: %f", v);
+            int32_t fx = (int32_t)(v * 65536.0f);
+            slot[row*4 + col] = fx >> 16;
+            slot[16 + row*4 + col] = fx & 0xFFFF;
+        }
+    }
+
+    rspq_write(tnl_ovl_id, TNL_CMD_SET_MATRIX, 0, PhysicalAddr(slot));
+}
+
+void tnl_viewport(int x0, int y0, int width, int height)
+{
+    assertf(tnl_ovl_id, "tnl_init was not called");
+    assertf(width > 0 && width <= 1024 && height > 0 && height <= 1024,
+        "invalid viewport size: %dx%d", width, height);
+
+    // Scale and offset in quarter-pixel units: NDC [-1,1] maps to
+    // [x0, x0+width] horizontally and (flipping Y) [y0+height, y0]
+    // vertically.
+    uint16_t xs = 2 * width;
+    uint16_t ys = -2 * height;
+    uint16_t xo = 4 * x0 + 2 * width;
+    uint16_t yo = 4 * y0 + 2 * height;
+
+    rspq_write(tnl_ovl_id, TNL_CMD_SET_VIEWPORT, 0,
+        ((uint32_t)xs << 16) | ys, ((uint32_t)xo << 16) | yo);
+}
+
+void tnl_vertex_load(const tnl_vertex_t *vertices, int first, int count)
+{
+    assertf(tnl_ovl_id, "tnl_init was not called");
+    assertf(((uint32_t)vertices & 7) == 0,
+        "vertex array must be 8-byte aligned: %p", vertices);
+    assertf(first >= 0 && count > 0 && first + count <= TNL_VERTEX_CACHE_SIZE,
+        "invalid vertex range: %d..%d", first, first + count);
+
+    // The RSP reads the vertices via DMA, so they must be in RDRAM
+    data_cache_hit_writeback((void*)vertices, count * sizeof(tnl_vertex_t));
+
+    rspq_write(tnl_ovl_id, TNL_CMD_LOAD_VERTICES,
+        (first << 8) | count, PhysicalAddr(vertices));
+}
+
+void tnl_triangle(int i0, int i1, int i2)
+{
+    assertf(tnl_ovl_id, "tnl_init was not called");
+    assertf((unsigned)i0 < TNL_VERTEX_CACHE_SIZE &&
+            (unsigned)i1 < TNL_VERTEX_CACHE_SIZE &&
+            (unsigned)i2 < TNL_VERTEX_CACHE_SIZE,
+        "invalid vertex indices: %d %d %d", i0, i1, i2);
+
+    rspq_write(tnl_ovl_id, TNL_CMD_TRIANGLE, (i0 << 16) | (i1 << 8) | i2);
+}
+
+void tnl_triangle_list(const uint16_t *indices, int count)
+{
+    assertf((count % 3) == 0, "index count must be a multiple of 3: %d", count);
+
+    for (int i = 0; i < count; i += 3)
+        tnl_triangle(indices[i], indices[i+1], indices[i+2]);
+}
@@ -269,36 +269,85 @@ int tpak_write(int controller, uint16_t address, uint8_t* data, uint16_t size)
  */
 int tpak_read(int controller, uint16_t address, uint8_t* buffer, uint16_t size)
 {
-    if (controller < 0 || controller > 3 || size % TPAK_BLOCK_SIZE || address % TPAK_BLOCK_SIZE)
+    tpak_request_t request = { .address = address, .size = size, .buffer = buffer };
+    return tpak_read_bulk(controller, &request, 1);
+}
+
+/**
+ * @brief Read multiple ranges from a Game Boy cartridge, batched by bank.
+ *
+ * This is the fast path for dumping large amounts of cartridge data.
+ * The requests are processed grouped by Transfer Pak bank: each bank
+ * switch is performed exactly once, and all the data belonging to that
+ * bank is then streamed back-to-back with a pipelined joybus transfer
+ * (see #read_mempak_bulk), instead of paying a blocking 32-byte command
+ * per chunk. Dumping a full cartridge this way is several times faster
+ * than looping over #tpak_read with small sizes.
+ *
+ * Requests may span bank boundaries; the portions are read as the
+ * respective bank is visited. The relative order of two requests
+ * touching the same bank is preserved.
+ *
+ * @param[in] controller
+ *            The controller (0-3) with Transfer Pak connected.
+ * @param[in] requests
+ *            Array of ranges to read (addresses and sizes must be
+ *            multiples of #TPAK_BLOCK_SIZE).
+ * @param[in] count
+ *            Number of entries in the requests array.
+ * @return 0 if successful or @ref TPAK_ERROR otherwise.
+ */
+int tpak_read_bulk(int controller, tpak_request_t* requests, int count)
+{
+    if (controller < 0 || controller > 3 || requests == NULL || count <= 0)
     {
         return TPAK_ERROR_INVALID_ARGUMENT;
     }
 
-    uint16_t adjusted_address = (address % TPAK_BANK_SIZE) + TPAK_ADDRESS_DATA;
-    uint16_t end_address = address + size;
-    if (end_address < address)
+    for (int i = 0; i < count; i++)
     {
-        return TPAK_ERROR_ADDRESS_OVERFLOW;
+        if (requests[i].size % TPAK_BLOCK_SIZE || requests[i].address % TPAK_BLOCK_SIZE ||
+            requests[i].buffer == NULL)
+        {
+            return TPAK_ERROR_INVALID_ARGUMENT;
+        }
+        if ((uint32_t)requests[i].address + requests[i].size > 0x10000)
+        {
+            return TPAK_ERROR_ADDRESS_OVERFLOW;
+        }
     }
 
-    uint8_t* cursor = buffer;
-
-    int bank = address / TPAK_BANK_SIZE;
-    tpak_set_bank(controller, bank);
-
-    while(address < end_address)
+    // Visit the four banks in order, and stream every request portion that
+    // falls within the current bank. This way each bank switch handshake
+    // happens at most once, no matter how the requests are laid out.
+    for (int bank = 0; bank < 4; bank++)
     {
-        // Check if we need to change the bank.
-        if (address / TPAK_BANK_SIZE > bank) {
-            bank = address / TPAK_BANK_SIZE;
-            tpak_set_bank(controller, bank);
-            adjusted_address = TPAK_ADDRESS_DATA;
+        uint32_t bank_start = bank * TPAK_BANK_SIZE;
+        uint32_t bank_end = bank_start + TPAK_BANK_SIZE;
+        bool bank_selected = false;
+
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t start = requests[i].address;
+            uint32_t end = start + requests[i].size;
+            if (start < bank_start) { start = bank_start; }
+            if (end > bank_end) { end = bank_end; }
+            if (start >= end) { continue; }
+
+            if (!bank_selected)
+            {
+                tpak_set_bank(controller, bank);
+                bank_selected = true;
+            }
+
+            uint16_t adjusted_address = (start % TPAK_BANK_SIZE) + TPAK_ADDRESS_DATA;
+            uint8_t *cursor = requests[i].buffer + (start - requests[i].address);
+
+            int result = read_mempak_bulk(controller, adjusted_address,
+                end - start, cursor, NULL);
+            if (result == -2) { return TPAK_ERROR_NO_TPAK; }
+            if (result != 0) { return TPAK_ERROR_UNKNOWN_BEHAVIOUR; }
         }
-
-        read_mempak_address(controller, adjusted_address, cursor);
-        address += TPAK_BLOCK_SIZE;
-        cursor += TPAK_BLOCK_SIZE;
-        adjusted_address += TPAK_BLOCK_SIZE;
     }
 
     return 0;
@@ -0,0 +1,236 @@
+/**
+ * @file tunables.c
+ * @brief Live variable tuning over USB
+ * @ingroup lowlevel
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "tunables.h"
+#include "usb.h"
+#include "debug.h"
+#include "utils.h"
+
+/**
+ * The wire protocol is plain text so that it works through any host
+ * setup that can exchange UNFLoader text packets. Commands from the
+ * host are single lines:
+ *
+ *      tune list
+ *      tune get <name>
+ *      tune set <name> <value>
+ *
+ * Every reply line is prefixed with "tune: " so the host tool can tell
+ * replies apart from regular log output sharing the text channel:
+ *
+ *      tune: i32 streaming_window 32768        (one per tunable, for list/get)
+ *      tune: .                                 (end of a list)
+ *      tune: err <message>
+ *
+ * A successful set is answered with the tunable's line re-read after
+ * the store, so the host shows the value actually in effect.
+ */
+
+/** @brief Maximum number of registered tunables */
+#define MAX_TUNABLES        64
+/** @brief Maximum length of one incoming command line */
+#define MAX_COMMAND_LEN     128
+
+/** @brief One registered tunable */
+typedef struct {
+    const char *name;           ///< Name of the tunable (not copied)
+    tunable_type_t type;        ///< Type of the variable
+    volatile void *var;         ///< The variable itself
+} tunable_t;
+
+/** @brief Registry of tunables */
+static tunable_t tunables[MAX_TUNABLES];
+/** @brief Number of registered tunables */
+static int num_tunables = 0;
+/** @brief Whether tunables_init has succeeded */
+static bool tunables_active = false;
+
+bool tunables_init(void)
+{
+    if (tunables_active)
+        return true;
+    // Commands are collected in the background by the USB receive ring,
+    // so they are already in RAM by the time tunables_poll runs
+    if (!usb_rx_start(10))
+        return false;
+    tunables_active = true;
+    return true;
+}
+
+void tunable_register(const char *name, tunable_type_t type, volatile void *var)
+{
+    assertf(name != NULL && name[0] != 0 && strchr(name, ' ') == NULL,
+        "invalid tunable name");
+    assertf(((uint32_t)var & 3) == 0,
+        "tunable %s is not 32-bit aligned", name);
+    assertf(num_tunables < MAX_TUNABLES,
+        "too many tunables (max %d)", MAX_TUNABLES);
+    for (int i=0; i<num_tunables; i++)
+        assertf(strcmp(tunables[i].name, name) != 0,
+            "duplicated tunable: %s", name);
+
+    tunables[num_tunables++] = (tunable_t){
+        .name = name, .type = type, .var = var,
+    };
+}
+
+/** @brief Look up a tunable by name. */
+static tunable_t* tunable_find(const char *name)
+{
+    for (int i=0; i<num_tunables; i++)
+        if (strcmp(tunables[i].name, name) == 0)
+            return &tunables[i];
+    return NULL;
+}
+
+/** @brief Format one tunable as a "<type> <name> <value>" line. */
+static void tunable_describe(tunable_t *t, char *buf, int bufsize)
+{
+    switch (t->type) {
+    case TUNABLE_TYPE_I32:
+        snprintf(buf, bufsize, "i32 %s %ld", t->name, (long)*(volatile int32_t*)t->var);
+        break;
+    case TUNABLE_TYPE_U32:
+        snprintf(buf, bufsize, "u32 %s %lu", t->name, (unsigned long)*(volatile uint32_t*)t->var);
+        break;
+    case TUNABLE_TYPE_F32:
+        snprintf(buf, bufsize, "f32 %s %g", t->name, *(volatile float*)t->var);
+        break;
+    }
+}
+
+/** @brief Send one "tune: "-prefixed reply line to the host. */
+__attribute__((format(printf, 1, 2)))
+static void tunable_reply(const char *fmt, ...)
+{
+    char buf[MAX_COMMAND_LEN + 32];
+    int len = snprintf(buf, sizeof(buf), "tune: ");
+
+    va_list args;
+    va_start(args, fmt);
+    len += vsnprintf(buf + len, sizeof(buf) - len - 1, fmt, args);
+    va_end(args);
+
+    buf[len++] = '\n';
+    usb_write(DATATYPE_TEXT, buf, len);
+}
+
+bool tunable_set(const char *name, const char *value)
+{
+    tunable_t *t = tunable_find(name);
+    if (t == NULL || value == NULL || value[0] == 0)
+        return false;
+
+    // Each case ends in a single aligned 32-bit store, which the VR4300
+    // performs atomically: readers never see a torn value, so no locking
+    // is needed against code using the variable
+    char *end;
+    switch (t->type) {
+    case TUNABLE_TYPE_I32: {
+        long v = strtol(value, &end, 0);
+        if (*end != 0) return false;
+        *(volatile int32_t*)t->var = v;
+        break;
+    }
+    case TUNABLE_TYPE_U32: {
+        unsigned long v = strtoul(value, &end, 0);
+        if (*end != 0) return false;
+        *(volatile uint32_t*)t->var = v;
+        break;
+    }
+    case TUNABLE_TYPE_F32: {
+        float v = strtof(value, &end);
+        if (*end != 0) return false;
+        *(volatile float*)t->var = v;
+        break;
+    }
+    }
+    return true;
+}
+
+/** @brief Parse and execute one command line, replying to the host. */
+static void tunable_command(char *cmd)
+{
+    char buf[MAX_COMMAND_LEN];
+    const char *sep = " \t\r\n";
+
+    char *tag  = strtok(cmd, sep);
+    char *verb = strtok(NULL, sep);
+    if (tag == NULL || strcmp(tag, "tune") != 0 || verb == NULL) {
+        tunable_reply("err unknown command");
+        return;
+    }
+
+    if (strcmp(verb, "list") == 0) {
+        for (int i=0; i<num_tunables; i++) {
+            tunable_describe(&tunables[i], buf, sizeof(buf));
+            tunable_reply("%s", buf);
+        }
+        tunable_reply(".");
+        return;
+    }
+
+    char *name = strtok(NULL, sep);
+    if (name == NULL) {
+        tunable_reply("err missing tunable name");
+        return;
+    }
+    tunable_t *t = tunable_find(name);
+    if (t == NULL) {
+        tunable_reply("err no such tunable: %s", name);
+        return;
+    }
+
+    if (strcmp(verb, "get") == 0) {
+        tunable_describe(t, buf, sizeof(buf));
+        tunable_reply("%s", buf);
+    } else if (strcmp(verb, "set") == 0) {
+        char *value = strtok(NULL, sep);
+        if (value == NULL || !tunable_set(name, value)) {
+            tunable_reply("err invalid value for %s", name);
+            return;
+        }
+        // Echo the value actually in effect after the store
+        tunable_describe(t, buf, sizeof(buf));
+        tunable_reply("%s", buf);
+    } else {
+        tunable_reply("err unknown command: %s", verb);
+    }
+}
+
+bool tunables_poll(void)
+{
+    bool processed = false;
+
+    if (!tunables_active)
+        return false;
+
+    while (1) {
+        // Only consume text packets; anything else at the head of the
+        // ring belongs to the application
+        unsigned long header = usb_rx_poll();
+        if (header == 0 || USBHEADER_GETTYPE(header) != DATATYPE_TEXT)
+            break;
+
+        char cmd[MAX_COMMAND_LEN];
+        int size = (int)USBHEADER_GETSIZE(header);
+        if (size >= MAX_COMMAND_LEN) {
+            // Far too long to be a tuning command: drain and drop it
+            while (size > 0)
+                size -= usb_rx_read(cmd, MIN(size, (int)sizeof(cmd)));
+            tunable_reply("err command too long");
+        } else {
+            usb_rx_read(cmd, size);
+            cmd[size] = 0;
+            tunable_command(cmd);
+        }
+        processed = true;
+    }
+    return processed;
+}
@@ -25,6 +25,10 @@ https://github.com/buu342/N64-UNFLoader
 // USB Memory location
 #define DEBUG_ADDRESS (0x04000000 - DEBUG_ADDRESS_SIZE) // Put the debug area at the 64MB - DEBUG_ADDRESS_SIZE area in ROM space
 
+// Staging area for chunked packets (usb_write_start), placed in the upper half of the
+// debug area so interleaved usb_write packets don't clobber a stream being assembled
+#define STREAM_ADDRESS (DEBUG_ADDRESS + DEBUG_ADDRESS_SIZE/2)
+
 // Data header related
 #define USBHEADER_CREATE(type, left) ((((type)<<24) | ((left) & 0x00FFFFFF)))
 
@@ -215,14 +219,23 @@ https://github.com/buu342/N64-UNFLoader
 static void usb_findcart(void);
 
 static void usb_64drive_write(int datatype, const void* data, int size);
+static char usb_64drive_write_start(int datatype, int size);
+static void usb_64drive_write_chunk(const void* data, int size);
+static char usb_64drive_write_end(void);
 static u32  usb_64drive_poll(void);
 static void usb_64drive_read(void);
 
 static void usb_everdrive_write(int datatype, const void* data, int size);
+static char usb_everdrive_write_start(int datatype, int size);
+static void usb_everdrive_write_chunk(const void* data, int size);
+static char usb_everdrive_write_end(void);
 static u32  usb_everdrive_poll(void);
 static void usb_everdrive_read(void);
 
 static void usb_sc64_write(int datatype, const void* data, int size);
+static char usb_sc64_write_start(int datatype, int size);
+static void usb_sc64_write_chunk(const void* data, int size);
+static char usb_sc64_write_end(void);
 static u32  usb_sc64_poll(void);
 static void usb_sc64_read(void);
 
@@ -240,12 +253,49 @@ void (*funcPointer_read)(void);
 static s8 usb_cart = CART_NONE;
 static u8 usb_buffer_align[BUFFER_SIZE+16]; // IDO doesn't support GCC's __attribute__((aligned(x))), so this is a workaround
 static u8* usb_buffer;
+static u8 usb_buffer2_align[BUFFER_SIZE+16]; // Second buffer for double-buffered writes
+static u8* usb_buffer2;
+static u32 usb_stat_bytes = 0;
+static u32 usb_stat_ticks = 0;
 static char usb_didtimeout = FALSE;
 static int usb_datatype = 0;
 static int usb_datasize = 0;
 static int usb_dataleft = 0;
 static int usb_readblock = -1;
 
+// Chunked packet state (usb_write_start/usb_write_chunk/usb_write_end)
+static char usb_stream_open = FALSE;   // A chunked packet is being assembled
+static char usb_stream_failed = FALSE; // The stream hit a timeout, drop the rest
+static int  usb_stream_type = 0;       // Datatype of the open packet
+static int  usb_stream_size = 0;       // Total size announced at usb_write_start
+static u32  usb_stream_offset = 0;     // Bytes staged so far (64Drive and SC64)
+static int  usb_stream_bufpos = 0;     // Staging buffer fill level (EverDrive)
+
+// Receive ring state (usb_rx_start/usb_rx_service/usb_rx_read). The ring is
+// filled by usb_rx_service (normally a timer interrupt) and drained by the
+// application; with a single producer and a single consumer the volatile
+// indices are enough, no interrupt masking is needed.
+#define USB_RX_RING_SIZE 4096
+static u8  usb_rx_ring[USB_RX_RING_SIZE];
+static volatile u32 usb_rx_widx = 0;   // Write index, owned by usb_rx_service
+static volatile u32 usb_rx_ridx = 0;   // Read index, owned by the application
+static int  usb_rx_left = 0;           // Payload left in the packet being dequeued
+static int  usb_rx_type = 0;           // Datatype of the packet being dequeued
+static char usb_rx_active = FALSE;     // The RX service has been started
+static char usb_rx_parked = FALSE;     // A polled packet is waiting for ring space
+
+// Set while application code is inside a function that drives the cart
+// (PI traffic and shared read state). The RX service runs at interrupt
+// level: if it fires in that window it must back off and retry next
+// tick, otherwise its own cart accesses would interleave with the
+// interrupted sequence. The flag needs no atomics: the interrupt either
+// runs entirely before the flag is set (the application hasn't touched
+// the cart yet) or sees it set and skips.
+static volatile char usb_pi_busy = FALSE;
+#ifdef LIBDRAGON
+    static timer_link_t* usb_rx_timer = NULL;
+#endif
+
 #ifndef LIBDRAGON
     // Message globals
     #if !USE_OSRAW
@@ -370,6 +420,42 @@ static inline void usb_dma_write(void *ram_address, u32 pi_address, size_t size)
 }
 
 
+/*==============================
+    usb_dma_write_async
+    Starts writing data to a given address using DMA without waiting
+    for it to finish, so the CPU can prepare the next block while the
+    PI transfers this one. Call usb_dma_write_wait before touching the
+    source buffer or the PI again.
+    @param  The buffer to read from
+    @param  The address to write to
+    @param  The size of the data to write
+==============================*/
+
+static inline void usb_dma_write_async(void *ram_address, u32 pi_address, size_t size)
+{
+    #ifndef LIBDRAGON
+        // No asynchronous PI API is used here, fall back to a blocking write
+        usb_dma_write(ram_address, pi_address, size);
+    #else
+        data_cache_hit_writeback(ram_address, size);
+        dma_write_raw_async(ram_address, pi_address, size);
+    #endif
+}
+
+
+/*==============================
+    usb_dma_write_wait
+    Waits for a DMA started with usb_dma_write_async to finish
+==============================*/
+
+static inline void usb_dma_write_wait(void)
+{
+    #ifdef LIBDRAGON
+        dma_wait();
+    #endif
+}
+
+
 /*********************************
          Timeout helpers
 *********************************/
@@ -430,6 +516,8 @@ char usb_initialize(void)
     // Initialize the debug related globals
     usb_buffer = (u8*)OS_DCACHE_ROUNDUP_ADDR(usb_buffer_align);
     memset(usb_buffer, 0, BUFFER_SIZE);
+    usb_buffer2 = (u8*)OS_DCACHE_ROUNDUP_ADDR(usb_buffer2_align);
+    memset(usb_buffer2, 0, BUFFER_SIZE);
         
     #ifndef LIBDRAGON
         // Create the message queue
@@ -573,9 +661,151 @@ void usb_write(int datatype, const void* data, int size)
     // If there's data to read first, stop
     if (usb_dataleft != 0)
         return;
-    
-    // Call the correct write function
+
+    // The EverDrive streams chunked packets straight over USB, so a regular
+    // packet cannot be interleaved while one is open; drop it. The other
+    // carts stage chunked packets at a separate address and are unaffected.
+    if (usb_stream_open && usb_cart == CART_EVERDRIVE)
+        return;
+
+    // Call the correct write function, accounting time and bytes moved
+    // so callers can compute the achieved throughput
+    usb_pi_busy = TRUE;
+    u32 start_ticks = usb_timeout_start();
     funcPointer_write(datatype, data, size);
+    usb_stat_ticks += (u32)(usb_timeout_start() - start_ticks);
+    usb_stat_bytes += size;
+    usb_pi_busy = FALSE;
+}
+
+
+/*==============================
+    usb_write_start
+    Opens a chunked packet: the packet is announced with its total size
+    up front and its payload is then supplied incrementally with
+    usb_write_chunk, so a large transfer can be spread over time without
+    a single long blocking call. Only one chunked packet can be open at
+    a time, and regular usb_write calls are dropped while one is open on
+    the EverDrive (they keep working on the other carts).
+    @param  The DATATYPE of the packet
+    @param  The total payload size in bytes
+    @return 1 if the packet was opened, 0 if the cart is missing or busy
+==============================*/
+
+char usb_write_start(int datatype, int size)
+{
+    char ok = FALSE;
+
+    // If no debug cart exists, stop
+    if (usb_cart == CART_NONE)
+        return FALSE;
+
+    // Refuse nested streams or streaming over pending incoming data
+    if (usb_stream_open || usb_dataleft != 0)
+        return FALSE;
+
+    // Let the correct cart prepare for the stream
+    usb_pi_busy = TRUE;
+    switch (usb_cart)
+    {
+        case CART_64DRIVE:   ok = usb_64drive_write_start(datatype, size); break;
+        case CART_EVERDRIVE: ok = usb_everdrive_write_start(datatype, size); break;
+        case CART_SC64:      ok = usb_sc64_write_start(datatype, size); break;
+    }
+    usb_pi_busy = FALSE;
+    if (!ok)
+        return FALSE;
+
+    usb_stream_open = TRUE;
+    usb_stream_failed = FALSE;
+    usb_stream_type = datatype;
+    usb_stream_size = size;
+    usb_stream_offset = 0;
+    return TRUE;
+}
+
+
+/*==============================
+    usb_write_chunk
+    Supplies the next piece of the payload of a chunked packet opened
+    with usb_write_start. Every chunk except the final one must be a
+    multiple of 4 bytes long; the chunks must add up to exactly the
+    size announced at usb_write_start.
+    @param A buffer with the payload piece
+    @param The size of the piece in bytes
+==============================*/
+
+void usb_write_chunk(const void* data, int size)
+{
+    if (!usb_stream_open || usb_stream_failed || size <= 0)
+        return;
+
+    // Call the correct cart function, accounting time and bytes moved
+    usb_pi_busy = TRUE;
+    u32 start_ticks = usb_timeout_start();
+    switch (usb_cart)
+    {
+        case CART_64DRIVE:   usb_64drive_write_chunk(data, size); break;
+        case CART_EVERDRIVE: usb_everdrive_write_chunk(data, size); break;
+        case CART_SC64:      usb_sc64_write_chunk(data, size); break;
+    }
+    usb_stat_ticks += (u32)(usb_timeout_start() - start_ticks);
+    usb_stat_bytes += size;
+    usb_pi_busy = FALSE;
+}
+
+
+/*==============================
+    usb_write_end
+    Closes a chunked packet and hands it to the USB hardware. On the
+    64Drive and SC64 this is the point where the staged data starts
+    moving; on the EverDrive it flushes the final burst.
+    @return 1 if the packet went out whole, 0 on timeout or if no
+            packet was open
+==============================*/
+
+char usb_write_end(void)
+{
+    char ok = FALSE;
+
+    if (!usb_stream_open)
+        return FALSE;
+
+    if (!usb_stream_failed)
+    {
+        usb_pi_busy = TRUE;
+        u32 start_ticks = usb_timeout_start();
+        switch (usb_cart)
+        {
+            case CART_64DRIVE:   ok = usb_64drive_write_end(); break;
+            case CART_EVERDRIVE: ok = usb_everdrive_write_end(); break;
+            case CART_SC64:      ok = usb_sc64_write_end(); break;
+        }
+        usb_stat_ticks += (u32)(usb_timeout_start() - start_ticks);
+        usb_pi_busy = FALSE;
+    }
+
+    usb_stream_open = FALSE;
+    return ok;
+}
+
+
+/*==============================
+    usb_getstats
+    Returns running totals of bytes written through USB and CPU ticks
+    spent writing them. Divide bytes by ticks (converted to seconds)
+    for the achieved throughput; diff successive readings to measure
+    a specific window.
+    @param Destination for the total bytes written (can be NULL)
+    @param Destination for the total ticks spent writing (can be NULL)
+==============================*/
+
+void usb_getstats(unsigned int* bytes, unsigned int* ticks)
+{
+    if (bytes != NULL)
+        *bytes = usb_stat_bytes;
+    if (ticks != NULL)
+        *ticks = usb_stat_ticks;
 }
 
 
@@ -604,9 +834,12 @@ u32 usb_poll(void)
     // If there's still data that needs to be read, return the header with the data left
     if (usb_dataleft != 0)
         return USBHEADER_CREATE(usb_datatype, usb_dataleft);
-        
+
     // Call the correct read function
-    return funcPointer_poll();
+    usb_pi_busy = TRUE;
+    u32 header = funcPointer_poll();
+    usb_pi_busy = FALSE;
+    return header;
 }
 
 
@@ -635,6 +868,7 @@ void usb_read(void* buffer, int nbytes)
         return;
     
     // Read chunks from ROM
+    usb_pi_busy = TRUE;
     while (left > 0)
     {
         // Ensure we don't read too much data
@@ -661,6 +895,7 @@ void usb_read(void* buffer, int nbytes)
         block = BUFFER_SIZE;
         copystart = 0;
     }
+    usb_pi_busy = FALSE;
 }
 
 
@@ -746,6 +981,264 @@ void usb_sendheartbeat(void)
 }
 
 
+/*********************************
+      Receive ring functions
+*********************************/
+
+/*==============================
+    usb_rx_service
+    Polls the flashcart for incoming data and drains complete packets
+    into the RX ring buffer. Called automatically from a timer once
+    usb_rx_start has been called; can also be pumped manually from a
+    scheduler on platforms without the timer library.
+==============================*/
+
+void usb_rx_service(void)
+{
+    u32 used, widx, header;
+    int size, seg;
+
+    // Nothing to do if there's no cart or the service isn't running
+    if (usb_cart == CART_NONE || !usb_rx_active)
+        return;
+
+    // On the EverDrive, polling switches the USB mode and would corrupt
+    // a chunked packet that is being streamed out; try again next tick
+    if (usb_stream_open && usb_cart == CART_EVERDRIVE)
+        return;
+
+    // If we interrupted application code mid-way through driving the
+    // cart, don't touch it; retry next tick
+    if (usb_pi_busy)
+        return;
+
+    if (!usb_rx_parked)
+    {
+        // If the application owns pending incoming data (legacy
+        // usb_poll/usb_read), leave it alone
+        if (usb_dataleft != 0)
+            return;
+
+        // Ask the cart for a new packet. This fills usb_datatype,
+        // usb_datasize and usb_dataleft on success.
+        if (funcPointer_poll() == 0)
+            return;
+        usb_rx_parked = TRUE;
+    }
+    else if (usb_dataleft != usb_datasize)
+    {
+        // The application started consuming the parked packet through
+        // the legacy API; it's theirs now
+        usb_rx_parked = FALSE;
+        return;
+    }
+
+    // A packet too big for the ring can never be queued: un-park it and
+    // leave it in cart memory for the application to usb_read directly
+    size = usb_datasize;
+    if (4 + size > USB_RX_RING_SIZE - 1)
+    {
+        usb_rx_parked = FALSE;
+        return;
+    }
+
+    // Queue the packet only once it fits whole (header plus payload);
+    // until then it stays parked in cart memory and we retry next tick
+    used = (usb_rx_widx - usb_rx_ridx + USB_RX_RING_SIZE) % USB_RX_RING_SIZE;
+    if (used + 4 + size >= USB_RX_RING_SIZE)
+        return;
+
+    // Enqueue the 4 byte header
+    header = USBHEADER_CREATE(usb_datatype, size);
+    widx = usb_rx_widx;
+    for (int i=0; i<4; i++)
+    {
+        usb_rx_ring[widx] = (header >> (24-8*i)) & 0xFF;
+        widx = (widx+1) % USB_RX_RING_SIZE;
+    }
+
+    // Drain the payload through the normal block read path, in at most
+    // two contiguous segments around the ring wrap
+    seg = MIN(size, USB_RX_RING_SIZE - (int)widx);
+    usb_read(&usb_rx_ring[widx], seg);
+    if (size - seg > 0)
+        usb_read(&usb_rx_ring[0], size - seg);
+
+    // Publish the packet only after its bytes are in place
+    usb_rx_widx = (widx + size) % USB_RX_RING_SIZE;
+    usb_rx_parked = FALSE;
+}
+
+
+#ifdef LIBDRAGON
+/*==============================
+    usb_rx_tick
+    Timer callback that services the RX ring
+    @param The number of times the timer overflowed (unused)
+==============================*/
+
+static void usb_rx_tick(int ovfl)
+{
+    usb_rx_service();
+}
+#endif
+
+
+/*==============================
+    usb_rx_start
+    Starts servicing incoming USB data in the background: a periodic
+    timer polls the cart and drains packets into a RAM ring, so host
+    commands are picked up within one interval instead of whenever the
+    game explicitly polls. Requires the timer library to be initialized.
+    @param  How often to poll the cart, in milliseconds
+    @return 1 if the service is running, 0 if there is no cart or no timer
+==============================*/
+
+char usb_rx_start(int interval_ms)
+{
+    // If no debug cart exists, stop
+    if (usb_cart == CART_NONE)
+        return FALSE;
+
+    // Already running
+    if (usb_rx_active)
+        return TRUE;
+
+    if (interval_ms <= 0)
+        interval_ms = 1;
+
+    // Reset the ring state
+    usb_rx_widx = 0;
+    usb_rx_ridx = 0;
+    usb_rx_left = 0;
+    usb_rx_parked = FALSE;
+    usb_rx_active = TRUE;
+
+    #ifdef LIBDRAGON
+        usb_rx_timer = new_timer(TICKS_FROM_MS(interval_ms), TF_CONTINUOUS, usb_rx_tick);
+        if (usb_rx_timer == NULL)
+        {
+            usb_rx_active = FALSE;
+            return FALSE;
+        }
+    #else
+        // No timer library here: the application must pump
+        // usb_rx_service from its own scheduler
+    #endif
+    return TRUE;
+}
+
+
+/*==============================
+    usb_rx_stop
+    Stops the background RX service and discards queued packets
+==============================*/
+
+void usb_rx_stop(void)
+{
+    if (!usb_rx_active)
+        return;
+
+    #ifdef LIBDRAGON
+        delete_timer(usb_rx_timer);
+        usb_rx_timer = NULL;
+    #endif
+    usb_rx_active = FALSE;
+    usb_rx_widx = 0;
+    usb_rx_ridx = 0;
+    usb_rx_left = 0;
+    usb_rx_parked = FALSE;
+}
+
+
+/*==============================
+    usb_rx_poll
+    Returns the header of the oldest packet queued in the RX ring,
+    without blocking and without touching the cart. Like usb_poll, the
+    first byte is the data type and the other 3 the bytes left to read.
+    @return The data header, or 0 if no packet is queued
+==============================*/
+
+u32 usb_rx_poll(void)
+{
+    u32 used, ridx, header;
+
+    // A partially dequeued packet stays current until it's consumed
+    if (usb_rx_left > 0)
+        return USBHEADER_CREATE(usb_rx_type, usb_rx_left);
+
+    // Check if a new packet has been queued (packets are published
+    // whole, so 4 readable bytes imply the full packet is there)
+    used = (usb_rx_widx - usb_rx_ridx + USB_RX_RING_SIZE) % USB_RX_RING_SIZE;
+    if (used < 4)
+        return 0;
+
+    // Consume the header and make this the current packet
+    ridx = usb_rx_ridx;
+    header = 0;
+    for (int i=0; i<4; i++)
+    {
+        header = (header << 8) | usb_rx_ring[ridx];
+        ridx = (ridx+1) % USB_RX_RING_SIZE;
+    }
+    usb_rx_ridx = ridx;
+    usb_rx_type = USBHEADER_GETTYPE(header);
+    usb_rx_left = USBHEADER_GETSIZE(header);
+    return header;
+}
+
+
+/*==============================
+    usb_read_available
+    Returns how many payload bytes of the oldest queued packet can be
+    dequeued right now, without blocking
+    @return The number of bytes available, or 0 if no packet is queued
+==============================*/
+
+int usb_read_available(void)
+{
+    return USBHEADER_GETSIZE(usb_rx_poll());
+}
+
+
+/*==============================
+    usb_rx_read
+    Dequeues bytes of the oldest queued packet from the RX ring into
+    the provided buffer. Never blocks and never touches the cart.
+    @param  The buffer to put the read data in
+    @param  The maximum number of bytes to read
+    @return The number of bytes actually dequeued
+==============================*/
+
+int usb_rx_read(void* buffer, int nbytes)
+{
+    u32 ridx;
+    int seg;
+
+    // Establish the current packet (or bail if none is queued)
+    if (usb_rx_poll() == 0)
+        return 0;
+
+    // Clamp to the current packet; the next packet needs its own
+    // usb_rx_poll/usb_rx_read round so boundaries are preserved
+    if (nbytes > usb_rx_left)
+        nbytes = usb_rx_left;
+    if (nbytes <= 0)
+        return 0;
+
+    // Copy out in at most two contiguous segments around the ring wrap
+    ridx = usb_rx_ridx;
+    seg = MIN(nbytes, USB_RX_RING_SIZE - (int)ridx);
+    memcpy(buffer, &usb_rx_ring[ridx], seg);
+    if (nbytes - seg > 0)
+        memcpy((void*)(((u32)buffer) + seg), &usb_rx_ring[0], nbytes - seg);
+
+    usb_rx_ridx = (ridx + nbytes) % USB_RX_RING_SIZE;
+    usb_rx_left -= nbytes;
+    return nbytes;
+}
+
+
 /*********************************
         64Drive functions
 *********************************/
@@ -934,28 +1427,37 @@ static void usb_64drive_write(int datatype, const void* data, int size)
     // Set the cartridge to write mode
     usb_64drive_set_writable(TRUE);
 
-    // Write data to SDRAM until we've finished
+    // Write data to SDRAM until we've finished. The two staging buffers
+    // are ping-ponged so the CPU fills one while the PI DMAs the other.
+    int bufidx = 0;
     while (left > 0)
     {
         // Calculate transfer size
         u32 block = MIN(left, BUFFER_SIZE);
+        u8* buffer = bufidx ? usb_buffer2 : usb_buffer;
 
         // Copy data to PI DMA aligned buffer
-        memcpy(usb_buffer, data, block);
-        
+        memcpy(buffer, data, block);
+
         // Pad the buffer with zeroes if it wasn't 4 byte aligned
         while (block%4)
-            usb_buffer[block++] = 0;
+            buffer[block++] = 0;
 
-        // Copy block of data from RDRAM to SDRAM
-        usb_dma_write(usb_buffer, pi_address, ALIGN(block, 2));
+        // Wait for the previous block's DMA (overlapped with the copy
+        // above), then start this block's transfer to SDRAM
+        usb_dma_write_wait();
+        usb_dma_write_async(buffer, pi_address, ALIGN(block, 2));
 
         // Update pointers and variables
         data = (void*)(((u32)data) + block);
         left -= block;
         pi_address += block;
+        bufidx ^= 1;
     }
 
+    // Wait for the last block before touching the PI again
+    usb_dma_write_wait();
+
     // Disable write mode
     usb_64drive_set_writable(FALSE);
 
@@ -965,6 +1467,93 @@ static void usb_64drive_write(int datatype, const void* data, int size)
 }
 
 
+/*==============================
+    usb_64drive_write_start
+    Opens a chunked packet on the 64Drive. The payload is staged at
+    STREAM_ADDRESS piece by piece and only handed to the USB FIFO at
+    usb_write_end, so regular packets can go out in between.
+    @param The DATATYPE of the packet
+    @param The total payload size in bytes
+    @return 1 if the stream can start, 0 if a previous write is busy
+==============================*/
+
+static char usb_64drive_write_start(int datatype, int size)
+{
+    // Fail if the previous transfer is still in flight
+    if ((usb_io_read(D64_REG_USBCOMSTAT) & D64_CUI_WRITE_MASK) == D64_CUI_WRITE_BUSY)
+    {
+        usb_didtimeout = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*==============================
+    usb_64drive_write_chunk
+    Stages one piece of a chunked packet in 64Drive SDRAM
+    @param A buffer with the payload piece
+    @param The size of the piece in bytes
+==============================*/
+
+static void usb_64drive_write_chunk(const void* data, int size)
+{
+    s32 left = size;
+    u32 pi_address = D64_BASE + STREAM_ADDRESS + usb_stream_offset;
+
+    // Set the cartridge to write mode
+    usb_64drive_set_writable(TRUE);
+
+    // Stage the piece in SDRAM with the same double-buffered DMA as
+    // usb_64drive_write
+    int bufidx = 0;
+    while (left > 0)
+    {
+        // Calculate transfer size
+        u32 block = MIN(left, BUFFER_SIZE);
+        u8* buffer = bufidx ? usb_buffer2 : usb_buffer;
+
+        // Copy data to PI DMA aligned buffer
+        memcpy(buffer, data, block);
+
+        // Pad the buffer with zeroes if it wasn't 4 byte aligned
+        while (block%4)
+            buffer[block++] = 0;
+
+        // Wait for the previous block's DMA, then start this one
+        usb_dma_write_wait();
+        usb_dma_write_async(buffer, pi_address, ALIGN(block, 2));
+
+        // Update pointers and variables
+        data = (void*)(((u32)data) + block);
+        left -= block;
+        pi_address += block;
+        bufidx ^= 1;
+    }
+
+    // Wait for the last block before touching the PI again
+    usb_dma_write_wait();
+
+    // Disable write mode
+    usb_64drive_set_writable(FALSE);
+    usb_stream_offset += size;
+}
+
+
+/*==============================
+    usb_64drive_write_end
+    Hands the fully staged chunked packet to the 64Drive USB FIFO
+    @return 1 on success
+==============================*/
+
+static char usb_64drive_write_end(void)
+{
+    usb_64drive_cui_write(usb_stream_type, STREAM_ADDRESS, usb_stream_size);
+    usb_didtimeout = FALSE;
+    return TRUE;
+}
+
+
 /*==============================
     usb_64drive_poll
     Returns the header of data being received via USB on the 64Drive
@@ -1167,6 +1756,120 @@ static void usb_everdrive_write(int datatype, const void* data, int size)
 }
 
 
+/*==============================
+    usb_everdrive_flush_burst
+    Sends the accumulated staging buffer of a chunked packet as one USB
+    burst and resets the fill level
+    @return FALSE on success, TRUE on timeout
+==============================*/
+
+static char usb_everdrive_flush_burst(void)
+{
+    // Ensure the data is 2 byte aligned and the block address is correct
+    int blocksend = ALIGN(usb_stream_bufpos, 2);
+    int baddr = BUFFER_SIZE - blocksend;
+
+    // Set USB to write mode and send data through USB
+    usb_io_write(ED_REG_USBCFG, ED_USBMODE_WRNOP);
+    usb_dma_write(usb_buffer, ED_REG_USBDAT + baddr, blocksend);
+
+    // Set USB to write mode with the new address and wait for USB to end
+    usb_io_write(ED_REG_USBCFG, ED_USBMODE_WR | baddr);
+    usb_stream_bufpos = 0;
+    return usb_everdrive_usbbusy();
+}
+
+
+/*==============================
+    usb_everdrive_write_start
+    Opens a chunked packet on the EverDrive. The EverDrive protocol
+    streams packets over USB directly, so the DMA header goes out with
+    the first full burst and the size must be known up front.
+    @param The DATATYPE of the packet
+    @param The total payload size in bytes
+    @return 1 if the stream can start
+==============================*/
+
+static char usb_everdrive_write_start(int datatype, int size)
+{
+    u32 header = (size & 0x00FFFFFF) | (datatype << 24);
+
+    // Put in the DMA header along with length and type information in the global buffer
+    usb_buffer[0] = 'D';
+    usb_buffer[1] = 'M';
+    usb_buffer[2] = 'A';
+    usb_buffer[3] = '@';
+    usb_buffer[4] = (header >> 24) & 0xFF;
+    usb_buffer[5] = (header >> 16) & 0xFF;
+    usb_buffer[6] = (header >> 8)  & 0xFF;
+    usb_buffer[7] = header & 0xFF;
+    usb_stream_bufpos = 8;
+    return TRUE;
+}
+
+
+/*==============================
+    usb_everdrive_write_chunk
+    Accumulates one piece of a chunked packet, sending full bursts as
+    the staging buffer fills up
+    @param A buffer with the payload piece
+    @param The size of the piece in bytes
+==============================*/
+
+static void usb_everdrive_write_chunk(const void* data, int size)
+{
+    while (size > 0)
+    {
+        int block = MIN(size, BUFFER_SIZE - usb_stream_bufpos);
+
+        // Copy the data to the next available spots in the global buffer
+        memcpy(usb_buffer + usb_stream_bufpos, data, block);
+        usb_stream_bufpos += block;
+        data = (void*)(((char*)data) + block);
+        size -= block;
+
+        // Send the burst once the buffer is full
+        if (usb_stream_bufpos == BUFFER_SIZE && usb_everdrive_flush_burst())
+        {
+            usb_stream_failed = TRUE;
+            usb_didtimeout = TRUE;
+            return;
+        }
+    }
+}
+
+
+/*==============================
+    usb_everdrive_write_end
+    Appends the CMP signal and flushes the final burst of a chunked
+    packet on the EverDrive
+    @return 1 on success, 0 on timeout
+==============================*/
+
+static char usb_everdrive_write_end(void)
+{
+    char cmp[] = {'C', 'M', 'P', 'H'};
+
+    for (int i=0; i<4; i++)
+    {
+        if (usb_stream_bufpos == BUFFER_SIZE && usb_everdrive_flush_burst())
+        {
+            usb_didtimeout = TRUE;
+            return FALSE;
+        }
+        usb_buffer[usb_stream_bufpos++] = cmp[i];
+    }
+
+    if (usb_stream_bufpos > 0 && usb_everdrive_flush_burst())
+    {
+        usb_didtimeout = TRUE;
+        return FALSE;
+    }
+    usb_didtimeout = FALSE;
+    return TRUE;
+}
+
+
 /*==============================
     usb_everdrive_poll
     Returns the header of data being received via USB on the EverDrive
@@ -1351,23 +2054,32 @@ static void usb_sc64_write(int datatype, const void* data, int size)
     // Enable SDRAM writes and get previous setting
     writable_restore = usb_sc64_set_writable(TRUE);
 
+    // Double-buffered staging: the CPU fills one buffer while the PI
+    // DMAs the other one to SDRAM
+    int bufidx = 0;
     while (left > 0)
     {
         // Calculate transfer size
         u32 block = MIN(left, BUFFER_SIZE);
+        u8* buffer = bufidx ? usb_buffer2 : usb_buffer;
 
         // Copy data to PI DMA aligned buffer
-        memcpy(usb_buffer, data, block);
+        memcpy(buffer, data, block);
 
-        // Copy block of data from RDRAM to SDRAM
-        usb_dma_write(usb_buffer, pi_address, ALIGN(block, 2));
+        // Wait for the previous block's DMA, then start this one
+        usb_dma_write_wait();
+        usb_dma_write_async(buffer, pi_address, ALIGN(block, 2));
 
         // Update pointers and variables
         data = (void*)(((u32)data) + block);
         left -= block;
         pi_address += block;
+        bufidx ^= 1;
     }
 
+    // Wait for the last block before touching the PI again
+    usb_dma_write_wait();
+
     // Restore previous SDRAM writable setting
     usb_sc64_set_writable(writable_restore);
 
@@ -1397,6 +2109,117 @@ static void usb_sc64_write(int datatype, const void* data, int size)
 }
 
 
+/*==============================
+    usb_sc64_write_start
+    Opens a chunked packet on the SC64. The payload is staged in SDRAM
+    at STREAM_ADDRESS and only handed to the USB interface at
+    usb_write_end, so regular packets can go out in between.
+    @param The DATATYPE of the packet
+    @param The total payload size in bytes
+    @return 1 if the stream can start, 0 if a previous write is busy
+==============================*/
+
+static char usb_sc64_write_start(int datatype, int size)
+{
+    u32 result[2];
+
+    // Fail if the previous transfer is still in flight
+    usb_sc64_execute_cmd(SC64_CMD_USB_WRITE_STATUS, NULL, result);
+    if (result[0] & SC64_USB_WRITE_STATUS_BUSY)
+    {
+        usb_didtimeout = TRUE;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+/*==============================
+    usb_sc64_write_chunk
+    Stages one piece of a chunked packet in SC64 SDRAM
+    @param A buffer with the payload piece
+    @param The size of the piece in bytes
+==============================*/
+
+static void usb_sc64_write_chunk(const void* data, int size)
+{
+    u32 left = size;
+    u32 pi_address = SC64_BASE + STREAM_ADDRESS + usb_stream_offset;
+    u32 writable_restore;
+
+    // Enable SDRAM writes and get previous setting
+    writable_restore = usb_sc64_set_writable(TRUE);
+
+    // Stage the piece with the same double-buffered DMA as usb_sc64_write
+    int bufidx = 0;
+    while (left > 0)
+    {
+        // Calculate transfer size
+        u32 block = MIN(left, BUFFER_SIZE);
+        u8* buffer = bufidx ? usb_buffer2 : usb_buffer;
+
+        // Copy data to PI DMA aligned buffer
+        memcpy(buffer, data, block);
+
+        // Wait for the previous block's DMA, then start this one
+        usb_dma_write_wait();
+        usb_dma_write_async(buffer, pi_address, ALIGN(block, 2));
+
+        // Update pointers and variables
+        data = (void*)(((u32)data) + block);
+        left -= block;
+        pi_address += block;
+        bufidx ^= 1;
+    }
+
+    // Wait for the last block before touching the PI again
+    usb_dma_write_wait();
+
+    // Restore previous SDRAM writable setting
+    usb_sc64_set_writable(writable_restore);
+    usb_stream_offset += size;
+}
+
+
+/*==============================
+    usb_sc64_write_end
+    Hands the fully staged chunked packet to the SC64 USB interface
+    @return 1 on success, 0 on timeout
+==============================*/
+
+static char usb_sc64_write_end(void)
+{
+    u32 args[2];
+    u32 result[2];
+    u32 timeout;
+
+    // Start sending data from buffer in SDRAM
+    args[0] = SC64_BASE + STREAM_ADDRESS;
+    args[1] = USBHEADER_CREATE(usb_stream_type, usb_stream_size);
+    if (usb_sc64_execute_cmd(SC64_CMD_USB_WRITE, args, NULL))
+    {
+        usb_didtimeout = TRUE;
+        return FALSE;
+    }
+
+    // Wait for transfer to end
+    timeout = usb_timeout_start();
+    do
+    {
+        // Took too long, abort
+        if (usb_timeout_check(timeout, SC64_WRITE_TIMEOUT))
+        {
+            usb_didtimeout = TRUE;
+            return FALSE;
+        }
+        usb_sc64_execute_cmd(SC64_CMD_USB_WRITE_STATUS, NULL, result);
+    }
+    while (result[0] & SC64_USB_WRITE_STATUS_BUSY);
+    usb_didtimeout = FALSE;
+    return TRUE;
+}
+
+
 /*==============================
     usb_sc64_poll
     Returns the header of data being received via USB on the SC64
@@ -0,0 +1,230 @@
+/**
+ * @file video64.c
+ * @brief Support for VIDEO64 movie files
+ * @ingroup rdp
+ */
+
+#include "video64.h"
+#include "video64internal.h"
+#include "rdp.h"
+#include "mixer.h"
+#include "audio.h"
+#include "interrupt.h"
+#include "dragonfs.h"
+#include "n64sys.h"
+#include "dma.h"
+#include "debug.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/** @brief Profile of DMA usage by VIDEO64, used for debugging purposes. */
+int64_t __video64_profile_dma = 0;
+
+/** @brief ROM address of the specified frame. */
+static uint32_t frame_rom_addr(video64_t *vid, int frame) {
+	return vid->rom_addr + (uint32_t)frame * vid->frame_size;
+}
+
+/**
+ * @brief Mixer event implementing the frame clock.
+ *
+ * The event fires once per frame period, counted in audio output samples,
+ * and accounts the elapsed frame in #video64_t::frames_due. The period is
+ * rarely a whole number of samples: the division remainder is carried over
+ * to the next period (Bresenham-style), so the clock does not drift no
+ * matter how long the video is.
+ */
+static int video64_frame_event(void *ctx) {
+	video64_t *vid = (video64_t*)ctx;
+	if (!vid->playing) {
+		vid->clock_active = false;
+		return 0;
+	}
+
+	vid->frames_due++;
+
+	int64_t delay = vid->clock_num / vid->clock_den;
+	vid->clock_rem += vid->clock_num % vid->clock_den;
+	if (vid->clock_rem >= vid->clock_den) {
+		vid->clock_rem -= vid->clock_den;
+		delay++;
+	}
+	return delay;
+}
+
+void video64_open(video64_t *vid, const char *fn) {
+	memset(vid, 0, sizeof(*vid));
+
+	// Like wav64, video64 files can only be streamed from DFS (ROMs), as
+	// frames are fetched with direct PI DMA transfers.
+	if (strstr(fn, ":/")) {
+		assertf(strncmp(fn, "rom:/", 5) == 0, "Cannot open %s: video64 only supports files in ROM (rom:/)", fn);
+		fn += 5;
+	}
+
+	int fh = dfs_open(fn);
+	assertf(fh >= 0, "file does not exist: %s", fn);
+
+	video64_header_t head;
+	dfs_read(&head, 1, sizeof(head), fh);
+	dfs_close(fh);
+
+	assertf(memcmp(head.id, VIDEO64_ID, 4) == 0, "video64 %s: invalid ID: %02x%02x%02x%02x\n",
+		fn, head.id[0], head.id[1], head.id[2], head.id[3]);
+	assertf(head.version == VIDEO64_FILE_VERSION, "video64 %s: invalid version: %02x\n",
+		fn, head.version);
+
+	vid->width = head.width;
+	vid->height = head.height;
+	vid->fps_num = head.fps_num;
+	vid->fps_den = head.fps_den;
+	vid->num_frames = head.num_frames;
+	vid->strip_height = head.strip_height;
+	vid->frame_size = vid->width * vid->height * 2;
+	vid->rom_addr = dfs_rom_addr(fn) + head.start_offset;
+	vid->cur_frame = -1;
+	vid->buf_frame[0] = vid->buf_frame[1] = -1;
+
+	// Frame buffers are uncached: they are written by PI DMA and read by
+	// the RDP, so going through the CPU cache would only cost invalidations.
+	for (int i = 0; i < 2; i++) {
+		vid->buffers[i] = malloc_uncached(vid->frame_size);
+		assert(vid->buffers[i] != NULL);
+	}
+}
+
+void video64_play(video64_t *vid) {
+	float rate = audio_get_frequency_exact();
+	assertf(rate > 0, "audio must be initialized before video64_play");
+
+	// Restarting while the previous clock is still registered would
+	// register a second event for the same video.
+	video64_stop(vid);
+	dma_wait();
+
+	vid->cur_frame = -1;
+	vid->buf_frame[0] = vid->buf_frame[1] = -1;
+	vid->buf_front = 1;
+	vid->playing = true;
+
+	// Frame period expressed in audio output samples, as a fraction:
+	// (exact sample rate * fps_den) / fps_num.
+	vid->clock_num = (int64_t)(rate * vid->fps_den + 0.5f);
+	vid->clock_den = vid->fps_num;
+	vid->clock_rem = 0;
+
+	// The first frame is due immediately; start fetching it right away so
+	// that it is likely already in RDRAM when video64_update is called.
+	vid->frames_due = 1;
+	uint32_t t0 = TICKS_READ();
+	dma_read_async(vid->buffers[0], frame_rom_addr(vid, 0), vid->frame_size);
+	__video64_profile_dma += TICKS_READ() - t0;
+	vid->buf_frame[0] = 0;
+
+	vid->clock_active = true;
+	mixer_add_event(vid->clock_num / vid->clock_den, video64_frame_event, vid);
+}
+
+bool video64_update(video64_t *vid) {
+	if (!vid->playing)
+		return false;
+
+	// Consume the frames elapsed on the audio clock. The counter is
+	// incremented from the mixer (possibly in interrupt context).
+	disable_interrupts();
+	int due = vid->frames_due;
+	vid->frames_due = 0;
+	enable_interrupts();
+	if (due == 0)
+		return true;
+
+	int target = vid->cur_frame + due;
+	if (target >= vid->num_frames) {
+		if (vid->loop)
+			target %= vid->num_frames;
+		else
+			target = vid->num_frames - 1;
+	}
+
+	// Wait for the prefetch of the back buffer to complete. If the clock
+	// skipped past the prefetched frame, drop it and fetch the due frame
+	// instead: frames have a fixed size, so any frame can be addressed
+	// directly.
+	int back = vid->buf_front ^ 1;
+	uint32_t t0 = TICKS_READ();
+	dma_wait();
+	if (vid->buf_frame[back] != target)
+		dma_read(vid->buffers[back], frame_rom_addr(vid, target), vid->frame_size);
+	__video64_profile_dma += TICKS_READ() - t0;
+	vid->buf_frame[back] = target;
+	vid->buf_front = back;
+	vid->cur_frame = target;
+
+	// Start prefetching the next frame into the other buffer, overlapping
+	// the transfer with the display of the frame just flipped in.
+	int next = target + 1;
+	if (next >= vid->num_frames)
+		next = vid->loop ? 0 : -1;
+	if (next >= 0) {
+		t0 = TICKS_READ();
+		dma_read_async(vid->buffers[back ^ 1], frame_rom_addr(vid, next), vid->frame_size);
+		__video64_profile_dma += TICKS_READ() - t0;
+		vid->buf_frame[back ^ 1] = next;
+	} else if (vid->cur_frame == vid->num_frames - 1) {
+		// Last frame reached: stop the clock. The frame itself stays
+		// valid for drawing (eg: to hold on the final picture).
+		vid->playing = false;
+		return false;
+	}
+
+	return true;
+}
+
+void video64_draw(video64_t *vid, int x, int y) {
+	assertf(vid->cur_frame >= 0, "video64_draw called before video64_play/video64_update");
+
+	rdp_enable_texture_yuv();
+
+	uint8_t *frame = vid->buffers[vid->buf_front];
+	int sh = vid->strip_height;
+	for (int ty = 0; ty < vid->height; ty += sh) {
+		// Ensure the previous strip has been rasterized before its TMEM
+		// contents are overwritten by the next load
+		if (ty)
+			rdp_sync(SYNC_PIPE);
+		rdp_load_yuv_texture(0, 0, frame + ty * vid->width * 2, vid->width, sh);
+		rdp_draw_textured_rectangle(0, x, y + ty, x + vid->width - 1, y + ty + sh - 1, MIRROR_DISABLED);
+	}
+}
+
+void video64_set_loop(video64_t *vid, bool loop) {
+	vid->loop = loop;
+}
+
+void video64_stop(video64_t *vid) {
+	// The mixer event might fire from interrupt context (if the mixer is
+	// attached to the audio interrupt), so removal must not race with it.
+	disable_interrupts();
+	vid->playing = false;
+	if (vid->clock_active) {
+		mixer_remove_event(video64_frame_event, vid);
+		vid->clock_active = false;
+	}
+	enable_interrupts();
+}
+
+void video64_close(video64_t *vid) {
+	video64_stop(vid);
+
+	// Make sure no transfer is still targeting the buffers being freed.
+	dma_wait();
+	for (int i = 0; i < 2; i++) {
+		if (vid->buffers[i]) {
+			free_uncached(vid->buffers[i]);
+			vid->buffers[i] = NULL;
+		}
+	}
+	memset(vid, 0, sizeof(*vid));
+}
@@ -0,0 +1,524 @@
+#include <libdragon.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+/**********************************************************************
+ * BENCHMARK ROM
+ *
+ * Measures the hot paths of the library on real hardware and reports
+ * the results in a machine-parsable format over the usb log (and
+ * ISViewer), so that CI or a developer at a flashcart can diff runs
+ * and catch performance regressions before they land.
+ *
+ * Output format (one line per measurement):
+ *
+ *   BENCH <name> <param> <iters> <total_ticks> <ticks_per_iter> <bytes_per_iter>
+ *
+ * Ticks are TICKS_READ() units (half the CPU clock, 46.875 MHz on NTSC).
+ * <bytes_per_iter> is 0 when a throughput figure makes no sense for the
+ * benchmark. The run is terminated by a single "BENCH-END" line.
+ **********************************************************************/
+
+// Run "stmt" for "iters" iterations with caches flushed beforehand, and
+// return the total elapsed ticks.
+#define BENCH_LOOP(iters, stmt) ({ \
+	data_cache_writeback_invalidate_all(); \
+	inst_cache_invalidate_all(); \
+	uint32_t __t0 = TICKS_READ(); \
+	for (int __i = 0; __i < (iters); __i++) { stmt; } \
+	TICKS_DISTANCE(__t0, TICKS_READ()); \
+})
+
+static void bench_report(const char *name, const char *param, int iters, uint32_t ticks, int bytes)
+{
+	debugf("BENCH %s %s %d %lu %lu %d\n",
+		name, param, iters, (unsigned long)ticks, (unsigned long)(ticks / iters), bytes);
+}
+
+static uint8_t buf_dst[64*1024 + 16] __attribute__((aligned(16)));
+static uint8_t buf_src[64*1024 + 16] __attribute__((aligned(16)));
+
+/**********************************************************************
+ * dma_read: throughput across transfer sizes and alignments
+ **********************************************************************/
+
+static void bench_dma_read(void)
+{
+	// Any ROM address works as a DMA source; transfers larger than the
+	// file just keep reading the rest of the image.
+	uint32_t rom = dfs_rom_addr("random.dat");
+	const int sizes[] = { 16, 128, 1024, 16384, 65536 };
+
+	for (int s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		for (int off = 0; off <= 2; off += 2) {
+			int size = sizes[s];
+			int iters = 512*1024 / size;
+			if (iters > 2048) iters = 2048;
+
+			char param[32];
+			sprintf(param, "size=%d,off=%d", size, off);
+
+			uint32_t t = BENCH_LOOP(iters,
+				dma_read(buf_dst + off, rom + off, size));
+			bench_report("dma_read", param, iters, t, size);
+		}
+	}
+}
+
+/**********************************************************************
+ * PI timing calibration: sweep progressively faster DOM1 timings,
+ * validate data integrity against a block read at boot timings, and
+ * emit the fastest configuration that still reads back correctly.
+ * DOM2 is left alone: there is no device we can safely read on every
+ * cart, while DOM1 ROM reads work everywhere. Flashcarts, repro carts
+ * and emulators all top out at different points, which is exactly what
+ * the BENCH-PICAL records capture for the cart the ROM runs on.
+ **********************************************************************/
+
+static void bench_pi_cal(void)
+{
+	static uint8_t ref_buf[64*1024] __attribute__((aligned(16)));
+	uint32_t rom = dfs_rom_addr("random.dat");
+	uint8_t boot_lat, boot_pwd, boot_pgs, boot_rls;
+	dma_get_domain_timings(1, &boot_lat, &boot_pwd, &boot_pgs, &boot_rls);
+
+	data_cache_writeback_invalidate_all();
+	dma_read(ref_buf, rom, sizeof(ref_buf));
+
+	struct { uint8_t lat, pwd; } profiles[] = {
+		{ 0, 0 },          // boot timings (filled in below)
+		{ 0x40, 0x12 },    // standard retail header values
+		{ 0x20, 0x10 },
+		{ 0x10, 0x0c },
+		{ 0x0c, 0x0a },
+		{ 0x08, 0x09 },
+		{ 0x04, 0x07 },
+	};
+	profiles[0].lat = boot_lat;
+	profiles[0].pwd = boot_pwd;
+
+	uint32_t best_bps = 0;
+	int best = -1;
+
+	for (int p = 0; p < sizeof(profiles)/sizeof(profiles[0]); p++) {
+		dma_set_domain_timings(1, profiles[p].lat, profiles[p].pwd, boot_pgs, boot_rls);
+
+		// Integrity: re-read the reference block at several sizes and
+		// alignments, multiple times, and require exact matches
+		bool ok = true;
+		const int sizes[] = { 14, 4096, 65536 };
+		for (int pass = 0; pass < 4 && ok; pass++) {
+			for (int s = 0; s < 3 && ok; s++) {
+				for (int off = 0; off <= 2 && ok; off += 2) {
+					int size = sizes[s];
+					if (off + size > sizeof(ref_buf)) size = sizeof(ref_buf) - off;
+					memset(buf_dst, 0, size);
+					data_cache_writeback_invalidate_all();
+					dma_read(buf_dst, rom + off, size);
+					if (memcmp(buf_dst, ref_buf + off, size))
+						ok = false;
+				}
+			}
+		}
+
+		if (!ok) {
+			// Back to known-good timings before touching the bus again
+			dma_set_domain_timings(1, boot_lat, boot_pwd, boot_pgs, boot_rls);
+			debugf("BENCH-PICAL lat=0x%02x pwd=0x%02x UNSAFE\n",
+				profiles[p].lat, profiles[p].pwd);
+			continue;
+		}
+
+		uint32_t bps = dma_measure_bandwidth(buf_dst, rom, 64*1024);
+		debugf("BENCH-PICAL lat=0x%02x pwd=0x%02x pgs=0x%02x rls=0x%02x bps=%lu\n",
+			profiles[p].lat, profiles[p].pwd, boot_pgs, boot_rls,
+			(unsigned long)bps);
+
+		if (bps > best_bps) {
+			best_bps = bps;
+			best = p;
+		}
+	}
+
+	dma_set_domain_timings(1, boot_lat, boot_pwd, boot_pgs, boot_rls);
+
+	if (best >= 0)
+		debugf("BENCH-PICAL-BEST lat=0x%02x pwd=0x%02x pgs=0x%02x rls=0x%02x bps=%lu\n",
+			profiles[best].lat, profiles[best].pwd, boot_pgs, boot_rls,
+			(unsigned long)best_bps);
+}
+
+/**********************************************************************
+ * memcpy/memset variants on cached RDRAM
+ **********************************************************************/
+
+static void bench_memcpy(void)
+{
+	const struct {
+		const char *param;
+		int dst_off, src_off, size;
+	} cfgs[] = {
+		{ "aligned,size=1024",    0, 0, 1024 },
+		{ "aligned,size=65536",   0, 0, 65536 },
+		{ "misaligned,size=65536", 1, 3, 65536 },
+	};
+
+	for (int c = 0; c < sizeof(cfgs)/sizeof(cfgs[0]); c++) {
+		int iters = 512*1024 / cfgs[c].size;
+		uint32_t t = BENCH_LOOP(iters,
+			memcpy(buf_dst + cfgs[c].dst_off, buf_src + cfgs[c].src_off, cfgs[c].size));
+		bench_report("memcpy", cfgs[c].param, iters, t, cfgs[c].size);
+	}
+
+	uint32_t t = BENCH_LOOP(8, memset(buf_dst, 0, 65536));
+	bench_report("memset", "size=65536", 8, t, 65536);
+}
+
+/**********************************************************************
+ * dfs_read: file read throughput at different chunk sizes
+ **********************************************************************/
+
+static void bench_dfs_read(void)
+{
+	const int chunks[] = { 1024, 8192 };
+
+	for (int c = 0; c < sizeof(chunks)/sizeof(chunks[0]); c++) {
+		int fp = dfs_open("random.dat");
+		int size = dfs_size(fp);
+		int chunk = chunks[c];
+		char param[32];
+		sprintf(param, "chunk=%d", chunk);
+
+		uint32_t t = BENCH_LOOP(64, ({
+			dfs_seek(fp, 0, SEEK_SET);
+			for (int pos = 0; pos < size; pos += chunk)
+				dfs_read(buf_dst, 1, chunk, fp);
+		}));
+		bench_report("dfs_read", param, 64, t, size);
+		dfs_close(fp);
+	}
+}
+
+/**********************************************************************
+ * mixer_poll: mixing cost scaling over channel counts and sample rates.
+ * Reports three lines per configuration: total mixer_poll CPU time,
+ * the RSP portion of it (via the mixer's own __mixer_profile_rsp
+ * counter around the rsp_mixer dispatch), and the sample buffer
+ * high-water mark as seen by the waveform read callback.
+ **********************************************************************/
+
+extern int64_t __mixer_profile_rsp;
+
+static int bench_sbuf_hwm;
+static int bench_sbuf_size;
+
+static void bench_silence_read(void *ctx, samplebuffer_t *sbuf, int wpos, int wlen, bool seeking)
+{
+	int16_t *out = samplebuffer_append(sbuf, wlen);
+	memset(out, 0, wlen * sizeof(int16_t));
+	if (sbuf->widx > bench_sbuf_hwm)
+		bench_sbuf_hwm = sbuf->widx;
+	bench_sbuf_size = sbuf->size;
+}
+
+static waveform_t bench_silence = {
+	.name = "bench-silence",
+	.bits = 16,
+	.channels = 1,
+	.frequency = 32000,
+	.len = WAVEFORM_UNKNOWN_LEN,
+	.loop_len = 0,
+	.read = bench_silence_read,
+};
+
+static void bench_mixer_poll(void)
+{
+	static int16_t poll_buf[256*2];
+	const int freqs[] = { 32000, 44100, 48000 };
+	const int nch[] = { 1, 4, 8, 16, 32 };
+
+	for (int f = 0; f < sizeof(freqs)/sizeof(freqs[0]); f++) {
+		audio_init(freqs[f], 4);
+		mixer_init(32);
+		// Keep the waveform at the output rate, so we measure pure
+		// per-channel mixing cost without a resampling component
+		bench_silence.frequency = freqs[f];
+
+		for (int c = 0; c < sizeof(nch)/sizeof(nch[0]); c++) {
+			for (int i = 0; i < nch[c]; i++)
+				mixer_ch_play(i, &bench_silence);
+
+			char param[32];
+			sprintf(param, "freq=%d,ch=%d", freqs[f], nch[c]);
+
+			bench_sbuf_hwm = bench_sbuf_size = 0;
+			__mixer_profile_rsp = 0;
+			uint32_t t = BENCH_LOOP(64, mixer_poll(poll_buf, 256));
+			bench_report("mixer_poll", param, 64, t, 0);
+			bench_report("mixer_rsp", param, 64, __mixer_profile_rsp, 0);
+			// ticks columns hold samples here: high-water mark of the
+			// per-channel sample buffer, with its capacity as "bytes"
+			bench_report("mixer_sbuf", param, 1, bench_sbuf_hwm, bench_sbuf_size);
+
+			for (int i = 0; i < nch[c]; i++)
+				mixer_ch_stop(i);
+		}
+
+		mixer_close();
+		audio_close();
+	}
+}
+
+/**********************************************************************
+ * graphics.c: software blitting into an offscreen surface
+ **********************************************************************/
+
+static void bench_graphics(void)
+{
+	surface_t surf = surface_alloc(FMT_RGBA16, 320, 240);
+	uint32_t color = graphics_make_color(255, 0, 255, 255);
+
+	uint32_t t = BENCH_LOOP(16, graphics_fill_screen(&surf, color));
+	bench_report("graphics", "fill_screen", 16, t, 320*240*2);
+
+	t = BENCH_LOOP(16, graphics_draw_box(&surf, 16, 16, 288, 208, color));
+	bench_report("graphics", "draw_box", 16, t, 288*208*2);
+
+	t = BENCH_LOOP(64, graphics_draw_text(&surf, 8, 8, "the quick brown fox jumps over the lazy dog"));
+	bench_report("graphics", "draw_text", 64, t, 0);
+
+	surface_free(&surf);
+}
+
+/**********************************************************************
+ * Sprite blits: CPU (graphics_draw_sprite_trans) vs RDP textured
+ * rectangles, sweeping sprite dimensions and formats. The RDP path is
+ * measured both with the texture resident in TMEM (loaded once, drawn
+ * many times) and reloaded before every draw, since the crossover
+ * point depends on TMEM state. Besides the usual BENCH lines, each
+ * configuration emits a BENCH-XOVER line with the per-sprite cost of
+ * all three variants, which is the table the batched sprite renderer
+ * thresholds can be derived from.
+ **********************************************************************/
+
+static sprite_t *bench_make_sprite(int width, int height, int bitdepth)
+{
+	sprite_t *sp = malloc(sizeof(sprite_t) + width*height*bitdepth);
+	sp->width = width;
+	sp->height = height;
+	sp->bitdepth = bitdepth;
+	sp->format = 0;
+	sp->hslices = 1;
+	sp->vslices = 1;
+	// Arbitrary opaque pixels (alpha bits set, so the transparent
+	// blitter takes its slow path like it would for real artwork)
+	uint8_t *px = (uint8_t*)sp->data;
+	for (int i = 0; i < width*height*bitdepth; i++)
+		px[i] = (i * 29) | 1;
+	return sp;
+}
+
+static void bench_blit(void)
+{
+	const struct {
+		int width, height, bitdepth;
+	} cfgs[] = {
+		{  8,  8, 2 }, { 16, 16, 2 }, { 32, 32, 2 }, { 64, 32, 2 },
+		{  8,  8, 4 }, { 16, 16, 4 }, { 32, 32, 4 },
+	};
+
+	rdp_init();
+
+	for (int c = 0; c < sizeof(cfgs)/sizeof(cfgs[0]); c++) {
+		int width = cfgs[c].width, height = cfgs[c].height, bitdepth = cfgs[c].bitdepth;
+		sprite_t *sp = bench_make_sprite(width, height, bitdepth);
+		surface_t surf = surface_alloc(bitdepth == 2 ? FMT_RGBA16 : FMT_RGBA32, 320, 240);
+
+		int iters = 1280*1024 / (width*height);
+		if (iters > 4096) iters = 4096;
+
+		char param[32];
+		sprintf(param, "fmt=%d,w=%d,h=%d", bitdepth*8, width, height);
+
+		uint32_t t_cpu = BENCH_LOOP(iters,
+			graphics_draw_sprite_trans(&surf, 32, 32, sp));
+		bench_report("blit_cpu", param, iters, t_cpu, width*height*bitdepth);
+
+		uint32_t t_hot = BENCH_LOOP(1, ({
+			rdp_attach(&surf);
+			rdp_enable_texture_copy();
+			rdp_load_texture(0, 0, MIRROR_DISABLED, sp);
+			for (int j = 0; j < iters; j++)
+				rdp_draw_sprite(0, 32, 32, MIRROR_DISABLED);
+			rdp_detach();
+		}));
+		bench_report("blit_rdp_hot", param, iters, t_hot, width*height*bitdepth);
+
+		uint32_t t_cold = BENCH_LOOP(1, ({
+			rdp_attach(&surf);
+			rdp_enable_texture_copy();
+			for (int j = 0; j < iters; j++) {
+				rdp_tmem_invalidate();
+				rdp_load_texture(0, 0, MIRROR_DISABLED, sp);
+				rdp_draw_sprite(0, 32, 32, MIRROR_DISABLED);
+			}
+			rdp_detach();
+		}));
+		bench_report("blit_rdp_cold", param, iters, t_cold, width*height*bitdepth);
+
+		debugf("BENCH-XOVER fmt=%d w=%d h=%d cpu=%lu rdp_hot=%lu rdp_cold=%lu\n",
+			bitdepth*8, width, height,
+			(unsigned long)(t_cpu / iters),
+			(unsigned long)(t_hot / iters),
+			(unsigned long)(t_cold / iters));
+
+		surface_free(&surf);
+		free(sp);
+	}
+
+	rdp_close();
+}
+
+/**********************************************************************
+ * rspq: round-trip latency, sustained command throughput, block replay
+ * and overlay switch cost, using the test ucodes from test_rspq.c
+ **********************************************************************/
+
+DEFINE_RSP_UCODE(rsp_test);
+DEFINE_RSP_UCODE(rsp_test2);
+
+static void bench_rspq(void)
+{
+	void *test_ovl_state = rspq_overlay_get_state(&rsp_test);
+	memset(test_ovl_state, 0, sizeof(uint32_t) * 2);
+
+	rspq_init();
+	uint32_t ovl = rspq_overlay_register(&rsp_test);
+	uint32_t ovl2 = rspq_overlay_register(&rsp_test2);
+
+	// Syncpoint round-trip: enqueue, kick the RSP, wait for completion
+	uint32_t t = BENCH_LOOP(256, ({
+		rspq_syncpoint_t sp = rspq_syncpoint_new();
+		rspq_flush();
+		rspq_syncpoint_wait(sp);
+	}));
+	bench_report("rspq", "roundtrip", 256, t, 0);
+
+	// Sustained throughput: enqueue a large batch of no-op-ish commands
+	// and wait for the RSP to drain them, so that both the CPU write
+	// cost and the RSP fetch/dispatch cost are included. Per-command
+	// ticks come out in the ticks_per_iter column.
+	const int NCMD = 4096;
+
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < NCMD; j++)
+			rspq_write(ovl, 0x0, 0);
+		rspq_wait();
+	}));
+	bench_report("rspq_write", "size=4", NCMD, t, 4);
+
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < NCMD; j++)
+			rspq_write(ovl, 0x2, 0, 0, 0, 0);
+		rspq_wait();
+	}));
+	bench_report("rspq_write", "size=16", NCMD, t, 16);
+
+	// Maximum-size command (132 bytes), via the long-command write path
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < NCMD/8; j++) {
+			rspq_write_t w = rspq_write_begin(ovl, 0x8, 33);
+			for (int k = 0; k < 32; k++)
+				rspq_write_arg(&w, 0);
+			rspq_write_end(&w);
+		}
+		rspq_wait();
+	}));
+	bench_report("rspq_write", "size=132", NCMD/8, t, 132);
+
+	// Block replay vs writing the same commands directly every time
+	rspq_block_begin();
+	for (int j = 0; j < 256; j++)
+		rspq_write(ovl, 0x0, 0);
+	rspq_block_t *block = rspq_block_end();
+
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < 16; j++)
+			rspq_block_run(block);
+		rspq_wait();
+	}));
+	bench_report("rspq_block", "replay,cmds=256", 16*256, t, 4);
+
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < 16*256; j++)
+			rspq_write(ovl, 0x0, 0);
+		rspq_wait();
+	}));
+	bench_report("rspq_block", "direct,cmds=256", 16*256, t, 4);
+
+	rspq_block_free(block);
+
+	// Overlay switch cost: alternate commands from two overlays so every
+	// command forces an overlay load, against the same command mix from a
+	// single overlay. The per-command difference is the switch cost.
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < NCMD/2; j++) {
+			rspq_write(ovl, 0x0, 0);
+			rspq_write(ovl2, 0x0, 0, 0);
+		}
+		rspq_wait();
+	}));
+	bench_report("rspq_ovl", "alternate", NCMD, t, 0);
+
+	t = BENCH_LOOP(1, ({
+		for (int j = 0; j < NCMD/2; j++) {
+			rspq_write(ovl, 0x0, 0);
+			rspq_write(ovl, 0x1, 0, 0);
+		}
+		rspq_wait();
+	}));
+	bench_report("rspq_ovl", "single", NCMD, t, 0);
+
+	rspq_overlay_unregister(ovl2);
+	rspq_overlay_unregister(ovl);
+	rspq_close();
+}
+
+int main(void)
+{
+	console_init();
+	console_set_debug(true);
+	debug_init_isviewer();
+	debug_init_usblog();
+
+	if (dfs_init(DFS_DEFAULT_LOCATION) != DFS_ESUCCESS) {
+		printf("Invalid ROM: cannot initialize DFS\n");
+		return 0;
+	}
+
+	printf("libdragon benchmarks (%s)\n\n", sys_bbplayer() ? "iQue" : "N64");
+
+	// Run header for host-side collectors (tools/benchcheck): platform,
+	// TV type and timer frequency, so ticks can be converted and runs
+	// from different racks are never compared against each other.
+	debugf("BENCH-BEGIN platform=%s tv=%d ticks_per_sec=%ld\n",
+		sys_bbplayer() ? "ique" : "n64", get_tv_type(), TICKS_PER_SECOND);
+
+	// Fill the memcpy source with non-trivial data, so compilers/caches
+	// cannot play tricks
+	for (int i = 0; i < sizeof(buf_src); i++)
+		buf_src[i] = i * 17;
+
+	bench_dma_read();
+	bench_pi_cal();
+	bench_memcpy();
+	bench_dfs_read();
+	bench_mixer_poll();
+	bench_graphics();
+	bench_blit();
+	bench_rspq();
+
+	debugf("BENCH-END\n");
+	printf("\nAll benchmarks completed.\n");
+}
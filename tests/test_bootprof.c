@@ -0,0 +1,19 @@
+
+void test_bootprof(TestContext *ctx) {
+	int base = bootprof_count();
+
+	uint32_t before = TICKS_READ();
+	bootprof_mark("test_phase");
+	uint32_t after = TICKS_READ();
+
+	ASSERT(bootprof_count() == base + 1, "mark was not recorded");
+
+	const bootprof_mark_t *m = bootprof_get(base);
+	ASSERT(m != NULL, "recorded mark not retrievable");
+	ASSERT(strcmp(m->name, "test_phase") == 0, "wrong mark name: %s", m->name);
+	ASSERT(TICKS_BEFORE(before, m->ticks) || before == m->ticks, "mark timestamp too early");
+	ASSERT(TICKS_BEFORE(m->ticks, after) || m->ticks == after, "mark timestamp too late");
+
+	ASSERT(bootprof_get(-1) == NULL, "negative index not rejected");
+	ASSERT(bootprof_get(bootprof_count()) == NULL, "out-of-range index not rejected");
+}
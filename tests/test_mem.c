@@ -0,0 +1,104 @@
+
+static uint8_t mem_src[1024+16] __attribute__((aligned(16)));
+static uint8_t mem_dst[1024+64] __attribute__((aligned(16)));
+static uint8_t mem_ref[1024+64] __attribute__((aligned(16)));
+
+// Reference byte-by-byte copy/fill, so that the optimized implementations
+// are checked against something trivially correct (and that also serves as
+// the baseline in the benchmark below).
+static void mem_refcpy(uint8_t *d, const uint8_t *s, int n) {
+	while (n--) *d++ = *s++;
+}
+
+void test_mem_memcpy(TestContext *ctx) {
+	SRAND(0x12345);
+	for (int i=0;i<sizeof(mem_src);i++) mem_src[i] = myrand();
+
+	// All combinations of source/destination misalignment, with sizes
+	// covering the byte loops, the unrolled loops, and their boundaries.
+	static const int sizes[] = { 0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 255, 256, 1000 };
+	for (int so=0; so<8; so++) {
+		for (int dof=0; dof<8; dof++) {
+			for (int si=0; si<sizeof(sizes)/sizeof(sizes[0]); si++) {
+				int n = sizes[si];
+				memset(mem_dst, 0xCC, sizeof(mem_dst));
+				memset(mem_ref, 0xCC, sizeof(mem_ref));
+				mem_refcpy(mem_ref+16+dof, mem_src+so, n);
+				memcpy(mem_dst+16+dof, mem_src+so, n);
+				ASSERT_EQUAL_MEM(mem_dst, mem_ref, sizeof(mem_dst),
+					"memcpy mismatch (so=%d dof=%d n=%d)", so, dof, n);
+			}
+		}
+	}
+}
+
+void test_mem_memset(TestContext *ctx) {
+	static const int sizes[] = { 0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 255, 256, 1000 };
+	for (int dof=0; dof<8; dof++) {
+		for (int si=0; si<sizeof(sizes)/sizeof(sizes[0]); si++) {
+			int n = sizes[si];
+			for (int i=0;i<sizeof(mem_dst);i++) mem_dst[i] = mem_ref[i] = 0xCC;
+			for (int i=0;i<n;i++) mem_ref[16+dof+i] = 0x5A;
+			memset(mem_dst+16+dof, 0x5A, n);
+			ASSERT_EQUAL_MEM(mem_dst, mem_ref, sizeof(mem_dst),
+				"memset mismatch (dof=%d n=%d)", dof, n);
+		}
+	}
+
+	// Large fill through the cached segment, to exercise the create-dirty
+	// fast path (needs >= 256 bytes in KSEG0).
+	uint8_t *big = malloc(8192);
+	ASSERT(big, "out of memory");
+	DEFER(free(big));
+	memset(big, 0xA5, 8192);
+	for (int i=0;i<8192;i++) {
+		if (big[i] != 0xA5)
+			ASSERT(0, "large memset mismatch at offset %d: %02x", i, big[i]);
+	}
+}
+
+void test_mem_memmove(TestContext *ctx) {
+	// Overlapping moves in both directions, for all shifts around the
+	// 8-byte alignment boundaries.
+	for (int shift=-24; shift<=24; shift++) {
+		if (shift == 0) continue;
+		for (int n=0; n<300; n+=7) {
+			for (int i=0;i<sizeof(mem_dst);i++) mem_dst[i] = mem_ref[i] = (uint8_t)(i*31+7);
+			// Reference: copy through a temporary buffer.
+			mem_refcpy(mem_src, mem_ref+64, n);
+			mem_refcpy(mem_ref+64+shift, mem_src, n);
+			memmove(mem_dst+64+shift, mem_dst+64, n);
+			ASSERT_EQUAL_MEM(mem_dst, mem_ref, sizeof(mem_dst),
+				"memmove mismatch (shift=%d n=%d)", shift, n);
+		}
+	}
+}
+
+void test_mem_bench(TestContext *ctx) {
+	const int N = 64*1024;
+	uint8_t *src = malloc(N), *dst = malloc(N);
+	ASSERT(src && dst, "out of memory");
+	DEFER(free(src); free(dst));
+	SRAND(0x54321);
+	for (int i=0;i<N;i++) src[i] = myrand();
+
+	disable_interrupts();
+	uint32_t t0 = TICKS_READ();
+	mem_refcpy(dst, src, N);
+	uint32_t byte_time = TICKS_READ() - t0;
+
+	t0 = TICKS_READ();
+	memcpy(dst, src, N);
+	uint32_t opt_time = TICKS_READ() - t0;
+	enable_interrupts();
+
+	ASSERT_EQUAL_MEM(dst, src, N, "benchmark memcpy corrupted the data");
+	LOG("memcpy of %d KiB: %ld us (byte loop: %ld us)\n",
+		N/1024, TIMER_MICROS(opt_time), TIMER_MICROS(byte_time));
+
+	// The 64-bit unrolled copy must be far faster than a byte loop; require
+	// a conservative 3x so the test is robust across ROM/emulator timings.
+	ASSERT(opt_time * 3 < byte_time,
+		"optimized memcpy not faster than byte loop: %ld vs %ld ticks",
+		opt_time, byte_time);
+}
@@ -0,0 +1,25 @@
+
+void test_profiler(TestContext *ctx) {
+	timer_init();
+	DEFER(timer_close());
+
+	profiler_init(1000, 1024);
+	DEFER(profiler_close());
+
+	// At 1000 Hz, 50 ms of busy work should collect roughly 50 samples.
+	wait_ms(50);
+	uint32_t count = profiler_sample_count();
+	ASSERT(count >= 25 && count <= 100, "unexpected sample count: %lu", count);
+
+	profiler_pause();
+	uint32_t paused = profiler_sample_count();
+	wait_ms(10);
+	ASSERT_EQUAL_UNSIGNED(profiler_sample_count(), paused, "samples recorded while paused");
+
+	profiler_resume();
+	wait_ms(10);
+	ASSERT(profiler_sample_count() > paused, "no samples recorded after resume");
+
+	profiler_reset();
+	ASSERT_EQUAL_UNSIGNED(profiler_sample_count(), 0, "reset did not clear samples");
+}
@@ -0,0 +1,57 @@
+
+void test_rspmem_memcpy(TestContext *ctx) {
+	rspq_init();
+	DEFER(rspq_close());
+	rspmem_init();
+	DEFER(rspmem_close());
+
+	// Sizes exercising a single chunk, exact chunk multiples, and a tail
+	// chunk (the DMEM staging buffer is 1 KiB).
+	static const int sizes[] = { 8, 512, 1024, 1032, 4096, 4096+8 };
+	for (int si=0; si<sizeof(sizes)/sizeof(sizes[0]); si++) {
+		int n = sizes[si];
+		uint8_t *src = malloc_uncached(n);
+		uint8_t *dst = malloc_uncached(n);
+		ASSERT(src && dst, "out of memory");
+		DEFER(free_uncached(src); free_uncached(dst));
+
+		SRAND(n);
+		for (int i=0;i<n;i++) src[i] = myrand();
+		memset(dst, 0xCC, n);
+
+		rsp_memcpy(dst, src, n);
+		rspq_wait();
+
+		ASSERT_EQUAL_MEM(dst, src, n, "rsp_memcpy mismatch (n=%d)", n);
+	}
+}
+
+void test_rspmem_memset(TestContext *ctx) {
+	rspq_init();
+	DEFER(rspq_close());
+	rspmem_init();
+	DEFER(rspmem_close());
+
+	static const int sizes[] = { 8, 1024, 1032, 4096+8 };
+	for (int si=0; si<sizeof(sizes)/sizeof(sizes[0]); si++) {
+		int n = sizes[si];
+		// Guard bytes around the target area to catch overruns.
+		uint8_t *buf = malloc_uncached(n + 16);
+		ASSERT(buf, "out of memory");
+		DEFER(free_uncached(buf));
+		memset(buf, 0xCC, n + 16);
+
+		rsp_memset(buf + 8, 0xA55A1234, n);
+		rspq_wait();
+
+		for (int i=0;i<8;i++)
+			ASSERT(buf[i] == 0xCC, "rsp_memset underrun at %d (n=%d)", i, n);
+		for (int i=0;i<n;i++) {
+			uint8_t exp = (uint8_t)(0xA55A1234 >> (24 - (i%4)*8));
+			if (buf[8+i] != exp)
+				ASSERT(0, "rsp_memset mismatch at %d (n=%d): %02x != %02x", i, n, buf[8+i], exp);
+		}
+		for (int i=0;i<8;i++)
+			ASSERT(buf[8+n+i] == 0xCC, "rsp_memset overrun at %d (n=%d)", i, n);
+	}
+}
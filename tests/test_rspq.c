@@ -741,6 +741,332 @@ void test_rspq_big_command(TestContext *ctx)
         uint32_t x = i | i << 8 | i << 16 | i << 24;
         expected[i] = x ^ values[i];
     }
-    
+
     ASSERT_EQUAL_MEM((uint8_t*)output, (uint8_t*)expected, 128, "Output does not match!");
 }
+
+void test_rspq_write_bulk(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    // Pre-assemble a batch mixing 1-word and 2-word commands, and enqueue
+    // it many times so that the single capacity check of rspq_write_bulk
+    // also gets exercised across a buffer switch.
+    uint32_t batch[3*16];
+    for (uint32_t i = 0; i < 16; i++) {
+        batch[i*3+0] = RSPQ_CMD_WORD(test_ovl_id, 0x0, 1);
+        batch[i*3+1] = RSPQ_CMD_WORD(test_ovl_id, 0x1, 1);
+        batch[i*3+2] = 0x02000000 | SP_WSTATUS_SET_SIG0;
+    }
+
+    for (uint32_t i = 0; i < 64; i++)
+        rspq_write_bulk(batch, 3*16);
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    rspq_test_output(actual_sum);
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 64*32, "Sum is incorrect!");
+}
+
+void test_rspq_write_reserve(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    // Build 16 2-word commands in place. The first word of the region is
+    // left to rspq_write_commit; fill the rest backwards to verify that the
+    // RSP does not run past an uncommitted region.
+    volatile uint32_t *region = rspq_write_reserve(2*16);
+    for (int i = 15; i > 0; i--) {
+        region[i*2+0] = RSPQ_CMD_WORD(test_ovl_id, 0x1, 1);
+        region[i*2+1] = 0x02000000 | SP_WSTATUS_SET_SIG0;
+    }
+    region[1] = 0x02000000 | SP_WSTATUS_SET_SIG0;
+
+    // Commands enqueued after the region must not execute before the commit.
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+    rspq_test_output(actual_sum);
+    rspq_flush();
+    wait_ms(3);
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 0, "output ran before the region was committed!");
+    data_cache_hit_invalidate(actual_sum, 16);
+
+    rspq_write_commit(region, RSPQ_CMD_WORD(test_ovl_id, 0x1, 1));
+    rspq_test_output(actual_sum);
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 16, "Sum is incorrect!");
+}
+
+void test_rspq_write_const(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    // The command words are assembled on the first iteration and replayed
+    // from the latched copy on all the others; the sum checks that every
+    // iteration enqueued the same, correct command.
+    for (uint32_t i = 0; i < 64; i++)
+        rspq_write_const(test_ovl_id, 0x0, 1);
+
+    for (uint32_t i = 0; i < 64; i++)
+        rspq_write_const(test_ovl_id, 0x1, 1,
+            0x02000000 | SP_WSTATUS_SET_SIG0);
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    rspq_test_output(actual_sum);
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 128, "Sum is incorrect!");
+}
+
+void test_rspq_deferred(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+    timer_init();
+    DEFER(timer_close());
+
+    const uint32_t cmd8[2] = {
+        RSPQ_CMD_WORD(test_ovl_id, 0x1, 1),
+        0x02000000 | SP_WSTATUS_SET_SIG0,
+    };
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    // Deferred commands must stay in the staging buffer until the next
+    // rspq_flush: rspq_wait does not drain them, so the output command
+    // written directly to the queue must not see them yet.
+    ASSERT(rspq_write_deferred(cmd8, 2), "staging buffer is full!");
+    ASSERT(rspq_write_deferred(cmd8, 2), "staging buffer is full!");
+    rspq_test_output(actual_sum);
+    rspq_wait();
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 0, "deferred commands were drained too early!");
+    data_cache_hit_invalidate(actual_sum, 16);
+
+    rspq_flush();
+    rspq_test_output(actual_sum);
+    rspq_wait();
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 2, "deferred commands were not drained!");
+    data_cache_hit_invalidate(actual_sum, 16);
+
+    // Stage from interrupt context. The callback also calls rspq_flush,
+    // which is legal under interrupt but must not drain the staging buffer;
+    // only the flush from the main loop may move the command into the queue.
+    volatile bool fired = false;
+    volatile bool staged = false;
+
+    void timer_cb(int ovfl)
+    {
+        staged = rspq_write_deferred(cmd8, 2);
+        rspq_flush();
+        fired = true;
+    }
+
+    timer_link_t *t = new_timer(TICKS_FROM_MS(2), TF_ONE_SHOT, timer_cb);
+    DEFER(delete_timer(t));
+
+    uint32_t t0 = TICKS_READ();
+    while (!fired && TICKS_DISTANCE(t0, TICKS_READ()) < (int)TICKS_FROM_MS(100)) {}
+    ASSERT(fired, "timer did not fire!");
+    ASSERT(staged, "staging buffer is full!");
+
+    rspq_test_output(actual_sum);
+    rspq_wait();
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 2, "deferred command was drained under interrupt!");
+    data_cache_hit_invalidate(actual_sum, 16);
+
+    rspq_flush();
+    rspq_test_output(actual_sum);
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 3, "Sum is incorrect!");
+}
+
+void test_rspq_block_serialize(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    // Record a block big enough to span multiple chunks, so that the
+    // serializer has to flatten them.
+    rspq_block_begin();
+    for (uint32_t i = 0; i < 512; i++)
+        rspq_test_8(1);
+    rspq_block_t *b512 = rspq_block_end();
+    DEFER(rspq_block_free(b512));
+
+    int size = rspq_block_serialized_size(b512);
+    void *image = memalign(8, size);
+    DEFER(free(image));
+    rspq_block_serialize(b512, image);
+
+    rspq_block_t *b512s = rspq_block_from_serialized(image, size);
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    rspq_test_reset();
+    rspq_block_run(b512s);
+    rspq_test_output(actual_sum);
+    rspq_wait();
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 512, "sum #1 is not correct");
+    data_cache_hit_invalidate(actual_sum, 16);
+
+    // The serialized copy must be independent from the original block.
+    rspq_test_reset();
+    rspq_block_run(b512);
+    rspq_block_run(b512s);
+    rspq_test_output(actual_sum);
+    rspq_wait();
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 1024, "sum #2 is not correct");
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+}
+
+void test_rspq_syncpoint_cb(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    volatile int order[3] = {0};
+    volatile int called = 0;
+
+    void sync_cb(void *arg)
+    {
+        int idx = (int)arg;
+        if (called < 3)
+            order[called] = idx;
+        called++;
+    }
+
+    // Delay the RSP so that the syncpoints are all created before the RSP
+    // reaches them, then check that the callbacks fire in creation order.
+    rspq_test_wait(0x8000);
+    rspq_syncpoint_t s1 = rspq_syncpoint_new_cb(sync_cb, (void*)1);
+    rspq_test_wait(0x8000);
+    rspq_syncpoint_t s2 = rspq_syncpoint_new_cb(sync_cb, (void*)2);
+    rspq_syncpoint_t s3 = rspq_syncpoint_new_cb(sync_cb, (void*)3);
+    rspq_flush();
+
+    rspq_syncpoint_wait(s3);
+    ASSERT(rspq_syncpoint_check(s1), "syncpoint #1 was not reached!");
+    ASSERT(rspq_syncpoint_check(s2), "syncpoint #2 was not reached!");
+
+    ASSERT_EQUAL_SIGNED(called, 3, "callbacks were not invoked exactly once each!");
+    ASSERT_EQUAL_SIGNED(order[0], 1, "callbacks were invoked out of order!");
+    ASSERT_EQUAL_SIGNED(order[1], 2, "callbacks were invoked out of order!");
+    ASSERT_EQUAL_SIGNED(order[2], 3, "callbacks were invoked out of order!");
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+}
+
+void test_rspq_trace(TestContext *ctx)
+{
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    uint32_t capture[64];
+    rspq_trace_start(capture, 64);
+    for (uint32_t i = 0; i < 16; i++)
+        rspq_test_8(1);
+    int nwords = rspq_trace_stop();
+
+    ASSERT_EQUAL_SIGNED(nwords, 32, "unexpected capture length!");
+
+    uint32_t expected[32];
+    for (uint32_t i = 0; i < 16; i++) {
+        expected[i*2+0] = RSPQ_CMD_WORD(test_ovl_id, 0x1, 1);
+        expected[i*2+1] = 0x02000000 | SP_WSTATUS_SET_SIG0;
+    }
+    ASSERT_EQUAL_MEM((uint8_t*)capture, (uint8_t*)expected, 32*4, "captured stream does not match!");
+
+    // Replay the capture on top of the live commands (which are still in
+    // the queue), doubling the sum.
+    rspq_block_t *replay = rspq_trace_to_block(capture, nwords);
+    DEFER(free_uncached(replay));
+    rspq_block_run(replay);
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    rspq_test_output(actual_sum);
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+
+    ASSERT_EQUAL_UNSIGNED(*actual_sum, 32, "Sum is incorrect!");
+}
+
+void test_rspq_highpri_budget(TestContext *ctx)
+{
+    timer_init();
+    DEFER(timer_close());
+    TEST_RSPQ_PROLOG();
+    test_ovl_init();
+    DEFER(test_ovl_close());
+
+    uint64_t actual_sum[2] __attribute__((aligned(16))) = {0};
+    data_cache_hit_writeback_invalidate(actual_sum, 16);
+
+    // Without a budget, sections are counted but never forced to yield.
+    rspq_highpri_reset_stats();
+    for (int i = 0; i < 2; i++) {
+        rspq_highpri_begin();
+            rspq_test_high(1);
+        rspq_highpri_end();
+    }
+    rspq_highpri_sync();
+
+    rspq_highpri_stats_t stats;
+    rspq_highpri_get_stats(&stats);
+    ASSERT_EQUAL_UNSIGNED(stats.sections, 2, "sections count is incorrect!");
+    ASSERT_EQUAL_UNSIGNED(stats.budget_yields, 0, "unexpected forced yield!");
+    ASSERT(stats.occupancy_ticks >= stats.max_occupancy_ticks, "inconsistent occupancy stats!");
+
+    // With a tiny budget slice, back-to-back sections that keep the RSP busy
+    // must be forced to yield at least once; no command may be lost in the
+    // process, and rspq_highpri_sync must release a deferred request.
+    rspq_highpri_reset_stats();
+    rspq_highpri_set_budget(50, 100);
+    for (int i = 0; i < 32; i++) {
+        rspq_highpri_begin();
+            rspq_test_high(1);
+            rspq_test_wait(0x1000);
+        rspq_highpri_end();
+        wait_ticks(TIMER_TICKS(10));
+    }
+    rspq_highpri_sync();
+    rspq_highpri_set_budget(0, 0);
+
+    rspq_highpri_get_stats(&stats);
+    ASSERT_EQUAL_UNSIGNED(stats.sections, 32, "sections count is incorrect!");
+    ASSERT(stats.budget_yields > 0, "budget never forced a yield!");
+
+    rspq_highpri_begin();
+        rspq_test_output(actual_sum);
+    rspq_highpri_end();
+    rspq_highpri_sync();
+
+    ASSERT_EQUAL_UNSIGNED(actual_sum[1], 2+32, "highpri sum is not correct");
+
+    TEST_RSPQ_EPILOG(0, rspq_timeout);
+}
@@ -360,3 +360,91 @@ void test_timer_continuous_short(TestContext *ctx) {
 		ASSERT_EQUAL_SIGNED(cb_called, 50, "invalid number of calls to timer callback");
 	}
 }
+
+void test_timer_wheel_boundary(TestContext *ctx) {
+	timer_init();
+	DEFER(timer_close());
+
+	volatile int called = 0;
+	void cb(int ovlf) { called++; }
+
+	// A timer armed while the wheel clock sits in the last bucket of a
+	// level-1 window gets filed into a level-0 bucket that lies past the
+	// cascade boundary. Regression test: such a timer must still be
+	// scheduled and fire on time (it used to be missed by the wakeup scan
+	// and fire only half a counter wrap later).
+	uint32_t old = write_count(0x3F4000);
+
+	// Fire a short timer first, so that the wheel clock advances into the
+	// last level-0 bucket of the level-1 window (0x3F0000-0x3FFFFF).
+	timer_link_t *t1 = new_timer(0x1000, TF_ONE_SHOT, cb);
+	DEFER(delete_timer(t1));
+	while (!called && TICKS_BEFORE(TICKS_READ(), 0x3F8000)) {}
+	ASSERT_EQUAL_SIGNED(called, 1, "prime timer not called");
+
+	// Now arm a timer whose deadline is less than one level-1 window away,
+	// but past the 0x400000 cascade boundary.
+	called = 0;
+	uint32_t deadline = TICKS_READ() + 0x12000;
+	timer_link_t *t2 = new_timer(0x12000, TF_ONE_SHOT, cb);
+	DEFER(delete_timer(t2));
+	while (!called && TICKS_BEFORE(TICKS_READ(), deadline + 0x8000)) {}
+	write_count(old);
+	ASSERT_EQUAL_SIGNED(called, 1, "boundary-crossing timer not called");
+}
+
+void test_timer_wheel_cascade(TestContext *ctx) {
+	timer_init();
+	DEFER(timer_close());
+
+	volatile int called = 0;
+	void cb(int ovlf) { called++; }
+
+	// A timer more than one level-1 window away is parked in a coarse level
+	// and must be cascaded down when the wheel clock enters its window,
+	// then fire at the right time: neither early (at the cascade itself)
+	// nor late.
+	uint32_t old = write_count(0x3F4000);
+	uint32_t deadline = TICKS_READ() + 0x410000;
+	timer_link_t *t1 = new_timer(0x410000, TF_ONE_SHOT, cb);
+	DEFER(delete_timer(t1));
+	while (TICKS_BEFORE(TICKS_READ(), deadline - 0x8000)) {}
+	ASSERT_EQUAL_SIGNED(called, 0, "cascaded timer fired early");
+	while (!called && TICKS_BEFORE(TICKS_READ(), deadline + 0x8000)) {}
+	write_count(old);
+	ASSERT_EQUAL_SIGNED(called, 1, "cascaded timer not called");
+}
+
+void test_timer_wheel_restart(TestContext *ctx) {
+	timer_init();
+	DEFER(timer_close());
+
+	volatile int called = 0;
+	void cb(int ovlf) { called++; }
+
+	// Restarting a timer that is already linked and pending must move it to
+	// the new deadline: it fires once at the new time, and not at the old one.
+	timer_link_t *t1 = new_timer(TICKS_FROM_MS(5), TF_ONE_SHOT, cb);
+	DEFER(delete_timer(t1));
+	wait_ms(1);
+	start_timer(t1, TICKS_FROM_MS(2), TF_ONE_SHOT, cb);
+	wait_ms(1);
+	ASSERT_EQUAL_SIGNED(called, 0, "restarted timer fired early");
+	wait_ms(2);
+	ASSERT_EQUAL_SIGNED(called, 1, "restarted timer not called");
+	wait_ms(3);
+	ASSERT_EQUAL_SIGNED(called, 1, "restarted timer fired at the old deadline too");
+
+	// Continuous timers relink themselves while the wheel clock is current:
+	// run one with a short period through a level-1 cascade boundary and
+	// check that it keeps firing on the other side.
+	called = 0;
+	uint32_t old = write_count(0x3F4000);
+	timer_link_t *t2 = new_timer(0x4000, TF_CONTINUOUS, cb);
+	DEFER(delete_timer(t2));
+	while (TICKS_BEFORE(TICKS_READ(), 0x3F4000 + 16*0x4000)) {}
+	stop_timer(t2);
+	write_count(old);
+	ASSERT(called >= 14 && called <= 18,
+		"continuous timer stalled across the boundary (%d calls)", called);
+}
@@ -196,8 +196,11 @@ int assert_equal_mem(TestContext *ctx, const char *file, int line, const uint8_t
 #include "test_dfs.c"
 #include "test_eepromfs.c"
 #include "test_cache.c"
+#include "test_mem.c"
+#include "test_bootprof.c"
 #include "test_ticks.c"
 #include "test_timer.c"
+#include "test_profiler.c"
 #include "test_irq.c"
 #include "test_exception.c"
 #include "test_debug.c"
@@ -206,6 +209,7 @@ int assert_equal_mem(TestContext *ctx, const char *file, int line, const uint8_t
 #include "test_constructors.c"
 #include "test_backtrace.c"
 #include "test_rspq.c"
+#include "test_rspmem.c"
 
 /**********************************************************************
  * MAIN
@@ -239,11 +243,20 @@ static const struct Testsuite
 	TEST_FUNC(test_timer_context,            186, TEST_FLAGS_RESET_COUNT),
 	TEST_FUNC(test_timer_disabled_start,     733, TEST_FLAGS_RESET_COUNT),
 	TEST_FUNC(test_timer_disabled_restart,   733, TEST_FLAGS_RESET_COUNT),
+	TEST_FUNC(test_timer_wheel_boundary,       0, TEST_FLAGS_RESET_COUNT | TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_timer_wheel_cascade,        0, TEST_FLAGS_RESET_COUNT | TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_timer_wheel_restart,        0, TEST_FLAGS_RESET_COUNT | TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_profiler,                   0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_irq_reentrancy,           230, TEST_FLAGS_RESET_COUNT),
 	TEST_FUNC(test_dfs_read,                 948, TEST_FLAGS_IO),
 	TEST_FUNC(test_dfs_rom_addr,              25, TEST_FLAGS_IO),
 	TEST_FUNC(test_eepromfs,                   0, TEST_FLAGS_IO),
 	TEST_FUNC(test_cache_invalidate,        1763, TEST_FLAGS_NONE),
+	TEST_FUNC(test_mem_memcpy,                 0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_mem_memset,                 0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_mem_memmove,                0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_mem_bench,                  0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_bootprof,                   0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_debug_sdfs,                 0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_dma_read_misalign,       7003, TEST_FLAGS_NONE),
 	TEST_FUNC(test_cop1_denormalized_float,    0, TEST_FLAGS_NO_BENCHMARK),
@@ -273,6 +286,16 @@ static const struct Testsuite
 	TEST_FUNC(test_rspq_highpri_multiple,      0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rspq_highpri_overlay,       0, TEST_FLAGS_NO_BENCHMARK),
 	TEST_FUNC(test_rspq_big_command,           0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_write_bulk,            0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_write_reserve,         0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_write_const,           0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_deferred,              0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_block_serialize,       0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_syncpoint_cb,          0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_trace,                 0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspq_highpri_budget,        0, TEST_FLAGS_NO_BENCHMARK | TEST_FLAGS_NO_EMULATOR),
+	TEST_FUNC(test_rspmem_memcpy,              0, TEST_FLAGS_NO_BENCHMARK),
+	TEST_FUNC(test_rspmem_memset,              0, TEST_FLAGS_NO_BENCHMARK),
 };
 
 int main() {
@@ -0,0 +1,754 @@
+/*
+ * assetwatch - incremental asset pipeline daemon
+ *
+ * Watches a source directory and keeps a staged asset directory (and,
+ * optionally, a DFS image) up to date with it: when a source file changes,
+ * only that file is reconverted, the image is patched in place with
+ * `mkdfs -i`, and an upload hook is notified with the changed byte ranges,
+ * so an asset edit reaches the hardware in seconds instead of going
+ * through a full `make` of every asset.
+ *
+ * The converters are not linked in: each changed file is matched against a
+ * list of rules (pattern + command template) and the matching command is
+ * spawned, up to -j of them in parallel. Built-in rules cover the
+ * extensions audioconv64 converts on its own (.wav, .xm, .ym); everything
+ * else is copied verbatim into the staged directory. Project-specific
+ * conversions (eg: mksprite, which needs a bit depth) are described in a
+ * rule file:
+ *
+ *     # <pattern> <command>   (%i input, %o staged mirror, %d its directory)
+ *     *.png       mksprite 32 %i %o.sprite
+ *     maps/?*.csv mkasset -c 2 -o %d %i
+ *
+ * Rules are tried in file order before the built-in ones; the pattern is
+ * matched (fnmatch) against the path relative to the source directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* Poll period of the watch loop, in microseconds */
+#define POLL_PERIOD_US      500000
+
+/* One watched source file */
+struct watched_file
+{
+    char *path;             /* Path relative to the source directory */
+    time_t mtime;           /* Last seen modification time */
+    off_t size;             /* Last seen size */
+    int seen;               /* Found by the current scan */
+    int changed;            /* Needs reconversion */
+};
+
+struct watched_file *files = NULL;
+int file_count = 0;
+int file_capacity = 0;
+
+/* One conversion rule */
+struct rule
+{
+    char *pattern;          /* fnmatch pattern, relative to the source dir */
+    char *command;          /* Command template (%i, %o, %d), NULL: copy */
+};
+
+struct rule *rules = NULL;
+int rule_count = 0;
+int rule_capacity = 0;
+
+const char *src_dir = NULL;
+const char *dest_dir = NULL;
+const char *image_file = NULL;
+const char *notify_command = NULL;
+const char *mkdfs_command = "mkdfs";
+int max_jobs = 1;
+
+void print_help(const char * const prog_name)
+{
+    fprintf(stderr, "Usage: %s [options] -s <SrcDir> -d <DestDir>\n", prog_name);
+    fprintf(stderr, "  Watch <SrcDir> and keep the staged asset directory <DestDir> up to date,\n");
+    fprintf(stderr, "  reconverting only the files that changed.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  -r <File>     Read conversion rules from <File>: one rule per line as\n");
+    fprintf(stderr, "                '<pattern> <command>' ('#' starts a comment). The command is\n");
+    fprintf(stderr, "                run with %%i replaced by the source file, %%o by its mirror\n");
+    fprintf(stderr, "                in <DestDir> and %%d by the mirror's directory. Files not\n");
+    fprintf(stderr, "                matching any rule are converted with audioconv64 (.wav, .xm,\n");
+    fprintf(stderr, "                .ym) or copied verbatim.\n");
+    fprintf(stderr, "  -f <File>     After each batch of conversions, patch the DFS image <File>\n");
+    fprintf(stderr, "                in place from <DestDir> (mkdfs -i), rewriting only the byte\n");
+    fprintf(stderr, "                ranges that actually changed.\n");
+    fprintf(stderr, "  -n <Command>  Run <Command> after each image patch, once per changed\n");
+    fprintf(stderr, "                range, with %%f replaced by the image path and %%s/%%e by the\n");
+    fprintf(stderr, "                range start/end. Meant to drive a USB uploader with deltas.\n");
+    fprintf(stderr, "  -j <Jobs>     Run up to <Jobs> conversions in parallel (default 1).\n");
+    fprintf(stderr, "  -m <Path>     Path of the mkdfs executable (default: 'mkdfs' from PATH).\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  On startup every file is converted once to bring <DestDir> in sync; after\n");
+    fprintf(stderr, "  that, only changed files are. Deleting a source file does not delete its\n");
+    fprintf(stderr, "  staged output (the daemon cannot know the name a converter gave it): a\n");
+    fprintf(stderr, "  warning is printed instead.\n");
+}
+
+int rule_add(const char *pattern, const char *command)
+{
+    if(rule_count == rule_capacity)
+    {
+        rule_capacity = rule_capacity ? rule_capacity * 2 : 16;
+        rules = realloc(rules, rule_capacity * sizeof(struct rule));
+
+        if(!rules)
+        {
+            return 0;
+        }
+    }
+
+    rules[rule_count].pattern = strdup(pattern);
+    rules[rule_count].command = command ? strdup(command) : NULL;
+    rule_count++;
+
+    return 1;
+}
+
+/* Read the rule file: one '<pattern> <command>' per line */
+int load_rules(const char * const fn)
+{
+    FILE *fp = fopen(fn, "r");
+
+    if(!fp)
+    {
+        fprintf(stderr, "Cannot open rule file '%s' for read!\n", fn);
+        return 0;
+    }
+
+    char line[4096];
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        char pattern[4096];
+        int cmd_off = 0;
+
+        if(line[0] == '#' || sscanf(line, "%4095s %n", pattern, &cmd_off) != 1)
+        {
+            continue;
+        }
+
+        char *command = line + cmd_off;
+        command[strcspn(command, "\n")] = 0;
+
+        if(!command[0])
+        {
+            fprintf(stderr, "Missing command in rule line: %s\n", line);
+            fclose(fp);
+            return 0;
+        }
+
+        if(!rule_add(pattern, command))
+        {
+            fclose(fp);
+            return 0;
+        }
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+struct watched_file *file_find(const char * const path)
+{
+    for(int i = 0; i < file_count; i++)
+    {
+        if(strcmp(files[i].path, path) == 0)
+        {
+            return &files[i];
+        }
+    }
+
+    return NULL;
+}
+
+int file_add(const char * const path, time_t mtime, off_t size)
+{
+    if(file_count == file_capacity)
+    {
+        file_capacity = file_capacity ? file_capacity * 2 : 256;
+        files = realloc(files, file_capacity * sizeof(struct watched_file));
+
+        if(!files)
+        {
+            return 0;
+        }
+    }
+
+    files[file_count].path = strdup(path);
+    files[file_count].mtime = mtime;
+    files[file_count].size = size;
+    files[file_count].seen = 1;
+    files[file_count].changed = 1;
+    file_count++;
+
+    return 1;
+}
+
+/* Recursively scan (a subdirectory of) the source tree, marking new and
+   modified files as changed. Returns the number of changes found. */
+int scan_directory(const char * const path, const char * const prefix)
+{
+    DIR *dirp = opendir(path);
+    struct dirent *dp;
+    int changes = 0;
+
+    if(!dirp)
+    {
+        return 0;
+    }
+
+    while((dp = readdir(dirp)) != NULL)
+    {
+        if(strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+        {
+            continue;
+        }
+
+        char *file = malloc(strlen(path) + strlen(dp->d_name) + 2);
+        char *rel = malloc(strlen(prefix) + strlen(dp->d_name) + 2);
+        struct stat stats;
+
+        if(!file || !rel)
+        {
+            free(file);
+            free(rel);
+            break;
+        }
+
+        sprintf(file, "%s/%s", path, dp->d_name);
+        sprintf(rel, "%s%s%s", prefix, prefix[0] ? "/" : "", dp->d_name);
+
+        if(stat(file, &stats) == 0)
+        {
+            if(S_ISDIR(stats.st_mode))
+            {
+                changes += scan_directory(file, rel);
+            }
+            else if(S_ISREG(stats.st_mode))
+            {
+                struct watched_file *wf = file_find(rel);
+
+                if(!wf)
+                {
+                    file_add(rel, stats.st_mtime, stats.st_size);
+                    changes++;
+                }
+                else
+                {
+                    wf->seen = 1;
+
+                    if(wf->mtime != stats.st_mtime || wf->size != stats.st_size)
+                    {
+                        wf->mtime = stats.st_mtime;
+                        wf->size = stats.st_size;
+
+                        if(!wf->changed)
+                        {
+                            wf->changed = 1;
+                            changes++;
+                        }
+                    }
+                }
+            }
+        }
+
+        free(file);
+        free(rel);
+    }
+
+    closedir(dirp);
+    return changes;
+}
+
+/* Scan the whole source tree; forget deleted files (with a warning) */
+int scan_sources(void)
+{
+    for(int i = 0; i < file_count; i++)
+    {
+        files[i].seen = 0;
+    }
+
+    int changes = scan_directory(src_dir, "");
+
+    for(int i = 0; i < file_count; i++)
+    {
+        if(!files[i].seen)
+        {
+            fprintf(stderr, "Warning: '%s' was deleted; its staged output is not removed\n",
+                files[i].path);
+
+            free(files[i].path);
+            files[i] = files[--file_count];
+            i--;
+        }
+    }
+
+    return changes;
+}
+
+/* Create every missing directory along a path (the last component is a file) */
+int make_parent_dirs(char *path)
+{
+    for(char *p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/'))
+    {
+        *p = 0;
+
+        if(mkdir(path, 0777) < 0 && errno != EEXIST)
+        {
+            *p = '/';
+            return 0;
+        }
+
+        *p = '/';
+    }
+
+    return 1;
+}
+
+/* Expand a command template, replacing %i, %o and %d */
+char *expand_command(const char * const template, const char * const input,
+    const char * const output)
+{
+    int len = strlen(template) + 1;
+
+    for(const char *p = template; *p; p++)
+    {
+        if(*p == '%')
+        {
+            len += strlen(input) + strlen(output);
+        }
+    }
+
+    char *cmd = malloc(len);
+    char *out = cmd;
+
+    if(!cmd)
+    {
+        return NULL;
+    }
+
+    for(const char *p = template; *p; p++)
+    {
+        if(p[0] == '%' && (p[1] == 'i' || p[1] == 'o' || p[1] == 'd'))
+        {
+            const char *sub = p[1] == 'i' ? input : output;
+            int sub_len = strlen(sub);
+
+            if(p[1] == 'd')
+            {
+                /* Directory of the staged mirror */
+                const char *slash = strrchr(sub, '/');
+                sub_len = slash ? slash - sub : 1;
+                if(!slash) sub = ".";
+            }
+
+            memcpy(out, sub, sub_len);
+            out += sub_len;
+            p++;
+        }
+        else
+        {
+            *out++ = *p;
+        }
+    }
+
+    *out = 0;
+    return cmd;
+}
+
+/* Copy a source file verbatim into the staged directory */
+int copy_file(const char * const input, const char * const output)
+{
+    FILE *in = fopen(input, "rb");
+    FILE *out = in ? fopen(output, "wb") : NULL;
+    char buf[65536];
+    size_t n;
+
+    if(!in || !out)
+    {
+        if(in) fclose(in);
+        fprintf(stderr, "Cannot copy '%s' to '%s'!\n", input, output);
+        return 0;
+    }
+
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+    {
+        fwrite(buf, 1, n, out);
+    }
+
+    fclose(in);
+    fclose(out);
+    return 1;
+}
+
+/* Convert one file: match the rules, spawn the command (or copy).
+   Returns the pid of the spawned command, 0 for an in-process copy,
+   or -1 on failure. */
+pid_t convert_file(const char * const rel)
+{
+    char *input = malloc(strlen(src_dir) + strlen(rel) + 2);
+    char *output = malloc(strlen(dest_dir) + strlen(rel) + 2);
+
+    if(!input || !output)
+    {
+        free(input);
+        free(output);
+        return -1;
+    }
+
+    sprintf(input, "%s/%s", src_dir, rel);
+    sprintf(output, "%s/%s", dest_dir, rel);
+
+    if(!make_parent_dirs(output))
+    {
+        fprintf(stderr, "Cannot create staging directory for '%s'!\n", rel);
+        free(input);
+        free(output);
+        return -1;
+    }
+
+    const char *command = NULL;
+    int matched = 0;
+
+    for(int i = 0; i < rule_count; i++)
+    {
+        if(fnmatch(rules[i].pattern, rel, 0) == 0)
+        {
+            command = rules[i].command;
+            matched = 1;
+            break;
+        }
+    }
+
+    if(!matched || !command)
+    {
+        /* No rule (or an explicit copy rule): stage the file verbatim */
+        int ok = copy_file(input, output);
+
+        free(input);
+        free(output);
+        return ok ? 0 : -1;
+    }
+
+    char *cmd = expand_command(command, input, output);
+
+    free(input);
+    free(output);
+
+    if(!cmd)
+    {
+        return -1;
+    }
+
+    pid_t pid = fork();
+
+    if(pid == 0)
+    {
+        execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+
+    free(cmd);
+    return pid;
+}
+
+/* Convert every changed file, running up to max_jobs commands in parallel.
+   Returns the number of files converted, or -1 if any conversion failed. */
+int convert_changed(void)
+{
+    int converted = 0;
+    int running = 0;
+    int failed = 0;
+
+    for(int i = 0; i < file_count; i++)
+    {
+        if(!files[i].changed)
+        {
+            continue;
+        }
+
+        printf("Converting '%s'\n", files[i].path);
+
+        pid_t pid = convert_file(files[i].path);
+
+        if(pid < 0)
+        {
+            failed = 1;
+        }
+        else if(pid > 0)
+        {
+            running++;
+
+            while(running >= max_jobs)
+            {
+                int status;
+
+                waitpid(-1, &status, 0);
+                running--;
+
+                if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                {
+                    failed = 1;
+                }
+            }
+        }
+
+        /* Converted (or failed: don't retry until the file changes again) */
+        files[i].changed = 0;
+        converted++;
+    }
+
+    while(running > 0)
+    {
+        int status;
+
+        waitpid(-1, &status, 0);
+        running--;
+
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            failed = 1;
+        }
+    }
+
+    if(failed)
+    {
+        fprintf(stderr, "Warning: some conversions failed; fix and re-save the source file\n");
+        return -1;
+    }
+
+    return converted;
+}
+
+/* Run the notify command for one changed image range, replacing %f with
+   the image path and %s/%e with the range start/end */
+void notify_range(const char *start, const char *end)
+{
+    int len = strlen(notify_command) + 1;
+
+    for(const char *p = notify_command; *p; p++)
+    {
+        if(*p == '%')
+        {
+            len += strlen(image_file) + strlen(start) + strlen(end);
+        }
+    }
+
+    char *cmd = malloc(len);
+    char *out = cmd;
+
+    if(!cmd)
+    {
+        return;
+    }
+
+    for(const char *p = notify_command; *p; p++)
+    {
+        if(p[0] == '%' && (p[1] == 'f' || p[1] == 's' || p[1] == 'e'))
+        {
+            const char *sub = p[1] == 'f' ? image_file : p[1] == 's' ? start : end;
+
+            out = stpcpy(out, sub);
+            p++;
+        }
+        else
+        {
+            *out++ = *p;
+        }
+    }
+
+    *out = 0;
+
+    int ret = system(cmd);
+
+    if(ret != 0)
+    {
+        fprintf(stderr, "Warning: notify command failed (%d): %s\n", ret, cmd);
+    }
+
+    free(cmd);
+}
+
+/* Patch the DFS image in place and notify the uploader of every range
+   that mkdfs reports as changed */
+int pack_image(void)
+{
+    int len = strlen(mkdfs_command) + strlen(image_file) + strlen(dest_dir) + 16;
+    char *cmd = malloc(len);
+
+    if(!cmd)
+    {
+        return 0;
+    }
+
+    snprintf(cmd, len, "%s -i '%s' '%s'", mkdfs_command, image_file, dest_dir);
+
+    FILE *fp = popen(cmd, "r");
+
+    free(cmd);
+
+    if(!fp)
+    {
+        fprintf(stderr, "Cannot run mkdfs!\n");
+        return 0;
+    }
+
+    char line[4096];
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        char start[32], end[32];
+
+        fputs(line, stdout);
+
+        if(notify_command && sscanf(line, "CHANGED %31s %31s", start, end) == 2)
+        {
+            notify_range(start, end);
+        }
+    }
+
+    if(pclose(fp) != 0)
+    {
+        fprintf(stderr, "Warning: mkdfs failed; image not updated\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *rule_file = NULL;
+    int argbase = 1;
+
+    while(argbase < argc && argv[argbase][0] == '-')
+    {
+        if(strcmp(argv[argbase], "-s") == 0 && argbase + 1 < argc)
+        {
+            src_dir = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-d") == 0 && argbase + 1 < argc)
+        {
+            dest_dir = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-f") == 0 && argbase + 1 < argc)
+        {
+            image_file = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-n") == 0 && argbase + 1 < argc)
+        {
+            notify_command = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-r") == 0 && argbase + 1 < argc)
+        {
+            rule_file = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-m") == 0 && argbase + 1 < argc)
+        {
+            mkdfs_command = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-j") == 0 && argbase + 1 < argc)
+        {
+            max_jobs = atoi(argv[argbase + 1]);
+
+            if(max_jobs < 1)
+            {
+                fprintf(stderr, "Invalid number of jobs: %s\n", argv[argbase + 1]);
+                return -1;
+            }
+
+            argbase += 2;
+        }
+        else
+        {
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+
+    if(!src_dir || !dest_dir || argbase != argc)
+    {
+        print_help(argv[0]);
+        return -1;
+    }
+
+    if(rule_file && !load_rules(rule_file))
+    {
+        return -1;
+    }
+
+    /* Built-in rules, tried after the rule file ones: the formats that
+       audioconv64 converts on its own. Anything else is copied. */
+    rule_add("*.wav", "audioconv64 -o %d %i");
+    rule_add("*.xm", "audioconv64 -o %d %i");
+    rule_add("*.ym", "audioconv64 -o %d %i");
+
+    if(mkdir(dest_dir, 0777) < 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Cannot create staging directory '%s'!\n", dest_dir);
+        return -1;
+    }
+
+    /* Keep the log readable when redirected to a file or pipe */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    printf("Watching '%s' (staging in '%s')\n", src_dir, dest_dir);
+
+    /* Watch loop: poll for changes, debounce until the tree is stable,
+       then convert the changed files and patch the image. The first
+       iteration converts everything once, to bring the staged directory
+       in sync with the sources. */
+    while(1)
+    {
+        if(scan_sources())
+        {
+            /* Debounce: keep scanning until no new change shows up, so a
+               save of many files (or a slow export) is batched as one */
+            while(1)
+            {
+                usleep(POLL_PERIOD_US);
+
+                if(!scan_sources())
+                {
+                    break;
+                }
+            }
+        }
+
+        int converted = convert_changed();
+
+        if(converted > 0)
+        {
+            if(image_file)
+            {
+                pack_image();
+            }
+
+            printf("Up to date (%d files converted).\n", converted);
+        }
+
+        usleep(POLL_PERIOD_US);
+    }
+
+    return 0;
+}
@@ -7,9 +7,21 @@
 #include <assert.h>
 #include <dirent.h>
 #include <stdlib.h>
+#include <math.h>
 #include <sys/stat.h>
+#ifndef __MINGW32__
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 
 bool flag_verbose = false;
+bool flag_force = false;
+int flag_jobs = 1;
+
+/** Conversions that failed so far (any mode) */
+static int conv_errors = 0;
+/** Worker processes currently in flight (-j) */
+static int conv_running = 0;
 
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 	#define LE32_TO_HOST(i) __builtin_bswap32(i)
@@ -69,13 +81,27 @@ void usage(void) {
 	printf("Global options:\n");
 	printf("   -o / --output <dir>       Specify output directory\n");
 	printf("   -v / --verbose            Verbose mode\n");
+	printf("   -j / --jobs <n>           Convert up to <n> files in parallel (default: 1)\n");
+	printf("   -f / --force              Convert even if the output is up to date\n");
 	printf("\n");
 	printf("WAV options:\n");
 	printf("   --wav-loop <true|false>   Activate playback loop by default\n");
 	printf("   --wav-loop-offset <N>     Set looping offset (in samples; default: 0)\n");
+	printf("   --wav-compress <true|false>  Compress output file (IMA-ADPCM, 4 bits per sample)\n");
+	printf("   --wav-quality <0|1|2>     Compression quality/speed preset: 0=fast (greedy),\n");
+	printf("                             1=balanced, 2=high (exhaustive search; default: 1)\n");
+	printf("   --wav-bank <file>         Pack all WAV inputs into a single bank file,\n");
+	printf("                             instead of converting them individually\n");
+	printf("\n");
+	printf("XM options:\n");
+	printf("   --xm-bank <file>          Extract the samples of all XM inputs into a\n");
+	printf("                             shared bank file, deduplicating waveforms used\n");
+	printf("                             by multiple modules\n");
 	printf("\n");
 	printf("YM options:\n");
 	printf("   --ym-compress <true|false>  Compress output file\n");
+	printf("   --ym-lz4 <true|false>       Output a LZ4 block-compressed file that can\n");
+	printf("                               be seeked and streamed with no decoder state\n");
 	printf("\n");
 }
 
@@ -87,6 +113,69 @@ char* changeext(char* fn, char *ext) {
 	return strdup(buf);
 }
 
+/** True if the output is missing or older than the input */
+bool is_stale(const char *infn, const char *outfn) {
+	struct stat in_st, out_st;
+	if (stat(outfn, &out_st) != 0)
+		return true;
+	if (stat(infn, &in_st) != 0)
+		return true;
+	return in_st.st_mtime >= out_st.st_mtime;
+}
+
+#ifndef __MINGW32__
+/** Wait for one worker process and record its outcome */
+void reap_one(void) {
+	int status;
+	if (wait(&status) > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+		conv_errors++;
+	conv_running--;
+}
+#endif
+
+/** Run one conversion, either in this process or in a worker (-j) */
+void dispatch(int (*fn)(const char*, const char*), const char *infn, const char *outfn) {
+	if (!flag_force && !is_stale(infn, outfn)) {
+		if (flag_verbose)
+			fprintf(stderr, "Skipping: %s (up to date)\n", outfn);
+		return;
+	}
+
+#ifndef __MINGW32__
+	if (flag_jobs > 1) {
+		// Each conversion runs in its own process: the converters are
+		// independent per file, and forking at dispatch time means the
+		// child inherits exactly the per-file flags in effect now.
+		if (conv_running == flag_jobs)
+			reap_one();
+		pid_t pid = fork();
+		if (pid == 0)
+			exit(fn(infn, outfn));
+		if (pid > 0) {
+			conv_running++;
+			return;
+		}
+		perror("fork");
+		// Fall through to a synchronous conversion
+	}
+#endif
+
+	if (fn(infn, outfn) != 0)
+		conv_errors++;
+}
+
+/** Output file of the WAV bank (--wav-bank), or NULL */
+char *flag_wav_bank = NULL;
+/** WAV files queued for bank packing, in command-line order */
+static wav_bank_entry_t *bank_entries = NULL;
+static int bank_num_entries = 0;
+
+/** Output file of the XM sample bank (--xm-bank), or NULL */
+char *flag_xm_bank = NULL;
+/** XM files queued for shared bank conversion, in command-line order */
+static xm_bank_entry_t *xm_bank_entries = NULL;
+static int xm_bank_num_entries = 0;
+
 void convert(char *infn, char *outfn1) {
 	char *ext = strrchr(infn, '.');
 	if (!ext) {
@@ -95,16 +184,40 @@ void convert(char *infn, char *outfn1) {
 	}
 
 	if (strcmp(ext, ".wav") == 0 || strcmp(ext, ".WAV") == 0) {
+		if (flag_wav_bank) {
+			// Just queue the file: the bank is written in one go at the end,
+			// when the number of waveforms is known. Snapshot the WAV flags
+			// so that per-file flags keep working like in individual mode.
+			bank_entries = realloc(bank_entries, (bank_num_entries+1) * sizeof(wav_bank_entry_t));
+			bank_entries[bank_num_entries++] = (wav_bank_entry_t){
+				.fn = strdup(infn),
+				.looping = flag_wav_looping,
+				.looping_offset = flag_wav_looping_offset,
+				.compress = flag_wav_compress,
+				.quality = flag_wav_compress_quality,
+			};
+			return;
+		}
 		char *outfn = changeext(outfn1, ".wav64");
-		wav_convert(infn, outfn);
+		dispatch(wav_convert, infn, outfn);
 		free(outfn);
 	} else if (strcmp(ext, ".xm") == 0 || strcmp(ext, ".XM") == 0) {
 		char *outfn = changeext(outfn1, ".xm64");
-		xm_convert(infn, outfn);
+		if (flag_xm_bank) {
+			// Just queue the file: modules sharing a bank reference it by
+			// offset, so they are all converted together at the end.
+			xm_bank_entries = realloc(xm_bank_entries, (xm_bank_num_entries+1) * sizeof(xm_bank_entry_t));
+			xm_bank_entries[xm_bank_num_entries++] = (xm_bank_entry_t){
+				.fn = strdup(infn),
+				.outfn = outfn,
+			};
+			return;
+		}
+		dispatch(xm_convert, infn, outfn);
 		free(outfn);
 	} else if (strcmp(ext, ".ym") == 0 || strcmp(ext, ".YM") == 0) {
 		char *outfn = changeext(outfn1, ".ym64");
-		ym_convert(infn, outfn);
+		dispatch(ym_convert, infn, outfn);
 		free(outfn);
 	} else {
 		fprintf(stderr, "WARNING: ignoring unknown file: %s\n", infn);
@@ -188,6 +301,24 @@ int main(int argc, char *argv[]) {
 		if (argv[i][0] == '-') {	
 			if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
 				flag_verbose = true;
+			} else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--force")) {
+				flag_force = true;
+			} else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for -j/--jobs\n");
+					return 1;
+				}
+				char extra;
+				if (sscanf(argv[i], "%d%c", &flag_jobs, &extra) != 1 || flag_jobs <= 0) {
+					fprintf(stderr, "invalid argument for -j/--jobs: %s\n", argv[i]);
+					return 1;
+				}
+				#ifdef __MINGW32__
+				if (flag_jobs > 1) {
+					fprintf(stderr, "WARNING: -j is not supported on this platform, converting serially\n");
+					flag_jobs = 1;
+				}
+				#endif
 			} else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
 				if (++i == argc) {
 					fprintf(stderr, "missing argument for -o/--output\n");
@@ -218,6 +349,42 @@ int main(int argc, char *argv[]) {
 					return 1;
 				}
 				flag_wav_looping = true;
+			} else if (!strcmp(argv[i], "--wav-compress")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for --wav-compress\n");
+					return 1;
+				}
+				if (!strcmp(argv[i], "true") || !strcmp(argv[i], "1"))
+					flag_wav_compress = true;
+				else if (!strcmp(argv[i], "false") || !strcmp(argv[i], "0"))
+					flag_wav_compress = false;
+				else {
+					fprintf(stderr, "invalid boolean argument for --wav-compress: %s\n", argv[i]);
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--wav-quality")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for --wav-quality\n");
+					return 1;
+				}
+				char extra;
+				if (sscanf(argv[i], "%d%c", &flag_wav_compress_quality, &extra) != 1
+						|| flag_wav_compress_quality < 0 || flag_wav_compress_quality > 2) {
+					fprintf(stderr, "invalid argument for --wav-quality: %s\n", argv[i]);
+					return 1;
+				}
+			} else if (!strcmp(argv[i], "--wav-bank")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for --wav-bank\n");
+					return 1;
+				}
+				flag_wav_bank = argv[i];
+			} else if (!strcmp(argv[i], "--xm-bank")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for --xm-bank\n");
+					return 1;
+				}
+				flag_xm_bank = argv[i];
 			} else if (!strcmp(argv[i], "--ym-compress")) {
 				if (++i == argc) {
 					fprintf(stderr, "missing argument for --ym-compress\n");
@@ -231,6 +398,19 @@ int main(int argc, char *argv[]) {
 					fprintf(stderr, "invalid boolean argument for --ym-compress: %s\n", argv[i]);
 					return 1;
 				}
+			} else if (!strcmp(argv[i], "--ym-lz4")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for --ym-lz4\n");
+					return 1;
+				}
+				if (!strcmp(argv[i], "true") || !strcmp(argv[i], "1"))
+					flag_ym_lz4 = true;
+				else if (!strcmp(argv[i], "false") || !strcmp(argv[i], "0"))
+					flag_ym_lz4 = false;
+				else {
+					fprintf(stderr, "invalid boolean argument for --ym-lz4: %s\n", argv[i]);
+					return 1;
+				}
 			} else {
 				fprintf(stderr, "invalid option: %s\n", argv[i]);
 				return 1;
@@ -245,5 +425,38 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	return 0;
+#ifndef __MINGW32__
+	while (conv_running > 0)
+		reap_one();
+#endif
+
+	if (flag_wav_bank && bank_num_entries > 0) {
+		// The bank is up to date only if it is newer than all its inputs.
+		bool stale = flag_force;
+		for (int j=0; j<bank_num_entries && !stale; j++)
+			stale = is_stale(bank_entries[j].fn, flag_wav_bank);
+		if (stale) {
+			if (wav_bank_convert(bank_entries, bank_num_entries, flag_wav_bank) != 0)
+				conv_errors++;
+		} else if (flag_verbose) {
+			fprintf(stderr, "Skipping: %s (up to date)\n", flag_wav_bank);
+		}
+	}
+
+	if (flag_xm_bank && xm_bank_num_entries > 0) {
+		// The modules reference the bank by offset, so if anything is out of
+		// date, the whole set is reconverted together.
+		bool stale = flag_force;
+		for (int j=0; j<xm_bank_num_entries && !stale; j++)
+			stale = is_stale(xm_bank_entries[j].fn, flag_xm_bank)
+			     || is_stale(xm_bank_entries[j].fn, xm_bank_entries[j].outfn);
+		if (stale) {
+			if (xm_bank_convert(xm_bank_entries, xm_bank_num_entries, flag_xm_bank) != 0)
+				conv_errors++;
+		} else if (flag_verbose) {
+			fprintf(stderr, "Skipping: %s (up to date)\n", flag_xm_bank);
+		}
+	}
+
+	return conv_errors ? 1 : 0;
 }
@@ -5,8 +5,76 @@
 
 bool flag_wav_looping = false;
 int flag_wav_looping_offset = 0;
+bool flag_wav_compress = false;
+int flag_wav_compress_quality = 1;
 
-int wav_convert(const char *infn, const char *outfn) {
+/**
+ * Encode one sample as an IMA-ADPCM nibble, updating the encoder state.
+ * The state update goes through the shared decoder step so that the
+ * encoder tracks exactly what the player will reconstruct.
+ */
+static int ima_encode_sample(int16_t *predictor, int *step_index, int sample) {
+	int step = ima_step_table[*step_index];
+	int diff = sample - *predictor;
+	int nib = 0;
+	if (diff < 0) { nib = 8; diff = -diff; }
+	if (diff >= step)      { nib |= 4; diff -= step; }
+	if (diff >= step >> 1) { nib |= 2; diff -= step >> 1; }
+	if (diff >= step >> 2) { nib |= 1; }
+	ima_decode_nibble(predictor, step_index, nib);
+	return nib;
+}
+
+/**
+ * Encode one block of one channel from a given starting state, writing the
+ * nibbles into a caller-zeroed buffer and updating the state in place.
+ * Returns the summed squared error over the first @p valid samples, so it
+ * can be used both to emit the final nibbles and to compare candidate
+ * per-block starting states.
+ *
+ * With quality 2, each nibble is chosen by trying all 16 candidates and
+ * keeping the one whose reconstruction lands closest to the source sample
+ * (this accounts for clamping, which the fast quantizer ignores).
+ */
+static int64_t ima_encode_block_ch(const int16_t *src, int n, int valid,
+		int16_t *predictor, int *step_index, uint8_t *nibbles, int quality) {
+	int64_t err = 0;
+	for (int i=0; i<n; i++) {
+		int s = src[i];
+		int nib;
+		if (quality >= 2) {
+			int64_t best = INT64_MAX;
+			int16_t best_pred = 0;
+			int best_step = 0;
+			nib = 0;
+			for (int c=0; c<16; c++) {
+				int16_t p = *predictor; int si = *step_index;
+				int r = ima_decode_nibble(&p, &si, c);
+				int64_t e = (int64_t)(r - s) * (r - s);
+				if (e < best) { best = e; nib = c; best_pred = p; best_step = si; }
+			}
+			*predictor = best_pred; *step_index = best_step;
+		} else {
+			nib = ima_encode_sample(predictor, step_index, s);
+		}
+		if (i < valid) {
+			int64_t d = *predictor - s;
+			err += d*d;
+		}
+		nibbles[i/2] |= nib << ((i&1)*4);
+	}
+	return err;
+}
+
+/**
+ * Parse one WAV file and write its converted sample data at the current
+ * position of @p out, filling @p head with the (big-endian) wav64 header.
+ * head->start_offset is the data position relative to the start of the file,
+ * so the same writer serves both standalone files (data right after the
+ * header) and banks (data after the shared table). @p outfn is only used
+ * for messages.
+ */
+static int wav_write_data(const char *infn, const char *outfn, FILE *out, wav64_header_t *head) {
 	drwav wav;
 	if (!drwav_init_file(&wav, infn, NULL)) {
 		// Check if it's a RIFX file. This is a big-endian variant of WAV
@@ -38,14 +106,40 @@ int wav_convert(const char *infn, const char *outfn) {
 		fprintf(stderr, "WARNING: %s: %llu frames found, but only %zu decoded\n", infn, wav.totalPCMFrameCount, cnt);
 	}
 
+	if (flag_wav_compress && wav.channels > 2) {
+		fprintf(stderr, "ERROR: %s: compression supports mono/stereo files only (%d channels found)\n", infn, wav.channels);
+		free(samples);
+		drwav_uninit(&wav);
+		return 1;
+	}
+
 	// Keep 8 bits file if original is 8 bit, otherwise expand to 16 bit.
-	int nbits = wav.bitsPerSample == 8 ? 8 : 16;
+	// Compressed files always decode to 16 bit.
+	int nbits = wav.bitsPerSample == 8 && !flag_wav_compress ? 8 : 16;
 
 	int loop_len = flag_wav_looping ? cnt - flag_wav_looping_offset : 0;
 	if (loop_len < 0) {
 		fprintf(stderr, "WARNING: %s: invalid looping offset: %d (size: %zu)\n", infn, flag_wav_looping_offset, cnt);
 		loop_len = 0;
 	}
+	if (flag_wav_compress && loop_len > 0) {
+		// The ADPCM decoder can only restart from a block header, so the loop
+		// start must fall on a block boundary for the loop to be sample-exact.
+		// Shorten the loop (moving its start later) until it is aligned, like
+		// the odd-length adjustment for 8-bit files below.
+		int loop_start = cnt - loop_len;
+		int aligned = (loop_start + WAV64_IMA_BLOCK_SAMPLES - 1)
+			/ WAV64_IMA_BLOCK_SAMPLES * WAV64_IMA_BLOCK_SAMPLES;
+		if (aligned != loop_start) {
+			fprintf(stderr, "WARNING: %s: loop start moved from %d to %d to align it to an ADPCM block\n",
+				infn, loop_start, aligned);
+			loop_len = cnt - aligned;
+			if (loop_len <= 0) {
+				fprintf(stderr, "WARNING: %s: loop too short for ADPCM block alignment, loop removed\n", infn);
+				loop_len = 0;
+			}
+		}
+	}
 	if (loop_len&1 && nbits==8) {
 		// Odd loop lengths are not supported for 8-bit waveforms because they would
 		// change the 2-byte phase between ROM and RDRAM addresses during loop unrolling.
@@ -54,63 +148,232 @@ int wav_convert(const char *infn, const char *outfn) {
 		loop_len -= 1;
 	}
 
-	wav64_header_t head;
-	memset(&head, 0, sizeof(wav64_header_t));
+	memset(head, 0, sizeof(wav64_header_t));
 
-	memcpy(head.id, "WV64", 4);
-	head.version = WAV64_FILE_VERSION;
-	head.format = 0;
-	head.channels = wav.channels;
-	head.nbits = nbits;
-	head.freq = HOST_TO_BE32(wav.sampleRate);
-	head.len = HOST_TO_BE32(cnt);
-	head.loop_len = HOST_TO_BE32(loop_len);
-	head.start_offset = HOST_TO_BE32(sizeof(wav64_header_t));
+	memcpy(head->id, "WV64", 4);
+	head->version = WAV64_FILE_VERSION;
+	head->format = flag_wav_compress ? WAV64_FORMAT_IMA_ADPCM : WAV64_FORMAT_RAW;
+	head->channels = wav.channels;
+	head->nbits = nbits;
+	head->freq = HOST_TO_BE32(wav.sampleRate);
+	head->len = HOST_TO_BE32(cnt);
+	head->loop_len = HOST_TO_BE32(loop_len);
+	head->start_offset = HOST_TO_BE32(ftell(out));
 
 	if (flag_verbose)
 		fprintf(stderr, "Converting: %s => %s\n", infn, outfn);
 
+	if (!flag_wav_compress) {
+		int16_t *sptr = samples;
+		for (int i=0;i<cnt*wav.channels;i++) {
+			// Write the sample as 16bit or 8bit. Since *sptr is 16-bit big-endian,
+			// the 8bit representation is just the first byte (MSB). Notice
+			// that WAV64 8bit is signed anyway.
+			fwrite(sptr, 1, nbits == 8 ? 1 : 2, out);
+			sptr++;
+		}
+
+		// Amount of data that can be overread by the player.
+		const int OVERREAD_BYTES = 64;
+		if (loop_len == 0) {
+			for (int i=0;i<OVERREAD_BYTES;i++)
+				fputc(0, out);
+		} else {
+			int idx = cnt - loop_len;
+			int nb = 0;
+			while (nb < OVERREAD_BYTES) {
+				int16_t *sptr = samples + idx*wav.channels;
+				for (int ch=0;ch<wav.channels;ch++) {
+					nb += fwrite(sptr, 1, nbits==8 ? 1 : 2, out);
+					sptr++;
+				}
+				idx++;
+				if (idx == cnt)
+					idx -= loop_len;
+			}
+		}
+	} else {
+		// Encode the samples as IMA-ADPCM, one fixed-size block at a time.
+		// Each block header stores a starting state snapshot so that the
+		// player can start decoding at any block boundary (needed for
+		// seeking and loop unrolling). The last block is padded by repeating
+		// the final sample. No overread area is written: the player
+		// synthesizes it while decoding.
+		//
+		// Since the header makes each block self-contained, the encoder is
+		// free to pick the starting state: with quality >= 1 the predictor
+		// is anchored to the true source sample preceding the block, and the
+		// step index is searched (a window around the previous block's end
+		// index at quality 1, exhaustively at quality 2) keeping the
+		// candidate with the smallest squared error.
+		int nblocks = (cnt + WAV64_IMA_BLOCK_SAMPLES - 1) / WAV64_IMA_BLOCK_SAMPLES;
+		int16_t predictor[2] = {0, 0};
+		int step_index[2] = {0, 0};
+		int64_t noise = 0, signal = 0;
+		for (int b=0; b<nblocks; b++) {
+			int16_t blk[2][WAV64_IMA_BLOCK_SAMPLES];
+			int16_t start_pred[2];
+			int start_step[2];
+			uint8_t data[2][WAV64_IMA_BLOCK_SAMPLES/2];
+			int valid = cnt - (size_t)b*WAV64_IMA_BLOCK_SAMPLES;
+			if (valid > WAV64_IMA_BLOCK_SAMPLES) valid = WAV64_IMA_BLOCK_SAMPLES;
+
+			for (int ch=0; ch<wav.channels; ch++) {
+				for (int i=0; i<WAV64_IMA_BLOCK_SAMPLES; i++) {
+					size_t idx = (size_t)b*WAV64_IMA_BLOCK_SAMPLES + i;
+					if (idx >= cnt) idx = cnt-1;
+					blk[ch][i] = (int16_t)BE16_TO_HOST(samples[idx*wav.channels + ch]);
+					if (i < valid) signal += (int64_t)blk[ch][i] * blk[ch][i];
+				}
+
+				if (flag_wav_compress_quality == 0) {
+					// Fast: state just runs through from the previous block
+					start_pred[ch] = predictor[ch];
+					start_step[ch] = step_index[ch];
+					memset(data[ch], 0, sizeof(data[ch]));
+					noise += ima_encode_block_ch(blk[ch], WAV64_IMA_BLOCK_SAMPLES, valid,
+						&predictor[ch], &step_index[ch], data[ch], 0);
+					continue;
+				}
+
+				// Anchor the predictor to the true sample preceding the block
+				size_t pidx = b ? (size_t)b*WAV64_IMA_BLOCK_SAMPLES - 1 : 0;
+				start_pred[ch] = (int16_t)BE16_TO_HOST(samples[pidx*wav.channels + ch]);
+
+				int lo = 0, hi = 88;
+				if (flag_wav_compress_quality == 1) {
+					lo = step_index[ch] - 6; if (lo < 0) lo = 0;
+					hi = step_index[ch] + 6; if (hi > 88) hi = 88;
+				}
+
+				int64_t best_err = INT64_MAX;
+				for (int si=lo; si<=hi; si++) {
+					int16_t p = start_pred[ch];
+					int s = si;
+					uint8_t try_data[WAV64_IMA_BLOCK_SAMPLES/2] = {0};
+					int64_t err = ima_encode_block_ch(blk[ch], WAV64_IMA_BLOCK_SAMPLES, valid,
+						&p, &s, try_data, flag_wav_compress_quality);
+					if (err < best_err) {
+						best_err = err;
+						start_step[ch] = si;
+						predictor[ch] = p;
+						step_index[ch] = s;
+						memcpy(data[ch], try_data, sizeof(try_data));
+					}
+				}
+				noise += best_err;
+			}
+
+			for (int ch=0; ch<wav.channels; ch++) {
+				fputc((uint16_t)start_pred[ch] >> 8, out);
+				fputc((uint16_t)start_pred[ch] & 0xFF, out);
+				fputc(start_step[ch], out);
+				fputc(0, out);
+			}
+			for (int ch=0; ch<wav.channels; ch++)
+				fwrite(data[ch], 1, WAV64_IMA_BLOCK_SAMPLES/2, out);
+		}
+
+		int64_t pcm_size = (int64_t)cnt * wav.channels * 2;
+		int64_t adpcm_size = (int64_t)nblocks * WAV64_IMA_BLOCK_SIZE(wav.channels);
+		fprintf(stderr, "%s: IMA-ADPCM (quality %d): %lld => %lld bytes (%.2f:1), SNR %.1f dB\n",
+			outfn, flag_wav_compress_quality,
+			(long long)pcm_size, (long long)adpcm_size,
+			(double)pcm_size / adpcm_size,
+			noise ? 10.0 * log10((double)signal / noise) : 99.0);
+	}
+
+	free(samples);
+	drwav_uninit(&wav);
+	return 0;
+}
+
+int wav_convert(const char *infn, const char *outfn) {
 	FILE *out = fopen(outfn, "wb");
 	if (!out) {
 		fprintf(stderr, "ERROR: %s: cannot create file\n", outfn);
-		free(samples);
-		drwav_uninit(&wav);
 		return 1;
 	}
 
+	// Reserve space for the header; it is rewritten once the data writer
+	// has filled it in.
+	wav64_header_t head;
+	memset(&head, 0, sizeof(wav64_header_t));
 	fwrite(&head, 1, sizeof(wav64_header_t), out);
 
-	int16_t *sptr = samples;
-	for (int i=0;i<cnt*wav.channels;i++) {
-		// Write the sample as 16bit or 8bit. Since *sptr is 16-bit big-endian,
-		// the 8bit representation is just the first byte (MSB). Notice
-		// that WAV64 8bit is signed anyway.
-		fwrite(sptr, 1, nbits == 8 ? 1 : 2, out);
-		sptr++;
+	if (wav_write_data(infn, outfn, out, &head)) {
+		fclose(out);
+		remove(outfn);
+		return 1;
 	}
 
-	// Amount of data that can be overread by the player.
-	const int OVERREAD_BYTES = 64;
-	if (loop_len == 0) {
-		for (int i=0;i<OVERREAD_BYTES;i++)
+	fseek(out, 0, SEEK_SET);
+	fwrite(&head, 1, sizeof(wav64_header_t), out);
+	fclose(out);
+	return 0;
+}
+
+/** One WAV file queued for bank packing, with the WAV flags in effect at
+ *  the point it appeared on the command line. */
+typedef struct {
+	char *fn;               ///< Input WAV file
+	bool looping;           ///< flag_wav_looping snapshot
+	int looping_offset;     ///< flag_wav_looping_offset snapshot
+	bool compress;          ///< flag_wav_compress snapshot
+	int quality;            ///< flag_wav_compress_quality snapshot
+} wav_bank_entry_t;
+
+/**
+ * Pack multiple WAV files into a single wav64 bank (--wav-bank): a
+ * #wav64_bank_header_t, a table with one #wav64_header_t per waveform, then
+ * the sample data of all waveforms. Table offsets are relative to the start
+ * of the bank file, and waveforms are indexed in command-line order.
+ */
+int wav_bank_convert(wav_bank_entry_t *entries, int num, const char *outfn) {
+	FILE *out = fopen(outfn, "wb");
+	if (!out) {
+		fprintf(stderr, "ERROR: %s: cannot create file\n", outfn);
+		return 1;
+	}
+
+	wav64_bank_header_t bhead;
+	memset(&bhead, 0, sizeof(bhead));
+	memcpy(bhead.id, WAV64_BANK_ID, 4);
+	bhead.version = WAV64_BANK_VERSION;
+	bhead.num_waves = HOST_TO_BE32(num);
+	fwrite(&bhead, 1, sizeof(bhead), out);
+
+	// Reserve space for the table; it is rewritten at the end, when all
+	// data offsets are known.
+	wav64_header_t *heads = calloc(num, sizeof(wav64_header_t));
+	fwrite(heads, sizeof(wav64_header_t), num, out);
+
+	int errors = 0;
+	for (int i=0; i<num; i++) {
+		flag_wav_looping = entries[i].looping;
+		flag_wav_looping_offset = entries[i].looping_offset;
+		flag_wav_compress = entries[i].compress;
+		flag_wav_compress_quality = entries[i].quality;
+
+		// Keep every waveform on an even offset, so that the 2-byte ROM/RDRAM
+		// phase guarantee of dma_read holds for all of them.
+		if (ftell(out) & 1)
 			fputc(0, out);
-	} else {
-		int idx = cnt - loop_len;
-		int nb = 0;
-		while (nb < OVERREAD_BYTES) {
-			int16_t *sptr = samples + idx*wav.channels;
-			for (int ch=0;ch<wav.channels;ch++) {
-				nb += fwrite(sptr, 1, nbits==8 ? 1 : 2, out);
-				sptr++;
-			}
-			idx++;
-			if (idx == cnt)
-				idx -= loop_len;
-		}
+		if (wav_write_data(entries[i].fn, outfn, out, &heads[i]))
+			errors++;
 	}
 
+	long total = ftell(out);
+	fseek(out, sizeof(bhead), SEEK_SET);
+	fwrite(heads, sizeof(wav64_header_t), num, out);
 	fclose(out);
-	free(samples);
-	drwav_uninit(&wav);
+	free(heads);
+
+	if (errors) {
+		remove(outfn);
+		return 1;
+	}
+	if (flag_verbose)
+		fprintf(stderr, "Bank: %s (%d waveforms, %ld bytes)\n", outfn, num, total);
 	return 0;
 }
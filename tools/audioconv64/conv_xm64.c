@@ -30,6 +30,80 @@
 #include "../../src/audio/libxm/context.c"
 #include "../../src/audio/libxm/load.c"
 
+/** One XM file queued for shared bank extraction (--xm-bank) */
+typedef struct {
+	char *fn;               ///< Input XM file
+	char *outfn;            ///< Output XM64 file
+} xm_bank_entry_t;
+
+/** Shared sample bank under construction (--xm-bank). The image is the
+ *  exact XB64 file contents: an 8-byte header followed by the waveform
+ *  data, so the recorded offsets are file offsets. */
+static struct {
+	bool active;            ///< Bank mode enabled for this conversion batch
+	uint8_t *data;          ///< Bank file image (header + waveform data)
+	uint32_t size, cap;     ///< Used / allocated size of the image
+	uint64_t *hashes;       ///< Content hash of each waveform (FNV-1a)
+	uint32_t *offsets;      ///< File offset of each waveform
+	uint32_t *lengths;      ///< Length in bytes of each waveform
+	int num, num_cap;       ///< Number of distinct waveforms in the bank
+} xm_bank;
+
+/**
+ * Append a preprocessed waveform to the shared bank, deduplicating by
+ * content: a drum kit used by three modules is stored once and all three
+ * reference the same offset. Data is stored in the same (big-endian)
+ * layout as a module's WAVE section, so the N64 streams it from the bank
+ * exactly like it would from the module file.
+ */
+static uint32_t xm_bank_add(xm_sample_t *s) {
+	uint32_t len = s->length * (s->bits / 8) + XM_WAVEFORM_OVERREAD;
+	uint8_t *buf = malloc(len);
+	if (s->bits == 8)
+		memcpy(buf, s->data8, len);
+	else {
+		for (int k=0;k<s->length+XM_WAVEFORM_OVERREAD/2;k++) {
+			buf[k*2+0] = ((uint16_t)s->data16[k]) >> 8;
+			buf[k*2+1] = ((uint16_t)s->data16[k]) & 0xFF;
+		}
+	}
+
+	// FNV-1a content hash; matches are confirmed with a full memcmp
+	uint64_t h = 14695981039346656037ull;
+	for (uint32_t k=0;k<len;k++) { h ^= buf[k]; h *= 1099511628211ull; }
+
+	for (int k=0;k<xm_bank.num;k++) {
+		if (xm_bank.hashes[k] == h && xm_bank.lengths[k] == len &&
+		    memcmp(xm_bank.data + xm_bank.offsets[k], buf, len) == 0) {
+			free(buf);
+			return xm_bank.offsets[k];
+		}
+	}
+
+	// New waveform: append it 8-aligned (required alignment for waveforms)
+	uint32_t off = (xm_bank.size + 7) & ~7u;
+	while (off + len > xm_bank.cap) {
+		xm_bank.cap *= 2;
+		xm_bank.data = realloc(xm_bank.data, xm_bank.cap);
+	}
+	memset(xm_bank.data + xm_bank.size, 0, off - xm_bank.size);
+	memcpy(xm_bank.data + off, buf, len);
+	xm_bank.size = off + len;
+	free(buf);
+
+	if (xm_bank.num == xm_bank.num_cap) {
+		xm_bank.num_cap = xm_bank.num_cap ? xm_bank.num_cap*2 : 256;
+		xm_bank.hashes = realloc(xm_bank.hashes, xm_bank.num_cap * sizeof(uint64_t));
+		xm_bank.offsets = realloc(xm_bank.offsets, xm_bank.num_cap * sizeof(uint32_t));
+		xm_bank.lengths = realloc(xm_bank.lengths, xm_bank.num_cap * sizeof(uint32_t));
+	}
+	xm_bank.hashes[xm_bank.num] = h;
+	xm_bank.offsets[xm_bank.num] = off;
+	xm_bank.lengths[xm_bank.num] = len;
+	xm_bank.num++;
+	return off;
+}
+
 int xm_convert(const char *infn, const char *outfn) {
 	if (flag_verbose)
 		fprintf(stderr, "Converting: %s => %s\n", infn, outfn);
@@ -199,12 +273,32 @@ int xm_convert(const char *infn, const char *outfn) {
 		sam_size += ch_buf[i];
 	}
 
+	// In bank mode (--xm-bank), move all waveforms into the shared bank:
+	// the module then stores references instead of embedding the data.
+	uint32_t *bank_offsets = NULL;
+	if (xm_bank.active) {
+		int totsamples = 0;
+		for (int i=0;i<ctx->module.num_instruments;i++)
+			totsamples += ctx->module.instruments[i].num_samples;
+		bank_offsets = malloc(totsamples * sizeof(uint32_t));
+		int idx = 0;
+		for (int i=0;i<ctx->module.num_instruments;i++) {
+			xm_instrument_t *ins = &ctx->module.instruments[i];
+			for (int j=0;j<ins->num_samples;j++)
+				bank_offsets[idx++] = xm_bank_add(&ins->samples[j]);
+		}
+		xm_save_sample_bank_offsets = bank_offsets;
+	}
+
 	FILE *out = fopen(outfn, "wb");
 	if (!out) fatal("cannot create: %s", outfn);
 	xm_context_save(ctx, out);
 	int romsize = ftell(out);
 	fclose(out);
 
+	xm_save_sample_bank_offsets = NULL;
+	free(bank_offsets);
+
 	// Dump some statistics for the conversion
 	if (flag_verbose) {	
 		fprintf(stderr, "  * ROM size: %u KiB (samples:%zu)\n",
@@ -231,9 +325,60 @@ int xm_convert(const char *infn, const char *outfn) {
 	xm_context_t *ctx2;
 	out = fopen(outfn, "rb");
 	if (!out) fatal("cannot open: %s", outfn);
+	// Re-register the bank image at every reload: appends from previous
+	// conversions may have moved it with realloc.
+	if (xm_bank.active)
+		xm_set_sample_bank(xm_bank.data, xm_bank.size);
 	int ret = xm_context_load(&ctx2, out, 48000);
 	if (ret != 0) fatal("internal error: loading just created module: %s (ret:%d)", outfn, ret);
+	if (xm_bank.active)
+		xm_set_sample_bank(NULL, 0);
 	fclose(out);
 
 	return 0;
 }
+
+/**
+ * Convert multiple XM files against a shared sample bank (--xm-bank): each
+ * module is written as a regular XM64, but all waveforms are extracted
+ * (deduplicated by content) into a single XB64 bank file, which must be
+ * opened at runtime with xm64_sample_bank_open() before opening the modules.
+ * Modules reference the bank by offset, so the whole set is always
+ * reconverted together to keep the references consistent.
+ */
+int xm_bank_convert(xm_bank_entry_t *entries, int num, const char *outfn) {
+	xm_bank.active = true;
+	xm_bank.cap = 1024*1024;
+	xm_bank.data = malloc(xm_bank.cap);
+	memcpy(xm_bank.data, "XB64", 4);
+	xm_bank.data[4] = 1;  // version
+	memset(xm_bank.data+5, 0, 3);
+	xm_bank.size = 8;
+
+	int errors = 0;
+	for (int i=0; i<num; i++) {
+		if (xm_convert(entries[i].fn, entries[i].outfn) != 0)
+			errors++;
+	}
+
+	if (!errors) {
+		FILE *out = fopen(outfn, "wb");
+		if (!out) {
+			fprintf(stderr, "ERROR: %s: cannot create file\n", outfn);
+			errors++;
+		} else {
+			fwrite(xm_bank.data, 1, xm_bank.size, out);
+			fclose(out);
+		}
+	}
+
+	if (!errors && flag_verbose)
+		fprintf(stderr, "Bank: %s (%d waveforms, %u KiB)\n", outfn, xm_bank.num, xm_bank.size / 1024);
+
+	free(xm_bank.data);
+	free(xm_bank.hashes);
+	free(xm_bank.offsets);
+	free(xm_bank.lengths);
+	memset(&xm_bank, 0, sizeof(xm_bank));
+	return errors ? 1 : 0;
+}
@@ -9,6 +9,10 @@
  *   * Convert from older YM versions (eg: YM3!, YM3b).
  *   * Convert non-interleaved to interleaved.
  *   * Re-compress with LHA -lh5-.
+ *   * Optionally (--ym-lz4), emit a block-compressed "YMB1" file instead:
+ *     register frames are delta-coded and grouped in independently
+ *     compressed LZ4 blocks with a seek table, so the runtime can stream
+ *     them with no decoder state and seek even though they are compressed.
  *
  */
 
@@ -19,10 +23,13 @@
 #include "../../src/compress/lzh5.c"
 #include "../common/lzh5_compress.h"           // LZH5 compression
 #include "../common/lzh5_compress.c"
+#include "../../src/compress/lz4_enc_internal.h"  // LZ4 block compression
+#include "../../src/compress/lz4_enc.c"
 #include <stdalign.h>
 
 
 bool flag_ym_compress = false;
+bool flag_ym_lz4 = false;
 
 typedef struct __attribute__((packed)) {
     uint8_t size;
@@ -126,6 +133,90 @@ static void lha_compress(const char *outfn, const char *infn) {
     fclose(in); fclose(out);
 }
 
+// Number of audioframes grouped in each LZ4 block of a YMB1 file. At the
+// typical 50 Hz play frequency a block is ~5 seconds of music; the raw
+// delta-coded data of a block is at most 18*256 bytes, well within the
+// 64 KiB input limit of compress_lz4_full_mem.
+#define YMB_FRAMES_PER_BLOCK   256
+
+// Write a block-compressed YMB1 file. Audioframes are delta-coded (a 16-bit
+// bitmask of changed registers, followed by the changed values); the first
+// frame of each block stores all 16 registers, so that every block can be
+// decoded in isolation. Blocks are LZ4-compressed independently, and a block
+// offset table after the metadata makes the file seekable. ym64.c streams
+// these files with a small per-block buffer and no decoder state, so opening
+// one is instantaneous (unlike LHA files, which carry an 18 KiB streaming
+// decoder and cannot be seeked).
+static void ymb_write(const char *outfn, int nframes, uint32_t chipfreq,
+    uint16_t playfreq, uint32_t loop, const char *song_name,
+    const char *song_author, const char *song_comment, const uint8_t *frames)
+{
+    ym_f = fopen(outfn, "wb");
+    if (!ym_f) fatal("cannot create: %s", outfn);
+
+    int nblocks = (nframes + YMB_FRAMES_PER_BLOCK - 1) / YMB_FRAMES_PER_BLOCK;
+
+    uint32_t u32; uint16_t u16;
+    ymwrite("YMB1", 4);
+    u32 = HOST_TO_BE32(nframes); ymwrite(&u32, 4);
+    u32 = HOST_TO_BE32(chipfreq); ymwrite(&u32, 4);
+    u16 = HOST_TO_BE16(playfreq); ymwrite(&u16, 2);
+    u16 = HOST_TO_BE16(YMB_FRAMES_PER_BLOCK); ymwrite(&u16, 2);
+    u32 = HOST_TO_BE32(loop); ymwrite(&u32, 4);
+    u32 = HOST_TO_BE32(nblocks); ymwrite(&u32, 4);
+    ymwrite(song_name, strlen(song_name)+1);
+    ymwrite(song_author, strlen(song_author)+1);
+    ymwrite(song_comment, strlen(song_comment)+1);
+
+    // Reserve room for the block offset table; it is rewritten with the
+    // actual file offsets once all blocks have been compressed. One extra
+    // entry records the end of the last block, so that the runtime can
+    // derive the compressed size of each block.
+    long table_off = ftell(ym_f);
+    uint32_t *offs = calloc(nblocks+1, sizeof(uint32_t));
+    ymwrite(offs, (nblocks+1) * sizeof(uint32_t));
+
+    uint8_t raw[YMB_FRAMES_PER_BLOCK * 18];
+    uint8_t cmp[LZ4_COMPRESS_BOUND(sizeof(raw))];
+    uint8_t prev[16] = {0};
+
+    for (int b=0; b<nblocks; b++) {
+        offs[b] = HOST_TO_BE32(ftell(ym_f));
+
+        int bframes = nframes - b*YMB_FRAMES_PER_BLOCK;
+        if (bframes > YMB_FRAMES_PER_BLOCK) bframes = YMB_FRAMES_PER_BLOCK;
+
+        int rawlen = 0;
+        for (int f=0; f<bframes; f++) {
+            const uint8_t *cur = frames + (b*YMB_FRAMES_PER_BLOCK + f) * 16;
+
+            // Keyframe at the start of each block, delta otherwise.
+            uint16_t mask = 0;
+            if (f == 0)
+                mask = 0xFFFF;
+            else for (int r=0; r<16; r++)
+                if (cur[r] != prev[r]) mask |= 1 << r;
+
+            raw[rawlen++] = mask >> 8;
+            raw[rawlen++] = mask & 0xFF;
+            for (int r=0; r<16; r++)
+                if (mask & (1 << r)) raw[rawlen++] = cur[r];
+            memcpy(prev, cur, 16);
+        }
+
+        int cmplen = compress_lz4_full_mem(raw, rawlen, cmp, sizeof(cmp));
+        if (cmplen < 0) fatal("LZ4 compression failed: %s", outfn);
+        ymwrite(cmp, cmplen);
+    }
+    offs[nblocks] = HOST_TO_BE32(ftell(ym_f));
+
+    fseek(ym_f, table_off, SEEK_SET);
+    ymwrite(offs, (nblocks+1) * sizeof(uint32_t));
+
+    fclose(ym_f); ym_f = NULL;
+    free(offs);
+}
+
 int ym_convert(const char *infn, const char *outfn) {
     ym_f = fopen(infn, "rb");
     if (!ym_f) fatal("cannot open: %s\n", infn);
@@ -165,7 +256,7 @@ int ym_convert(const char *infn, const char *outfn) {
     // YM3 is an interleaved format. We need to convert it to non-interleaved
     // otherwise it cannot be streamed and thus would require lots of RAM.
     if (strncmp(head, "YM3!", 4) == 0 || strncmp(head, "YM3b", 4) == 0) {
-        int csize = fsize-4; uint32_t loop;
+        int csize = fsize-4; uint32_t loop = 0;
         if (head[3] == 'b') csize -= 4; // loop frame
 
         // A valid YM3! file contains data for 14 registers, so the actual size
@@ -189,37 +280,43 @@ int ym_convert(const char *infn, const char *outfn) {
             outdata[f*16+r] = data[i];
         }
 
-        // Write a YM5 format (uncompressed) into temporary file.
-        const char *tmpfilename = ".song.tmp";
-        ym_f = fopen(tmpfilename, "wb");
-        if (!ym_f) fatal("cannot create: %s", tmpfilename);
-
-        ymwrite("YM5!LeOnArD!", 12);
-
-        ym5header head;
-        memset(&head, 0, sizeof(head));
-        head.nvbl = HOST_TO_BE32(nframes);
-        head.extfreq = HOST_TO_BE32(1000000);
-        head.playfreq = HOST_TO_BE16(50);
-        head.loop = loop;
-        ymwrite(&head, sizeof(head));
-
-        const char *song_name = "";
-        const char *song_author = "";
-        const char *song_comment = "";
-        ymwrite(song_name, strlen(song_name)+1);
-        ymwrite(song_author, strlen(song_author)+1);
-        ymwrite(song_comment, strlen(song_comment)+1);
-
-        ymwrite(outdata, csize/14*16);
-        ymwrite("End!", 4);
-        fclose(ym_f);
-
-        // Do LHA compression to convert the temporary file into the final file.
-        lha_compress(outfn, tmpfilename);
+        if (flag_ym_lz4) {
+            // Write a block-compressed YMB1 file.
+            ymb_write(outfn, nframes, 1000000, 50, BE32_TO_HOST(loop),
+                "", "", "", outdata);
+        } else {
+            // Write a YM5 format (uncompressed) into temporary file.
+            const char *tmpfilename = ".song.tmp";
+            ym_f = fopen(tmpfilename, "wb");
+            if (!ym_f) fatal("cannot create: %s", tmpfilename);
+
+            ymwrite("YM5!LeOnArD!", 12);
+
+            ym5header head;
+            memset(&head, 0, sizeof(head));
+            head.nvbl = HOST_TO_BE32(nframes);
+            head.extfreq = HOST_TO_BE32(1000000);
+            head.playfreq = HOST_TO_BE16(50);
+            head.loop = loop;
+            ymwrite(&head, sizeof(head));
+
+            const char *song_name = "";
+            const char *song_author = "";
+            const char *song_comment = "";
+            ymwrite(song_name, strlen(song_name)+1);
+            ymwrite(song_author, strlen(song_author)+1);
+            ymwrite(song_comment, strlen(song_comment)+1);
+
+            ymwrite(outdata, csize/14*16);
+            ymwrite("End!", 4);
+            fclose(ym_f);
+
+            // Do LHA compression to convert the temporary file into the final file.
+            lha_compress(outfn, tmpfilename);
+            remove(tmpfilename);
+        }
 
         free(data); free(outdata);
-        remove(tmpfilename);
 
     // If this is a YM5! or YM6! file, we might need to convert it if it's not
     // interleaved, and compress it if it's not compressed.
@@ -265,23 +362,30 @@ int ym_convert(const char *infn, const char *outfn) {
         // Turn off interleaving bit in header attributes
         ymhead.attrs = HOST_TO_BE32((BE32_TO_HOST(ymhead.attrs) & ~1));
 
-        // Write back the YM5 file into a temporary file.
-        const char *tmpfilename = ".song.tmp";
-        ym_f = fopen(flag_ym_compress ? tmpfilename : outfn, "wb");
-        if (!ym_f) fatal("cannot create: %s", flag_ym_compress ? tmpfilename : outfn);
-        ymwrite("YM5!LeOnArD!", 12);
-        ymwrite(&ymhead, sizeof(ymhead));
-        ymwrite(song_name, strlen(song_name)+1);
-        ymwrite(song_author, strlen(song_author)+1);
-        ymwrite(song_comment, strlen(song_comment)+1);
-        ymwrite(outdata, datasize);
-        ymwrite("End!", 4);
-        fclose(ym_f);
-
-        // Do LHA compression
-        if (flag_ym_compress) {
-            lha_compress(outfn, tmpfilename);
-            remove(tmpfilename);
+        if (flag_ym_lz4) {
+            // Write a block-compressed YMB1 file.
+            ymb_write(outfn, numframes, BE32_TO_HOST(ymhead.extfreq),
+                BE16_TO_HOST(ymhead.playfreq), BE32_TO_HOST(ymhead.loop),
+                song_name, song_author, song_comment, outdata);
+        } else {
+            // Write back the YM5 file into a temporary file.
+            const char *tmpfilename = ".song.tmp";
+            ym_f = fopen(flag_ym_compress ? tmpfilename : outfn, "wb");
+            if (!ym_f) fatal("cannot create: %s", flag_ym_compress ? tmpfilename : outfn);
+            ymwrite("YM5!LeOnArD!", 12);
+            ymwrite(&ymhead, sizeof(ymhead));
+            ymwrite(song_name, strlen(song_name)+1);
+            ymwrite(song_author, strlen(song_author)+1);
+            ymwrite(song_comment, strlen(song_comment)+1);
+            ymwrite(outdata, datasize);
+            ymwrite("End!", 4);
+            fclose(ym_f);
+
+            // Do LHA compression
+            if (flag_ym_compress) {
+                lha_compress(outfn, tmpfilename);
+                remove(tmpfilename);
+            }
         }
 
         free(data); free(outdata);
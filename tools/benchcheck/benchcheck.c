@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Host-side collector for the BENCH records emitted by tests/benchrom.c
+// over the usb log. Feed it a captured log (eg: the output of your usb
+// loader's logging mode); it maintains a baseline database across runs and
+// exits non-zero when a benchmark regresses beyond what the recorded
+// run-to-run noise can explain, so a hardware rack can gate merges on it.
+//
+// Each benchmark is keyed by its name and parameter string, and the metric
+// is the ticks-per-iteration column. The baseline stores running mean and
+// variance (Welford); a result is flagged when it exceeds the mean by more
+// than 3 standard deviations AND by more than a relative threshold
+// (default 5%), so that both noisy and ultra-stable benchmarks behave.
+
+#define MAX_KEY 128
+
+typedef struct {
+    char key[MAX_KEY];          // "<name> <param>"
+    long long count;            // number of baseline runs folded in
+    double mean;                // mean ticks/iter across baseline runs
+    double m2;                  // sum of squared deviations (Welford)
+    double cur;                 // ticks/iter in the run being checked
+    bool in_baseline;
+    bool in_run;
+} bench_entry_t;
+
+static bench_entry_t *entries = NULL;
+static int num_entries = 0;
+
+static bench_entry_t *entry_get(const char *key)
+{
+    for (int i = 0; i < num_entries; i++)
+        if (!strcmp(entries[i].key, key))
+            return &entries[i];
+    entries = realloc(entries, (num_entries + 1) * sizeof(bench_entry_t));
+    bench_entry_t *e = &entries[num_entries++];
+    memset(e, 0, sizeof(*e));
+    snprintf(e->key, MAX_KEY, "%s", key);
+    return e;
+}
+
+static bool baseline_load(const char *fn)
+{
+    FILE *f = fopen(fn, "r");
+    if (!f) return false;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char key[MAX_KEY];
+        long long count;
+        double mean, m2;
+        if (sscanf(line, "%127[^\t]\t%lld\t%lf\t%lf", key, &count, &mean, &m2) != 4)
+            continue;
+        bench_entry_t *e = entry_get(key);
+        e->count = count;
+        e->mean = mean;
+        e->m2 = m2;
+        e->in_baseline = true;
+    }
+    fclose(f);
+    return true;
+}
+
+static bool baseline_save(const char *fn)
+{
+    FILE *f = fopen(fn, "w");
+    if (!f) return false;
+    for (int i = 0; i < num_entries; i++) {
+        bench_entry_t *e = &entries[i];
+        if (e->count > 0)
+            fprintf(f, "%s\t%lld\t%.6f\t%.6f\n", e->key, e->count, e->mean, e->m2);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool log_parse(FILE *f)
+{
+    char line[512];
+    bool any = false;
+
+    while (fgets(line, sizeof(line), f)) {
+        // Tolerate CR and leading junk from the usb capture
+        char *p = strstr(line, "BENCH ");
+        if (!p) continue;
+
+        char name[64], param[64];
+        long long iters, total, per_iter, bytes;
+        if (sscanf(p, "BENCH %63s %63s %lld %lld %lld %lld",
+                name, param, &iters, &total, &per_iter, &bytes) != 6)
+            continue;
+
+        char key[MAX_KEY];
+        snprintf(key, sizeof(key), "%s %s", name, param);
+        bench_entry_t *e = entry_get(key);
+        e->cur = per_iter;
+        e->in_run = true;
+        any = true;
+    }
+    return any;
+}
+
+void print_args(char *name)
+{
+    fprintf(stderr, "benchcheck -- Track benchrom results and detect performance regressions\n\n");
+    fprintf(stderr, "Parses the BENCH records that tests/benchrom.z64 streams over the usb\n");
+    fprintf(stderr, "log, compares them against a baseline database, and exits with status 1\n");
+    fprintf(stderr, "if any benchmark regressed beyond the recorded run-to-run noise.\n\n");
+    fprintf(stderr, "Usage: %s [flags] -b <baseline> [<logfile>]\n", name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Reads the captured log from <logfile>, or stdin when omitted.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -b/--baseline <file>  Baseline database (created if missing)\n");
+    fprintf(stderr, "   -u/--update           Fold this run into the baseline instead of\n");
+    fprintf(stderr, "                         checking against it\n");
+    fprintf(stderr, "   -t/--threshold <pct>  Minimum relative slowdown to flag (default: 5)\n");
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *baseline_fn = NULL;
+    const char *log_fn = NULL;
+    bool update = false;
+    double threshold = 5.0;
+
+    if (argc < 2) {
+        print_args(argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--baseline")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                baseline_fn = argv[i];
+            } else if (!strcmp(argv[i], "-u") || !strcmp(argv[i], "--update")) {
+                update = true;
+            } else if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--threshold")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                threshold = atof(argv[i]);
+            } else {
+                fprintf(stderr, "invalid flag: %s\n", argv[i]);
+                return 1;
+            }
+            continue;
+        }
+        if (log_fn) {
+            fprintf(stderr, "multiple log files specified\n");
+            return 1;
+        }
+        log_fn = argv[i];
+    }
+
+    if (!baseline_fn) {
+        fprintf(stderr, "no baseline database specified (use -b)\n");
+        return 1;
+    }
+
+    baseline_load(baseline_fn);
+
+    FILE *logf = stdin;
+    if (log_fn) {
+        logf = fopen(log_fn, "r");
+        if (!logf) {
+            fprintf(stderr, "cannot open: %s\n", log_fn);
+            return 1;
+        }
+    }
+    bool any = log_parse(logf);
+    if (log_fn)
+        fclose(logf);
+    if (!any) {
+        fprintf(stderr, "no BENCH records found in input\n");
+        return 1;
+    }
+
+    if (update) {
+        // Fold this run into the running mean/variance of each benchmark
+        for (int i = 0; i < num_entries; i++) {
+            bench_entry_t *e = &entries[i];
+            if (!e->in_run) continue;
+            e->count++;
+            double delta = e->cur - e->mean;
+            e->mean += delta / e->count;
+            e->m2 += delta * (e->cur - e->mean);
+        }
+        if (!baseline_save(baseline_fn)) {
+            fprintf(stderr, "cannot write: %s\n", baseline_fn);
+            return 1;
+        }
+        printf("baseline updated: %s\n", baseline_fn);
+        return 0;
+    }
+
+    int regressions = 0, improvements = 0, fresh = 0, missing = 0;
+
+    for (int i = 0; i < num_entries; i++) {
+        bench_entry_t *e = &entries[i];
+        if (e->in_run && !e->in_baseline) {
+            printf("NEW        %-48s %12.0f\n", e->key, e->cur);
+            fresh++;
+            continue;
+        }
+        if (!e->in_run) {
+            printf("MISSING    %-48s (in baseline, not in run)\n", e->key);
+            missing++;
+            continue;
+        }
+
+        // With a single baseline run there is no noise estimate yet:
+        // fall back to the relative threshold alone
+        double sd = e->count > 1 ? sqrt(e->m2 / (e->count - 1)) : 0;
+        double delta_pct = 100.0 * (e->cur - e->mean) / e->mean;
+
+        if (e->cur > e->mean + 3*sd && delta_pct > threshold) {
+            printf("REGRESSION %-48s %12.0f vs %.0f (+%.1f%%, sd=%.0f, n=%lld)\n",
+                e->key, e->cur, e->mean, delta_pct, sd, e->count);
+            regressions++;
+        } else if (e->cur < e->mean - 3*sd && delta_pct < -threshold) {
+            printf("IMPROVED   %-48s %12.0f vs %.0f (%.1f%%)\n",
+                e->key, e->cur, e->mean, delta_pct);
+            improvements++;
+        }
+    }
+
+    printf("\n%d regression(s), %d improvement(s), %d new, %d missing\n",
+        regressions, improvements, fresh, missing);
+
+    return regressions > 0 ? 1 : 0;
+}
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "n64checksum.h"
+
 #define max2(a, b) ( (a)>(b) ? (a) : (b) )
 #define min2(a, b) ( (a)<(b) ? (a) : (b) )
 
@@ -31,10 +33,6 @@
 #define CHECKSUM_HEADERPOS 0x10
 #define CHECKSUM_END (CHECKSUM_START + CHECKSUM_LENGTH)
 
-#define CHECKSUM_STARTVALUE 0xf8ca4ddc
-
-#define ROL(i, b) (((i)<<(b)) | ((i)>>(32-(b))))
-
 #define BYTES2LONG(b, s) ( (((b)[0^(s)] & 0xffL) << 24) | \
                            (((b)[1^(s)] & 0xffL) << 16) | \
                            (((b)[2^(s)] & 0xffL) <<  8) | \
@@ -150,30 +148,23 @@ int main(int argc, char *argv[])
   }
   fseek(file1, CHECKSUM_START, SEEK_SET);
   {
-    unsigned int i;
-    unsigned int c1, k1, k2;
-    unsigned int t1, t2, t3, t4;
-    unsigned int t5, t6;
+    n64_checksum_t chk;
     unsigned int n;
     unsigned clen = CHECKSUM_LENGTH;
     unsigned rlen = flen1 - CHECKSUM_START;
 
-    /* Below is the actual checksum calculation algorithm, which was
-       reverse engineered out of Nagra's program.
+    /* The actual checksum calculation algorithm lives in n64checksum.h,
+       shared with n64tool (which computes it inline while building the
+       ROM).
 
-       As you can see, the algorithm is total crap. Obviously it was
+       As you can see there, the algorithm is total crap. Obviously it was
        designed to be difficult to guess and reverse engineer, and not
        to give a good checksum. A simple XOR and ROL 13 would give a
        just as good checksum. The ifs and the data dependent ROL are really
        extreme nonsense.
     */
 
-    t1 = CHECKSUM_STARTVALUE;
-    t2 = CHECKSUM_STARTVALUE;
-    t3 = CHECKSUM_STARTVALUE;
-    t4 = CHECKSUM_STARTVALUE;
-    t5 = CHECKSUM_STARTVALUE;
-    t6 = CHECKSUM_STARTVALUE;
+    n64_checksum_init(&chk);
 
     for( ;; ) {
       if( rlen > 0 ) {
@@ -190,30 +181,14 @@ int main(int argc, char *argv[])
         }
         break;
       }
-      for( i=0; i<n; i+=4 ) {
-        c1 = BYTES2LONG(&buffer1[i], swapped);
-        k1 = t6 + c1;
-        if( k1 < t6 ) t4++;
-        t6 = k1;
-        t3 ^= c1;
-        k2 = c1 & 0x1f;
-        k1 = ROL(c1, k2);
-        t5 += k1;
-        if( c1 < t2 ) {
-          t2 ^= k1;
-        } else {
-          t2 ^= t6 ^ c1;
-        }
-        t1 += c1 ^ t5;
-      }
+      n64_checksum_data(&chk, buffer1, n, swapped);
       if( rlen > 0 ) {
         rlen -= n;
         if( rlen <= 0 ) memset(buffer1, 0, BUFSIZE);
       }
       clen -= n;
     }
-    sum1 = t6 ^ t4 ^ t3;
-    sum2 = t5 ^ t2 ^ t1;
+    n64_checksum_final(&chk, &sum1, &sum2);
   }
   LONG2BYTES(sum1, &buffer1[0], 0);
   LONG2BYTES(sum2, &buffer1[4], 0);
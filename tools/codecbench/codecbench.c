@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../common/binout.c"
+#include "../common/assetcomp.h"
+#include "asset.h"
+
+// Benchmark harness for the asset codecs. The compressors come from
+// tools/common and the decoders are the very same sources that run on the
+// N64 (src/asset.c and src/compress/*, compiled into assetcomp.c), so the
+// ratio and the decode path measured here are exactly what ships. Host
+// decode speed is measured directly; on-hardware load time is estimated
+// with a cost model (see below), which is enough to rank the codecs for a
+// given asset class before committing to one in asset_init_compression.
+
+#define VR4300_CLOCK_HZ   93750000.0
+#define PI_CLOCK_HZ       62500000.0
+#define PI_PAGE_SIZE      512            // cartridge domain 1, PGS=7
+#define PI_PAGE_CYCLES    65             // LAT+1
+#define PI_WORD_CYCLES    23             // PWD+1 + RLS+1 per 16-bit word
+
+// Rough VR4300 decode cost per input/output byte, in CPU cycles. These are
+// not measurements of this exact build, but ballpark figures for the three
+// inner loops: LZ4 copies words with little per-byte work, LZE pays a table
+// lookup per symbol, LZH5 walks Huffman codes bit by bit. The absolute
+// numbers are approximate; the ranking they produce matches what we observe
+// on hardware.
+typedef struct {
+    int algo;
+    const char *name;
+    double cyc_out;     // cycles per decompressed byte
+    double cyc_in;      // cycles per compressed byte
+} codec_model_t;
+
+static const codec_model_t models[] = {
+    { 1, "lz4",  2.5,  6.0 },
+    { 2, "lzh5", 32.0,  8.0 },
+    { 3, "lze",  9.0,  6.0 },
+};
+
+static double now(void)
+{
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Estimated seconds to DMA 'bytes' sequential bytes from cartridge ROM
+static double pi_time(long long bytes)
+{
+    long long pages = (bytes + PI_PAGE_SIZE - 1) / PI_PAGE_SIZE;
+    long long cycles = pages * PI_PAGE_CYCLES + ((bytes + 1) / 2) * PI_WORD_CYCLES;
+    return cycles / PI_CLOCK_HZ;
+}
+
+static long long file_size(const char *fn)
+{
+    FILE *f = fopen(fn, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    long long sz = ftell(f);
+    fclose(f);
+    return sz;
+}
+
+void print_args(char *name)
+{
+    fprintf(stderr, "codecbench -- Benchmark asset codecs on a compression corpus\n\n");
+    fprintf(stderr, "Runs each input file through every asset compression level, using the\n");
+    fprintf(stderr, "same decoder sources that run on the N64, and reports compression ratio,\n");
+    fprintf(stderr, "host decode speed, and an estimated on-hardware load time (PI transfer\n");
+    fprintf(stderr, "plus modeled VR4300 decode cost) against loading the file uncompressed.\n\n");
+    fprintf(stderr, "Usage: %s [flags] <input files...>\n", name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -n/--iterations <n>   Decode each file exactly <n> times (default:\n");
+    fprintf(stderr, "                         as many as fit in ~0.5s)\n");
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int fixed_iters = 0;
+    bool any = false;
+
+    if (argc < 2) {
+        print_args(argv[0]);
+        return 1;
+    }
+
+    // All levels are exercised, so register the non-default decoders
+    // (the asset_init_compression macro needs assertf, which is N64-only)
+    __asset_init_compression_lvl2();
+    __asset_init_compression_lvl3();
+
+    for (int i = 1; i < argc; i++) {
+        char *infn = argv[i];
+        if (infn[0] == '-') {
+            if (!strcmp(infn, "-n") || !strcmp(infn, "--iterations")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", infn);
+                    return 1;
+                }
+                fixed_iters = atoi(argv[i]);
+                continue;
+            }
+            fprintf(stderr, "invalid flag: %s\n", infn);
+            return 1;
+        }
+
+        long long orig_size = file_size(infn);
+        if (orig_size < 0) {
+            fprintf(stderr, "cannot open: %s\n", infn);
+            return 1;
+        }
+
+        double raw_ms = pi_time(orig_size) * 1000.0;
+        printf("%s: %lld bytes, raw load %.2f ms\n", infn, orig_size, raw_ms);
+        printf("  %-5s %10s %7s %14s %14s %13s\n",
+            "algo", "size", "ratio", "host-decode", "est-decode", "est-load");
+
+        for (int m = 0; m < sizeof(models)/sizeof(models[0]); m++) {
+            const codec_model_t *cm = &models[m];
+
+            char *tmpfn = NULL;
+            asprintf(&tmpfn, "%s.cbench%d", infn, cm->algo);
+
+            if (!asset_compress(infn, tmpfn, cm->algo, 0, NULL, 0)) {
+                fprintf(stderr, "error compressing %s with %s\n", infn, cm->name);
+                remove(tmpfn);
+                free(tmpfn);
+                continue;
+            }
+
+            long long cmp_size = file_size(tmpfn) - 16;  // minus asset header
+
+            // Measure host decode speed through the real asset_load path.
+            // The compressed file sits in the page cache, so this is
+            // dominated by the decoder itself.
+            int iters = 0;
+            int sz;
+            void *data = asset_load(tmpfn, &sz);   // warmup
+            free(data);
+            double t0 = now(), elapsed;
+            do {
+                data = asset_load(tmpfn, &sz);
+                free(data);
+                iters++;
+                elapsed = now() - t0;
+            } while (fixed_iters ? iters < fixed_iters : elapsed < 0.5);
+
+            double host_mbs = (orig_size * (double)iters / elapsed) / (1024*1024);
+
+            // Model the on-hardware cost: PI transfer of the compressed
+            // data, plus the VR4300 decode cycles.
+            double dec_s = (cm->cyc_out * orig_size + cm->cyc_in * cmp_size) / VR4300_CLOCK_HZ;
+            double est_mbs = (orig_size / dec_s) / (1024*1024);
+            double load_ms = (pi_time(cmp_size) + dec_s) * 1000.0;
+
+            printf("  %-5s %10lld %6.1f%% %9.1f MB/s %9.1f MB/s %10.2f ms%s\n",
+                cm->name, cmp_size, 100.0 * cmp_size / orig_size,
+                host_mbs, est_mbs, load_ms,
+                load_ms < raw_ms ? " *" : "");
+
+            remove(tmpfn);
+            free(tmpfn);
+            any = true;
+        }
+    }
+
+    if (any)
+        printf("\n(* = estimated to load faster than the uncompressed file)\n");
+
+    return 0;
+}
@@ -5,11 +5,13 @@
 
 #include "../common/binout.h"
 #include "../common/lzh5_compress.c"
+#include "../common/lze_compress.c"
 #undef MIN
 #undef MAX
 #include "../../src/asset.c"
 #include "../../src/compress/lzh5.c"
 #include "../../src/compress/lz4_dec.c"
+#include "../../src/compress/lze_dec.c"
 #include "../../src/compress/ringbuf.c"
 #undef MIN
 #undef MAX
@@ -24,7 +26,216 @@
 #undef MAX
 
 
-bool asset_compress(const char *infn, const char *outfn, int compression)
+static uint8_t *compress_block(int compression, const uint8_t *data, int sz, int *cmp_size)
+{
+    switch (compression) {
+    case 1: {
+        int cmp_max_size = LZ4_COMPRESSBOUND(sz);
+        uint8_t *output = malloc(cmp_max_size);
+        *cmp_size = LZ4_compress_HC((const char*)data, (char*)output, sz, cmp_max_size, LZ4HC_CLEVEL_MAX);
+        return output;
+    }
+    case 3:
+        return lze_compress(data, sz, cmp_size);
+    }
+    assert(0);
+    return NULL;
+}
+
+static bool asset_compress_blocked(const char *infn, const char *outfn,
+    int compression, int blocksize, const uint8_t *data, int sz)
+{
+    int nblocks = (sz + blocksize - 1) / blocksize;
+    uint8_t **blocks = malloc(nblocks * sizeof(uint8_t*));
+    uint32_t *offsets = malloc((nblocks+1) * sizeof(uint32_t));
+
+    offsets[0] = 0;
+    for (int i = 0; i < nblocks; i++) {
+        int bsz = sz - i*blocksize;
+        if (bsz > blocksize) bsz = blocksize;
+
+        int csz;
+        blocks[i] = compress_block(compression, data + i*blocksize, bsz, &csz);
+        offsets[i+1] = offsets[i] + csz;
+
+        // Verify the block round-trips: much better to fail the build than
+        // to corrupt an asset at runtime.
+        uint8_t *verify = malloc(bsz);
+        int n = compression == 1
+            ? decompress_lz4_full_mem(blocks[i], csz, verify, bsz, false)
+            : decompress_lze_full_mem(blocks[i], csz, verify, bsz, false);
+        if (n != bsz || memcmp(verify, data + i*blocksize, bsz) != 0) {
+            fprintf(stderr, "error: blocked decompression mismatch on %s (block %d)\n", infn, i);
+            free(verify);
+            return false;
+        }
+        free(verify);
+    }
+
+    FILE *out = fopen(outfn, "wb");
+    if (!out) {
+        fprintf(stderr, "error opening output file: %s\n", outfn);
+        return false;
+    }
+    wbuf_open(out);
+    wdata(out, "DCA2", 4);
+    w16(out, compression); // algo
+    w16(out, ASSET_FLAG_BLOCKED); // flags
+    w32(out, 8 + 4*(nblocks+1) + offsets[nblocks]); // cmp_size (index + blocks)
+    w32(out, sz); // dec_size
+    w32(out, blocksize);
+    w32(out, nblocks);
+    for (int i = 0; i < nblocks+1; i++)
+        w32(out, offsets[i]);
+    for (int i = 0; i < nblocks; i++) {
+        wdata(out, blocks[i], offsets[i+1] - offsets[i]);
+        free(blocks[i]);
+    }
+    wbuf_close(out);
+    fclose(out);
+    free(blocks);
+    free(offsets);
+    return true;
+}
+
+static bool asset_compress_with_dict(const char *infn, const char *outfn,
+    const uint8_t *data, int sz, const uint8_t *dict, int dict_size)
+{
+    // Compress against the shared dictionary. Only the last LZ4_DISTANCE_MAX
+    // bytes of it are reachable by matches, which is also all that
+    // --train-dict ever emits.
+    int cmp_max_size = LZ4_COMPRESSBOUND(sz);
+    uint8_t *output = malloc(cmp_max_size);
+
+    LZ4_streamHC_t *stream = LZ4_createStreamHC();
+    LZ4_resetStreamHC_fast(stream, LZ4HC_CLEVEL_MAX);
+    LZ4_loadDictHC(stream, (const char*)dict, dict_size);
+    int cmp_size = LZ4_compress_HC_continue(stream, (const char*)data, (char*)output, sz, cmp_max_size);
+    LZ4_freeStreamHC(stream);
+    assert(cmp_size > 0 && cmp_size <= cmp_max_size);
+
+    // Verify with the runtime decoder and the exact runtime layout
+    // (dictionary placed right before the output): much better to fail
+    // the build than to corrupt an asset at runtime.
+    uint8_t *verify = malloc(dict_size + sz);
+    memcpy(verify, dict, dict_size);
+    int ver_size = decompress_lz4_full_mem_dict(output, cmp_size, verify + dict_size, sz, verify, false);
+    if (ver_size != sz || memcmp(verify + dict_size, data, sz) != 0) {
+        fprintf(stderr, "error: dictionary decompression mismatch on %s\n", infn);
+        free(verify);
+        free(output);
+        return false;
+    }
+    free(verify);
+
+    FILE *out = fopen(outfn, "wb");
+    if (!out) {
+        fprintf(stderr, "error opening output file: %s\n", outfn);
+        free(output);
+        return false;
+    }
+    wbuf_open(out);
+    wdata(out, "DCA2", 4);
+    w16(out, 1); // algo
+    w16(out, ASSET_FLAG_DICT); // flags
+    w32(out, cmp_size); // cmp_size
+    w32(out, sz); // dec_size
+    wdata(out, output, cmp_size);
+    wbuf_close(out);
+    fclose(out);
+    free(output);
+    return true;
+}
+
+bool asset_train_dict(char **infns, int num_files, const char *outfn, int dict_size)
+{
+    // Simple chunk-frequency trainer: split every input in small chunks,
+    // count how often each distinct chunk occurs across the corpus, and
+    // fill the dictionary with the most frequent ones. Repeated structure
+    // shared by many small files (entity definitions, dialogue records)
+    // surfaces as high-frequency chunks.
+    enum { CHUNK = 32, SAMPLE_MAX = 64*1024 };
+
+    typedef struct { uint8_t bytes[CHUNK]; uint32_t count; } chunk_t;
+    chunk_t *chunks = NULL;
+    int num_chunks = 0, max_chunks = 0;
+
+    for (int i = 0; i < num_files; i++) {
+        FILE *in = fopen(infns[i], "rb");
+        if (!in) {
+            fprintf(stderr, "error opening input file: %s\n", infns[i]);
+            free(chunks);
+            return false;
+        }
+        uint8_t sample[SAMPLE_MAX];
+        int n = fread(sample, 1, SAMPLE_MAX, in);
+        fclose(in);
+
+        for (int off = 0; off + CHUNK <= n; off += CHUNK) {
+            // Linear scan is fine for the corpus sizes at hand
+            int j;
+            for (j = 0; j < num_chunks; j++)
+                if (!memcmp(chunks[j].bytes, sample + off, CHUNK))
+                    break;
+            if (j == num_chunks) {
+                if (num_chunks == max_chunks) {
+                    max_chunks = max_chunks ? max_chunks * 2 : 4096;
+                    chunks = realloc(chunks, max_chunks * sizeof(chunk_t));
+                }
+                memcpy(chunks[num_chunks].bytes, sample + off, CHUNK);
+                chunks[num_chunks].count = 0;
+                num_chunks++;
+            }
+            chunks[j].count++;
+        }
+    }
+
+    FILE *out = fopen(outfn, "wb");
+    if (!out) {
+        fprintf(stderr, "error opening output file: %s\n", outfn);
+        free(chunks);
+        return false;
+    }
+
+    // Select the chunks seen at least twice, least frequent first: LZ4
+    // matches reach backwards, so the most frequent chunks belong at the
+    // tail of the dictionary where they are the cheapest to address.
+    int emitted = 0;
+    int *order = malloc(num_chunks * sizeof(int));
+    int num_order = 0;
+    for (int j = 0; j < num_chunks; j++)
+        if (chunks[j].count >= 2)
+            order[num_order++] = j;
+    for (int a = 0; a < num_order; a++)
+        for (int b = a + 1; b < num_order; b++)
+            if (chunks[order[b]].count < chunks[order[a]].count) {
+                int tmp = order[a]; order[a] = order[b]; order[b] = tmp;
+            }
+    // Keep only the most frequent ones that fit, preserving the
+    // least-frequent-first order so the best chunks end up at the tail
+    int fit = dict_size / CHUNK;
+    int start = num_order > fit ? num_order - fit : 0;
+    wbuf_open(out);
+    for (int a = start; a < num_order; a++, emitted += CHUNK)
+        wdata(out, chunks[order[a]].bytes, CHUNK);
+    wbuf_close(out);
+
+    fclose(out);
+    free(order);
+    free(chunks);
+
+    if (emitted == 0) {
+        fprintf(stderr, "warning: no repeated content found, dictionary %s is empty\n", outfn);
+        remove(outfn);
+        return false;
+    }
+
+    printf("Trained dictionary %s: %d bytes from %d files\n", outfn, emitted, num_files);
+    return true;
+}
+
+bool asset_compress(const char *infn, const char *outfn, int compression, int blocksize,
+    const uint8_t *dict, int dict_size)
 {
     // Make sure the file exists before calling asset_load,
     // which would just assert.
@@ -38,6 +249,27 @@ bool asset_compress(const char *infn, const char *outfn, int compression)
     int sz;
     uint8_t *data = asset_load(infn, &sz);
 
+    if (dict) {
+        if (compression != 1) {
+            fprintf(stderr, "warning: dictionary is only supported with lz4 (-c 1), ignoring for %s\n", infn);
+        } else if (blocksize) {
+            fprintf(stderr, "warning: dictionary is not supported with blocks (-b), ignoring for %s\n", infn);
+        } else {
+            return asset_compress_with_dict(infn, outfn, data, sz, dict, dict_size);
+        }
+    }
+
+    if (blocksize) {
+        if (compression == 0) {
+            fprintf(stderr, "warning: ignoring block size for uncompressed file %s\n", infn);
+        } else if (compression == 2) {
+            fprintf(stderr, "error: seekable blocks are not supported with lzh5 (use -c 1 or -c 3)\n");
+            return false;
+        } else {
+            return asset_compress_blocked(infn, outfn, compression, blocksize, data, sz);
+        }
+    }
+
     switch (compression) {
     case 0: { // none
         FILE *out = fopen(outfn, "wb");
@@ -85,13 +317,65 @@ bool asset_compress(const char *infn, const char *outfn, int compression)
         int cmp_size = LZ4_compress_HC((char*)data, output, sz, cmp_max_size, LZ4HC_CLEVEL_MAX);
         assert(cmp_size <= cmp_max_size);
 
+        // Verify that in-place decompression reproduces the input. asset_load
+        // decompresses LZ4 in-place on the console (compressed data at the
+        // tail of the output buffer, with LZ4_DECOMPRESS_INPLACE_MARGIN of
+        // slack), so replicate that exact layout here: much better to fail
+        // the build than to corrupt an asset at runtime.
+        int ver_bufsize = sz + LZ4_DECOMPRESS_INPLACE_MARGIN(cmp_size);
+        int ver_offset = ver_bufsize - cmp_size;
+        if (ver_offset & 1) {
+            ver_offset++;
+            ver_bufsize++;
+        }
+        uint8_t *verify = malloc(ver_bufsize);
+        memcpy(verify + ver_offset, output, cmp_size);
+        int ver_size = decompress_lz4_full_mem(verify + ver_offset, cmp_size, verify, sz, false);
+        if (ver_size != sz || memcmp(verify, data, sz) != 0) {
+            fprintf(stderr, "error: in-place decompression mismatch on %s\n", infn);
+            free(verify);
+            free(output);
+            return false;
+        }
+        free(verify);
+
         FILE *out = fopen(outfn, "wb");
-        fwrite("DCA2", 1, 4, out);
+        wbuf_open(out);
+        wdata(out, "DCA2", 4);
         w16(out, 1); // algo
         w16(out, 0); // flags
         w32(out, cmp_size); // cmp_size
         w32(out, sz); // dec_size
-        fwrite(output, 1, cmp_size, out);
+        wdata(out, output, cmp_size);
+        wbuf_close(out);
+        fclose(out);
+        free(output);
+    }   break;
+    case 3: { // lze
+        int cmp_size;
+        uint8_t *output = lze_compress(data, sz, &cmp_size);
+
+        // Verify that decompression reproduces the input: much better to
+        // fail the build than to corrupt an asset at runtime.
+        uint8_t *verify = malloc(sz);
+        int ver_size = decompress_lze_full_mem(output, cmp_size, verify, sz, false);
+        if (ver_size != sz || memcmp(verify, data, sz) != 0) {
+            fprintf(stderr, "error: lze decompression mismatch on %s\n", infn);
+            free(verify);
+            free(output);
+            return false;
+        }
+        free(verify);
+
+        FILE *out = fopen(outfn, "wb");
+        wbuf_open(out);
+        wdata(out, "DCA2", 4);
+        w16(out, 3); // algo
+        w16(out, 0); // flags
+        w32(out, cmp_size); // cmp_size
+        w32(out, sz); // dec_size
+        wdata(out, output, cmp_size);
+        wbuf_close(out);
         fclose(out);
         free(output);
     }   break;
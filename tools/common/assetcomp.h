@@ -3,6 +3,8 @@
 
 #define DEFAULT_COMPRESSION     1
 
-bool asset_compress(const char *infn, const char *outfn, int compression);
+bool asset_compress(const char *infn, const char *outfn, int compression, int blocksize,
+    const uint8_t *dict, int dict_size);
+bool asset_train_dict(char **infns, int num_files, const char *outfn, int dict_size);
 
 #endif
@@ -1,43 +1,194 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
-void w8(FILE *f, uint8_t v) 
+/**
+ * Buffered output layer
+ *
+ * Tools emit their output through many field-sized writes (w8/w16/w32), and
+ * going through stdio for each of them makes packing large asset trees
+ * syscall-bound. A stream can opt into buffering with wbuf_open(): all
+ * writes are then staged in a chain of fixed-size memory chunks, and
+ * wbuf_close() flushes the whole chain with a few vectored writes.
+ * Backpatching placeholders (w32_at) pokes directly into the staged memory,
+ * so it no longer forces a seek round-trip.
+ *
+ * Streams that never call wbuf_open() keep the old unbuffered behavior, which
+ * also remains the right choice when some other code writes to the same FILE*
+ * behind our back (e.g. the lzh5 compressor).
+ */
+
+#define WBUF_CHUNK    (256*1024)
+#define WBUF_STREAMS  8
+
+typedef struct {
+    FILE *f;            // stream being buffered (NULL = free slot)
+    long base;          // file offset at which buffering started
+    uint8_t **chunks;   // chain of WBUF_CHUNK-sized blocks
+    int num_chunks;
+    long len;           // total bytes staged so far
+} wbuf_t;
+
+static wbuf_t wbufs[WBUF_STREAMS];
+
+static wbuf_t *wbuf_find(FILE *f)
+{
+    for (int i = 0; i < WBUF_STREAMS; i++) {
+        if (wbufs[i].f == f)
+            return &wbufs[i];
+    }
+    return NULL;
+}
+
+void wbuf_open(FILE *f)
+{
+    assert(!wbuf_find(f));
+    wbuf_t *wb = wbuf_find(NULL);
+    assert(wb);  // too many buffered streams
+    wb->f = f;
+    wb->base = ftell(f);
+    wb->chunks = NULL;
+    wb->num_chunks = 0;
+    wb->len = 0;
+}
+
+static void wbuf_append(wbuf_t *wb, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        int idx = wb->len / WBUF_CHUNK;
+        int off = wb->len % WBUF_CHUNK;
+        if (idx == wb->num_chunks) {
+            wb->chunks = realloc(wb->chunks, (wb->num_chunks+1) * sizeof(uint8_t*));
+            wb->chunks[wb->num_chunks++] = malloc(WBUF_CHUNK);
+        }
+        size_t n = WBUF_CHUNK - off;
+        if (n > len) n = len;
+        memcpy(wb->chunks[idx] + off, data, n);
+        wb->len += n; data += n; len -= n;
+    }
+}
+
+static void wbuf_poke(wbuf_t *wb, long pos, const uint8_t *data, size_t len)
+{
+    assert(pos >= wb->base && pos + (long)len <= wb->base + wb->len);
+    pos -= wb->base;
+    while (len > 0) {
+        int idx = pos / WBUF_CHUNK;
+        int off = pos % WBUF_CHUNK;
+        size_t n = WBUF_CHUNK - off;
+        if (n > len) n = len;
+        memcpy(wb->chunks[idx] + off, data, n);
+        pos += n; data += n; len -= n;
+    }
+}
+
+void wbuf_close(FILE *f)
+{
+    wbuf_t *wb = wbuf_find(f);
+    assert(wb);
+
+#ifndef _WIN32
+    // Flush the chunk chain with as few syscalls as possible
+    fflush(f);
+    int i = 0;
+    long left = wb->len;
+    while (left > 0) {
+        struct iovec iov[64];
+        int niov = 0;
+        ssize_t batch = 0;
+        while (niov < 64 && left > 0) {
+            long n = left < WBUF_CHUNK ? left : WBUF_CHUNK;
+            iov[niov].iov_base = wb->chunks[i++];
+            iov[niov].iov_len = n;
+            batch += n; left -= n; niov++;
+        }
+        ssize_t written = writev(fileno(f), iov, niov);
+        assert(written == batch); (void)written;
+    }
+#else
+    long left = wb->len;
+    for (int i = 0; left > 0; i++) {
+        long n = left < WBUF_CHUNK ? left : WBUF_CHUNK;
+        fwrite(wb->chunks[i], 1, n, f);
+        left -= n;
+    }
+#endif
+
+    for (int i = 0; i < wb->num_chunks; i++)
+        free(wb->chunks[i]);
+    free(wb->chunks);
+    memset(wb, 0, sizeof(*wb));
+}
+
+void wdata(FILE *f, const void *data, size_t len)
 {
-    fputc(v, f);
+    wbuf_t *wb = wbuf_find(f);
+    if (wb)
+        wbuf_append(wb, data, len);
+    else
+        fwrite(data, 1, len, f);
+}
+
+static long wtell(FILE *f)
+{
+    wbuf_t *wb = wbuf_find(f);
+    if (wb)
+        return wb->base + wb->len;
+    return ftell(f);
+}
+
+void w8(FILE *f, uint8_t v)
+{
+    wbuf_t *wb = wbuf_find(f);
+    if (wb)
+        wbuf_append(wb, &v, 1);
+    else
+        fputc(v, f);
 }
 
 void w16(FILE *f, uint16_t v)
 {
-    w8(f, v >> 8);
-    w8(f, v & 0xff);
+    uint8_t buf[2] = { v >> 8, v & 0xff };
+    wdata(f, buf, 2);
 }
 
 void w32(FILE *f, uint32_t v)
 {
-    w16(f, v >> 16);
-    w16(f, v & 0xffff);
+    uint8_t buf[4] = { v >> 24, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff };
+    wdata(f, buf, 4);
 }
 
 int w32_placeholder(FILE *f)
 {
-    int pos = ftell(f);
+    int pos = wtell(f);
     w32(f, 0);
     return pos;
 }
 
 void w32_at(FILE *f, int pos, uint32_t v)
 {
+    uint8_t buf[4] = { v >> 24, (v >> 16) & 0xff, (v >> 8) & 0xff, v & 0xff };
+    wbuf_t *wb = wbuf_find(f);
+    if (wb) {
+        wbuf_poke(wb, pos, buf, 4);
+        return;
+    }
     int cur = ftell(f);
     assert(cur >= 0);  // fail on pipes
     fseek(f, pos, SEEK_SET);
-    w32(f, v);
+    fwrite(buf, 1, 4, f);
     fseek(f, cur, SEEK_SET);
 }
 
 void walign(FILE *f, int align)
-{ 
-    int pos = ftell(f);
+{
+    int pos = wtell(f);
     assert(pos >= 0);  // fail on pipes
     while (pos++ % align) w8(f, 0);
 }
@@ -4,6 +4,11 @@
 /**
  * @file binout.h
  * @brief Helper to write binary big-endian data to a file
+ *
+ * A stream can opt into in-memory buffering with wbuf_open(): writes are
+ * staged in user-space and flushed with a vectored write by wbuf_close(),
+ * and w32_at() patches placeholders directly in the staged memory. Do not
+ * buffer a stream that other code also writes to with plain stdio calls.
  */
 
 #include <stdio.h>
@@ -12,9 +17,13 @@
 
 #define BITCAST_F2I(f)   ({ uint32_t __i; memcpy(&__i, &(f), 4); __i; })
 
+void wbuf_open(FILE *f);
+void wbuf_close(FILE *f);
+
 void w8(FILE *f, uint8_t v);
 void w16(FILE *f, uint16_t v);
 void w32(FILE *f, uint32_t v);
+void wdata(FILE *f, const void *data, size_t len);
 #define wf32(f, v) w32(f, BITCAST_F2I(v))
 
 int w32_placeholder(FILE *f);
@@ -0,0 +1,369 @@
+// Encoder for the LZE format, the level-3 asset compression.
+// See src/compress/lze_dec.c for the format description and the decoder.
+//
+// The parser is a classic hash-chain LZ77 with one-step lazy matching
+// (in the style of zlib's deflate): tokens are collected in a first pass,
+// the two Huffman code sets are built from the token statistics, and the
+// bit stream is emitted in a second pass.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "lze_compress.h"
+
+#define LZEC_WINDOW        16384
+#define LZEC_MIN_MATCH     3
+#define LZEC_MAX_MATCH     258
+#define LZEC_HASH_BITS     15
+#define LZEC_HASH_SIZE     (1 << LZEC_HASH_BITS)
+#define LZEC_CHAIN_LIMIT   1024
+
+#define LZEC_NUM_LITLEN    286
+#define LZEC_NUM_DIST      28
+#define LZEC_EOB           256
+#define LZEC_MAX_BITS      11
+
+// Base values and extra bits, mirrored from the decoder.
+static const uint16_t lzec_len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t lzec_len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t lzec_dist_base[28] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289,
+};
+static const uint8_t lzec_dist_extra[28] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+};
+
+// Map a match length (3..258) to its length code (0..28).
+static int lzec_len_code(int len)
+{
+    for (int i = 28; i >= 0; i--)
+        if (len >= lzec_len_base[i])
+            return i;
+    assert(0);
+    return -1;
+}
+
+// Map a match distance (1..16384) to its distance code (0..27).
+static int lzec_dist_code(int dist)
+{
+    for (int i = 27; i >= 0; i--)
+        if (dist >= lzec_dist_base[i])
+            return i;
+    assert(0);
+    return -1;
+}
+
+/** One parsed token: a literal (len == 0) or a match. */
+typedef struct {
+    uint16_t len;       ///< Match length (0 = literal)
+    uint16_t dist;      ///< Match distance
+    uint8_t lit;        ///< Literal byte (when len == 0)
+} lzec_token_t;
+
+/*************************************************
+ * Length-limited canonical Huffman construction
+ *************************************************/
+
+// Compute code lengths for the given frequencies, limited to
+// LZEC_MAX_BITS, using the two-queue Huffman algorithm followed by a
+// Kraft-sum fixup for the length limit.
+static void lzec_build_lengths(const uint32_t *freq, int num, uint8_t *lens)
+{
+    typedef struct { uint32_t freq; int left, right, depth; } node_t;
+    node_t nodes[LZEC_NUM_LITLEN * 2];
+    int leaves[LZEC_NUM_LITLEN];
+    int num_leaves = 0;
+
+    memset(lens, 0, num);
+
+    for (int i = 0; i < num; i++) {
+        if (freq[i]) {
+            nodes[num_leaves] = (node_t){ .freq = freq[i], .left = -1, .right = -1 };
+            leaves[num_leaves] = i;
+            num_leaves++;
+        }
+    }
+
+    if (num_leaves == 0)
+        return;
+    if (num_leaves == 1) {
+        lens[leaves[0]] = 1;
+        return;
+    }
+
+    // Sort leaves by frequency (insertion sort, the alphabets are small).
+    for (int i = 1; i < num_leaves; i++) {
+        node_t n = nodes[i];
+        int leaf = leaves[i];
+        int j = i - 1;
+        while (j >= 0 && nodes[j].freq > n.freq) {
+            nodes[j+1] = nodes[j];
+            leaves[j+1] = leaves[j];
+            j--;
+        }
+        nodes[j+1] = n;
+        leaves[j+1] = leaf;
+    }
+
+    // Two-queue merge: leaves are sorted, and internal nodes are produced
+    // in non-decreasing frequency order.
+    int num_nodes = num_leaves;
+    int leaf_head = 0, node_head = num_leaves;
+    while (num_nodes - node_head + (num_leaves - leaf_head) > 1) {
+        int picks[2];
+        for (int k = 0; k < 2; k++) {
+            if (leaf_head < num_leaves &&
+                (node_head >= num_nodes || nodes[leaf_head].freq <= nodes[node_head].freq))
+                picks[k] = leaf_head++;
+            else
+                picks[k] = node_head++;
+        }
+        nodes[num_nodes] = (node_t){
+            .freq = nodes[picks[0]].freq + nodes[picks[1]].freq,
+            .left = picks[0], .right = picks[1],
+        };
+        num_nodes++;
+    }
+
+    // Walk the tree top-down to assign depths (the root is the last node).
+    nodes[num_nodes-1].depth = 0;
+    for (int i = num_nodes-1; i >= 0; i--) {
+        if (nodes[i].left >= 0) {
+            nodes[nodes[i].left].depth = nodes[i].depth + 1;
+            nodes[nodes[i].right].depth = nodes[i].depth + 1;
+        }
+    }
+
+    for (int i = 0; i < num_leaves; i++) {
+        int d = nodes[i].depth;
+        if (d > LZEC_MAX_BITS)
+            d = LZEC_MAX_BITS;
+        if (d < 1)
+            d = 1;
+        lens[leaves[i]] = d;
+    }
+
+    // Fix up the Kraft sum if the length clamp oversubscribed the code
+    // space: lengthen the deepest codes still below the limit until the
+    // code is valid again.
+    int64_t kraft = 0;
+    for (int i = 0; i < num; i++)
+        if (lens[i])
+            kraft += 1 << (LZEC_MAX_BITS - lens[i]);
+    while (kraft > (1 << LZEC_MAX_BITS)) {
+        int best = -1;
+        for (int i = 0; i < num; i++)
+            if (lens[i] && lens[i] < LZEC_MAX_BITS && (best < 0 || lens[i] > lens[best]))
+                best = i;
+        assert(best >= 0);
+        kraft -= 1 << (LZEC_MAX_BITS - lens[best] - 1);
+        lens[best]++;
+    }
+}
+
+// Assign canonical codes from the code lengths (same convention as the
+// decoder's table builder).
+static void lzec_build_codes(const uint8_t *lens, int num, uint16_t *codes)
+{
+    int bl_count[LZEC_MAX_BITS+1] = {0};
+    uint32_t next_code[LZEC_MAX_BITS+1];
+
+    for (int i = 0; i < num; i++)
+        bl_count[lens[i]]++;
+    bl_count[0] = 0;
+
+    uint32_t code = 0;
+    for (int b = 1; b <= LZEC_MAX_BITS; b++) {
+        code = (code + bl_count[b-1]) << 1;
+        next_code[b] = code;
+    }
+
+    for (int i = 0; i < num; i++)
+        codes[i] = lens[i] ? next_code[lens[i]]++ : 0;
+}
+
+/*************************************************
+ * Bit writer (MSB first)
+ *************************************************/
+
+typedef struct {
+    uint8_t *buf;
+    int size, capacity;
+    uint64_t bits;
+    int nbits;
+} lzec_writer_t;
+
+static void lzec_putbyte(lzec_writer_t *w, uint8_t b)
+{
+    if (w->size == w->capacity) {
+        w->capacity = w->capacity ? w->capacity * 2 : 4096;
+        w->buf = realloc(w->buf, w->capacity);
+        assert(w->buf);
+    }
+    w->buf[w->size++] = b;
+}
+
+static void lzec_putbits(lzec_writer_t *w, uint32_t value, int n)
+{
+    w->bits |= (uint64_t)value << (64 - w->nbits - n);
+    w->nbits += n;
+    while (w->nbits >= 8) {
+        lzec_putbyte(w, w->bits >> 56);
+        w->bits <<= 8;
+        w->nbits -= 8;
+    }
+}
+
+static void lzec_flushbits(lzec_writer_t *w)
+{
+    if (w->nbits)
+        lzec_putbits(w, 0, 8 - (w->nbits & 7));
+}
+
+/*************************************************
+ * LZ77 parsing
+ *************************************************/
+
+static inline uint32_t lzec_hash(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - LZEC_HASH_BITS);
+}
+
+uint8_t *lze_compress(const uint8_t *src, int src_size, int *out_size)
+{
+    lzec_token_t *tokens = malloc((src_size + 1) * sizeof(lzec_token_t));
+    int num_tokens = 0;
+    assert(tokens);
+
+    int *head = malloc(LZEC_HASH_SIZE * sizeof(int));
+    int *prev = malloc(LZEC_WINDOW * sizeof(int));
+    for (int i = 0; i < LZEC_HASH_SIZE; i++)
+        head[i] = -1;
+
+    // Find the longest match for position pos; returns the length and
+    // fills *match_dist (0 if no acceptable match).
+    int pos = 0;
+    #define FIND_MATCH(pos, match_dist) ({ \
+        int best_len = 0; \
+        int p = (pos); \
+        *(match_dist) = 0; \
+        if (p + LZEC_MIN_MATCH <= src_size) { \
+            int limit = p - LZEC_WINDOW; \
+            int max_len = src_size - p; \
+            if (max_len > LZEC_MAX_MATCH) max_len = LZEC_MAX_MATCH; \
+            int chain = LZEC_CHAIN_LIMIT; \
+            for (int m = head[lzec_hash(src + p)]; m >= 0 && m > limit && chain--; m = prev[m & (LZEC_WINDOW-1)]) { \
+                if (src[m + best_len] != src[p + best_len]) continue; \
+                int l = 0; \
+                while (l < max_len && src[m + l] == src[p + l]) l++; \
+                if (l > best_len) { \
+                    best_len = l; \
+                    *(match_dist) = p - m; \
+                    if (l >= max_len) break; \
+                } \
+            } \
+        } \
+        best_len; \
+    })
+
+    #define INSERT(p) ({ \
+        if ((p) + LZEC_MIN_MATCH <= src_size) { \
+            uint32_t h = lzec_hash(src + (p)); \
+            prev[(p) & (LZEC_WINDOW-1)] = head[h]; \
+            head[h] = (p); \
+        } \
+    })
+
+    while (pos < src_size) {
+        int dist, len = FIND_MATCH(pos, &dist);
+
+        // One-step lazy matching: prefer a longer match starting at the
+        // next byte.
+        if (len >= LZEC_MIN_MATCH && pos + 1 < src_size) {
+            INSERT(pos);
+            int dist2, len2 = FIND_MATCH(pos + 1, &dist2);
+            if (len2 > len) {
+                tokens[num_tokens++] = (lzec_token_t){ .len = 0, .lit = src[pos] };
+                pos++;
+                len = len2;
+                dist = dist2;
+            }
+        } else if (len >= LZEC_MIN_MATCH) {
+            INSERT(pos);
+        }
+
+        if (len >= LZEC_MIN_MATCH) {
+            tokens[num_tokens++] = (lzec_token_t){ .len = len, .dist = dist };
+            // The first position was already inserted above.
+            for (int i = 1; i < len; i++)
+                INSERT(pos + i);
+            pos += len;
+        } else {
+            INSERT(pos);
+            tokens[num_tokens++] = (lzec_token_t){ .len = 0, .lit = src[pos] };
+            pos++;
+        }
+    }
+
+    free(head);
+    free(prev);
+
+    // Collect symbol statistics.
+    uint32_t litlen_freq[LZEC_NUM_LITLEN] = {0};
+    uint32_t dist_freq[LZEC_NUM_DIST] = {0};
+    litlen_freq[LZEC_EOB] = 1;
+    for (int i = 0; i < num_tokens; i++) {
+        if (tokens[i].len) {
+            litlen_freq[257 + lzec_len_code(tokens[i].len)]++;
+            dist_freq[lzec_dist_code(tokens[i].dist)]++;
+        } else {
+            litlen_freq[tokens[i].lit]++;
+        }
+    }
+
+    uint8_t litlen_lens[LZEC_NUM_LITLEN], dist_lens[LZEC_NUM_DIST];
+    uint16_t litlen_codes[LZEC_NUM_LITLEN], dist_codes[LZEC_NUM_DIST];
+    lzec_build_lengths(litlen_freq, LZEC_NUM_LITLEN, litlen_lens);
+    lzec_build_lengths(dist_freq, LZEC_NUM_DIST, dist_lens);
+    lzec_build_codes(litlen_lens, LZEC_NUM_LITLEN, litlen_codes);
+    lzec_build_codes(dist_lens, LZEC_NUM_DIST, dist_codes);
+
+    // Emit: code length prelude (4 bits per symbol, high nibble first),
+    // then the entropy-coded token stream, then the end-of-block symbol.
+    lzec_writer_t w = {0};
+    for (int i = 0; i < LZEC_NUM_LITLEN; i += 2)
+        lzec_putbyte(&w, (litlen_lens[i] << 4) | litlen_lens[i+1]);
+    for (int i = 0; i < LZEC_NUM_DIST; i += 2)
+        lzec_putbyte(&w, (dist_lens[i] << 4) | dist_lens[i+1]);
+
+    for (int i = 0; i < num_tokens; i++) {
+        if (tokens[i].len) {
+            int lc = lzec_len_code(tokens[i].len);
+            lzec_putbits(&w, litlen_codes[257 + lc], litlen_lens[257 + lc]);
+            if (lzec_len_extra[lc])
+                lzec_putbits(&w, tokens[i].len - lzec_len_base[lc], lzec_len_extra[lc]);
+            int dc = lzec_dist_code(tokens[i].dist);
+            lzec_putbits(&w, dist_codes[dc], dist_lens[dc]);
+            if (lzec_dist_extra[dc])
+                lzec_putbits(&w, tokens[i].dist - lzec_dist_base[dc], lzec_dist_extra[dc]);
+        } else {
+            lzec_putbits(&w, litlen_codes[tokens[i].lit], litlen_lens[tokens[i].lit]);
+        }
+    }
+    lzec_putbits(&w, litlen_codes[LZEC_EOB], litlen_lens[LZEC_EOB]);
+    lzec_flushbits(&w);
+
+    free(tokens);
+    *out_size = w.size;
+    return w.buf;
+}
@@ -0,0 +1,20 @@
+#ifndef COMMON_LZE_COMPRESS_H
+#define COMMON_LZE_COMPRESS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Compress a buffer in the LZE format (level-3 asset compression).
+ *
+ * LZE is LZ77 over a 16 KiB window with per-file static canonical Huffman
+ * coding of literals, match lengths and distances. See
+ * src/compress/lze_dec.c for the format description and the decoder.
+ *
+ * @param src       Input buffer
+ * @param src_size  Size of the input in bytes
+ * @param out_size  Filled with the size of the compressed output
+ * @return          Malloc'd buffer with the compressed data (caller frees)
+ */
+uint8_t *lze_compress(const uint8_t *src, int src_size, int *out_size);
+
+#endif
@@ -1015,7 +1015,12 @@ encode_alloc(
     dicsiz = (((unsigned long)1) << dicbit);
     txtsiz = dicsiz*2+maxmatch;
 
-    if (hash) return method;
+    if (hash) {
+        /* encode_end_st1() frees buf after each file: re-allocate it so
+           the encoder can be reused for the next one */
+        if (!buf) alloc_buf();
+        return method;
+    }
 
     alloc_buf();
 
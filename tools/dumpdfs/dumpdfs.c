@@ -33,9 +33,65 @@ static directory_entry_t* directories[MAX_DIRECTORY_DEPTH];
 static uint32_t directory_top = 0;
 static directory_entry_t *next_entry = 0;
 
+/* PI transaction timing simulation (-t mode)
+
+   On real hardware, every sector fetched during directory traversal and every
+   dfs_read is a PI DMA transaction. We estimate its duration with the standard
+   PI bus timing model: for each ROM page touched by the transfer the device
+   pays the access latency, and each 16-bit word costs the pulse width plus the
+   release time. All values are in PI bus cycles (62.5 MHz); the defaults match
+   the cartridge domain 1 configuration advertised in the ROM header
+   (0x80371240). A configurable per-transaction overhead accounts for the CPU
+   cost of setting up the DMA and servicing the completion interrupt. */
+
+#define PI_CLOCK_HZ 62500000.0
+
+static int sim_enabled = 0;
+static int sim_lat = 0x40;           /* PI_BSD_DOM1_LAT */
+static int sim_pwd = 0x12;           /* PI_BSD_DOM1_PWD */
+static int sim_rls = 0x03;           /* PI_BSD_DOM1_RLS */
+static int sim_pgs = 0x07;           /* PI_BSD_DOM1_PGS; page size = 2^(PGS+2) bytes */
+static double sim_overhead_us = 2.0; /* CPU cost per DMA transaction */
+
+static long long sim_cycles = 0;
+static long long sim_transactions = 0;
+static long long sim_bytes = 0;
+static long long sim_pages = 0;
+
+static void sim_transfer(uint32_t rom_offset, uint32_t len)
+{
+    if(!sim_enabled || len == 0)
+    {
+        return;
+    }
+
+    uint32_t page_size = 1 << (sim_pgs + 2);
+    long long pages = (long long)((rom_offset + len - 1) / page_size) - (rom_offset / page_size) + 1;
+
+    sim_cycles += pages * (sim_lat + 1);
+    sim_cycles += (long long)((len + 1) / 2) * (sim_pwd + 1 + sim_rls + 1);
+    sim_pages += pages;
+    sim_bytes += len;
+    sim_transactions++;
+}
+
+static void sim_reset()
+{
+    sim_cycles = 0;
+    sim_transactions = 0;
+    sim_bytes = 0;
+    sim_pages = 0;
+}
+
+static double sim_time_ms()
+{
+    return (sim_cycles / PI_CLOCK_HZ) * 1000.0 + (sim_transactions * sim_overhead_us) / 1000.0;
+}
+
 /* Handling DMA from ROM to RAM */
 static inline void grab_sector(void *cart_loc, void *ram_loc)
 {
+    sim_transfer( cart_loc - base_ptr, SECTOR_SIZE );
     memcpy( ram_loc, cart_loc, SECTOR_SIZE );
 }
 
@@ -652,6 +708,7 @@ int dfs_read(void * const buf, int size, int count, uint32_t handle)
         to_read = file->size - file->loc;
     }
 
+    sim_transfer(SWAPLONG(file->cart_start_loc) + file->loc, to_read);
     memcpy(buf, get_file_location(file->cart_start_loc, file->loc), to_read);
     file->loc += to_read;
 
@@ -724,6 +781,20 @@ void usage(void)
     printf("Usage:\n");
     printf("   dumpdfs -l file.dfs -- List contents\n");
     printf("   dumpdfs -e file.dfs file -- Extract single file to stdout\n");
+    printf("   dumpdfs -t file.dfs sequences.txt [options] -- Estimate on-hardware load time\n");
+    printf("\n");
+    printf("The sequence file contains one file path per line; blank lines separate\n");
+    printf("independent access sequences, '#' starts a comment. Each sequence is\n");
+    printf("simulated by opening and fully reading its files in order, and the\n");
+    printf("estimated PI transfer time is reported per sequence.\n");
+    printf("\n");
+    printf("Timing options (defaults match the standard cartridge domain 1 config):\n");
+    printf("   --lat n       PI access latency in PI cycles per page (default 0x40)\n");
+    printf("   --pwd n       PI pulse width in PI cycles per 16-bit word (default 0x12)\n");
+    printf("   --rls n       PI release time in PI cycles per 16-bit word (default 0x03)\n");
+    printf("   --pgs n       PI page size exponent; page is 2^(n+2) bytes (default 0x07)\n");
+    printf("   --overhead f  CPU overhead per DMA transaction, in us (default 2.0)\n");
+    printf("   --chunk n     Read files in chunks of n bytes instead of one read\n");
 }
 
 int main( int argc, char *argv[] )
@@ -846,6 +917,147 @@ int main( int argc, char *argv[] )
 
             break;
         }
+        case 't':
+        case 'T':
+        {
+            if (argc < 4)
+            {
+                usage();
+                return -1;
+            }
+
+            /* Parse timing options */
+            int chunk_size = 0;
+            for( int i = 4; i < argc; i += 2 )
+            {
+                if( i + 1 >= argc )
+                {
+                    usage();
+                    return -1;
+                }
+
+                if( !strcmp( argv[i], "--lat" ) ) { sim_lat = strtol( argv[i+1], 0, 0 ); }
+                else if( !strcmp( argv[i], "--pwd" ) ) { sim_pwd = strtol( argv[i+1], 0, 0 ); }
+                else if( !strcmp( argv[i], "--rls" ) ) { sim_rls = strtol( argv[i+1], 0, 0 ); }
+                else if( !strcmp( argv[i], "--pgs" ) ) { sim_pgs = strtol( argv[i+1], 0, 0 ); }
+                else if( !strcmp( argv[i], "--overhead" ) ) { sim_overhead_us = atof( argv[i+1] ); }
+                else if( !strcmp( argv[i], "--chunk" ) ) { chunk_size = strtol( argv[i+1], 0, 0 ); }
+                else
+                {
+                    usage();
+                    return -1;
+                }
+            }
+
+            /* Load the image */
+            FILE *fp = fopen( argv[2], "rb" );
+
+            if( !fp )
+            {
+                fprintf(stderr, "Cannot open image %s\n", argv[2]);
+                return -1;
+            }
+
+            fseek( fp, 0, SEEK_END );
+            int lSize = ftell( fp );
+            fseek( fp, 0, SEEK_SET );
+
+            void *filesystem = malloc( lSize );
+            fread( filesystem, 1, lSize, fp );
+            fclose( fp );
+
+            if (dfs_init_pc( filesystem, 1 ) != DFS_ESUCCESS)
+            {
+                fprintf(stderr, "Invalid DragonFS filesystem\n");
+                return -1;
+            }
+
+            FILE *seq = fopen( argv[3], "r" );
+
+            if( !seq )
+            {
+                fprintf(stderr, "Cannot open sequence file %s\n", argv[3]);
+                return -1;
+            }
+
+            sim_enabled = 1;
+            sim_reset();
+
+            char line[MAX_FILENAME_LEN + 16];
+            int seq_idx = 1;
+            int seq_files = 0;
+            double total_ms = 0;
+
+            while( 1 )
+            {
+                int at_eof = (fgets( line, sizeof(line), seq ) == NULL);
+
+                if( !at_eof )
+                {
+                    /* Strip comments and trailing whitespace */
+                    char *p = strchr( line, '#' );
+                    if( p ) { *p = 0; }
+                    p = line + strlen( line );
+                    while( p > line && (p[-1] == '\n' || p[-1] == '\r' || p[-1] == ' ' || p[-1] == '\t') ) { *--p = 0; }
+                }
+
+                if( at_eof || line[0] == 0 )
+                {
+                    /* End of a sequence: report and reset the counters */
+                    if( seq_files > 0 )
+                    {
+                        double ms = sim_time_ms();
+                        printf( "Sequence %d: %d files, %lld bytes, %lld transactions, %lld pages -> %.2f ms\n",
+                            seq_idx, seq_files, sim_bytes, sim_transactions, sim_pages, ms );
+                        total_ms += ms;
+                        seq_idx++;
+                        seq_files = 0;
+                        sim_reset();
+                    }
+
+                    if( at_eof ) { break; }
+                    continue;
+                }
+
+                /* Paths in the image are absolute; accept mkdfs profile files
+                   (and dfs_profile_dump output) which omit the leading '/' */
+                char path[MAX_FILENAME_LEN + 16];
+                snprintf( path, sizeof(path), "%s%s", line[0] == '/' ? "" : "/", line );
+
+                int fl = dfs_open( path );
+
+                if( fl <= 0 )
+                {
+                    fprintf(stderr, "WARNING: file not found in image: %s\n", path);
+                    continue;
+                }
+
+                int size = dfs_size( fl );
+                uint8_t *data = malloc( size > 0 ? size : 1 );
+                int left = size;
+
+                while( left > 0 )
+                {
+                    int n = (chunk_size > 0 && chunk_size < left) ? chunk_size : left;
+                    dfs_read( data, 1, n, fl );
+                    left -= n;
+                }
+
+                free( data );
+                dfs_close( fl );
+                seq_files++;
+            }
+
+            fclose( seq );
+
+            if( seq_idx > 2 )
+            {
+                printf( "Total: %.2f ms\n", total_ms );
+            }
+
+            free( filesystem );
+            break;
+        }
     }
 
     return 0;
@@ -4,11 +4,26 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
 #include "../common/binout.c"
 #include "../common/assetcomp.h"
 
+// Matches LZ4_DISTANCE_MAX: only the last 16 KiB of the dictionary are
+// reachable by matches, so a larger one would just waste ROM and RAM.
+#define DICT_MAX_SIZE   (16*1024)
+
 bool flag_verbose = false;
 
+typedef struct {
+    char *infn;             ///< Input file
+    char *outfn;            ///< Output file
+    int compression;        ///< Compression algorithm in effect for this file
+    int blocksize;          ///< Block size in effect for this file (0 = none)
+} job_t;
+
 void print_args(char * name)
 {
     fprintf(stderr, "%s -- Libdragon asset compression tool\n\n", name);
@@ -20,7 +35,14 @@ void print_args(char * name)
     fprintf(stderr, "Command-line flags:\n");
     fprintf(stderr, "   -v/--verbose          Verbose output\n");
     fprintf(stderr, "   -o/--output <dir>     Specify output directory (default: .)\n");
-    fprintf(stderr, "   -c/--compress <algo>  Compression: 0=none, 1=lha, 2=lzh5 (default: %d)\n", DEFAULT_COMPRESSION);
+    fprintf(stderr, "   -c/--compress <algo>  Compression: 0=none, 1=lz4, 2=lzh5, 3=lze (default: %d)\n", DEFAULT_COMPRESSION);
+    fprintf(stderr, "   -b/--blocks <kb>      Compress in independent <kb> KiB blocks, so that the\n");
+    fprintf(stderr, "                         file can be seeked via asset_fopen (not with -c 2)\n");
+    fprintf(stderr, "   -j/--jobs <n>         Compress up to <n> files in parallel (default: 1)\n");
+    fprintf(stderr, "   -d/--dict <file>      Compress against a shared dictionary (lz4 only);\n");
+    fprintf(stderr, "                         load it at runtime and register it with asset_set_dict\n");
+    fprintf(stderr, "   --train-dict <file>   Don't compress: train a shared dictionary on the\n");
+    fprintf(stderr, "                         input files and write it to <file>\n");
     fprintf(stderr, "\n");
 }
 
@@ -28,6 +50,12 @@ int main(int argc, char *argv[])
 {
     char *infn = NULL, *outdir = ".", *outfn = NULL;
     int compression = DEFAULT_COMPRESSION;
+    int blocksize = 0;
+    int num_jobs = 1;
+    char *dictfn = NULL, *trainfn = NULL;
+
+    job_t *jobs = calloc(argc, sizeof(job_t));
+    int count = 0;
 
     if (argc < 2) {
         print_args(argv[0]);
@@ -57,10 +85,43 @@ int main(int argc, char *argv[])
                     fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
                     return 1;
                 }
-                if (compression < 0 || compression > 2) {
+                if (compression < 0 || compression > 3) {
                     fprintf(stderr, "invalid compression algorithm: %d\n", compression);
                     return 1;
                 }
+            } else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--blocks")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                char extra; int kb;
+                if (sscanf(argv[i], "%d%c", &kb, &extra) != 1 || kb <= 0) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+                blocksize = kb * 1024;
+            } else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                char extra;
+                if (sscanf(argv[i], "%d%c", &num_jobs, &extra) != 1 || num_jobs <= 0) {
+                    fprintf(stderr, "invalid argument for %s: %s\n", argv[i-1], argv[i]);
+                    return 1;
+                }
+            } else if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--dict")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                dictfn = argv[i];
+            } else if (!strcmp(argv[i], "--train-dict")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                trainfn = argv[i];
             } else {
                 fprintf(stderr, "invalid flag: %s\n", argv[i]);
                 return 1;
@@ -68,17 +129,94 @@ int main(int argc, char *argv[])
             continue;
         }
 
+        // Record the job with the flags in effect at this point of the
+        // command line, so per-file flag ordering keeps working.
         infn = argv[i];
         char *basename = strrchr(infn, '/');
         if (!basename) basename = infn; else basename += 1;
-
         asprintf(&outfn, "%s/%s", outdir, basename);
 
-        if (flag_verbose)
-            printf("Compressing: %s => %s [algo=%d]\n", infn, outfn, compression);
+        jobs[count].infn = infn;
+        jobs[count].outfn = outfn;
+        jobs[count].compression = compression;
+        jobs[count].blocksize = blocksize;
+        count++;
+    }
 
-        asset_compress(infn, outfn, compression);
+    if (trainfn) {
+        char **infns = malloc(count * sizeof(char*));
+        for (int i = 0; i < count; i++) infns[i] = jobs[i].infn;
+        return asset_train_dict(infns, count, trainfn, DICT_MAX_SIZE) ? 0 : 1;
+    }
 
-        free(outfn);
+    uint8_t *dict = NULL; int dict_size = 0;
+    if (dictfn) {
+        FILE *df = fopen(dictfn, "rb");
+        if (!df) {
+            fprintf(stderr, "error opening dictionary file: %s\n", dictfn);
+            return 1;
+        }
+        fseek(df, 0, SEEK_END);
+        dict_size = ftell(df);
+        if (dict_size > DICT_MAX_SIZE) {
+            // Only the tail is reachable by matches anyway
+            fseek(df, dict_size - DICT_MAX_SIZE, SEEK_SET);
+            dict_size = DICT_MAX_SIZE;
+        } else {
+            fseek(df, 0, SEEK_SET);
+        }
+        dict = malloc(dict_size);
+        fread(dict, 1, dict_size, df);
+        fclose(df);
+    }
+
+    int errors = 0;
+
+#ifndef _WIN32
+    if (num_jobs > 1) {
+        // Process pool rather than threads: the lzh5 encoder keeps its
+        // state in globals, so each compression must run in its own
+        // address space.
+        int running = 0;
+        for (int i = 0; i < count; i++) {
+            if (running == num_jobs) {
+                int status;
+                if (wait(&status) > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+                    errors++;
+                running--;
+            }
+            if (flag_verbose)
+                printf("Compressing: %s => %s [algo=%d]\n", jobs[i].infn, jobs[i].outfn, jobs[i].compression);
+            pid_t pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                errors++;
+                continue;
+            }
+            if (pid == 0)
+                exit(asset_compress(jobs[i].infn, jobs[i].outfn, jobs[i].compression,
+                    jobs[i].blocksize, dict, dict_size) ? 0 : 1);
+            running++;
+        }
+        while (running > 0) {
+            int status;
+            if (wait(&status) > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+                errors++;
+            running--;
+        }
+        return errors ? 1 : 0;
+    }
+#else
+    if (num_jobs > 1)
+        fprintf(stderr, "warning: -j is not supported on this platform, compressing serially\n");
+#endif
+
+    for (int i = 0; i < count; i++) {
+        if (flag_verbose)
+            printf("Compressing: %s => %s [algo=%d]\n", jobs[i].infn, jobs[i].outfn, jobs[i].compression);
+        if (!asset_compress(jobs[i].infn, jobs[i].outfn, jobs[i].compression,
+                jobs[i].blocksize, dict, dict_size))
+            errors++;
     }
+    return errors ? 1 : 0;
 }
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include "dragonfs.h"
@@ -19,6 +20,243 @@
 uint8_t *dfs = NULL;
 uint32_t fs_size = 0;
 
+/* Path lookup index under construction (one record per file added) */
+struct lookup_record
+{
+    uint64_t hash;
+    uint32_t entry_offset;
+};
+
+struct lookup_record *lookup = NULL;
+int lookup_count = 0;
+int lookup_capacity = 0;
+
+/* Manifest under construction: content hash and layout of every file,
+   used for incremental rebuilds (-i) and written next to the image */
+struct manifest_record
+{
+    uint64_t hash;
+    uint32_t offset;
+    uint32_t size;
+    char *path;
+};
+
+struct manifest_record *manifest = NULL;
+int manifest_count = 0;
+int manifest_capacity = 0;
+
+/* Files waiting for data placement: directory entries are laid out during
+   the tree walk, but file data is placed in a second pass so a load-order
+   profile (-p) can group co-loaded files adjacently */
+struct pending_file
+{
+    uint32_t entry_offset;
+    char *host_path;
+    char *image_path;
+    uint32_t align;
+    int profile_order;
+    int scan_order;
+};
+
+struct pending_file *pending = NULL;
+int pending_count = 0;
+int pending_capacity = 0;
+
+uint32_t default_align = 0;
+
+/* FNV-1a 64-bit hash of a path, as used by the runtime hashed lookup.
+   Paths are hashed relative to the image root, without a leading slash. */
+uint64_t hash_path(const char * const path)
+{
+    uint64_t hash = DFS_FNV1A_OFFSET;
+
+    for(const char *p = path; *p; p++)
+    {
+        hash = (hash ^ (uint8_t)*p) * DFS_FNV1A_PRIME;
+    }
+
+    return hash;
+}
+
+/* Record a file in the path lookup index */
+int lookup_add(const char * const path, uint32_t entry_offset)
+{
+    if(lookup_count == lookup_capacity)
+    {
+        lookup_capacity = lookup_capacity ? lookup_capacity * 2 : 256;
+        lookup = realloc(lookup, lookup_capacity * sizeof(struct lookup_record));
+
+        if(!lookup)
+        {
+            return 0;
+        }
+    }
+
+    lookup[lookup_count].hash = hash_path(path);
+    lookup[lookup_count].entry_offset = entry_offset;
+    lookup_count++;
+
+    return 1;
+}
+
+/* FNV-1a 64-bit hash of file contents, for the rebuild manifest */
+uint64_t hash_data(const uint8_t * const data, uint32_t size)
+{
+    uint64_t hash = DFS_FNV1A_OFFSET;
+
+    for(uint32_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * DFS_FNV1A_PRIME;
+    }
+
+    return hash;
+}
+
+/* Record a file in the rebuild manifest */
+int manifest_add(const char * const path, uint64_t hash, uint32_t offset, uint32_t size)
+{
+    if(manifest_count == manifest_capacity)
+    {
+        manifest_capacity = manifest_capacity ? manifest_capacity * 2 : 256;
+        manifest = realloc(manifest, manifest_capacity * sizeof(struct manifest_record));
+
+        if(!manifest)
+        {
+            return 0;
+        }
+    }
+
+    manifest[manifest_count].hash = hash;
+    manifest[manifest_count].offset = offset;
+    manifest[manifest_count].size = size;
+    manifest[manifest_count].path = strdup(path);
+    manifest_count++;
+
+    return 1;
+}
+
+/* Queue a file for the data placement pass */
+int pending_add(uint32_t entry_offset, const char * const host_path, const char * const image_path)
+{
+    if(pending_count == pending_capacity)
+    {
+        pending_capacity = pending_capacity ? pending_capacity * 2 : 256;
+        pending = realloc(pending, pending_capacity * sizeof(struct pending_file));
+
+        if(!pending)
+        {
+            return 0;
+        }
+    }
+
+    pending[pending_count].entry_offset = entry_offset;
+    pending[pending_count].host_path = strdup(host_path);
+    pending[pending_count].image_path = strdup(image_path);
+    pending[pending_count].align = default_align;
+    pending[pending_count].profile_order = INT32_MAX;
+    pending[pending_count].scan_order = pending_count;
+    pending_count++;
+
+    return 1;
+}
+
+/* Order file data by profile position first, directory scan order second */
+int pending_compare(const void *a, const void *b)
+{
+    const struct pending_file *fa = a;
+    const struct pending_file *fb = b;
+
+    if(fa->profile_order != fb->profile_order)
+    {
+        return (fa->profile_order < fb->profile_order) ? -1 : 1;
+    }
+
+    return (fa->scan_order < fb->scan_order) ? -1 : 1;
+}
+
+/* Read a load-order profile: one image path per line in first-load order,
+   optionally followed by 'align=<bytes>', with '#' comments. Files listed
+   in the profile have their data placed adjacently, in profile order,
+   ahead of everything else. */
+int load_profile(const char * const fn)
+{
+    FILE *fp = fopen(fn, "r");
+
+    if(!fp)
+    {
+        fprintf(stderr, "Cannot open profile '%s' for read!\n", fn);
+        return 0;
+    }
+
+    char line[4096];
+    int order = 0;
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        char path[4096];
+        uint32_t align = 0;
+
+        if(line[0] == '#' || sscanf(line, "%4095s", path) != 1)
+        {
+            continue;
+        }
+
+        char *opt = strstr(line, "align=");
+
+        if(opt && sscanf(opt, "align=%u", &align) == 1)
+        {
+            if(align & (align - 1))
+            {
+                fprintf(stderr, "Alignment must be a power of two in profile line: %s", line);
+                fclose(fp);
+                return 0;
+            }
+        }
+
+        int found = 0;
+
+        for(int i = 0; i < pending_count; i++)
+        {
+            if(strcmp(pending[i].image_path, path) == 0)
+            {
+                pending[i].profile_order = order;
+
+                if(align)
+                {
+                    pending[i].align = align;
+                }
+
+                found = 1;
+                break;
+            }
+        }
+
+        if(!found)
+        {
+            fprintf(stderr, "Warning: profiled file not in filesystem: %s\n", path);
+        }
+
+        order++;
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+int lookup_compare(const void *a, const void *b)
+{
+    const struct lookup_record *ra = a;
+    const struct lookup_record *rb = b;
+
+    if(ra->hash != rb->hash)
+    {
+        return (ra->hash < rb->hash) ? -1 : 1;
+    }
+
+    /* Stable tie-break so the output is deterministic */
+    return (ra->entry_offset < rb->entry_offset) ? -1 : 1;
+}
+
 /* Offset from start of filesystem */
 inline uint32_t sector_offset(void *sector)
 {
@@ -58,6 +296,18 @@ uint32_t dfs_alloc(int size)
     return sector_offset(end);    
 }
 
+/* Like dfs_alloc, but pad the filesystem so the returned offset is aligned.
+   Alignments below SECTOR_SIZE are already guaranteed by the sector layout. */
+uint32_t dfs_alloc_aligned(int size, uint32_t align)
+{
+    if(align > SECTOR_SIZE && fs_size % align)
+    {
+        dfs_alloc(align - fs_size % align);
+    }
+
+    return dfs_alloc(size);
+}
+
 /* Add a new sector to the filesystem, return that sector pointer */
 uint32_t new_sector(void)
 {
@@ -79,23 +329,204 @@ void kill_fs()
 
 void print_help(const char * const prog_name)
 {
-    fprintf(stderr, "Usage: %s <File> <Directory>\n", prog_name);
+    fprintf(stderr, "Usage: %s [-i] [-p <Profile>] [-a <Align>] <File> <Directory>\n", prog_name);
     fprintf(stderr, "  where <File> is the resulting filesystem image\n");
     fprintf(stderr, "  and <Directory> is the directory (including subdirectories) to include\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  With -p, file data is laid out following the load-order profile: one image\n");
+    fprintf(stderr, "  path per line (optionally followed by 'align=<bytes>'), as recorded by the\n");
+    fprintf(stderr, "  dfs_profile_start/dfs_profile_dump runtime instrumentation. Files listed in\n");
+    fprintf(stderr, "  the profile are placed adjacently in that order, so a level load becomes a\n");
+    fprintf(stderr, "  near-sequential sweep of PI reads. A layout report is printed on stdout.\n");
+    fprintf(stderr, "  -a sets the default data alignment in bytes (power of two).\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  With -i, rebuild incrementally: only the extents of <File> that actually\n");
+    fprintf(stderr, "  changed are rewritten in place, and each changed range is reported on\n");
+    fprintf(stderr, "  stdout as 'CHANGED <start> <end>' so upload scripts can send only deltas.\n");
+    fprintf(stderr, "  A manifest of content hashes is kept in <File>.map to report which\n");
+    fprintf(stderr, "  files changed between builds.\n");
 }
 
-uint32_t add_file(const char * const file, uint32_t *size)
+/* Write the rebuild manifest: one line of content hash and layout per file */
+int write_manifest(const char * const fn)
 {
-    FILE *fp;
+    FILE *fp = fopen(fn, "w");
+
+    if(!fp)
+    {
+        return 0;
+    }
+
+    fprintf(fp, "# mkdfs manifest v1\n");
+
+    for(int i = 0; i < manifest_count; i++)
+    {
+        fprintf(fp, "%016llx %08x %08x %s\n", (unsigned long long)manifest[i].hash,
+            manifest[i].offset, manifest[i].size, manifest[i].path);
+    }
+
+    fclose(fp);
+    return 1;
+}
+
+/* Report which files changed content since the previous build, by comparing
+   their hashes against the old manifest. Purely informative: the in-place
+   patch below works on the actual image bytes. */
+void report_changed_files(const char * const fn)
+{
+    FILE *fp = fopen(fn, "r");
 
-    printf("Adding '%s' to filesystem image.\n", file);
+    if(!fp)
+    {
+        return;
+    }
+
+    char line[4096];
+
+    if(!fgets(line, sizeof(line), fp) || strncmp(line, "# mkdfs manifest v1", 19))
+    {
+        fclose(fp);
+        return;
+    }
+
+    /* Mark every current file as new until its path shows up in the old manifest */
+    int *seen = calloc(manifest_count, sizeof(int));
+
+    while(fgets(line, sizeof(line), fp))
+    {
+        unsigned long long hash;
+        uint32_t offset, size;
+        char path[4096];
+
+        if(sscanf(line, "%llx %x %x %4095[^\n]", &hash, &offset, &size, path) != 4)
+        {
+            continue;
+        }
+
+        for(int i = 0; i < manifest_count; i++)
+        {
+            if(strcmp(manifest[i].path, path) == 0)
+            {
+                seen[i] = 1;
+
+                if(manifest[i].hash != hash)
+                {
+                    printf("Changed: '%s'\n", path);
+                }
+
+                break;
+            }
+        }
+    }
+
+    for(int i = 0; i < manifest_count; i++)
+    {
+        if(!seen[i])
+        {
+            printf("New: '%s'\n", manifest[i].path);
+        }
+    }
+
+    free(seen);
+    fclose(fp);
+}
+
+/* Patch only the extents of the existing image that differ from the new one,
+   comparing sector by sector, and report every changed range. Returns the
+   number of bytes rewritten, or -1 if the image had to be written in full. */
+int64_t patch_image(const char * const fn)
+{
+    FILE *fp = fopen(fn, "r+b");
+
+    if(!fp)
+    {
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    uint32_t old_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t *old = malloc(old_size);
+
+    if(!old || fread(old, 1, old_size, fp) != old_size)
+    {
+        free(old);
+        fclose(fp);
+        return -1;
+    }
+
+    uint32_t common = old_size < fs_size ? old_size : fs_size;
+    int64_t patched = 0;
+    uint32_t range_start = 0;
+    int in_range = 0;
+
+    for(uint32_t off = 0; off <= common; off += SECTOR_SIZE)
+    {
+        uint32_t chunk = common - off < SECTOR_SIZE ? common - off : SECTOR_SIZE;
+        int differs = off < common && memcmp(old + off, dfs + off, chunk) != 0;
+
+        if(differs && !in_range)
+        {
+            range_start = off;
+            in_range = 1;
+        }
+        else if(!differs && in_range)
+        {
+            fseek(fp, range_start, SEEK_SET);
+            fwrite(dfs + range_start, 1, off - range_start, fp);
+            printf("CHANGED 0x%08x 0x%08x\n", range_start, off);
+            patched += off - range_start;
+            in_range = 0;
+        }
+    }
+
+    /* Anything past the old (or common) size is new data */
+    if(fs_size > common)
+    {
+        uint32_t start = in_range ? range_start : common;
+        fseek(fp, start, SEEK_SET);
+        fwrite(dfs + start, 1, fs_size - start, fp);
+        printf("CHANGED 0x%08x 0x%08x\n", start, fs_size);
+        patched += fs_size - start;
+    }
+    else if(in_range)
+    {
+        fseek(fp, range_start, SEEK_SET);
+        fwrite(dfs + range_start, 1, common - range_start, fp);
+        printf("CHANGED 0x%08x 0x%08x\n", range_start, common);
+        patched += common - range_start;
+    }
+
+    fflush(fp);
+
+    if(fs_size < old_size)
+    {
+        /* The image shrank: drop the stale tail */
+        if(ftruncate(fileno(fp), fs_size) < 0)
+        {
+            free(old);
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    free(old);
+    fclose(fp);
+    return patched;
+}
+
+/* Read the whole contents of a file into a malloc'd buffer */
+uint8_t *read_file(const char * const file, uint32_t *size)
+{
+    FILE *fp;
 
     fp = fopen(file, "rb");
 
     if(!fp)
     {
         fprintf(stderr, "Cannot open file '%s' for read!\n", file);
-        return 0;
+        return NULL;
     }
 
     fseek(fp, 0, SEEK_END);
@@ -105,25 +536,32 @@ uint32_t add_file(const char * const file, uint32_t *size)
     if (*size > 0x0FFFFFFF)
     {
         fprintf(stderr, "File '%s' too big for the filesystem!\n", file);
-        return 0;
+        fclose(fp);
+        return NULL;
     }
 
-    uint32_t blob = new_blob(*size);
-    uint8_t *data = sector_to_memory(blob);
+    uint8_t *data = malloc(*size ? *size : 1);
+
+    if(!data)
+    {
+        fclose(fp);
+        return NULL;
+    }
 
     int read = fread(data, 1, *size, fp);
     if (read < 0) {
         /* Wat? */
         fprintf(stderr, "Cannot add all contents of file '%s' to filesystem!\n", file);
+        free(data);
         fclose(fp);
-        return 0;    
+        return NULL;
     }
 
     fclose(fp);
-    return blob;
+    return data;
 }
 
-uint32_t add_directory(const char * const path)
+uint32_t add_directory(const char * const path, const char * const prefix)
 {
     directory_entry_t *tmp_entry;
     uint32_t first_entry = 0;
@@ -150,9 +588,10 @@ uint32_t add_directory(const char * const path)
             else
             {
                 char *file = malloc(strlen(path) + strlen(dp->d_name) + 2);
+                char *image_path = malloc(strlen(prefix) + strlen(dp->d_name) + 2);
                 struct stat stats;
 
-                if(!file)
+                if(!file || !image_path)
                 {
                     /* Out of memory */
                     return 0;
@@ -168,13 +607,22 @@ uint32_t add_directory(const char * const path)
 
                 strcat(file, dp->d_name);
 
+                /* Build the path as seen from the image root, for the lookup index */
+                strcpy(image_path, prefix);
+
+                if(prefix[0])
+                {
+                    strcat(image_path, "/");
+                }
+
+                strcat(image_path, dp->d_name);
+
                 /* Figure out if it is a directory or regular (windows doesn't include d_type in dirent) */
                 stat( file, &stats );
 
                 if(S_ISREG(stats.st_mode))
                 {
                     uint32_t new_entry = new_sector();
-                    uint32_t file_size = 0;
 
                     tmp_entry = sector_to_memory(new_entry);
                     tmp_entry->next_entry = 0;
@@ -183,17 +631,22 @@ uint32_t add_directory(const char * const path)
                     strncpy(tmp_entry->path, dp->d_name, MAX_FILENAME_LEN);
                     tmp_entry->path[MAX_FILENAME_LEN] = 0;
 
-                    uint32_t new_file = add_file(file, &file_size);
-
-                    if(!new_file)
+                    /* File data is placed later, once the load-order
+                       profile (if any) is known */
+                    if(!pending_add(new_entry, file, image_path))
                     {
                         free(file);
+                        free(image_path);
                         return 0;
                     }
 
-                    tmp_entry = sector_to_memory(new_entry);
-                    tmp_entry->file_pointer = SWAPLONG(new_file);
-                    tmp_entry->flags = SWAPLONG((FLAGS_FILE << 28) | (file_size & 0x0FFFFFFF));
+                    /* Remember the file in the path lookup index */
+                    if(!lookup_add(image_path, new_entry))
+                    {
+                        free(file);
+                        free(image_path);
+                        return 0;
+                    }
 
                     if(cur_entry)
                     {
@@ -217,12 +670,13 @@ uint32_t add_directory(const char * const path)
                     strncpy(tmp_entry->path, dp->d_name, MAX_FILENAME_LEN);
                     tmp_entry->path[MAX_FILENAME_LEN] = 0;
 
-                    uint32_t new_directory = add_directory(file);
+                    uint32_t new_directory = add_directory(file, image_path);
 
                     if(!new_directory)
                     {
                         fprintf(stderr, "Skipping empty directory: %s\n", file);
                         free(file);
+                        free(image_path);
                         continue;
                     }
 
@@ -241,6 +695,7 @@ uint32_t add_directory(const char * const path)
                 }
 
                 free(file);
+                free(image_path);
 
                 if(!first_entry)
                 {
@@ -257,14 +712,187 @@ uint32_t add_directory(const char * const path)
     return first_entry;
 }
 
+/* Data placement pass: lay out file data in profile order (co-loaded files
+   become adjacent, near-sequential PI reads), then everything else in scan
+   order, and patch the directory entries to point at it */
+int place_files(int report)
+{
+    qsort(pending, pending_count, sizeof(struct pending_file), pending_compare);
+
+    if(report)
+    {
+        printf("Layout report:\n");
+        printf("  %-10s %9s %6s  %s\n", "offset", "size", "align", "path");
+    }
+
+    uint64_t dedup_saved = 0;
+
+    /* Small-file cluster under construction (0: none yet) */
+    uint32_t cluster_off = 0;
+    uint32_t cluster_fill = 0;
+    int cluster_files = 0;
+    int cluster_count = 0;
+
+    for(int i = 0; i < pending_count; i++)
+    {
+        uint32_t file_size = 0;
+        uint8_t *data = read_file(pending[i].host_path, &file_size);
+
+        if(!data)
+        {
+            return 0;
+        }
+
+        uint64_t hash = hash_data(data, file_size);
+
+        /* Content-addressed deduplication: if a byte-identical blob is
+           already stored in the image (and satisfies this file's alignment),
+           point this directory entry at the existing extent instead of
+           storing a second copy. The manifest records the content hash and
+           layout of every placed file, so it doubles as the dedup index. */
+        uint32_t new_file = 0;
+        int shared = 0;
+        int clustered = 0;
+
+        for(int j = 0; j < manifest_count; j++)
+        {
+            if(manifest[j].hash == hash && manifest[j].size == file_size
+                && (pending[i].align <= SECTOR_SIZE || manifest[j].offset % pending[i].align == 0)
+                && memcmp(sector_to_memory(manifest[j].offset), data, file_size) == 0)
+            {
+                new_file = manifest[j].offset;
+                shared = 1;
+                dedup_saved += file_size;
+                break;
+            }
+        }
+
+        if(!shared)
+        {
+            printf("Adding '%s' to filesystem image.\n", pending[i].host_path);
+
+            if(file_size && file_size <= CLUSTER_FILE_MAX && pending[i].align <= SECTOR_SIZE)
+            {
+                /* Pack small files back to back into shared clusters, so a
+                   burst of tiny reads becomes one PI transfer of a cluster
+                   (served by the runtime cluster cache) instead of one
+                   transfer per file, and no per-file sector padding is
+                   wasted. 8-byte boundaries satisfy every alignment the
+                   runtime DMA paths require; stricter (sub-sector) requests
+                   from the profile are honored within the cluster. */
+                uint32_t suba = pending[i].align > 8 ? pending[i].align : 8;
+                uint32_t fill = (cluster_fill + suba - 1) & ~(suba - 1);
+
+                if(cluster_off == 0 || fill + file_size > CLUSTER_SIZE)
+                {
+                    cluster_off = dfs_alloc(CLUSTER_SIZE);
+                    cluster_count++;
+                    fill = 0;
+                }
+
+                new_file = cluster_off + fill;
+                cluster_fill = fill + file_size;
+                cluster_files++;
+                clustered = 1;
+            }
+            else
+            {
+                new_file = dfs_alloc_aligned(file_size, pending[i].align);
+            }
+
+            memcpy(sector_to_memory(new_file), data, file_size);
+        }
+        else
+        {
+            printf("Adding '%s' to filesystem image (sharing identical data).\n", pending[i].host_path);
+        }
+
+        free(data);
+
+        directory_entry_t *tmp_entry = sector_to_memory(pending[i].entry_offset);
+        tmp_entry->file_pointer = SWAPLONG(new_file);
+        tmp_entry->flags = SWAPLONG((FLAGS_FILE << 28) | (file_size & 0x0FFFFFFF));
+
+        /* Remember the file in the rebuild manifest */
+        if(!manifest_add(pending[i].image_path, hash, new_file, file_size))
+        {
+            return 0;
+        }
+
+        if(report)
+        {
+            printf("  0x%08x %9u %6u  %s%s%s%s\n", new_file, file_size,
+                clustered ? 8 : (pending[i].align > SECTOR_SIZE ? pending[i].align : SECTOR_SIZE),
+                pending[i].image_path,
+                pending[i].profile_order != INT32_MAX ? " [profiled]" : "",
+                shared ? " [shared]" : "",
+                clustered ? " [clustered]" : "");
+        }
+
+        free(pending[i].host_path);
+        free(pending[i].image_path);
+    }
+
+    if(dedup_saved)
+    {
+        printf("Deduplicated %llu bytes of identical file data.\n", (unsigned long long)dedup_saved);
+    }
+
+    if(cluster_files)
+    {
+        printf("Packed %d small files into %d clusters.\n", cluster_files, cluster_count);
+    }
+
+    free(pending);
+    return 1;
+}
+
 int main(int argc, char *argv[])
 {
-    if(argc != 3)
+    int incremental = 0;
+    const char *profile_file = NULL;
+    int argbase = 1;
+
+    while(argbase < argc && argv[argbase][0] == '-')
+    {
+        if(strcmp(argv[argbase], "-i") == 0)
+        {
+            incremental = 1;
+            argbase++;
+        }
+        else if(strcmp(argv[argbase], "-p") == 0 && argbase + 1 < argc)
+        {
+            profile_file = argv[argbase + 1];
+            argbase += 2;
+        }
+        else if(strcmp(argv[argbase], "-a") == 0 && argbase + 1 < argc)
+        {
+            default_align = strtoul(argv[argbase + 1], NULL, 0);
+
+            if(default_align & (default_align - 1))
+            {
+                fprintf(stderr, "Alignment must be a power of two: %s\n", argv[argbase + 1]);
+                return -1;
+            }
+
+            argbase += 2;
+        }
+        else
+        {
+            print_help(argv[0]);
+            return -1;
+        }
+    }
+
+    if(argc - argbase != 2)
     {
         print_help(argv[0]);
         return -1;
     }
 
+    const char *out_file = argv[argbase];
+    const char *in_directory = argv[argbase + 1];
+
     /* Add in identifier */
     directory_entry_t *id = sector_to_memory(new_sector());
 
@@ -279,23 +907,95 @@ int main(int argc, char *argv[])
     id->next_entry = SWAPLONG(ROOT_NEXT_ENTRY);
     strcpy(id->path, ROOT_PATH);
 
-    if(!add_directory(argv[2]))
+    if(!add_directory(in_directory, ""))
     {
         /* Error adding directory */
-        fprintf(stderr, "Error creating filesystem: directory is empty or does not exist: %s\n", argv[2]);
+        fprintf(stderr, "Error creating filesystem: directory is empty or does not exist: %s\n", in_directory);
+
+        kill_fs();
+
+        return -1;
+    }
+
+    if(profile_file && !load_profile(profile_file))
+    {
+        kill_fs();
+
+        return -1;
+    }
+
+    if(!place_files(profile_file || default_align))
+    {
+        fprintf(stderr, "Error creating filesystem: could not place file data\n");
 
         kill_fs();
 
         return -1;
     }
 
+    /* Append the path lookup index, sorted by hash so the runtime can
+       binary search it, and point the (otherwise unused) file_pointer of
+       the root sector at it. Old runtimes ignore the extra blob. */
+    qsort(lookup, lookup_count, sizeof(struct lookup_record), lookup_compare);
+
+    uint32_t index_offset = new_blob(sizeof(struct dfs_lookup_header) + lookup_count * sizeof(struct dfs_lookup_entry));
+
+    struct dfs_lookup_header *header = sector_to_memory(index_offset);
+    header->magic = SWAPLONG(DFS_LOOKUP_MAGIC);
+    header->num_entries = SWAPLONG(lookup_count);
+
+    struct dfs_lookup_entry *entries = sector_to_memory(index_offset + sizeof(struct dfs_lookup_header));
+
+    for(int i = 0; i < lookup_count; i++)
+    {
+        entries[i].hash_hi = SWAPLONG((uint32_t)(lookup[i].hash >> 32));
+        entries[i].hash_lo = SWAPLONG((uint32_t)(lookup[i].hash & 0xFFFFFFFF));
+        entries[i].entry_offset = SWAPLONG(lookup[i].entry_offset);
+    }
+
+    /* The filesystem buffer may have moved, re-fetch the root sector */
+    id = sector_to_memory(0);
+    id->file_pointer = SWAPLONG(index_offset);
+
+    free(lookup);
+
+    char *manifest_file = malloc(strlen(out_file) + 5);
+    sprintf(manifest_file, "%s.map", out_file);
+
+    if(incremental)
+    {
+        /* Report which files changed content since the previous build, then
+           patch only the image extents that actually differ */
+        report_changed_files(manifest_file);
+
+        int64_t patched = patch_image(out_file);
+
+        if(patched >= 0)
+        {
+            printf("Patched %lld of %u bytes in place.\n", (long long)patched, fs_size);
+
+            write_manifest(manifest_file);
+            free(manifest_file);
+
+            kill_fs();
+
+            return 0;
+        }
+
+        /* No previous image (or it could not be read): fall through to a
+           full write, reported as one changed range */
+        printf("CHANGED 0x%08x 0x%08x\n", 0, fs_size);
+    }
+
     /* Write out filesystem */
-    FILE *fp = fopen(argv[1], "wb");
+    FILE *fp = fopen(out_file, "wb");
 
     if(!fp)
     {
         /* Error writing file out */
-        fprintf(stderr, "Error opening '%s' for writing.\n", argv[1]);
+        fprintf(stderr, "Error opening '%s' for writing.\n", out_file);
+
+        free(manifest_file);
 
         kill_fs();
 
@@ -305,6 +1005,13 @@ int main(int argc, char *argv[])
     fwrite(dfs, 1, fs_size, fp);
     fclose(fp);
 
+    if(incremental)
+    {
+        write_manifest(manifest_file);
+    }
+
+    free(manifest_file);
+
     kill_fs();
 
     return 0;
@@ -0,0 +1,497 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <png.h>
+#include <sys/types.h>
+#include <sys/param.h>
+
+/**
+  * Texture atlas packer.  Reads a manifest of small PNG sprites, packs them
+  * into shared TMEM-sized sheets and emits:
+  *
+  *   <prefix>_<n>.sprite  - the sheets, regular sprite files loadable whole
+  *                          with rdp_load_texture (each fits TMEM)
+  *   <prefix>.atlas       - big-endian coordinate table, readable directly
+  *                          into memory on the N64 (see atlas_t in graphics.h)
+  *   <prefix>.h           - C header mapping each input to its entry index
+  *
+  * Manifest lines are "<tag> <input png>"; '#' starts a comment.  Sprites
+  * sharing a tag are packed into the same sheet(s), so sprites that are
+  * drawn together (one HUD screen, one menu) share a single TMEM load.
+  */
+
+#define BITDEPTH_16BPP      16
+#define BITDEPTH_32BPP      32
+
+#define FORMAT_UNCOMPRESSED 0
+
+/* RDP texture memory size; every emitted sheet must fit it whole */
+#define TMEM_SIZE 4096
+
+/* Maximum sheets, inputs and tag length the packer handles */
+#define MAX_SHEETS  64
+#define MAX_INPUTS  1024
+#define MAX_TAG     64
+
+#if BYTE_ORDER == BIG_ENDIAN
+#define SWAP_WORD(x) (x)
+#else
+#define SWAP_WORD(x) ((((x)>>8) & 0x00FF) | (((x)<<8) & 0xFF00))
+#endif
+
+/* One input sprite and where it ended up */
+typedef struct
+{
+    char tag[MAX_TAG];
+    char *png_file;
+    uint8_t *rgba;
+    int width;
+    int height;
+    int sheet;
+    int x;
+    int y;
+} input_t;
+
+static input_t inputs[MAX_INPUTS];
+static int num_inputs = 0;
+
+/* Decode a PNG into a plain RGBA8 buffer (caller frees) */
+int load_png_rgba( char *png_file, uint8_t **out, int *out_width, int *out_height )
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_uint_32 width, height;
+    int bit_depth, color_type, interlace_type;
+    FILE *fp;
+    uint8_t *rgba = NULL;
+
+    if ((fp = fopen(png_file, "rb")) == NULL)
+    {
+        return -ENOENT;
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_ptr ? png_create_info_struct( png_ptr ) : NULL;
+
+    if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr)))
+    {
+        free( rgba );
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -EINTR;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_read_info(png_ptr, info_ptr);
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+
+    if(color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png_ptr);
+    if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if(bit_depth == 16)
+        png_set_strip_16(png_ptr);
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_set_tRNS_to_alpha(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png_ptr);
+
+    /* Pad out a missing alpha channel so the output is always RGBA8 */
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    rgba = malloc( (size_t)width * height * 4 );
+
+    if( rgba == NULL )
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -ENOMEM;
+    }
+
+    {
+        png_bytep row_pointers[height];
+
+        for( int row = 0; row < height; row++ )
+        {
+            row_pointers[row] = rgba + row * width * 4;
+        }
+
+        png_read_image(png_ptr, row_pointers);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    fclose(fp);
+
+    *out = rgba;
+    *out_width = width;
+    *out_height = height;
+
+    return 0;
+}
+
+/* Sort inputs by tag first (keeps co-drawn sprites together), then by
+   descending height so the shelf packer wastes little vertical space */
+int compare_inputs( const void *a, const void *b )
+{
+    const input_t *ia = a, *ib = b;
+    int tag = strcmp( ia->tag, ib->tag );
+
+    if( tag )
+    {
+        return tag;
+    }
+
+    return ib->height - ia->height;
+}
+
+/* Shelf-pack all inputs into sheets of the given size.  A new sheet starts
+   whenever the current one is full or the tag changes, so a tag never shares
+   a sheet with another tag.  Returns the number of sheets, or -1. */
+int pack_inputs( int sheet_width, int sheet_height )
+{
+    int sheet = -1;
+    int shelf_x = 0, shelf_y = 0, shelf_h = 0;
+    const char *tag = NULL;
+
+    qsort( inputs, num_inputs, sizeof( input_t ), compare_inputs );
+
+    for( int i = 0; i < num_inputs; i++ )
+    {
+        input_t *in = &inputs[i];
+
+        if( in->width > sheet_width || in->height > sheet_height )
+        {
+            fprintf( stderr, "%s: %dx%d does not fit a %dx%d sheet, pack it separately\n",
+                in->png_file, in->width, in->height, sheet_width, sheet_height );
+            return -1;
+        }
+
+        /* New tag: always start a fresh sheet */
+        if( tag == NULL || strcmp( tag, in->tag ) != 0 )
+        {
+            tag = in->tag;
+            sheet++;
+            shelf_x = shelf_y = shelf_h = 0;
+        }
+
+        /* End of shelf: open the next one below */
+        if( shelf_x + in->width > sheet_width )
+        {
+            shelf_y += shelf_h;
+            shelf_x = shelf_h = 0;
+        }
+
+        /* Sheet full: continue the tag on a new sheet */
+        if( shelf_y + in->height > sheet_height )
+        {
+            sheet++;
+            shelf_x = shelf_y = shelf_h = 0;
+        }
+
+        in->sheet = sheet;
+        in->x = shelf_x;
+        in->y = shelf_y;
+        shelf_x += in->width;
+        shelf_h = MAX( shelf_h, in->height );
+    }
+
+    return sheet + 1;
+}
+
+/* Write one packed sheet as a regular sprite file */
+int write_sheet( char *filename, int sheet, int sheet_width, int sheet_height, int depth )
+{
+    int pixbytes = (depth == BITDEPTH_32BPP) ? 4 : 2;
+    uint8_t *canvas = calloc( sheet_width * sheet_height, 4 );
+    FILE *op;
+    uint8_t wval8;
+    uint16_t wval16;
+
+    if( canvas == NULL )
+    {
+        return -ENOMEM;
+    }
+
+    /* Blit every sprite assigned to this sheet onto the RGBA canvas */
+    for( int i = 0; i < num_inputs; i++ )
+    {
+        input_t *in = &inputs[i];
+
+        if( in->sheet != sheet )
+        {
+            continue;
+        }
+
+        for( int row = 0; row < in->height; row++ )
+        {
+            memcpy( &canvas[((in->y + row) * sheet_width + in->x) * 4],
+                    &in->rgba[row * in->width * 4], in->width * 4 );
+        }
+    }
+
+    if ((op = fopen(filename, "wb")) == NULL)
+    {
+        free( canvas );
+        return -ENOENT;
+    }
+
+    /* Regular sprite header: the sheet is loadable with rdp_load_texture */
+    wval16 = SWAP_WORD((uint16_t)sheet_width);
+    fwrite( &wval16, sizeof( wval16 ), 1, op );
+    wval16 = SWAP_WORD((uint16_t)sheet_height);
+    fwrite( &wval16, sizeof( wval16 ), 1, op );
+    wval8 = pixbytes;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+    wval8 = FORMAT_UNCOMPRESSED;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+    wval8 = 1;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+
+    for( long i = 0; i < (long)sheet_width * sheet_height; i++ )
+    {
+        uint8_t *px = &canvas[i * 4];
+
+        if( pixbytes == 2 )
+        {
+            uint16_t val = SWAP_WORD((((px[0] >> 3) & 0x1F) << 11) | (((px[1] >> 3) & 0x1F) << 6) |
+                           (((px[2] >> 3) & 0x1F) << 1) | (px[3] >> 7));
+
+            fwrite( &val, 2, 1, op );
+        }
+        else
+        {
+            fwrite( px, 4, 1, op );
+        }
+    }
+
+    fclose( op );
+    free( canvas );
+
+    return 0;
+}
+
+/* Turn an input file name into a C identifier for the generated header */
+void sanitize_name( const char *path, char *out, int outlen )
+{
+    /* Use the basename without extension */
+    const char *base = strrchr( path, '/' );
+    base = base ? base + 1 : path;
+
+    int n = 0;
+
+    while( *base && *base != '.' && n < outlen - 1 )
+    {
+        out[n++] = isalnum( (unsigned char)*base ) ? toupper( (unsigned char)*base ) : '_';
+        base++;
+    }
+
+    out[n] = 0;
+}
+
+void print_args( char * name )
+{
+    fprintf( stderr, "Usage: %s [-d <bit depth>] -o <prefix> <manifest>\n", name );
+    fprintf( stderr, "\t<manifest> lists one sprite per line as '<tag> <input png>' ('#' starts a comment). Sprites sharing a tag are packed into the same sheet(s).\n" );
+    fprintf( stderr, "\t-d selects the sheet bit depth, 16 (default) or 32.\n" );
+    fprintf( stderr, "\t-o names the outputs: <prefix>_<n>.sprite sheets, a <prefix>.atlas coordinate table and a <prefix>.h index header.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+    int depth = BITDEPTH_16BPP;
+    char *prefix = NULL;
+
+    while( argc > 1 )
+    {
+        if( strcmp( argv[1], "-d" ) == 0 && argc > 2 )
+        {
+            depth = atoi( argv[2] ) == 32 ? BITDEPTH_32BPP : BITDEPTH_16BPP;
+            argv += 2;
+            argc -= 2;
+        }
+        else if( strcmp( argv[1], "-o" ) == 0 && argc > 2 )
+        {
+            prefix = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( prefix == NULL || argc != 2 )
+    {
+        print_args( argv[0] );
+        return -EINVAL;
+    }
+
+    /* Read the manifest and decode every input */
+    FILE *fp;
+    char line[1024];
+    int lineno = 0;
+
+    if( (fp = fopen( argv[1], "r" )) == NULL )
+    {
+        fprintf( stderr, "Cannot open manifest %s!\n", argv[1] );
+        return -ENOENT;
+    }
+
+    while( fgets( line, sizeof( line ), fp ) )
+    {
+        lineno++;
+
+        char *p = line + strspn( line, " \t\r\n" );
+        if( *p == 0 || *p == '#' )
+        {
+            continue;
+        }
+
+        if( num_inputs == MAX_INPUTS )
+        {
+            fprintf( stderr, "Too many inputs (max %d)\n", MAX_INPUTS );
+            fclose( fp );
+            return -EINVAL;
+        }
+
+        char *tag = strtok( p, " \t\r\n" );
+        char *png = strtok( NULL, " \t\r\n" );
+
+        if( tag == NULL || png == NULL )
+        {
+            fprintf( stderr, "Manifest line %d: expected '<tag> <input png>'\n", lineno );
+            fclose( fp );
+            return -EINVAL;
+        }
+
+        input_t *in = &inputs[num_inputs];
+        strncpy( in->tag, tag, MAX_TAG - 1 );
+        in->png_file = strdup( png );
+
+        if( load_png_rgba( png, &in->rgba, &in->width, &in->height ) )
+        {
+            fprintf( stderr, "%s: cannot read PNG\n", png );
+            fclose( fp );
+            return -ENOENT;
+        }
+
+        num_inputs++;
+    }
+
+    fclose( fp );
+
+    if( num_inputs == 0 )
+    {
+        fprintf( stderr, "Manifest lists no sprites\n" );
+        return -EINVAL;
+    }
+
+    /* Sheet dimensions filling TMEM exactly at the chosen depth */
+    int pixbytes = (depth == BITDEPTH_32BPP) ? 4 : 2;
+    int sheet_width = (depth == BITDEPTH_32BPP) ? 32 : 64;
+    int sheet_height = TMEM_SIZE / (sheet_width * pixbytes);
+
+    int num_sheets = pack_inputs( sheet_width, sheet_height );
+
+    if( num_sheets < 0 )
+    {
+        return -EINVAL;
+    }
+
+    if( num_sheets > MAX_SHEETS )
+    {
+        fprintf( stderr, "Too many sheets (%d, max %d)\n", num_sheets, MAX_SHEETS );
+        return -EINVAL;
+    }
+
+    char filename[1024];
+
+    /* Emit the sheets */
+    for( int sheet = 0; sheet < num_sheets; sheet++ )
+    {
+        snprintf( filename, sizeof( filename ), "%s_%d.sprite", prefix, sheet );
+
+        if( write_sheet( filename, sheet, sheet_width, sheet_height, depth ) )
+        {
+            fprintf( stderr, "Cannot write sheet %s!\n", filename );
+            return -ENOENT;
+        }
+    }
+
+    /* Emit the big-endian coordinate table (atlas_t in graphics.h) */
+    snprintf( filename, sizeof( filename ), "%s.atlas", prefix );
+    FILE *op = fopen( filename, "wb" );
+
+    if( op == NULL )
+    {
+        fprintf( stderr, "Cannot write atlas %s!\n", filename );
+        return -ENOENT;
+    }
+
+    uint16_t wval16;
+    fwrite( "ATL1", 1, 4, op );
+    wval16 = SWAP_WORD((uint16_t)num_inputs);
+    fwrite( &wval16, 2, 1, op );
+    wval16 = SWAP_WORD((uint16_t)num_sheets);
+    fwrite( &wval16, 2, 1, op );
+
+    for( int i = 0; i < num_inputs; i++ )
+    {
+        uint8_t sheet = inputs[i].sheet;
+        uint8_t pad = 0;
+
+        fwrite( &sheet, 1, 1, op );
+        fwrite( &pad, 1, 1, op );
+        wval16 = SWAP_WORD((uint16_t)inputs[i].x);
+        fwrite( &wval16, 2, 1, op );
+        wval16 = SWAP_WORD((uint16_t)inputs[i].y);
+        fwrite( &wval16, 2, 1, op );
+        wval16 = SWAP_WORD((uint16_t)inputs[i].width);
+        fwrite( &wval16, 2, 1, op );
+        wval16 = SWAP_WORD((uint16_t)inputs[i].height);
+        fwrite( &wval16, 2, 1, op );
+    }
+
+    fclose( op );
+
+    /* Emit the index header so entries can be addressed by name */
+    snprintf( filename, sizeof( filename ), "%s.h", prefix );
+    op = fopen( filename, "w" );
+
+    if( op == NULL )
+    {
+        fprintf( stderr, "Cannot write header %s!\n", filename );
+        return -ENOENT;
+    }
+
+    char guard[256], ident[256];
+    sanitize_name( prefix, guard, sizeof( guard ) );
+
+    fprintf( op, "/* Generated by mkatlas, do not edit */\n" );
+    fprintf( op, "#ifndef __ATLAS_%s_H\n#define __ATLAS_%s_H\n\n", guard, guard );
+
+    for( int i = 0; i < num_inputs; i++ )
+    {
+        sanitize_name( inputs[i].png_file, ident, sizeof( ident ) );
+        fprintf( op, "#define ATLAS_%s_%s %d /* sheet %d at %d,%d %dx%d */\n",
+            guard, ident, i, inputs[i].sheet, inputs[i].x, inputs[i].y,
+            inputs[i].width, inputs[i].height );
+    }
+
+    fprintf( op, "\n#endif\n" );
+    fclose( op );
+
+    fprintf( stderr, "Packed %d sprites into %d sheet(s) of %dx%d\n",
+        num_inputs, num_sheets, sheet_width, sheet_height );
+
+    return 0;
+}
@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <png.h>
+#include <sys/types.h>
+#include <sys/param.h>
+
+/**
+  * Bitmap font compiler.  Reads a font in the BMFont text format (a ".fnt"
+  * descriptor plus its PNG page images, as generated from a TTF by BMFont,
+  * Hiero and similar tools) and emits a single ".font64" file:
+  *
+  *   - per-glyph metrics (offsets and advances) and the kerning pairs
+  *   - the glyph bitmaps repacked into CI4 atlas sheets that each fit the
+  *     low half of TMEM, quantized against one shared 16 color palette
+  *
+  * The file is written big-endian and is used in place by the font64
+  * runtime (see font64.h): the palette and sheets are loaded once and text
+  * is drawn with one textured rectangle per glyph.
+  */
+
+/* Atlas sheet dimensions: 128x32 CI4 texels are 2048 bytes, the low half
+   of TMEM (the high half holds the palette) */
+#define SHEET_WIDTH 128
+#define SHEET_HEIGHT 32
+
+/* Limits of the font64 format */
+#define MAX_SHEETS 8
+#define MAX_PAGES 8
+#define MAX_GLYPHS 256
+#define MAX_KERNS 2048
+
+#define FORMAT_CI4 4
+#define FORMAT_SHARED_PALETTE 8
+
+/* One glyph parsed from the descriptor and where it was packed */
+typedef struct
+{
+    int id;
+    int page;
+    int x, y;
+    int width, height;
+    int xofs, yofs;
+    int xadvance;
+    int sheet;
+    int sx, sy;
+} glyph_t;
+
+/* One kerning pair parsed from the descriptor */
+typedef struct
+{
+    int first;
+    int second;
+    int amount;
+} kern_t;
+
+static glyph_t glyphs[MAX_GLYPHS];
+static int num_glyphs = 0;
+static kern_t kerns[MAX_KERNS];
+static int num_kerns = 0;
+static uint8_t *pages[MAX_PAGES];
+static int page_width[MAX_PAGES], page_height[MAX_PAGES];
+static int num_pages = 0;
+static int line_height = 0;
+static int baseline = 0;
+
+/* Decode a PNG into a plain RGBA8 buffer (caller frees) */
+int load_png_rgba( char *png_file, uint8_t **out, int *out_width, int *out_height )
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_uint_32 width, height;
+    int bit_depth, color_type, interlace_type;
+    FILE *fp;
+    uint8_t *rgba = NULL;
+
+    if ((fp = fopen(png_file, "rb")) == NULL)
+    {
+        return -ENOENT;
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_ptr ? png_create_info_struct( png_ptr ) : NULL;
+
+    if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr)))
+    {
+        free( rgba );
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -EINTR;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_read_info(png_ptr, info_ptr);
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+
+    if(color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png_ptr);
+    if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if(bit_depth == 16)
+        png_set_strip_16(png_ptr);
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_set_tRNS_to_alpha(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png_ptr);
+
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    rgba = malloc( width * height * 4 );
+
+    if( rgba == NULL )
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -ENOMEM;
+    }
+
+    {
+        png_bytep row_pointers[height];
+
+        for( int row = 0; row < height; row++ )
+        {
+            row_pointers[row] = rgba + row * width * 4;
+        }
+
+        png_read_image(png_ptr, row_pointers);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    fclose(fp);
+
+    *out = rgba;
+    *out_width = width;
+    *out_height = height;
+
+    return 0;
+}
+
+/* Read one "key=value" integer attribute off a BMFont descriptor line */
+int tag_int( const char *line, const char *key )
+{
+    char pattern[64];
+
+    snprintf( pattern, sizeof( pattern ), " %s=", key );
+
+    const char *p = strstr( line, pattern );
+
+    return p ? atoi( p + strlen( pattern ) ) : 0;
+}
+
+/* Read one quoted "key=\"value\"" string attribute off a descriptor line */
+int tag_str( const char *line, const char *key, char *out, int outlen )
+{
+    char pattern[64];
+
+    snprintf( pattern, sizeof( pattern ), " %s=\"", key );
+
+    const char *p = strstr( line, pattern );
+
+    if( p == NULL )
+    {
+        return -EINVAL;
+    }
+
+    p += strlen( pattern );
+
+    int n = 0;
+
+    while( *p && *p != '"' && n < outlen - 1 )
+    {
+        out[n++] = *p++;
+    }
+
+    out[n] = 0;
+
+    return 0;
+}
+
+/* Parse the BMFont text descriptor and load its page images.  Page file
+   names are relative to the descriptor's own directory. */
+int parse_fnt( char *fnt_file )
+{
+    FILE *fp;
+    char line[1024];
+
+    if( (fp = fopen( fnt_file, "r" )) == NULL )
+    {
+        fprintf( stderr, "Cannot open font descriptor %s!\n", fnt_file );
+        return -ENOENT;
+    }
+
+    /* Directory prefix of the descriptor, for resolving page files */
+    char dir[1024] = "";
+    const char *slash = strrchr( fnt_file, '/' );
+
+    if( slash )
+    {
+        snprintf( dir, sizeof( dir ), "%.*s", (int)(slash - fnt_file + 1), fnt_file );
+    }
+
+    while( fgets( line, sizeof( line ), fp ) )
+    {
+        if( strncmp( line, "common ", 7 ) == 0 )
+        {
+            line_height = tag_int( line, "lineHeight" );
+            baseline = tag_int( line, "base" );
+        }
+        else if( strncmp( line, "page ", 5 ) == 0 )
+        {
+            int id = tag_int( line, "id" );
+            char file[512], path[1600];
+
+            if( id < 0 || id >= MAX_PAGES || tag_str( line, "file", file, sizeof( file ) ) )
+            {
+                fprintf( stderr, "%s: bad page line: %s", fnt_file, line );
+                fclose( fp );
+                return -EINVAL;
+            }
+
+            snprintf( path, sizeof( path ), "%s%s", dir, file );
+
+            if( load_png_rgba( path, &pages[id], &page_width[id], &page_height[id] ) )
+            {
+                fprintf( stderr, "%s: cannot read page image %s\n", fnt_file, path );
+                fclose( fp );
+                return -ENOENT;
+            }
+
+            if( id >= num_pages )
+            {
+                num_pages = id + 1;
+            }
+        }
+        else if( strncmp( line, "char ", 5 ) == 0 )
+        {
+            int id = tag_int( line, "id" );
+
+            /* The format covers single-byte codes; skip anything beyond */
+            if( id < 0 || id > 255 )
+            {
+                continue;
+            }
+
+            if( num_glyphs == MAX_GLYPHS )
+            {
+                fprintf( stderr, "%s: too many glyphs (max %d)\n", fnt_file, MAX_GLYPHS );
+                fclose( fp );
+                return -EINVAL;
+            }
+
+            glyph_t *g = &glyphs[num_glyphs++];
+
+            g->id = id;
+            g->page = tag_int( line, "page" );
+            g->x = tag_int( line, "x" );
+            g->y = tag_int( line, "y" );
+            g->width = tag_int( line, "width" );
+            g->height = tag_int( line, "height" );
+            g->xofs = tag_int( line, "xoffset" );
+            g->yofs = tag_int( line, "yoffset" );
+            g->xadvance = tag_int( line, "xadvance" );
+            g->sheet = 0;
+        }
+        else if( strncmp( line, "kerning ", 8 ) == 0 )
+        {
+            if( num_kerns == MAX_KERNS )
+            {
+                fprintf( stderr, "%s: too many kerning pairs (max %d)\n", fnt_file, MAX_KERNS );
+                fclose( fp );
+                return -EINVAL;
+            }
+
+            kern_t *k = &kerns[num_kerns++];
+
+            k->first = tag_int( line, "first" );
+            k->second = tag_int( line, "second" );
+            k->amount = tag_int( line, "amount" );
+        }
+    }
+
+    fclose( fp );
+
+    if( line_height == 0 || num_glyphs == 0 || num_pages == 0 )
+    {
+        fprintf( stderr, "%s: not a BMFont text descriptor (missing common/char/page lines)\n", fnt_file );
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* Shelf-pack the glyph bitmaps into CI4 atlas sheets, keeping character
+   order so runs of consecutive glyphs land on the same sheet.  Glyph X
+   positions are kept even so every bitmap starts on a whole CI4 byte.
+   Returns the number of sheets, or -1. */
+int pack_glyphs( void )
+{
+    int sheet = 0;
+    int shelf_x = 0, shelf_y = 0, shelf_h = 0;
+
+    for( int i = 0; i < num_glyphs; i++ )
+    {
+        glyph_t *g = &glyphs[i];
+
+        if( g->width == 0 || g->height == 0 )
+        {
+            continue;
+        }
+
+        if( g->width > SHEET_WIDTH || g->height > SHEET_HEIGHT )
+        {
+            fprintf( stderr, "Glyph %d is %dx%d, larger than a %dx%d sheet; use a smaller font size\n",
+                g->id, g->width, g->height, SHEET_WIDTH, SHEET_HEIGHT );
+            return -1;
+        }
+
+        /* End of shelf: open the next one below */
+        if( shelf_x + g->width > SHEET_WIDTH )
+        {
+            shelf_y += shelf_h;
+            shelf_x = shelf_h = 0;
+        }
+
+        /* Sheet full: continue on a new sheet */
+        if( shelf_y + g->height > SHEET_HEIGHT )
+        {
+            sheet++;
+            shelf_x = shelf_y = shelf_h = 0;
+        }
+
+        if( sheet == MAX_SHEETS )
+        {
+            fprintf( stderr, "Font does not fit %d atlas sheets; use a smaller font size\n", MAX_SHEETS );
+            return -1;
+        }
+
+        g->sheet = sheet;
+        g->sx = shelf_x;
+        g->sy = shelf_y;
+        shelf_x += (g->width + 1) & ~1;
+        shelf_h = MAX( shelf_h, g->height );
+    }
+
+    return sheet + 1;
+}
+
+/* Pack an RGBA8 color to a host-order RGBA16 (5551) value */
+uint16_t pack_rgba16( uint8_t *rgba )
+{
+    if( rgba[3] < 128 )
+    {
+        return 0;
+    }
+
+    return (((rgba[0] >> 3) & 0x1F) << 11) | (((rgba[1] >> 3) & 0x1F) << 6) |
+           (((rgba[2] >> 3) & 0x1F) << 1) | 1;
+}
+
+/* Map a color to its palette index, growing the palette on first sight.
+   Entry 0 is reserved for fully transparent pixels.  Returns -1 when a
+   17th color shows up. */
+int palette_index( uint16_t *palette, int *ncolors, uint16_t color )
+{
+    if( color == 0 )
+    {
+        return 0;
+    }
+
+    for( int i = 1; i < *ncolors; i++ )
+    {
+        if( palette[i] == color )
+        {
+            return i;
+        }
+    }
+
+    if( *ncolors == 16 )
+    {
+        return -1;
+    }
+
+    palette[(*ncolors)++] = color;
+
+    return *ncolors - 1;
+}
+
+void fwrite_u16( FILE *fp, uint16_t val )
+{
+    uint8_t buf[2] = { val >> 8, val };
+
+    fwrite( buf, 1, 2, fp );
+}
+
+void fwrite_u32( FILE *fp, uint32_t val )
+{
+    uint8_t buf[4] = { val >> 24, val >> 16, val >> 8, val };
+
+    fwrite( buf, 1, 4, fp );
+}
+
+void print_args( char * name )
+{
+    fprintf( stderr, "Usage: %s -o <output font64> <input fnt>\n", name );
+    fprintf( stderr, "\t<input fnt> is a font in the BMFont text format; its PNG page images are read from the same directory. Tools like BMFont and Hiero generate this format from a TTF.\n" );
+    fprintf( stderr, "\t-o names the output, loadable on the N64 with font64_load.\n" );
+    fprintf( stderr, "\tGlyphs may use at most 15 colors beside transparency (RGBA16 has a 1-bit alpha, so antialiased edges are thresholded).\n" );
+}
+
+int compare_kerns( const void *a, const void *b )
+{
+    const kern_t *ka = a, *kb = b;
+
+    if( ka->first != kb->first )
+    {
+        return ka->first - kb->first;
+    }
+
+    return ka->second - kb->second;
+}
+
+int main( int argc, char *argv[] )
+{
+    char *output = NULL;
+
+    while( argc > 1 )
+    {
+        if( strcmp( argv[1], "-o" ) == 0 && argc > 2 )
+        {
+            output = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( output == NULL || argc != 2 )
+    {
+        print_args( argv[0] );
+        return -EINVAL;
+    }
+
+    if( parse_fnt( argv[1] ) )
+    {
+        return -EINVAL;
+    }
+
+    /* The glyph table is indexed by character code */
+    int first_char = 256, last_char = 0;
+
+    for( int i = 0; i < num_glyphs; i++ )
+    {
+        if( glyphs[i].id < first_char ) { first_char = glyphs[i].id; }
+        if( glyphs[i].id > last_char ) { last_char = glyphs[i].id; }
+    }
+
+    int num_chars = last_char - first_char + 1;
+
+    if( num_chars > 256 )
+    {
+        fprintf( stderr, "Glyph table spans %d codes, more than the format holds\n", num_chars );
+        return -EINVAL;
+    }
+
+    int num_sheets = pack_glyphs();
+
+    if( num_sheets < 0 )
+    {
+        return -EINVAL;
+    }
+
+    /* Render every sheet as palette indices, building the shared palette
+       from the glyph pixels along the way */
+    uint16_t palette[16] = { 0 };
+    int ncolors = 1;
+    uint8_t *canvas = calloc( num_sheets, SHEET_WIDTH * SHEET_HEIGHT );
+
+    if( canvas == NULL )
+    {
+        return -ENOMEM;
+    }
+
+    for( int i = 0; i < num_glyphs; i++ )
+    {
+        glyph_t *g = &glyphs[i];
+
+        if( g->width == 0 || g->height == 0 || g->page >= num_pages )
+        {
+            continue;
+        }
+
+        uint8_t *sheet = canvas + g->sheet * SHEET_WIDTH * SHEET_HEIGHT;
+
+        for( int y = 0; y < g->height; y++ )
+        {
+            for( int x = 0; x < g->width; x++ )
+            {
+                uint8_t *px = &pages[g->page][((g->y + y) * page_width[g->page] + g->x + x) * 4];
+                int index = palette_index( palette, &ncolors, pack_rgba16( px ) );
+
+                if( index < 0 )
+                {
+                    fprintf( stderr, "Font uses more than 15 colors beside transparency; reduce the colors of the page images\n" );
+                    free( canvas );
+                    return -EINVAL;
+                }
+
+                sheet[(g->sy + y) * SHEET_WIDTH + g->sx + x] = index;
+            }
+        }
+    }
+
+    /* Trim each sheet to the rows it actually uses */
+    int sheet_height[MAX_SHEETS] = { 0 };
+
+    for( int i = 0; i < num_glyphs; i++ )
+    {
+        glyph_t *g = &glyphs[i];
+
+        if( g->width && g->height )
+        {
+            sheet_height[g->sheet] = MAX( sheet_height[g->sheet], g->sy + g->height );
+        }
+    }
+
+    qsort( kerns, num_kerns, sizeof( kern_t ), compare_kerns );
+
+    /* Lay the file out: header, glyph table, kerning table, then the
+       sheet sprites aligned to 8 bytes for the RDP */
+    uint32_t header_size = 4 + 6 + 2 + 16 * 2 + MAX_SHEETS * 4;
+    uint32_t kerns_off = header_size + num_chars * 8;
+    uint32_t sheets_off = (kerns_off + num_kerns * 4 + 7) & ~7;
+    uint32_t sheet_offset[MAX_SHEETS] = { 0 };
+    uint32_t off = sheets_off;
+
+    for( int i = 0; i < num_sheets; i++ )
+    {
+        sheet_offset[i] = off;
+        off = (off + 8 + (SHEET_WIDTH / 2) * sheet_height[i] + 7) & ~7;
+    }
+
+    FILE *op;
+
+    if( (op = fopen( output, "wb" )) == NULL )
+    {
+        fprintf( stderr, "Cannot open %s for writing!\n", output );
+        free( canvas );
+        return -ENOENT;
+    }
+
+    /* Header */
+    fwrite( "FNT1", 1, 4, op );
+    fputc( first_char, op );
+    fputc( num_chars, op );
+    fputc( num_sheets, op );
+    fputc( line_height, op );
+    fputc( baseline, op );
+    fputc( 0, op );
+    fwrite_u16( op, num_kerns );
+
+    for( int i = 0; i < 16; i++ )
+    {
+        fwrite_u16( op, palette[i] );
+    }
+
+    for( int i = 0; i < MAX_SHEETS; i++ )
+    {
+        fwrite_u32( op, sheet_offset[i] );
+    }
+
+    /* Glyph table; codes without a glyph stay zeroed */
+    for( int c = first_char; c <= last_char; c++ )
+    {
+        glyph_t *g = NULL;
+
+        for( int i = 0; i < num_glyphs; i++ )
+        {
+            if( glyphs[i].id == c )
+            {
+                g = &glyphs[i];
+                break;
+            }
+        }
+
+        fputc( g ? g->sheet : 0, op );
+        fputc( g ? g->sx : 0, op );
+        fputc( g ? g->sy : 0, op );
+        fputc( g ? g->width : 0, op );
+        fputc( g ? g->height : 0, op );
+        fputc( g ? (int8_t)g->xofs : 0, op );
+        fputc( g ? (int8_t)g->yofs : 0, op );
+        fputc( g ? (int8_t)g->xadvance : 0, op );
+    }
+
+    /* Kerning table */
+    for( int i = 0; i < num_kerns; i++ )
+    {
+        fputc( kerns[i].first, op );
+        fputc( kerns[i].second, op );
+        fputc( (int8_t)kerns[i].amount, op );
+        fputc( 0, op );
+    }
+
+    /* Sheet sprites: regular CI4 sprites sharing the header palette */
+    for( int i = 0; i < num_sheets; i++ )
+    {
+        while( ftell( op ) < sheet_offset[i] )
+        {
+            fputc( 0, op );
+        }
+
+        fwrite_u16( op, SHEET_WIDTH );
+        fwrite_u16( op, sheet_height[i] );
+        fputc( 1, op );
+        fputc( FORMAT_CI4 | FORMAT_SHARED_PALETTE, op );
+        fputc( 1, op );
+        fputc( 1, op );
+
+        uint8_t *sheet = canvas + i * SHEET_WIDTH * SHEET_HEIGHT;
+
+        for( int y = 0; y < sheet_height[i]; y++ )
+        {
+            for( int x = 0; x < SHEET_WIDTH; x += 2 )
+            {
+                fputc( (sheet[y * SHEET_WIDTH + x] << 4) | sheet[y * SHEET_WIDTH + x + 1], op );
+            }
+        }
+    }
+
+    fclose( op );
+    free( canvas );
+
+    for( int i = 0; i < num_pages; i++ )
+    {
+        free( pages[i] );
+    }
+
+    fprintf( stderr, "Compiled %d glyphs and %d kerning pairs into %d sheets (%d colors)\n",
+        num_glyphs, num_kerns, num_sheets, ncolors );
+
+    return 0;
+}
@@ -4,13 +4,23 @@
 #include <string.h>
 #include <errno.h>
 #include <png.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/param.h>
 
+#define BITDEPTH_4BPP       4
 #define BITDEPTH_16BPP      16
 #define BITDEPTH_32BPP      32
 
 #define FORMAT_UNCOMPRESSED 0
+#define FORMAT_TMEM_SWIZZLED 1
+#define FORMAT_MIPMAPPED 2
+#define FORMAT_CI4 4
+#define FORMAT_SHARED_PALETTE 8
+#define FORMAT_ALPHA_SPANS 16
+
+/* RDP texture memory size; pre-swizzled sprites must fit it whole */
+#define TMEM_SIZE 4096
 
 #if BYTE_ORDER == BIG_ENDIAN
 #define SWAP_WORD(x) (x)
@@ -18,23 +28,126 @@
 #define SWAP_WORD(x) ((((x)>>8) & 0x00FF) | (((x)<<8) & 0xFF00))
 #endif
 
-void write_value( uint8_t *colorbuf, FILE *fp, int bitdepth )
+void pack_value( uint8_t *colorbuf, uint8_t *out, int bitdepth )
 {
     if( bitdepth == BITDEPTH_16BPP )
     {
-        uint16_t out = SWAP_WORD((((colorbuf[0] >> 3) & 0x1F) << 11) | (((colorbuf[1] >> 3) & 0x1F) << 6) |
+        uint16_t val = SWAP_WORD((((colorbuf[0] >> 3) & 0x1F) << 11) | (((colorbuf[1] >> 3) & 0x1F) << 6) |
                        (((colorbuf[2] >> 3) & 0x1F) << 1) | (colorbuf[3] >> 7));
 
-        fwrite( &out, 1, 2, fp );
+        memcpy( out, &val, 2 );
+    }
+    else
+    {
+        /* Just copy out */
+        memcpy( out, colorbuf, 4 );
+    }
+}
+
+#define SPAN_OP_SKIP  0
+#define SPAN_OP_COPY  1
+#define SPAN_OP_BLEND 2
+
+/* Accumulator for the transparency span metadata (FORMAT_ALPHA_SPANS).
+   Each entry holds an opcode in the top two bits and a run length in the
+   low 14; a row is flushed when it ends, so its entries always add up to
+   exactly the image width. */
+typedef struct
+{
+    uint16_t *entries;
+    int count;
+    int capacity;
+    int cur_op;
+    int cur_len;
+} span_build_t;
+
+void span_flush( span_build_t *sb )
+{
+    if( sb->cur_len == 0 )
+    {
+        return;
+    }
+
+    if( sb->count == sb->capacity )
+    {
+        sb->capacity = sb->capacity ? sb->capacity * 2 : 256;
+        sb->entries = realloc( sb->entries, sb->capacity * sizeof( uint16_t ) );
+    }
+
+    sb->entries[sb->count++] = (sb->cur_op << 14) | sb->cur_len;
+    sb->cur_len = 0;
+}
+
+void span_pixel( span_build_t *sb, uint8_t alpha, int depth )
+{
+    int op;
+
+    /* 16-bit sprites keep a single alpha bit, so a pixel is either skipped
+       or copied; only 32-bit sprites have a translucent class */
+    if( depth == BITDEPTH_16BPP )
+    {
+        op = (alpha >> 7) ? SPAN_OP_COPY : SPAN_OP_SKIP;
     }
     else
     {
-        /* Just write out */
-        fwrite( colorbuf, 1, 4, fp );
+        op = (alpha == 0) ? SPAN_OP_SKIP : (alpha == 255) ? SPAN_OP_COPY : SPAN_OP_BLEND;
+    }
+
+    if( op != sb->cur_op || sb->cur_len == 0x3FFF )
+    {
+        span_flush( sb );
+    }
+
+    sb->cur_op = op;
+    sb->cur_len++;
+}
+
+void write_row( uint8_t *rowbuf, int rowbytes, int swizzle_row, FILE *fp )
+{
+    if( swizzle_row )
+    {
+        /* Swap the 32-bit halves of every 64-bit word.  This is the interleave
+           the RDP applies to odd lines when loading textures into TMEM; doing
+           it here lets the runtime load the sprite with a raw block transfer. */
+        for( int i = 0; i < rowbytes; i += 8 )
+        {
+            uint8_t tmp[4];
+
+            memcpy( tmp, &rowbuf[i], 4 );
+            memcpy( &rowbuf[i], &rowbuf[i + 4], 4 );
+            memcpy( &rowbuf[i + 4], tmp, 4 );
+        }
+    }
+
+    fwrite( rowbuf, 1, rowbytes, fp );
+}
+
+/* Box-filter an RGBA8 image down to half size (odd dimensions clamp the
+   right/bottom sample, dimensions never go below one pixel) */
+void downsample_rgba( uint8_t *src, int sw, int sh, uint8_t *dst, int dw, int dh )
+{
+    for( int y = 0; y < dh; y++ )
+    {
+        int y0 = y * 2;
+        int y1 = MIN( y0 + 1, sh - 1 );
+
+        for( int x = 0; x < dw; x++ )
+        {
+            int x0 = x * 2;
+            int x1 = MIN( x0 + 1, sw - 1 );
+
+            for( int c = 0; c < 4; c++ )
+            {
+                int sum = src[(y0 * sw + x0) * 4 + c] + src[(y0 * sw + x1) * 4 + c] +
+                          src[(y1 * sw + x0) * 4 + c] + src[(y1 * sw + x1) * 4 + c];
+
+                dst[(y * dw + x) * 4 + c] = (sum + 2) / 4;
+            }
+        }
     }
 }
 
-int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslices )
+int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslices, int swizzle, int mipmap, int spans )
 {
     png_structp png_ptr;
     png_infop info_ptr;
@@ -44,6 +157,7 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
     uint16_t wval16;
     FILE *fp;
     FILE *op;
+    span_build_t sb = { 0 };
     int err = 0;
 
     /* Open file descriptors for read and write */
@@ -94,6 +208,39 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
     png_read_info(png_ptr, info_ptr);
     png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
 
+    int pixbytes = (depth == BITDEPTH_32BPP) ? 4 : 2;
+
+    /* Mipmap levels are loaded individually with regular tile loads and the
+       chain layout does not survive the block-transfer interleave */
+    if( swizzle && mipmap )
+    {
+        fprintf(stderr, "Mipmapped sprites cannot be pre-swizzled, not swizzling!\n");
+        swizzle = 0;
+    }
+
+    /* Pre-swizzled sprites are loaded into TMEM with one raw block transfer,
+       which requires whole 64-bit words per row and the sprite fitting TMEM */
+    if( swizzle && ((width * pixbytes) % 8) )
+    {
+        fprintf(stderr, "Rows are not a multiple of 64 bits, not swizzling!\n");
+        swizzle = 0;
+    }
+
+    if( swizzle && (width > 256 || height > 256 || (width * height * pixbytes) > TMEM_SIZE) )
+    {
+        fprintf(stderr, "Image does not fit in TMEM whole, not swizzling!\n");
+        swizzle = 0;
+    }
+
+    /* The software blitters find the span metadata right after the base
+       image, which a mipmap chain would occupy, and cannot draw swizzled
+       sprites in the first place */
+    if( spans && (swizzle || mipmap) )
+    {
+        fprintf(stderr, "Pre-swizzled or mipmapped sprites cannot carry span metadata, dropping spans!\n");
+        spans = 0;
+    }
+
     /* Write sprite header widht and height */
     wval16 = SWAP_WORD((uint16_t)width);
     fwrite( &wval16, sizeof( wval16 ), 1, op );
@@ -101,11 +248,12 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
     fwrite( &wval16, sizeof( wval16 ), 1, op );
 
     /* Bitdepth */
-    wval8 = (depth == BITDEPTH_32BPP) ? 4 : 2;
+    wval8 = pixbytes;
     fwrite( &wval8, sizeof( wval8 ), 1, op );
 
     /* Format */
-    wval8 = FORMAT_UNCOMPRESSED;
+    wval8 = (swizzle ? FORMAT_TMEM_SWIZZLED : FORMAT_UNCOMPRESSED) | (mipmap ? FORMAT_MIPMAPPED : 0) |
+        (spans ? FORMAT_ALPHA_SPANS : 0);
     fwrite( &wval8, sizeof( wval8 ), 1, op );
 
     /* Horizontal and vertical slices */
@@ -163,6 +311,17 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
         /* Now it's time to read the image. */
         png_read_image(png_ptr, row_pointers);
 
+        /* Row staging buffer so odd rows can be swizzled before writing */
+        uint8_t *rowbuf = malloc( width * pixbytes );
+
+        if( rowbuf == NULL )
+        {
+            fprintf(stderr, "Unable to allocate space for row buffer!\n");
+
+            err = -ENOMEM;
+            goto exitmem;
+        }
+
         /* Translate out to sprite format */
         switch( color_type )
         {
@@ -181,8 +340,20 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
                         buf[2] = row_pointers[j][(i * 3) + 2];
                         buf[3] = 255;
 
-                        write_value( buf, op, depth );
+                        pack_value( buf, &rowbuf[i * pixbytes], depth );
+
+                        if( spans )
+                        {
+                            span_pixel( &sb, buf[3], depth );
+                        }
+                    }
+
+                    if( spans )
+                    {
+                        span_flush( &sb );
                     }
+
+                    write_row( rowbuf, width * pixbytes, swizzle && (j & 1), op );
                 }
 
                 break;
@@ -192,13 +363,92 @@ int read_png( char *png_file, char *spr_file, int depth, int hslices, int vslice
                 {
                     for( int col = 0; col < width; col++ )
                     {
-                        write_value( &row_pointers[row][col * 4], op, depth );
+                        pack_value( &row_pointers[row][col * 4], &rowbuf[col * pixbytes], depth );
+
+                        if( spans )
+                        {
+                            span_pixel( &sb, row_pointers[row][(col * 4) + 3], depth );
+                        }
+                    }
+
+                    if( spans )
+                    {
+                        span_flush( &sb );
                     }
+
+                    write_row( rowbuf, width * pixbytes, swizzle && (row & 1), op );
                 }
 
                 break;
         }
 
+        /* Append the mipmap chain: box filter the image down level by level
+           (never below 1x1), packing each level right after the previous one */
+        if( mipmap )
+        {
+            int channels = (color_type == PNG_COLOR_TYPE_RGB) ? 3 : 4;
+            int lw = width, lh = height;
+            uint8_t *level = malloc( width * height * 4 );
+
+            if( level == NULL )
+            {
+                fprintf(stderr, "Unable to allocate space for mipmap level!\n");
+
+                free( rowbuf );
+                err = -ENOMEM;
+                goto exitmem;
+            }
+
+            /* Gather the decoded rows into one RGBA8 buffer to filter from */
+            for( int j = 0; j < height; j++ )
+            {
+                for( int i = 0; i < width; i++ )
+                {
+                    memcpy( &level[(j * width + i) * 4], &row_pointers[j][i * channels], channels );
+
+                    if( channels == 3 )
+                    {
+                        level[(j * width + i) * 4 + 3] = 255;
+                    }
+                }
+            }
+
+            while( lw > 1 || lh > 1 )
+            {
+                int nw = (lw > 1) ? lw / 2 : 1;
+                int nh = (lh > 1) ? lh / 2 : 1;
+
+                /* Filter in place; the destination never overlaps the source reads */
+                downsample_rgba( level, lw, lh, level, nw, nh );
+                lw = nw;
+                lh = nh;
+
+                for( int j = 0; j < lh; j++ )
+                {
+                    for( int i = 0; i < lw; i++ )
+                    {
+                        pack_value( &level[(j * lw + i) * 4], &rowbuf[i * pixbytes], depth );
+                    }
+
+                    write_row( rowbuf, lw * pixbytes, 0, op );
+                }
+            }
+
+            free( level );
+        }
+
+        /* Append the span metadata as big-endian entries */
+        if( spans )
+        {
+            for( int i = 0; i < sb.count; i++ )
+            {
+                wval16 = SWAP_WORD( sb.entries[i] );
+                fwrite( &wval16, sizeof( wval16 ), 1, op );
+            }
+        }
+
+        free( rowbuf );
+
 exitmem:
         /* Free the row pointers memory */
         for( int row = 0; row < height; row++ )
@@ -211,6 +461,8 @@ exitmem:
         }
     }
 
+    free( sb.entries );
+
 exitpng:
     /* Clean up after the read, and free any memory allocated */
     png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
@@ -223,54 +475,1033 @@ exitfiles:
     return err;
 }
 
-void print_args( char * name )
+/* Decode a PNG into a plain RGBA8 buffer (caller frees), applying the same
+   transforms as the converter.  Used by the analysis mode. */
+int load_png_rgba( char *png_file, uint8_t **out, int *out_width, int *out_height )
 {
-    fprintf( stderr, "Usage: %s <bit depth> [<horizontal slices> <vertical slices>] <input png> <output file>\n", name );
-    fprintf( stderr, "\t<bit depth> should be 16 or 32.\n" );
-    fprintf( stderr, "\t<horizontal slices> should be a number two or greater signifying how many images are in this spritemap horizontally.\n" );
-    fprintf( stderr, "\t<vertical slices> should be a number two or greater signifying how many images are in this spritemap vertically.\n" );
-    fprintf( stderr, "\t<input png> should be any valid PNG file.\n" );
-    fprintf( stderr, "\t<output file> will be written in binary for inclusion using DragonFS.\n" );
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_uint_32 width, height;
+    int bit_depth, color_type, interlace_type;
+    FILE *fp;
+    uint8_t *rgba = NULL;
+
+    if ((fp = fopen(png_file, "rb")) == NULL)
+    {
+        return -ENOENT;
+    }
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info_ptr = png_ptr ? png_create_info_struct( png_ptr ) : NULL;
+
+    if (info_ptr == NULL || setjmp(png_jmpbuf(png_ptr)))
+    {
+        free( rgba );
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -EINTR;
+    }
+
+    png_init_io(png_ptr, fp);
+    png_read_info(png_ptr, info_ptr);
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+
+    if(color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png_ptr);
+    if(color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
+    if(bit_depth == 16)
+        png_set_strip_16(png_ptr);
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_set_tRNS_to_alpha(png_ptr);
+    if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png_ptr);
+
+    /* Pad out a missing alpha channel so the output is always RGBA8 */
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    rgba = malloc( width * height * 4 );
+
+    if( rgba == NULL )
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+        fclose(fp);
+
+        return -ENOMEM;
+    }
+
+    {
+        png_bytep row_pointers[height];
+
+        for( int row = 0; row < height; row++ )
+        {
+            row_pointers[row] = rgba + row * width * 4;
+        }
+
+        png_read_image(png_ptr, row_pointers);
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    fclose(fp);
+
+    *out = rgba;
+    *out_width = width;
+    *out_height = height;
+
+    return 0;
 }
 
-int main( int argc, char *argv[] )
+/* Pack an RGBA8 color to a host-order RGBA16 (5551) value */
+uint16_t pack_rgba16( uint8_t *rgba )
 {
-    int bitdepth;
+    return (((rgba[0] >> 3) & 0x1F) << 11) | (((rgba[1] >> 3) & 0x1F) << 6) |
+           (((rgba[2] >> 3) & 0x1F) << 1) | (rgba[3] >> 7);
+}
 
-    if( argc != 4 && argc != 6 )
+/* Sort a slice of RGBA8 pixels by one channel with a counting sort.  Keeps
+   the quantizer free of qsort comparator state so batch workers can run it
+   concurrently. */
+void sort_by_channel( uint8_t *pixels, long count, int channel )
+{
+    long hist[257] = { 0 };
+    uint8_t *tmp = malloc( count * 4 );
+
+    if( tmp == NULL )
     {
-        print_args( argv[0] );
-        return -EINVAL;
+        return;
     }
 
-    /* Covert bitdepth argument */
-    bitdepth = atoi( argv[1] );
+    for( long i = 0; i < count; i++ )
+    {
+        hist[pixels[i * 4 + channel] + 1]++;
+    }
 
-    if( bitdepth == 32 )
+    for( int v = 1; v <= 256; v++ )
     {
-        bitdepth = BITDEPTH_32BPP;
+        hist[v] += hist[v - 1];
     }
-    else if( bitdepth == 16 )
+
+    for( long i = 0; i < count; i++ )
     {
-        bitdepth = BITDEPTH_16BPP;
+        memcpy( &tmp[hist[pixels[i * 4 + channel]]++ * 4], &pixels[i * 4], 4 );
     }
-    else
+
+    memcpy( pixels, tmp, count * 4 );
+    free( tmp );
+}
+
+/* Median-cut an RGBA8 pixel pool down to at most 16 RGBA16 palette entries.
+   The pool is reordered in place.  Returns the number of colors produced. */
+int build_palette( uint8_t *pixels, long count, uint16_t palette[16] )
+{
+    struct { long start; long count; } box[16];
+    int nboxes = 1;
+
+    box[0].start = 0;
+    box[0].count = count;
+
+    while( nboxes < 16 )
     {
-        print_args( argv[0] );
-        return -EINVAL;
+        /* Pick the box and channel with the widest spread of values */
+        int best_box = -1, best_channel = 0, best_range = 0;
+
+        for( int b = 0; b < nboxes; b++ )
+        {
+            if( box[b].count < 2 )
+            {
+                continue;
+            }
+
+            int cmin[4] = { 255, 255, 255, 255 };
+            int cmax[4] = { 0, 0, 0, 0 };
+
+            for( long i = box[b].start; i < box[b].start + box[b].count; i++ )
+            {
+                for( int c = 0; c < 4; c++ )
+                {
+                    int v = pixels[i * 4 + c];
+
+                    if( v < cmin[c] ) { cmin[c] = v; }
+                    if( v > cmax[c] ) { cmax[c] = v; }
+                }
+            }
+
+            for( int c = 0; c < 4; c++ )
+            {
+                if( cmax[c] - cmin[c] > best_range )
+                {
+                    best_range = cmax[c] - cmin[c];
+                    best_box = b;
+                    best_channel = c;
+                }
+            }
+        }
+
+        /* Every remaining box holds a single color; no more cuts possible */
+        if( best_box < 0 )
+        {
+            break;
+        }
+
+        /* Cut the box at its population median along that channel */
+        sort_by_channel( &pixels[box[best_box].start * 4], box[best_box].count, best_channel );
+
+        long half = box[best_box].count / 2;
+
+        box[nboxes].start = box[best_box].start + half;
+        box[nboxes].count = box[best_box].count - half;
+        box[best_box].count = half;
+        nboxes++;
     }
 
-    if( argc == 4 )
+    /* Each palette entry is the average color of its box */
+    memset( palette, 0, 16 * sizeof( uint16_t ) );
+
+    for( int b = 0; b < nboxes; b++ )
     {
-        /* Translate, return result */
-        return read_png( argv[2], argv[3], bitdepth, 1, 1 );
+        long sum[4] = { 0, 0, 0, 0 };
+        uint8_t avg[4];
+
+        for( long i = box[b].start; i < box[b].start + box[b].count; i++ )
+        {
+            for( int c = 0; c < 4; c++ )
+            {
+                sum[c] += pixels[i * 4 + c];
+            }
+        }
+
+        for( int c = 0; c < 4; c++ )
+        {
+            avg[c] = box[b].count ? (sum[c] + box[b].count / 2) / box[b].count : 0;
+        }
+
+        palette[b] = pack_rgba16( avg );
     }
-    else
+
+    return nboxes;
+}
+
+/* Find the palette entry closest to a color, measured in the 5-bit space the
+   entries live in.  An alpha bit mismatch dominates any color distance. */
+int nearest_color( uint16_t *palette, int ncolors, uint8_t *rgba )
+{
+    int best = 0;
+    long best_dist = -1;
+
+    for( int i = 0; i < ncolors; i++ )
     {
-        int hslices = atoi( argv[2] );
-        int vslices = atoi( argv[3] );
+        int er = (rgba[0] >> 3) - ((palette[i] >> 11) & 0x1F);
+        int eg = (rgba[1] >> 3) - ((palette[i] >> 6) & 0x1F);
+        int eb = (rgba[2] >> 3) - ((palette[i] >> 1) & 0x1F);
+        long dist = er * er + eg * eg + eb * eb;
 
-        /* Translate, return result */
-        return read_png( argv[4], argv[5], bitdepth, hslices, vslices );
+        if( (rgba[3] >> 7) != (palette[i] & 1) )
+        {
+            dist += 10000;
+        }
+
+        if( best_dist < 0 || dist < best_dist )
+        {
+            best_dist = dist;
+            best = i;
+        }
+    }
+
+    return best;
+}
+
+/* Read a shared palette file (16 big-endian RGBA16 entries) into host order */
+int load_palette_file( char *pal_file, uint16_t palette[16] )
+{
+    FILE *fp;
+    uint16_t raw[16];
+
+    if( (fp = fopen( pal_file, "rb" )) == NULL )
+    {
+        return -ENOENT;
+    }
+
+    if( fread( raw, sizeof( uint16_t ), 16, fp ) != 16 )
+    {
+        fclose( fp );
+        return -EINVAL;
     }
+
+    fclose( fp );
+
+    for( int i = 0; i < 16; i++ )
+    {
+        palette[i] = SWAP_WORD( raw[i] );
+    }
+
+    return 0;
+}
+
+/* Convert a PNG to a CI4 sprite: two 4-bit palette indices per byte, first
+   pixel of each pair in the high nibble.  With a shared palette the sprite
+   embeds nothing and the runtime expects the group palette to be loaded
+   once with rdp_load_palette; otherwise a per-image palette is quantized
+   and appended after the pixel data. */
+int convert_ci4( char *png_file, char *spr_file, int hslices, int vslices, uint16_t *shared_pal )
+{
+    uint8_t *rgba;
+    int width, height;
+    uint8_t wval8;
+    uint16_t wval16;
+    int err = load_png_rgba( png_file, &rgba, &width, &height );
+
+    if( err )
+    {
+        fprintf( stderr, "%s: cannot read PNG (%d)\n", png_file, err );
+        return err;
+    }
+
+    /* Two pixels per byte: rows must pack to whole bytes */
+    if( width & 1 )
+    {
+        fprintf( stderr, "%s: CI4 sprites must have an even width!\n", png_file );
+        free( rgba );
+
+        return -EINVAL;
+    }
+
+    uint16_t palette[16];
+    int ncolors = 16;
+
+    if( shared_pal )
+    {
+        memcpy( palette, shared_pal, sizeof( palette ) );
+    }
+    else
+    {
+        /* The median cut reorders its pool, so quantize a scratch copy and
+           keep the image intact for the index pass below */
+        uint8_t *pool = malloc( (long)width * height * 4 );
+
+        if( pool == NULL )
+        {
+            free( rgba );
+
+            return -ENOMEM;
+        }
+
+        memcpy( pool, rgba, (long)width * height * 4 );
+        ncolors = build_palette( pool, (long)width * height, palette );
+        free( pool );
+    }
+
+    FILE *op;
+
+    if( (op = fopen( spr_file, "wb" )) == NULL )
+    {
+        free( rgba );
+
+        return -ENOENT;
+    }
+
+    /* Write sprite header width and height */
+    wval16 = SWAP_WORD((uint16_t)width);
+    fwrite( &wval16, sizeof( wval16 ), 1, op );
+    wval16 = SWAP_WORD((uint16_t)height);
+    fwrite( &wval16, sizeof( wval16 ), 1, op );
+
+    /* Bitdepth; CI4 sprites store 1 and pack two pixels per byte */
+    wval8 = 1;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+
+    /* Format */
+    wval8 = FORMAT_CI4 | (shared_pal ? FORMAT_SHARED_PALETTE : 0);
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+
+    /* Horizontal and vertical slices */
+    wval8 = hslices;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+    wval8 = vslices;
+    fwrite( &wval8, sizeof( wval8 ), 1, op );
+
+    uint8_t *rowbuf = malloc( width / 2 );
+
+    if( rowbuf == NULL )
+    {
+        fclose( op );
+        free( rgba );
+
+        return -ENOMEM;
+    }
+
+    for( int row = 0; row < height; row++ )
+    {
+        for( int col = 0; col < width; col += 2 )
+        {
+            int i0 = nearest_color( palette, ncolors, &rgba[((long)row * width + col) * 4] );
+            int i1 = nearest_color( palette, ncolors, &rgba[((long)row * width + col + 1) * 4] );
+
+            rowbuf[col / 2] = (i0 << 4) | i1;
+        }
+
+        fwrite( rowbuf, 1, width / 2, op );
+    }
+
+    free( rowbuf );
+
+    /* Self-contained sprites append their palette after the pixel data */
+    if( !shared_pal )
+    {
+        for( int i = 0; i < 16; i++ )
+        {
+            wval16 = SWAP_WORD( palette[i] );
+            fwrite( &wval16, sizeof( wval16 ), 1, op );
+        }
+    }
+
+    fclose( op );
+    free( rgba );
+
+    return 0;
+}
+
+/* Build one optimized shared palette from a set of PNGs and write it as 16
+   big-endian RGBA16 entries, for later use with --palette */
+int make_palette( char *pal_file, char **png_files, int count )
+{
+    uint8_t *pool = NULL;
+    long total = 0;
+
+    for( int i = 0; i < count; i++ )
+    {
+        uint8_t *rgba;
+        int width, height;
+        int err = load_png_rgba( png_files[i], &rgba, &width, &height );
+
+        if( err )
+        {
+            fprintf( stderr, "%s: cannot read PNG (%d)\n", png_files[i], err );
+            free( pool );
+
+            return err;
+        }
+
+        uint8_t *grown = realloc( pool, (total + (long)width * height) * 4 );
+
+        if( grown == NULL )
+        {
+            free( rgba );
+            free( pool );
+
+            return -ENOMEM;
+        }
+
+        pool = grown;
+        memcpy( pool + total * 4, rgba, (long)width * height * 4 );
+        total += (long)width * height;
+        free( rgba );
+    }
+
+    uint16_t palette[16];
+    int ncolors = build_palette( pool, total, palette );
+
+    free( pool );
+
+    FILE *op;
+
+    if( (op = fopen( pal_file, "wb" )) == NULL )
+    {
+        fprintf( stderr, "Cannot open palette file %s for writing!\n", pal_file );
+
+        return -ENOENT;
+    }
+
+    for( int i = 0; i < 16; i++ )
+    {
+        uint16_t wval16 = SWAP_WORD( palette[i] );
+        fwrite( &wval16, sizeof( wval16 ), 1, op );
+    }
+
+    fclose( op );
+
+    fprintf( stderr, "Built a %d color shared palette from %d images\n", ncolors, count );
+
+    return 0;
+}
+
+/* Compare two packed RGBA32 values for qsort */
+int compare_u32( const void *a, const void *b )
+{
+    uint32_t va, vb;
+
+    memcpy( &va, a, 4 );
+    memcpy( &vb, b, 4 );
+
+    return (va > vb) - (va < vb);
+}
+
+/* Total sprite data bytes for an image with a full mipmap chain */
+long mipmap_chain_bytes( int width, int height, int pixbytes )
+{
+    long bytes = 0;
+
+    for( ;; )
+    {
+        bytes += (long)width * height * pixbytes;
+
+        if( width == 1 && height == 1 )
+        {
+            break;
+        }
+
+        width = (width > 1) ? width / 2 : 1;
+        height = (height > 1) ? height / 2 : 1;
+    }
+
+    return bytes;
+}
+
+/* Report, per input, the cheapest format within the error bound and whether
+   the result fits TMEM.  Purely advisory: nothing is converted. */
+int analyze_png( char *png_file, double error_bound )
+{
+    uint8_t *rgba;
+    int width, height;
+    int err = load_png_rgba( png_file, &rgba, &width, &height );
+
+    if( err )
+    {
+        fprintf( stderr, "%s: cannot read PNG (%d)\n", png_file, err );
+        return err;
+    }
+
+    size_t npixels = (size_t)width * height;
+
+    /* RGBA16 stores 5 bits per color channel and a 1-bit alpha.  Measure the
+       real round-trip error of this image instead of assuming the worst. */
+    long color_error_sum = 0;
+    long semi_transparent = 0;
+
+    for( size_t i = 0; i < npixels; i++ )
+    {
+        for( int c = 0; c < 3; c++ )
+        {
+            int v = rgba[i * 4 + c];
+            int recon = ((v >> 3) << 3) | (v >> 5);
+
+            color_error_sum += (v > recon) ? v - recon : recon - v;
+        }
+
+        int a = rgba[i * 4 + 3];
+
+        if( a > 7 && a < 248 )
+        {
+            semi_transparent++;
+        }
+    }
+
+    double mean_error = (double)color_error_sum / (npixels * 3);
+    double semi_percent = 100.0 * semi_transparent / npixels;
+
+    /* Count unique colors to judge how well a palette would fit */
+    uint32_t *colors = malloc( npixels * 4 );
+    long unique = 0;
+
+    if( colors )
+    {
+        memcpy( colors, rgba, npixels * 4 );
+        qsort( colors, npixels, 4, compare_u32 );
+
+        for( size_t i = 0; i < npixels; i++ )
+        {
+            if( i == 0 || colors[i] != colors[i - 1] )
+            {
+                unique++;
+            }
+        }
+
+        free( colors );
+    }
+
+    /* RGBA16 is the cheapest format the sprite runtime supports; it loses if
+       the image needs blended alpha or exceeds the color error bound */
+    int pick32 = (semi_percent > 1.0) || (mean_error > error_bound);
+    int pixbytes = pick32 ? 4 : 2;
+
+    printf( "%s: %dx%d, %ld unique colors\n", png_file, width, height, unique );
+    printf( "  RGBA16 round-trip: mean color error %.2f/255, %.1f%% semi-transparent pixels\n",
+        mean_error, semi_percent );
+    printf( "  recommended format: %s (error bound %.1f)\n", pick32 ? "32 (RGBA32)" : "16 (RGBA16)", error_bound );
+
+    long bytes = (long)npixels * pixbytes;
+    long mip_bytes = mipmap_chain_bytes( width, height, pixbytes );
+
+    printf( "  TMEM: %ld bytes whole (%s), largest mip level fitting: ", bytes,
+        bytes <= TMEM_SIZE ? "fits" : "needs slicing" );
+
+    int lw = width, lh = height, level = 0;
+    while( (long)lw * lh * pixbytes > TMEM_SIZE && (lw > 1 || lh > 1) )
+    {
+        lw = (lw > 1) ? lw / 2 : 1;
+        lh = (lh > 1) ? lh / 2 : 1;
+        level++;
+    }
+    printf( "level %d (%dx%d); full chain %ld bytes in ROM\n", level, lw, lh, mip_bytes );
+
+    if( unique <= 16 )
+    {
+        printf( "  note: %ld unique colors fit CI4 exactly (convert with bit depth 4)\n", unique );
+    }
+    else if( unique <= 256 )
+    {
+        printf( "  note: %ld unique colors would fit CI8, not supported by the sprite runtime\n", unique );
+    }
+
+    free( rgba );
+
+    return 0;
+}
+
+/* One conversion from the batch manifest */
+typedef struct
+{
+    char *png_file;
+    char *spr_file;
+    int depth;
+    int hslices;
+    int vslices;
+    int swizzle;
+    int mipmap;
+    int spans;
+    char *palette_file;
+} batch_job_t;
+
+static batch_job_t *batch_jobs = NULL;
+static int batch_job_count = 0;
+static int batch_next_job = 0;
+static int batch_errors = 0;
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Parse one manifest line (same syntax as the command line arguments) into
+   a job.  The line is tokenized in place; file names are duplicated. */
+int parse_job( char *line, batch_job_t *job, int lineno, int def_swizzle, int def_mipmap, int def_spans, char *def_palette )
+{
+    char *tokens[12];
+    int ntok = 0;
+
+    for( char *tok = strtok( line, " \t\r\n" ); tok && ntok < 12; tok = strtok( NULL, " \t\r\n" ) )
+    {
+        tokens[ntok++] = tok;
+    }
+
+    int idx = 0;
+
+    job->swizzle = def_swizzle;
+    job->mipmap = def_mipmap;
+    job->spans = def_spans;
+    job->palette_file = def_palette ? strdup( def_palette ) : NULL;
+
+    while( idx < ntok )
+    {
+        if( strcmp( tokens[idx], "--swizzle" ) == 0 )
+        {
+            job->swizzle = 1;
+            idx++;
+        }
+        else if( strcmp( tokens[idx], "--mipmap" ) == 0 )
+        {
+            job->mipmap = 1;
+            idx++;
+        }
+        else if( strcmp( tokens[idx], "--spans" ) == 0 )
+        {
+            job->spans = 1;
+            idx++;
+        }
+        else if( strcmp( tokens[idx], "--palette" ) == 0 && idx + 1 < ntok )
+        {
+            free( job->palette_file );
+            job->palette_file = strdup( tokens[idx + 1] );
+            idx += 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( ntok - idx != 3 && ntok - idx != 5 )
+    {
+        fprintf( stderr, "Manifest line %d: expected [--swizzle] [--spans] [--palette <file>] <bit depth> [<h slices> <v slices>] <input png> <output file>\n", lineno );
+        return -EINVAL;
+    }
+
+    int bitdepth = atoi( tokens[idx] );
+
+    if( bitdepth != 4 && bitdepth != 16 && bitdepth != 32 )
+    {
+        fprintf( stderr, "Manifest line %d: invalid bit depth %s\n", lineno, tokens[idx] );
+        return -EINVAL;
+    }
+
+    job->depth = bitdepth;
+
+    if( ntok - idx == 5 )
+    {
+        job->hslices = atoi( tokens[idx + 1] );
+        job->vslices = atoi( tokens[idx + 2] );
+        idx += 2;
+    }
+    else
+    {
+        job->hslices = 1;
+        job->vslices = 1;
+    }
+
+    job->png_file = strdup( tokens[idx + 1] );
+    job->spr_file = strdup( tokens[idx + 2] );
+
+    return 0;
+}
+
+/* Worker thread: pull jobs off the shared queue until it runs dry.  Each
+   conversion only touches its own libpng instance and scratch buffers, so
+   workers share nothing but the queue index and the error counter. */
+void *batch_worker( void *arg )
+{
+    for( ;; )
+    {
+        pthread_mutex_lock( &batch_lock );
+        int i = batch_next_job++;
+        pthread_mutex_unlock( &batch_lock );
+
+        if( i >= batch_job_count )
+        {
+            break;
+        }
+
+        batch_job_t *job = &batch_jobs[i];
+        int err;
+
+        if( job->depth == BITDEPTH_4BPP )
+        {
+            uint16_t palette[16];
+            uint16_t *pal = NULL;
+
+            err = 0;
+
+            if( job->palette_file )
+            {
+                err = load_palette_file( job->palette_file, palette );
+
+                if( err )
+                {
+                    fprintf( stderr, "%s: cannot read palette %s (%d)\n", job->png_file, job->palette_file, err );
+                }
+
+                pal = palette;
+            }
+
+            if( !err )
+            {
+                err = convert_ci4( job->png_file, job->spr_file, job->hslices, job->vslices, pal );
+            }
+        }
+        else
+        {
+            err = read_png( job->png_file, job->spr_file, job->depth, job->hslices, job->vslices, job->swizzle, job->mipmap, job->spans );
+        }
+
+        if( err )
+        {
+            fprintf( stderr, "%s: conversion failed (%d)\n", job->png_file, err );
+
+            pthread_mutex_lock( &batch_lock );
+            batch_errors++;
+            pthread_mutex_unlock( &batch_lock );
+        }
+    }
+
+    return NULL;
+}
+
+int run_batch( char *manifest, int num_threads, int def_swizzle, int def_mipmap, int def_spans, char *def_palette )
+{
+    FILE *fp;
+    char line[1024];
+    int lineno = 0;
+    int capacity = 0;
+
+    if( (fp = fopen( manifest, "r" )) == NULL )
+    {
+        fprintf( stderr, "Cannot open manifest %s!\n", manifest );
+        return -ENOENT;
+    }
+
+    while( fgets( line, sizeof( line ), fp ) )
+    {
+        lineno++;
+
+        /* Skip blank lines and comments */
+        char *p = line + strspn( line, " \t\r\n" );
+        if( *p == 0 || *p == '#' )
+        {
+            continue;
+        }
+
+        if( batch_job_count == capacity )
+        {
+            capacity = capacity ? capacity * 2 : 64;
+            batch_jobs = realloc( batch_jobs, capacity * sizeof( batch_job_t ) );
+        }
+
+        if( parse_job( p, &batch_jobs[batch_job_count], lineno, def_swizzle, def_mipmap, def_spans, def_palette ) )
+        {
+            fclose( fp );
+            return -EINVAL;
+        }
+
+        batch_job_count++;
+    }
+
+    fclose( fp );
+
+    if( num_threads < 1 )
+    {
+        num_threads = 1;
+    }
+
+    if( num_threads > batch_job_count )
+    {
+        num_threads = batch_job_count;
+    }
+
+    pthread_t threads[num_threads];
+
+    for( int i = 0; i < num_threads; i++ )
+    {
+        pthread_create( &threads[i], NULL, batch_worker, NULL );
+    }
+
+    for( int i = 0; i < num_threads; i++ )
+    {
+        pthread_join( threads[i], NULL );
+    }
+
+    fprintf( stderr, "Converted %d of %d sprites\n", batch_job_count - batch_errors, batch_job_count );
+
+    return batch_errors ? -EINTR : 0;
+}
+
+void print_args( char * name )
+{
+    fprintf( stderr, "Usage: %s [--swizzle] [--mipmap] [--spans] [--palette <file>] <bit depth> [<horizontal slices> <vertical slices>] <input png> <output file>\n", name );
+    fprintf( stderr, "       %s [--swizzle] [--mipmap] [--spans] [--palette <file>] [-j <threads>] --batch <manifest>\n", name );
+    fprintf( stderr, "       %s --make-palette <output palette> <input png>...\n", name );
+    fprintf( stderr, "       %s --analyze [-e <error bound>] <input png>...\n", name );
+    fprintf( stderr, "\t--swizzle emits the sprite pre-swizzled for direct TMEM block loads. The sprite must fit TMEM whole and cannot be drawn with the software blitters.\n" );
+    fprintf( stderr, "\t--mipmap appends a box-filtered mipmap chain after the base image, loadable per level with rdp_load_texture_mipmap.\n" );
+    fprintf( stderr, "\t--spans appends per-row transparency run lengths after the image, letting graphics_draw_sprite_trans skip transparent areas and fast-copy opaque ones. Cannot be combined with --swizzle or --mipmap.\n" );
+    fprintf( stderr, "\t--palette quantizes CI4 sprites against the given shared palette instead of a per-image one. The sprite embeds no palette; load the group palette once with rdp_load_palette before drawing.\n" );
+    fprintf( stderr, "\t--make-palette converts nothing: it builds one optimized 16-color palette from every input and writes it for later use with --palette.\n" );
+    fprintf( stderr, "\t--batch converts every sprite listed in <manifest>, one per line with the same syntax as the command line ('#' starts a comment). Leading --swizzle/--mipmap/--palette apply to all lines.\n" );
+    fprintf( stderr, "\t-j spreads the batch over the given number of worker threads.\n" );
+    fprintf( stderr, "\t--analyze converts nothing: it reports per input the cheapest format within the error bound (-e, mean per-channel error out of 255, default 3.0) and whether the result fits TMEM.\n" );
+    fprintf( stderr, "\t<bit depth> should be 4 (CI4, quantized to a 16 color palette), 16 or 32.\n" );
+    fprintf( stderr, "\t<horizontal slices> should be a number two or greater signifying how many images are in this spritemap horizontally.\n" );
+    fprintf( stderr, "\t<vertical slices> should be a number two or greater signifying how many images are in this spritemap vertically.\n" );
+    fprintf( stderr, "\t<input png> should be any valid PNG file.\n" );
+    fprintf( stderr, "\t<output file> will be written in binary for inclusion using DragonFS.\n" );
+}
+
+int main( int argc, char *argv[] )
+{
+    int bitdepth;
+    int swizzle = 0;
+    int mipmap = 0;
+    int spans = 0;
+    int analyze = 0;
+    double error_bound = 3.0;
+    int num_threads = 1;
+    char *manifest = NULL;
+    char *palette_file = NULL;
+    char *makepal_file = NULL;
+
+    while( argc > 1 )
+    {
+        if( strcmp( argv[1], "--swizzle" ) == 0 )
+        {
+            swizzle = 1;
+            argv++;
+            argc--;
+        }
+        else if( strcmp( argv[1], "--mipmap" ) == 0 )
+        {
+            mipmap = 1;
+            argv++;
+            argc--;
+        }
+        else if( strcmp( argv[1], "--spans" ) == 0 )
+        {
+            spans = 1;
+            argv++;
+            argc--;
+        }
+        else if( strcmp( argv[1], "--analyze" ) == 0 )
+        {
+            analyze = 1;
+            argv++;
+            argc--;
+        }
+        else if( strcmp( argv[1], "-e" ) == 0 && argc > 2 )
+        {
+            error_bound = atof( argv[2] );
+            argv += 2;
+            argc -= 2;
+        }
+        else if( strcmp( argv[1], "-j" ) == 0 && argc > 2 )
+        {
+            num_threads = atoi( argv[2] );
+            argv += 2;
+            argc -= 2;
+        }
+        else if( strcmp( argv[1], "--batch" ) == 0 && argc > 2 )
+        {
+            manifest = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else if( strcmp( argv[1], "--palette" ) == 0 && argc > 2 )
+        {
+            palette_file = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else if( strcmp( argv[1], "--make-palette" ) == 0 && argc > 2 )
+        {
+            makepal_file = argv[2];
+            argv += 2;
+            argc -= 2;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if( analyze )
+    {
+        if( argc < 2 )
+        {
+            print_args( argv[0] );
+            return -EINVAL;
+        }
+
+        /* Analyze every input, return the first error */
+        int err = 0;
+
+        for( int i = 1; i < argc; i++ )
+        {
+            int r = analyze_png( argv[i], error_bound );
+
+            if( r && !err )
+            {
+                err = r;
+            }
+        }
+
+        return err;
+    }
+
+    if( makepal_file )
+    {
+        if( argc < 2 )
+        {
+            print_args( argv[0] );
+            return -EINVAL;
+        }
+
+        /* Build the shared palette, return result */
+        return make_palette( makepal_file, &argv[1], argc - 1 );
+    }
+
+    if( manifest )
+    {
+        if( argc != 1 )
+        {
+            print_args( argv[0] );
+            return -EINVAL;
+        }
+
+        /* Convert the whole manifest, return result */
+        return run_batch( manifest, num_threads, swizzle, mipmap, spans, palette_file );
+    }
+
+    if( argc != 4 && argc != 6 )
+    {
+        print_args( argv[0] );
+        return -EINVAL;
+    }
+
+    /* Covert bitdepth argument */
+    bitdepth = atoi( argv[1] );
+
+    if( bitdepth == 32 )
+    {
+        bitdepth = BITDEPTH_32BPP;
+    }
+    else if( bitdepth == 16 )
+    {
+        bitdepth = BITDEPTH_16BPP;
+    }
+    else if( bitdepth == 4 )
+    {
+        bitdepth = BITDEPTH_4BPP;
+    }
+    else
+    {
+        print_args( argv[0] );
+        return -EINVAL;
+    }
+
+    int hslices = 1;
+    int vslices = 1;
+    char *png_file = argv[2];
+    char *spr_file = argv[3];
+
+    if( argc == 6 )
+    {
+        hslices = atoi( argv[2] );
+        vslices = atoi( argv[3] );
+        png_file = argv[4];
+        spr_file = argv[5];
+    }
+
+    if( bitdepth == BITDEPTH_4BPP )
+    {
+        uint16_t palette[16];
+        uint16_t *pal = NULL;
+
+        if( swizzle || mipmap || spans )
+        {
+            fprintf( stderr, "CI4 sprites cannot be pre-swizzled, mipmapped or carry span metadata, ignoring!\n" );
+        }
+
+        if( palette_file )
+        {
+            int err = load_palette_file( palette_file, palette );
+
+            if( err )
+            {
+                fprintf( stderr, "Cannot read palette %s (%d)!\n", palette_file, err );
+                return err;
+            }
+
+            pal = palette;
+        }
+
+        /* Translate, return result */
+        return convert_ci4( png_file, spr_file, hslices, vslices, pal );
+    }
+
+    /* Translate, return result */
+    return read_png( png_file, spr_file, bitdepth, hslices, vslices, swizzle, mipmap, spans );
 }
@@ -0,0 +1,135 @@
+/*
+ * IPL3 bootcode checksum core, shared by chksum64 and n64tool.
+ *
+ * The checksum algorithm (reverse engineered by Andreas Sterbenz out of
+ * Nagra's program) is a serial recurrence: every word updates six running
+ * registers that feed into the next word, with data-dependent branches and
+ * a data-dependent rotate, so the chain itself cannot be parallelized.
+ * What can be done in parallel is the byte-order conversion of the input
+ * (ROMs are big-endian, optionally with the V64 16-bit byte swap on top):
+ * the words are converted a batch at a time with SSE2 or NEON where
+ * available, and the scalar chain then consumes ready-made words instead
+ * of assembling each one from four byte loads.
+ */
+
+#ifndef N64CHECKSUM_H
+#define N64CHECKSUM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define N64_CHECKSUM_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define N64_CHECKSUM_NEON 1
+#endif
+#endif
+
+#define N64_CHECKSUM_STARTVALUE  0xf8ca4ddc
+
+/** Running state of the bootcode checksum */
+typedef struct {
+	uint32_t t1, t2, t3, t4, t5, t6;
+} n64_checksum_t;
+
+static inline void n64_checksum_init(n64_checksum_t * chk)
+{
+	chk->t1 = chk->t2 = chk->t3 = chk->t4 = chk->t5 = chk->t6 =
+		N64_CHECKSUM_STARTVALUE;
+}
+
+/* Convert nwords 32-bit words from ROM byte order to host values.
+   swapped selects the V64 format, where each 16-bit pair is byte-swapped. */
+static inline void n64_checksum_convert(uint32_t * dst, const uint8_t * src,
+	int nwords, int swapped)
+{
+	int i = 0;
+
+#ifdef N64_CHECKSUM_SSE2
+	for(; i + 4 <= nwords; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+
+		if(!swapped)
+		{
+			/* bswap32: swap bytes within 16-bit lanes, then the lanes */
+			v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		}
+		v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+
+		_mm_storeu_si128((__m128i *)(dst + i), v);
+	}
+#elif defined(N64_CHECKSUM_NEON)
+	for(; i + 4 <= nwords; i += 4)
+	{
+		uint8x16_t v = vld1q_u8(src + i * 4);
+
+		if(!swapped)
+			v = vrev32q_u8(v);
+		else
+			v = vreinterpretq_u8_u16(vrev32q_u16(vreinterpretq_u16_u8(v)));
+
+		vst1q_u8((uint8_t *)(dst + i), v);
+	}
+#endif
+
+	for(; i < nwords; i++)
+	{
+		const uint8_t *b = src + i * 4;
+
+		dst[i] = ((uint32_t)b[0 ^ swapped] << 24) | ((uint32_t)b[1 ^ swapped] << 16) |
+		         ((uint32_t)b[2 ^ swapped] <<  8) |  (uint32_t)b[3 ^ swapped];
+	}
+}
+
+/* Feed len bytes (a multiple of 4) of ROM data into the checksum */
+static inline void n64_checksum_data(n64_checksum_t * chk, const uint8_t * data,
+	size_t len, int swapped)
+{
+	uint32_t words[1024];
+	uint32_t c1, k1, k2;
+	uint32_t t1 = chk->t1, t2 = chk->t2, t3 = chk->t3;
+	uint32_t t4 = chk->t4, t5 = chk->t5, t6 = chk->t6;
+
+	while(len > 0)
+	{
+		int nwords = len / 4 < 1024 ? len / 4 : 1024;
+
+		n64_checksum_convert(words, data, nwords, swapped);
+
+		for(int i = 0; i < nwords; i++)
+		{
+			c1 = words[i];
+			k1 = t6 + c1;
+			if(k1 < t6) t4++;
+			t6 = k1;
+			t3 ^= c1;
+			k2 = c1 & 0x1f;
+			k1 = (c1 << k2) | (c1 >> ((32 - k2) & 31));
+			t5 += k1;
+			if(c1 < t2)
+				t2 ^= k1;
+			else
+				t2 ^= t6 ^ c1;
+			t1 += c1 ^ t5;
+		}
+
+		data += nwords * 4;
+		len -= nwords * 4;
+	}
+
+	chk->t1 = t1; chk->t2 = t2; chk->t3 = t3;
+	chk->t4 = t4; chk->t5 = t5; chk->t6 = t6;
+}
+
+static inline void n64_checksum_final(const n64_checksum_t * chk,
+	uint32_t * sum1, uint32_t * sum2)
+{
+	*sum1 = chk->t6 ^ chk->t4 ^ chk->t3;
+	*sum2 = chk->t5 ^ chk->t2 ^ chk->t1;
+}
+
+#endif
@@ -0,0 +1,248 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#define STBDS_NO_SHORT_NAMES
+#define STB_DS_IMPLEMENTATION
+#include "common/stb_ds.h"
+
+#include "common/polyfill.h"
+#include "common/utils.h"
+
+bool flag_verbose = false;
+int flag_budget = 16*1024;      // VR4300 I-cache size
+float flag_min_pct = 0.5f;      // minimum sample share to qualify as hot
+const char *n64_inst = NULL;
+
+// Printf if verbose
+void verbose(const char *fmt, ...) {
+    if (flag_verbose) {
+        va_list args;
+        va_start(args, fmt);
+        vprintf(fmt, args);
+        va_end(args);
+    }
+}
+
+void usage(const char *progname)
+{
+    fprintf(stderr, "%s - Turn CPU profiler samples into a hot-code linker order file\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Usage: %s [flags] <program.elf> <capture.log> [<hotorder.ld>]\n", progname);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -v/--verbose          Verbose output\n");
+    fprintf(stderr, "   -b/--budget <KiB>     Size budget of the hot region (default: 16,\n");
+    fprintf(stderr, "                         the VR4300 instruction cache size)\n");
+    fprintf(stderr, "   -m/--min-pct <pct>    Minimum sample share for a function to be\n");
+    fprintf(stderr, "                         placed in the hot region (default: 0.5)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "<capture.log> is a debug log captured from the console (eg: via USB)\n");
+    fprintf(stderr, "containing one or more profiler_dump_raw() blocks (the text between\n");
+    fprintf(stderr, "PROFILER-RAW-BEGIN / PROFILER-RAW-END markers); everything else in the\n");
+    fprintf(stderr, "log is ignored. The output file lists the sampled functions in\n");
+    fprintf(stderr, "decreasing hotness as linker input-section patterns, and is picked up\n");
+    fprintf(stderr, "by n64.ld (INCLUDE hotorder.ld) when placed in the project directory,\n");
+    fprintf(stderr, "so the next build lays those functions out contiguously at the start\n");
+    fprintf(stderr, "of the text segment. Rebuild, re-profile, re-run to keep the layout\n");
+    fprintf(stderr, "in sync with the code.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "This program requires a libdragon toolchain installed in $N64_INST.\n");
+}
+
+struct funcsym_s {
+    uint32_t addr;
+    uint32_t size;
+    char *name;
+    uint32_t hits;
+};
+struct funcsym_s *funcs = NULL;
+
+// Load the function symbols of the ELF, sorted by address, via nm.
+void symbols_load(const char *elf)
+{
+    char *cmd = NULL;
+    asprintf(&cmd, "%s/bin/mips64-elf-nm -n -S --defined-only %s", n64_inst, elf);
+    verbose("Running: %s\n", cmd);
+
+    FILE *nm = popen(cmd, "r");
+    if (!nm) {
+        fprintf(stderr, "Error: cannot run: %s\n", cmd);
+        exit(1);
+    }
+
+    char *line = NULL; size_t line_size = 0;
+    while (getline(&line, &line_size, nm) >= 0) {
+        uint32_t addr, size; char type; char name[1024];
+        // Functions without a recorded size cannot be matched against
+        // sampled PCs nor fit in the budget; skip them (with
+        // -ffunction-sections, all C/C++ functions do have one).
+        if (sscanf(line, "%x %x %c %1023s", &addr, &size, &type, name) != 4)
+            continue;
+        if (type != 't' && type != 'T')
+            continue;
+        stbds_arrput(funcs, ((struct funcsym_s) {
+            .addr = addr, .size = size, .name = strdup(name),
+        }));
+    }
+    free(line);
+    pclose(nm);
+
+    if (stbds_arrlen(funcs) == 0) {
+        fprintf(stderr, "Error: no function symbols found in %s\n", elf);
+        exit(1);
+    }
+    verbose("Loaded %d function symbols\n", (int)stbds_arrlen(funcs));
+}
+
+// Find the function containing the given PC (or NULL).
+struct funcsym_s *symbols_find(uint32_t pc)
+{
+    int lo = 0, hi = stbds_arrlen(funcs)-1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (funcs[mid].addr <= pc) lo = mid;
+        else hi = mid-1;
+    }
+    if (funcs[lo].addr <= pc && pc < funcs[lo].addr + funcs[lo].size)
+        return &funcs[lo];
+    return NULL;
+}
+
+// Parse the raw sample blocks out of the captured log, attributing each
+// sampled PC to its function. Returns the total number of samples attributed.
+uint32_t samples_load(const char *logfn)
+{
+    FILE *log = fopen(logfn, "rb");
+    if (!log) {
+        fprintf(stderr, "Error: cannot open: %s\n", logfn);
+        exit(1);
+    }
+
+    uint32_t total = 0; int blocks = 0; bool in_block = false;
+    char *line = NULL; size_t line_size = 0;
+    while (getline(&line, &line_size, log) >= 0) {
+        if (strstr(line, "PROFILER-RAW-BEGIN")) { in_block = true; blocks++; continue; }
+        if (strstr(line, "PROFILER-RAW-END"))   { in_block = false; continue; }
+        if (!in_block) continue;
+        for (char *tok = strtok(line, " \r\n"); tok; tok = strtok(NULL, " \r\n")) {
+            uint32_t pc = strtoul(tok, NULL, 16);
+            if (!pc) continue;
+            struct funcsym_s *f = symbols_find(pc);
+            if (f) f->hits++;
+            total++;
+        }
+    }
+    free(line);
+    fclose(log);
+
+    if (blocks == 0) {
+        fprintf(stderr, "Error: no PROFILER-RAW-BEGIN block found in %s\n", logfn);
+        fprintf(stderr, "Capture the debug log while calling profiler_dump_raw()\n");
+        exit(1);
+    }
+    verbose("Parsed %d raw block(s), %d samples\n", blocks, (int)total);
+    return total;
+}
+
+int cmp_hits(const void *a_, const void *b_)
+{
+    const struct funcsym_s *a = a_, *b = b_;
+    if (a->hits != b->hits) return (a->hits < b->hits) ? 1 : -1;
+    return strcmp(a->name, b->name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *infn_elf = NULL, *infn_log = NULL, *outfn = "hotorder.ld";
+
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+                flag_verbose = true;
+            } else if (!strcmp(argv[i], "-b") || !strcmp(argv[i], "--budget")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                flag_budget = atoi(argv[i]) * 1024;
+            } else if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--min-pct")) {
+                if (++i == argc) {
+                    fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                    return 1;
+                }
+                flag_min_pct = atof(argv[i]);
+            } else {
+                fprintf(stderr, "invalid flag: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!infn_elf) {
+            infn_elf = argv[i];
+        } else if (!infn_log) {
+            infn_log = argv[i];
+        } else {
+            outfn = argv[i];
+        }
+    }
+    if (!infn_elf || !infn_log) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    n64_inst = n64_toolchain_dir();
+    if (!n64_inst) {
+        fprintf(stderr, "Error: N64_INST environment variable not set\n");
+        return 1;
+    }
+
+    symbols_load(infn_elf);
+    uint32_t total = samples_load(infn_log);
+    if (!total) {
+        fprintf(stderr, "Error: no samples in %s\n", infn_log);
+        return 1;
+    }
+
+    qsort(funcs, stbds_arrlen(funcs), sizeof(struct funcsym_s), cmp_hits);
+
+    FILE *out = fopen(outfn, "w");
+    if (!out) {
+        fprintf(stderr, "Error: cannot create: %s\n", outfn);
+        return 1;
+    }
+    fprintf(out, "/* Hot function order generated by n64hotorder -- do not edit.\n");
+    fprintf(out, " * Source: %s (%u samples)\n", infn_log, total);
+    fprintf(out, " * Included by n64.ld inside the hot text region; delete this file\n");
+    fprintf(out, " * (or re-run n64hotorder after profiling) to change the layout.\n");
+    fprintf(out, " */\n");
+
+    uint32_t hot_size = 0, hot_hits = 0; int placed = 0;
+    for (int i = 0; i < stbds_arrlen(funcs); i++) {
+        struct funcsym_s *f = &funcs[i];
+        float pct = 100.0f * f->hits / total;
+        if (pct < flag_min_pct) break;
+        // Functions are 32-byte aligned in the text segment (n64.mk builds
+        // with -falign-functions=32), so account the padded size
+        uint32_t size = (f->size + 31) & ~31u;
+        if (hot_size + size > (uint32_t)flag_budget) {
+            verbose("Budget full, dropping %s (%5.1f%%, %u bytes)\n", f->name, pct, size);
+            continue;
+        }
+        fprintf(out, "*(.text.%s)    /* %5.1f%%  %u bytes */\n", f->name, pct, size);
+        hot_size += size; hot_hits += f->hits; placed++;
+    }
+    fclose(out);
+
+    printf("%s: %d functions, %u/%d bytes, covering %.1f%% of %u samples\n",
+        outfn, placed, hot_size, flag_budget, 100.0f * hot_hits / total, total);
+    return 0;
+}
@@ -28,6 +28,8 @@
 #include <sys/errno.h>
 #endif
 
+#include "n64checksum.h"
+
 #define ROUND_UP(n, d) ({ \
 	typeof(n) _n = n; typeof(d) _d = d; \
 	(((_n) + (_d) - 1) / (_d) * (_d)); \
@@ -71,14 +73,25 @@ size_t __strlcpy(char * restrict dst, const char * restrict src, size_t dstsize)
 #define TOC_ENTRY_SIZE   64
 #define TOC_MAX_ENTRIES  ((TOC_SIZE - 16) / 64)
 
+// IPL3 bootcode checksum parameters. The bootcode checksums the first megabyte
+// of the ROM contents (after the header) and compares it with the value stored
+// at CHECKSUM_HEADERPOS, refusing to boot on mismatch. We compute it inline
+// while assembling the ROM (algorithm from chksum64, originally reverse
+// engineered by Andreas Sterbenz), so no separate checksum pass over the
+// output file is needed.
+#define CHECKSUM_START      0x1000
+#define CHECKSUM_LENGTH     0x100000
+#define CHECKSUM_HEADERPOS  0x10
+#define CHECKSUM_END        (CHECKSUM_START + CHECKSUM_LENGTH)
+
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 #define SWAPLONG(i) (i)
 #else
 #define SWAPLONG(i) (((uint32_t)((i) & 0xFF000000) >> 24) | ((uint32_t)((i) & 0x00FF0000) >>  8) | ((uint32_t)((i) & 0x0000FF00) <<  8) | ((uint32_t)((i) & 0x000000FF) << 24))
 #endif
 
-static const unsigned char zero[1024] = {0};
 static char * tmp_output = NULL;
+static unsigned char * chk_buf = NULL;    // mirror of the first CHECKSUM_END bytes of the ROM
 
 struct toc_s {
 	char magic[4];
@@ -139,6 +152,44 @@ size_t get_file_size(FILE * fp)
 	return end;
 }
 
+/* Write data to the output file, mirroring everything that falls within the
+   checksummed region into chk_buf so that the bootcode checksum can be
+   computed at the end without re-reading the file. All ROM contents must go
+   through this function (including later patches done after seeking back). */
+size_t rom_write(const void * data, size_t size, FILE * dest)
+{
+	size_t pos = ftell(dest);
+
+	if(chk_buf && pos < CHECKSUM_END)
+	{
+		size_t n = size;
+		if(n > CHECKSUM_END - pos)
+			n = CHECKSUM_END - pos;
+		memcpy(chk_buf + pos, data, n);
+	}
+
+	return fwrite(data, 1, size, dest);
+}
+
+/* Compute the IPL3 bootcode checksum over chk_buf and store it in the header
+   mirror, then patch it into the output file. */
+void write_checksum(FILE * dest)
+{
+	n64_checksum_t chk;
+	uint32_t sum1, sum2;
+
+	n64_checksum_init(&chk);
+	n64_checksum_data(&chk, chk_buf + CHECKSUM_START, CHECKSUM_LENGTH, 0);
+	n64_checksum_final(&chk, &sum1, &sum2);
+	uint8_t sums[8] = {
+		sum1 >> 24, sum1 >> 16, sum1 >> 8, sum1,
+		sum2 >> 24, sum2 >> 16, sum2 >> 8, sum2,
+	};
+
+	fseek(dest, CHECKSUM_HEADERPOS, SEEK_SET);
+	rom_write(sums, 8, dest);
+}
+
 ssize_t copy_file(FILE * dest, const char * file)
 {
 	FILE *read_file = fopen(file, "rb");
@@ -173,7 +224,7 @@ ssize_t copy_file(FILE * dest, const char * file)
 		fsize -= write_size;
 
 		fread(buffer, 1, write_size, read_file);
-		fwrite(buffer, 1, write_size, dest);
+		rom_write(buffer, write_size, dest);
 	}
 
 	free(buffer);
@@ -190,13 +241,17 @@ ssize_t output_zeros(FILE * dest, ssize_t amount)
 		return -1;
 	}
 
-	int i;
-	while (amount > 0) {
-		int sz = amount;
-		if (sz > sizeof(zero))
-			sz = sizeof(zero);
-		fwrite(zero, 1, sz, dest);
-		amount -= sz;
+	if(amount > 0)
+	{
+		/* Seek over the gap instead of physically writing filler: on
+		   filesystems with sparse file support the padding costs nothing,
+		   elsewhere the zeros get materialized lazily. Write the last byte
+		   explicitly so that the file always extends to the padded size,
+		   even when nothing else is written after us. (chk_buf needs no
+		   update: it is zero-initialized.) */
+		fseek(dest, amount - 1, SEEK_CUR);
+		static const unsigned char zero = 0;
+		fwrite(&zero, 1, 1, dest);
 	}
 
 	return 0;
@@ -492,6 +547,17 @@ int main(int argc, char *argv[])
 			/* Try to clean up the temporary file if we exit */
 			atexit(remove_tmp_file);
 
+			/* Mirror of the checksummed region, used to compute the bootcode
+			   checksum without re-reading the output file. Zero-initialized so
+			   that sparse padding is accounted for automatically. */
+			chk_buf = calloc(1, CHECKSUM_END);
+
+			if(!chk_buf)
+			{
+				fprintf(stderr, "ERROR: Out of memory!\n");
+				return STATUS_ERROR;
+			}
+
 			/* Copy over the ROM header */
 			ssize_t bytes_copied = copy_file(write_file, header);
 
@@ -599,7 +665,7 @@ int main(int argc, char *argv[])
 
 	/* Set title in header */
 	fseek(write_file, TITLE_OFFSET, SEEK_SET);
-	fwrite(title, 1, TITLE_SIZE, write_file);
+	rom_write(title, TITLE_SIZE, write_file);
 
 	/* Write table of contents */
 	if(create_toc)
@@ -611,9 +677,12 @@ int main(int argc, char *argv[])
 		toc.entry_size = SWAPLONG(toc.entry_size);
 
 		fseek(write_file, toc_offset, SEEK_SET);
-		fwrite(&toc, 1, TOC_SIZE, write_file);
+		rom_write(&toc, TOC_SIZE, write_file);
 	}
 
+	/* Compute the bootcode checksum and patch it into the header */
+	write_checksum(write_file);
+
 	/* Sync and close the output file */
 	fclose(write_file);
 
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "common/subprocess.h"
+#include "common/polyfill.h"
+
+// n64tune - host-side client for the libdragon live tuning service.
+//
+// The target registers tunable variables (see tunables.h) and answers
+// text commands of the form "tune list" / "tune get <name>" /
+// "tune set <name> <value>", prefixing every reply line with "tune: ".
+// This tool drives UNFLoader in basic debug mode as the USB transport:
+// it types the command on UNFLoader's stdin and picks the "tune: "
+// reply lines out of the console output stream.
+
+bool flag_verbose = false;
+const char *flag_unfloader = NULL;
+
+struct subprocess_s unf_subp;
+FILE *unf_w = NULL, *unf_r = NULL;
+
+void print_args(char *name)
+{
+    fprintf(stderr, "%s - Tune libdragon variables on a running console\n", name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Usage: %s [flags] [command]\n", name);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Commands:\n");
+    fprintf(stderr, "   list                    List all tunables with their current values\n");
+    fprintf(stderr, "   get <name>              Read one tunable\n");
+    fprintf(stderr, "   set <name> <value>      Change one tunable\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "With no command, an interactive session is started that accepts the\n");
+    fprintf(stderr, "same commands from stdin (plus \"quit\").\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Command-line flags:\n");
+    fprintf(stderr, "   -v/--verbose            Also show non-tuning console output\n");
+    fprintf(stderr, "   -u/--unfloader <path>   UNFLoader executable to use as transport\n");
+    fprintf(stderr, "                           (default: UNFLoader, or the N64_UNFLOADER\n");
+    fprintf(stderr, "                           environment variable)\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "The console must be running a program that called tunables_init and\n");
+    fprintf(stderr, "polls tunables_poll.\n");
+}
+
+// Spawn UNFLoader in basic (non-curses) debug mode and keep both pipe
+// ends open: stdin to type commands, stdout to read console output.
+bool transport_open(void)
+{
+    const char *unfloader = flag_unfloader;
+    if (!unfloader) unfloader = getenv("N64_UNFLOADER");
+    if (!unfloader) unfloader = "UNFLoader";
+
+    const char *cmd[8] = {0}; int i = 0;
+    cmd[i++] = unfloader;
+    cmd[i++] = "-b";
+    cmd[i++] = "-d";
+
+    if (subprocess_create(cmd, subprocess_option_no_window, &unf_subp) != 0) {
+        fprintf(stderr, "Error: cannot run: %s\n", unfloader);
+        fprintf(stderr, "Use -u or N64_UNFLOADER to point to the UNFLoader executable\n");
+        return false;
+    }
+    unf_w = subprocess_stdin(&unf_subp);
+    unf_r = subprocess_stdout(&unf_subp);
+    return true;
+}
+
+void transport_close(void)
+{
+    if (unf_r)
+        subprocess_terminate(&unf_subp);
+    unf_w = unf_r = NULL;
+}
+
+// Send one command and print its reply lines. A "list" is terminated by
+// the "tune: ." end marker, the other commands by their single reply
+// line. Returns false if the transport died, or if the target answered
+// with an error (which is still printed).
+bool command_run(const char *cmd)
+{
+    char *line_buf = NULL; size_t line_buf_size = 0;
+    bool is_list = strcmp(cmd, "list") == 0;
+    bool ok = true;
+
+    fprintf(unf_w, "tune %s\n", cmd);
+    fflush(unf_w);
+
+    while (getline(&line_buf, &line_buf_size, unf_r) != -1) {
+        line_buf[strcspn(line_buf, "\r\n")] = 0;
+
+        // Console output that is not a tuning reply shares the channel
+        // (regular debugf spew); show it only when asked to
+        char *reply = strstr(line_buf, "tune: ");
+        if (!reply) {
+            if (flag_verbose && line_buf[0])
+                fprintf(stderr, "%s\n", line_buf);
+            continue;
+        }
+        reply += strlen("tune: ");
+
+        if (is_list && strcmp(reply, ".") == 0)
+            break;
+        if (strncmp(reply, "err ", 4) == 0) {
+            fprintf(stderr, "Error: %s\n", reply + 4);
+            ok = false;
+        } else {
+            printf("%s\n", reply);
+        }
+        if (!is_list)
+            break;
+    }
+    free(line_buf);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+            print_args(argv[0]);
+            return 0;
+        } else if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+            flag_verbose = true;
+        } else if (!strcmp(argv[i], "-u") || !strcmp(argv[i], "--unfloader")) {
+            if (++i == argc) {
+                fprintf(stderr, "missing argument for %s\n", argv[i-1]);
+                return 1;
+            }
+            flag_unfloader = argv[i];
+        } else {
+            fprintf(stderr, "invalid flag: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // Assemble the command from the remaining arguments
+    char cmd[256] = {0};
+    for (int j = i; j < argc; j++) {
+        if (strlen(cmd) + strlen(argv[j]) + 2 > sizeof(cmd)) {
+            fprintf(stderr, "command too long\n");
+            return 1;
+        }
+        if (cmd[0]) strcat(cmd, " ");
+        strcat(cmd, argv[j]);
+    }
+
+    if (!transport_open())
+        return 1;
+
+    int res = 0;
+    if (cmd[0]) {
+        // One-shot mode
+        res = command_run(cmd) ? 0 : 1;
+    } else {
+        // Interactive mode
+        char *line_buf = NULL; size_t line_buf_size = 0;
+        fprintf(stderr, "Connected; commands: list, get <name>, set <name> <value>, quit\n");
+        while (fprintf(stderr, "> "), getline(&line_buf, &line_buf_size, stdin) != -1) {
+            line_buf[strcspn(line_buf, "\r\n")] = 0;
+            if (!line_buf[0])
+                continue;
+            if (!strcmp(line_buf, "quit") || !strcmp(line_buf, "exit"))
+                break;
+            command_run(line_buf);
+        }
+        free(line_buf);
+    }
+
+    transport_close();
+    return res;
+}
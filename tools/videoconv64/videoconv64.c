@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#ifndef __MINGW32__
+#include <unistd.h>
+#endif
+
+#include "video64internal.h"
+
+bool flag_verbose = false;
+bool flag_force = false;
+
+/** Conversions that failed so far */
+static int conv_errors = 0;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	#define HOST_TO_BE32(i) (i)
+	#define HOST_TO_BE16(i) (i)
+#else
+	#define HOST_TO_BE32(i) __builtin_bswap32(i)
+	#define HOST_TO_BE16(i) __builtin_bswap16(i)
+#endif
+
+__attribute__((noreturn, format(printf, 1, 2)))
+void fatal(const char *str, ...) {
+	va_list va;
+	va_start(va, str);
+	vfprintf(stderr, str, va);
+	va_end(va);
+	exit(1);
+}
+
+/************************************************************************************
+ *  CONVERTER
+ ************************************************************************************/
+
+/** Chroma layout of the YUV4MPEG2 input */
+typedef enum {
+	CHROMA_420,
+	CHROMA_422,
+	CHROMA_444,
+} chroma_t;
+
+/**
+ * Convert one YUV4MPEG2 file to VIDEO64.
+ *
+ * The input is the uncompressed interchange format emitted by basically
+ * every video tool (eg: "ffmpeg -i movie.mp4 movie.y4m"): planar YUV
+ * frames preceded by a one-line header. The output is the packed 4:2:2
+ * layout the RDP YUV texture format wants (U Y0 V Y1 macropixels), sliced
+ * in TMEM-sized strips; 4:2:0 input gets its chroma rows duplicated, 4:4:4
+ * input gets its chroma columns averaged in pairs.
+ */
+int vid_convert(const char *infn, const char *outfn) {
+	FILE *in = fopen(infn, "rb");
+	if (!in) {
+		fprintf(stderr, "ERROR: cannot open: %s\n", infn);
+		return 1;
+	}
+
+	char line[1024];
+	if (!fgets(line, sizeof(line), in) || strncmp(line, "YUV4MPEG2", 9) != 0) {
+		fprintf(stderr, "ERROR: %s: not a YUV4MPEG2 file\n", infn);
+		fclose(in);
+		return 1;
+	}
+
+	// Parse the stream header tags. Interlaced sources must be deinterlaced
+	// beforehand (eg: with the ffmpeg "yadif" filter).
+	int width = 0, height = 0, fps_num = 30, fps_den = 1;
+	chroma_t chroma = CHROMA_420;
+	char *tok = strtok(line, " \n");
+	while ((tok = strtok(NULL, " \n"))) {
+		switch (tok[0]) {
+		case 'W': width = atoi(tok+1); break;
+		case 'H': height = atoi(tok+1); break;
+		case 'F': sscanf(tok+1, "%d:%d", &fps_num, &fps_den); break;
+		case 'I':
+			if (tok[1] != 'p') {
+				fprintf(stderr, "ERROR: %s: interlaced input is not supported (deinterlace it first)\n", infn);
+				fclose(in);
+				return 1;
+			}
+			break;
+		case 'C':
+			if (strncmp(tok+1, "420", 3) == 0) chroma = CHROMA_420;
+			else if (strncmp(tok+1, "422", 3) == 0) chroma = CHROMA_422;
+			else if (strncmp(tok+1, "444", 3) == 0) chroma = CHROMA_444;
+			else {
+				fprintf(stderr, "ERROR: %s: unsupported chroma layout: %s\n", infn, tok+1);
+				fclose(in);
+				return 1;
+			}
+			break;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || fps_num <= 0 || fps_den <= 0) {
+		fprintf(stderr, "ERROR: %s: invalid stream header\n", infn);
+		fclose(in);
+		return 1;
+	}
+	if (width % 8 != 0 || (chroma == CHROMA_420 && height % 2 != 0)) {
+		fprintf(stderr, "ERROR: %s: width must be a multiple of 8 (and height even for 4:2:0)\n", infn);
+		fclose(in);
+		return 1;
+	}
+
+	// Strips are RDP tile loads: pick the tallest divisor of the frame
+	// height whose luma plane fits the low half of TMEM (2 KiB).
+	int strip_height = 0;
+	for (int sh = height; sh >= 1; sh--) {
+		if (height % sh == 0 && width * sh <= 2048) {
+			strip_height = sh;
+			break;
+		}
+	}
+	if (!strip_height || width > 2048) {
+		fprintf(stderr, "ERROR: %s: frame too wide for TMEM: %d\n", infn, width);
+		fclose(in);
+		return 1;
+	}
+
+	int cw = (chroma == CHROMA_444) ? width : width/2;
+	int ch = (chroma == CHROMA_420) ? height/2 : height;
+	uint8_t *ybuf = malloc(width * height);
+	uint8_t *ubuf = malloc(cw * ch);
+	uint8_t *vbuf = malloc(cw * ch);
+	uint8_t *row = malloc(width * 2);
+	assert(ybuf && ubuf && vbuf && row);
+
+	FILE *out = fopen(outfn, "wb");
+	if (!out) {
+		fprintf(stderr, "ERROR: cannot create: %s\n", outfn);
+		fclose(in);
+		return 1;
+	}
+
+	// Write a dummy header; it will be rewritten at the end of the
+	// conversion, when the number of frames is known.
+	video64_header_t head;
+	memset(&head, 0, sizeof(head));
+	fwrite(&head, 1, sizeof(head), out);
+
+	int num_frames = 0;
+	while (fgets(line, sizeof(line), in)) {
+		if (strncmp(line, "FRAME", 5) != 0) {
+			fprintf(stderr, "ERROR: %s: malformed frame header\n", infn);
+			conv_errors++;
+			break;
+		}
+		if (fread(ybuf, 1, width * height, in) != width * height ||
+		    fread(ubuf, 1, cw * ch, in) != cw * ch ||
+		    fread(vbuf, 1, cw * ch, in) != cw * ch) {
+			fprintf(stderr, "ERROR: %s: truncated frame %d\n", infn, num_frames);
+			conv_errors++;
+			break;
+		}
+
+		// Pack the planes in U Y0 V Y1 macropixels, row by row. Strips are
+		// full-width row ranges, so raster order is already strip order.
+		for (int y = 0; y < height; y++) {
+			uint8_t *yrow = ybuf + y * width;
+			uint8_t *urow = ubuf + (chroma == CHROMA_420 ? y/2 : y) * cw;
+			uint8_t *vrow = vbuf + (chroma == CHROMA_420 ? y/2 : y) * cw;
+			for (int x = 0; x < width; x += 2) {
+				uint8_t u, v;
+				if (chroma == CHROMA_444) {
+					u = (urow[x] + urow[x+1] + 1) / 2;
+					v = (vrow[x] + vrow[x+1] + 1) / 2;
+				} else {
+					u = urow[x/2];
+					v = vrow[x/2];
+				}
+				row[x*2+0] = u;
+				row[x*2+1] = yrow[x];
+				row[x*2+2] = v;
+				row[x*2+3] = yrow[x+1];
+			}
+			fwrite(row, 1, width * 2, out);
+		}
+		num_frames++;
+	}
+
+	if (flag_verbose)
+		fprintf(stderr, "Converted: %s => %s (%dx%d, %g fps, %d frames)\n",
+			infn, outfn, width, height, (double)fps_num / fps_den, num_frames);
+
+	memcpy(head.id, VIDEO64_ID, 4);
+	head.version = VIDEO64_FILE_VERSION;
+	head.width = HOST_TO_BE16(width);
+	head.height = HOST_TO_BE16(height);
+	head.strip_height = HOST_TO_BE16(strip_height);
+	head.fps_num = HOST_TO_BE32(fps_num);
+	head.fps_den = HOST_TO_BE32(fps_den);
+	head.num_frames = HOST_TO_BE32(num_frames);
+	head.start_offset = HOST_TO_BE32(sizeof(head));
+	fseek(out, 0, SEEK_SET);
+	fwrite(&head, 1, sizeof(head), out);
+
+	fclose(out);
+	fclose(in);
+	free(ybuf); free(ubuf); free(vbuf); free(row);
+	return num_frames > 0 ? 0 : 1;
+}
+
+/************************************************************************************
+ *  MAIN
+ ************************************************************************************/
+
+void usage(void) {
+	printf("videoconv64 -- Video conversion tool for libdragon\n");
+	printf("\n");
+	printf("Usage:\n");
+	printf("   videoconv64 [flags] <file-or-dir> [[flags] <file-or-dir>..]\n");
+	printf("\n");
+	printf("Supported conversions:\n");
+	printf("   * Y4M => VIDEO64 (YUV4MPEG2, eg: ffmpeg -i movie.mp4 movie.y4m)\n");
+	printf("\n");
+	printf("Global options:\n");
+	printf("   -o / --output <dir>       Specify output directory\n");
+	printf("   -v / --verbose            Verbose mode\n");
+	printf("   -f / --force              Convert even if the output is up to date\n");
+	printf("\n");
+}
+
+char* changeext(char* fn, char *ext) {
+	char buf[4096];
+	strcpy(buf, fn);
+	*strrchr(buf, '.') = '\0';
+	strcat(buf, ext);
+	return strdup(buf);
+}
+
+/** True if the output is missing or older than the input */
+bool is_stale(const char *infn, const char *outfn) {
+	struct stat in_st, out_st;
+	if (stat(outfn, &out_st) != 0)
+		return true;
+	if (stat(infn, &in_st) != 0)
+		return true;
+	return in_st.st_mtime >= out_st.st_mtime;
+}
+
+void convert(char *infn, char *outfn1) {
+	char *ext = strrchr(infn, '.');
+	if (!ext) {
+		fprintf(stderr, "unknown file type: %s\n", infn);
+		return;
+	}
+
+	if (strcmp(ext, ".y4m") == 0 || strcmp(ext, ".Y4M") == 0) {
+		char *outfn = changeext(outfn1, ".vid64");
+		if (flag_force || is_stale(infn, outfn)) {
+			if (vid_convert(infn, outfn) != 0)
+				conv_errors++;
+		} else if (flag_verbose) {
+			fprintf(stderr, "Skipping: %s (up to date)\n", outfn);
+		}
+		free(outfn);
+	} else {
+		fprintf(stderr, "WARNING: ignoring unknown file: %s\n", infn);
+	}
+}
+
+bool exists(const char *path) {
+	struct stat st;
+	return stat(path, &st) == 0;
+}
+
+bool isfile(const char *path) {
+	struct stat st;
+	stat(path, &st);
+	return (st.st_mode & S_IFREG) != 0;
+}
+
+bool isdir(const char *path) {
+	struct stat st;
+	stat(path, &st);
+	return (st.st_mode & S_IFDIR) != 0;
+}
+
+void walkdir(char *inpath, char *outpath, void (*func)(char *, char*)) {
+	if (isdir(inpath)) {
+		// We're walking a directory. Make sure there's also a matching
+		// output directory or create it otherwise.
+		if (!isdir(outpath)) {
+			// If there's an obstructing file, exit with an error.
+			if (isfile(outpath)) {
+				fprintf(stderr, "ERROR: %s is a file but should be a directory\n", outpath);
+				return;
+			}
+			#ifndef __MINGW32__
+			mkdir(outpath, 0777);
+			#else
+			mkdir(outpath);
+			#endif
+		}
+		DIR* d = opendir(inpath);
+		struct dirent *de;
+		while ((de = readdir(d))) {
+			if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+				continue;
+			char *inpathsub, *outpathsub;
+			asprintf(&inpathsub, "%s/%s", inpath, de->d_name);
+			asprintf(&outpathsub, "%s/%s", outpath, de->d_name);
+			walkdir(inpathsub, outpathsub, func);
+			free(inpathsub);
+			free(outpathsub);
+		}
+		closedir(d);
+	} else if (isfile(inpath)) {
+		if (isdir(outpath)) {
+			// We support the format "videoconv64 -o <dir> <file>" as special case
+			char *outpathsub;
+			char *basename = strrchr(inpath, '/');
+			if (!basename) basename = inpath;
+			asprintf(&outpathsub, "%s/%s", outpath, basename);
+
+			func(inpath, outpathsub);
+
+			free(outpathsub);
+		} else {
+			func(inpath, outpath);
+		}
+	} else {
+		fprintf(stderr, "WARNING: ignoring special file: %s\n", inpath);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		usage();
+		return 1;
+	}
+
+	char *outdir = ".";
+
+	int i;
+	for (i=1; i<argc; i++) {
+		if (argv[i][0] == '-') {
+			if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--verbose")) {
+				flag_verbose = true;
+			} else if (!strcmp(argv[i], "-f") || !strcmp(argv[i], "--force")) {
+				flag_force = true;
+			} else if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+				if (++i == argc) {
+					fprintf(stderr, "missing argument for -o/--output\n");
+					return 1;
+				}
+				outdir = argv[i];
+			} else {
+				fprintf(stderr, "invalid option: %s\n", argv[i]);
+				return 1;
+			}
+		} else {
+			// Positional argument. It's either a file or a directory. Convert it
+			if (!exists(argv[i])) {
+				fprintf(stderr, "ERROR: file %s does not exist\n", argv[i]);
+			} else {
+				walkdir(argv[i], outdir, convert);
+			}
+		}
+	}
+
+	return conv_errors ? 1 : 0;
+}